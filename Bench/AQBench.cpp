@@ -0,0 +1,848 @@
+//
+//  AQBench.cpp
+//  PlayingAudioExample
+//
+
+/* Times the stages of the buffer-fill path on synthetic input, one case per
+ * stage and per source sample format, with hardware counters where the host
+ * has them; the packet table cases count one packet as a frame. Files given on
+ * the command line are decoded whole, one case per file: .ogg through AQVorbis,
+ * .aac through AQAAC, .flac through AQFLAC and .aqb through AQBlockFile everywhere, anything else on macOS through AQPCMSource the way
+ * HandleOutputBuffer does. On macOS .aac files are decoded through
+ * AudioToolbox as well, for comparison.
+ *
+ * Building with the scalar preset (AQ_SIMD=OFF) and running the same cases
+ * gives the baseline the vector kernels are measured against.
+ *
+ * Usage: AQBench [--frames n] [--passes n] [--no-counters] [file ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AQAAC.h"
+#include "AQBlockFile.h"
+#include "AQChannelMap.h"
+#include "AQCrossfade.h"
+#include "AQEqualizer.h"
+#include "AQFLAC.h"
+#include "AQMDCT.h"
+#include "AQPacketTable.h"
+#include "AQPerfCounters.h"
+#include "AQSampleConvert.h"
+#include "AQSpectrum.h"
+#include "AQVorbis.h"
+
+#ifdef __APPLE__
+#include "AQPlayerState.h"
+#endif
+
+// Frames handed to each stage per call, about what one queue buffer holds
+static const UInt32 kAQBenchBlockFrames = 4096;
+
+static const UInt32 kAQBenchDefaultFrames = 1 << 20;
+static const UInt32 kAQBenchDefaultPasses = 5;
+
+typedef void (*AQBenchFunction)(void * context, UInt32 blockIndex);
+
+struct AQBenchOptions
+{
+	UInt32 mNumFrames;
+	UInt32 mNumPasses;
+	bool mUseCounters;
+};
+
+struct AQBench
+{
+	struct AQBenchOptions mOptions;
+	struct AQPerfCounters mCounters;
+	bool mHasCounters;
+};
+
+static
+void AQBench_PrintHeader(const struct AQBench * bench)
+{
+	printf("%-24s %10s %10s", "case", "ns/frame", "Mframes/s");
+	
+	if (bench->mHasCounters)
+	{
+		printf(" %8s %10s %10s", "IPC", "cmiss/kf", "bmiss/kf");
+	}
+	
+	printf("\n");
+}
+
+// Counts per thousand frames, or n/a when the host could not count the event
+static
+void AQBench_PrintPerKiloFrame(const struct AQPerfSample * sample, AQPerfEvent event, UInt64 numFrames)
+{
+	if (sample->mIsValid[event])
+	{
+		printf(" %10.2f", sample->mCounts[event] * 1000.0 / numFrames);
+	}
+	else
+	{
+		printf(" %10s", "n/a");
+	}
+}
+
+static
+void AQBench_Report(const struct AQBench * bench, const char * name, const struct AQPerfSample * sample, UInt64 numFrames)
+{
+	printf("%-24s %10.3f %10.2f", name, (Float64) sample->mNanos / numFrames, numFrames * 1000.0 / sample->mNanos);
+	
+	if (bench->mHasCounters)
+	{
+		if (sample->mIsValid[kAQPerfEvent_Cycles] && sample->mIsValid[kAQPerfEvent_Instructions] && sample->mCounts[kAQPerfEvent_Cycles] > 0)
+		{
+			printf(" %8.2f", (Float64) sample->mCounts[kAQPerfEvent_Instructions] / sample->mCounts[kAQPerfEvent_Cycles]);
+		}
+		else
+		{
+			printf(" %8s", "n/a");
+		}
+		
+		AQBench_PrintPerKiloFrame(sample, kAQPerfEvent_CacheMisses, numFrames);
+		AQBench_PrintPerKiloFrame(sample, kAQPerfEvent_BranchMisses, numFrames);
+	}
+	
+	printf("\n");
+}
+
+// Runs one warm-up pass, then measures mNumPasses passes over all the blocks
+static
+void AQBench_Run(struct AQBench * bench, const char * name, AQBenchFunction function, void * context)
+{
+	UInt32 numBlocks = bench->mOptions.mNumFrames / kAQBenchBlockFrames;
+	struct AQPerfSample sum;
+	struct AQPerfSample sample;
+	UInt32 pass;
+	UInt32 k;
+	
+	for (k = 0; k < numBlocks; k++)
+	{
+		function(context, k);
+	}
+	
+	memset(&sum, 0, sizeof(sum));
+	memset(sum.mIsValid, true, sizeof(sum.mIsValid));
+	
+	for (pass = 0; pass < bench->mOptions.mNumPasses; pass++)
+	{
+		AQPerfCounters_Start(&bench->mCounters);
+		
+		for (k = 0; k < numBlocks; k++)
+		{
+			function(context, k);
+		}
+		
+		AQPerfCounters_Stop(&bench->mCounters, &sample);
+		AQPerfSample_Accumulate(&sum, &sample);
+	}
+	
+	AQBench_Report(bench, name, &sum, (UInt64) numBlocks * kAQBenchBlockFrames * bench->mOptions.mNumPasses);
+}
+
+/* Description:
+ * Input for one conversion case: mNumFrames frames of noise in the source layout.
+ */
+struct AQBenchConvert
+{
+	AQSampleConvertKernel mKernel;
+	UInt32 mNumChannels;
+	UInt32 mBytesPerFrame;
+	UInt8 * mInput;
+	Float32 * mOutput;
+};
+
+static
+void AQBench_Convert(void * context, UInt32 blockIndex)
+{
+	struct AQBenchConvert * convert = (struct AQBenchConvert *) context;
+	
+	convert->mKernel(convert->mInput + (size_t) blockIndex * kAQBenchBlockFrames * convert->mBytesPerFrame,
+					 convert->mOutput,
+					 kAQBenchBlockFrames,
+					 convert->mNumChannels);
+}
+
+static
+void AQBench_FillNoise(UInt8 * bytes, size_t numBytes)
+{
+	UInt32 state = 0x12345678;
+	size_t k;
+	
+	for (k = 0; k < numBytes; k++)
+	{
+		state = state * 1664525 + 1013904223;
+		bytes[k] = (UInt8) (state >> 24);
+	}
+}
+
+static
+void AQBench_FillNoiseFloat(Float32 * samples, size_t numSamples)
+{
+	UInt32 state = 0x9e3779b9;
+	size_t k;
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		state = state * 1664525 + 1013904223;
+		samples[k] = (Float32) ((SInt32) state) / 2147483648.0f * 0.5f;
+	}
+}
+
+// The raw layouts each container hands the fill path
+static
+void AQBench_RunConvertCases(struct AQBench * bench)
+{
+	static const struct
+	{
+		const char * mName;
+		struct AQSampleLayout mLayout;
+	}
+	kCases[] =
+	{
+		{ "convert/wav-u8",			{ kAQSampleType_UInt8, false, true, 2 } },
+		{ "convert/wav-s16",		{ kAQSampleType_SInt16, false, true, 2 } },
+		{ "convert/wav-s24",		{ kAQSampleType_SInt24, false, true, 2 } },
+		{ "convert/wav-s32",		{ kAQSampleType_SInt32, false, true, 2 } },
+		{ "convert/wav-f32",		{ kAQSampleType_Float32, false, true, 2 } },
+		{ "convert/caf-f64",		{ kAQSampleType_Float64, false, true, 2 } },
+		{ "convert/aiff-s16be",		{ kAQSampleType_SInt16, true, true, 2 } },
+		{ "convert/aiff-s24be",		{ kAQSampleType_SInt24, true, true, 2 } },
+		{ "convert/caf-s16-planar",	{ kAQSampleType_SInt16, false, false, 2 } },
+		{ "convert/wav-s16-5.1",	{ kAQSampleType_SInt16, false, true, 6 } }
+	};
+	
+	UInt32 k;
+	
+	for (k = 0; k < sizeof(kCases) / sizeof(kCases[0]); k++)
+	{
+		struct AQBenchConvert convert;
+		
+		convert.mKernel = AQSampleConvert_SelectKernel(&kCases[k].mLayout);
+		convert.mNumChannels = kCases[k].mLayout.mNumChannels;
+		convert.mBytesPerFrame = AQSampleConvert_BytesPerSample(kCases[k].mLayout.mType) * convert.mNumChannels;
+		
+		if (!convert.mKernel)
+		{
+			printf("%-24s unsupported\n", kCases[k].mName);
+			continue;
+		}
+		
+		size_t numBytes = (size_t) bench->mOptions.mNumFrames * convert.mBytesPerFrame;
+		
+		convert.mInput = (UInt8 *) malloc(numBytes);
+		convert.mOutput = (Float32 *) malloc(kAQBenchBlockFrames * convert.mNumChannels * sizeof(Float32));
+		
+		AQBench_FillNoise(convert.mInput, numBytes);
+		
+		AQBench_Run(bench, kCases[k].mName, AQBench_Convert, &convert);
+		
+		free(convert.mInput);
+		free(convert.mOutput);
+	}
+}
+
+/* Description:
+ * Interleaved float input shared by the DSP cases, with each stage's state.
+ */
+struct AQBenchDSP
+{
+	UInt32 mNumChannels;
+	Float32 * mInput;
+	Float32 * mIncoming;
+	Float32 * mOutput;
+	
+	struct AQChannelMap mChannelMap;
+	struct AQEqualizer mEqualizer;
+	struct AQCrossfade mCrossfade;
+	struct AQSpectrum * mSpectrum;
+	struct AQMDCTPlan mMDCT;
+};
+
+static
+Float32 * AQBench_Block(const struct AQBenchDSP * dsp, Float32 * samples, UInt32 blockIndex)
+{
+	return samples + (size_t) blockIndex * kAQBenchBlockFrames * dsp->mNumChannels;
+}
+
+static
+void AQBench_ChannelMap(void * context, UInt32 blockIndex)
+{
+	struct AQBenchDSP * dsp = (struct AQBenchDSP *) context;
+	
+	AQChannelMap_Apply(&dsp->mChannelMap, AQBench_Block(dsp, dsp->mInput, blockIndex), dsp->mOutput, kAQBenchBlockFrames);
+}
+
+static
+void AQBench_Equalizer(void * context, UInt32 blockIndex)
+{
+	struct AQBenchDSP * dsp = (struct AQBenchDSP *) context;
+	
+	AQEqualizer_Process(&dsp->mEqualizer, AQBench_Block(dsp, dsp->mInput, blockIndex), kAQBenchBlockFrames);
+}
+
+static
+void AQBench_Crossfade(void * context, UInt32 blockIndex)
+{
+	struct AQBenchDSP * dsp = (struct AQBenchDSP *) context;
+	
+	if (AQCrossfade_IsDone(&dsp->mCrossfade))
+	{
+		AQCrossfade_Start(&dsp->mCrossfade, dsp->mCrossfade.mLengthFrames);
+	}
+	
+	AQCrossfade_Mix(&dsp->mCrossfade,
+					AQBench_Block(dsp, dsp->mInput, blockIndex),
+					AQBench_Block(dsp, dsp->mIncoming, blockIndex),
+					dsp->mOutput,
+					kAQBenchBlockFrames);
+}
+
+static
+void AQBench_Spectrum(void * context, UInt32 blockIndex)
+{
+	struct AQBenchDSP * dsp = (struct AQBenchDSP *) context;
+	
+	AQSpectrum_Tap(dsp->mSpectrum, AQBench_Block(dsp, dsp->mInput, blockIndex), kAQBenchBlockFrames);
+}
+
+// As many transforms as it takes to produce a block of frames, each overlapping half a block
+static
+void AQBench_MDCT(void * context, UInt32 blockIndex)
+{
+	struct AQBenchDSP * dsp = (struct AQBenchDSP *) context;
+	UInt32 half = dsp->mMDCT.mSize / 2;
+	const Float32 * input = AQBench_Block(dsp, dsp->mInput, blockIndex);
+	UInt32 k;
+	
+	for (k = 0; k < kAQBenchBlockFrames; k += half)
+	{
+		AQMDCT_Inverse(&dsp->mMDCT, input + k, dsp->mOutput);
+	}
+}
+
+static
+void AQBench_RunDSPCases(struct AQBench * bench)
+{
+	static const Float64 kSampleRate = 44100;
+	
+	struct AQBenchDSP dsp;
+	struct AQBiquadBand bands[3];
+	size_t numSamples;
+	
+	// 5.1 input so the channel map has a real downmix to do
+	dsp.mNumChannels = 6;
+	numSamples = (size_t) bench->mOptions.mNumFrames * dsp.mNumChannels;
+	
+	dsp.mInput = (Float32 *) malloc(numSamples * sizeof(Float32));
+	dsp.mIncoming = (Float32 *) malloc(numSamples * sizeof(Float32));
+	dsp.mOutput = (Float32 *) malloc(kAQBenchBlockFrames * dsp.mNumChannels * sizeof(Float32));
+	
+	AQBench_FillNoiseFloat(dsp.mInput, numSamples);
+	AQBench_FillNoiseFloat(dsp.mIncoming, numSamples);
+	
+	AQChannelMap_Init(&dsp.mChannelMap, 6, 2);
+	AQBench_Run(bench, "channelmap/5.1-to-2", AQBench_ChannelMap, &dsp);
+	
+	AQBiquad_ParseBand("lowshelf:100:0.7:3", kSampleRate, &bands[0]);
+	AQBiquad_ParseBand("peak:1000:1:-4", kSampleRate, &bands[1]);
+	AQBiquad_ParseBand("highshelf:8000:0.7:2", kSampleRate, &bands[2]);
+	
+	AQEqualizer_Init(&dsp.mEqualizer, dsp.mNumChannels, kSampleRate);
+	AQEqualizer_SetBands(&dsp.mEqualizer, bands, 3);
+	AQBench_Run(bench, "equalizer/3-bands", AQBench_Equalizer, &dsp);
+	
+	AQCrossfade_Init(&dsp.mCrossfade, 3 * kSampleRate, dsp.mNumChannels);
+	AQCrossfade_Start(&dsp.mCrossfade, dsp.mCrossfade.mLengthFrames);
+	AQBench_Run(bench, "crossfade/mix", AQBench_Crossfade, &dsp);
+	AQCrossfade_CleanUp(&dsp.mCrossfade);
+	
+	dsp.mSpectrum = AQSpectrum_Create(2048, 1024, dsp.mNumChannels, kSampleRate);
+	AQBench_Run(bench, "spectrum/2048", AQBench_Spectrum, &dsp);
+	AQSpectrum_Dispose(dsp.mSpectrum);
+	
+	// Vorbis' usual short and long blocks
+	AQMDCTPlan_Init(&dsp.mMDCT, 256);
+	AQBench_Run(bench, "imdct/256", AQBench_MDCT, &dsp);
+	AQMDCTPlan_CleanUp(&dsp.mMDCT);
+	
+	AQMDCTPlan_Init(&dsp.mMDCT, 2048);
+	AQBench_Run(bench, "imdct/2048", AQBench_MDCT, &dsp);
+	AQMDCTPlan_CleanUp(&dsp.mMDCT);
+	
+	free(dsp.mInput);
+	free(dsp.mIncoming);
+	free(dsp.mOutput);
+}
+
+/* Description:
+ * A synthetic file of mNumFrames packets shaped like Vorbis: 128 or 1024 frames each,
+ * sizes tracking the frame count. Each benchmark frame is one packet here.
+ */
+struct AQBenchPacketTable
+{
+	UInt32 mNumPackets;
+	UInt32 * mSizes;
+	UInt32 * mFrameCounts;
+	UInt64 * mLookupFrames;
+	struct AQPacketTable mTable;
+	UInt64 mChecksum;
+};
+
+static
+void AQBench_PacketTableAppend(void * context, UInt32 blockIndex)
+{
+	struct AQBenchPacketTable * packets = (struct AQBenchPacketTable *) context;
+	UInt32 first = blockIndex * kAQBenchBlockFrames;
+	UInt32 k;
+	
+	if (blockIndex == 0)
+	{
+		AQPacketTable_CleanUp(&packets->mTable);
+		AQPacketTable_Init(&packets->mTable, 0);
+	}
+	
+	for (k = first; k < first + kAQBenchBlockFrames; k++)
+	{
+		AQPacketTable_Append(&packets->mTable, packets->mTable.mNextOffset, packets->mSizes[k], packets->mFrameCounts[k]);
+	}
+}
+
+// What a seek does: find the packet holding a frame, then where that packet is
+static
+void AQBench_PacketTableSeek(void * context, UInt32 blockIndex)
+{
+	struct AQBenchPacketTable * packets = (struct AQBenchPacketTable *) context;
+	const UInt64 * frames = packets->mLookupFrames + (size_t) blockIndex * kAQBenchBlockFrames;
+	struct AQPacketInfo info;
+	UInt32 k;
+	
+	for (k = 0; k < kAQBenchBlockFrames; k++)
+	{
+		AQPacketTable_Get(&packets->mTable, AQPacketTable_FindPacket(&packets->mTable, frames[k]), &info);
+		packets->mChecksum += info.mStartOffset;
+	}
+}
+
+static
+void AQBench_RunPacketTableCases(struct AQBench * bench)
+{
+	struct AQBenchPacketTable packets;
+	UInt32 state = 0x2545f491;
+	UInt32 k;
+	
+	packets.mNumPackets = bench->mOptions.mNumFrames / kAQBenchBlockFrames * kAQBenchBlockFrames;
+	packets.mSizes = (UInt32 *) malloc(packets.mNumPackets * sizeof(UInt32));
+	packets.mFrameCounts = (UInt32 *) malloc(packets.mNumPackets * sizeof(UInt32));
+	packets.mLookupFrames = (UInt64 *) malloc(packets.mNumPackets * sizeof(UInt64));
+	packets.mChecksum = 0;
+	
+	AQPacketTable_Init(&packets.mTable, 0);
+	
+	for (k = 0; k < packets.mNumPackets; k++)
+	{
+		state = state * 1664525 + 1013904223;
+		
+		// One short block in eight, long blocks of 200 to 711 bytes
+		packets.mFrameCounts[k] = (state >> 29) == 0 ? 128 : 1024;
+		packets.mSizes[k] = packets.mFrameCounts[k] == 128 ? 20 + (state >> 26) : 200 + (state >> 23);
+	}
+	
+	AQBench_Run(bench, "packettable/append", AQBench_PacketTableAppend, &packets);
+	AQPacketTable_Trim(&packets.mTable);
+	
+	for (k = 0; k < packets.mNumPackets; k++)
+	{
+		state = state * 1664525 + 1013904223;
+		packets.mLookupFrames[k] = ((UInt64) state << 16 ^ state) % packets.mTable.mNumFrames;
+	}
+	
+	AQBench_Run(bench, "packettable/seek", AQBench_PacketTableSeek, &packets);
+	
+	// An AudioStreamPacketDescription per packet would take 16 bytes
+	printf("%-24s %10.2f bytes/packet, %zu bytes for %u packets\n",
+		   "packettable/size",
+		   (Float64) AQPacketTable_GetMemorySize(&packets.mTable) / packets.mNumPackets,
+		   AQPacketTable_GetMemorySize(&packets.mTable),
+		   packets.mNumPackets);
+	
+	AQPacketTable_CleanUp(&packets.mTable);
+	free(packets.mSizes);
+	free(packets.mFrameCounts);
+	free(packets.mLookupFrames);
+}
+
+typedef UInt32 (*AQBenchReadFunction)(void * file, Float32 * out, UInt32 numFrames);
+typedef bool (*AQBenchRewindFunction)(void * file);
+
+static
+UInt32 AQBench_ReadVorbis(void * file, Float32 * out, UInt32 numFrames)
+{
+	return AQVorbisFile_Read((struct AQVorbisFile *) file, out, numFrames);
+}
+
+static
+bool AQBench_RewindVorbis(void * file)
+{
+	return AQVorbisFile_Rewind((struct AQVorbisFile *) file);
+}
+
+static
+UInt32 AQBench_ReadAAC(void * file, Float32 * out, UInt32 numFrames)
+{
+	return AQAACFile_Read((struct AQAACFile *) file, out, numFrames);
+}
+
+static
+bool AQBench_RewindAAC(void * file)
+{
+	return AQAACFile_Rewind((struct AQAACFile *) file);
+}
+
+static
+UInt32 AQBench_ReadFLAC(void * file, Float32 * out, UInt32 numFrames)
+{
+	return AQFLACFile_Read((struct AQFLACFile *) file, out, numFrames);
+}
+
+static
+bool AQBench_RewindFLAC(void * file)
+{
+	return AQFLACFile_Rewind((struct AQFLACFile *) file);
+}
+
+/* Description:
+ * A block file read the way AQPCMSource reads linear PCM: raw frames into
+ * mRaw, then through the convert kernel for the file's layout.
+ */
+struct AQBenchBlockSource
+{
+	struct AQBlockFile * mFile;
+	AQSampleConvertKernel mConvertKernel;
+	UInt32 mNumChannels;
+	void * mRaw;
+};
+
+static
+UInt32 AQBench_ReadBlockFile(void * file, Float32 * out, UInt32 numFrames)
+{
+	struct AQBenchBlockSource * source = (struct AQBenchBlockSource *) file;
+	
+	numFrames = AQBlockFile_Read(source->mFile, source->mRaw, numFrames);
+	source->mConvertKernel(source->mRaw, out, numFrames, source->mNumChannels);
+	
+	return numFrames;
+}
+
+static
+bool AQBench_RewindBlockFile(void * file)
+{
+	AQBlockFile_Seek(((struct AQBenchBlockSource *) file)->mFile, 0);
+	
+	return true;
+}
+
+// Decodes a whole file through one of the native decoders once per pass
+static
+void AQBench_RunNativeDecodeCase(struct AQBench * bench,
+								 const char * name,
+								 void * file,
+								 UInt32 numChannels,
+								 AQBenchReadFunction read,
+								 AQBenchRewindFunction rewind)
+{
+	struct AQPerfSample sum;
+	struct AQPerfSample sample;
+	UInt64 numFrames = 0;
+	UInt32 numFramesRead;
+	UInt32 pass;
+	
+	memset(&sum, 0, sizeof(sum));
+	memset(sum.mIsValid, true, sizeof(sum.mIsValid));
+	
+	Float32 * samples = (Float32 *) malloc(kAQBenchBlockFrames * numChannels * sizeof(Float32));
+	
+	for (pass = 0; pass < bench->mOptions.mNumPasses; pass++)
+	{
+		rewind(file);
+		AQPerfCounters_Start(&bench->mCounters);
+		
+		while ((numFramesRead = read(file, samples, kAQBenchBlockFrames)) > 0)
+		{
+			numFrames += numFramesRead;
+		}
+		
+		AQPerfCounters_Stop(&bench->mCounters, &sample);
+		AQPerfSample_Accumulate(&sum, &sample);
+	}
+	
+	if (numFrames > 0)
+	{
+		AQBench_Report(bench, name, &sum, numFrames);
+	}
+	
+	free(samples);
+}
+
+static
+void AQBench_RunVorbisCase(struct AQBench * bench, const char filePath[])
+{
+	struct AQVorbisFile * file = AQVorbisFile_Open(filePath);
+	
+	if (!file)
+	{
+		fprintf(stderr, "Could not open %s as Ogg Vorbis\n", filePath);
+		return;
+	}
+	
+	AQBench_RunNativeDecodeCase(bench,
+								"decode/ogg-vorbis",
+								file,
+								AQVorbisFile_GetInfo(file)->mNumChannels,
+								AQBench_ReadVorbis,
+								AQBench_RewindVorbis);
+	AQVorbisFile_Close(file);
+}
+
+static
+void AQBench_RunAACCase(struct AQBench * bench, const char filePath[])
+{
+	struct AQAACFile * file = AQAACFile_Open(filePath);
+	
+	if (!file)
+	{
+		fprintf(stderr, "Could not open %s as ADTS AAC\n", filePath);
+		return;
+	}
+	
+	AQBench_RunNativeDecodeCase(bench,
+								"decode/aac-lc",
+								file,
+								AQAACFile_GetInfo(file)->mNumChannels,
+								AQBench_ReadAAC,
+								AQBench_RewindAAC);
+	AQAACFile_Close(file);
+}
+
+static
+void AQBench_RunFLACCase(struct AQBench * bench, const char filePath[])
+{
+	struct AQFLACFile * file = AQFLACFile_Open(filePath);
+	
+	if (!file)
+	{
+		fprintf(stderr, "Could not open %s as FLAC\n", filePath);
+		return;
+	}
+	
+	AQBench_RunNativeDecodeCase(bench,
+								"decode/flac",
+								file,
+								AQFLACFile_GetInfo(file)->mNumChannels,
+								AQBench_ReadFLAC,
+								AQBench_RewindFLAC);
+	AQFLACFile_Close(file);
+}
+
+static
+void AQBench_RunBlockFileCase(struct AQBench * bench, const char filePath[])
+{
+	struct AQBenchBlockSource source;
+	
+	if (!(source.mFile = AQBlockFile_Open(filePath)))
+	{
+		fprintf(stderr, "Could not open %s as a block file\n", filePath);
+		return;
+	}
+	
+	const struct AQBlockFileInfo * info = AQBlockFile_GetInfo(source.mFile);
+	
+	source.mConvertKernel = AQSampleConvert_SelectKernel(&info->mLayout);
+	source.mNumChannels = info->mLayout.mNumChannels;
+	source.mRaw = malloc((size_t) kAQBenchBlockFrames * info->mBytesPerFrame);
+	
+	AQBench_RunNativeDecodeCase(bench,
+								"decode/aqb",
+								&source,
+								source.mNumChannels,
+								AQBench_ReadBlockFile,
+								AQBench_RewindBlockFile);
+	
+	free(source.mRaw);
+	AQBlockFile_Close(source.mFile);
+}
+
+#ifdef __APPLE__
+
+// Decodes a whole file through AQPCMSource, as the PCM fill path does, once per pass
+static
+void AQBench_RunDecodeCase(struct AQBench * bench, const char filePath[])
+{
+	struct AQPCMSource source;
+	struct AQPerfSample sum;
+	struct AQPerfSample sample;
+	struct AQHeaderInfo header;
+	AudioStreamBasicDescription pcmFormat;
+	AudioFileID audioFile;
+	UInt64 numFrames = 0;
+	UInt32 numFramesRead;
+	UInt32 pass;
+	char name[64];
+	
+	const char * extension = strrchr(filePath, '.');
+	
+	snprintf(name, sizeof(name), "decode/%s", extension ? extension + 1 : "?");
+	
+	memset(&source, 0, sizeof(source));
+	memset(&sum, 0, sizeof(sum));
+	memset(sum.mIsValid, true, sizeof(sum.mIsValid));
+	
+	CheckError(OpenAudioFileWithHeader(filePath, NULL, &audioFile, &header), "AudioFileOpen");
+	
+	FillPCMFormat(&pcmFormat, header.mSampleRate, header.mChannelsPerFrame);
+	
+	AQPCMSource_Open(&source, audioFile, &header, &pcmFormat, kAQBenchBlockFrames);
+	
+	Float32 * samples = (Float32 *) malloc(kAQBenchBlockFrames * source.mFormat.mBytesPerFrame);
+	
+	for (pass = 0; pass < bench->mOptions.mNumPasses; pass++)
+	{
+		AQPCMSource_Seek(&source, 0);
+		AQPerfCounters_Start(&bench->mCounters);
+		
+		while ((numFramesRead = AQPCMSource_Read(&source, samples, kAQBenchBlockFrames)) > 0)
+		{
+			numFrames += numFramesRead;
+		}
+		
+		AQPerfCounters_Stop(&bench->mCounters, &sample);
+		AQPerfSample_Accumulate(&sum, &sample);
+	}
+	
+	if (numFrames > 0)
+	{
+		AQBench_Report(bench, name, &sum, numFrames);
+	}
+	
+	free(samples);
+	AQPCMSource_Close(&source);
+}
+
+#endif
+
+int main(int argc, const char * argv[])
+{
+	struct AQBench bench;
+	int argIndex = 1;
+	
+	bench.mOptions.mNumFrames = kAQBenchDefaultFrames;
+	bench.mOptions.mNumPasses = kAQBenchDefaultPasses;
+	bench.mOptions.mUseCounters = true;
+	
+	while (argIndex < argc && strncmp(argv[argIndex], "--", 2) == 0)
+	{
+		if (strcmp(argv[argIndex], "--no-counters") == 0)
+		{
+			bench.mOptions.mUseCounters = false;
+			argIndex++;
+			continue;
+		}
+		
+		if (argIndex + 1 == argc)
+		{
+			fprintf(stderr, "Missing value for %s\n", argv[argIndex]);
+			return 1;
+		}
+		
+		if (strcmp(argv[argIndex], "--frames") == 0)
+		{
+			bench.mOptions.mNumFrames = atoi(argv[argIndex + 1]);
+		}
+		else if (strcmp(argv[argIndex], "--passes") == 0)
+		{
+			bench.mOptions.mNumPasses = atoi(argv[argIndex + 1]);
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option: %s\n", argv[argIndex]);
+			return 1;
+		}
+		
+		argIndex += 2;
+	}
+	
+	if (bench.mOptions.mNumFrames < kAQBenchBlockFrames || bench.mOptions.mNumPasses < 1)
+	{
+		fprintf(stderr, "Need at least %u frames and one pass\n", kAQBenchBlockFrames);
+		return 1;
+	}
+	
+	if (bench.mOptions.mUseCounters)
+	{
+		bench.mHasCounters = AQPerfCounters_Open(&bench.mCounters);
+		
+		if (!bench.mHasCounters)
+		{
+			fprintf(stderr, "Hardware counters unavailable, timing only\n");
+		}
+	}
+	else
+	{
+		// With every descriptor closed the counters only time
+		bench.mHasCounters = false;
+		memset(&bench.mCounters, 0, sizeof(bench.mCounters));
+		memset(bench.mCounters.mFDs, -1, sizeof(bench.mCounters.mFDs));
+		bench.mCounters.mGroupFD = -1;
+	}
+	
+	AQBench_PrintHeader(&bench);
+	
+	AQBench_RunConvertCases(&bench);
+	AQBench_RunDSPCases(&bench);
+	AQBench_RunPacketTableCases(&bench);
+	
+	for (; argIndex < argc; argIndex++)
+	{
+		const char * extension = strrchr(argv[argIndex], '.');
+		
+		if (extension && strcmp(extension, ".ogg") == 0)
+		{
+			AQBench_RunVorbisCase(&bench, argv[argIndex]);
+			continue;
+		}
+		
+		if (extension && strcmp(extension, ".flac") == 0)
+		{
+			AQBench_RunFLACCase(&bench, argv[argIndex]);
+			continue;
+		}
+		
+		if (AQBlockFile_IsBlockFilePath(argv[argIndex]))
+		{
+			AQBench_RunBlockFileCase(&bench, argv[argIndex]);
+			continue;
+		}
+		
+		if (extension && strcmp(extension, ".aac") == 0)
+		{
+			AQBench_RunAACCase(&bench, argv[argIndex]);
+#ifndef __APPLE__
+			continue;
+#endif
+		}
+
+#ifdef __APPLE__
+		AQBench_RunDecodeCase(&bench, argv[argIndex]);
+#else
+		fprintf(stderr, "Decoding %s needs AudioToolbox, skipping it\n", argv[argIndex]);
+#endif
+	}
+	
+	AQPerfCounters_Close(&bench.mCounters);
+	
+	return 0;
+}
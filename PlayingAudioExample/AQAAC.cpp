@@ -0,0 +1,2254 @@
+//
+//  AQAAC.cpp
+//  PlayingAudioExample
+//
+
+#include "AQAAC.h"
+#include "AQAACTables.h"
+#include "AQArena.h"
+#include "AQMDCT.h"
+#include "AQSimd.h"
+#include "AQTrace.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const UInt32 kAACObjectTypeLC = 2;
+
+static const UInt32 kAACElementSCE = 0;
+static const UInt32 kAACElementCPE = 1;
+static const UInt32 kAACElementCCE = 2;
+static const UInt32 kAACElementLFE = 3;
+static const UInt32 kAACElementDSE = 4;
+static const UInt32 kAACElementPCE = 5;
+static const UInt32 kAACElementFIL = 6;
+static const UInt32 kAACElementEND = 7;
+
+static const UInt32 kAACOnlyLongSequence = 0;
+static const UInt32 kAACLongStartSequence = 1;
+static const UInt32 kAACEightShortSequence = 2;
+static const UInt32 kAACLongStopSequence = 3;
+
+static const UInt32 kAACZeroBook = 0;
+static const UInt32 kAACEscapeBook = 11;
+static const UInt32 kAACNoiseBook = 13;
+static const UInt32 kAACIntensityOutOfPhaseBook = 14;
+static const UInt32 kAACIntensityBook = 15;
+
+static const UInt32 kAACMaxBands = 64;
+static const UInt32 kAACMaxWindows = 8;
+static const UInt32 kAACShortWindowSize = 128;
+static const UInt32 kAACMaxTNSFilters = 3;
+static const UInt32 kAACMaxTNSOrder = 12;
+static const UInt32 kAACMaxShortTNSOrder = 7;
+
+// Scalefactors, noise energies and intensity positions are sent as differences from this
+static const SInt32 kAACScalefactorDifferenceOffset = 60;
+static const SInt32 kAACScalefactorOffset = 100;
+static const SInt32 kAACNoiseOffset = 90;
+
+// Quantized values up to this have their x^(4/3) in a table, larger ones take pow
+static const UInt32 kAACPowerTableSize = 8192;
+
+// Codes up to this long are decoded with one table lookup, longer ones by a search
+static const UInt32 kAACFastBits = 10;
+
+// Entries of the largest codebook, the escape codebook's 17 x 17 pairs
+static const UInt32 kAACMaxCodes = 289;
+
+static const UInt32 kADTSHeaderSize = 7;
+static const UInt32 kADTSMaxFrameSize = 8192;
+
+static const UInt8 kMPEG4ESDescriptorTag = 0x03;
+static const UInt8 kMPEG4DecoderConfigDescriptorTag = 0x04;
+static const UInt8 kMPEG4DecoderSpecificInfoTag = 0x05;
+
+// Whatever the decoder holds comes out of its arena in blocks of this size
+static const size_t kAACArenaBlockSize = 64 * 1024;
+
+// Channels of each channel configuration
+static const UInt32 kAACNumChannels[8] = { 0, 1, 2, 3, 4, 5, 6, 8 };
+
+/* Description:
+ * Output channel of each channel in the order the configuration's elements
+ * come in: C before L R, LFE last, as ISO/IEC 14496-3 lays them out.
+ */
+static const UInt8 kAACChannelOrders[8][8] =
+{
+	{ 0 },
+	{ 0 },
+	{ 0, 1 },
+	{ 2, 0, 1 },
+	{ 2, 0, 1, 3 },
+	{ 2, 0, 1, 3, 4 },
+	{ 2, 0, 1, 4, 5, 3 },
+	{ 2, 0, 1, 4, 5, 6, 7, 3 }
+};
+
+/* Description:
+ * MSB-first reader over one access unit. Reading past the end sets mIsPastEnd
+ * and returns zeros, and the packet is then dropped.
+ */
+struct AQAACBits
+{
+	const UInt8 * mStart;
+	const UInt8 * mData;
+	const UInt8 * mEnd;
+	UInt64 mBuffer;
+	SInt32 mNumBits;
+	bool mIsPastEnd;
+};
+
+struct AQAACHuffmanBook
+{
+	/* Description:
+	 * Entry and length, as entry << 5 | length, of the code the next
+	 * kAACFastBits bits start with; 0 when the code is longer than that.
+	 */
+	UInt16 mFastTable[1 << kAACFastBits];
+	
+	/* Description:
+	 * Codes longer than kAACFastBits, MSB aligned and in ascending order, with
+	 * their entries and lengths.
+	 */
+	UInt32 mNumLongCodes;
+	UInt32 mLongCodes[kAACMaxCodes];
+	UInt16 mLongEntries[kAACMaxCodes];
+	UInt8 mLongLengths[kAACMaxCodes];
+};
+
+/* Description:
+ * The scalefactor codebook at 0 and the spectral ones at their number.
+ */
+struct AQAACHuffmanBooks
+{
+	struct AQAACHuffmanBook mBooks[12];
+};
+
+struct AQAACPowerTable
+{
+	Float32 mValues[kAACPowerTableSize];
+};
+
+/* Description:
+ * How the spectral codebooks pack their values: 4 or 2 per entry, each one of
+ * mModulo values starting at -mOffset; unsigned codebooks send signs apart.
+ */
+struct AQAACSpectralBook
+{
+	UInt32 mDimensions;
+	UInt32 mModulo;
+	SInt32 mOffset;
+	bool mIsUnsigned;
+};
+
+static const struct AQAACSpectralBook kAACSpectralBooks[12] =
+{
+	{ 0, 0, 0, false },
+	{ 4, 3, 1, false },
+	{ 4, 3, 1, false },
+	{ 4, 3, 0, true },
+	{ 4, 3, 0, true },
+	{ 2, 9, 4, false },
+	{ 2, 9, 4, false },
+	{ 2, 8, 0, true },
+	{ 2, 8, 0, true },
+	{ 2, 13, 0, true },
+	{ 2, 13, 0, true },
+	{ 2, 17, 0, true }
+};
+
+/* Description:
+ * ics_info: the window sequence and shape, and how the windows and bands of
+ * the frame are laid out.
+ */
+struct AQAACWindowInfo
+{
+	UInt32 mWindowSequence;
+	UInt32 mWindowShape;
+	UInt32 mMaxBand;
+	
+	/* Description:
+	 * 1 or 8 windows, grouped for sharing scalefactors.
+	 */
+	UInt32 mNumWindows;
+	UInt32 mNumGroups;
+	UInt32 mGroupLengths[kAACMaxWindows];
+	
+	/* Description:
+	 * Bands of the window size, from the sample rate's AQAACBandTable.
+	 */
+	UInt32 mNumBands;
+	const UInt16 * mOffsets;
+};
+
+struct AQAACTNSFilter
+{
+	UInt32 mLength;
+	UInt32 mOrder;
+	bool mIsDownward;
+	
+	/* Description:
+	 * Direct form coefficients 1 to mOrder, converted from the reflection
+	 * coefficients sent.
+	 */
+	Float32 mLPC[kAACMaxTNSOrder + 1];
+};
+
+struct AQAACTNS
+{
+	bool mIsPresent;
+	UInt32 mNumFilters[kAACMaxWindows];
+	struct AQAACTNSFilter mFilters[kAACMaxWindows][kAACMaxTNSFilters];
+};
+
+struct AQAACChannel
+{
+	/* Description:
+	 * What the packet being decoded sent for this channel: its windows, the
+	 * codebook of each band in each group, and each band's scalefactor,
+	 * intensity position or noise energy depending on its codebook.
+	 */
+	struct AQAACWindowInfo mInfo;
+	UInt8 mBooks[kAACMaxWindows][kAACMaxBands];
+	SInt32 mScalefactors[kAACMaxWindows][kAACMaxBands];
+	struct AQAACTNS mTNS;
+	
+	/* Description:
+	 * kAQAACFramesPerPacket coefficients, short windows one after the other.
+	 */
+	Float32 * mSpectrum;
+	
+	/* Description:
+	 * The windowed second half of the previous packet and its window shape,
+	 * which the first half of this packet's window takes.
+	 */
+	Float32 * mOverlap;
+	UInt32 mPreviousWindowShape;
+};
+
+struct AQAACDecoder
+{
+	struct AQAACConfig mConfig;
+	const struct AQAACBandTable * mBands;
+	struct AQArena mArena;
+	
+	/* Description:
+	 * Transforms of the short and long windows and the rising half of the sine
+	 * and KBD window shapes in both sizes.
+	 */
+	struct AQMDCTPlan mMDCT[2];
+	Float32 * mShortSlopes[2];
+	Float32 * mLongSlopes[2];
+	
+	struct AQAACChannel * mChannels;
+	
+	/* Description:
+	 * Mid/side flags of the channel pair being decoded, per group and band.
+	 */
+	UInt32 mMSMaskPresent;
+	UInt8 mMSUsed[kAACMaxWindows][kAACMaxBands];
+	
+	/* Description:
+	 * Scratch: one channel's quantized values, the windowed blocks of the
+	 * inverse transform and the planar output of every channel.
+	 */
+	SInt32 * mQuantized;
+	Float32 * mBlock;
+	Float32 * mShortBlock;
+	Float32 * mOutput;
+	
+	/* Description:
+	 * Generator of the noise that noise substituted bands are filled with.
+	 */
+	UInt32 mRandomState;
+};
+
+/* Description:
+ * Where an ADTS frame starts in the file, and the first packet in it.
+ */
+struct AQAACFrameEntry
+{
+	UInt64 mOffset;
+	UInt64 mFirstPacket;
+};
+
+struct AQAACFile
+{
+	FILE * mFile;
+	struct AQAACInfo mInfo;
+	struct AQAACConfig mConfig;
+	struct AQAACDecoder * mDecoder;
+	
+	/* Description:
+	 * Every ADTS frame and one more entry for the end of the last, once
+	 * AQAACFile_IndexFrames has run.
+	 */
+	struct AQAACFrameEntry * mIndex;
+	UInt32 mNumIndexEntries;
+	
+	/* Description:
+	 * The ADTS frame being decoded, the offset of its next raw data block and
+	 * how many blocks are left in it.
+	 */
+	UInt8 mFrame[kADTSMaxFrameSize];
+	UInt32 mFrameSize;
+	UInt32 mBlockOffset;
+	UInt32 mNumBlocksLeft;
+	bool mHasCRC;
+	
+	/* Description:
+	 * Interleaved frames of the last packet and how many of them were read already.
+	 */
+	Float32 * mOutput;
+	UInt32 mNumOutputFrames;
+	UInt32 mOutputPosition;
+	
+	/* Description:
+	 * Frames decoded so far, priming included, read or skipped.
+	 */
+	UInt64 mPosition;
+};
+
+/* Description:
+ * The fields of an ADTS frame header that matter here.
+ */
+struct AQADTSHeader
+{
+	UInt32 mObjectType;
+	UInt32 mSampleRateIndex;
+	UInt32 mChannelConfiguration;
+	UInt32 mFrameSize;
+	UInt32 mNumBlocks;
+	bool mHasCRC;
+};
+
+static
+void AQAACBits_Init(struct AQAACBits * bits, const UInt8 * data, UInt32 size)
+{
+	bits->mStart = data;
+	bits->mData = data;
+	bits->mEnd = data + size;
+	bits->mBuffer = 0;
+	bits->mNumBits = 0;
+	bits->mIsPastEnd = false;
+}
+
+static inline
+void AQAACBits_Refill(struct AQAACBits * bits)
+{
+	while (bits->mNumBits <= 56 && bits->mData < bits->mEnd)
+	{
+		bits->mBuffer |= (UInt64) *bits->mData++ << (56 - bits->mNumBits);
+		bits->mNumBits += 8;
+	}
+}
+
+// The next n <= 32 bits without taking them, zeros past the end
+static inline
+UInt32 AQAACBits_Peek(struct AQAACBits * bits, UInt32 n)
+{
+	if (bits->mNumBits < (SInt32) n)
+	{
+		AQAACBits_Refill(bits);
+	}
+	
+	return (UInt32) (bits->mBuffer >> 32) >> (32 - n);
+}
+
+static inline
+void AQAACBits_Skip(struct AQAACBits * bits, UInt32 n)
+{
+	if (bits->mNumBits < (SInt32) n)
+	{
+		AQAACBits_Refill(bits);
+		
+		if (bits->mNumBits < (SInt32) n)
+		{
+			bits->mIsPastEnd = true;
+			bits->mBuffer = 0;
+			bits->mNumBits = 0;
+			return;
+		}
+	}
+	
+	bits->mBuffer <<= n;
+	bits->mNumBits -= n;
+}
+
+// 1 <= n <= 32
+static inline
+UInt32 AQAACBits_Read(struct AQAACBits * bits, UInt32 n)
+{
+	UInt32 value = AQAACBits_Peek(bits, n);
+	
+	AQAACBits_Skip(bits, n);
+	
+	return bits->mIsPastEnd ? 0 : value;
+}
+
+static
+UInt32 AQAACBits_GetPosition(const struct AQAACBits * bits)
+{
+	return (UInt32) (bits->mData - bits->mStart) * 8 - bits->mNumBits;
+}
+
+static
+void AQAACBits_SkipBytes(struct AQAACBits * bits, UInt32 numBytes)
+{
+	while (numBytes-- > 0 && !bits->mIsPastEnd)
+	{
+		AQAACBits_Skip(bits, 8);
+	}
+}
+
+static
+void AQAACBits_ByteAlign(struct AQAACBits * bits)
+{
+	UInt32 remainder = AQAACBits_GetPosition(bits) % 8;
+	
+	if (remainder)
+	{
+		AQAACBits_Skip(bits, 8 - remainder);
+	}
+}
+
+struct AQAACLongCode
+{
+	UInt32 mCode;
+	UInt16 mEntry;
+	UInt8 mLength;
+};
+
+static
+int AQAACLongCode_Compare(const void * a, const void * b)
+{
+	UInt32 x = ((const struct AQAACLongCode *) a)->mCode;
+	UInt32 y = ((const struct AQAACLongCode *) b)->mCode;
+	
+	return x < y ? -1 : x > y;
+}
+
+static
+void AQAACHuffmanBook_Build(struct AQAACHuffmanBook * book, const struct AQAACHuffmanTable * table)
+{
+	struct AQAACLongCode longCodes[kAACMaxCodes];
+	UInt32 k, j;
+	
+	memset(book, 0, sizeof(struct AQAACHuffmanBook));
+	
+	for (k = 0; k < table->mNumCodes; k++)
+	{
+		UInt32 length = table->mLengths[k];
+		UInt32 code = table->mCodes[k];
+		
+		if (length <= kAACFastBits)
+		{
+			UInt32 first = code << (kAACFastBits - length);
+			
+			for (j = 0; j < 1u << (kAACFastBits - length); j++)
+			{
+				book->mFastTable[first + j] = (UInt16) (k << 5 | length);
+			}
+		}
+		else
+		{
+			longCodes[book->mNumLongCodes].mCode = code << (32 - length);
+			longCodes[book->mNumLongCodes].mEntry = (UInt16) k;
+			longCodes[book->mNumLongCodes].mLength = (UInt8) length;
+			book->mNumLongCodes++;
+		}
+	}
+	
+	qsort(longCodes, book->mNumLongCodes, sizeof(struct AQAACLongCode), AQAACLongCode_Compare);
+	
+	for (k = 0; k < book->mNumLongCodes; k++)
+	{
+		book->mLongCodes[k] = longCodes[k].mCode;
+		book->mLongEntries[k] = longCodes[k].mEntry;
+		book->mLongLengths[k] = longCodes[k].mLength;
+	}
+}
+
+static
+struct AQAACHuffmanBooks AQAAC_MakeHuffmanBooks()
+{
+	struct AQAACHuffmanBooks books;
+	UInt32 k;
+	
+	AQAACHuffmanBook_Build(&books.mBooks[0], &kAQAACScalefactorTable);
+	
+	for (k = 1; k < 12; k++)
+	{
+		AQAACHuffmanBook_Build(&books.mBooks[k], &kAQAACSpectralTables[k - 1]);
+	}
+	
+	return books;
+}
+
+static
+const struct AQAACHuffmanBook * AQAAC_GetHuffmanBook(UInt32 index)
+{
+	static const struct AQAACHuffmanBooks sBooks = AQAAC_MakeHuffmanBooks();
+	
+	return &sBooks.mBooks[index];
+}
+
+static
+struct AQAACPowerTable AQAAC_MakePowerTable()
+{
+	struct AQAACPowerTable table;
+	UInt32 k;
+	
+	for (k = 0; k < kAACPowerTableSize; k++)
+	{
+		table.mValues[k] = (Float32) pow((Float64) k, 4.0 / 3.0);
+	}
+	
+	return table;
+}
+
+// |q|^(4/3) with q's sign
+static inline
+Float32 AQAAC_InverseQuantize(SInt32 q)
+{
+	static const struct AQAACPowerTable sTable = AQAAC_MakePowerTable();
+	UInt32 a = q < 0 ? -q : q;
+	Float32 x = a < kAACPowerTableSize ? sTable.mValues[a] : (Float32) pow((Float64) a, 4.0 / 3.0);
+	
+	return q < 0 ? -x : x;
+}
+
+// The entry whose code comes next, -1 for bits no code starts with
+static inline
+SInt32 AQAACHuffmanBook_Decode(const struct AQAACHuffmanBook * book, struct AQAACBits * bits)
+{
+	UInt32 peek = AQAACBits_Peek(bits, 32);
+	UInt32 fast = book->mFastTable[peek >> (32 - kAACFastBits)];
+	
+	if (fast)
+	{
+		AQAACBits_Skip(bits, fast & 31);
+		return fast >> 5;
+	}
+	
+	// The code that matches is the last one not above the peeked bits
+	UInt32 low = 0;
+	UInt32 high = book->mNumLongCodes;
+	
+	while (high - low > 1)
+	{
+		UInt32 middle = (low + high) / 2;
+		
+		if (book->mLongCodes[middle] <= peek)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	
+	UInt32 length = book->mLongLengths[low];
+	
+	if (high == 0 || book->mLongCodes[low] > peek || (book->mLongCodes[low] ^ peek) >> (32 - length) != 0)
+	{
+		return -1;
+	}
+	
+	AQAACBits_Skip(bits, length);
+	
+	return book->mLongEntries[low];
+}
+
+// Modified Bessel function of the first kind, order 0
+static
+Float64 AQAAC_BesselI0(Float64 x)
+{
+	Float64 sum = 1.0;
+	Float64 term = 1.0;
+	UInt32 k;
+	
+	for (k = 1; k < 64; k++)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		
+		if (term < sum * 1e-12)
+		{
+			break;
+		}
+	}
+	
+	return sum;
+}
+
+// Rising halves of the sine window (shape 0) and the Kaiser-Bessel derived one (shape 1)
+static
+void AQAAC_MakeWindowSlopes(Float32 * sine, Float32 * kbd, UInt32 half, Float64 alpha)
+{
+	Float64 * kernel = (Float64 *) malloc((half + 1) * sizeof(Float64));
+	Float64 total = 0;
+	Float64 sum = 0;
+	UInt32 k;
+	
+	for (k = 0; k < half; k++)
+	{
+		sine[k] = (Float32) sin(M_PI / (2 * half) * (k + 0.5));
+	}
+	
+	for (k = 0; k <= half; k++)
+	{
+		Float64 x = (Float64) k / (half / 2) - 1.0;
+		
+		kernel[k] = AQAAC_BesselI0(M_PI * alpha * sqrt(1.0 - x * x));
+		total += kernel[k];
+	}
+	
+	for (k = 0; k < half; k++)
+	{
+		sum += kernel[k];
+		kbd[k] = (Float32) sqrt(sum / total);
+	}
+	
+	free(kernel);
+}
+
+static
+bool AQAAC_ReadDescriptorHeader(const UInt8 ** p, const UInt8 * end, UInt8 tag, UInt32 * length)
+{
+	UInt32 k;
+	
+	if (*p >= end || **p != tag)
+	{
+		return false;
+	}
+	
+	(*p)++;
+	*length = 0;
+	
+	// Up to four bytes of seven bits, the high bit set on all but the last
+	for (k = 0; k < 4 && *p < end; k++)
+	{
+		UInt8 byte = *(*p)++;
+		
+		*length = *length << 7 | (byte & 0x7f);
+		
+		if (!(byte & 0x80))
+		{
+			return *length <= (UInt32) (end - *p);
+		}
+	}
+	
+	return false;
+}
+
+// The AudioSpecificConfig inside an MPEG-4 elementary stream descriptor (esds)
+static
+bool AQAAC_FindAudioSpecificConfig(const UInt8 ** p, const UInt8 ** end)
+{
+	UInt32 length;
+	
+	if (!AQAAC_ReadDescriptorHeader(p, *end, kMPEG4ESDescriptorTag, &length))
+	{
+		return false;
+	}
+	
+	*end = *p + length;
+	
+	if (*end - *p < 3)
+	{
+		return false;
+	}
+	
+	// ES_ID, then flags for the optional fields that follow
+	UInt8 flags = (*p)[2];
+	
+	*p += 3;
+	
+	if (flags & 0x80)
+	{
+		*p += 2;
+	}
+	
+	if ((flags & 0x40) && *p < *end)
+	{
+		*p += 1 + **p;
+	}
+	
+	if (flags & 0x20)
+	{
+		*p += 2;
+	}
+	
+	// Object type, stream type, buffer size and bit rates come before the specific info
+	if (!AQAAC_ReadDescriptorHeader(p, *end, kMPEG4DecoderConfigDescriptorTag, &length) || length < 13)
+	{
+		return false;
+	}
+	
+	*end = *p + length;
+	*p += 13;
+	
+	if (!AQAAC_ReadDescriptorHeader(p, *end, kMPEG4DecoderSpecificInfoTag, &length))
+	{
+		return false;
+	}
+	
+	*end = *p + length;
+	
+	return true;
+}
+
+bool AQAACConfig_Parse(struct AQAACConfig * config, const void * cookie, UInt32 cookieSize)
+{
+	const UInt8 * p = (const UInt8 *) cookie;
+	const UInt8 * end = p + cookieSize;
+	struct AQAACBits bits;
+	UInt32 k;
+	
+	memset(config, 0, sizeof(struct AQAACConfig));
+	
+	// A whole esds atom, or its payload with the version and flags in front
+	if (cookieSize >= 12 && memcmp(p + 4, "esds", 4) == 0)
+	{
+		p += 12;
+	}
+	else if (cookieSize >= 5 && p[0] == 0 && p[4] == kMPEG4ESDescriptorTag)
+	{
+		p += 4;
+	}
+	
+	if (p < end && *p == kMPEG4ESDescriptorTag && !AQAAC_FindAudioSpecificConfig(&p, &end))
+	{
+		return false;
+	}
+	
+	if (p >= end)
+	{
+		return false;
+	}
+	
+	AQAACBits_Init(&bits, p, (UInt32) (end - p));
+	
+	config->mObjectType = AQAACBits_Read(&bits, 5);
+	
+	if (config->mObjectType == 31)
+	{
+		config->mObjectType = 32 + AQAACBits_Read(&bits, 6);
+	}
+	
+	config->mSampleRateIndex = AQAACBits_Read(&bits, 4);
+	
+	if (config->mSampleRateIndex == 15)
+	{
+		// An explicit rate takes the bands of the nearest standard one
+		config->mSampleRate = AQAACBits_Read(&bits, 24);
+		config->mSampleRateIndex = 0;
+		
+		for (k = 1; k < kAQAACNumSampleRates; k++)
+		{
+			if (abs((int) kAQAACBandTables[k].mSampleRate - (int) config->mSampleRate) <
+				abs((int) kAQAACBandTables[config->mSampleRateIndex].mSampleRate - (int) config->mSampleRate))
+			{
+				config->mSampleRateIndex = k;
+			}
+		}
+	}
+	else if (config->mSampleRateIndex < kAQAACNumSampleRates)
+	{
+		config->mSampleRate = kAQAACBandTables[config->mSampleRateIndex].mSampleRate;
+	}
+	else
+	{
+		return false;
+	}
+	
+	config->mChannelConfiguration = AQAACBits_Read(&bits, 4);
+	
+	if (config->mObjectType != kAACObjectTypeLC || config->mChannelConfiguration < 1 || config->mChannelConfiguration > 7)
+	{
+		return false;
+	}
+	
+	config->mNumChannels = kAACNumChannels[config->mChannelConfiguration];
+	
+	// GASpecificConfig: only the 1024 frame length is decoded
+	bool isShortFrame = AQAACBits_Read(&bits, 1);
+	
+	return !isShortFrame && !bits.mIsPastEnd;
+}
+
+struct AQAACDecoder * AQAACDecoder_Create(const struct AQAACConfig * config)
+{
+	struct AQAACDecoder * decoder = (struct AQAACDecoder *) calloc(1, sizeof(struct AQAACDecoder));
+	struct AQArena * arena = &decoder->mArena;
+	UInt32 numChannels = config->mNumChannels;
+	UInt32 ch, k;
+	
+	AQArena_Init(arena, kAACArenaBlockSize);
+	
+	decoder->mConfig = *config;
+	decoder->mBands = &kAQAACBandTables[config->mSampleRateIndex];
+	
+	AQMDCTPlan_Init(&decoder->mMDCT[0], 2 * kAACShortWindowSize);
+	AQMDCTPlan_Init(&decoder->mMDCT[1], 2 * kAQAACFramesPerPacket);
+	
+	for (k = 0; k < 2; k++)
+	{
+		decoder->mShortSlopes[k] = (Float32 *) AQArena_Alloc(arena, kAACShortWindowSize * sizeof(Float32));
+		decoder->mLongSlopes[k] = (Float32 *) AQArena_Alloc(arena, kAQAACFramesPerPacket * sizeof(Float32));
+	}
+	
+	AQAAC_MakeWindowSlopes(decoder->mShortSlopes[0], decoder->mShortSlopes[1], kAACShortWindowSize, 6.0);
+	AQAAC_MakeWindowSlopes(decoder->mLongSlopes[0], decoder->mLongSlopes[1], kAQAACFramesPerPacket, 4.0);
+	
+	decoder->mChannels = (struct AQAACChannel *) AQArena_Calloc(arena, numChannels, sizeof(struct AQAACChannel));
+	
+	for (ch = 0; ch < numChannels; ch++)
+	{
+		decoder->mChannels[ch].mSpectrum = (Float32 *) AQArena_Calloc(arena, kAQAACFramesPerPacket, sizeof(Float32));
+		decoder->mChannels[ch].mOverlap = (Float32 *) AQArena_Calloc(arena, kAQAACFramesPerPacket, sizeof(Float32));
+	}
+	
+	decoder->mQuantized = (SInt32 *) AQArena_Calloc(arena, kAQAACFramesPerPacket, sizeof(SInt32));
+	decoder->mBlock = (Float32 *) AQArena_Calloc(arena, 2 * kAQAACFramesPerPacket, sizeof(Float32));
+	decoder->mShortBlock = (Float32 *) AQArena_Calloc(arena, 2 * kAACShortWindowSize, sizeof(Float32));
+	decoder->mOutput = (Float32 *) AQArena_Calloc(arena, (size_t) numChannels * kAQAACFramesPerPacket, sizeof(Float32));
+	
+	AQAACDecoder_Reset(decoder);
+	
+	return decoder;
+}
+
+static
+bool AQAACDecoder_ReadWindowInfo(const struct AQAACDecoder * decoder, struct AQAACBits * bits, struct AQAACWindowInfo * info)
+{
+	UInt32 k;
+	
+	AQAACBits_Skip(bits, 1);
+	
+	info->mWindowSequence = AQAACBits_Read(bits, 2);
+	info->mWindowShape = AQAACBits_Read(bits, 1);
+	info->mNumGroups = 1;
+	info->mGroupLengths[0] = 1;
+	
+	if (info->mWindowSequence == kAACEightShortSequence)
+	{
+		info->mMaxBand = AQAACBits_Read(bits, 4);
+		info->mNumWindows = kAACMaxWindows;
+		info->mNumBands = decoder->mBands->mNumShortBands;
+		info->mOffsets = decoder->mBands->mShortOffsets;
+		
+		// One bit per window after the first: set when it shares the previous window's group
+		UInt32 grouping = AQAACBits_Read(bits, 7);
+		
+		for (k = 0; k < 7; k++)
+		{
+			if (grouping >> (6 - k) & 1)
+			{
+				info->mGroupLengths[info->mNumGroups - 1]++;
+			}
+			else
+			{
+				info->mGroupLengths[info->mNumGroups++] = 1;
+			}
+		}
+	}
+	else
+	{
+		info->mMaxBand = AQAACBits_Read(bits, 6);
+		info->mNumWindows = 1;
+		info->mNumBands = decoder->mBands->mNumLongBands;
+		info->mOffsets = decoder->mBands->mLongOffsets;
+		
+		// Prediction belongs to the main profile
+		if (AQAACBits_Read(bits, 1))
+		{
+			return false;
+		}
+	}
+	
+	return info->mMaxBand <= info->mNumBands && !bits->mIsPastEnd;
+}
+
+// section_data: the codebook of each band in each group
+static
+bool AQAACChannel_ReadSections(struct AQAACChannel * channel, struct AQAACBits * bits)
+{
+	const struct AQAACWindowInfo * info = &channel->mInfo;
+	UInt32 lengthBits = info->mNumWindows == 1 ? 5 : 3;
+	UInt32 escape = (1 << lengthBits) - 1;
+	UInt32 group, band, k;
+	
+	for (group = 0; group < info->mNumGroups; group++)
+	{
+		for (band = 0; band < info->mMaxBand; )
+		{
+			UInt32 book = AQAACBits_Read(bits, 4);
+			UInt32 length = 0;
+			UInt32 increment;
+			
+			if (book == 12)
+			{
+				return false;
+			}
+			
+			do
+			{
+				increment = AQAACBits_Read(bits, lengthBits);
+				length += increment;
+			}
+			while (increment == escape && !bits->mIsPastEnd);
+			
+			if (bits->mIsPastEnd || band + length > info->mMaxBand)
+			{
+				return false;
+			}
+			
+			for (k = 0; k < length; k++)
+			{
+				channel->mBooks[group][band++] = (UInt8) book;
+			}
+		}
+	}
+	
+	return true;
+}
+
+// scale_factor_data: three running values, each sent as differences from the previous band's
+static
+bool AQAACChannel_ReadScalefactors(struct AQAACChannel * channel, struct AQAACBits * bits, UInt32 globalGain)
+{
+	const struct AQAACHuffmanBook * book = AQAAC_GetHuffmanBook(0);
+	const struct AQAACWindowInfo * info = &channel->mInfo;
+	SInt32 scalefactor = globalGain;
+	SInt32 position = 0;
+	SInt32 energy = (SInt32) globalGain - kAACNoiseOffset;
+	bool isFirstNoiseBand = true;
+	UInt32 group, band;
+	
+	for (group = 0; group < info->mNumGroups; group++)
+	{
+		for (band = 0; band < info->mMaxBand; band++)
+		{
+			UInt32 type = channel->mBooks[group][band];
+			SInt32 * value = &channel->mScalefactors[group][band];
+			
+			if (type == kAACZeroBook)
+			{
+				*value = 0;
+				continue;
+			}
+			
+			// The first noise energy is sent as 9 bits, every other difference Huffman coded
+			if (type == kAACNoiseBook && isFirstNoiseBand)
+			{
+				energy += (SInt32) AQAACBits_Read(bits, 9) - 256;
+				isFirstNoiseBand = false;
+				*value = energy;
+				continue;
+			}
+			
+			SInt32 entry = AQAACHuffmanBook_Decode(book, bits);
+			
+			if (entry < 0)
+			{
+				return false;
+			}
+			
+			SInt32 difference = entry - kAACScalefactorDifferenceOffset;
+			
+			if (type == kAACIntensityBook || type == kAACIntensityOutOfPhaseBook)
+			{
+				*value = position += difference;
+			}
+			else if (type == kAACNoiseBook)
+			{
+				*value = energy += difference;
+			}
+			else
+			{
+				*value = scalefactor += difference;
+				
+				if (scalefactor < 0 || scalefactor > 255)
+				{
+					return false;
+				}
+			}
+		}
+	}
+	
+	return !bits->mIsPastEnd;
+}
+
+// Reflection coefficients to the direct form filter, by the Levinson recursion
+static
+void AQAAC_ReflectionToLPC(const Float64 * reflection, UInt32 order, Float32 * lpc)
+{
+	Float64 a[kAACMaxTNSOrder + 1];
+	Float64 b[kAACMaxTNSOrder + 1];
+	UInt32 m, i;
+	
+	a[0] = 1.0;
+	
+	for (m = 1; m <= order; m++)
+	{
+		for (i = 1; i < m; i++)
+		{
+			b[i] = a[i] + reflection[m - 1] * a[m - i];
+		}
+		
+		for (i = 1; i < m; i++)
+		{
+			a[i] = b[i];
+		}
+		
+		a[m] = reflection[m - 1];
+	}
+	
+	for (i = 0; i <= order; i++)
+	{
+		lpc[i] = (Float32) a[i];
+	}
+}
+
+// tns_data
+static
+bool AQAACChannel_ReadTNS(struct AQAACChannel * channel, struct AQAACBits * bits)
+{
+	const struct AQAACWindowInfo * info = &channel->mInfo;
+	struct AQAACTNS * tns = &channel->mTNS;
+	bool isLong = info->mNumWindows == 1;
+	UInt32 maxOrder = isLong ? kAACMaxTNSOrder : kAACMaxShortTNSOrder;
+	UInt32 window, filter, k;
+	
+	for (window = 0; window < info->mNumWindows; window++)
+	{
+		tns->mNumFilters[window] = AQAACBits_Read(bits, isLong ? 2 : 1);
+		
+		if (tns->mNumFilters[window] == 0)
+		{
+			continue;
+		}
+		
+		// Coefficients have 3 or 4 bits of resolution, sent with one less when compressed
+		UInt32 resolution = AQAACBits_Read(bits, 1) + 3;
+		Float64 positiveStep = ((1 << (resolution - 1)) - 0.5) / (M_PI / 2);
+		Float64 negativeStep = ((1 << (resolution - 1)) + 0.5) / (M_PI / 2);
+		
+		for (filter = 0; filter < tns->mNumFilters[window]; filter++)
+		{
+			struct AQAACTNSFilter * f = &tns->mFilters[window][filter];
+			Float64 reflection[kAACMaxTNSOrder];
+			
+			f->mLength = AQAACBits_Read(bits, isLong ? 6 : 4);
+			f->mOrder = AQAACBits_Read(bits, isLong ? 5 : 3);
+			
+			if (f->mOrder > maxOrder)
+			{
+				return false;
+			}
+			
+			if (f->mOrder == 0)
+			{
+				continue;
+			}
+			
+			f->mIsDownward = AQAACBits_Read(bits, 1);
+			
+			UInt32 numBits = resolution - AQAACBits_Read(bits, 1);
+			
+			for (k = 0; k < f->mOrder; k++)
+			{
+				SInt32 value = (SInt32) AQAACBits_Read(bits, numBits);
+				
+				if (value >= 1 << (numBits - 1))
+				{
+					value -= 1 << numBits;
+				}
+				
+				reflection[k] = sin(value / (value >= 0 ? positiveStep : negativeStep));
+			}
+			
+			AQAAC_ReflectionToLPC(reflection, f->mOrder, f->mLPC);
+		}
+	}
+	
+	return !bits->mIsPastEnd;
+}
+
+// Adds sign bits to an unsigned codebook's values, and for the escape codebook the
+// escape sequences of values at 16
+static
+void AQAAC_ReadSignsAndEscapes(struct AQAACBits * bits, UInt32 bookIndex, SInt32 * values, UInt32 dimensions)
+{
+	UInt32 k;
+	
+	for (k = 0; k < dimensions; k++)
+	{
+		if (values[k] && AQAACBits_Read(bits, 1))
+		{
+			values[k] = -values[k];
+		}
+	}
+	
+	if (bookIndex != kAACEscapeBook)
+	{
+		return;
+	}
+	
+	for (k = 0; k < dimensions; k++)
+	{
+		if (values[k] == 16 || values[k] == -16)
+		{
+			// N ones and a zero, then N + 4 bits below the implicit top one
+			UInt32 numBits = 4;
+			
+			while (numBits < 13 && AQAACBits_Read(bits, 1))
+			{
+				numBits++;
+			}
+			
+			SInt32 magnitude = (1 << numBits) + AQAACBits_Read(bits, numBits);
+			
+			values[k] = values[k] < 0 ? -magnitude : magnitude;
+		}
+	}
+}
+
+// spectral_data into mQuantized, numValues of one band of one window from first
+static
+bool AQAACDecoder_ReadSpectralBand(struct AQAACDecoder * decoder, struct AQAACBits * bits, UInt32 bookIndex, UInt32 first, UInt32 numValues)
+{
+	const struct AQAACHuffmanBook * book = AQAAC_GetHuffmanBook(bookIndex);
+	const struct AQAACSpectralBook * layout = &kAACSpectralBooks[bookIndex];
+	SInt32 * out = decoder->mQuantized + first;
+	UInt32 k;
+	
+	for (k = 0; k < numValues; k += layout->mDimensions)
+	{
+		SInt32 entry = AQAACHuffmanBook_Decode(book, bits);
+		SInt32 values[4];
+		
+		if (entry < 0)
+		{
+			return false;
+		}
+		
+		if (layout->mDimensions == 4)
+		{
+			values[0] = entry / 27 - layout->mOffset;
+			values[1] = entry / 9 % 3 - layout->mOffset;
+			values[2] = entry / 3 % 3 - layout->mOffset;
+			values[3] = entry % 3 - layout->mOffset;
+		}
+		else
+		{
+			values[0] = entry / layout->mModulo - layout->mOffset;
+			values[1] = entry % layout->mModulo - layout->mOffset;
+		}
+		
+		if (layout->mIsUnsigned)
+		{
+			AQAAC_ReadSignsAndEscapes(bits, bookIndex, values, layout->mDimensions);
+		}
+		
+		memcpy(out + k, values, layout->mDimensions * sizeof(SInt32));
+	}
+	
+	return true;
+}
+
+// Coefficient index of a band in a window: short windows follow one another
+static inline
+UInt32 AQAACWindowInfo_GetOffset(const struct AQAACWindowInfo * info, UInt32 window, UInt32 band)
+{
+	return window * kAACShortWindowSize + info->mOffsets[band];
+}
+
+// Fills a noise substituted band with random values at its energy
+static
+void AQAACDecoder_FillNoise(struct AQAACDecoder * decoder, Float32 * band, UInt32 numValues, Float32 gain)
+{
+	Float32 energy = 0;
+	UInt32 k;
+	
+	for (k = 0; k < numValues; k++)
+	{
+		decoder->mRandomState = decoder->mRandomState * 1664525 + 1013904223;
+		band[k] = (Float32) (SInt32) decoder->mRandomState;
+		energy += band[k] * band[k];
+	}
+	
+	AQFloat4 scale = AQFloat4_Set1(energy > 0 ? gain / sqrtf(energy) : 0.f);
+	
+	for (k = 0; k < numValues; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4_Store(band + k, AQFloat4_Mul(AQFloat4_Load(band + k), scale));
+	}
+}
+
+/* The coefficients of every band from the quantized values, scalefactors and
+ * noise energies. Intensity bands stay zero until the pair's other channel is
+ * known. The inverse transform's 2 / N and the scale from 16 bit samples to
+ * float are folded into the gains. Bands are multiples of four wide.
+ */
+static
+void AQAACDecoder_InverseQuantize(struct AQAACDecoder * decoder, struct AQAACChannel * channel)
+{
+	const struct AQAACWindowInfo * info = &channel->mInfo;
+	Float32 normalization = 2.f / (info->mNumWindows == 1 ? 2 * kAQAACFramesPerPacket : 2 * kAACShortWindowSize) / 32768.f;
+	UInt32 group, band, window, k;
+	UInt32 firstWindow = 0;
+	
+	memset(channel->mSpectrum, 0, kAQAACFramesPerPacket * sizeof(Float32));
+	
+	for (group = 0; group < info->mNumGroups; group++)
+	{
+		for (band = 0; band < info->mMaxBand; band++)
+		{
+			UInt32 type = channel->mBooks[group][band];
+			UInt32 numValues = info->mOffsets[band + 1] - info->mOffsets[band];
+			
+			if (type == kAACZeroBook || type == kAACIntensityBook || type == kAACIntensityOutOfPhaseBook)
+			{
+				continue;
+			}
+			
+			for (window = firstWindow; window < firstWindow + info->mGroupLengths[group]; window++)
+			{
+				UInt32 first = AQAACWindowInfo_GetOffset(info, window, band);
+				Float32 * out = channel->mSpectrum + first;
+				
+				if (type == kAACNoiseBook)
+				{
+					AQAACDecoder_FillNoise(decoder, out, numValues, exp2f(0.25f * channel->mScalefactors[group][band]) * normalization);
+					continue;
+				}
+				
+				AQFloat4 gain = AQFloat4_Set1(exp2f(0.25f * (channel->mScalefactors[group][band] - kAACScalefactorOffset)) * normalization);
+				const SInt32 * quantized = decoder->mQuantized + first;
+				
+				for (k = 0; k < numValues; k++)
+				{
+					out[k] = AQAAC_InverseQuantize(quantized[k]);
+				}
+				
+				for (k = 0; k < numValues; k += AQ_SIMD_WIDTH)
+				{
+					AQFloat4_Store(out + k, AQFloat4_Mul(AQFloat4_Load(out + k), gain));
+				}
+			}
+		}
+		
+		firstWindow += info->mGroupLengths[group];
+	}
+}
+
+// individual_channel_stream, through to the inverse quantized spectrum
+static
+bool AQAACDecoder_ReadChannel(struct AQAACDecoder * decoder, struct AQAACBits * bits, struct AQAACChannel * channel, bool isCommonWindow)
+{
+	const struct AQAACWindowInfo * info = &channel->mInfo;
+	UInt32 pulsePositions[4];
+	UInt32 pulseAmplitudes[4];
+	UInt32 numPulses = 0;
+	UInt32 group, band, window, k;
+	
+	AQ_TRACE_SCOPE("spectrum", 0);
+	
+	UInt32 globalGain = AQAACBits_Read(bits, 8);
+	
+	if (!isCommonWindow && !AQAACDecoder_ReadWindowInfo(decoder, bits, &channel->mInfo))
+	{
+		return false;
+	}
+	
+	if (!AQAACChannel_ReadSections(channel, bits) || !AQAACChannel_ReadScalefactors(channel, bits, globalGain))
+	{
+		return false;
+	}
+	
+	if (AQAACBits_Read(bits, 1))
+	{
+		if (info->mNumWindows != 1)
+		{
+			return false;
+		}
+		
+		numPulses = AQAACBits_Read(bits, 2) + 1;
+		
+		UInt32 position = AQAACBits_Read(bits, 6);
+		
+		if (position >= info->mNumBands)
+		{
+			return false;
+		}
+		
+		position = info->mOffsets[position];
+		
+		for (k = 0; k < numPulses; k++)
+		{
+			position += AQAACBits_Read(bits, 5);
+			pulsePositions[k] = position;
+			pulseAmplitudes[k] = AQAACBits_Read(bits, 4);
+			
+			if (position >= kAQAACFramesPerPacket)
+			{
+				return false;
+			}
+		}
+	}
+	
+	channel->mTNS.mIsPresent = AQAACBits_Read(bits, 1);
+	
+	if (channel->mTNS.mIsPresent && !AQAACChannel_ReadTNS(channel, bits))
+	{
+		return false;
+	}
+	
+	// Gain control belongs to the SSR profile
+	if (AQAACBits_Read(bits, 1))
+	{
+		return false;
+	}
+	
+	memset(decoder->mQuantized, 0, kAQAACFramesPerPacket * sizeof(SInt32));
+	
+	UInt32 firstWindow = 0;
+	
+	for (group = 0; group < info->mNumGroups; group++)
+	{
+		for (band = 0; band < info->mMaxBand; band++)
+		{
+			UInt32 type = channel->mBooks[group][band];
+			UInt32 numValues = info->mOffsets[band + 1] - info->mOffsets[band];
+			
+			if (type == kAACZeroBook || type >= kAACNoiseBook)
+			{
+				continue;
+			}
+			
+			for (window = firstWindow; window < firstWindow + info->mGroupLengths[group]; window++)
+			{
+				if (!AQAACDecoder_ReadSpectralBand(decoder, bits, type, AQAACWindowInfo_GetOffset(info, window, band), numValues))
+				{
+					return false;
+				}
+			}
+		}
+		
+		firstWindow += info->mGroupLengths[group];
+	}
+	
+	for (k = 0; k < numPulses; k++)
+	{
+		SInt32 * value = &decoder->mQuantized[pulsePositions[k]];
+		
+		*value += *value < 0 ? -(SInt32) pulseAmplitudes[k] : (SInt32) pulseAmplitudes[k];
+	}
+	
+	if (bits->mIsPastEnd)
+	{
+		return false;
+	}
+	
+	AQAACDecoder_InverseQuantize(decoder, channel);
+	
+	return true;
+}
+
+// Mid/side and intensity stereo of a channel pair, band by band
+static
+void AQAACDecoder_ApplyStereo(struct AQAACDecoder * decoder, struct AQAACChannel * left, struct AQAACChannel * right)
+{
+	const struct AQAACWindowInfo * info = &right->mInfo;
+	UInt32 group, band, window, k;
+	UInt32 firstWindow = 0;
+	
+	for (group = 0; group < info->mNumGroups; group++)
+	{
+		for (band = 0; band < info->mMaxBand; band++)
+		{
+			UInt32 leftType = left->mBooks[group][band];
+			UInt32 rightType = right->mBooks[group][band];
+			bool isMS = decoder->mMSMaskPresent && decoder->mMSUsed[group][band];
+			UInt32 numValues = info->mOffsets[band + 1] - info->mOffsets[band];
+			
+			for (window = firstWindow; window < firstWindow + info->mGroupLengths[group]; window++)
+			{
+				UInt32 first = AQAACWindowInfo_GetOffset(info, window, band);
+				Float32 * l = left->mSpectrum + first;
+				Float32 * r = right->mSpectrum + first;
+				
+				if (rightType == kAACIntensityBook || rightType == kAACIntensityOutOfPhaseBook)
+				{
+					// The right channel is the left one scaled, its phase flipped by the codebook and mid/side flag
+					bool isOutOfPhase = (rightType == kAACIntensityOutOfPhaseBook) != isMS;
+					Float32 scale = exp2f(-0.25f * right->mScalefactors[group][band]);
+					AQFloat4 gain = AQFloat4_Set1(isOutOfPhase ? -scale : scale);
+					
+					for (k = 0; k < numValues; k += AQ_SIMD_WIDTH)
+					{
+						AQFloat4_Store(r + k, AQFloat4_Mul(AQFloat4_Load(l + k), gain));
+					}
+				}
+				else if (isMS && leftType < kAACNoiseBook && rightType < kAACNoiseBook)
+				{
+					for (k = 0; k < numValues; k += AQ_SIMD_WIDTH)
+					{
+						AQFloat4 mid = AQFloat4_Load(l + k);
+						AQFloat4 side = AQFloat4_Load(r + k);
+						
+						AQFloat4_Store(l + k, AQFloat4_Add(mid, side));
+						AQFloat4_Store(r + k, AQFloat4_Sub(mid, side));
+					}
+				}
+			}
+		}
+		
+		firstWindow += info->mGroupLengths[group];
+	}
+}
+
+// All-pole filters over the bands each TNS filter covers, in place
+static
+void AQAACChannel_ApplyTNS(const struct AQAACDecoder * decoder, struct AQAACChannel * channel)
+{
+	const struct AQAACWindowInfo * info = &channel->mInfo;
+	const struct AQAACTNS * tns = &channel->mTNS;
+	UInt32 maxBand = decoder->mBands->mTNSMaxBands[info->mNumWindows == 1 ? 0 : 1];
+	UInt32 window, filter, i;
+	SInt32 m;
+	
+	AQ_TRACE_SCOPE("tns", 0);
+	
+	maxBand = maxBand < info->mMaxBand ? maxBand : info->mMaxBand;
+	
+	for (window = 0; window < info->mNumWindows; window++)
+	{
+		Float32 * spectrum = channel->mSpectrum + window * kAACShortWindowSize;
+		UInt32 bottom = info->mNumBands;
+		
+		for (filter = 0; filter < tns->mNumFilters[window]; filter++)
+		{
+			const struct AQAACTNSFilter * f = &tns->mFilters[window][filter];
+			UInt32 top = bottom;
+			
+			bottom = top > f->mLength ? top - f->mLength : 0;
+			
+			if (f->mOrder == 0)
+			{
+				continue;
+			}
+			
+			SInt32 start = info->mOffsets[bottom < maxBand ? bottom : maxBand];
+			SInt32 end = info->mOffsets[top < maxBand ? top : maxBand];
+			SInt32 size = end - start;
+			SInt32 step = f->mIsDownward ? -1 : 1;
+			SInt32 position = f->mIsDownward ? end - 1 : start;
+			
+			for (m = 0; m < size; m++, position += step)
+			{
+				UInt32 order = (UInt32) m < f->mOrder ? (UInt32) m : f->mOrder;
+				Float32 y = spectrum[position];
+				
+				for (i = 1; i <= order; i++)
+				{
+					y -= f->mLPC[i] * spectrum[position - (SInt32) i * step];
+				}
+				
+				spectrum[position] = y;
+			}
+		}
+	}
+}
+
+// block[offset, offset + n) times a rising slope into out, plus add when it is not NULL
+static inline
+void AQAAC_WindowRising(Float32 * out, const Float32 * add, const Float32 * block, const Float32 * slope, UInt32 n)
+{
+	UInt32 k;
+	
+	for (k = 0; k < n; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 x = AQFloat4_Mul(AQFloat4_Load(block + k), AQFloat4_Load(slope + k));
+		
+		AQFloat4_Store(out + k, add ? AQFloat4_Add(x, AQFloat4_Load(add + k)) : x);
+	}
+}
+
+// Like AQAAC_WindowRising along the slope backwards, falling
+static inline
+void AQAAC_WindowFalling(Float32 * out, const Float32 * add, const Float32 * block, const Float32 * slope, UInt32 n)
+{
+	UInt32 k;
+	
+	for (k = 0; k < n; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 x = AQFloat4_Mul(AQFloat4_Load(block + k), AQFloat4_Reverse(AQFloat4_Load(slope + n - AQ_SIMD_WIDTH - k)));
+		
+		AQFloat4_Store(out + k, add ? AQFloat4_Add(x, AQFloat4_Load(add + k)) : x);
+	}
+}
+
+static inline
+void AQAAC_Copy(Float32 * out, const Float32 * add, const Float32 * block, UInt32 n)
+{
+	UInt32 k;
+	
+	for (k = 0; k < n; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 x = AQFloat4_Load(block + k);
+		
+		AQFloat4_Store(out + k, add ? AQFloat4_Add(x, AQFloat4_Load(add + k)) : x);
+	}
+}
+
+/* Inverse transform, windowing and overlap-add of one channel into out. Long
+ * sequences transform the whole frame; the start and stop sequences bridge to
+ * and from eight short windows, whose slopes sit 448 samples into each half.
+ * Every segment is a multiple of four samples.
+ */
+static
+void AQAACDecoder_Filterbank(struct AQAACDecoder * decoder, struct AQAACChannel * channel, Float32 * out)
+{
+	const UInt32 n = kAQAACFramesPerPacket;
+	const UInt32 s = kAACShortWindowSize;
+	const UInt32 flat = (n - s) / 2;
+	UInt32 sequence = channel->mInfo.mWindowSequence;
+	UInt32 shape = channel->mInfo.mWindowShape;
+	UInt32 previousShape = channel->mPreviousWindowShape;
+	Float32 * overlap = channel->mOverlap;
+	Float32 * block = decoder->mBlock;
+	UInt32 window;
+	
+	if (sequence == kAACEightShortSequence)
+	{
+		AQFloat4 zero = AQFloat4_Set1(0.f);
+		UInt32 k;
+		
+		for (k = 0; k < 2 * n; k += AQ_SIMD_WIDTH)
+		{
+			AQFloat4_Store(block + k, zero);
+		}
+		
+		for (window = 0; window < kAACMaxWindows; window++)
+		{
+			Float32 * windowStart = block + flat + window * s;
+			
+			{
+				AQ_TRACE_SCOPE("imdct", 2 * s);
+				
+				AQMDCT_Inverse(&decoder->mMDCT[0], channel->mSpectrum + window * s, decoder->mShortBlock);
+			}
+			
+			AQAAC_WindowRising(windowStart, windowStart, decoder->mShortBlock, decoder->mShortSlopes[window == 0 ? previousShape : shape], s);
+			AQAAC_WindowFalling(windowStart + s, windowStart + s, decoder->mShortBlock + s, decoder->mShortSlopes[shape], s);
+		}
+		
+		AQ_TRACE_SCOPE("overlap", n);
+		
+		AQAAC_Copy(out, overlap, block, n);
+		AQAAC_Copy(overlap, NULL, block + n, n);
+	}
+	else
+	{
+		{
+			AQ_TRACE_SCOPE("imdct", 2 * n);
+			
+			AQMDCT_Inverse(&decoder->mMDCT[1], channel->mSpectrum, block);
+		}
+		
+		AQ_TRACE_SCOPE("overlap", n);
+		
+		if (sequence == kAACLongStopSequence)
+		{
+			AQAAC_Copy(out, NULL, overlap, flat);
+			AQAAC_WindowRising(out + flat, overlap + flat, block + flat, decoder->mShortSlopes[previousShape], s);
+			AQAAC_Copy(out + flat + s, overlap + flat + s, block + flat + s, flat);
+		}
+		else
+		{
+			AQAAC_WindowRising(out, overlap, block, decoder->mLongSlopes[previousShape], n);
+		}
+		
+		if (sequence == kAACLongStartSequence)
+		{
+			AQFloat4 zero = AQFloat4_Set1(0.f);
+			UInt32 k;
+			
+			AQAAC_Copy(overlap, NULL, block + n, flat);
+			AQAAC_WindowFalling(overlap + flat, NULL, block + n + flat, decoder->mShortSlopes[shape], s);
+			
+			for (k = flat + s; k < n; k += AQ_SIMD_WIDTH)
+			{
+				AQFloat4_Store(overlap + k, zero);
+			}
+		}
+		else
+		{
+			AQAAC_WindowFalling(overlap, NULL, block + n, decoder->mLongSlopes[shape], n);
+		}
+	}
+	
+	channel->mPreviousWindowShape = shape;
+}
+
+// Skips a program_config_element; the channel configuration already says the layout
+static
+void AQAAC_SkipProgramConfig(struct AQAACBits * bits)
+{
+	AQAACBits_Skip(bits, 4 + 2 + 4);
+	
+	UInt32 numFront = AQAACBits_Read(bits, 4);
+	UInt32 numSide = AQAACBits_Read(bits, 4);
+	UInt32 numBack = AQAACBits_Read(bits, 4);
+	UInt32 numLFE = AQAACBits_Read(bits, 2);
+	UInt32 numAssociatedData = AQAACBits_Read(bits, 3);
+	UInt32 numCoupling = AQAACBits_Read(bits, 4);
+	UInt32 k;
+	
+	// Mono, stereo and matrix mixdowns, each a flag and its element
+	for (k = 0; k < 3; k++)
+	{
+		if (AQAACBits_Read(bits, 1))
+		{
+			AQAACBits_Skip(bits, k < 2 ? 4 : 3);
+		}
+	}
+	
+	for (k = 0; k < numFront + numSide + numBack; k++)
+	{
+		AQAACBits_Skip(bits, 5);
+	}
+	
+	for (k = 0; k < numLFE + numAssociatedData; k++)
+	{
+		AQAACBits_Skip(bits, 4);
+	}
+	
+	for (k = 0; k < numCoupling; k++)
+	{
+		AQAACBits_Skip(bits, 5);
+	}
+	
+	AQAACBits_ByteAlign(bits);
+	AQAACBits_SkipBytes(bits, AQAACBits_Read(bits, 8));
+}
+
+// raw_data_block: every element up to ID_END, the channels' spectra into mOutput
+static
+bool AQAACDecoder_DecodeBlock(struct AQAACDecoder * decoder, struct AQAACBits * bits)
+{
+	UInt32 numChannels = decoder->mConfig.mNumChannels;
+	UInt32 numDecoded = 0;
+	UInt32 element, ch, band, group;
+	
+	while ((element = AQAACBits_Read(bits, 3)) != kAACElementEND && !bits->mIsPastEnd)
+	{
+		if (element == kAACElementSCE || element == kAACElementLFE)
+		{
+			AQAACBits_Skip(bits, 4);
+			
+			if (numDecoded + 1 > numChannels ||
+				!AQAACDecoder_ReadChannel(decoder, bits, &decoder->mChannels[numDecoded], false))
+			{
+				return false;
+			}
+			
+			numDecoded++;
+		}
+		else if (element == kAACElementCPE)
+		{
+			struct AQAACChannel * left = &decoder->mChannels[numDecoded];
+			struct AQAACChannel * right = left + 1;
+			
+			AQAACBits_Skip(bits, 4);
+			
+			if (numDecoded + 2 > numChannels)
+			{
+				return false;
+			}
+			
+			bool isCommonWindow = AQAACBits_Read(bits, 1);
+			
+			decoder->mMSMaskPresent = 0;
+			
+			if (isCommonWindow)
+			{
+				if (!AQAACDecoder_ReadWindowInfo(decoder, bits, &left->mInfo))
+				{
+					return false;
+				}
+				
+				right->mInfo = left->mInfo;
+				decoder->mMSMaskPresent = AQAACBits_Read(bits, 2);
+				
+				if (decoder->mMSMaskPresent == 3)
+				{
+					return false;
+				}
+				
+				for (group = 0; group < left->mInfo.mNumGroups; group++)
+				{
+					for (band = 0; band < left->mInfo.mMaxBand; band++)
+					{
+						decoder->mMSUsed[group][band] = decoder->mMSMaskPresent == 2 ? 1 : decoder->mMSMaskPresent == 1 ? (UInt8) AQAACBits_Read(bits, 1) : 0;
+					}
+				}
+			}
+			
+			if (!AQAACDecoder_ReadChannel(decoder, bits, left, isCommonWindow) ||
+				!AQAACDecoder_ReadChannel(decoder, bits, right, isCommonWindow))
+			{
+				return false;
+			}
+			
+			if (isCommonWindow)
+			{
+				AQAACDecoder_ApplyStereo(decoder, left, right);
+			}
+			
+			numDecoded += 2;
+		}
+		else if (element == kAACElementDSE)
+		{
+			AQAACBits_Skip(bits, 4);
+			
+			bool isAligned = AQAACBits_Read(bits, 1);
+			UInt32 count = AQAACBits_Read(bits, 8);
+			
+			if (count == 255)
+			{
+				count += AQAACBits_Read(bits, 8);
+			}
+			
+			if (isAligned)
+			{
+				AQAACBits_ByteAlign(bits);
+			}
+			
+			AQAACBits_SkipBytes(bits, count);
+		}
+		else if (element == kAACElementPCE)
+		{
+			AQAAC_SkipProgramConfig(bits);
+		}
+		else if (element == kAACElementFIL)
+		{
+			UInt32 count = AQAACBits_Read(bits, 4);
+			
+			if (count == 15)
+			{
+				count += AQAACBits_Read(bits, 8) - 1;
+			}
+			
+			AQAACBits_SkipBytes(bits, count);
+		}
+		else
+		{
+			// Coupling channel elements, kAACElementCCE, are not decoded
+			return false;
+		}
+	}
+	
+	if (bits->mIsPastEnd || numDecoded != numChannels)
+	{
+		return false;
+	}
+	
+	AQAACBits_ByteAlign(bits);
+	
+	for (ch = 0; ch < numChannels; ch++)
+	{
+		struct AQAACChannel * channel = &decoder->mChannels[ch];
+		
+		if (channel->mTNS.mIsPresent)
+		{
+			AQAACChannel_ApplyTNS(decoder, channel);
+		}
+		
+		AQAACDecoder_Filterbank(decoder, channel, decoder->mOutput + (size_t) ch * kAQAACFramesPerPacket);
+	}
+	
+	return true;
+}
+
+// mOutput, in stream order, to interleaved frames in WAVE order
+static
+void AQAACDecoder_Interleave(const struct AQAACDecoder * decoder, Float32 * out)
+{
+	UInt32 numChannels = decoder->mConfig.mNumChannels;
+	const UInt8 * order = kAACChannelOrders[decoder->mConfig.mChannelConfiguration];
+	const Float32 * planar = decoder->mOutput;
+	UInt32 k, ch;
+	
+	if (numChannels == 2)
+	{
+		for (k = 0; k < kAQAACFramesPerPacket; k += AQ_SIMD_WIDTH)
+		{
+			AQFloat4_StoreInterleaved(out + 2 * k, AQFloat4_Load(planar + k), AQFloat4_Load(planar + kAQAACFramesPerPacket + k));
+		}
+		
+		return;
+	}
+	
+	for (k = 0; k < kAQAACFramesPerPacket; k++)
+	{
+		for (ch = 0; ch < numChannels; ch++)
+		{
+			out[k * numChannels + order[ch]] = planar[(size_t) ch * kAQAACFramesPerPacket + k];
+		}
+	}
+}
+
+// Decodes the raw data block at the start of data into out, silence if it does not
+// decode, and returns its size in bytes
+static
+UInt32 AQAACDecoder_DecodeBlockAt(struct AQAACDecoder * decoder, const UInt8 * data, UInt32 size, Float32 * out)
+{
+	struct AQAACBits bits;
+	
+	AQ_TRACE_SCOPE("decode", size);
+	
+	AQAACBits_Init(&bits, data, size);
+	
+	if (AQAACDecoder_DecodeBlock(decoder, &bits))
+	{
+		AQAACDecoder_Interleave(decoder, out);
+		return AQAACBits_GetPosition(&bits) / 8;
+	}
+	
+	// Whatever overlap the bad block would have left is gone
+	memset(out, 0, (size_t) kAQAACFramesPerPacket * decoder->mConfig.mNumChannels * sizeof(Float32));
+	AQAACDecoder_Reset(decoder);
+	
+	return size;
+}
+
+UInt32 AQAACDecoder_DecodePacket(struct AQAACDecoder * decoder, const void * packet, UInt32 size, Float32 * out)
+{
+	AQAACDecoder_DecodeBlockAt(decoder, (const UInt8 *) packet, size, out);
+	
+	return kAQAACFramesPerPacket;
+}
+
+void AQAACDecoder_Reset(struct AQAACDecoder * decoder)
+{
+	UInt32 ch;
+	
+	for (ch = 0; ch < decoder->mConfig.mNumChannels; ch++)
+	{
+		memset(decoder->mChannels[ch].mOverlap, 0, kAQAACFramesPerPacket * sizeof(Float32));
+		decoder->mChannels[ch].mPreviousWindowShape = 0;
+	}
+	
+	decoder->mRandomState = 0x1f2e3d4c;
+}
+
+void AQAACDecoder_Dispose(struct AQAACDecoder * decoder)
+{
+	AQMDCTPlan_CleanUp(&decoder->mMDCT[0]);
+	AQMDCTPlan_CleanUp(&decoder->mMDCT[1]);
+	AQArena_CleanUp(&decoder->mArena);
+	free(decoder);
+}
+
+static
+bool AQADTS_ParseHeader(const UInt8 * h, struct AQADTSHeader * header)
+{
+	// Sync word, then MPEG version, layer 0
+	if (h[0] != 0xff || (h[1] & 0xf6) != 0xf0)
+	{
+		return false;
+	}
+	
+	header->mHasCRC = !(h[1] & 0x01);
+	header->mObjectType = (h[2] >> 6) + 1;
+	header->mSampleRateIndex = (h[2] >> 2) & 0x0f;
+	header->mChannelConfiguration = ((h[2] & 0x01) << 2) | (h[3] >> 6);
+	header->mFrameSize = ((h[3] & 0x03) << 11) | (h[4] << 3) | (h[5] >> 5);
+	header->mNumBlocks = (h[6] & 0x03) + 1;
+	
+	return header->mSampleRateIndex < kAQAACNumSampleRates &&
+		   header->mFrameSize > kADTSHeaderSize + (header->mHasCRC ? 2 : 0);
+}
+
+// Reads the next ADTS frame of the file's configuration into mFrame, skipping
+// anything in between
+static
+bool AQAACFile_ReadFrame(struct AQAACFile * file, struct AQADTSHeader * header)
+{
+	UInt8 * h = file->mFrame;
+	
+	if (fread(h, 1, kADTSHeaderSize, file->mFile) != kADTSHeaderSize)
+	{
+		return false;
+	}
+	
+	while (!AQADTS_ParseHeader(h, header) ||
+		   header->mObjectType != file->mConfig.mObjectType ||
+		   header->mSampleRateIndex != file->mConfig.mSampleRateIndex ||
+		   header->mChannelConfiguration != file->mConfig.mChannelConfiguration)
+	{
+		memmove(h, h + 1, kADTSHeaderSize - 1);
+		
+		if (fread(h + kADTSHeaderSize - 1, 1, 1, file->mFile) != 1)
+		{
+			return false;
+		}
+	}
+	
+	UInt32 bodySize = header->mFrameSize - kADTSHeaderSize;
+	
+	return fread(h + kADTSHeaderSize, 1, bodySize, file->mFile) == bodySize;
+}
+
+// Where the first raw data block of an ADTS frame starts
+static
+UInt32 AQADTS_GetFirstBlockOffset(const struct AQADTSHeader * header)
+{
+	// With a CRC, the positions of the blocks after the first precede it
+	return kADTSHeaderSize + (header->mHasCRC ? 2 * header->mNumBlocks : 0);
+}
+
+// Decodes the raw data block at blockOffset of an ADTS frame into out and returns where
+// the next one starts, given how many blocks come after this one
+static
+UInt32 AQAACDecoder_DecodeFrameBlock(struct AQAACDecoder * decoder, const UInt8 * frame, UInt32 frameSize,
+									 bool hasCRC, UInt32 blockOffset, UInt32 numBlocksLeft, Float32 * out)
+{
+	UInt32 size = frameSize > blockOffset ? frameSize - blockOffset : 0;
+	
+	blockOffset += AQAACDecoder_DecodeBlockAt(decoder, frame + blockOffset, size, out);
+	
+	// Blocks of a frame with a CRC are followed by one apiece
+	if (hasCRC && numBlocksLeft > 0)
+	{
+		blockOffset += 2;
+	}
+	
+	return blockOffset;
+}
+
+// Decodes the next raw data block into mOutput
+static
+bool AQAACFile_DecodeNext(struct AQAACFile * file)
+{
+	if (file->mNumBlocksLeft == 0)
+	{
+		struct AQADTSHeader header;
+		
+		if (!AQAACFile_ReadFrame(file, &header))
+		{
+			return false;
+		}
+		
+		file->mFrameSize = header.mFrameSize;
+		file->mNumBlocksLeft = header.mNumBlocks;
+		file->mHasCRC = header.mHasCRC;
+		file->mBlockOffset = AQADTS_GetFirstBlockOffset(&header);
+	}
+	
+	file->mNumBlocksLeft--;
+	file->mBlockOffset = AQAACDecoder_DecodeFrameBlock(file->mDecoder, file->mFrame, file->mFrameSize, file->mHasCRC,
+													   file->mBlockOffset, file->mNumBlocksLeft, file->mOutput);
+	
+	return true;
+}
+
+// Frames in the whole file, and the largest ADTS frame, from the ADTS headers
+static
+void AQAACFile_CountFrames(struct AQAACFile * file)
+{
+	struct AQADTSHeader header;
+	UInt8 h[kADTSHeaderSize];
+	
+	UInt64 numFrames = 0;
+	
+	file->mInfo.mMaxPacketSize = 0;
+	
+	while (fread(h, 1, kADTSHeaderSize, file->mFile) == kADTSHeaderSize &&
+		   AQADTS_ParseHeader(h, &header) &&
+		   fseeko(file->mFile, header.mFrameSize - kADTSHeaderSize, SEEK_CUR) == 0)
+	{
+		numFrames += header.mNumBlocks * kAQAACFramesPerPacket;
+		
+		if (header.mFrameSize > file->mInfo.mMaxPacketSize)
+		{
+			file->mInfo.mMaxPacketSize = header.mFrameSize;
+		}
+	}
+	
+	file->mInfo.mPrimingFrames = numFrames < kAQAACPrimingFrames ? (UInt32) numFrames : kAQAACPrimingFrames;
+	file->mInfo.mRemainderFrames = 0;
+	file->mInfo.mNumFrames = numFrames - file->mInfo.mPrimingFrames - file->mInfo.mRemainderFrames;
+}
+
+struct AQAACFile * AQAACFile_Open(const char path[])
+{
+	struct AQAACFile * file = (struct AQAACFile *) calloc(1, sizeof(struct AQAACFile));
+	struct AQADTSHeader header;
+	UInt8 h[kADTSHeaderSize];
+	
+	AQ_TRACE_SCOPE("open", 0);
+	
+	if (!(file->mFile = fopen(path, "rb")) ||
+		fread(h, 1, kADTSHeaderSize, file->mFile) != kADTSHeaderSize ||
+		!AQADTS_ParseHeader(h, &header))
+	{
+		AQAACFile_Close(file);
+		return NULL;
+	}
+	
+	// The first header stands for the magic cookie a container would carry
+	UInt8 cookie[2];
+	
+	cookie[0] = (UInt8) (header.mObjectType << 3 | header.mSampleRateIndex >> 1);
+	cookie[1] = (UInt8) ((header.mSampleRateIndex & 1) << 7 | header.mChannelConfiguration << 3);
+	
+	if (!AQAACConfig_Parse(&file->mConfig, cookie, sizeof(cookie)))
+	{
+		AQAACFile_Close(file);
+		return NULL;
+	}
+	
+	file->mDecoder = AQAACDecoder_Create(&file->mConfig);
+	file->mOutput = (Float32 *) malloc((size_t) kAQAACFramesPerPacket * file->mConfig.mNumChannels * sizeof(Float32));
+	
+	file->mInfo.mNumChannels = file->mConfig.mNumChannels;
+	file->mInfo.mSampleRate = file->mConfig.mSampleRate;
+	
+	rewind(file->mFile);
+	AQAACFile_CountFrames(file);
+	
+	AQAACFile_Rewind(file);
+	
+	return file;
+}
+
+const struct AQAACInfo * AQAACFile_GetInfo(const struct AQAACFile * file)
+{
+	return &file->mInfo;
+}
+
+UInt32 AQAACFile_Read(struct AQAACFile * file, Float32 * out, UInt32 numFrames)
+{
+	UInt32 numChannels = file->mInfo.mNumChannels;
+	UInt64 endPosition = file->mInfo.mPrimingFrames + file->mInfo.mNumFrames;
+	UInt32 numRead = 0;
+	
+	while (numRead < numFrames && file->mPosition < endPosition)
+	{
+		if (file->mOutputPosition == file->mNumOutputFrames)
+		{
+			if (!AQAACFile_DecodeNext(file))
+			{
+				break;
+			}
+			
+			file->mNumOutputFrames = kAQAACFramesPerPacket;
+			file->mOutputPosition = 0;
+		}
+		
+		UInt32 count = file->mNumOutputFrames - file->mOutputPosition;
+		
+		// The priming is decoded for its overlap, not read
+		if (file->mPosition < file->mInfo.mPrimingFrames)
+		{
+			count = file->mInfo.mPrimingFrames - file->mPosition < count ? (UInt32) (file->mInfo.mPrimingFrames - file->mPosition) : count;
+			
+			file->mOutputPosition += count;
+			file->mPosition += count;
+			continue;
+		}
+		
+		count = count < numFrames - numRead ? count : numFrames - numRead;
+		count = endPosition - file->mPosition < count ? (UInt32) (endPosition - file->mPosition) : count;
+		
+		memcpy(out + (size_t) numRead * numChannels,
+			   file->mOutput + (size_t) file->mOutputPosition * numChannels,
+			   (size_t) count * numChannels * sizeof(Float32));
+		
+		file->mOutputPosition += count;
+		file->mPosition += count;
+		numRead += count;
+	}
+	
+	return numRead;
+}
+
+bool AQAACFile_Rewind(struct AQAACFile * file)
+{
+	AQAACDecoder_Reset(file->mDecoder);
+	
+	file->mNumBlocksLeft = 0;
+	file->mNumOutputFrames = 0;
+	file->mOutputPosition = 0;
+	file->mPosition = 0;
+	
+	return fseeko(file->mFile, 0, SEEK_SET) == 0;
+}
+
+bool AQAACFile_IndexFrames(struct AQAACFile * file)
+{
+	if (file->mIndex)
+	{
+		return true;
+	}
+	
+	AQ_TRACE_SCOPE("index", 0);
+	
+	struct AQADTSHeader header;
+	UInt8 h[kADTSHeaderSize];
+	UInt32 capacity = 1024;
+	UInt32 numEntries = 0;
+	UInt64 offset = 0;
+	UInt64 packet = 0;
+	int fd = fileno(file->mFile);
+	
+	file->mIndex = (struct AQAACFrameEntry *) malloc(capacity * sizeof(struct AQAACFrameEntry));
+	
+	// As far as AQAACFile_CountFrames counted, which stops at the first damaged header
+	while (pread(fd, h, kADTSHeaderSize, (off_t) offset) == (ssize_t) kADTSHeaderSize && AQADTS_ParseHeader(h, &header))
+	{
+		// One more than the frames, for the end
+		if (numEntries + 1 == capacity)
+		{
+			capacity *= 2;
+			file->mIndex = (struct AQAACFrameEntry *) realloc(file->mIndex, capacity * sizeof(struct AQAACFrameEntry));
+		}
+		
+		file->mIndex[numEntries].mOffset = offset;
+		file->mIndex[numEntries].mFirstPacket = packet;
+		numEntries++;
+		
+		offset += header.mFrameSize;
+		packet += header.mNumBlocks;
+	}
+	
+	if (numEntries == 0)
+	{
+		free(file->mIndex);
+		file->mIndex = NULL;
+		return false;
+	}
+	
+	file->mIndex[numEntries].mOffset = offset;
+	file->mIndex[numEntries].mFirstPacket = packet;
+	file->mNumIndexEntries = numEntries;
+	
+	return true;
+}
+
+UInt32 AQAACFile_ReadAt(const struct AQAACFile * file, UInt64 frame, Float32 * out, UInt32 numFrames)
+{
+	const struct AQAACFrameEntry * index = file->mIndex;
+	UInt32 numChannels = file->mInfo.mNumChannels;
+	
+	if (!index || frame >= file->mInfo.mNumFrames)
+	{
+		return 0;
+	}
+	
+	if (numFrames > file->mInfo.mNumFrames - frame)
+	{
+		numFrames = (UInt32) (file->mInfo.mNumFrames - frame);
+	}
+	
+	// From here on frames count the priming
+	frame += file->mInfo.mPrimingFrames;
+	
+	// Decoding starts a packet early, so the first one wanted has the overlap it needs
+	UInt64 preRollPacket = frame / kAQAACFramesPerPacket > 0 ? frame / kAQAACFramesPerPacket - 1 : 0;
+	UInt32 low = 0;
+	UInt32 high = file->mNumIndexEntries - 1;
+	
+	// The last ADTS frame starting at or before the pre-roll packet
+	while (low < high)
+	{
+		UInt32 middle = (low + high + 1) / 2;
+		
+		if (index[middle].mFirstPacket <= preRollPacket)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+	
+	struct AQAACDecoder * decoder = AQAACDecoder_Create(&file->mConfig);
+	UInt8 * data = (UInt8 *) malloc(kADTSMaxFrameSize);
+	Float32 * block = (Float32 *) malloc((size_t) kAQAACFramesPerPacket * numChannels * sizeof(Float32));
+	const struct AQAACFrameEntry * entry = index + low;
+	int fd = fileno(file->mFile);
+	UInt32 numRead = 0;
+	
+	for (; numRead < numFrames && entry < index + file->mNumIndexEntries; entry++)
+	{
+		struct AQADTSHeader header;
+		UInt32 frameSize = (UInt32) (entry[1].mOffset - entry->mOffset);
+		UInt64 packet = entry->mFirstPacket;
+		
+		if (frameSize > kADTSMaxFrameSize ||
+			pread(fd, data, frameSize, (off_t) entry->mOffset) != (ssize_t) frameSize ||
+			!AQADTS_ParseHeader(data, &header))
+		{
+			break;
+		}
+		
+		UInt32 blockOffset = AQADTS_GetFirstBlockOffset(&header);
+		UInt32 numBlocksLeft = header.mNumBlocks;
+		
+		for (; numBlocksLeft > 0 && numRead < numFrames; packet++)
+		{
+			UInt64 position = frame + numRead;
+			
+			numBlocksLeft--;
+			blockOffset = AQAACDecoder_DecodeFrameBlock(decoder, data, frameSize, header.mHasCRC, blockOffset, numBlocksLeft, block);
+			
+			// The pre-roll, and anything else before frame, is only decoded for its overlap
+			if ((packet + 1) * kAQAACFramesPerPacket <= position)
+			{
+				continue;
+			}
+			
+			UInt32 first = (UInt32) (position - packet * kAQAACFramesPerPacket);
+			UInt32 count = kAQAACFramesPerPacket - first < numFrames - numRead ? kAQAACFramesPerPacket - first : numFrames - numRead;
+			
+			memcpy(out + (size_t) numRead * numChannels, block + (size_t) first * numChannels, (size_t) count * numChannels * sizeof(Float32));
+			numRead += count;
+		}
+	}
+	
+	AQAACDecoder_Dispose(decoder);
+	free(data);
+	free(block);
+	
+	return numRead;
+}
+
+void AQAACFile_Close(struct AQAACFile * file)
+{
+	if (file->mDecoder)
+	{
+		AQAACDecoder_Dispose(file->mDecoder);
+	}
+	
+	if (file->mFile)
+	{
+		fclose(file->mFile);
+	}
+	
+	free(file->mIndex);
+	free(file->mOutput);
+	free(file);
+}
@@ -0,0 +1,115 @@
+//
+//  AQAAC.h
+//  PlayingAudioExample
+//
+
+/* AAC-LC decoder, for hosts where no system codec sits behind AudioQueue.
+ *
+ * AQAACDecoder takes the stream's magic cookie, either the AudioSpecificConfig
+ * itself or the MPEG-4 elementary stream descriptor that
+ * kAudioFilePropertyMagicCookieData yields, and decodes raw access units of
+ * kAQAACFramesPerPacket frames. AQAACFile reads ADTS files (.aac) on top of
+ * it, turning each frame header into the same AudioSpecificConfig.
+ *
+ * Huffman decoding and the scalefactors are serial and stay scalar. The
+ * inverse quantization gains, mid/side and intensity stereo, windowing,
+ * overlap-add and interleaving run AQ_SIMD_WIDTH values at a time, and the
+ * filterbank's inverse MDCT goes through AQMDCT. Temporal noise shaping and
+ * perceptual noise substitution are decoded; the main and LTP profiles'
+ * prediction, SBR and coupling channels are not.
+ */
+
+#ifndef AQAAC_h
+#define AQAAC_h
+
+#include "AQTypes.h"
+
+static const UInt32 kAQAACFramesPerPacket = 1024;
+
+// Frames AudioToolbox's encoder decodes to ahead of the first frame it was given
+static const UInt32 kAQAACPrimingFrames = 2048;
+
+struct AQAACConfig
+{
+	UInt32 mObjectType;
+	UInt32 mSampleRateIndex;
+	UInt32 mSampleRate;
+	
+	/* Description:
+	 * 1 to 7, and the channels it implies. Output is in WAVE order, L R C LFE
+	 * Ls Rs [Lb Rb], whatever order the stream sends its elements in.
+	 */
+	UInt32 mChannelConfiguration;
+	UInt32 mNumChannels;
+};
+
+// Parses a magic cookie. False for anything but AAC-LC at 1024 frames per packet
+// with one of the standard channel configurations.
+bool AQAACConfig_Parse(struct AQAACConfig * config, const void * cookie, UInt32 cookieSize);
+
+struct AQAACDecoder;
+
+struct AQAACDecoder * AQAACDecoder_Create(const struct AQAACConfig * config);
+
+// Decodes one access unit into kAQAACFramesPerPacket interleaved float frames.
+// A packet that does not decode comes out as silence; returns the frames written.
+UInt32 AQAACDecoder_DecodePacket(struct AQAACDecoder * decoder, const void * packet, UInt32 size, Float32 * out);
+
+// Forgets the overlap of previous packets, before decoding from somewhere else
+void AQAACDecoder_Reset(struct AQAACDecoder * decoder);
+
+void AQAACDecoder_Dispose(struct AQAACDecoder * decoder);
+
+struct AQAACInfo
+{
+	UInt32 mNumChannels;
+	UInt32 mSampleRate;
+	
+	/* Description:
+	 * kAQAACFramesPerPacket for each raw data block of the file's ADTS frames,
+	 * counted up to the first damaged header, less the priming and remainder
+	 * frames, which AQAACFile_Read and AQAACFile_ReadAt leave out.
+	 */
+	UInt64 mNumFrames;
+	
+	/* Description:
+	 * The encoder's frames before the first and after the last frame of audio,
+	 * as in an AudioFilePacketTableInfo. ADTS records neither: the priming is
+	 * kAQAACPrimingFrames, and the remainder, the padding of the last packet,
+	 * is 0 since nothing in the file tells it apart from audio.
+	 */
+	UInt32 mPrimingFrames;
+	UInt32 mRemainderFrames;
+	
+	/* Description:
+	 * Bytes in the largest of those ADTS frames, header included.
+	 */
+	UInt32 mMaxPacketSize;
+};
+
+struct AQAACFile;
+
+// NULL if the file is not ADTS AAC-LC
+struct AQAACFile * AQAACFile_Open(const char path[]);
+
+const struct AQAACInfo * AQAACFile_GetInfo(const struct AQAACFile * file);
+
+// Decodes up to numFrames interleaved float frames into out and returns the number
+// decoded, 0 at the end of the stream
+UInt32 AQAACFile_Read(struct AQAACFile * file, Float32 * out, UInt32 numFrames);
+
+// Starts decoding over from the first frame
+bool AQAACFile_Rewind(struct AQAACFile * file);
+
+// Finds every ADTS frame, once, before AQAACFile_ReadAt. False if there are none.
+bool AQAACFile_IndexFrames(struct AQAACFile * file);
+
+// Decodes up to numFrames interleaved float frames from frame on into out, leaving the
+// position of AQAACFile_Read alone. Needs AQAACFile_IndexFrames; safe to call from
+// several threads at once. Blocks overlap their neighbours, so each call decodes the
+// packet before frame's as well, and throws it away.
+UInt32 AQAACFile_ReadAt(const struct AQAACFile * file, UInt64 frame, Float32 * out, UInt32 numFrames);
+
+void AQAACFile_Close(struct AQAACFile * file);
+
+#endif /* AQAAC_h */
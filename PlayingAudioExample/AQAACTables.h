@@ -0,0 +1,52 @@
+//
+//  AQAACTables.h
+//  PlayingAudioExample
+//
+
+/* Constant tables of the AAC syntax that AQAAC decodes with: the Huffman
+ * codebooks of scalefactors and spectral data, and the scalefactor bands of
+ * each sampling frequency.
+ */
+
+#ifndef AQAACTables_h
+#define AQAACTables_h
+
+#include "AQTypes.h"
+
+static const UInt32 kAQAACNumSampleRates = 12;
+
+struct AQAACHuffmanTable
+{
+	UInt32 mNumCodes;
+	const UInt8 * mLengths;
+	const UInt32 * mCodes;
+};
+
+struct AQAACBandTable
+{
+	UInt32 mSampleRate;
+	
+	/* Description:
+	 * Scalefactor bands of long and short windows, and their offsets: one more
+	 * than the number of bands, the last one being the window size.
+	 */
+	UInt32 mNumLongBands;
+	const UInt16 * mLongOffsets;
+	UInt32 mNumShortBands;
+	const UInt16 * mShortOffsets;
+	
+	/* Description:
+	 * The bands a TNS filter may reach in long and short windows.
+	 */
+	UInt32 mTNSMaxBands[2];
+};
+
+extern const struct AQAACHuffmanTable kAQAACScalefactorTable;
+
+// Spectral codebooks 1 to 11, codebook n at n - 1
+extern const struct AQAACHuffmanTable kAQAACSpectralTables[11];
+
+// By sampling frequency index
+extern const struct AQAACBandTable kAQAACBandTables[kAQAACNumSampleRates];
+
+#endif /* AQAACTables_h */
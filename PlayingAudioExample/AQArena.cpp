@@ -0,0 +1,150 @@
+//
+//  AQArena.cpp
+//  PlayingAudioExample
+//
+
+#include "AQArena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Aligned so that the data following each header starts aligned too
+struct alignas(kAQArenaAlignment) AQArenaBlock
+{
+	struct AQArenaBlock * mNext;
+	size_t mCapacity;
+	size_t mUsed;
+};
+
+static
+size_t AQArena_Align(size_t size)
+{
+	return (size + kAQArenaAlignment - 1) & ~(kAQArenaAlignment - 1);
+}
+
+static
+UInt8 * AQArenaBlock_Data(struct AQArenaBlock * block)
+{
+	return (UInt8 *) (block + 1);
+}
+
+static
+struct AQArenaBlock * AQArena_AddBlock(struct AQArena * arena, size_t capacity)
+{
+	struct AQArenaBlock * block = NULL;
+	
+	if (posix_memalign((void **) &block, kAQArenaAlignment, sizeof(struct AQArenaBlock) + capacity) != 0)
+	{
+		return NULL;
+	}
+	
+	block->mNext = arena->mBlocks;
+	block->mCapacity = capacity;
+	block->mUsed = 0;
+	
+	arena->mBlocks = block;
+	arena->mBytesReserved += capacity;
+	
+	return block;
+}
+
+void AQArena_Init(struct AQArena * arena, size_t blockSize)
+{
+	memset(arena, 0, sizeof(struct AQArena));
+	
+	arena->mBlockSize = AQArena_Align(blockSize);
+}
+
+void AQArena_CleanUp(struct AQArena * arena)
+{
+	struct AQArenaBlock * block = arena->mBlocks;
+	
+	while (block)
+	{
+		struct AQArenaBlock * next = block->mNext;
+		
+		free(block);
+		block = next;
+	}
+	
+	arena->mBlocks = NULL;
+	arena->mBytesUsed = 0;
+	arena->mBytesReserved = 0;
+}
+
+void AQArena_Reset(struct AQArena * arena)
+{
+	struct AQArenaBlock * keep = NULL;
+	struct AQArenaBlock * block = arena->mBlocks;
+	
+	// Keep the largest block, which is the one most likely to fit everything next time
+	while (block)
+	{
+		struct AQArenaBlock * next = block->mNext;
+		
+		if (!keep || block->mCapacity > keep->mCapacity)
+		{
+			free(keep);
+			keep = block;
+		}
+		else
+		{
+			free(block);
+		}
+		
+		block = next;
+	}
+	
+	arena->mBlocks = keep;
+	arena->mBytesUsed = 0;
+	arena->mBytesReserved = 0;
+	
+	if (keep)
+	{
+		keep->mNext = NULL;
+		keep->mUsed = 0;
+		arena->mBytesReserved = keep->mCapacity;
+	}
+}
+
+void * AQArena_Alloc(struct AQArena * arena, size_t size)
+{
+	struct AQArenaBlock * block = arena->mBlocks;
+	size_t blockSize = arena->mBlockSize ? arena->mBlockSize : kAQArenaDefaultBlockSize;
+	
+	size = AQArena_Align(size > 0 ? size : 1);
+	
+	if (!block || block->mCapacity - block->mUsed < size)
+	{
+		block = AQArena_AddBlock(arena, size > blockSize ? size : blockSize);
+		
+		if (!block)
+		{
+			return NULL;
+		}
+	}
+	
+	void * result = AQArenaBlock_Data(block) + block->mUsed;
+	
+	block->mUsed += size;
+	arena->mBytesUsed += size;
+	
+	return result;
+}
+
+void * AQArena_Calloc(struct AQArena * arena, size_t count, size_t size)
+{
+	if (size != 0 && count > (size_t) -1 / size)
+	{
+		return NULL;
+	}
+	
+	void * result = AQArena_Alloc(arena, count * size);
+	
+	if (result)
+	{
+		memset(result, 0, count * size);
+	}
+	
+	return result;
+}
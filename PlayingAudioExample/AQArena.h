@@ -0,0 +1,60 @@
+//
+//  AQArena.h
+//  PlayingAudioExample
+//
+
+/* Bump allocation for state that lives as long as its owner. Allocations are
+ * carved out of a few large blocks and are never freed one by one; the whole
+ * arena goes in a single AQArena_CleanUp, or is emptied for reuse with
+ * AQArena_Reset. Not thread safe.
+ */
+
+#ifndef AQArena_h
+#define AQArena_h
+
+#include <stddef.h>
+
+#include "AQTypes.h"
+
+static const size_t kAQArenaDefaultBlockSize = 64 * 1024;
+
+// Every allocation is aligned for any scalar or SIMD vector the DSP stages use
+static const size_t kAQArenaAlignment = 16;
+
+struct AQArenaBlock;
+
+/* Description:
+ * A zeroed arena is empty and uses kAQArenaDefaultBlockSize.
+ */
+struct AQArena
+{
+	/* Description:
+	 * Blocks newest first; only the newest one is allocated from.
+	 */
+	struct AQArenaBlock * mBlocks;
+	
+	size_t mBlockSize;
+	
+	/* Description:
+	 * Bytes handed out since the last reset, and block memory held from the system.
+	 */
+	size_t mBytesUsed;
+	size_t mBytesReserved;
+};
+
+void AQArena_Init(struct AQArena * arena, size_t blockSize);
+
+// Releases every block
+void AQArena_CleanUp(struct AQArena * arena);
+
+// Invalidates everything allocated, keeping one block to allocate from again
+void AQArena_Reset(struct AQArena * arena);
+
+// Requests larger than the block size get a block of their own. Returns NULL only
+// if the system is out of memory.
+void * AQArena_Alloc(struct AQArena * arena, size_t size);
+
+// Like AQArena_Alloc, zero filled
+void * AQArena_Calloc(struct AQArena * arena, size_t count, size_t size);
+
+#endif /* AQArena_h */
@@ -0,0 +1,813 @@
+//
+//  AQBlockFile.cpp
+//  PlayingAudioExample
+//
+
+#include "AQBlockFile.h"
+#include "AQLZ4.h"
+#include "AQLossless.h"
+#include "AQTrace.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The file, all little endian:
+ *
+ *   header   "AQBF", version, sample rate (Float64), channels, sample type,
+ *            frames per block, alignment, flags, then the header's checksum
+ *            in its last 4 of kBlockFileHeaderSize bytes
+ *   blocks   each at a multiple of kBlockFileAlignment, the gaps zero filled
+ *   index    per block: offset (UInt64), stored size, codec, checksum, reserved
+ *   trailer  "AQBI", blocks, frames (UInt64), index offset (UInt64), the
+ *            index's checksum and the trailer's own
+ *
+ * Checksums are xxHash32 with seed 0. Block checksums are of the stored bytes,
+ * and 0 unless kBlockFileFlag_Checksums is set.
+ */
+
+static const UInt32 kBlockFileVersion = 1;
+
+static const UInt32 kBlockFileHeaderSize = 64;
+static const UInt32 kBlockFileIndexEntrySize = 24;
+static const UInt32 kBlockFileTrailerSize = 32;
+
+static const UInt32 kBlockFileAlignment = 4096;
+
+static const UInt32 kBlockFileFlag_Checksums = 1 << 0;
+
+// Bounds the buffers one block needs
+static const UInt32 kBlockFileMaxFramesPerBlock = 1 << 20;
+static const UInt32 kBlockFileMaxChannels = 64;
+
+struct AQBlockFile
+{
+	struct AQBlockFileInfo mInfo;
+	bool mHasChecksums;
+	
+	const UInt8 * mData;
+	size_t mSize;
+	
+	const UInt8 * mIndex;
+	UInt64 mIndexOffset;
+	
+	/* Description:
+	 * Bytes of raw frames in a full block.
+	 */
+	UInt32 mBlockBytes;
+	
+	/* Description:
+	 * State of AQBlockFile_Read: the next frame, and the frames of the block it is in,
+	 * either in the mapping or decoded into mCache. mCachedBlock is mInfo.mNumBlocks
+	 * when no block is loaded.
+	 */
+	UInt64 mPosition;
+	UInt32 mCachedBlock;
+	const UInt8 * mCachedFrames;
+	UInt8 * mCache;
+};
+
+struct AQBlockFileWriter
+{
+	FILE * mFile;
+	struct AQBlockFileInfo mInfo;
+	AQBlockCodec mCodec;
+	bool mHasChecksums;
+	
+	/* Description:
+	 * Frames of the block being filled, in the file's type, and the compressor's
+	 * output, of AQLZ4_CompressBound of a full block.
+	 */
+	UInt8 * mBlock;
+	UInt32 mNumBlockFrames;
+	UInt8 * mCompressed;
+	UInt32 mCompressedCapacity;
+	
+	/* Description:
+	 * Index entries of the blocks written, as they go in the file.
+	 */
+	UInt8 * mIndex;
+	UInt32 mIndexCapacity;
+	
+	UInt64 mOffset;
+	bool mFailed;
+};
+
+// Everything is little endian in the file; the host is assumed to be too, as in AQPeaks
+static
+UInt32 GetUInt32(const UInt8 * p)
+{
+	return (UInt32) p[0] | (UInt32) p[1] << 8 | (UInt32) p[2] << 16 | (UInt32) p[3] << 24;
+}
+
+static
+UInt64 GetUInt64(const UInt8 * p)
+{
+	return (UInt64) GetUInt32(p) | (UInt64) GetUInt32(p + 4) << 32;
+}
+
+static
+void PutUInt32(UInt8 * p, UInt32 value)
+{
+	p[0] = (UInt8) value;
+	p[1] = (UInt8) (value >> 8);
+	p[2] = (UInt8) (value >> 16);
+	p[3] = (UInt8) (value >> 24);
+}
+
+static
+void PutUInt64(UInt8 * p, UInt64 value)
+{
+	PutUInt32(p, (UInt32) value);
+	PutUInt32(p + 4, (UInt32) (value >> 32));
+}
+
+static const UInt32 kXXH32Prime1 = 2654435761u;
+static const UInt32 kXXH32Prime2 = 2246822519u;
+static const UInt32 kXXH32Prime3 = 3266489917u;
+static const UInt32 kXXH32Prime4 = 668265263u;
+static const UInt32 kXXH32Prime5 = 374761393u;
+
+static inline
+UInt32 RotateLeft(UInt32 value, int count)
+{
+	return value << count | value >> (32 - count);
+}
+
+static inline
+UInt32 XXH32_Round(UInt32 accumulator, const UInt8 * p)
+{
+	UInt32 lane;
+	
+	memcpy(&lane, p, sizeof(lane));
+	
+	return RotateLeft(accumulator + lane * kXXH32Prime2, 13) * kXXH32Prime1;
+}
+
+// xxHash32 with seed 0: four independent lanes, so it runs at several GB/s
+static
+UInt32 XXH32(const void * data, size_t size)
+{
+	const UInt8 * p = (const UInt8 *) data;
+	const UInt8 * end = p + size;
+	UInt32 hash;
+	
+	if (size >= 16)
+	{
+		UInt32 v1 = kXXH32Prime1 + kXXH32Prime2;
+		UInt32 v2 = kXXH32Prime2;
+		UInt32 v3 = 0;
+		UInt32 v4 = 0 - kXXH32Prime1;
+		
+		for (; end - p >= 16; p += 16)
+		{
+			v1 = XXH32_Round(v1, p);
+			v2 = XXH32_Round(v2, p + 4);
+			v3 = XXH32_Round(v3, p + 8);
+			v4 = XXH32_Round(v4, p + 12);
+		}
+		
+		hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+	}
+	else
+	{
+		hash = kXXH32Prime5;
+	}
+	
+	hash += (UInt32) size;
+	
+	for (; end - p >= 4; p += 4)
+	{
+		hash = RotateLeft(hash + GetUInt32(p) * kXXH32Prime3, 17) * kXXH32Prime4;
+	}
+	
+	for (; p < end; p++)
+	{
+		hash = RotateLeft(hash + *p * kXXH32Prime5, 11) * kXXH32Prime1;
+	}
+	
+	hash ^= hash >> 15;
+	hash *= kXXH32Prime2;
+	hash ^= hash >> 13;
+	hash *= kXXH32Prime3;
+	hash ^= hash >> 16;
+	
+	return hash;
+}
+
+static
+bool AQBlockFile_IsStoredType(UInt32 type)
+{
+	return type == kAQSampleType_SInt16 ||
+		   type == kAQSampleType_SInt24 ||
+		   type == kAQSampleType_SInt32 ||
+		   type == kAQSampleType_Float32;
+}
+
+static
+void AQBlockFile_FillInfo(struct AQBlockFileInfo * info, Float64 sampleRate, UInt32 numChannels, AQSampleType type, UInt32 framesPerBlock)
+{
+	info->mLayout.mType = type;
+	info->mLayout.mIsBigEndian = false;
+	info->mLayout.mIsInterleaved = true;
+	info->mLayout.mNumChannels = numChannels;
+	info->mBytesPerFrame = numChannels * AQSampleConvert_BytesPerSample(type);
+	info->mSampleRate = sampleRate;
+	info->mFramesPerBlock = framesPerBlock;
+}
+
+bool AQBlockFile_IsBlockFilePath(const char path[])
+{
+	size_t length = strlen(path);
+	size_t extensionLength = sizeof(kAQBlockFileExtension) - 1;
+	
+	return length > extensionLength && strcasecmp(path + length - extensionLength, kAQBlockFileExtension) == 0;
+}
+
+static
+bool AQBlockFile_ParseHeader(struct AQBlockFile * file)
+{
+	const UInt8 * header = file->mData;
+	UInt64 sampleRateBits;
+	Float64 sampleRate;
+	
+	if (file->mSize < kBlockFileHeaderSize + kBlockFileTrailerSize ||
+		memcmp(header, "AQBF", 4) != 0 ||
+		GetUInt32(header + 4) != kBlockFileVersion ||
+		GetUInt32(header + kBlockFileHeaderSize - 4) != XXH32(header, kBlockFileHeaderSize - 4))
+	{
+		return false;
+	}
+	
+	sampleRateBits = GetUInt64(header + 8);
+	memcpy(&sampleRate, &sampleRateBits, sizeof(sampleRate));
+	
+	UInt32 numChannels = GetUInt32(header + 16);
+	UInt32 type = GetUInt32(header + 20);
+	UInt32 framesPerBlock = GetUInt32(header + 24);
+	
+	if (!(sampleRate > 0) ||
+		numChannels == 0 || numChannels > kBlockFileMaxChannels ||
+		!AQBlockFile_IsStoredType(type) ||
+		framesPerBlock == 0 || framesPerBlock > kBlockFileMaxFramesPerBlock ||
+		GetUInt32(header + 28) != kBlockFileAlignment)
+	{
+		return false;
+	}
+	
+	AQBlockFile_FillInfo(&file->mInfo, sampleRate, numChannels, (AQSampleType) type, framesPerBlock);
+	
+	file->mHasChecksums = (GetUInt32(header + 32) & kBlockFileFlag_Checksums) != 0;
+	file->mBlockBytes = framesPerBlock * file->mInfo.mBytesPerFrame;
+	
+	return true;
+}
+
+static
+bool AQBlockFile_ParseTrailer(struct AQBlockFile * file)
+{
+	const UInt8 * trailer = file->mData + file->mSize - kBlockFileTrailerSize;
+	
+	if (memcmp(trailer, "AQBI", 4) != 0 || GetUInt32(trailer + 28) != XXH32(trailer, 28))
+	{
+		return false;
+	}
+	
+	UInt32 numBlocks = GetUInt32(trailer + 4);
+	UInt64 numFrames = GetUInt64(trailer + 8);
+	UInt64 indexOffset = GetUInt64(trailer + 16);
+	UInt64 framesPerBlock = file->mInfo.mFramesPerBlock;
+	
+	// The index runs from its offset right up to the trailer, and covers every frame
+	if (indexOffset < kBlockFileHeaderSize ||
+		indexOffset > file->mSize - kBlockFileTrailerSize ||
+		(file->mSize - kBlockFileTrailerSize - indexOffset) != (UInt64) numBlocks * kBlockFileIndexEntrySize ||
+		numBlocks != (numFrames + framesPerBlock - 1) / framesPerBlock)
+	{
+		return false;
+	}
+	
+	file->mIndex = file->mData + indexOffset;
+	file->mIndexOffset = indexOffset;
+	
+	if (GetUInt32(trailer + 24) != XXH32(file->mIndex, (size_t) numBlocks * kBlockFileIndexEntrySize))
+	{
+		return false;
+	}
+	
+	file->mInfo.mNumBlocks = numBlocks;
+	file->mInfo.mNumFrames = numFrames;
+	
+	return true;
+}
+
+static
+UInt32 AQBlockFile_NumBlockFrames(const struct AQBlockFile * file, UInt32 block)
+{
+	UInt64 firstFrame = (UInt64) block * file->mInfo.mFramesPerBlock;
+	UInt64 numFrames = file->mInfo.mNumFrames - firstFrame;
+	
+	return numFrames < file->mInfo.mFramesPerBlock ? (UInt32) numFrames : file->mInfo.mFramesPerBlock;
+}
+
+// Where the stored bytes of block are, NULL if its index entry points outside the blocks
+static
+const UInt8 * AQBlockFile_GetStored(const struct AQBlockFile * file, UInt32 block, UInt32 * outSize, UInt32 * outCodec, UInt32 * outChecksum)
+{
+	const UInt8 * entry = file->mIndex + (size_t) block * kBlockFileIndexEntrySize;
+	UInt64 offset = GetUInt64(entry);
+	UInt32 size = GetUInt32(entry + 8);
+	
+	if (offset < kBlockFileHeaderSize || offset > file->mIndexOffset || size > file->mIndexOffset - offset)
+	{
+		return NULL;
+	}
+	
+	*outSize = size;
+	*outCodec = GetUInt32(entry + 12);
+	*outChecksum = GetUInt32(entry + 16);
+	
+	return file->mData + offset;
+}
+
+// The raw frames of block: in the mapping when they are stored as they are, otherwise
+// decoded into scratch, which has room for a full block. Damaged blocks are silence.
+static
+const UInt8 * AQBlockFile_LoadBlock(const struct AQBlockFile * file, UInt32 block, UInt8 * scratch)
+{
+	UInt32 numBytes = AQBlockFile_NumBlockFrames(file, block) * file->mInfo.mBytesPerFrame;
+	UInt32 size, codec, checksum;
+	const UInt8 * stored = AQBlockFile_GetStored(file, block, &size, &codec, &checksum);
+	
+	if (stored && (!file->mHasChecksums || XXH32(stored, size) == checksum))
+	{
+		if (codec == kAQBlockCodec_None && size == numBytes)
+		{
+			return stored;
+		}
+		
+		if (codec == kAQBlockCodec_LZ4)
+		{
+			AQ_TRACE_SCOPE("decode", numBytes / file->mInfo.mBytesPerFrame);
+			
+			if (AQLZ4_Decompress(stored, size, scratch, numBytes) == numBytes)
+			{
+				return scratch;
+			}
+		}
+		
+		if (codec == kAQBlockCodec_Lossless)
+		{
+			AQ_TRACE_SCOPE("decode", numBytes / file->mInfo.mBytesPerFrame);
+			
+			if (AQLossless_Decompress(stored, size, scratch, numBytes / file->mInfo.mBytesPerFrame, &file->mInfo.mLayout))
+			{
+				return scratch;
+			}
+		}
+	}
+	
+	AQTrace_Instant("damaged block", block);
+	
+	// All the stored types are signed, so zero is silence
+	memset(scratch, 0, numBytes);
+	
+	return scratch;
+}
+
+// Asks for the stored bytes of block ahead of reading them
+static
+void AQBlockFile_Prefetch(const struct AQBlockFile * file, UInt32 block)
+{
+	UInt32 size, codec, checksum;
+	const UInt8 * stored = AQBlockFile_GetStored(file, block, &size, &codec, &checksum);
+	
+	if (stored && size > 0)
+	{
+		size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+		size_t start = (size_t) (stored - file->mData) & ~(pageSize - 1);
+		
+		posix_madvise((void *) (file->mData + start), (size_t) (stored - file->mData) + size - start, POSIX_MADV_WILLNEED);
+	}
+}
+
+struct AQBlockFile * AQBlockFile_Open(const char path[])
+{
+	struct AQBlockFile * file = (struct AQBlockFile *) calloc(1, sizeof(struct AQBlockFile));
+	struct stat status;
+	int fd;
+	
+	AQ_TRACE_SCOPE("open", 0);
+	
+	if ((fd = open(path, O_RDONLY)) < 0)
+	{
+		free(file);
+		return NULL;
+	}
+	
+	if (fstat(fd, &status) == 0 && status.st_size > 0)
+	{
+		void * data = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		
+		if (data != MAP_FAILED)
+		{
+			file->mData = (const UInt8 *) data;
+			file->mSize = (size_t) status.st_size;
+		}
+	}
+	
+	// The mapping keeps the file
+	close(fd);
+	
+	if (!file->mData || !AQBlockFile_ParseHeader(file) || !AQBlockFile_ParseTrailer(file))
+	{
+		AQBlockFile_Close(file);
+		return NULL;
+	}
+	
+	file->mCache = (UInt8 *) malloc(file->mBlockBytes);
+	file->mCachedBlock = file->mInfo.mNumBlocks;
+	
+	if (file->mInfo.mNumBlocks > 0)
+	{
+		AQBlockFile_Prefetch(file, 0);
+	}
+	
+	return file;
+}
+
+const struct AQBlockFileInfo * AQBlockFile_GetInfo(const struct AQBlockFile * file)
+{
+	return &file->mInfo;
+}
+
+UInt32 AQBlockFile_Read(struct AQBlockFile * file, void * data, UInt32 numFrames)
+{
+	UInt32 bytesPerFrame = file->mInfo.mBytesPerFrame;
+	UInt32 numRead = 0;
+	
+	while (numRead < numFrames && file->mPosition < file->mInfo.mNumFrames)
+	{
+		UInt32 block = (UInt32) (file->mPosition / file->mInfo.mFramesPerBlock);
+		UInt32 frameInBlock = (UInt32) (file->mPosition - (UInt64) block * file->mInfo.mFramesPerBlock);
+		UInt32 numToCopy = AQBlockFile_NumBlockFrames(file, block) - frameInBlock;
+		
+		if (block != file->mCachedBlock)
+		{
+			file->mCachedFrames = AQBlockFile_LoadBlock(file, block, file->mCache);
+			file->mCachedBlock = block;
+			
+			if (block + 1 < file->mInfo.mNumBlocks)
+			{
+				AQBlockFile_Prefetch(file, block + 1);
+			}
+		}
+		
+		if (numToCopy > numFrames - numRead)
+		{
+			numToCopy = numFrames - numRead;
+		}
+		
+		memcpy((UInt8 *) data + (size_t) numRead * bytesPerFrame, file->mCachedFrames + (size_t) frameInBlock * bytesPerFrame, (size_t) numToCopy * bytesPerFrame);
+		
+		numRead += numToCopy;
+		file->mPosition += numToCopy;
+	}
+	
+	return numRead;
+}
+
+void AQBlockFile_Seek(struct AQBlockFile * file, UInt64 frame)
+{
+	file->mPosition = frame < file->mInfo.mNumFrames ? frame : file->mInfo.mNumFrames;
+}
+
+UInt32 AQBlockFile_ReadAt(const struct AQBlockFile * file, UInt64 frame, void * data, UInt32 numFrames)
+{
+	UInt32 bytesPerFrame = file->mInfo.mBytesPerFrame;
+	UInt8 * scratch = NULL;
+	UInt32 numRead = 0;
+	
+	if (frame >= file->mInfo.mNumFrames)
+	{
+		return 0;
+	}
+	
+	if (numFrames > file->mInfo.mNumFrames - frame)
+	{
+		numFrames = (UInt32) (file->mInfo.mNumFrames - frame);
+	}
+	
+	while (numRead < numFrames)
+	{
+		UInt32 block = (UInt32) (frame / file->mInfo.mFramesPerBlock);
+		UInt32 frameInBlock = (UInt32) (frame - (UInt64) block * file->mInfo.mFramesPerBlock);
+		UInt32 numBlockFrames = AQBlockFile_NumBlockFrames(file, block);
+		UInt32 numToCopy = numBlockFrames - frameInBlock;
+		UInt8 * out = (UInt8 *) data + (size_t) numRead * bytesPerFrame;
+		const UInt8 * frames;
+		
+		if (numToCopy > numFrames - numRead)
+		{
+			numToCopy = numFrames - numRead;
+		}
+		
+		// Whole blocks decode straight into data, the ends of the range go through scratch
+		if (numToCopy == numBlockFrames)
+		{
+			frames = AQBlockFile_LoadBlock(file, block, out);
+		}
+		else
+		{
+			if (!scratch)
+			{
+				scratch = (UInt8 *) malloc(file->mBlockBytes);
+			}
+			
+			frames = AQBlockFile_LoadBlock(file, block, scratch) + (size_t) frameInBlock * bytesPerFrame;
+		}
+		
+		if (frames != out)
+		{
+			memcpy(out, frames, (size_t) numToCopy * bytesPerFrame);
+		}
+		
+		numRead += numToCopy;
+		frame += numToCopy;
+	}
+	
+	free(scratch);
+	
+	return numRead;
+}
+
+void AQBlockFile_Close(struct AQBlockFile * file)
+{
+	if (!file)
+	{
+		return;
+	}
+	
+	if (file->mData)
+	{
+		munmap((void *) file->mData, file->mSize);
+	}
+	
+	free(file->mCache);
+	free(file);
+}
+
+// Rounds and clips numSamples floats to type
+static
+void AQBlockFile_StoreSamples(const Float32 * in, UInt8 * out, UInt32 numSamples, AQSampleType type)
+{
+	UInt32 k;
+	
+	if (type == kAQSampleType_Float32)
+	{
+		memcpy(out, in, (size_t) numSamples * sizeof(Float32));
+		return;
+	}
+	
+	// Full scale is 1.0, as in the convert kernels
+	Float64 scale = type == kAQSampleType_SInt16 ? 32768.0 : type == kAQSampleType_SInt24 ? 8388608.0 : 2147483648.0;
+	UInt32 bytesPerSample = AQSampleConvert_BytesPerSample(type);
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		Float64 value = rint(in[k] * scale);
+		SInt64 sample;
+		
+		if (value >= scale)        sample = (SInt64) scale - 1;
+		else if (value < -scale)   sample = (SInt64) -scale;
+		else if (value == value)   sample = (SInt64) value;
+		else                       sample = 0;
+		
+		UInt32 bits = (UInt32) sample;
+		UInt8 * p = out + (size_t) k * bytesPerSample;
+		
+		p[0] = (UInt8) bits;
+		p[1] = (UInt8) (bits >> 8);
+		
+		if (bytesPerSample > 2)
+		{
+			p[2] = (UInt8) (bits >> 16);
+		}
+		
+		if (bytesPerSample > 3)
+		{
+			p[3] = (UInt8) (bits >> 24);
+		}
+	}
+}
+
+static
+bool AQBlockFileWriter_WriteBytes(struct AQBlockFileWriter * writer, const void * bytes, size_t size)
+{
+	if (!writer->mFailed && fwrite(bytes, 1, size, writer->mFile) != size)
+	{
+		writer->mFailed = true;
+	}
+	
+	writer->mOffset += size;
+	
+	return !writer->mFailed;
+}
+
+// Zeros up to the next multiple of kBlockFileAlignment
+static
+bool AQBlockFileWriter_Align(struct AQBlockFileWriter * writer)
+{
+	static const UInt8 zeros[kBlockFileAlignment] = {0};
+	UInt32 padding = (UInt32) (-writer->mOffset & (kBlockFileAlignment - 1));
+	
+	return AQBlockFileWriter_WriteBytes(writer, zeros, padding);
+}
+
+// Writes out the block being filled, compressed if that is smaller
+static
+bool AQBlockFileWriter_FlushBlock(struct AQBlockFileWriter * writer)
+{
+	UInt32 numBytes = writer->mNumBlockFrames * writer->mInfo.mBytesPerFrame;
+	const UInt8 * stored = writer->mBlock;
+	UInt32 storedSize = numBytes;
+	AQBlockCodec codec = kAQBlockCodec_None;
+	
+	if (writer->mCodec != kAQBlockCodec_None)
+	{
+		AQ_TRACE_SCOPE("encode", writer->mNumBlockFrames);
+		
+		UInt32 compressedSize;
+		
+		if (writer->mCodec == kAQBlockCodec_Lossless && AQLossless_CanCompress(&writer->mInfo.mLayout))
+		{
+			compressedSize = AQLossless_Compress(writer->mBlock, writer->mNumBlockFrames, &writer->mInfo.mLayout, writer->mCompressed, writer->mCompressedCapacity);
+			codec = kAQBlockCodec_Lossless;
+		}
+		else
+		{
+			compressedSize = AQLZ4_Compress(writer->mBlock, numBytes, writer->mCompressed, writer->mCompressedCapacity);
+			codec = kAQBlockCodec_LZ4;
+		}
+		
+		if (compressedSize > 0 && compressedSize < numBytes)
+		{
+			stored = writer->mCompressed;
+			storedSize = compressedSize;
+		}
+		else
+		{
+			codec = kAQBlockCodec_None;
+		}
+	}
+	
+	if (writer->mInfo.mNumBlocks == writer->mIndexCapacity)
+	{
+		writer->mIndexCapacity = writer->mIndexCapacity > 0 ? 2 * writer->mIndexCapacity : 64;
+		writer->mIndex = (UInt8 *) realloc(writer->mIndex, (size_t) writer->mIndexCapacity * kBlockFileIndexEntrySize);
+	}
+	
+	UInt8 * entry = writer->mIndex + (size_t) writer->mInfo.mNumBlocks * kBlockFileIndexEntrySize;
+	
+	PutUInt64(entry, writer->mOffset);
+	PutUInt32(entry + 8, storedSize);
+	PutUInt32(entry + 12, codec);
+	PutUInt32(entry + 16, writer->mHasChecksums ? XXH32(stored, storedSize) : 0);
+	PutUInt32(entry + 20, 0);
+	
+	writer->mInfo.mNumBlocks++;
+	writer->mNumBlockFrames = 0;
+	
+	return AQBlockFileWriter_WriteBytes(writer, stored, storedSize) && AQBlockFileWriter_Align(writer);
+}
+
+struct AQBlockFileWriter * AQBlockFileWriter_Create(const char path[], Float64 sampleRate, UInt32 numChannels, AQSampleType type, UInt32 framesPerBlock, AQBlockCodec codec, bool hasChecksums)
+{
+	struct AQBlockFileWriter * writer;
+	UInt8 header[kBlockFileHeaderSize];
+	UInt64 sampleRateBits;
+	
+	if (framesPerBlock == 0)
+	{
+		framesPerBlock = kAQBlockFileDefaultFramesPerBlock;
+	}
+	
+	if (!(sampleRate > 0) ||
+		numChannels == 0 || numChannels > kBlockFileMaxChannels ||
+		!AQBlockFile_IsStoredType(type) ||
+		framesPerBlock > kBlockFileMaxFramesPerBlock)
+	{
+		return NULL;
+	}
+	
+	writer = (struct AQBlockFileWriter *) calloc(1, sizeof(struct AQBlockFileWriter));
+	
+	if (!(writer->mFile = fopen(path, "wb")))
+	{
+		free(writer);
+		return NULL;
+	}
+	
+	AQBlockFile_FillInfo(&writer->mInfo, sampleRate, numChannels, type, framesPerBlock);
+	
+	writer->mCodec = codec;
+	writer->mHasChecksums = hasChecksums;
+	writer->mBlock = (UInt8 *) malloc((size_t) framesPerBlock * writer->mInfo.mBytesPerFrame);
+	
+	if (codec != kAQBlockCodec_None)
+	{
+		writer->mCompressedCapacity = AQLZ4_CompressBound(framesPerBlock * writer->mInfo.mBytesPerFrame);
+		writer->mCompressed = (UInt8 *) malloc(writer->mCompressedCapacity);
+	}
+	
+	memset(header, 0, sizeof(header));
+	memcpy(&sampleRateBits, &sampleRate, sizeof(sampleRateBits));
+	
+	memcpy(header, "AQBF", 4);
+	PutUInt32(header + 4, kBlockFileVersion);
+	PutUInt64(header + 8, sampleRateBits);
+	PutUInt32(header + 16, numChannels);
+	PutUInt32(header + 20, type);
+	PutUInt32(header + 24, framesPerBlock);
+	PutUInt32(header + 28, kBlockFileAlignment);
+	PutUInt32(header + 32, hasChecksums ? kBlockFileFlag_Checksums : 0);
+	PutUInt32(header + kBlockFileHeaderSize - 4, XXH32(header, kBlockFileHeaderSize - 4));
+	
+	AQBlockFileWriter_WriteBytes(writer, header, sizeof(header));
+	AQBlockFileWriter_Align(writer);
+	
+	return writer;
+}
+
+bool AQBlockFileWriter_Write(struct AQBlockFileWriter * writer, const Float32 * samples, UInt32 numFrames)
+{
+	UInt32 numChannels = writer->mInfo.mLayout.mNumChannels;
+	UInt32 numWritten = 0;
+	
+	while (numWritten < numFrames && !writer->mFailed)
+	{
+		UInt32 numToStore = writer->mInfo.mFramesPerBlock - writer->mNumBlockFrames;
+		
+		if (numToStore > numFrames - numWritten)
+		{
+			numToStore = numFrames - numWritten;
+		}
+		
+		AQBlockFile_StoreSamples(samples + (size_t) numWritten * numChannels,
+								 writer->mBlock + (size_t) writer->mNumBlockFrames * writer->mInfo.mBytesPerFrame,
+								 numToStore * numChannels,
+								 writer->mInfo.mLayout.mType);
+		
+		writer->mNumBlockFrames += numToStore;
+		writer->mInfo.mNumFrames += numToStore;
+		numWritten += numToStore;
+		
+		if (writer->mNumBlockFrames == writer->mInfo.mFramesPerBlock)
+		{
+			AQBlockFileWriter_FlushBlock(writer);
+		}
+	}
+	
+	return !writer->mFailed;
+}
+
+bool AQBlockFileWriter_Close(struct AQBlockFileWriter * writer)
+{
+	UInt8 trailer[kBlockFileTrailerSize];
+	size_t indexSize;
+	UInt64 indexOffset;
+	bool ok;
+	
+	if (writer->mNumBlockFrames > 0)
+	{
+		AQBlockFileWriter_FlushBlock(writer);
+	}
+	
+	indexSize = (size_t) writer->mInfo.mNumBlocks * kBlockFileIndexEntrySize;
+	indexOffset = writer->mOffset;
+	
+	memcpy(trailer, "AQBI", 4);
+	PutUInt32(trailer + 4, writer->mInfo.mNumBlocks);
+	PutUInt64(trailer + 8, writer->mInfo.mNumFrames);
+	PutUInt64(trailer + 16, indexOffset);
+	PutUInt32(trailer + 24, XXH32(writer->mIndex, indexSize));
+	PutUInt32(trailer + 28, XXH32(trailer, 28));
+	
+	AQBlockFileWriter_WriteBytes(writer, writer->mIndex, indexSize);
+	AQBlockFileWriter_WriteBytes(writer, trailer, sizeof(trailer));
+	
+	ok = fclose(writer->mFile) == 0 && !writer->mFailed;
+	
+	free(writer->mBlock);
+	free(writer->mCompressed);
+	free(writer->mIndex);
+	free(writer);
+	
+	return ok;
+}
@@ -0,0 +1,93 @@
+//
+//  AQBlockFile.h
+//  PlayingAudioExample
+//
+
+/* A container for decoded PCM, laid out for random access rather than for
+ * interchange: a render or a cache writes it once, and players and offline
+ * jobs read any part of it from then on without decoding or parsing.
+ *
+ * Frames are stored interleaved and little endian in blocks of a fixed
+ * number of frames. Every block starts on a 4 KB boundary, and an index at
+ * the end of the file holds where each one is and how it is stored, so the
+ * block holding a frame is found by a division, the index entry by a
+ * multiplication and the samples are already in the mapped file: seeking is
+ * O(1) and costs no I/O until the samples are used. A block can be stored
+ * compressed, when that makes it smaller, and carry a checksum; a block whose
+ * checksum does not match reads as silence.
+ *
+ * The reader maps the file. AQBlockFile_Read reads in order and keeps the
+ * current block, AQBlockFile_ReadAt reads any range from any thread.
+ * Both hand out raw frames in mLayout, for an AQSampleConvert kernel.
+ */
+
+#ifndef AQBlockFile_h
+#define AQBlockFile_h
+
+#include "AQSampleConvert.h"
+
+static const char kAQBlockFileExtension[] = ".aqb";
+
+// 0.37 s of 44.1 kHz audio, 64 KB of 16 bit stereo
+static const UInt32 kAQBlockFileDefaultFramesPerBlock = 16384;
+
+enum AQBlockCodec
+{
+	kAQBlockCodec_None,
+	kAQBlockCodec_LZ4,			// see AQLZ4.h
+	kAQBlockCodec_Lossless		// see AQLossless.h; blocks it cannot take are LZ4
+};
+
+struct AQBlockFileInfo
+{
+	/* Description:
+	 * Always interleaved and little endian; one of the integer types or Float32.
+	 */
+	struct AQSampleLayout mLayout;
+	UInt32 mBytesPerFrame;
+	
+	Float64 mSampleRate;
+	
+	/* Description:
+	 * Frames in every block but the last, which holds what is left.
+	 */
+	UInt32 mFramesPerBlock;
+	UInt32 mNumBlocks;
+	UInt64 mNumFrames;
+};
+
+struct AQBlockFile;
+struct AQBlockFileWriter;
+
+// Whether path ends in kAQBlockFileExtension
+bool AQBlockFile_IsBlockFilePath(const char path[]);
+
+// NULL if the file is not a complete block file
+struct AQBlockFile * AQBlockFile_Open(const char path[]);
+
+const struct AQBlockFileInfo * AQBlockFile_GetInfo(const struct AQBlockFile * file);
+
+// Reads up to numFrames raw frames into data and returns the number read, 0 at the end
+UInt32 AQBlockFile_Read(struct AQBlockFile * file, void * data, UInt32 numFrames);
+
+void AQBlockFile_Seek(struct AQBlockFile * file, UInt64 frame);
+
+// Reads up to numFrames raw frames from frame on, leaving the position of AQBlockFile_Read
+// alone. Safe to call from several threads at once.
+UInt32 AQBlockFile_ReadAt(const struct AQBlockFile * file, UInt64 frame, void * data, UInt32 numFrames);
+
+void AQBlockFile_Close(struct AQBlockFile * file);
+
+// Starts a block file of type samples, which has to be an integer type or Float32.
+// framesPerBlock 0 takes kAQBlockFileDefaultFramesPerBlock. NULL if the file cannot
+// be created.
+struct AQBlockFileWriter * AQBlockFileWriter_Create(const char path[], Float64 sampleRate, UInt32 numChannels, AQSampleType type, UInt32 framesPerBlock, AQBlockCodec codec, bool hasChecksums);
+
+// Appends numFrames interleaved float frames, rounded and clipped to the file's type
+bool AQBlockFileWriter_Write(struct AQBlockFileWriter * writer, const Float32 * samples, UInt32 numFrames);
+
+// Writes the last block and the index and frees the writer. Returns false if anything
+// could not be written, in which case the file is not usable.
+bool AQBlockFileWriter_Close(struct AQBlockFileWriter * writer);
+
+#endif /* AQBlockFile_h */
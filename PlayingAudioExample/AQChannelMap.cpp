@@ -0,0 +1,409 @@
+//
+//  AQChannelMap.cpp
+//  PlayingAudioExample
+//
+
+#include "AQChannelMap.h"
+#include "AQSimd.h"
+
+#include <math.h>
+#include <string.h>
+
+enum
+{
+	kChannel_L = 0,
+	kChannel_R,
+	kChannel_C,
+	kChannel_LFE,
+	kChannel_Ls,
+	kChannel_Rs,
+	kChannel_Lb,
+	kChannel_Rb
+};
+
+// -3 dB, the ITU-R BS.775 weight for centre and surrounds
+static const Float32 kMinus3dB = (Float32) M_SQRT1_2;
+
+/* Generic kernel, counts known only at runtime. */
+static
+void AQChannelMap_KernelGeneric(const struct AQChannelMap * map, const Float32 * in, Float32 * out, UInt32 numFrames)
+{
+	UInt32 numIn = map->mNumInputChannels;
+	UInt32 numOut = map->mNumOutputChannels;
+	UInt32 f, o, i;
+	
+	for (f = 0; f < numFrames; f++, in += numIn, out += numOut)
+	{
+		for (o = 0; o < numOut; o++)
+		{
+			Float32 sum = 0.f;
+			
+			for (i = 0; i < numIn; i++)
+			{
+				sum += map->mMatrix[o][i] * in[i];
+			}
+			
+			out[o] = sum;
+		}
+	}
+}
+
+/* Specialized kernel for NumOut in { 1, 2, 4 }, with both counts constant so the
+ * loops below unroll. Frames are loaded four channels at a time, never reading
+ * past the last one.
+ *
+ * With two or four outputs a vector holds 4 / NumOut whole output frames: each
+ * input channel is broadcast across the lanes of its frame with a shuffle and
+ * multiplied by the matching matrix column. A mono output takes the dot product
+ * of each of four frames with the matrix row instead and sums their lanes.
+ */
+template <UInt32 NumIn, UInt32 NumOut>
+static
+void AQChannelMap_Kernel(const struct AQChannelMap * map, const Float32 * in, Float32 * out, UInt32 numFrames)
+{
+	static const UInt32 kFramesPerVector = AQ_SIMD_WIDTH / NumOut;
+	static const UInt32 kNumChunks = (NumIn + AQ_SIMD_WIDTH - 1) / AQ_SIMD_WIDTH;
+	AQFloat4 columns[NumIn];
+	AQFloat4 row[kNumChunks];
+	AQFloat4 frames[kFramesPerVector][kNumChunks];
+	UInt32 f, i, k, c, lane;
+	
+	for (i = 0; i < NumIn; i++)
+	{
+		Float32 column[AQ_SIMD_WIDTH];
+		
+		for (lane = 0; lane < AQ_SIMD_WIDTH; lane++)
+		{
+			column[lane] = map->mMatrix[lane % NumOut][i];
+		}
+		
+		columns[i] = AQFloat4_Load(column);
+	}
+	
+	// Matrix rows are kAQChannelMapMaxChannels wide and zero past the input count
+	for (c = 0; c < kNumChunks; c++)
+	{
+		row[c] = AQFloat4_Load(&map->mMatrix[0][c * AQ_SIMD_WIDTH]);
+	}
+	
+	for (f = 0; f + kFramesPerVector <= numFrames; f += kFramesPerVector)
+	{
+		AQFloat4 sum = AQFloat4_Set1(0.f);
+		
+		for (k = 0; k < kFramesPerVector; k++)
+		{
+			for (c = 0; c < kNumChunks; c++)
+			{
+				UInt32 numLanes = NumIn - c * AQ_SIMD_WIDTH < AQ_SIMD_WIDTH ? NumIn - c * AQ_SIMD_WIDTH : AQ_SIMD_WIDTH;
+				
+				frames[k][c] = AQFloat4_LoadPartial(in + k * NumIn + c * AQ_SIMD_WIDTH, numLanes);
+			}
+		}
+		
+		if (NumOut == 1)
+		{
+			AQFloat4 dots[AQ_SIMD_WIDTH];
+			
+			for (k = 0; k < AQ_SIMD_WIDTH; k++)
+			{
+				dots[k] = AQFloat4_Mul(frames[k % kFramesPerVector][0], row[0]);
+				
+				for (c = 1; c < kNumChunks; c++)
+				{
+					dots[k] = AQFloat4_MulAdd(frames[k % kFramesPerVector][c], row[c], dots[k]);
+				}
+			}
+			
+			sum = AQFloat4_SumLanes4(dots[0], dots[1], dots[2], dots[3]);
+		}
+		else
+		{
+			// With four outputs both halves come from the one frame
+			for (i = 0; i < NumIn; i++)
+			{
+				AQFloat4 broadcast = AQFloat4_DupLanePair(frames[0][i / AQ_SIMD_WIDTH],
+														  frames[kFramesPerVector - 1][i / AQ_SIMD_WIDTH],
+														  i % AQ_SIMD_WIDTH);
+				
+				sum = AQFloat4_MulAdd(broadcast, columns[i], sum);
+			}
+		}
+		
+		AQFloat4_Store(out, sum);
+		
+		in += kFramesPerVector * NumIn;
+		out += kFramesPerVector * NumOut;
+	}
+	
+	for (; f < numFrames; f++, in += NumIn, out += NumOut)
+	{
+		UInt32 o;
+		
+		for (o = 0; o < NumOut; o++)
+		{
+			Float32 sum = 0.f;
+			
+			for (i = 0; i < NumIn; i++)
+			{
+				sum += map->mMatrix[o][i] * in[i];
+			}
+			
+			out[o] = sum;
+		}
+	}
+}
+
+static
+void AQChannelMap_KernelCopy(const struct AQChannelMap * map, const Float32 * in, Float32 * out, UInt32 numFrames)
+{
+	if (in != out)
+	{
+		memmove(out, in, numFrames * map->mNumInputChannels * sizeof(Float32));
+	}
+}
+
+static
+AQChannelMapKernel AQChannelMap_SelectKernel(UInt32 numIn, UInt32 numOut)
+{
+	#define AQ_CHANNEL_MAP_KERNEL(in, out) \
+		if (numIn == in && numOut == out) return AQChannelMap_Kernel<in, out>;
+	
+	AQ_CHANNEL_MAP_KERNEL(1, 2)
+	AQ_CHANNEL_MAP_KERNEL(2, 1)
+	AQ_CHANNEL_MAP_KERNEL(6, 1)
+	AQ_CHANNEL_MAP_KERNEL(6, 2)
+	AQ_CHANNEL_MAP_KERNEL(8, 1)
+	AQ_CHANNEL_MAP_KERNEL(8, 2)
+	AQ_CHANNEL_MAP_KERNEL(6, 4)
+	AQ_CHANNEL_MAP_KERNEL(8, 4)
+	
+	#undef AQ_CHANNEL_MAP_KERNEL
+	
+	return AQChannelMap_KernelGeneric;
+}
+
+/* Description:
+ * Speaker of each channel for the channel counts with a standard WAVE layout:
+ * mono is a centre and four channels are quad. Counts left empty (7) have none.
+ */
+static const SInt8 kLayouts[kAQChannelMapMaxChannels + 1][kAQChannelMapMaxChannels] =
+{
+	{ 0 },
+	{ kChannel_C },
+	{ kChannel_L, kChannel_R },
+	{ kChannel_L, kChannel_R, kChannel_C },
+	{ kChannel_L, kChannel_R, kChannel_Ls, kChannel_Rs },
+	{ kChannel_L, kChannel_R, kChannel_C, kChannel_Ls, kChannel_Rs },
+	{ kChannel_L, kChannel_R, kChannel_C, kChannel_LFE, kChannel_Ls, kChannel_Rs },
+	{ 0 },
+	{ kChannel_L, kChannel_R, kChannel_C, kChannel_LFE, kChannel_Ls, kChannel_Rs, kChannel_Lb, kChannel_Rb }
+};
+
+static
+bool AQChannelMap_HasLayout(UInt32 numChannels)
+{
+	return numChannels != 0 && numChannels != 7;
+}
+
+// Adds gain from input channel i to the output speaker, if the output has one
+static
+bool AQChannelMap_AddToSpeaker(struct AQChannelMap * map, UInt32 i, SInt8 speaker, Float32 gain)
+{
+	UInt32 o;
+	
+	for (o = 0; o < map->mNumOutputChannels; o++)
+	{
+		if (kLayouts[map->mNumOutputChannels][o] == speaker)
+		{
+			map->mMatrix[o][i] += gain;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+/* Routes every input speaker to the same output speaker, or folds it onto the
+ * nearest ones the output has: centre onto left and right, surrounds onto the
+ * fronts and backs onto the surrounds, at -3 dB. LFE is dropped when the output
+ * has none, and output speakers the input lacks stay silent.
+ */
+static
+bool AQChannelMap_InitLayouts(struct AQChannelMap * map)
+{
+	UInt32 numIn = map->mNumInputChannels;
+	UInt32 i;
+	
+	if (!AQChannelMap_HasLayout(numIn) || !AQChannelMap_HasLayout(map->mNumOutputChannels))
+	{
+		return false;
+	}
+	
+	for (i = 0; i < numIn; i++)
+	{
+		SInt8 speaker = kLayouts[numIn][i];
+		
+		if (AQChannelMap_AddToSpeaker(map, i, speaker, 1.f))
+		{
+			continue;
+		}
+		
+		switch (speaker)
+		{
+			case kChannel_C:
+				AQChannelMap_AddToSpeaker(map, i, kChannel_L, kMinus3dB);
+				AQChannelMap_AddToSpeaker(map, i, kChannel_R, kMinus3dB);
+				break;
+			case kChannel_Ls:
+				AQChannelMap_AddToSpeaker(map, i, kChannel_L, kMinus3dB);
+				break;
+			case kChannel_Rs:
+				AQChannelMap_AddToSpeaker(map, i, kChannel_R, kMinus3dB);
+				break;
+			case kChannel_Lb:
+				if (!AQChannelMap_AddToSpeaker(map, i, kChannel_Ls, 1.f))
+				{
+					AQChannelMap_AddToSpeaker(map, i, kChannel_L, kMinus3dB);
+				}
+				break;
+			case kChannel_Rb:
+				if (!AQChannelMap_AddToSpeaker(map, i, kChannel_Rs, 1.f))
+				{
+					AQChannelMap_AddToSpeaker(map, i, kChannel_R, kMinus3dB);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	
+	return true;
+}
+
+// Scales down the rows whose gains add up to more than 1, so a full-scale input cannot clip
+static
+void AQChannelMap_NormalizeRows(struct AQChannelMap * map)
+{
+	UInt32 i, o;
+	
+	for (o = 0; o < map->mNumOutputChannels; o++)
+	{
+		Float32 rowSum = 0.f;
+		
+		for (i = 0; i < map->mNumInputChannels; i++)
+		{
+			rowSum += map->mMatrix[o][i];
+		}
+		
+		for (i = 0; rowSum > 1.f && i < map->mNumInputChannels; i++)
+		{
+			map->mMatrix[o][i] /= rowSum;
+		}
+	}
+}
+
+// Fills both rows of a stereo downmix, which a mono output then averages
+static
+void AQChannelMap_InitStereoDownmix(struct AQChannelMap * map)
+{
+	UInt32 numIn = map->mNumInputChannels;
+	UInt32 numOut = map->mNumOutputChannels;
+	bool hasLayout;
+	UInt32 i;
+	
+	switch (numIn)
+	{
+		case 1:
+			map->mMatrix[0][0] = 1.f;
+			map->mMatrix[1][0] = 1.f;
+			return;
+		case 2:
+			map->mMatrix[0][kChannel_L] = 1.f;
+			map->mMatrix[1][kChannel_R] = 1.f;
+			return;
+		default:
+			break;
+	}
+	
+	// By speaker: centre at -3 dB to both sides, surrounds and backs to their side,
+	// LFE dropped
+	map->mNumOutputChannels = 2;
+	hasLayout = AQChannelMap_InitLayouts(map);
+	
+	if (hasLayout)
+	{
+		AQChannelMap_NormalizeRows(map);
+	}
+	
+	map->mNumOutputChannels = numOut;
+	
+	if (hasLayout)
+	{
+		return;
+	}
+	
+	// Unknown layout: alternate channels between left and right
+	for (i = 0; i < numIn; i++)
+	{
+		map->mMatrix[i % 2][i] = 1.f / ((numIn + 1 - i % 2) / 2);
+	}
+}
+
+void AQChannelMap_Init(struct AQChannelMap * map, UInt32 numInputChannels, UInt32 numOutputChannels)
+{
+	UInt32 i, o;
+	
+	memset(map, 0, sizeof(struct AQChannelMap));
+	
+	map->mNumInputChannels = numInputChannels;
+	map->mNumOutputChannels = numOutputChannels;
+	
+	if (numInputChannels == numOutputChannels)
+	{
+		for (i = 0; i < numInputChannels; i++)
+		{
+			map->mMatrix[i][i] = 1.f;
+		}
+		
+		map->mKernel = AQChannelMap_KernelCopy;
+		map->mIsIdentity = true;
+		return;
+	}
+	
+	if (numOutputChannels == 2 || numOutputChannels == 1)
+	{
+		AQChannelMap_InitStereoDownmix(map);
+		
+		if (numOutputChannels == 1 && numInputChannels != 2)
+		{
+			// Mono is the average of the stereo downmix
+			for (i = 0; i < numInputChannels; i++)
+			{
+				map->mMatrix[0][i] = 0.5f * (map->mMatrix[0][i] + map->mMatrix[1][i]);
+				map->mMatrix[1][i] = 0.f;
+			}
+		}
+		else if (numOutputChannels == 1)
+		{
+			map->mMatrix[0][kChannel_L] = 0.5f;
+			map->mMatrix[0][kChannel_R] = 0.5f;
+			map->mMatrix[1][kChannel_R] = 0.f;
+		}
+	}
+	else
+	{
+		if (!AQChannelMap_InitLayouts(map))
+		{
+			// Unknown layout: keep the channels both have, fold the rest onto them
+			for (i = 0; i < numInputChannels; i++)
+			{
+				o = i < numOutputChannels ? i : i % numOutputChannels;
+				map->mMatrix[o][i] = 1.f;
+			}
+		}
+		
+		AQChannelMap_NormalizeRows(map);
+	}
+	
+	map->mKernel = AQChannelMap_SelectKernel(numInputChannels, numOutputChannels);
+}
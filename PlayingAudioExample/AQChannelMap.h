@@ -0,0 +1,56 @@
+//
+//  AQChannelMap.h
+//  PlayingAudioExample
+//
+
+#ifndef AQChannelMap_h
+#define AQChannelMap_h
+
+#include "AQTypes.h"
+
+static const UInt32 kAQChannelMapMaxChannels = 8;
+
+struct AQChannelMap;
+
+typedef void (*AQChannelMapKernel)(const struct AQChannelMap * map,
+								   const Float32 * in,
+								   Float32 * out,
+								   UInt32 numFrames);
+
+/* Description:
+ * Mixes interleaved frames of mNumInputChannels into mNumOutputChannels with a
+ * fixed matrix. Channel order is the WAVE / SMPTE one: L R C LFE Ls Rs [Lb Rb],
+ * except that one channel is a centre and four are quad, L R Ls Rs.
+ */
+struct AQChannelMap
+{
+	UInt32 mNumInputChannels;
+	UInt32 mNumOutputChannels;
+	
+	/* Description:
+	 * Gain from each input channel to each output channel, mMatrix[out][in].
+	 */
+	Float32 mMatrix[kAQChannelMapMaxChannels][kAQChannelMapMaxChannels];
+	
+	/* Description:
+	 * Kernel picked by AQChannelMap_Init. The common layouts get one instantiated
+	 * for their exact channel counts; anything else uses a generic loop.
+	 */
+	AQChannelMapKernel mKernel;
+	
+	/* Description:
+	 * True when the map is a plain copy, so callers can skip it altogether.
+	 */
+	bool mIsIdentity;
+};
+
+// Both counts must be between 1 and kAQChannelMapMaxChannels
+void AQChannelMap_Init(struct AQChannelMap * map, UInt32 numInputChannels, UInt32 numOutputChannels);
+
+static inline
+void AQChannelMap_Apply(const struct AQChannelMap * map, const Float32 * in, Float32 * out, UInt32 numFrames)
+{
+	map->mKernel(map, in, out, numFrames);
+}
+
+#endif /* AQChannelMap_h */
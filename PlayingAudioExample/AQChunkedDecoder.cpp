@@ -0,0 +1,210 @@
+//
+//  AQChunkedDecoder.cpp
+//  PlayingAudioExample
+//
+
+#include "AQChunkedDecoder.h"
+#include "AQThreadPool.h"
+#include "AQTrace.h"
+
+#include <stdlib.h>
+
+#include <condition_variable>
+#include <mutex>
+
+struct AQChunkSlot
+{
+	struct AQChunkedDecoder * mDecoder;
+	Float32 * mSamples;
+	
+	UInt64 mChunkIndex;
+	UInt32 mNumFrames;
+	
+	/* Description:
+	 * Set under the decoder's mutex once mSamples holds mChunkIndex.
+	 */
+	bool mIsReady;
+};
+
+struct AQChunkedDecoder
+{
+	struct AQThreadPool * mPool;
+	AQChunkDecodeFunction mDecode;
+	void * mContext;
+	
+	UInt64 mNumFrames;
+	UInt32 mNumChannels;
+	UInt32 mChunkFrames;
+	UInt64 mNumChunks;
+	
+	/* Description:
+	 * Chunk k decodes into mSlots[k % mNumSlots]; a slot is reused once the
+	 * consumer has moved past its chunk.
+	 */
+	struct AQChunkSlot * mSlots;
+	UInt32 mNumSlots;
+	
+	UInt64 mNextToSubmit;
+	UInt64 mNextToDeliver;
+	
+	/* Description:
+	 * Set when a chunk came back short, everything after it is dropped.
+	 */
+	bool mIsAtEnd;
+	
+	std::mutex mMutex;
+	std::condition_variable mChunkReady;
+	UInt32 mNumRunning;
+};
+
+static
+void AQChunkedDecoder_DecodeChunk(void * arg)
+{
+	struct AQChunkSlot * slot = (struct AQChunkSlot *) arg;
+	struct AQChunkedDecoder * decoder = slot->mDecoder;
+	UInt64 firstFrame = slot->mChunkIndex * decoder->mChunkFrames;
+	UInt64 numFramesLeft = decoder->mNumFrames - firstFrame;
+	UInt32 numFrames = numFramesLeft < decoder->mChunkFrames ? (UInt32) numFramesLeft : decoder->mChunkFrames;
+	UInt32 numDecoded;
+	
+	{
+		AQ_TRACE_SCOPE("decode", slot->mChunkIndex);
+		
+		numDecoded = decoder->mDecode(decoder->mContext, firstFrame, numFrames, slot->mSamples);
+	}
+	
+	std::lock_guard<std::mutex> lock(decoder->mMutex);
+	
+	slot->mNumFrames = numDecoded;
+	slot->mIsReady = true;
+	decoder->mNumRunning--;
+	
+	// Notify under the lock, Dispose may free the decoder as soon as it sees mNumRunning at 0
+	decoder->mChunkReady.notify_all();
+}
+
+// Call with the mutex held
+static
+void AQChunkedDecoder_Submit(struct AQChunkedDecoder * decoder)
+{
+	struct AQChunkSlot * slot = &decoder->mSlots[decoder->mNextToSubmit % decoder->mNumSlots];
+	
+	slot->mChunkIndex = decoder->mNextToSubmit++;
+	slot->mIsReady = false;
+	decoder->mNumRunning++;
+	
+	AQThreadPool_Submit(decoder->mPool, AQChunkedDecoder_DecodeChunk, slot);
+}
+
+struct AQChunkedDecoder * AQChunkedDecoder_Create(struct AQThreadPool * pool,
+												  AQChunkDecodeFunction decode,
+												  void * context,
+												  UInt64 numFrames,
+												  UInt32 numChannels,
+												  UInt32 chunkFrames,
+												  UInt32 numChunksAhead)
+{
+	struct AQChunkedDecoder * decoder = new AQChunkedDecoder;
+	UInt32 k;
+	
+	if (numChunksAhead == 0)
+	{
+		numChunksAhead = 2 * AQThreadPool_NumThreads(pool);
+	}
+	
+	decoder->mPool = pool;
+	decoder->mDecode = decode;
+	decoder->mContext = context;
+	decoder->mNumFrames = numFrames;
+	decoder->mNumChannels = numChannels;
+	decoder->mChunkFrames = chunkFrames;
+	decoder->mNumChunks = (numFrames + chunkFrames - 1) / chunkFrames;
+	decoder->mNextToSubmit = 0;
+	decoder->mNextToDeliver = 0;
+	decoder->mIsAtEnd = false;
+	decoder->mNumRunning = 0;
+	
+	// One more slot than chunks ahead, for the chunk the consumer is holding
+	decoder->mNumSlots = numChunksAhead + 1;
+	decoder->mSlots = (struct AQChunkSlot *) calloc(decoder->mNumSlots, sizeof(struct AQChunkSlot));
+	
+	for (k = 0; k < decoder->mNumSlots; k++)
+	{
+		decoder->mSlots[k].mDecoder = decoder;
+		decoder->mSlots[k].mSamples = (Float32 *) malloc((size_t) chunkFrames * numChannels * sizeof(Float32));
+	}
+	
+	std::lock_guard<std::mutex> lock(decoder->mMutex);
+	
+	while (decoder->mNextToSubmit < decoder->mNumChunks && decoder->mNextToSubmit < numChunksAhead)
+	{
+		AQChunkedDecoder_Submit(decoder);
+	}
+	
+	return decoder;
+}
+
+const Float32 * AQChunkedDecoder_Next(struct AQChunkedDecoder * decoder, UInt32 * outNumFrames)
+{
+	std::unique_lock<std::mutex> lock(decoder->mMutex);
+	
+	// The slot of the chunk handed out last time is free again
+	if (decoder->mNextToDeliver > 0 && !decoder->mIsAtEnd && decoder->mNextToSubmit < decoder->mNumChunks)
+	{
+		AQChunkedDecoder_Submit(decoder);
+	}
+	
+	if (decoder->mIsAtEnd || decoder->mNextToDeliver == decoder->mNumChunks)
+	{
+		*outNumFrames = 0;
+		return NULL;
+	}
+	
+	struct AQChunkSlot * slot = &decoder->mSlots[decoder->mNextToDeliver % decoder->mNumSlots];
+	
+	if (!slot->mIsReady)
+	{
+		// The consumer caught up with the decoders
+		AQ_TRACE_SCOPE("underrun", decoder->mNextToDeliver);
+		
+		while (!slot->mIsReady)
+		{
+			decoder->mChunkReady.wait(lock);
+		}
+	}
+	
+	UInt64 firstFrame = decoder->mNextToDeliver * decoder->mChunkFrames;
+	UInt64 numFramesLeft = decoder->mNumFrames - firstFrame;
+	
+	if (slot->mNumFrames < decoder->mChunkFrames && slot->mNumFrames < numFramesLeft)
+	{
+		decoder->mIsAtEnd = true;
+	}
+	
+	decoder->mNextToDeliver++;
+	*outNumFrames = slot->mNumFrames;
+	
+	return slot->mSamples;
+}
+
+void AQChunkedDecoder_Dispose(struct AQChunkedDecoder * decoder)
+{
+	UInt32 k;
+	
+	{
+		std::unique_lock<std::mutex> lock(decoder->mMutex);
+		
+		while (decoder->mNumRunning > 0)
+		{
+			decoder->mChunkReady.wait(lock);
+		}
+	}
+	
+	for (k = 0; k < decoder->mNumSlots; k++)
+	{
+		free(decoder->mSlots[k].mSamples);
+	}
+	
+	free(decoder->mSlots);
+	delete decoder;
+}
@@ -0,0 +1,43 @@
+//
+//  AQChunkedDecoder.h
+//  PlayingAudioExample
+//
+
+/* Decodes one file as consecutive chunks on a thread pool and hands them back
+ * in order. Only formats whose chunks decode independently of each other fit
+ * (linear PCM, or packets a decoder can seek to with its own pre-roll); the
+ * decode function is called concurrently, each call with its own output.
+ *
+ * At most a fixed number of chunks are decoded ahead of the consumer, so the
+ * memory used does not grow with the file.
+ */
+
+#ifndef AQChunkedDecoder_h
+#define AQChunkedDecoder_h
+
+#include "AQTypes.h"
+
+struct AQThreadPool;
+
+// Decodes numFrames interleaved float frames starting at firstFrame into out and returns
+// the number decoded; fewer than asked ends the stream after this chunk
+typedef UInt32 (*AQChunkDecodeFunction)(void * context, UInt64 firstFrame, UInt32 numFrames, Float32 * out);
+
+struct AQChunkedDecoder;
+
+// numChunksAhead of 0 keeps two chunks per pool thread in flight
+struct AQChunkedDecoder * AQChunkedDecoder_Create(struct AQThreadPool * pool,
+												  AQChunkDecodeFunction decode,
+												  void * context,
+												  UInt64 numFrames,
+												  UInt32 numChannels,
+												  UInt32 chunkFrames,
+												  UInt32 numChunksAhead);
+
+// The next chunk in file order, valid until the following call; NULL at the end
+const Float32 * AQChunkedDecoder_Next(struct AQChunkedDecoder * decoder, UInt32 * outNumFrames);
+
+// Waits for the chunks still being decoded
+void AQChunkedDecoder_Dispose(struct AQChunkedDecoder * decoder);
+
+#endif /* AQChunkedDecoder_h */
@@ -0,0 +1,526 @@
+//
+//  AQControl.cpp
+//  PlayingAudioExample
+//
+
+#include "AQControl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#if defined(MSG_NOSIGNAL)
+static const int kAQControlSendFlags = MSG_NOSIGNAL;
+#else
+static const int kAQControlSendFlags = 0;
+#endif
+
+static const UInt32 kAQControlHeaderSize = sizeof(struct AQControlHeader);
+
+// Room for a batch of pipelined requests and their replies
+static const UInt32 kAQControlInputSize = 64 * 1024;
+static const UInt32 kAQControlOutputSize = 64 * 1024;
+
+static const UInt32 kAQControlMaxEvents = 64;
+
+struct AQControlConnection
+{
+	int mFD;
+	
+	/* Description:
+	 * Bytes received and not yet parsed into requests.
+	 */
+	UInt8 mInput[kAQControlInputSize];
+	UInt32 mInputUsed;
+	
+	/* Description:
+	 * Replies not yet sent, from mOutputSent to mOutputUsed. While any are left the
+	 * socket is watched for writing and no new requests are run.
+	 */
+	UInt8 mOutput[kAQControlOutputSize];
+	UInt32 mOutputUsed;
+	UInt32 mOutputSent;
+	
+	bool mHungUp;
+	
+	/* Description:
+	 * The request whose reply a handler put off, NULL when none is. Until it is
+	 * complete the requests after it wait in mInput.
+	 */
+	struct AQControlDeferred * mDeferred;
+	
+	struct AQControlConnection * mNext;
+};
+
+struct AQControlPost
+{
+	AQTaskFunction mFunction;
+	void * mArg;
+	struct AQControlPost * mNext;
+};
+
+static
+bool AQControl_SetNonBlocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+	{
+		return false;
+	}
+
+#if defined(SO_NOSIGPIPE)
+	int on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+	
+	return fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+static
+void AQControlServer_CloseConnection(struct AQControlServer * server, struct AQControlConnection * connection)
+{
+	struct AQControlConnection ** link = &server->mConnections;
+	
+	while (*link != connection)
+	{
+		link = &(*link)->mNext;
+	}
+	
+	*link = connection->mNext;
+	server->mNumConnections--;
+	
+	if (connection->mDeferred)
+	{
+		// Whoever completes it now only frees it
+		connection->mDeferred->mConnection = NULL;
+	}
+	
+	AQEventLoop_Remove(&server->mLoop, connection->mFD);
+	close(connection->mFD);
+	free(connection);
+}
+
+static
+void AQControlServer_Accept(struct AQControlServer * server)
+{
+	int fd;
+	
+	while ((fd = accept(server->mListenFD, NULL, NULL)) >= 0)
+	{
+		struct AQControlConnection * connection = (struct AQControlConnection *) malloc(sizeof(struct AQControlConnection));
+		
+		connection->mFD = fd;
+		connection->mInputUsed = 0;
+		connection->mOutputUsed = 0;
+		connection->mOutputSent = 0;
+		connection->mHungUp = false;
+		connection->mDeferred = NULL;
+		
+		if (!AQControl_SetNonBlocking(fd) || !AQEventLoop_Add(&server->mLoop, fd, connection, false))
+		{
+			close(fd);
+			free(connection);
+			continue;
+		}
+		
+		connection->mNext = server->mConnections;
+		server->mConnections = connection;
+		server->mNumConnections++;
+	}
+}
+
+// Runs the complete requests in mInput while there is room for their replies and
+// none has been deferred, returning whether it ran any
+static
+bool AQControlServer_RunRequests(struct AQControlServer * server, struct AQControlConnection * connection)
+{
+	UInt32 offset = 0;
+	
+	while (!connection->mDeferred &&
+		   connection->mInputUsed - offset >= kAQControlHeaderSize &&
+		   kAQControlOutputSize - connection->mOutputUsed >= kAQControlHeaderSize + kAQControlMaxReplyPayload)
+	{
+		struct AQControlHeader request;
+		struct AQControlHeader reply;
+		
+		memcpy(&request, connection->mInput + offset, kAQControlHeaderSize);
+		
+		if (request.mLength > kAQControlMaxPayload)
+		{
+			// The stream cannot be resynchronised after a bogus length
+			connection->mHungUp = true;
+			return false;
+		}
+		
+		if (connection->mInputUsed - offset < kAQControlHeaderSize + request.mLength)
+		{
+			break;
+		}
+		
+		UInt8 * replyPayload = connection->mOutput + connection->mOutputUsed + kAQControlHeaderSize;
+		
+		reply = request;
+		reply.mStatus = kAQControlOK;
+		reply.mLength = 0;
+		
+		server->mHandling = connection;
+		server->mHandlingRequest = &request;
+		server->mHandler(server->mContext, &request, connection->mInput + offset + kAQControlHeaderSize, &reply, replyPayload);
+		server->mHandling = NULL;
+		
+		offset += kAQControlHeaderSize + request.mLength;
+		
+		if (connection->mDeferred)
+		{
+			// The room checked for above stays free for the reply, since nothing else
+			// is added to mOutput until it is complete
+			break;
+		}
+		
+		memcpy(connection->mOutput + connection->mOutputUsed, &reply, kAQControlHeaderSize);
+		connection->mOutputUsed += kAQControlHeaderSize + reply.mLength;
+	}
+	
+	memmove(connection->mInput, connection->mInput + offset, connection->mInputUsed - offset);
+	connection->mInputUsed -= offset;
+	
+	return offset > 0;
+}
+
+// Sends what it can of the pending replies
+static
+bool AQControlServer_Flush(struct AQControlServer * server, struct AQControlConnection * connection)
+{
+	while (connection->mOutputSent < connection->mOutputUsed)
+	{
+		ssize_t numBytes = send(connection->mFD,
+								connection->mOutput + connection->mOutputSent,
+								connection->mOutputUsed - connection->mOutputSent,
+								kAQControlSendFlags);
+		
+		if (numBytes < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				break;
+			}
+			
+			return false;
+		}
+		
+		connection->mOutputSent += numBytes;
+	}
+	
+	bool pending = connection->mOutputSent < connection->mOutputUsed;
+	
+	if (!pending)
+	{
+		connection->mOutputUsed = 0;
+		connection->mOutputSent = 0;
+	}
+	
+	AQEventLoop_SetWritable(&server->mLoop, connection->mFD, connection, pending);
+	
+	return true;
+}
+
+// Returns false once the connection should be closed
+static
+bool AQControlServer_Service(struct AQControlServer * server, struct AQControlConnection * connection)
+{
+	for (;;)
+	{
+		// Finish sending earlier replies before taking on more work, so a client that
+		// does not read its replies cannot make the server buffer without bound
+		if (connection->mOutputUsed > 0 && !AQControlServer_Flush(server, connection))
+		{
+			return false;
+		}
+		
+		if (connection->mOutputUsed > 0)
+		{
+			return true;
+		}
+		
+		// Requests held back by a full output buffer run before anything new is read,
+		// since the client may have nothing more to send
+		if (AQControlServer_RunRequests(server, connection))
+		{
+			continue;
+		}
+		
+		if (connection->mHungUp || connection->mInputUsed == kAQControlInputSize)
+		{
+			break;
+		}
+		
+		ssize_t numBytes = recv(connection->mFD,
+								connection->mInput + connection->mInputUsed,
+								kAQControlInputSize - connection->mInputUsed,
+								0);
+		
+		if (numBytes > 0)
+		{
+			connection->mInputUsed += numBytes;
+		}
+		else if (numBytes == 0)
+		{
+			connection->mHungUp = true;
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			break;
+		}
+		else if (errno != EINTR)
+		{
+			return false;
+		}
+	}
+	
+	return !connection->mHungUp;
+}
+
+// Runs the tasks posted so far, oldest first
+static
+void AQControlServer_RunPosts(struct AQControlServer * server)
+{
+	UInt8 wakeBytes[64];
+	struct AQControlPost * posts;
+	
+	// Drained before taking the list, so a task posted meanwhile wakes the next poll
+	while (read(server->mWakeFDs[0], wakeBytes, sizeof(wakeBytes)) > 0)
+	{
+	}
+	
+	pthread_mutex_lock(&server->mPostMutex);
+	posts = server->mPosts;
+	server->mPosts = NULL;
+	server->mPostsTail = &server->mPosts;
+	pthread_mutex_unlock(&server->mPostMutex);
+	
+	while (posts)
+	{
+		struct AQControlPost * next = posts->mNext;
+		
+		posts->mFunction(posts->mArg);
+		free(posts);
+		posts = next;
+	}
+}
+
+bool AQControlServer_Open(struct AQControlServer * server, const char path[], AQControlHandler handler, void * context)
+{
+	struct sockaddr_un address;
+	
+	memset(server, 0, sizeof(*server));
+	server->mListenFD = -1;
+	server->mWakeFDs[0] = -1;
+	server->mWakeFDs[1] = -1;
+	server->mHandler = handler;
+	server->mContext = context;
+	
+	if (strlen(path) >= sizeof(address.sun_path))
+	{
+		fprintf(stderr, "Control socket path too long: %s\n", path);
+		return false;
+	}
+	
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	
+	if (!AQEventLoop_Init(&server->mLoop))
+	{
+		perror("event loop");
+		return false;
+	}
+	
+	pthread_mutex_init(&server->mPostMutex, NULL);
+	server->mPostsTail = &server->mPosts;
+	
+	server->mListenFD = socket(AF_UNIX, SOCK_STREAM, 0);
+	
+	unlink(path);
+	
+	if (server->mListenFD < 0 ||
+		bind(server->mListenFD, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+		listen(server->mListenFD, SOMAXCONN) < 0 ||
+		!AQControl_SetNonBlocking(server->mListenFD) ||
+		!AQEventLoop_Add(&server->mLoop, server->mListenFD, &server->mListenFD, false) ||
+		pipe(server->mWakeFDs) < 0 ||
+		!AQControl_SetNonBlocking(server->mWakeFDs[0]) ||
+		!AQControl_SetNonBlocking(server->mWakeFDs[1]) ||
+		!AQEventLoop_Add(&server->mLoop, server->mWakeFDs[0], server->mWakeFDs, false))
+	{
+		perror(path);
+		AQControlServer_Close(server);
+		return false;
+	}
+	
+	server->mPath = strdup(path);
+	
+	return true;
+}
+
+void AQControlServer_Poll(struct AQControlServer * server, int timeoutMs)
+{
+	struct AQEvent events[kAQControlMaxEvents];
+	int numEvents = AQEventLoop_Wait(&server->mLoop, events, kAQControlMaxEvents, timeoutMs);
+	bool woken = false;
+	int k;
+	
+	for (k = 0; k < numEvents; k++)
+	{
+		if (!events[k].mContext)
+		{
+			// Closed earlier in this batch
+			continue;
+		}
+		
+		if (events[k].mContext == server->mWakeFDs)
+		{
+			woken = true;
+			continue;
+		}
+		
+		// The listening socket's context is its descriptor
+		if (events[k].mContext == &server->mListenFD)
+		{
+			AQControlServer_Accept(server);
+			continue;
+		}
+		
+		struct AQControlConnection * connection = (struct AQControlConnection *) events[k].mContext;
+		
+		if (!AQControlServer_Service(server, connection))
+		{
+			AQControlServer_CloseConnection(server, connection);
+			
+			// kqueue may report the same connection again further down this batch
+			int j;
+			
+			for (j = k + 1; j < numEvents; j++)
+			{
+				if (events[j].mContext == connection)
+				{
+					events[j].mContext = NULL;
+				}
+			}
+		}
+	}
+	
+	// After the batch, since completing a deferred reply may close its connection
+	if (woken)
+	{
+		AQControlServer_RunPosts(server);
+	}
+}
+
+struct AQControlDeferred * AQControlServer_Defer(struct AQControlServer * server)
+{
+	struct AQControlDeferred * deferred = (struct AQControlDeferred *) malloc(sizeof(struct AQControlDeferred));
+	
+	deferred->mReply = *server->mHandlingRequest;
+	deferred->mReply.mStatus = kAQControlOK;
+	deferred->mReply.mLength = 0;
+	deferred->mConnection = server->mHandling;
+	
+	server->mHandling->mDeferred = deferred;
+	
+	return deferred;
+}
+
+void AQControlServer_Complete(struct AQControlServer * server, struct AQControlDeferred * deferred)
+{
+	struct AQControlConnection * connection = deferred->mConnection;
+	
+	if (connection)
+	{
+		UInt8 * output = connection->mOutput + connection->mOutputUsed;
+		
+		memcpy(output, &deferred->mReply, kAQControlHeaderSize);
+		memcpy(output + kAQControlHeaderSize, deferred->mReplyPayload, deferred->mReply.mLength);
+		connection->mOutputUsed += kAQControlHeaderSize + deferred->mReply.mLength;
+		connection->mDeferred = NULL;
+		
+		if (!AQControlServer_Service(server, connection))
+		{
+			AQControlServer_CloseConnection(server, connection);
+		}
+	}
+	
+	free(deferred);
+}
+
+void AQControlServer_Post(struct AQControlServer * server, AQTaskFunction function, void * arg)
+{
+	struct AQControlPost * post = (struct AQControlPost *) malloc(sizeof(struct AQControlPost));
+	UInt8 wakeByte = 0;
+	
+	post->mFunction = function;
+	post->mArg = arg;
+	post->mNext = NULL;
+	
+	pthread_mutex_lock(&server->mPostMutex);
+	*server->mPostsTail = post;
+	server->mPostsTail = &post->mNext;
+	pthread_mutex_unlock(&server->mPostMutex);
+	
+	if (write(server->mWakeFDs[1], &wakeByte, 1) < 0)
+	{
+		// The pipe is full, so the poll is woken already
+	}
+}
+
+void AQControlServer_Close(struct AQControlServer * server)
+{
+	if (server->mPostsTail)
+	{
+		AQControlServer_RunPosts(server);
+	}
+	
+	while (server->mConnections)
+	{
+		AQControlServer_CloseConnection(server, server->mConnections);
+	}
+	
+	if (server->mListenFD >= 0)
+	{
+		close(server->mListenFD);
+		server->mListenFD = -1;
+	}
+	
+	if (server->mPath)
+	{
+		unlink(server->mPath);
+		free(server->mPath);
+		server->mPath = NULL;
+	}
+	
+	if (server->mWakeFDs[0] >= 0)
+	{
+		close(server->mWakeFDs[0]);
+		close(server->mWakeFDs[1]);
+		server->mWakeFDs[0] = -1;
+		server->mWakeFDs[1] = -1;
+	}
+	
+	if (server->mPostsTail)
+	{
+		pthread_mutex_destroy(&server->mPostMutex);
+		server->mPostsTail = NULL;
+	}
+	
+	AQEventLoop_CleanUp(&server->mLoop);
+}
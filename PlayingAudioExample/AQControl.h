@@ -0,0 +1,181 @@
+//
+//  AQControl.h
+//  PlayingAudioExample
+//
+
+/* Binary control protocol over a Unix domain stream socket.
+ *
+ * Every message, in both directions, is an AQControlHeader followed by mLength
+ * bytes of payload, all in host byte order since both ends share the machine.
+ * A client may pipeline any number of requests; replies come back in request
+ * order and echo mSequence so they can be matched up anyway. A request whose
+ * handler answers later, as load does, holds up the rest of its connection but
+ * not the other connections.
+ *
+ *   command  request payload         reply payload
+ *   load     file path, no NUL       none, mPlayer is the new player
+ *   play     none                    none
+ *   pause    none                    none
+ *   seek     Float64 seconds         none
+ *   gain     Float32 linear gain     none
+ *   stats    none                    AQControlStats (mPlayer 0 for the server only)
+ */
+
+#ifndef AQControl_h
+#define AQControl_h
+
+#include "AQTypes.h"
+#include "AQEventLoop.h"
+#include "AQThreadPool.h"
+
+#include <pthread.h>
+
+static const UInt32 kAQControlMaxPayload = 4096;
+static const UInt32 kAQControlMaxReplyPayload = 64;
+
+enum
+{
+	kAQControlLoad = 1,
+	kAQControlPlay = 2,
+	kAQControlPause = 3,
+	kAQControlSeek = 4,
+	kAQControlGain = 5,
+	kAQControlStats = 6
+};
+
+enum
+{
+	kAQControlOK = 0,
+	kAQControlUnknownCommand = 1,
+	kAQControlUnknownPlayer = 2,
+	kAQControlBadPayload = 3,
+	kAQControlFailed = 4
+};
+
+enum
+{
+	kAQControlStopped = 0,
+	kAQControlPlaying = 1,
+	kAQControlPaused = 2
+};
+
+struct AQControlHeader
+{
+	UInt8 mCommand;
+	
+	/* Description:
+	 * One of the kAQControl status codes in replies, 0 in requests.
+	 */
+	UInt8 mStatus;
+	
+	UInt16 mLength;
+	UInt32 mSequence;
+	
+	/* Description:
+	 * Handle of the player the command is for, as returned by load.
+	 */
+	UInt32 mPlayer;
+};
+
+struct AQControlStats
+{
+	UInt32 mState;
+	UInt32 mNumPlayers;
+	
+	/* Description:
+	 * How far into its file the player has decoded, which runs a few buffers
+	 * ahead of what is audible.
+	 */
+	Float64 mPositionSeconds;
+	
+	Float32 mGain;
+	
+	/* Description:
+	 * From loading the player to its queue first running (including any time spent
+	 * paused before the first play), 0 until it has run.
+	 */
+	UInt32 mTimeToFirstSampleMicros;
+};
+
+/* Description:
+ * Runs one request. reply arrives filled in as an empty success echoing the
+ * request; the handler sets mStatus, and mLength when it writes replyPayload
+ * (at most kAQControlMaxReplyPayload bytes). payload is not NUL terminated.
+ */
+typedef void (*AQControlHandler)(void * context,
+								 const struct AQControlHeader * request, const void * payload,
+								 struct AQControlHeader * reply, void * replyPayload);
+
+struct AQControlConnection;
+
+/* Description:
+ * A request whose reply its handler put off with AQControlServer_Defer. mReply
+ * starts out as the empty success a handler gets; fill it in, and mReplyPayload
+ * with it, then send it with AQControlServer_Complete.
+ */
+struct AQControlDeferred
+{
+	struct AQControlHeader mReply;
+	UInt8 mReplyPayload[kAQControlMaxReplyPayload];
+	
+	/* Description:
+	 * Where the reply goes, NULL once the connection has closed.
+	 */
+	struct AQControlConnection * mConnection;
+};
+
+struct AQControlPost;
+
+struct AQControlServer
+{
+	struct AQEventLoop mLoop;
+	int mListenFD;
+	char * mPath;
+	
+	AQControlHandler mHandler;
+	void * mContext;
+	
+	/* Description:
+	 * Open client connections, linked through their mNext.
+	 */
+	struct AQControlConnection * mConnections;
+	UInt32 mNumConnections;
+	
+	/* Description:
+	 * The connection whose request the handler is running, for AQControlServer_Defer.
+	 */
+	struct AQControlConnection * mHandling;
+	const struct AQControlHeader * mHandlingRequest;
+	
+	/* Description:
+	 * Tasks posted from other threads, oldest first, and the pipe that wakes the
+	 * poll to run them.
+	 */
+	pthread_mutex_t mPostMutex;
+	struct AQControlPost * mPosts;
+	struct AQControlPost ** mPostsTail;
+	int mWakeFDs[2];
+};
+
+// Listens on path, replacing a stale socket file left there
+bool AQControlServer_Open(struct AQControlServer * server, const char path[], AQControlHandler handler, void * context);
+
+// Waits up to timeoutMs for socket activity and runs every request that has arrived,
+// and every task posted
+void AQControlServer_Poll(struct AQControlServer * server, int timeoutMs);
+
+// Only from inside a handler: answers the request later instead. Its connection runs no
+// further requests until AQControlServer_Complete, and is closed if the client hangs up.
+struct AQControlDeferred * AQControlServer_Defer(struct AQControlServer * server);
+
+// On the polling thread: sends the deferred reply, runs the requests held up behind it
+// and frees deferred
+void AQControlServer_Complete(struct AQControlServer * server, struct AQControlDeferred * deferred);
+
+// Any thread: has the polling thread run function(arg) from its next poll, waking it
+void AQControlServer_Post(struct AQControlServer * server, AQTaskFunction function, void * arg);
+
+// Runs the tasks still posted; none may be posted from here on
+void AQControlServer_Close(struct AQControlServer * server);
+
+#endif /* AQControl_h */
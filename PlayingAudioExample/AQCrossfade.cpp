@@ -0,0 +1,121 @@
+//
+//  AQCrossfade.cpp
+//  PlayingAudioExample
+//
+
+#include "AQCrossfade.h"
+#include "AQSimd.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void AQCrossfade_Init(struct AQCrossfade * xf, UInt32 lengthFrames, UInt32 channels)
+{
+	UInt32 k;
+	UInt32 c;
+	UInt32 numSamples = lengthFrames * channels;
+	
+	xf->mLengthFrames = lengthFrames;
+	xf->mChannels = channels;
+	xf->mFadeFrames = lengthFrames;
+	xf->mPosition = lengthFrames;
+	
+	xf->mFadeOutCurve = (Float32 *) malloc(numSamples * sizeof(Float32));
+	xf->mFadeInCurve = (Float32 *) malloc(numSamples * sizeof(Float32));
+	
+	for (k = 0; k < lengthFrames; k++)
+	{
+		// Quarter period over the fade; cos^2 + sin^2 = 1 keeps the summed power flat
+		Float64 theta = (k + 0.5) / lengthFrames * M_PI_2;
+		Float32 fadeOut = (Float32) cos(theta);
+		Float32 fadeIn = (Float32) sin(theta);
+		
+		for (c = 0; c < channels; c++)
+		{
+			xf->mFadeOutCurve[k * channels + c] = fadeOut;
+			xf->mFadeInCurve[k * channels + c] = fadeIn;
+		}
+	}
+}
+
+void AQCrossfade_CleanUp(struct AQCrossfade * xf)
+{
+	free(xf->mFadeOutCurve);
+	free(xf->mFadeInCurve);
+	memset(xf, 0, sizeof(struct AQCrossfade));
+}
+
+void AQCrossfade_Start(struct AQCrossfade * xf, UInt32 lengthFrames)
+{
+	if (lengthFrames > xf->mLengthFrames)
+	{
+		lengthFrames = xf->mLengthFrames;
+	}
+	
+	xf->mFadeFrames = lengthFrames;
+	xf->mPosition = 0;
+}
+
+bool AQCrossfade_IsDone(const struct AQCrossfade * xf)
+{
+	return xf->mPosition >= xf->mFadeFrames;
+}
+
+UInt32 AQCrossfade_FramesLeft(const struct AQCrossfade * xf)
+{
+	return xf->mFadeFrames - xf->mPosition;
+}
+
+UInt32 AQCrossfade_Mix(struct AQCrossfade * xf,
+					   const Float32 * outgoing,
+					   const Float32 * incoming,
+					   Float32 * dst,
+					   UInt32 inFrames)
+{
+	UInt32 frames = inFrames < AQCrossfade_FramesLeft(xf) ? inFrames : AQCrossfade_FramesLeft(xf);
+	UInt32 numSamples = frames * xf->mChannels;
+	const Float32 * fadeOut = xf->mFadeOutCurve + xf->mPosition * xf->mChannels;
+	const Float32 * fadeIn = xf->mFadeInCurve + xf->mPosition * xf->mChannels;
+	UInt32 k = 0;
+	UInt32 c;
+	
+	// A shorter fade takes the curve point nearest each of its frames, from full
+	// gain down to silence as a whole fade does, rather than starting part way in
+	if (xf->mFadeFrames < xf->mLengthFrames)
+	{
+		for (k = 0; k < frames; k++)
+		{
+			UInt64 point = ((2 * (UInt64) (xf->mPosition + k) + 1) * xf->mLengthFrames) / (2 * (UInt64) xf->mFadeFrames);
+			Float32 gainOut = xf->mFadeOutCurve[point * xf->mChannels];
+			Float32 gainIn = xf->mFadeInCurve[point * xf->mChannels];
+			
+			for (c = 0; c < xf->mChannels; c++)
+			{
+				UInt32 sample = k * xf->mChannels + c;
+				
+				dst[sample] = outgoing[sample] * gainOut + incoming[sample] * gainIn;
+			}
+		}
+		
+		xf->mPosition += frames;
+		
+		return frames;
+	}
+	
+	for (; k + AQ_SIMD_WIDTH <= numSamples; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 out = AQFloat4_Mul(AQFloat4_Load(outgoing + k), AQFloat4_Load(fadeOut + k));
+		
+		AQFloat4_Store(dst + k, AQFloat4_MulAdd(AQFloat4_Load(incoming + k), AQFloat4_Load(fadeIn + k), out));
+	}
+	
+	for (; k < numSamples; k++)
+	{
+		dst[k] = outgoing[k] * fadeOut[k] + incoming[k] * fadeIn[k];
+	}
+	
+	xf->mPosition += frames;
+	
+	return frames;
+}
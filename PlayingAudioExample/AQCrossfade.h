@@ -0,0 +1,54 @@
+//
+//  AQCrossfade.h
+//  PlayingAudioExample
+//
+
+#ifndef AQCrossfade_h
+#define AQCrossfade_h
+
+#include "AQTypes.h"
+
+struct AQCrossfade
+{
+	/* Description:
+	 * Equal-power gain curves, cos for the outgoing file and sin for the incoming one.
+	 * Each gain is repeated mChannels times so the curves line up with interleaved
+	 * samples and the blend is a straight vector multiply-add.
+	 */
+	Float32 * mFadeOutCurve;
+	Float32 * mFadeInCurve;
+	
+	/* Description:
+	 * Length of the fade in frames, and the interleaved channel count the curves were built for.
+	 */
+	UInt32 mLengthFrames;
+	UInt32 mChannels;
+	
+	/* Description:
+	 * Length of the fade under way, at most mLengthFrames; a shorter one steps
+	 * through the whole curves faster. mPosition counts its frames already mixed.
+	 */
+	UInt32 mFadeFrames;
+	UInt32 mPosition;
+};
+
+void AQCrossfade_Init(struct AQCrossfade * xf, UInt32 lengthFrames, UInt32 channels);
+
+void AQCrossfade_CleanUp(struct AQCrossfade * xf);
+
+// Start a new fade of at most lengthFrames (shorter fades go through the curves faster)
+void AQCrossfade_Start(struct AQCrossfade * xf, UInt32 lengthFrames);
+
+bool AQCrossfade_IsDone(const struct AQCrossfade * xf);
+
+UInt32 AQCrossfade_FramesLeft(const struct AQCrossfade * xf);
+
+// Blends up to inFrames interleaved frames of outgoing and incoming into dst (which
+// may alias outgoing) and returns the number of frames mixed.
+UInt32 AQCrossfade_Mix(struct AQCrossfade * xf,
+					   const Float32 * outgoing,
+					   const Float32 * incoming,
+					   Float32 * dst,
+					   UInt32 inFrames);
+
+#endif /* AQCrossfade_h */
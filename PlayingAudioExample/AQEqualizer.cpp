@@ -0,0 +1,297 @@
+//
+//  AQEqualizer.cpp
+//  PlayingAudioExample
+//
+
+#include "AQEqualizer.h"
+#include "AQSimd.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static
+void AQEqualizerSettings_InitPassThrough(struct AQEqualizerSettings * settings)
+{
+	UInt32 k;
+	
+	settings->mNumBands = 0;
+	
+	for (k = 0; k < kAQEqualizerMaxBands; k++)
+	{
+		struct AQBiquadCoefficients passThrough = { 1.f, 0.f, 0.f, 0.f, 0.f };
+		
+		settings->mCoefficients[k] = passThrough;
+	}
+}
+
+void AQBiquad_Design(const struct AQBiquadBand * band, Float64 sampleRate, struct AQBiquadCoefficients * outCoefficients)
+{
+	// Audio EQ cookbook (R. Bristow-Johnson) formulas
+	Float64 A = pow(10.0, band->mGainDB / 40.0);
+	Float64 w0 = 2.0 * M_PI * band->mFrequency / sampleRate;
+	Float64 cosW0 = cos(w0);
+	Float64 alpha = sin(w0) / (2.0 * band->mQ);
+	Float64 sqrtAAlpha2 = 2.0 * sqrt(A) * alpha;
+	Float64 b0, b1, b2, a0, a1, a2;
+	
+	switch (band->mType)
+	{
+		case kAQBiquadType_Peaking:
+			b0 = 1.0 + alpha * A;
+			b1 = -2.0 * cosW0;
+			b2 = 1.0 - alpha * A;
+			a0 = 1.0 + alpha / A;
+			a1 = -2.0 * cosW0;
+			a2 = 1.0 - alpha / A;
+			break;
+		case kAQBiquadType_LowShelf:
+			b0 = A * ((A + 1.0) - (A - 1.0) * cosW0 + sqrtAAlpha2);
+			b1 = 2.0 * A * ((A - 1.0) - (A + 1.0) * cosW0);
+			b2 = A * ((A + 1.0) - (A - 1.0) * cosW0 - sqrtAAlpha2);
+			a0 = (A + 1.0) + (A - 1.0) * cosW0 + sqrtAAlpha2;
+			a1 = -2.0 * ((A - 1.0) + (A + 1.0) * cosW0);
+			a2 = (A + 1.0) + (A - 1.0) * cosW0 - sqrtAAlpha2;
+			break;
+		case kAQBiquadType_HighShelf:
+			b0 = A * ((A + 1.0) + (A - 1.0) * cosW0 + sqrtAAlpha2);
+			b1 = -2.0 * A * ((A - 1.0) + (A + 1.0) * cosW0);
+			b2 = A * ((A + 1.0) + (A - 1.0) * cosW0 - sqrtAAlpha2);
+			a0 = (A + 1.0) - (A - 1.0) * cosW0 + sqrtAAlpha2;
+			a1 = 2.0 * ((A - 1.0) - (A + 1.0) * cosW0);
+			a2 = (A + 1.0) - (A - 1.0) * cosW0 - sqrtAAlpha2;
+			break;
+		case kAQBiquadType_LowPass:
+			b0 = (1.0 - cosW0) / 2.0;
+			b1 = 1.0 - cosW0;
+			b2 = (1.0 - cosW0) / 2.0;
+			a0 = 1.0 + alpha;
+			a1 = -2.0 * cosW0;
+			a2 = 1.0 - alpha;
+			break;
+		case kAQBiquadType_HighPass:
+		default:
+			b0 = (1.0 + cosW0) / 2.0;
+			b1 = -(1.0 + cosW0);
+			b2 = (1.0 + cosW0) / 2.0;
+			a0 = 1.0 + alpha;
+			a1 = -2.0 * cosW0;
+			a2 = 1.0 - alpha;
+			break;
+	}
+	
+	outCoefficients->mB0 = (Float32) (b0 / a0);
+	outCoefficients->mB1 = (Float32) (b1 / a0);
+	outCoefficients->mB2 = (Float32) (b2 / a0);
+	outCoefficients->mA1 = (Float32) (a1 / a0);
+	outCoefficients->mA2 = (Float32) (a2 / a0);
+}
+
+bool AQBiquad_IsBandValid(const struct AQBiquadBand * band, Float64 sampleRate)
+{
+	// The cookbook formulas fold a frequency at or past Nyquist back into an unstable filter
+	return band->mFrequency > 0.f && band->mQ > 0.f && (sampleRate == 0.0 || band->mFrequency < sampleRate / 2.0);
+}
+
+bool AQBiquad_ParseBand(const char * string, Float64 sampleRate, struct AQBiquadBand * outBand)
+{
+	static const struct
+	{
+		const char * mName;
+		AQBiquadType mType;
+	}
+	kTypeNames[] =
+	{
+		{ "peak",      kAQBiquadType_Peaking },
+		{ "lowshelf",  kAQBiquadType_LowShelf },
+		{ "highshelf", kAQBiquadType_HighShelf },
+		{ "lowpass",   kAQBiquadType_LowPass },
+		{ "highpass",  kAQBiquadType_HighPass },
+	};
+	
+	char typeName[16];
+	UInt32 k;
+	
+	outBand->mQ = (Float32) M_SQRT1_2;
+	outBand->mGainDB = 0.f;
+	
+	if (sscanf(string, "%15[a-z]:%f:%f:%f", typeName, &outBand->mFrequency, &outBand->mQ, &outBand->mGainDB) < 2)
+	{
+		return false;
+	}
+	
+	for (k = 0; k < sizeof(kTypeNames) / sizeof(kTypeNames[0]); k++)
+	{
+		if (strcmp(typeName, kTypeNames[k].mName) == 0)
+		{
+			outBand->mType = kTypeNames[k].mType;
+			return AQBiquad_IsBandValid(outBand, sampleRate);
+		}
+	}
+	
+	return false;
+}
+
+void AQEqualizer_Init(struct AQEqualizer * eq, UInt32 numChannels, Float64 sampleRate)
+{
+	struct AQEqualizerSettings passThrough;
+	
+	AQEqualizerSettings_InitPassThrough(&passThrough);
+	
+	eq->mSampleRate = sampleRate;
+	eq->mNumChannels = numChannels;
+	eq->mCurrent = passThrough;
+	
+	AQTripleBuffer_Init(&eq->mSettings, &passThrough);
+	
+	memset(eq->mZ1, 0, sizeof(eq->mZ1));
+	memset(eq->mZ2, 0, sizeof(eq->mZ2));
+}
+
+bool AQEqualizer_SetBands(struct AQEqualizer * eq, const struct AQBiquadBand * bands, UInt32 numBands)
+{
+	struct AQEqualizerSettings * settings = AQTripleBuffer_WriteBuffer(&eq->mSettings);
+	UInt32 k;
+	
+	for (k = 0; k < numBands && k < kAQEqualizerMaxBands; k++)
+	{
+		if (!AQBiquad_IsBandValid(&bands[k], eq->mSampleRate))
+		{
+			return false;
+		}
+	}
+	
+	AQEqualizerSettings_InitPassThrough(settings);
+	
+	settings->mNumBands = numBands < kAQEqualizerMaxBands ? numBands : kAQEqualizerMaxBands;
+	
+	for (k = 0; k < settings->mNumBands; k++)
+	{
+		AQBiquad_Design(&bands[k], eq->mSampleRate, &settings->mCoefficients[k]);
+	}
+	
+	AQTripleBuffer_Publish(&eq->mSettings);
+	
+	return true;
+}
+
+/* Description:
+ * Coefficients of every band for one ramp step, one per lane. The feedback
+ * ones are negated so each state update is two multiply-adds.
+ */
+struct AQEqualizerStep
+{
+	AQFloat4 mB0[kAQEqualizerMaxBands];
+	AQFloat4 mB1[kAQEqualizerMaxBands];
+	AQFloat4 mB2[kAQEqualizerMaxBands];
+	AQFloat4 mNegA1[kAQEqualizerMaxBands];
+	AQFloat4 mNegA2[kAQEqualizerMaxBands];
+};
+
+/* Runs NumLanes adjacent channels through the cascade. Frames go straight from
+ * memory into a register and back, and an IIR cannot put consecutive frames in
+ * one vector, so the lanes are channels and stereo leaves two of them idle.
+ */
+template <UInt32 NumLanes>
+static
+void AQEqualizer_ProcessLanes(const struct AQEqualizerStep * step, UInt32 numBands, AQFloat4 * z1, AQFloat4 * z2,
+							  Float32 * frame, UInt32 frameStride, UInt32 numFrames)
+{
+	UInt32 f, b;
+	
+	for (f = 0; f < numFrames; f++, frame += frameStride)
+	{
+		AQFloat4 x = AQFloat4_LoadPartial(frame, NumLanes);
+		
+		for (b = 0; b < numBands; b++)
+		{
+			AQFloat4 y = AQFloat4_MulAdd(step->mB0[b], x, z1[b]);
+			
+			z1[b] = AQFloat4_MulAdd(step->mNegA1[b], y, AQFloat4_MulAdd(step->mB1[b], x, z2[b]));
+			z2[b] = AQFloat4_MulAdd(step->mNegA2[b], y, AQFloat4_Mul(step->mB2[b], x));
+			x = y;
+		}
+		
+		AQFloat4_StorePartial(frame, x, NumLanes);
+	}
+}
+
+void AQEqualizer_Process(struct AQEqualizer * eq, Float32 * samples, UInt32 numFrames)
+{
+	AQTripleBuffer_Acquire(&eq->mSettings);
+	
+	const struct AQEqualizerSettings * target = AQTripleBuffer_ReadBuffer(&eq->mSettings);
+	const struct AQEqualizerSettings * current = &eq->mCurrent;
+	UInt32 numBands = current->mNumBands > target->mNumBands ? current->mNumBands : target->mNumBands;
+	UInt32 frameStride = eq->mNumChannels;
+	UInt32 numChannels = frameStride < kAQEqualizerMaxChannels ? frameStride : kAQEqualizerMaxChannels;
+	UInt32 numVectors = (numChannels + AQ_SIMD_WIDTH - 1) / AQ_SIMD_WIDTH;
+	UInt32 start;
+	
+	if (numBands == 0 || numFrames == 0)
+	{
+		return;
+	}
+	
+	for (start = 0; start < numFrames; start += kAQEqualizerRampFrames)
+	{
+		UInt32 numRampFrames = numFrames - start < kAQEqualizerRampFrames ? numFrames - start : kAQEqualizerRampFrames;
+		Float32 t = (Float32) (start + numRampFrames) / numFrames;
+		struct AQEqualizerStep step;
+		UInt32 b;
+		UInt32 v;
+		
+		// Linear ramp from the previous block's coefficients to the target ones
+		for (b = 0; b < numBands; b++)
+		{
+			const struct AQBiquadCoefficients * from = &current->mCoefficients[b];
+			const struct AQBiquadCoefficients * to = &target->mCoefficients[b];
+			
+			step.mB0[b] = AQFloat4_Set1(from->mB0 + (to->mB0 - from->mB0) * t);
+			step.mB1[b] = AQFloat4_Set1(from->mB1 + (to->mB1 - from->mB1) * t);
+			step.mB2[b] = AQFloat4_Set1(from->mB2 + (to->mB2 - from->mB2) * t);
+			step.mNegA1[b] = AQFloat4_Set1(-(from->mA1 + (to->mA1 - from->mA1) * t));
+			step.mNegA2[b] = AQFloat4_Set1(-(from->mA2 + (to->mA2 - from->mA2) * t));
+		}
+		
+		// Up to four channels per vector, the bands cascaded in registers
+		for (v = 0; v < numVectors; v++)
+		{
+			UInt32 firstChannel = v * AQ_SIMD_WIDTH;
+			UInt32 numLanes = numChannels - firstChannel < AQ_SIMD_WIDTH ? numChannels - firstChannel : AQ_SIMD_WIDTH;
+			Float32 * frame = samples + start * frameStride + firstChannel;
+			AQFloat4 z1[kAQEqualizerMaxBands];
+			AQFloat4 z2[kAQEqualizerMaxBands];
+			
+			for (b = 0; b < numBands; b++)
+			{
+				z1[b] = AQFloat4_Load(&eq->mZ1[b][firstChannel]);
+				z2[b] = AQFloat4_Load(&eq->mZ2[b][firstChannel]);
+			}
+			
+			switch (numLanes)
+			{
+				case 1:  AQEqualizer_ProcessLanes<1>(&step, numBands, z1, z2, frame, frameStride, numRampFrames); break;
+				case 2:  AQEqualizer_ProcessLanes<2>(&step, numBands, z1, z2, frame, frameStride, numRampFrames); break;
+				case 3:  AQEqualizer_ProcessLanes<3>(&step, numBands, z1, z2, frame, frameStride, numRampFrames); break;
+				default: AQEqualizer_ProcessLanes<4>(&step, numBands, z1, z2, frame, frameStride, numRampFrames); break;
+			}
+			
+			for (b = 0; b < numBands; b++)
+			{
+				AQFloat4_Store(&eq->mZ1[b][firstChannel], z1[b]);
+				AQFloat4_Store(&eq->mZ2[b][firstChannel], z2[b]);
+			}
+		}
+	}
+	
+	// Bands that just ramped out must not ring with stale state if they come back
+	for (UInt32 k = target->mNumBands; k < numBands; k++)
+	{
+		memset(eq->mZ1[k], 0, sizeof(eq->mZ1[k]));
+		memset(eq->mZ2[k], 0, sizeof(eq->mZ2[k]));
+	}
+	
+	eq->mCurrent = *target;
+}
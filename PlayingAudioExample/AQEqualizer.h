@@ -0,0 +1,101 @@
+//
+//  AQEqualizer.h
+//  PlayingAudioExample
+//
+
+#ifndef AQEqualizer_h
+#define AQEqualizer_h
+
+#include "AQTypes.h"
+#include "AQTripleBuffer.h"
+
+static const UInt32 kAQEqualizerMaxBands = 8;
+static const UInt32 kAQEqualizerMaxChannels = 8;
+
+// Coefficients are held constant over runs of this many frames while ramping to new settings
+static const UInt32 kAQEqualizerRampFrames = 32;
+
+enum AQBiquadType
+{
+	kAQBiquadType_Peaking,
+	kAQBiquadType_LowShelf,
+	kAQBiquadType_HighShelf,
+	kAQBiquadType_LowPass,
+	kAQBiquadType_HighPass
+};
+
+struct AQBiquadBand
+{
+	AQBiquadType mType;
+	Float32 mFrequency;		// Hz
+	Float32 mQ;
+	Float32 mGainDB;		// ignored by the low and high pass filters
+};
+
+/* Description:
+ * Transposed direct form II coefficients, normalized so that a0 = 1.
+ */
+struct AQBiquadCoefficients
+{
+	Float32 mB0;
+	Float32 mB1;
+	Float32 mB2;
+	Float32 mA1;
+	Float32 mA2;
+};
+
+struct AQEqualizerSettings
+{
+	UInt32 mNumBands;
+	
+	/* Description:
+	 * Bands past mNumBands are kept as pass-through so that a ramp between settings
+	 * with different band counts is still a plain interpolation.
+	 */
+	struct AQBiquadCoefficients mCoefficients[kAQEqualizerMaxBands];
+};
+
+struct AQEqualizer
+{
+	Float64 mSampleRate;
+	UInt32 mNumChannels;		// interleaved channels per frame, the first kAQEqualizerMaxChannels filtered
+	
+	/* Description:
+	 * Settings published by AQEqualizer_SetBands from any one control thread and
+	 * picked up by AQEqualizer_Process at the start of each block.
+	 */
+	AQTripleBuffer<struct AQEqualizerSettings> mSettings;
+	
+	/* Description:
+	 * The settings the audio thread finished the previous block with. A block
+	 * ramps from these to the latest published settings.
+	 */
+	struct AQEqualizerSettings mCurrent;
+	
+	/* Description:
+	 * Filter state per band, channels in lanes.
+	 */
+	Float32 mZ1[kAQEqualizerMaxBands][kAQEqualizerMaxChannels];
+	Float32 mZ2[kAQEqualizerMaxBands][kAQEqualizerMaxChannels];
+};
+
+// numChannels is capped at kAQEqualizerMaxChannels, further channels pass through
+void AQEqualizer_Init(struct AQEqualizer * eq, UInt32 numChannels, Float64 sampleRate);
+
+// Control thread: designs the cascade and hands it to the audio thread without locking.
+// Returns false, keeping the current bands, when a band is not valid at the equalizer's rate
+bool AQEqualizer_SetBands(struct AQEqualizer * eq, const struct AQBiquadBand * bands, UInt32 numBands);
+
+// Audio thread: filters interleaved samples in place, never allocates
+void AQEqualizer_Process(struct AQEqualizer * eq, Float32 * samples, UInt32 numFrames);
+
+void AQBiquad_Design(const struct AQBiquadBand * band, Float64 sampleRate, struct AQBiquadCoefficients * outCoefficients);
+
+// Positive frequency and Q, and the frequency below Nyquist; a sampleRate of 0 skips that check
+bool AQBiquad_IsBandValid(const struct AQBiquadBand * band, Float64 sampleRate);
+
+// Parses "type:frequency:q:gain" as given on the command line, type being one of
+// peak, lowshelf, highshelf, lowpass or highpass, and checks it with AQBiquad_IsBandValid
+bool AQBiquad_ParseBand(const char * string, Float64 sampleRate, struct AQBiquadBand * outBand);
+
+#endif /* AQEqualizer_h */
@@ -0,0 +1,182 @@
+//
+//  AQEventLoop.cpp
+//  PlayingAudioExample
+//
+
+#include "AQEventLoop.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+// Events taken from the kernel per wait
+static const UInt32 kAQEventLoopBatch = 64;
+
+#if defined(__linux__)
+
+bool AQEventLoop_Init(struct AQEventLoop * loop)
+{
+	loop->mFD = epoll_create1(EPOLL_CLOEXEC);
+	
+	return loop->mFD >= 0;
+}
+
+static
+bool AQEventLoop_Control(struct AQEventLoop * loop, int operation, int fd, void * context, bool writable)
+{
+	struct epoll_event event;
+	
+	event.events = EPOLLIN | EPOLLRDHUP;
+	
+	if (writable)
+	{
+		event.events |= EPOLLOUT;
+	}
+	
+	event.data.ptr = context;
+	
+	return epoll_ctl(loop->mFD, operation, fd, &event) == 0;
+}
+
+bool AQEventLoop_Add(struct AQEventLoop * loop, int fd, void * context, bool writable)
+{
+	return AQEventLoop_Control(loop, EPOLL_CTL_ADD, fd, context, writable);
+}
+
+bool AQEventLoop_SetWritable(struct AQEventLoop * loop, int fd, void * context, bool writable)
+{
+	return AQEventLoop_Control(loop, EPOLL_CTL_MOD, fd, context, writable);
+}
+
+void AQEventLoop_Remove(struct AQEventLoop * loop, int fd)
+{
+	struct epoll_event event;
+	
+	epoll_ctl(loop->mFD, EPOLL_CTL_DEL, fd, &event);
+}
+
+int AQEventLoop_Wait(struct AQEventLoop * loop, struct AQEvent * events, UInt32 maxEvents, int timeoutMs)
+{
+	struct epoll_event kernelEvents[kAQEventLoopBatch];
+	int numEvents;
+	int k;
+	
+	if (maxEvents > kAQEventLoopBatch)
+	{
+		maxEvents = kAQEventLoopBatch;
+	}
+	
+	do
+	{
+		numEvents = epoll_wait(loop->mFD, kernelEvents, maxEvents, timeoutMs);
+	} while (numEvents < 0 && errno == EINTR && timeoutMs < 0);
+	
+	if (numEvents < 0)
+	{
+		// A signal cut a timed wait short, report it as a timeout so the caller can look around
+		return errno == EINTR ? 0 : -1;
+	}
+	
+	for (k = 0; k < numEvents; k++)
+	{
+		events[k].mContext = kernelEvents[k].data.ptr;
+		events[k].mReadable = (kernelEvents[k].events & EPOLLIN) != 0;
+		events[k].mWritable = (kernelEvents[k].events & EPOLLOUT) != 0;
+		events[k].mHangUp = (kernelEvents[k].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) != 0;
+	}
+	
+	return numEvents;
+}
+
+#else
+
+bool AQEventLoop_Init(struct AQEventLoop * loop)
+{
+	loop->mFD = kqueue();
+	
+	return loop->mFD >= 0;
+}
+
+bool AQEventLoop_Add(struct AQEventLoop * loop, int fd, void * context, bool writable)
+{
+	struct kevent changes[2];
+	
+	EV_SET(&changes[0], fd, EVFILT_READ, EV_ADD, 0, 0, context);
+	EV_SET(&changes[1], fd, EVFILT_WRITE, EV_ADD | (writable ? EV_ENABLE : EV_DISABLE), 0, 0, context);
+	
+	return kevent(loop->mFD, changes, 2, NULL, 0, NULL) == 0;
+}
+
+bool AQEventLoop_SetWritable(struct AQEventLoop * loop, int fd, void * context, bool writable)
+{
+	struct kevent change;
+	
+	EV_SET(&change, fd, EVFILT_WRITE, writable ? EV_ENABLE : EV_DISABLE, 0, 0, context);
+	
+	return kevent(loop->mFD, &change, 1, NULL, 0, NULL) == 0;
+}
+
+void AQEventLoop_Remove(struct AQEventLoop * loop, int fd)
+{
+	struct kevent changes[2];
+	
+	EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+	EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+	
+	kevent(loop->mFD, changes, 2, NULL, 0, NULL);
+}
+
+int AQEventLoop_Wait(struct AQEventLoop * loop, struct AQEvent * events, UInt32 maxEvents, int timeoutMs)
+{
+	struct kevent kernelEvents[kAQEventLoopBatch];
+	struct timespec timeout;
+	int numEvents;
+	int k;
+	
+	if (maxEvents > kAQEventLoopBatch)
+	{
+		maxEvents = kAQEventLoopBatch;
+	}
+	
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+	
+	do
+	{
+		numEvents = kevent(loop->mFD, NULL, 0, kernelEvents, maxEvents, timeoutMs < 0 ? NULL : &timeout);
+	} while (numEvents < 0 && errno == EINTR && timeoutMs < 0);
+	
+	if (numEvents < 0)
+	{
+		return errno == EINTR ? 0 : -1;
+	}
+	
+	// kqueue reports reading and writing as separate events, one per filter
+	for (k = 0; k < numEvents; k++)
+	{
+		events[k].mContext = kernelEvents[k].udata;
+		events[k].mReadable = kernelEvents[k].filter == EVFILT_READ;
+		events[k].mWritable = kernelEvents[k].filter == EVFILT_WRITE;
+		events[k].mHangUp = (kernelEvents[k].flags & (EV_EOF | EV_ERROR)) != 0;
+	}
+	
+	return numEvents;
+}
+
+#endif
+
+void AQEventLoop_CleanUp(struct AQEventLoop * loop)
+{
+	if (loop->mFD >= 0)
+	{
+		close(loop->mFD);
+		loop->mFD = -1;
+	}
+}
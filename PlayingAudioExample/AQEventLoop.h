@@ -0,0 +1,50 @@
+//
+//  AQEventLoop.h
+//  PlayingAudioExample
+//
+
+/* Readiness notification for non-blocking sockets: epoll on Linux, kqueue on
+ * macOS and the BSDs. Each descriptor is registered with a context pointer that
+ * comes back with its events.
+ */
+
+#ifndef AQEventLoop_h
+#define AQEventLoop_h
+
+#include "AQTypes.h"
+
+struct AQEvent
+{
+	void * mContext;
+	bool mReadable;
+	bool mWritable;
+	
+	/* Description:
+	 * The peer hung up or the descriptor is in error. Reading may still return
+	 * the last bytes that arrived.
+	 */
+	bool mHangUp;
+};
+
+struct AQEventLoop
+{
+	int mFD;
+};
+
+bool AQEventLoop_Init(struct AQEventLoop * loop);
+
+void AQEventLoop_CleanUp(struct AQEventLoop * loop);
+
+// Watches fd for reading, and for writing too when writable is set
+bool AQEventLoop_Add(struct AQEventLoop * loop, int fd, void * context, bool writable);
+
+// Turns write interest on or off for a descriptor already added with the same context
+bool AQEventLoop_SetWritable(struct AQEventLoop * loop, int fd, void * context, bool writable);
+
+// Call before closing fd
+void AQEventLoop_Remove(struct AQEventLoop * loop, int fd);
+
+// Waits up to timeoutMs (-1 forever) and returns the number of events stored, -1 on error
+int AQEventLoop_Wait(struct AQEventLoop * loop, struct AQEvent * events, UInt32 maxEvents, int timeoutMs);
+
+#endif /* AQEventLoop_h */
@@ -0,0 +1,321 @@
+//
+//  AQFFT.cpp
+//  PlayingAudioExample
+//
+
+#include "AQFFT.h"
+#include "AQSimd.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void AQFFTPlan_Init(struct AQFFTPlan * plan, UInt32 size)
+{
+	UInt32 n;
+	UInt32 pass = 0;
+	
+	memset(plan, 0, sizeof(struct AQFFTPlan));
+	
+	plan->mSize = size;
+	plan->mWorkRe = (Float32 *) malloc(size * sizeof(Float32));
+	plan->mWorkIm = (Float32 *) malloc(size * sizeof(Float32));
+	
+	for (n = size; n >= 4; n /= 4, pass++)
+	{
+		UInt32 m = n / 4;
+		UInt32 k, p;
+		
+		for (k = 0; k < 3; k++)
+		{
+			plan->mTwiddleRe[pass][k] = (Float32 *) malloc(m * sizeof(Float32));
+			plan->mTwiddleIm[pass][k] = (Float32 *) malloc(m * sizeof(Float32));
+			
+			for (p = 0; p < m; p++)
+			{
+				Float64 theta = -2.0 * M_PI * (k + 1) * p / n;
+				
+				plan->mTwiddleRe[pass][k][p] = (Float32) cos(theta);
+				plan->mTwiddleIm[pass][k][p] = (Float32) sin(theta);
+			}
+		}
+	}
+	
+	plan->mNumPasses = pass + (n == 2 ? 1 : 0);
+}
+
+void AQFFTPlan_CleanUp(struct AQFFTPlan * plan)
+{
+	UInt32 pass, k;
+	
+	for (pass = 0; pass < kAQFFTMaxPasses; pass++)
+	{
+		for (k = 0; k < 3; k++)
+		{
+			free(plan->mTwiddleRe[pass][k]);
+			free(plan->mTwiddleIm[pass][k]);
+		}
+	}
+	
+	free(plan->mWorkRe);
+	free(plan->mWorkIm);
+	
+	memset(plan, 0, sizeof(struct AQFFTPlan));
+}
+
+/* One radix-4 Stockham pass over n-point sub-transforms interleaved with stride s.
+ * Sign is -1 for the forward transform and +1 for the inverse one; it selects
+ * between multiplying by -i and +i, and conjugates the twiddles.
+ */
+static
+void AQFFT_Radix4Pass(UInt32 n, UInt32 s, Float32 sign,
+					  const Float32 * twRe[3], const Float32 * twIm[3],
+					  const Float32 * xRe, const Float32 * xIm,
+					  Float32 * yRe, Float32 * yIm)
+{
+	UInt32 m = n / 4;
+	UInt32 p, q;
+	
+	for (p = 0; p < m; p++)
+	{
+		Float32 w1r = twRe[0][p], w1i = sign < 0 ? twIm[0][p] : -twIm[0][p];
+		Float32 w2r = twRe[1][p], w2i = sign < 0 ? twIm[1][p] : -twIm[1][p];
+		Float32 w3r = twRe[2][p], w3i = sign < 0 ? twIm[2][p] : -twIm[2][p];
+		
+		const Float32 * aRe = xRe + s * p;
+		const Float32 * aIm = xIm + s * p;
+		const Float32 * bRe = aRe + s * m;
+		const Float32 * bIm = aIm + s * m;
+		const Float32 * cRe = bRe + s * m;
+		const Float32 * cIm = bIm + s * m;
+		const Float32 * dRe = cRe + s * m;
+		const Float32 * dIm = cIm + s * m;
+		
+		Float32 * y0Re = yRe + s * 4 * p;
+		Float32 * y0Im = yIm + s * 4 * p;
+		Float32 * y1Re = y0Re + s;
+		Float32 * y1Im = y0Im + s;
+		Float32 * y2Re = y1Re + s;
+		Float32 * y2Im = y1Im + s;
+		Float32 * y3Re = y2Re + s;
+		Float32 * y3Im = y2Im + s;
+		
+		q = 0;
+		
+		if (s >= AQ_SIMD_WIDTH)
+		{
+			AQFloat4 vSign = AQFloat4_Set1(sign);
+			AQFloat4 vW1r = AQFloat4_Set1(w1r), vW1i = AQFloat4_Set1(w1i);
+			AQFloat4 vW2r = AQFloat4_Set1(w2r), vW2i = AQFloat4_Set1(w2i);
+			AQFloat4 vW3r = AQFloat4_Set1(w3r), vW3i = AQFloat4_Set1(w3i);
+			
+			for (; q + AQ_SIMD_WIDTH <= s; q += AQ_SIMD_WIDTH)
+			{
+				AQFloat4 ar = AQFloat4_Load(aRe + q), ai = AQFloat4_Load(aIm + q);
+				AQFloat4 br = AQFloat4_Load(bRe + q), bi = AQFloat4_Load(bIm + q);
+				AQFloat4 cr = AQFloat4_Load(cRe + q), ci = AQFloat4_Load(cIm + q);
+				AQFloat4 dr = AQFloat4_Load(dRe + q), di = AQFloat4_Load(dIm + q);
+				
+				AQFloat4 apcR = AQFloat4_Add(ar, cr), apcI = AQFloat4_Add(ai, ci);
+				AQFloat4 amcR = AQFloat4_Sub(ar, cr), amcI = AQFloat4_Sub(ai, ci);
+				AQFloat4 bpdR = AQFloat4_Add(br, dr), bpdI = AQFloat4_Add(bi, di);
+				
+				// j (b - d) with j = -i forward, +i inverse
+				AQFloat4 jbmdR = AQFloat4_Mul(vSign, AQFloat4_Sub(di, bi));
+				AQFloat4 jbmdI = AQFloat4_Mul(vSign, AQFloat4_Sub(br, dr));
+				
+				AQFloat4 t1r = AQFloat4_Add(amcR, jbmdR), t1i = AQFloat4_Add(amcI, jbmdI);
+				AQFloat4 t2r = AQFloat4_Sub(apcR, bpdR), t2i = AQFloat4_Sub(apcI, bpdI);
+				AQFloat4 t3r = AQFloat4_Sub(amcR, jbmdR), t3i = AQFloat4_Sub(amcI, jbmdI);
+				
+				AQFloat4_Store(y0Re + q, AQFloat4_Add(apcR, bpdR));
+				AQFloat4_Store(y0Im + q, AQFloat4_Add(apcI, bpdI));
+				AQFloat4_Store(y1Re + q, AQFloat4_Sub(AQFloat4_Mul(t1r, vW1r), AQFloat4_Mul(t1i, vW1i)));
+				AQFloat4_Store(y1Im + q, AQFloat4_MulAdd(t1r, vW1i, AQFloat4_Mul(t1i, vW1r)));
+				AQFloat4_Store(y2Re + q, AQFloat4_Sub(AQFloat4_Mul(t2r, vW2r), AQFloat4_Mul(t2i, vW2i)));
+				AQFloat4_Store(y2Im + q, AQFloat4_MulAdd(t2r, vW2i, AQFloat4_Mul(t2i, vW2r)));
+				AQFloat4_Store(y3Re + q, AQFloat4_Sub(AQFloat4_Mul(t3r, vW3r), AQFloat4_Mul(t3i, vW3i)));
+				AQFloat4_Store(y3Im + q, AQFloat4_MulAdd(t3r, vW3i, AQFloat4_Mul(t3i, vW3r)));
+			}
+		}
+		
+		for (; q < s; q++)
+		{
+			Float32 apcR = aRe[q] + cRe[q], apcI = aIm[q] + cIm[q];
+			Float32 amcR = aRe[q] - cRe[q], amcI = aIm[q] - cIm[q];
+			Float32 bpdR = bRe[q] + dRe[q], bpdI = bIm[q] + dIm[q];
+			Float32 jbmdR = sign * (dIm[q] - bIm[q]);
+			Float32 jbmdI = sign * (bRe[q] - dRe[q]);
+			
+			Float32 t1r = amcR + jbmdR, t1i = amcI + jbmdI;
+			Float32 t2r = apcR - bpdR, t2i = apcI - bpdI;
+			Float32 t3r = amcR - jbmdR, t3i = amcI - jbmdI;
+			
+			y0Re[q] = apcR + bpdR;
+			y0Im[q] = apcI + bpdI;
+			y1Re[q] = t1r * w1r - t1i * w1i;
+			y1Im[q] = t1r * w1i + t1i * w1r;
+			y2Re[q] = t2r * w2r - t2i * w2i;
+			y2Im[q] = t2r * w2i + t2i * w2r;
+			y3Re[q] = t3r * w3r - t3i * w3i;
+			y3Im[q] = t3r * w3i + t3i * w3r;
+		}
+	}
+}
+
+// Final radix-2 pass when log2(size) is odd: two-point butterflies with stride s
+static
+void AQFFT_Radix2Pass(UInt32 s,
+					  const Float32 * xRe, const Float32 * xIm,
+					  Float32 * yRe, Float32 * yIm)
+{
+	UInt32 q = 0;
+	
+	for (; q + AQ_SIMD_WIDTH <= s; q += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 ar = AQFloat4_Load(xRe + q), ai = AQFloat4_Load(xIm + q);
+		AQFloat4 br = AQFloat4_Load(xRe + s + q), bi = AQFloat4_Load(xIm + s + q);
+		
+		AQFloat4_Store(yRe + q, AQFloat4_Add(ar, br));
+		AQFloat4_Store(yIm + q, AQFloat4_Add(ai, bi));
+		AQFloat4_Store(yRe + s + q, AQFloat4_Sub(ar, br));
+		AQFloat4_Store(yIm + s + q, AQFloat4_Sub(ai, bi));
+	}
+	
+	for (; q < s; q++)
+	{
+		Float32 ar = xRe[q], ai = xIm[q];
+		Float32 br = xRe[s + q], bi = xIm[s + q];
+		
+		yRe[q] = ar + br;
+		yIm[q] = ai + bi;
+		yRe[s + q] = ar - br;
+		yIm[s + q] = ai - bi;
+	}
+}
+
+static
+void AQFFT_Transform(struct AQFFTPlan * plan, Float32 * re, Float32 * im, Float32 sign)
+{
+	Float32 * xRe = re, * xIm = im;
+	Float32 * yRe = plan->mWorkRe, * yIm = plan->mWorkIm;
+	UInt32 n = plan->mSize;
+	UInt32 s = 1;
+	UInt32 pass = 0;
+	
+	for (; n >= 4; n /= 4, s *= 4, pass++)
+	{
+		const Float32 * twRe[3] = { plan->mTwiddleRe[pass][0], plan->mTwiddleRe[pass][1], plan->mTwiddleRe[pass][2] };
+		const Float32 * twIm[3] = { plan->mTwiddleIm[pass][0], plan->mTwiddleIm[pass][1], plan->mTwiddleIm[pass][2] };
+		Float32 * tmp;
+		
+		AQFFT_Radix4Pass(n, s, sign, twRe, twIm, xRe, xIm, yRe, yIm);
+		
+		tmp = xRe; xRe = yRe; yRe = tmp;
+		tmp = xIm; xIm = yIm; yIm = tmp;
+	}
+	
+	if (n == 2)
+	{
+		AQFFT_Radix2Pass(s, xRe, xIm, yRe, yIm);
+		
+		xRe = yRe;
+		xIm = yIm;
+	}
+	
+	// An odd number of passes leaves the result in the work buffer
+	if (xRe != re)
+	{
+		memcpy(re, xRe, plan->mSize * sizeof(Float32));
+		memcpy(im, xIm, plan->mSize * sizeof(Float32));
+	}
+}
+
+void AQFFT_Forward(struct AQFFTPlan * plan, Float32 * re, Float32 * im)
+{
+	AQFFT_Transform(plan, re, im, -1.f);
+}
+
+void AQFFT_Inverse(struct AQFFTPlan * plan, Float32 * re, Float32 * im)
+{
+	AQFFT_Transform(plan, re, im, 1.f);
+}
+
+void AQRealFFTPlan_Init(struct AQRealFFTPlan * plan, UInt32 size)
+{
+	UInt32 half = size / 2;
+	UInt32 k;
+	
+	plan->mSize = size;
+	
+	AQFFTPlan_Init(&plan->mHalf, half);
+	
+	plan->mSplitRe = (Float32 *) malloc((half / 2 + 1) * sizeof(Float32));
+	plan->mSplitIm = (Float32 *) malloc((half / 2 + 1) * sizeof(Float32));
+	plan->mPackedRe = (Float32 *) malloc(half * sizeof(Float32));
+	plan->mPackedIm = (Float32 *) malloc(half * sizeof(Float32));
+	
+	for (k = 0; k <= half / 2; k++)
+	{
+		Float64 theta = -2.0 * M_PI * k / size;
+		
+		plan->mSplitRe[k] = (Float32) cos(theta);
+		plan->mSplitIm[k] = (Float32) sin(theta);
+	}
+}
+
+void AQRealFFTPlan_CleanUp(struct AQRealFFTPlan * plan)
+{
+	AQFFTPlan_CleanUp(&plan->mHalf);
+	
+	free(plan->mSplitRe);
+	free(plan->mSplitIm);
+	free(plan->mPackedRe);
+	free(plan->mPackedIm);
+	
+	memset(plan, 0, sizeof(struct AQRealFFTPlan));
+}
+
+void AQRealFFT_Forward(struct AQRealFFTPlan * plan, const Float32 * in, Float32 * outRe, Float32 * outIm)
+{
+	UInt32 half = plan->mSize / 2;
+	Float32 * zRe = plan->mPackedRe;
+	Float32 * zIm = plan->mPackedIm;
+	UInt32 k;
+	
+	// Even samples as the real part, odd samples as the imaginary part
+	for (k = 0; k < half; k++)
+	{
+		zRe[k] = in[2 * k];
+		zIm[k] = in[2 * k + 1];
+	}
+	
+	AQFFT_Forward(&plan->mHalf, zRe, zIm);
+	
+	outRe[0] = zRe[0] + zIm[0];
+	outIm[0] = 0.f;
+	outRe[half] = zRe[0] - zIm[0];
+	outIm[half] = 0.f;
+	
+	/* Split: with E = (Z[k] + conj Z[half - k]) / 2 and O = (Z[k] - conj Z[half - k]) / 2i,
+	 * X[k] = E + w^k O and X[half - k] = conj(E - w^k O), w = exp(-2 pi i / size).
+	 * Bins k and half - k share the work, so only k <= half / 2 is visited.
+	 */
+	for (k = 1; k <= half / 2; k++)
+	{
+		UInt32 j = half - k;
+		Float32 eRe = 0.5f * (zRe[k] + zRe[j]);
+		Float32 eIm = 0.5f * (zIm[k] - zIm[j]);
+		Float32 oRe = 0.5f * (zIm[k] + zIm[j]);
+		Float32 oIm = -0.5f * (zRe[k] - zRe[j]);
+		Float32 wRe = plan->mSplitRe[k];
+		Float32 wIm = plan->mSplitIm[k];
+		Float32 woRe = wRe * oRe - wIm * oIm;
+		Float32 woIm = wRe * oIm + wIm * oRe;
+		
+		outRe[k] = eRe + woRe;
+		outIm[k] = eIm + woIm;
+		outRe[j] = eRe - woRe;
+		outIm[j] = -(eIm - woIm);
+	}
+}
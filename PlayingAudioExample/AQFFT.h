@@ -0,0 +1,80 @@
+//
+//  AQFFT.h
+//  PlayingAudioExample
+//
+
+/* Power-of-two FFTs on split (separate real and imaginary) arrays.
+ *
+ * The complex transform is a Stockham autosort FFT: radix-4 passes plus one
+ * radix-2 pass when log2(n) is odd, ping-ponging between the data and a work
+ * buffer so no bit reversal is needed. Once a pass's stride reaches the vector
+ * width its butterflies run AQ_SIMD_WIDTH at a time on contiguous memory.
+ * All twiddles are computed when the plan is created.
+ */
+
+#ifndef AQFFT_h
+#define AQFFT_h
+
+#include "AQTypes.h"
+
+static const UInt32 kAQFFTMaxPasses = 16;
+
+struct AQFFTPlan
+{
+	UInt32 mSize;
+	UInt32 mNumPasses;
+	
+	/* Description:
+	 * Per radix-4 pass, the twiddles w^p, w^2p and w^3p for p < size / 4 of that
+	 * pass, real and imaginary parts in separate arrays. A trailing radix-2
+	 * pass needs none.
+	 */
+	Float32 * mTwiddleRe[kAQFFTMaxPasses][3];
+	Float32 * mTwiddleIm[kAQFFTMaxPasses][3];
+	
+	/* Description:
+	 * Scratch arrays of mSize values the passes ping-pong with.
+	 */
+	Float32 * mWorkRe;
+	Float32 * mWorkIm;
+};
+
+/* Description:
+ * Real FFT of mSize samples, computed as a complex FFT of half the size plus a
+ * split step.
+ */
+struct AQRealFFTPlan
+{
+	UInt32 mSize;
+	struct AQFFTPlan mHalf;
+	
+	/* Description:
+	 * exp(-2 pi i k / mSize) for k <= mSize / 4, used by the split step.
+	 */
+	Float32 * mSplitRe;
+	Float32 * mSplitIm;
+	
+	Float32 * mPackedRe;
+	Float32 * mPackedIm;
+};
+
+// size must be a power of two, at least 4
+void AQFFTPlan_Init(struct AQFFTPlan * plan, UInt32 size);
+
+void AQFFTPlan_CleanUp(struct AQFFTPlan * plan);
+
+// Forward transform in place, unnormalized: X[k] = sum x[n] exp(-2 pi i n k / size)
+void AQFFT_Forward(struct AQFFTPlan * plan, Float32 * re, Float32 * im);
+
+// Inverse transform in place, unnormalized (the caller scales by 1 / size)
+void AQFFT_Inverse(struct AQFFTPlan * plan, Float32 * re, Float32 * im);
+
+// size must be a power of two, at least 8
+void AQRealFFTPlan_Init(struct AQRealFFTPlan * plan, UInt32 size);
+
+void AQRealFFTPlan_CleanUp(struct AQRealFFTPlan * plan);
+
+// Transforms size real samples into bins 0 ... size / 2 (size / 2 + 1 values in each output array)
+void AQRealFFT_Forward(struct AQRealFFTPlan * plan, const Float32 * in, Float32 * outRe, Float32 * outIm);
+
+#endif /* AQFFT_h */
@@ -0,0 +1,1334 @@
+//
+//  AQFLAC.cpp
+//  PlayingAudioExample
+//
+
+#include "AQFLAC.h"
+#include "AQTrace.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const UInt32 kFLACMetadataStreamInfo = 0;
+static const UInt32 kFLACStreamInfoSize = 34;
+
+static const UInt32 kFLACMinBitsPerSample = 4;
+static const UInt32 kFLACMaxBitsPerSample = 24;
+static const UInt32 kFLACMinBlockSize = 16;
+
+// Channel assignments past the independent ones, the side channel taking one bit more
+static const UInt32 kFLACChannelsLeftSide = 8;
+static const UInt32 kFLACChannelsSideRight = 9;
+static const UInt32 kFLACChannelsMidSide = 10;
+
+// Subframe types: fixed predictors of orders 0 to 4 and LPC of orders 1 to 32 above these
+static const UInt32 kFLACSubframeConstant = 0;
+static const UInt32 kFLACSubframeVerbatim = 1;
+static const UInt32 kFLACSubframeFixed = 8;
+static const UInt32 kFLACSubframeLPC = 32;
+
+static const UInt32 kFLACMaxFixedOrder = 4;
+static const UInt32 kFLACMaxLPCOrder = 32;
+
+// Most a frame header takes: sync and codes, a 7 byte frame number, 16 bit block size and
+// sample rate, CRC-8
+static const UInt32 kFLACMaxHeaderSize = 16;
+
+// Bytes the system is asked to fetch ahead of the sequential decode at a time
+static const size_t kFLACReadAheadSize = 1 << 20;
+
+// Sample rates of the header's codes 1 to 11, code 0 taking STREAMINFO's
+static const UInt32 kFLACSampleRates[12] = { 0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000 };
+
+// Bits per sample of the header's codes, 0 for STREAMINFO's and the reserved ones
+static const UInt32 kFLACSampleSizes[8] = { 0, 8, 12, 0, 16, 20, 24, 0 };
+
+/* Description:
+ * MSB-first reader over one frame. mBuffer may hold more of the stream below
+ * its mNumBits; past the end it is topped up with zeros, counted in
+ * mNumPadBits, and taking any of those sets the frame apart as damaged.
+ */
+struct AQFLACBits
+{
+	const UInt8 * mStart;
+	const UInt8 * mData;
+	const UInt8 * mEnd;
+	UInt64 mBuffer;
+	SInt32 mNumBits;
+	UInt32 mNumPadBits;
+	bool mIsPastEnd;
+};
+
+struct AQFLACFrameHeader
+{
+	UInt64 mFirstFrame;
+	UInt32 mBlockSize;
+	UInt32 mChannelAssignment;
+	
+	/* Description:
+	 * Bytes of the header, the CRC-8 included.
+	 */
+	UInt32 mSize;
+};
+
+/* Description:
+ * Where a frame starts in the file, and the first frame of the stream it
+ * decodes to.
+ */
+struct AQFLACFrameEntry
+{
+	UInt64 mOffset;
+	UInt64 mFirstFrame;
+};
+
+struct AQFLACFile
+{
+	const UInt8 * mData;
+	size_t mSize;
+	
+	struct AQFLACInfo mInfo;
+	
+	/* Description:
+	 * STREAMINFO's smallest block, by which the frames of fixed block size
+	 * streams are numbered, and a bound on the bytes of one frame.
+	 */
+	UInt32 mMinBlockSize;
+	size_t mMaxFrameSize;
+	
+	size_t mFirstFrameOffset;
+	
+	/* Description:
+	 * Every frame, then the end of the file and of the stream, once
+	 * AQFLACFile_IndexFrames has run.
+	 */
+	struct AQFLACFrameEntry * mIndex;
+	UInt32 mNumIndexEntries;
+	
+	/* Description:
+	 * The sequential decode: where the next frame is and the frame number it
+	 * should start at, and how far ahead pages have been asked for.
+	 */
+	size_t mPosition;
+	UInt64 mNextFirstFrame;
+	size_t mReadAheadEnd;
+	
+	/* Description:
+	 * The block decoded last, one channel after the other, mOutputPosition of
+	 * whose frames have been read.
+	 */
+	SInt32 * mSamples;
+	UInt32 mNumOutputFrames;
+	UInt32 mOutputPosition;
+};
+
+/* Description:
+ * mCRC16[k] is the CRC-16 of a byte followed by k zeros, for taking eight
+ * bytes at a time.
+ */
+struct AQFLACCRCTables
+{
+	UInt8 mCRC8[256];
+	UInt16 mCRC16[8][256];
+};
+
+// CRC-8 with polynomial 0x07 over frame headers and CRC-16 with 0x8005 over whole frames,
+// neither reflected
+static
+struct AQFLACCRCTables AQFLAC_MakeCRCTables()
+{
+	struct AQFLACCRCTables tables;
+	UInt32 k, bit;
+	
+	for (k = 0; k < 256; k++)
+	{
+		UInt32 r8 = k;
+		UInt32 r16 = k << 8;
+		
+		for (bit = 0; bit < 8; bit++)
+		{
+			r8 = r8 & 0x80 ? (r8 << 1) ^ 0x07 : r8 << 1;
+			r16 = r16 & 0x8000 ? (r16 << 1) ^ 0x8005 : r16 << 1;
+		}
+		
+		tables.mCRC8[k] = (UInt8) r8;
+		tables.mCRC16[0][k] = (UInt16) r16;
+	}
+	
+	for (k = 0; k < 256; k++)
+	{
+		for (bit = 1; bit < 8; bit++)
+		{
+			UInt32 previous = tables.mCRC16[bit - 1][k];
+			
+			tables.mCRC16[bit][k] = (UInt16) ((previous << 8) ^ tables.mCRC16[0][previous >> 8]);
+		}
+	}
+	
+	return tables;
+}
+
+static
+const struct AQFLACCRCTables * AQFLAC_GetCRCTables()
+{
+	static const struct AQFLACCRCTables sTables = AQFLAC_MakeCRCTables();
+	
+	return &sTables;
+}
+
+static
+UInt8 AQFLAC_CRC8(const UInt8 * data, size_t size)
+{
+	const UInt8 * table = AQFLAC_GetCRCTables()->mCRC8;
+	UInt8 crc = 0;
+	size_t k;
+	
+	for (k = 0; k < size; k++)
+	{
+		crc = table[crc ^ data[k]];
+	}
+	
+	return crc;
+}
+
+static
+UInt16 AQFLAC_CRC16(const UInt8 * data, size_t size)
+{
+	const UInt16 (* tables)[256] = AQFLAC_GetCRCTables()->mCRC16;
+	UInt32 crc = 0;
+	size_t k = 0;
+	
+	// The CRC so far goes into the first two bytes of each eight
+	for (; k + 8 <= size; k += 8)
+	{
+		const UInt8 * p = data + k;
+		
+		crc = tables[7][p[0] ^ (crc >> 8)] ^ tables[6][p[1] ^ (crc & 0xff)] ^
+			  tables[5][p[2]] ^ tables[4][p[3]] ^ tables[3][p[4]] ^ tables[2][p[5]] ^ tables[1][p[6]] ^ tables[0][p[7]];
+	}
+	
+	for (; k < size; k++)
+	{
+		crc = ((crc << 8) & 0xffff) ^ tables[0][(crc >> 8) ^ data[k]];
+	}
+	
+	return (UInt16) crc;
+}
+
+static
+void AQFLACBits_Init(struct AQFLACBits * bits, const UInt8 * data, const UInt8 * end)
+{
+	bits->mStart = data;
+	bits->mData = data;
+	bits->mEnd = end;
+	bits->mBuffer = 0;
+	bits->mNumBits = 0;
+	bits->mNumPadBits = 0;
+	bits->mIsPastEnd = false;
+}
+
+// Tops the buffer up to at least 57 bits, eight bytes at a time while they last
+static inline
+void AQFLACBits_Refill(struct AQFLACBits * bits)
+{
+	if (bits->mData + 8 <= bits->mEnd)
+	{
+		const UInt8 * p = bits->mData;
+		UInt64 next = (UInt64) p[0] << 56 | (UInt64) p[1] << 48 | (UInt64) p[2] << 40 | (UInt64) p[3] << 32 |
+					  (UInt64) p[4] << 24 | (UInt64) p[5] << 16 | (UInt64) p[6] << 8 | (UInt64) p[7];
+		
+		bits->mBuffer |= next >> bits->mNumBits;
+		bits->mData += (63 - bits->mNumBits) >> 3;
+		bits->mNumBits |= 56;
+		return;
+	}
+	
+	while (bits->mNumBits <= 56)
+	{
+		UInt64 byte = 0;
+		
+		if (bits->mData < bits->mEnd)
+		{
+			byte = *bits->mData++;
+		}
+		else
+		{
+			bits->mNumPadBits += 8;
+		}
+		
+		bits->mBuffer |= byte << (56 - bits->mNumBits);
+		bits->mNumBits += 8;
+	}
+}
+
+// 0 <= n <= 32
+static inline
+UInt32 AQFLACBits_Read(struct AQFLACBits * bits, UInt32 n)
+{
+	if (bits->mNumBits < (SInt32) n)
+	{
+		AQFLACBits_Refill(bits);
+	}
+	
+	// In two shifts, as n may be 0
+	UInt32 value = (UInt32) ((bits->mBuffer >> 1) >> (63 - n));
+	
+	bits->mBuffer <<= n;
+	bits->mNumBits -= n;
+	
+	return value;
+}
+
+// Two's complement, 1 <= n <= 32
+static inline
+SInt32 AQFLACBits_ReadSigned(struct AQFLACBits * bits, UInt32 n)
+{
+	return (SInt32) (AQFLACBits_Read(bits, n) << (32 - n)) >> (32 - n);
+}
+
+// Zeros up to the next one, which is taken as well
+static inline
+UInt32 AQFLACBits_ReadUnary(struct AQFLACBits * bits)
+{
+	UInt32 count = 0;
+	
+	for (;;)
+	{
+		if (bits->mBuffer != 0)
+		{
+			SInt32 numZeros = __builtin_clzll(bits->mBuffer);
+			
+			if (numZeros < bits->mNumBits)
+			{
+				bits->mBuffer = bits->mBuffer << numZeros << 1;
+				bits->mNumBits -= numZeros + 1;
+				
+				return count + numZeros;
+			}
+		}
+		
+		count += bits->mNumBits;
+		bits->mBuffer = 0;
+		bits->mNumBits = 0;
+		
+		// Nothing but padding would follow
+		if (bits->mData == bits->mEnd)
+		{
+			bits->mIsPastEnd = true;
+			return count;
+		}
+		
+		AQFLACBits_Refill(bits);
+	}
+}
+
+// Bits taken since the start, padding included
+static
+size_t AQFLACBits_GetPosition(const struct AQFLACBits * bits)
+{
+	return (size_t) (bits->mData - bits->mStart) * 8 + bits->mNumPadBits - bits->mNumBits;
+}
+
+static
+bool AQFLACBits_IsPastEnd(const struct AQFLACBits * bits)
+{
+	return bits->mIsPastEnd || bits->mNumBits < (SInt32) bits->mNumPadBits;
+}
+
+// Reads the frame header at offset; false unless it is a valid header of this stream
+static
+bool AQFLACFile_ParseFrameHeader(const struct AQFLACFile * file, size_t offset, struct AQFLACFrameHeader * header)
+{
+	const UInt8 * h = file->mData + offset;
+	size_t available = file->mSize - offset;
+	
+	if (available < 6 || h[0] != 0xff || (h[1] & 0xfe) != 0xf8 || (h[3] & 0x01))
+	{
+		return false;
+	}
+	
+	bool isVariable = h[1] & 0x01;
+	UInt32 blockSizeCode = h[2] >> 4;
+	UInt32 sampleRateCode = h[2] & 0x0f;
+	UInt32 channelAssignment = h[3] >> 4;
+	UInt32 sampleSizeCode = (h[3] >> 1) & 0x07;
+	UInt32 numChannels = channelAssignment < kFLACChannelsLeftSide ? channelAssignment + 1 : 2;
+	
+	// Channels and sample size can only be the stream's, and reserved codes are refused
+	if (channelAssignment > kFLACChannelsMidSide ||
+		numChannels != file->mInfo.mNumChannels ||
+		blockSizeCode == 0 ||
+		sampleRateCode == 15 ||
+		(sampleSizeCode != 0 && kFLACSampleSizes[sampleSizeCode] != file->mInfo.mBitsPerSample))
+	{
+		return false;
+	}
+	
+	// The frame number, or the sample number of variable block size streams, coded like UTF-8
+	UInt32 numExtraBytes = 0;
+	UInt64 number = h[4];
+	UInt32 size = 5;
+	UInt32 k;
+	
+	if (number & 0x80)
+	{
+		while (numExtraBytes < 7 && (h[4] & (0x40 >> numExtraBytes)))
+		{
+			numExtraBytes++;
+		}
+		
+		if (numExtraBytes == 0 || numExtraBytes == 7 || (numExtraBytes == 6 && !isVariable))
+		{
+			return false;
+		}
+		
+		number = h[4] & (0x3f >> numExtraBytes);
+	}
+	
+	UInt32 numSizeBytes = blockSizeCode == 6 ? 1 : blockSizeCode == 7 ? 2 : 0;
+	UInt32 numRateBytes = sampleRateCode == 12 ? 1 : sampleRateCode > 12 ? 2 : 0;
+	
+	if (available < size + numExtraBytes + numSizeBytes + numRateBytes + 1)
+	{
+		return false;
+	}
+	
+	for (k = 0; k < numExtraBytes; k++)
+	{
+		if ((h[size] & 0xc0) != 0x80)
+		{
+			return false;
+		}
+		
+		number = number << 6 | (h[size++] & 0x3f);
+	}
+	
+	UInt32 blockSize;
+	
+	if (blockSizeCode == 1)
+	{
+		blockSize = 192;
+	}
+	else if (blockSizeCode < 6)
+	{
+		blockSize = 576 << (blockSizeCode - 2);
+	}
+	else if (blockSizeCode == 6)
+	{
+		blockSize = h[size] + 1;
+	}
+	else if (blockSizeCode == 7)
+	{
+		blockSize = (h[size] << 8 | h[size + 1]) + 1;
+	}
+	else
+	{
+		blockSize = 256 << (blockSizeCode - 8);
+	}
+	
+	size += numSizeBytes;
+	
+	UInt32 sampleRate = file->mInfo.mSampleRate;
+	
+	if (sampleRateCode == 12)
+	{
+		sampleRate = h[size] * 1000;
+	}
+	else if (sampleRateCode == 13)
+	{
+		sampleRate = h[size] << 8 | h[size + 1];
+	}
+	else if (sampleRateCode == 14)
+	{
+		sampleRate = (h[size] << 8 | h[size + 1]) * 10;
+	}
+	else if (sampleRateCode != 0)
+	{
+		sampleRate = kFLACSampleRates[sampleRateCode];
+	}
+	
+	size += numRateBytes;
+	
+	if (sampleRate != file->mInfo.mSampleRate ||
+		blockSize > file->mInfo.mMaxBlockSize ||
+		AQFLAC_CRC8(h, size) != h[size])
+	{
+		return false;
+	}
+	
+	header->mFirstFrame = isVariable ? number : number * file->mMinBlockSize;
+	header->mBlockSize = blockSize;
+	header->mChannelAssignment = channelAssignment;
+	header->mSize = size + 1;
+	
+	return true;
+}
+
+/* Description:
+ * The offset of the first frame header from offset on and before limit whose
+ * frame starts at firstFrame or, unless isExact, later; limit if there is
+ * none. A header later than firstFrame only counts if the one of the frame
+ * after it follows within mMaxFrameSize, so that a sync code turning up in
+ * damaged data is not taken for a frame.
+ */
+static
+size_t AQFLACFile_FindFrame(const struct AQFLACFile * file,
+							size_t offset,
+							size_t limit,
+							UInt64 firstFrame,
+							bool isExact,
+							struct AQFLACFrameHeader * header)
+{
+	while (offset < limit)
+	{
+		const UInt8 * sync = (const UInt8 *) memchr(file->mData + offset, 0xff, limit - offset);
+		
+		if (!sync)
+		{
+			break;
+		}
+		
+		offset = sync - file->mData;
+		
+		if (AQFLACFile_ParseFrameHeader(file, offset, header) && header->mFirstFrame >= firstFrame)
+		{
+			if (header->mFirstFrame == firstFrame)
+			{
+				return offset;
+			}
+			
+			if (!isExact)
+			{
+				// The last frame is followed by the end of the stream instead
+				UInt64 nextFirstFrame = header->mFirstFrame + header->mBlockSize;
+				size_t nextLimit = file->mSize - offset > file->mMaxFrameSize ? offset + file->mMaxFrameSize : file->mSize;
+				struct AQFLACFrameHeader next;
+				
+				if (nextFirstFrame == file->mInfo.mNumFrames ||
+					AQFLACFile_FindFrame(file, offset + header->mSize, nextLimit, nextFirstFrame, true, &next) < nextLimit)
+				{
+					return offset;
+				}
+			}
+		}
+		
+		offset++;
+	}
+	
+	return limit;
+}
+
+static
+bool AQFLAC_DecodeResidual(struct AQFLACBits * bits, UInt32 blockSize, UInt32 order, SInt32 * residual)
+{
+	UInt32 method = AQFLACBits_Read(bits, 2);
+	
+	if (method > 1)
+	{
+		return false;
+	}
+	
+	// Rice parameters of 4 or 5 bits, the largest escaping to raw binary
+	UInt32 parameterBits = method == 0 ? 4 : 5;
+	UInt32 escapeParameter = (1 << parameterBits) - 1;
+	UInt32 partitionOrder = AQFLACBits_Read(bits, 4);
+	UInt32 partitionSize = blockSize >> partitionOrder;
+	UInt32 numPartitions = 1 << partitionOrder;
+	UInt32 partition, k;
+	
+	if (partitionSize << partitionOrder != blockSize || partitionSize < order)
+	{
+		return false;
+	}
+	
+	for (partition = 0; partition < numPartitions; partition++)
+	{
+		UInt32 count = partition == 0 ? partitionSize - order : partitionSize;
+		UInt32 parameter = AQFLACBits_Read(bits, parameterBits);
+		
+		if (parameter == escapeParameter)
+		{
+			UInt32 numBits = AQFLACBits_Read(bits, 5);
+			
+			for (k = 0; k < count; k++)
+			{
+				residual[k] = numBits ? AQFLACBits_ReadSigned(bits, numBits) : 0;
+			}
+		}
+		else
+		{
+			// On a copy of the reader, which the stores to residual cannot alias
+			struct AQFLACBits local = *bits;
+			
+			for (k = 0; k < count; k++)
+			{
+				UInt32 quotient = AQFLACBits_ReadUnary(&local);
+				UInt32 value = quotient << parameter | AQFLACBits_Read(&local, parameter);
+				
+				// Zigzag: 0, -1, 1, -2, ...
+				residual[k] = (SInt32) (value >> 1) ^ -(SInt32) (value & 1);
+			}
+			
+			*bits = local;
+		}
+		
+		if (AQFLACBits_IsPastEnd(bits))
+		{
+			return false;
+		}
+		
+		residual += count;
+	}
+	
+	return true;
+}
+
+// Adds the fixed polynomial predictions to the residual that follows the warm-up samples,
+// wrapping around like AQFLAC_RestoreLPC
+static
+void AQFLAC_RestoreFixed(SInt32 * samples, UInt32 blockSize, UInt32 order)
+{
+	UInt32 * s = (UInt32 *) samples;
+	UInt32 k;
+	
+	switch (order)
+	{
+		case 1:
+			for (k = 1; k < blockSize; k++)
+			{
+				s[k] += s[k - 1];
+			}
+			break;
+		case 2:
+			for (k = 2; k < blockSize; k++)
+			{
+				s[k] += 2 * s[k - 1] - s[k - 2];
+			}
+			break;
+		case 3:
+			for (k = 3; k < blockSize; k++)
+			{
+				s[k] += 3 * (s[k - 1] - s[k - 2]) + s[k - 3];
+			}
+			break;
+		case 4:
+			for (k = 4; k < blockSize; k++)
+			{
+				s[k] += 4 * (s[k - 1] + s[k - 3]) - 6 * s[k - 2] - s[k - 4];
+			}
+			break;
+	}
+}
+
+// The 32 bit sum of AQFLAC_RestoreLPC for one order, which the compiler unrolls
+template <UInt32 Order>
+static
+void AQFLAC_RestoreLPCOrder(SInt32 * samples, UInt32 blockSize, const SInt32 * coefficients, UInt32 shift)
+{
+	const UInt32 * c = (const UInt32 *) coefficients;
+	UInt32 k, j;
+	
+	for (k = Order; k < blockSize; k++)
+	{
+		const UInt32 * history = (const UInt32 *) samples + k - Order;
+		UInt32 sum = 0;
+		
+		for (j = 0; j < Order; j++)
+		{
+			sum += c[j] * history[j];
+		}
+		
+		samples[k] = (SInt32) ((UInt32) samples[k] + (UInt32) ((SInt32) sum >> shift));
+	}
+}
+
+// Adds the LPC prediction to the residual that follows the warm-up samples, coefficients
+// being in the order of the samples they weigh, oldest first. The sum takes 64 bits only
+// when 32 could overflow, the way libFLAC decides it; arithmetic wraps around, as a
+// damaged frame may have any values.
+static
+void AQFLAC_RestoreLPC(SInt32 * samples,
+					   UInt32 blockSize,
+					   const SInt32 * coefficients,
+					   UInt32 order,
+					   UInt32 shift,
+					   bool isWide)
+{
+	UInt32 k, j;
+	
+	if (!isWide)
+	{
+		// The orders encoders pick up to their highest presets
+		switch (order)
+		{
+			case 1: AQFLAC_RestoreLPCOrder<1>(samples, blockSize, coefficients, shift); return;
+			case 2: AQFLAC_RestoreLPCOrder<2>(samples, blockSize, coefficients, shift); return;
+			case 3: AQFLAC_RestoreLPCOrder<3>(samples, blockSize, coefficients, shift); return;
+			case 4: AQFLAC_RestoreLPCOrder<4>(samples, blockSize, coefficients, shift); return;
+			case 5: AQFLAC_RestoreLPCOrder<5>(samples, blockSize, coefficients, shift); return;
+			case 6: AQFLAC_RestoreLPCOrder<6>(samples, blockSize, coefficients, shift); return;
+			case 7: AQFLAC_RestoreLPCOrder<7>(samples, blockSize, coefficients, shift); return;
+			case 8: AQFLAC_RestoreLPCOrder<8>(samples, blockSize, coefficients, shift); return;
+			case 9: AQFLAC_RestoreLPCOrder<9>(samples, blockSize, coefficients, shift); return;
+			case 10: AQFLAC_RestoreLPCOrder<10>(samples, blockSize, coefficients, shift); return;
+			case 11: AQFLAC_RestoreLPCOrder<11>(samples, blockSize, coefficients, shift); return;
+			case 12: AQFLAC_RestoreLPCOrder<12>(samples, blockSize, coefficients, shift); return;
+		}
+		
+		const UInt32 * c = (const UInt32 *) coefficients;
+		
+		for (k = order; k < blockSize; k++)
+		{
+			const UInt32 * history = (const UInt32 *) samples + k - order;
+			UInt32 sum = 0;
+			
+			for (j = 0; j < order; j++)
+			{
+				sum += c[j] * history[j];
+			}
+			
+			samples[k] = (SInt32) ((UInt32) samples[k] + (UInt32) ((SInt32) sum >> shift));
+		}
+	}
+	else
+	{
+		for (k = order; k < blockSize; k++)
+		{
+			const SInt32 * history = samples + k - order;
+			SInt64 sum = 0;
+			
+			for (j = 0; j < order; j++)
+			{
+				sum += (SInt64) coefficients[j] * history[j];
+			}
+			
+			samples[k] = (SInt32) ((UInt32) samples[k] + (UInt32) (sum >> shift));
+		}
+	}
+}
+
+static
+UInt32 AQFLAC_Log2(UInt32 value)
+{
+	return 31 - __builtin_clz(value);
+}
+
+static
+bool AQFLAC_DecodeSubframe(struct AQFLACBits * bits, UInt32 bitsPerSample, UInt32 blockSize, SInt32 * samples)
+{
+	UInt32 header = AQFLACBits_Read(bits, 8);
+	UInt32 type = (header >> 1) & 0x3f;
+	UInt32 wastedBits = 0;
+	UInt32 k;
+	
+	if (header & 0x80)
+	{
+		return false;
+	}
+	
+	// Low bits that are zero throughout the block, left out of the samples
+	if (header & 0x01)
+	{
+		wastedBits = AQFLACBits_ReadUnary(bits) + 1;
+		
+		if (wastedBits >= bitsPerSample)
+		{
+			return false;
+		}
+		
+		bitsPerSample -= wastedBits;
+	}
+	
+	if (type == kFLACSubframeConstant)
+	{
+		SInt32 value = AQFLACBits_ReadSigned(bits, bitsPerSample);
+		
+		for (k = 0; k < blockSize; k++)
+		{
+			samples[k] = value;
+		}
+	}
+	else if (type == kFLACSubframeVerbatim)
+	{
+		for (k = 0; k < blockSize; k++)
+		{
+			samples[k] = AQFLACBits_ReadSigned(bits, bitsPerSample);
+		}
+	}
+	else if (type >= kFLACSubframeFixed && type <= kFLACSubframeFixed + kFLACMaxFixedOrder)
+	{
+		UInt32 order = type - kFLACSubframeFixed;
+		
+		if (order > blockSize)
+		{
+			return false;
+		}
+		
+		for (k = 0; k < order; k++)
+		{
+			samples[k] = AQFLACBits_ReadSigned(bits, bitsPerSample);
+		}
+		
+		if (!AQFLAC_DecodeResidual(bits, blockSize, order, samples + order))
+		{
+			return false;
+		}
+		
+		AQFLAC_RestoreFixed(samples, blockSize, order);
+	}
+	else if (type >= kFLACSubframeLPC)
+	{
+		UInt32 order = type - kFLACSubframeLPC + 1;
+		SInt32 coefficients[kFLACMaxLPCOrder];
+		
+		if (order > blockSize)
+		{
+			return false;
+		}
+		
+		for (k = 0; k < order; k++)
+		{
+			samples[k] = AQFLACBits_ReadSigned(bits, bitsPerSample);
+		}
+		
+		UInt32 precisionCode = AQFLACBits_Read(bits, 4);
+		SInt32 shift = AQFLACBits_ReadSigned(bits, 5);
+		
+		if (precisionCode == 15 || shift < 0)
+		{
+			return false;
+		}
+		
+		// Sent newest first
+		for (k = 0; k < order; k++)
+		{
+			coefficients[order - 1 - k] = AQFLACBits_ReadSigned(bits, precisionCode + 1);
+		}
+		
+		if (!AQFLAC_DecodeResidual(bits, blockSize, order, samples + order))
+		{
+			return false;
+		}
+		
+		bool isWide = bitsPerSample + precisionCode + 1 + AQFLAC_Log2(order) > 32;
+		
+		AQFLAC_RestoreLPC(samples, blockSize, coefficients, order, shift, isWide);
+	}
+	else
+	{
+		return false;
+	}
+	
+	if (wastedBits > 0)
+	{
+		for (k = 0; k < blockSize; k++)
+		{
+			samples[k] = (SInt32) ((UInt32) samples[k] << wastedBits);
+		}
+	}
+	
+	return !AQFLACBits_IsPastEnd(bits);
+}
+
+// Undoes the stereo decorrelation of the header's channel assignment
+static
+void AQFLAC_Decorrelate(UInt32 channelAssignment, SInt32 * left, SInt32 * right, UInt32 blockSize)
+{
+	UInt32 k;
+	
+	if (channelAssignment == kFLACChannelsLeftSide)
+	{
+		for (k = 0; k < blockSize; k++)
+		{
+			right[k] = (SInt32) ((UInt32) left[k] - (UInt32) right[k]);
+		}
+	}
+	else if (channelAssignment == kFLACChannelsSideRight)
+	{
+		for (k = 0; k < blockSize; k++)
+		{
+			left[k] = (SInt32) ((UInt32) left[k] + (UInt32) right[k]);
+		}
+	}
+	else if (channelAssignment == kFLACChannelsMidSide)
+	{
+		for (k = 0; k < blockSize; k++)
+		{
+			SInt32 side = right[k];
+			SInt32 mid = (SInt32) ((UInt32) left[k] << 1 | (side & 1));
+			
+			left[k] = (SInt32) ((UInt32) mid + (UInt32) side) >> 1;
+			right[k] = (SInt32) ((UInt32) mid - (UInt32) side) >> 1;
+		}
+	}
+}
+
+/* Description:
+ * Decodes the frame of header at offset into one block of mMaxBlockSize
+ * samples per channel, the data ending at end at the latest. False if it is
+ * damaged; otherwise outEnd is where the frame ends.
+ */
+static
+bool AQFLACFile_DecodeFrame(const struct AQFLACFile * file,
+							const struct AQFLACFrameHeader * header,
+							size_t offset,
+							size_t end,
+							SInt32 * samples,
+							size_t * outEnd)
+{
+	UInt32 numChannels = file->mInfo.mNumChannels;
+	UInt32 assignment = header->mChannelAssignment;
+	struct AQFLACBits bits;
+	UInt32 channel;
+	
+	AQFLACBits_Init(&bits, file->mData + offset + header->mSize, file->mData + end);
+	
+	for (channel = 0; channel < numChannels; channel++)
+	{
+		bool isSide = channel == (assignment == kFLACChannelsSideRight ? 0 : 1) && assignment >= kFLACChannelsLeftSide;
+		
+		if (!AQFLAC_DecodeSubframe(&bits,
+								   file->mInfo.mBitsPerSample + isSide,
+								   header->mBlockSize,
+								   samples + (size_t) channel * file->mInfo.mMaxBlockSize))
+		{
+			return false;
+		}
+	}
+	
+	// Zero padding to a byte, then the CRC-16 of everything before it
+	AQFLACBits_Read(&bits, (8 - AQFLACBits_GetPosition(&bits) % 8) % 8);
+	
+	size_t frameSize = header->mSize + AQFLACBits_GetPosition(&bits) / 8;
+	UInt32 crc = AQFLACBits_Read(&bits, 16);
+	
+	if (AQFLACBits_IsPastEnd(&bits) || AQFLAC_CRC16(file->mData + offset, frameSize) != crc)
+	{
+		return false;
+	}
+	
+	if (assignment >= kFLACChannelsLeftSide)
+	{
+		AQFLAC_Decorrelate(assignment, samples, samples + file->mInfo.mMaxBlockSize, header->mBlockSize);
+	}
+	
+	*outEnd = offset + frameSize + 2;
+	
+	return true;
+}
+
+// Converts count frames from first on of a block decoded by AQFLACFile_DecodeFrame to
+// interleaved float
+static
+void AQFLACFile_Interleave(const struct AQFLACFile * file, const SInt32 * samples, UInt32 first, UInt32 count, Float32 * out)
+{
+	UInt32 numChannels = file->mInfo.mNumChannels;
+	UInt32 stride = file->mInfo.mMaxBlockSize;
+	Float32 scale = 1.0f / (Float32) (1 << (file->mInfo.mBitsPerSample - 1));
+	UInt32 channel, k;
+	
+	samples += first;
+	
+	if (numChannels == 2)
+	{
+		const SInt32 * left = samples;
+		const SInt32 * right = samples + stride;
+		
+		for (k = 0; k < count; k++)
+		{
+			out[2 * k] = left[k] * scale;
+			out[2 * k + 1] = right[k] * scale;
+		}
+		
+		return;
+	}
+	
+	for (channel = 0; channel < numChannels; channel++)
+	{
+		const SInt32 * in = samples + (size_t) channel * stride;
+		
+		for (k = 0; k < count; k++)
+		{
+			out[(size_t) k * numChannels + channel] = in[k] * scale;
+		}
+	}
+}
+
+static
+bool AQFLACFile_ParseMetadata(struct AQFLACFile * file)
+{
+	const UInt8 * data = file->mData;
+	size_t size = file->mSize;
+	size_t offset = 0;
+	bool hasStreamInfo = false;
+	bool isLast = false;
+	
+	// An ID3v2 tag some taggers put in front
+	if (size >= 10 && memcmp(data, "ID3", 3) == 0)
+	{
+		offset = 10 + ((data[6] & 0x7f) << 21 | (data[7] & 0x7f) << 14 | (data[8] & 0x7f) << 7 | (data[9] & 0x7f));
+		
+		if (data[5] & 0x10)
+		{
+			offset += 10;
+		}
+	}
+	
+	if (offset + 4 > size || memcmp(data + offset, "fLaC", 4) != 0)
+	{
+		return false;
+	}
+	
+	offset += 4;
+	
+	while (!isLast)
+	{
+		if (size - offset < 4)
+		{
+			return false;
+		}
+		
+		const UInt8 * h = data + offset;
+		UInt32 type = h[0] & 0x7f;
+		UInt32 length = h[1] << 16 | h[2] << 8 | h[3];
+		
+		isLast = h[0] & 0x80;
+		offset += 4;
+		
+		if (length > size - offset)
+		{
+			return false;
+		}
+		
+		if (type == kFLACMetadataStreamInfo && length >= kFLACStreamInfoSize)
+		{
+			const UInt8 * p = data + offset;
+			
+			file->mMinBlockSize = p[0] << 8 | p[1];
+			file->mInfo.mMaxBlockSize = p[2] << 8 | p[3];
+			file->mInfo.mMaxPacketSize = p[7] << 16 | p[8] << 8 | p[9];
+			file->mInfo.mSampleRate = p[10] << 12 | p[11] << 4 | p[12] >> 4;
+			file->mInfo.mNumChannels = ((p[12] >> 1) & 0x07) + 1;
+			file->mInfo.mBitsPerSample = ((p[12] & 0x01) << 4 | p[13] >> 4) + 1;
+			file->mInfo.mNumFrames = (UInt64) (p[13] & 0x0f) << 32 | (UInt64) p[14] << 24 | p[15] << 16 | p[16] << 8 | p[17];
+			hasStreamInfo = true;
+		}
+		
+		offset += length;
+	}
+	
+	file->mFirstFrameOffset = offset;
+	
+	// Verbatim subframes of the largest block, with room for headers and padding
+	file->mMaxFrameSize = (size_t) file->mInfo.mMaxBlockSize * file->mInfo.mNumChannels * (file->mInfo.mBitsPerSample + 1) / 8 +
+						  (file->mInfo.mNumChannels + 1) * kFLACMaxHeaderSize;
+	
+	return hasStreamInfo &&
+		   file->mInfo.mSampleRate > 0 &&
+		   file->mMinBlockSize >= kFLACMinBlockSize &&
+		   file->mInfo.mMaxBlockSize >= file->mMinBlockSize &&
+		   file->mInfo.mBitsPerSample >= kFLACMinBitsPerSample &&
+		   file->mInfo.mBitsPerSample <= kFLACMaxBitsPerSample;
+}
+
+struct AQFLACFile * AQFLACFile_Open(const char path[])
+{
+	struct AQFLACFile * file = (struct AQFLACFile *) calloc(1, sizeof(struct AQFLACFile));
+	struct stat status;
+	int fd;
+	
+	AQ_TRACE_SCOPE("open", 0);
+	
+	if ((fd = open(path, O_RDONLY)) < 0)
+	{
+		free(file);
+		return NULL;
+	}
+	
+	if (fstat(fd, &status) == 0 && status.st_size > 0)
+	{
+		void * data = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		
+		if (data != MAP_FAILED)
+		{
+			file->mData = (const UInt8 *) data;
+			file->mSize = (size_t) status.st_size;
+		}
+	}
+	
+	// The mapping keeps the file
+	close(fd);
+	
+	if (!file->mData || !AQFLACFile_ParseMetadata(file))
+	{
+		AQFLACFile_Close(file);
+		return NULL;
+	}
+	
+	posix_madvise((void *) file->mData, file->mSize, POSIX_MADV_SEQUENTIAL);
+	
+	file->mSamples = (SInt32 *) malloc((size_t) file->mInfo.mMaxBlockSize * file->mInfo.mNumChannels * sizeof(SInt32));
+	
+	AQFLACFile_Rewind(file);
+	
+	return file;
+}
+
+const struct AQFLACInfo * AQFLACFile_GetInfo(const struct AQFLACFile * file)
+{
+	return &file->mInfo;
+}
+
+// Asks for the pages up to kFLACReadAheadSize past the sequential decode, once it is within
+// half of that of the end of what was asked for before
+static
+void AQFLACFile_ReadAhead(struct AQFLACFile * file)
+{
+	if (file->mReadAheadEnd >= file->mSize || file->mPosition + kFLACReadAheadSize / 2 < file->mReadAheadEnd)
+	{
+		return;
+	}
+	
+	size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+	size_t start = (file->mReadAheadEnd > file->mPosition ? file->mReadAheadEnd : file->mPosition) & ~(pageSize - 1);
+	size_t end = file->mSize - start > kFLACReadAheadSize ? start + kFLACReadAheadSize : file->mSize;
+	
+	posix_madvise((void *) (file->mData + start), end - start, POSIX_MADV_WILLNEED);
+	
+	file->mReadAheadEnd = end;
+}
+
+// Decodes the frame at mPosition into mSamples, or silence in its place if it is damaged
+// or missing, and moves on past it
+static
+bool AQFLACFile_DecodeNext(struct AQFLACFile * file)
+{
+	struct AQFLACFrameHeader header;
+	size_t frameEnd;
+	
+	AQFLACFile_ReadAhead(file);
+	
+	file->mPosition = AQFLACFile_FindFrame(file, file->mPosition, file->mSize, file->mNextFirstFrame, false, &header);
+	
+	if (file->mPosition == file->mSize)
+	{
+		return false;
+	}
+	
+	UInt32 channel;
+	
+	// Frames lost to damage before this one come out as silence, a block at a time
+	if (header.mFirstFrame > file->mNextFirstFrame)
+	{
+		UInt64 numMissing = header.mFirstFrame - file->mNextFirstFrame;
+		UInt32 numFrames = numMissing < file->mInfo.mMaxBlockSize ? (UInt32) numMissing : file->mInfo.mMaxBlockSize;
+		
+		memset(file->mSamples, 0, (size_t) file->mInfo.mMaxBlockSize * file->mInfo.mNumChannels * sizeof(SInt32));
+		
+		file->mNextFirstFrame += numFrames;
+		file->mNumOutputFrames = numFrames;
+		file->mOutputPosition = 0;
+		
+		return true;
+	}
+	
+	if (!AQFLACFile_DecodeFrame(file, &header, file->mPosition, file->mSize, file->mSamples, &frameEnd))
+	{
+		for (channel = 0; channel < file->mInfo.mNumChannels; channel++)
+		{
+			memset(file->mSamples + (size_t) channel * file->mInfo.mMaxBlockSize, 0, header.mBlockSize * sizeof(SInt32));
+		}
+		
+		// Where the frame ends is unknown, the next one is searched for past its header
+		frameEnd = file->mPosition + header.mSize;
+	}
+	
+	file->mPosition = frameEnd;
+	file->mNextFirstFrame = header.mFirstFrame + header.mBlockSize;
+	file->mNumOutputFrames = header.mBlockSize;
+	file->mOutputPosition = 0;
+	
+	return true;
+}
+
+UInt32 AQFLACFile_Read(struct AQFLACFile * file, Float32 * out, UInt32 numFrames)
+{
+	UInt32 numChannels = file->mInfo.mNumChannels;
+	UInt32 numRead = 0;
+	
+	while (numRead < numFrames)
+	{
+		if (file->mOutputPosition == file->mNumOutputFrames && !AQFLACFile_DecodeNext(file))
+		{
+			break;
+		}
+		
+		UInt32 count = file->mNumOutputFrames - file->mOutputPosition;
+		
+		count = count < numFrames - numRead ? count : numFrames - numRead;
+		
+		AQFLACFile_Interleave(file, file->mSamples, file->mOutputPosition, count, out + (size_t) numRead * numChannels);
+		
+		file->mOutputPosition += count;
+		numRead += count;
+	}
+	
+	return numRead;
+}
+
+bool AQFLACFile_Rewind(struct AQFLACFile * file)
+{
+	file->mPosition = file->mFirstFrameOffset;
+	file->mNextFirstFrame = 0;
+	file->mReadAheadEnd = 0;
+	file->mNumOutputFrames = 0;
+	file->mOutputPosition = 0;
+	
+	return true;
+}
+
+bool AQFLACFile_IndexFrames(struct AQFLACFile * file)
+{
+	if (file->mIndex)
+	{
+		return true;
+	}
+	
+	AQ_TRACE_SCOPE("index", 0);
+	
+	struct AQFLACFrameHeader header;
+	UInt32 capacity = 1024;
+	UInt32 numEntries = 0;
+	UInt64 nextFirstFrame = 0;
+	size_t offset = file->mFirstFrameOffset;
+	
+	file->mIndex = (struct AQFLACFrameEntry *) malloc(capacity * sizeof(struct AQFLACFrameEntry));
+	
+	while ((offset = AQFLACFile_FindFrame(file, offset, file->mSize, nextFirstFrame, false, &header)) < file->mSize)
+	{
+		// One more than the frames, for the end
+		if (numEntries + 1 == capacity)
+		{
+			capacity *= 2;
+			file->mIndex = (struct AQFLACFrameEntry *) realloc(file->mIndex, capacity * sizeof(struct AQFLACFrameEntry));
+		}
+		
+		file->mIndex[numEntries].mOffset = offset;
+		file->mIndex[numEntries].mFirstFrame = header.mFirstFrame;
+		numEntries++;
+		
+		nextFirstFrame = header.mFirstFrame + header.mBlockSize;
+		offset += header.mSize;
+	}
+	
+	if (numEntries == 0)
+	{
+		free(file->mIndex);
+		file->mIndex = NULL;
+		return false;
+	}
+	
+	file->mIndex[numEntries].mOffset = file->mSize;
+	file->mIndex[numEntries].mFirstFrame = nextFirstFrame;
+	file->mNumIndexEntries = numEntries;
+	
+	if (file->mInfo.mNumFrames == 0)
+	{
+		file->mInfo.mNumFrames = nextFirstFrame;
+	}
+	
+	return true;
+}
+
+UInt32 AQFLACFile_ReadAt(const struct AQFLACFile * file, UInt64 frame, Float32 * out, UInt32 numFrames)
+{
+	const struct AQFLACFrameEntry * index = file->mIndex;
+	UInt32 numChannels = file->mInfo.mNumChannels;
+	
+	if (!index || frame >= index[file->mNumIndexEntries].mFirstFrame)
+	{
+		return 0;
+	}
+	
+	if (numFrames > index[file->mNumIndexEntries].mFirstFrame - frame)
+	{
+		numFrames = (UInt32) (index[file->mNumIndexEntries].mFirstFrame - frame);
+	}
+	
+	// The last frame starting at or before frame
+	UInt32 low = 0;
+	UInt32 high = file->mNumIndexEntries - 1;
+	
+	while (low < high)
+	{
+		UInt32 middle = (low + high + 1) / 2;
+		
+		if (index[middle].mFirstFrame <= frame)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+	
+	SInt32 * samples = (SInt32 *) malloc((size_t) file->mInfo.mMaxBlockSize * numChannels * sizeof(SInt32));
+	const struct AQFLACFrameEntry * entry = index + low;
+	UInt32 numRead = 0;
+	
+	while (numRead < numFrames)
+	{
+		UInt64 position = frame + numRead;
+		Float32 * block = out + (size_t) numRead * numChannels;
+		
+		// Frames lost to damage before the first frame found come out as silence
+		if (position < entry->mFirstFrame)
+		{
+			UInt32 count = entry->mFirstFrame - position < numFrames - numRead ? (UInt32) (entry->mFirstFrame - position) : numFrames - numRead;
+			
+			memset(block, 0, (size_t) count * numChannels * sizeof(Float32));
+			numRead += count;
+			continue;
+		}
+		
+		struct AQFLACFrameHeader header;
+		size_t frameEnd;
+		UInt32 first = (UInt32) (position - entry->mFirstFrame);
+		UInt32 count = entry[1].mFirstFrame - position < numFrames - numRead ? (UInt32) (entry[1].mFirstFrame - position) : numFrames - numRead;
+		UInt32 numDecoded = 0;
+		
+		if (AQFLACFile_ParseFrameHeader(file, entry->mOffset, &header) &&
+			AQFLACFile_DecodeFrame(file, &header, entry->mOffset, entry[1].mOffset, samples, &frameEnd))
+		{
+			numDecoded = header.mBlockSize > first ? header.mBlockSize - first : 0;
+			numDecoded = numDecoded < count ? numDecoded : count;
+		}
+		
+		// Damaged frames, and any gap after one, come out as silence
+		AQFLACFile_Interleave(file, samples, first, numDecoded, block);
+		memset(block + (size_t) numDecoded * numChannels, 0, (size_t) (count - numDecoded) * numChannels * sizeof(Float32));
+		
+		numRead += count;
+		entry++;
+	}
+	
+	free(samples);
+	
+	return numRead;
+}
+
+void AQFLACFile_Close(struct AQFLACFile * file)
+{
+	if (file->mData)
+	{
+		munmap((void *) file->mData, file->mSize);
+	}
+	
+	free(file->mIndex);
+	free(file->mSamples);
+	free(file);
+}
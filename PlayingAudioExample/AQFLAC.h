@@ -0,0 +1,78 @@
+//
+//  AQFLAC.h
+//  PlayingAudioExample
+//
+
+/* FLAC decoder, for hosts where AudioFile does not open .flac files.
+ *
+ * The file is mapped rather than read. AQFLACFile_Read decodes frames in
+ * order from wherever the previous one ended, advising the system to fetch
+ * the pages a little ahead of it, which is what playback needs.
+ *
+ * Every FLAC frame decodes on its own. AQFLACFile_IndexFrames finds each
+ * frame from its header (sync code, CRC-8 and a frame or sample number
+ * following on from the previous one), after which AQFLACFile_ReadAt decodes
+ * any range from any thread, and chunks of one file go to AQChunkedDecoder.
+ *
+ * Frames whose CRC-16 does not match come out as silence. Streams of 4 to 24
+ * bits per sample and up to 8 channels are decoded; output is float, with the
+ * channels in the WAVE order FLAC already uses.
+ */
+
+#ifndef AQFLAC_h
+#define AQFLAC_h
+
+#include "AQTypes.h"
+
+static const UInt32 kAQFLACMaxChannels = 8;
+
+struct AQFLACInfo
+{
+	UInt32 mNumChannels;
+	UInt32 mSampleRate;
+	UInt32 mBitsPerSample;
+	
+	/* Description:
+	 * Frames in the largest block of the stream, the most one FLAC frame decodes to.
+	 */
+	UInt32 mMaxBlockSize;
+	
+	/* Description:
+	 * Bytes in the largest FLAC frame of the stream, from STREAMINFO, or 0 when the
+	 * encoder did not know it.
+	 */
+	UInt32 mMaxPacketSize;
+	
+	/* Description:
+	 * From STREAMINFO, or 0 when the encoder did not know it until
+	 * AQFLACFile_IndexFrames counts them.
+	 */
+	UInt64 mNumFrames;
+};
+
+struct AQFLACFile;
+
+// NULL if the file is not FLAC or a kind of FLAC stream this does not decode
+struct AQFLACFile * AQFLACFile_Open(const char path[]);
+
+const struct AQFLACInfo * AQFLACFile_GetInfo(const struct AQFLACFile * file);
+
+// Decodes up to numFrames interleaved float frames into out and returns the number
+// decoded, 0 at the end of the stream
+UInt32 AQFLACFile_Read(struct AQFLACFile * file, Float32 * out, UInt32 numFrames);
+
+// Starts decoding over from the first frame
+bool AQFLACFile_Rewind(struct AQFLACFile * file);
+
+// Scans the whole file for its frames, once, before AQFLACFile_ReadAt. False if there
+// are none.
+bool AQFLACFile_IndexFrames(struct AQFLACFile * file);
+
+// Decodes up to numFrames interleaved float frames from frame on into out, leaving the
+// position of AQFLACFile_Read alone. Needs AQFLACFile_IndexFrames; safe to call from
+// several threads at once.
+UInt32 AQFLACFile_ReadAt(const struct AQFLACFile * file, UInt64 frame, Float32 * out, UInt32 numFrames);
+
+void AQFLACFile_Close(struct AQFLACFile * file);
+
+#endif /* AQFLAC_h */
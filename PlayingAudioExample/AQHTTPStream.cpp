@@ -0,0 +1,698 @@
+//
+//  AQHTTPStream.cpp
+//  PlayingAudioExample
+//
+
+#include "AQHTTPStream.h"
+#include "AQTrace.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#if defined(MSG_NOSIGNAL)
+static const int kAQHTTPSendFlags = MSG_NOSIGNAL;
+#else
+static const int kAQHTTPSendFlags = 0;
+#endif
+
+static const UInt32 kAQHTTPMaxHeaderBytes = 8192;
+
+// Reads at most this far past the buffered window wait for the download instead of seeking
+static const SInt64 kAQHTTPSkipAheadBytes = 256 * 1024;
+
+// Room the downloader frees up at a time once the ring is full
+static const UInt32 kAQHTTPReceiveBytes = 16 * 1024;
+
+// Attempts at resuming a dropped download before reads start failing
+static const UInt32 kAQHTTPMaxReconnects = 5;
+
+struct AQHTTPStream
+{
+	char * mHost;
+	char * mPort;
+	char * mPath;
+	
+	std::thread mThread;
+	
+	/* Description:
+	 * Guards everything below. mChanged is signalled whenever the window moves,
+	 * a seek is requested, or the stream fails or is disposed.
+	 */
+	std::mutex mMutex;
+	std::condition_variable mChanged;
+	
+	/* Description:
+	 * The ring holds bytes [mRingStart, mRingEnd) of the resource, byte n at
+	 * mRing[n % mRingSize]. Only the download thread moves the window; readers
+	 * copy out of it with the mutex held.
+	 */
+	UInt8 * mRing;
+	UInt32 mRingSize;
+	SInt64 mRingStart;
+	SInt64 mRingEnd;
+	
+	/* Description:
+	 * End of the latest read. The downloader only discards bytes before it.
+	 */
+	SInt64 mReadPosition;
+	
+	/* Description:
+	 * Where a reader wants the download to continue from, -1 when it is fine where
+	 * it is. The downloader picks it up after aborting its current connection.
+	 */
+	SInt64 mSeekOffset;
+	
+	SInt64 mLength;
+	int mSocket;
+	bool mHeadersDone;
+	bool mFailed;
+	bool mStopping;
+	
+	struct AQHTTPStreamStats mStats;
+};
+
+static
+int AQHTTPStream_Connect(struct AQHTTPStream * stream)
+{
+	struct addrinfo hints;
+	struct addrinfo * addresses;
+	struct addrinfo * address;
+	int fd = -1;
+	
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	
+	if (getaddrinfo(stream->mHost, stream->mPort, &hints, &addresses) != 0)
+	{
+		return -1;
+	}
+	
+	for (address = addresses; address; address = address->ai_next)
+	{
+		fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		
+		if (fd < 0)
+		{
+			continue;
+		}
+		
+		if (connect(fd, address->ai_addr, address->ai_addrlen) == 0)
+		{
+			break;
+		}
+		
+		close(fd);
+		fd = -1;
+	}
+	
+	freeaddrinfo(addresses);
+	
+#if defined(SO_NOSIGPIPE)
+	if (fd >= 0)
+	{
+		int on = 1;
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	}
+#endif
+	
+	return fd;
+}
+
+static
+bool AQHTTPStream_SendRequest(struct AQHTTPStream * stream, int fd, SInt64 offset)
+{
+	char request[kAQHTTPMaxHeaderBytes];
+	
+	int numBytes = snprintf(request, sizeof(request),
+							"GET %s HTTP/1.1\r\n"
+							"Host: %s:%s\r\n"
+							"Range: bytes=%lld-\r\n"
+							"Connection: close\r\n"
+							"\r\n",
+							stream->mPath, stream->mHost, stream->mPort, (long long) offset);
+	
+	if (numBytes <= 0 || numBytes >= (int) sizeof(request))
+	{
+		return false;
+	}
+	
+	return send(fd, request, numBytes, kAQHTTPSendFlags) == numBytes;
+}
+
+/* Reads the response headers and works out the total length. Body bytes that came
+ * in with the headers are left at the start of buffer, their count in outNumBody.
+ */
+static
+bool AQHTTPStream_ReceiveHeaders(int fd, SInt64 offset, char * buffer, SInt64 * outLength, UInt32 * outNumBody)
+{
+	UInt32 numReceived = 0;
+	char * headerEnd = NULL;
+	
+	while (!headerEnd)
+	{
+		if (numReceived == kAQHTTPMaxHeaderBytes - 1)
+		{
+			return false;
+		}
+		
+		ssize_t numBytes = recv(fd, buffer + numReceived, kAQHTTPMaxHeaderBytes - 1 - numReceived, 0);
+		
+		if (numBytes <= 0)
+		{
+			if (numBytes < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			
+			return false;
+		}
+		
+		numReceived += numBytes;
+		buffer[numReceived] = '\0';
+		headerEnd = strstr(buffer, "\r\n\r\n");
+	}
+	
+	int status = 0;
+	long long contentLength = -1;
+	long long totalLength = -1;
+	bool isChunked = false;
+	char * line;
+	
+	*headerEnd = '\0';
+	
+	if (sscanf(buffer, "HTTP/%*d.%*d %d", &status) != 1)
+	{
+		return false;
+	}
+	
+	for (line = strstr(buffer, "\r\n"); line; line = strstr(line, "\r\n"))
+	{
+		line += 2;
+		
+		if (strncasecmp(line, "Content-Length:", 15) == 0)
+		{
+			contentLength = atoll(line + 15);
+		}
+		else if (strncasecmp(line, "Content-Range:", 14) == 0)
+		{
+			const char * slash = strchr(line, '/');
+			
+			if (slash && slash[1] != '*')
+			{
+				totalLength = atoll(slash + 1);
+			}
+		}
+		else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked"))
+		{
+			isChunked = true;
+		}
+	}
+	
+	if (isChunked)
+	{
+		return false;
+	}
+	
+	if (status == 206 && totalLength >= 0)
+	{
+		*outLength = totalLength;
+	}
+	else if (status == 200 && offset == 0 && contentLength >= 0)
+	{
+		// The server ignored the Range header, which is fine from the start
+		*outLength = contentLength;
+	}
+	else if (status == 416)
+	{
+		// Asked for the end of the resource
+		*outLength = offset;
+	}
+	else
+	{
+		return false;
+	}
+	
+	char * body = headerEnd + 4;
+	
+	*outNumBody = numReceived - (UInt32) (body - buffer);
+	memmove(buffer, body, *outNumBody);
+	
+	return true;
+}
+
+/* Moves the body into the ring, starting with the bytes that came in with the
+ * headers, until the connection ends, the resource is complete, or a reader
+ * wants to seek.
+ */
+static
+void AQHTTPStream_ReceiveBody(struct AQHTTPStream * stream, int fd, const char * head, UInt32 numHead)
+{
+	for (;;)
+	{
+		std::unique_lock<std::mutex> lock(stream->mMutex);
+		UInt32 room;
+		
+		for (;;)
+		{
+			if (stream->mStopping || stream->mSeekOffset >= 0 || stream->mRingEnd >= stream->mLength)
+			{
+				return;
+			}
+			
+			room = stream->mRingSize - (UInt32) (stream->mRingEnd - stream->mRingStart);
+			
+			if (room < kAQHTTPReceiveBytes)
+			{
+				// Drop the oldest bytes the reader is done with, keep the rest for seeking back
+				SInt64 consumed = stream->mReadPosition < stream->mRingEnd ? stream->mReadPosition : stream->mRingEnd;
+				SInt64 discard = consumed - stream->mRingStart;
+				
+				if (discard > kAQHTTPReceiveBytes - room)
+				{
+					discard = kAQHTTPReceiveBytes - room;
+				}
+				
+				if (discard > 0)
+				{
+					stream->mRingStart += discard;
+					room += (UInt32) discard;
+				}
+			}
+			
+			if (room > 0)
+			{
+				break;
+			}
+			
+			// Full of bytes nobody has read yet, so let TCP hold the sender back
+			stream->mChanged.wait(lock);
+		}
+		
+		UInt32 index = (UInt32) (stream->mRingEnd % stream->mRingSize);
+		UInt32 numWanted = room < stream->mRingSize - index ? room : stream->mRingSize - index;
+		
+		if (numWanted > stream->mLength - stream->mRingEnd)
+		{
+			numWanted = (UInt32) (stream->mLength - stream->mRingEnd);
+		}
+		
+		// Outside the window, so no reader looks at these bytes while the lock is dropped
+		UInt8 * dst = stream->mRing + index;
+		ssize_t numBytes;
+		
+		lock.unlock();
+		
+		if (numHead > 0)
+		{
+			numBytes = numHead < numWanted ? numHead : numWanted;
+			memcpy(dst, head, numBytes);
+			head += numBytes;
+			numHead -= numBytes;
+		}
+		else
+		{
+			do
+			{
+				numBytes = recv(fd, dst, numWanted, 0);
+			} while (numBytes < 0 && errno == EINTR);
+		}
+		
+		lock.lock();
+		
+		if (numBytes <= 0)
+		{
+			return;
+		}
+		
+		stream->mRingEnd += numBytes;
+		stream->mStats.mBytesDownloaded += numBytes;
+		stream->mChanged.notify_all();
+	}
+}
+
+static
+void AQHTTPStream_Main(struct AQHTTPStream * stream)
+{
+	char head[kAQHTTPMaxHeaderBytes];
+	SInt64 offset = 0;
+	UInt32 numAttempts = 0;
+	
+	for (;;)
+	{
+		SInt64 length = -1;
+		UInt32 numHead = 0;
+		int fd = AQHTTPStream_Connect(stream);
+		
+		{
+			std::unique_lock<std::mutex> lock(stream->mMutex);
+			
+			if (stream->mStopping)
+			{
+				if (fd >= 0)
+				{
+					close(fd);
+				}
+				
+				return;
+			}
+			
+			// Published so that disposing or seeking can cut a blocked recv short
+			stream->mSocket = fd;
+		}
+		
+		bool ok = fd >= 0 &&
+				  AQHTTPStream_SendRequest(stream, fd, offset) &&
+				  AQHTTPStream_ReceiveHeaders(fd, offset, head, &length, &numHead);
+		
+		if (ok)
+		{
+			std::unique_lock<std::mutex> lock(stream->mMutex);
+			
+			if (!stream->mHeadersDone)
+			{
+				stream->mLength = length;
+				stream->mHeadersDone = true;
+			}
+			
+			// The seek is in effect once the ring restarts at its offset; a reader
+			// that asked for another one since is served on the next round
+			if (stream->mSeekOffset == offset)
+			{
+				stream->mSeekOffset = -1;
+				stream->mStats.mNumSeeks++;
+			}
+			
+			if (offset != stream->mRingEnd)
+			{
+				stream->mRingStart = offset;
+				stream->mRingEnd = offset;
+			}
+			
+			stream->mChanged.notify_all();
+		}
+		
+		if (ok)
+		{
+			numAttempts = 0;
+			AQHTTPStream_ReceiveBody(stream, fd, head, numHead);
+		}
+		
+		std::unique_lock<std::mutex> lock(stream->mMutex);
+		
+		stream->mSocket = -1;
+		
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		
+		if (stream->mStopping)
+		{
+			return;
+		}
+		
+		// Nothing to resume when the URL never worked
+		if (!stream->mHeadersDone || (!ok && ++numAttempts > kAQHTTPMaxReconnects))
+		{
+			stream->mFailed = true;
+			stream->mChanged.notify_all();
+			return;
+		}
+		
+		// With the whole resource in, sleep until a reader seeks outside the window
+		while (stream->mSeekOffset < 0 && stream->mRingEnd >= stream->mLength && !stream->mStopping)
+		{
+			stream->mChanged.wait(lock);
+		}
+		
+		if (stream->mStopping)
+		{
+			return;
+		}
+		
+		if (stream->mSeekOffset >= 0)
+		{
+			offset = stream->mSeekOffset;
+			continue;
+		}
+		
+		// The connection dropped part way, pick up where it left off,
+		// backing off a little more on each consecutive failure
+		offset = stream->mRingEnd;
+		stream->mStats.mNumReconnects++;
+		stream->mChanged.wait_for(lock, std::chrono::milliseconds(100 * numAttempts));
+		
+		if (stream->mStopping)
+		{
+			return;
+		}
+	}
+}
+
+// Splits http://host[:port][/path] into its parts
+static
+bool AQHTTPStream_ParseURL(struct AQHTTPStream * stream, const char url[])
+{
+	const char * host = url + 7;
+	const char * path = strchr(host, '/');
+	const char * hostEnd = path ? path : host + strlen(host);
+	const char * colon = (const char *) memchr(host, ':', hostEnd - host);
+	
+	if (!AQHTTPStream_IsURL(url) || hostEnd == host || colon == host)
+	{
+		return false;
+	}
+	
+	stream->mHost = strndup(host, (colon ? colon : hostEnd) - host);
+	stream->mPort = colon ? strndup(colon + 1, hostEnd - colon - 1) : strdup("80");
+	stream->mPath = strdup(path ? path : "/");
+	
+	return true;
+}
+
+bool AQHTTPStream_IsURL(const char path[])
+{
+	return strncmp(path, "http://", 7) == 0;
+}
+
+struct AQHTTPStream * AQHTTPStream_Open(const char url[], UInt32 bufferBytes)
+{
+	struct AQHTTPStream * stream = new AQHTTPStream;
+	
+	stream->mHost = NULL;
+	stream->mPort = NULL;
+	stream->mPath = NULL;
+	
+	if (!AQHTTPStream_ParseURL(stream, url))
+	{
+		delete stream;
+		return NULL;
+	}
+	
+	stream->mRingSize = bufferBytes > kAQHTTPReceiveBytes ? bufferBytes : kAQHTTPReceiveBytes;
+	stream->mRing = (UInt8 *) malloc(stream->mRingSize);
+	stream->mRingStart = 0;
+	stream->mRingEnd = 0;
+	stream->mReadPosition = 0;
+	stream->mSeekOffset = -1;
+	stream->mLength = -1;
+	stream->mSocket = -1;
+	stream->mHeadersDone = false;
+	stream->mFailed = false;
+	stream->mStopping = false;
+	
+	memset(&stream->mStats, 0, sizeof(stream->mStats));
+	
+	stream->mThread = std::thread(AQHTTPStream_Main, stream);
+	
+	return stream;
+}
+
+bool AQHTTPStream_WaitForHeaders(struct AQHTTPStream * stream)
+{
+	std::unique_lock<std::mutex> lock(stream->mMutex);
+	
+	while (!stream->mHeadersDone && !stream->mFailed)
+	{
+		stream->mChanged.wait(lock);
+	}
+	
+	return stream->mHeadersDone;
+}
+
+SInt64 AQHTTPStream_GetLength(struct AQHTTPStream * stream)
+{
+	std::unique_lock<std::mutex> lock(stream->mMutex);
+	
+	return stream->mLength;
+}
+
+bool AQHTTPStream_WaitForWatermark(struct AQHTTPStream * stream, UInt32 numBytes)
+{
+	std::unique_lock<std::mutex> lock(stream->mMutex);
+	
+	while (!stream->mFailed &&
+		   !(stream->mHeadersDone && (stream->mRingEnd >= numBytes || stream->mRingEnd >= stream->mLength)))
+	{
+		stream->mChanged.wait(lock);
+	}
+	
+	return !stream->mFailed;
+}
+
+// Reads at most half the ring, so the downloader can keep going while it is copied
+static
+SInt32 AQHTTPStream_ReadChunk(struct AQHTTPStream * stream, std::unique_lock<std::mutex> & lock,
+							  SInt64 offset, UInt32 numBytes, UInt8 * dst)
+{
+	bool stalled = false;
+	UInt64 stallNanos = 0;
+	
+	for (;;)
+	{
+		if (stream->mFailed)
+		{
+			return -1;
+		}
+		
+		if (stream->mSeekOffset < 0 && offset >= stream->mRingStart && offset + numBytes <= stream->mRingEnd)
+		{
+			break;
+		}
+		
+		if (stream->mSeekOffset < 0 && (offset < stream->mRingStart || offset > stream->mRingEnd + kAQHTTPSkipAheadBytes))
+		{
+			stream->mSeekOffset = offset;
+			
+			if (stream->mSocket >= 0)
+			{
+				shutdown(stream->mSocket, SHUT_RDWR);
+			}
+		}
+		
+		// Nothing before offset is needed any more
+		stream->mReadPosition = offset;
+		stream->mChanged.notify_all();
+		
+		if (!stalled && AQTrace_IsEnabled())
+		{
+			stallNanos = AQTrace_Now();
+		}
+		
+		stalled = true;
+		stream->mChanged.wait(lock);
+	}
+	
+	UInt32 index = (UInt32) (offset % stream->mRingSize);
+	UInt32 numFirst = numBytes < stream->mRingSize - index ? numBytes : stream->mRingSize - index;
+	
+	memcpy(dst, stream->mRing + index, numFirst);
+	memcpy(dst + numFirst, stream->mRing, numBytes - numFirst);
+	
+	stream->mReadPosition = offset + numBytes;
+	stream->mChanged.notify_all();
+	
+	stream->mStats.mNumStalls += stalled;
+	
+	if (stallNanos)
+	{
+		// The reader got ahead of the network
+		AQTrace_Complete("underrun", stallNanos, offset);
+	}
+	
+	return numBytes;
+}
+
+SInt32 AQHTTPStream_ReadAt(struct AQHTTPStream * stream, SInt64 offset, UInt32 numBytes, void * dst)
+{
+	std::unique_lock<std::mutex> lock(stream->mMutex);
+	UInt32 numRead = 0;
+	
+	while (!stream->mHeadersDone && !stream->mFailed)
+	{
+		stream->mChanged.wait(lock);
+	}
+	
+	if (stream->mFailed)
+	{
+		return -1;
+	}
+	
+	if (offset >= stream->mLength)
+	{
+		return 0;
+	}
+	
+	if (numBytes > stream->mLength - offset)
+	{
+		numBytes = (UInt32) (stream->mLength - offset);
+	}
+	
+	while (numRead < numBytes)
+	{
+		UInt32 numChunk = numBytes - numRead;
+		
+		if (numChunk > stream->mRingSize / 2)
+		{
+			numChunk = stream->mRingSize / 2;
+		}
+		
+		if (AQHTTPStream_ReadChunk(stream, lock, offset + numRead, numChunk, (UInt8 *) dst + numRead) < 0)
+		{
+			return -1;
+		}
+		
+		numRead += numChunk;
+	}
+	
+	return numRead;
+}
+
+void AQHTTPStream_GetStats(struct AQHTTPStream * stream, struct AQHTTPStreamStats * outStats)
+{
+	std::unique_lock<std::mutex> lock(stream->mMutex);
+	
+	*outStats = stream->mStats;
+}
+
+void AQHTTPStream_Dispose(struct AQHTTPStream * stream)
+{
+	if (!stream)
+	{
+		return;
+	}
+	
+	{
+		std::unique_lock<std::mutex> lock(stream->mMutex);
+		
+		stream->mStopping = true;
+		
+		if (stream->mSocket >= 0)
+		{
+			shutdown(stream->mSocket, SHUT_RDWR);
+		}
+		
+		stream->mChanged.notify_all();
+	}
+	
+	stream->mThread.join();
+	
+	free(stream->mRing);
+	free(stream->mHost);
+	free(stream->mPort);
+	free(stream->mPath);
+	
+	delete stream;
+}
@@ -0,0 +1,65 @@
+//
+//  AQHTTPStream.h
+//  PlayingAudioExample
+//
+
+/* Random-access reads over a progressive HTTP/1.1 download.
+ *
+ * A background thread downloads the resource into a ring buffer that serves as
+ * the jitter buffer: readers are served from it and only wait when they get ahead
+ * of the download. Bytes behind the last read are kept for as long as there is
+ * room, so short seeks backwards are free. A read outside the buffered window
+ * (or far ahead of it) restarts the download there with a Range request, and a
+ * dropped connection is resumed the same way.
+ *
+ * Only plain http:// URLs are handled, and the server has to send Content-Length.
+ */
+
+#ifndef AQHTTPStream_h
+#define AQHTTPStream_h
+
+#include "AQTypes.h"
+
+static const UInt32 kAQHTTPStreamDefaultBufferBytes = 1 << 20;
+
+struct AQHTTPStreamStats
+{
+	UInt64 mBytesDownloaded;
+	
+	/* Description:
+	 * Reads that found the buffer behind them and had to wait for the network.
+	 */
+	UInt32 mNumStalls;
+	
+	/* Description:
+	 * Range requests made for reads outside the buffer, and after dropped connections.
+	 */
+	UInt32 mNumSeeks;
+	UInt32 mNumReconnects;
+};
+
+struct AQHTTPStream;
+
+bool AQHTTPStream_IsURL(const char path[]);
+
+// Starts downloading url into a ring of bufferBytes; NULL when the URL cannot be parsed
+struct AQHTTPStream * AQHTTPStream_Open(const char url[], UInt32 bufferBytes);
+
+// Waits for the response headers; false unless the server answered with the content
+bool AQHTTPStream_WaitForHeaders(struct AQHTTPStream * stream);
+
+// Total length in bytes, valid once AQHTTPStream_WaitForHeaders has succeeded
+SInt64 AQHTTPStream_GetLength(struct AQHTTPStream * stream);
+
+// Waits until numBytes from the start are buffered or the whole resource is; false on error
+bool AQHTTPStream_WaitForWatermark(struct AQHTTPStream * stream, UInt32 numBytes);
+
+// Copies numBytes at offset into dst, waiting for them if needed.
+// Returns the number of bytes copied, short only at the end, or -1 on error.
+SInt32 AQHTTPStream_ReadAt(struct AQHTTPStream * stream, SInt64 offset, UInt32 numBytes, void * dst);
+
+void AQHTTPStream_GetStats(struct AQHTTPStream * stream, struct AQHTTPStreamStats * outStats);
+
+void AQHTTPStream_Dispose(struct AQHTTPStream * stream);
+
+#endif /* AQHTTPStream_h */
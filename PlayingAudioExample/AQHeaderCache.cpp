@@ -0,0 +1,487 @@
+//
+//  AQHeaderCache.cpp
+//  PlayingAudioExample
+//
+
+#include "AQHeaderCache.h"
+#include "AQArena.h"
+
+#include <limits.h>
+#include <mutex>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* The file, in host (little endian) byte order: "AQHC", version, number of
+ * entries and a reserved word, then every entry as the fields of
+ * AQHeaderCache_PutEntry followed by its path and its cookie.
+ */
+
+static const UInt32 kHeaderCacheVersion = 1;
+static const UInt32 kHeaderCacheHeaderSize = 16;
+static const UInt32 kHeaderCacheEntrySize = 88;
+
+// Longer paths than this in a cache file mean it is damaged
+static const UInt32 kHeaderCacheMaxPathLength = 4096;
+
+// Only the start of an AQHeaderInfo is kept for an entry, up to the end of its cookie
+static const size_t kHeaderInfoFixedSize = offsetof(struct AQHeaderInfo, mCookie);
+
+/* Description:
+ * mHash is 0 for an empty slot. mInfo, like mPath, lives in the cache's arena and
+ * is only as long as its cookie needs.
+ */
+struct AQHeaderCacheEntry
+{
+	UInt64 mHash;
+	const char * mPath;
+	UInt64 mFileSize;
+	SInt64 mModifiedSeconds;
+	UInt32 mModifiedNanoseconds;
+	struct AQHeaderInfo * mInfo;
+};
+
+struct AQHeaderCache
+{
+	std::mutex mMutex;
+	char * mPath;
+	
+	/* Description:
+	 * Open addressing by hash of the path, never more than half full. Entries
+	 * replaced by a store leave their old path and info in mArena until close.
+	 */
+	struct AQHeaderCacheEntry * mSlots;
+	UInt32 mNumSlots;
+	UInt32 mNumEntries;
+	struct AQArena mArena;
+	
+	bool mIsDirty;
+};
+
+static
+UInt64 AQHeaderCache_Hash(const char path[])
+{
+	// FNV-1a
+	UInt64 hash = 14695981039346656037ull;
+	
+	for (; *path; path++)
+	{
+		hash = (hash ^ (UInt8) *path) * 1099511628211ull;
+	}
+	
+	return hash ? hash : 1;
+}
+
+// Size and modification time of a regular file; false for anything else
+static
+bool AQHeaderCache_Stat(const char filePath[], UInt64 * outFileSize, SInt64 * outModifiedSeconds, UInt32 * outModifiedNanoseconds)
+{
+	struct stat status;
+	
+	if (stat(filePath, &status) != 0 || !S_ISREG(status.st_mode))
+	{
+		return false;
+	}
+	
+	*outFileSize = (UInt64) status.st_size;
+#ifdef __APPLE__
+	*outModifiedSeconds = (SInt64) status.st_mtimespec.tv_sec;
+	*outModifiedNanoseconds = (UInt32) status.st_mtimespec.tv_nsec;
+#else
+	*outModifiedSeconds = (SInt64) status.st_mtim.tv_sec;
+	*outModifiedNanoseconds = (UInt32) status.st_mtim.tv_nsec;
+#endif
+	
+	return true;
+}
+
+// The key for filePath: the same file reached through a relative path, a symlink or
+// extra slashes is one entry. False when the file cannot be found.
+static
+bool AQHeaderCache_Canonicalize(const char filePath[], char outPath[PATH_MAX])
+{
+	return realpath(filePath, outPath) != NULL;
+}
+
+// Whether the file at the entry's path is still the one its header was stored for
+static
+bool AQHeaderCache_IsCurrent(const struct AQHeaderCacheEntry * entry)
+{
+	UInt64 fileSize;
+	SInt64 modifiedSeconds;
+	UInt32 modifiedNanoseconds;
+	
+	return AQHeaderCache_Stat(entry->mPath, &fileSize, &modifiedSeconds, &modifiedNanoseconds) &&
+		   entry->mFileSize == fileSize &&
+		   entry->mModifiedSeconds == modifiedSeconds &&
+		   entry->mModifiedNanoseconds == modifiedNanoseconds;
+}
+
+// The slot holding path, or the empty slot it would go in
+static
+struct AQHeaderCacheEntry * AQHeaderCache_FindSlot(struct AQHeaderCacheEntry * slots, UInt32 numSlots, UInt64 hash, const char path[])
+{
+	UInt32 mask = numSlots - 1;
+	UInt32 index = (UInt32) hash & mask;
+	
+	while (slots[index].mHash != 0 &&
+		   (slots[index].mHash != hash || strcmp(slots[index].mPath, path) != 0))
+	{
+		index = (index + 1) & mask;
+	}
+	
+	return &slots[index];
+}
+
+// Makes room for one more entry
+static
+void AQHeaderCache_Reserve(struct AQHeaderCache * cache)
+{
+	if (2 * (cache->mNumEntries + 1) <= cache->mNumSlots)
+	{
+		return;
+	}
+	
+	UInt32 numSlots = cache->mNumSlots ? 2 * cache->mNumSlots : 1024;
+	struct AQHeaderCacheEntry * slots = (struct AQHeaderCacheEntry *) calloc(numSlots, sizeof(struct AQHeaderCacheEntry));
+	UInt32 k;
+	
+	for (k = 0; k < cache->mNumSlots; k++)
+	{
+		if (cache->mSlots[k].mHash != 0)
+		{
+			*AQHeaderCache_FindSlot(slots, numSlots, cache->mSlots[k].mHash, cache->mSlots[k].mPath) = cache->mSlots[k];
+		}
+	}
+	
+	free(cache->mSlots);
+	cache->mSlots = slots;
+	cache->mNumSlots = numSlots;
+}
+
+// Drops the entries of files that were deleted or changed since they were stored, so
+// they are not saved again; the caller holds the mutex. Their paths and infos stay in
+// mArena until close, like those a store replaces.
+static
+void AQHeaderCache_Prune(struct AQHeaderCache * cache)
+{
+	struct AQHeaderCacheEntry * slots;
+	UInt32 numEntries = 0;
+	UInt32 k;
+	
+	if (cache->mNumEntries == 0)
+	{
+		return;
+	}
+	
+	slots = (struct AQHeaderCacheEntry *) calloc(cache->mNumSlots, sizeof(struct AQHeaderCacheEntry));
+	
+	// Rehashed rather than emptied in place, which would break the probe chains
+	for (k = 0; k < cache->mNumSlots; k++)
+	{
+		if (cache->mSlots[k].mHash != 0 && AQHeaderCache_IsCurrent(&cache->mSlots[k]))
+		{
+			*AQHeaderCache_FindSlot(slots, cache->mNumSlots, cache->mSlots[k].mHash, cache->mSlots[k].mPath) = cache->mSlots[k];
+			numEntries++;
+		}
+	}
+	
+	free(cache->mSlots);
+	cache->mSlots = slots;
+	
+	if (numEntries != cache->mNumEntries)
+	{
+		cache->mNumEntries = numEntries;
+		cache->mIsDirty = true;
+	}
+}
+
+// Adds or replaces the entry for path; the caller holds the mutex
+static
+void AQHeaderCache_Insert(struct AQHeaderCache * cache, const char path[], UInt32 pathLength, UInt64 fileSize, SInt64 modifiedSeconds, UInt32 modifiedNanoseconds, const struct AQHeaderInfo * info)
+{
+	AQHeaderCache_Reserve(cache);
+	
+	UInt64 hash = AQHeaderCache_Hash(path);
+	struct AQHeaderCacheEntry * entry = AQHeaderCache_FindSlot(cache->mSlots, cache->mNumSlots, hash, path);
+	
+	if (entry->mHash == 0)
+	{
+		char * pathCopy = (char *) AQArena_Alloc(&cache->mArena, pathLength + 1);
+		
+		memcpy(pathCopy, path, pathLength + 1);
+		
+		entry->mHash = hash;
+		entry->mPath = pathCopy;
+		cache->mNumEntries++;
+	}
+	
+	entry->mFileSize = fileSize;
+	entry->mModifiedSeconds = modifiedSeconds;
+	entry->mModifiedNanoseconds = modifiedNanoseconds;
+	entry->mInfo = (struct AQHeaderInfo *) AQArena_Alloc(&cache->mArena, kHeaderInfoFixedSize + info->mCookieSize);
+	
+	memcpy(entry->mInfo, info, kHeaderInfoFixedSize + info->mCookieSize);
+}
+
+static
+void AQHeaderCache_PutEntry(UInt8 * p, const struct AQHeaderCacheEntry * entry, UInt32 pathLength)
+{
+	const struct AQHeaderInfo * info = entry->mInfo;
+	
+	memcpy(p, &entry->mFileSize, 8);
+	memcpy(p + 8, &entry->mModifiedSeconds, 8);
+	memcpy(p + 16, &entry->mModifiedNanoseconds, 4);
+	memcpy(p + 20, &pathLength, 4);
+	memcpy(p + 24, &info->mCookieSize, 4);
+	memcpy(p + 28, &info->mSampleRate, 8);
+	memcpy(p + 36, &info->mFormatID, 4);
+	memcpy(p + 40, &info->mFormatFlags, 4);
+	memcpy(p + 44, &info->mBytesPerPacket, 4);
+	memcpy(p + 48, &info->mFramesPerPacket, 4);
+	memcpy(p + 52, &info->mBytesPerFrame, 4);
+	memcpy(p + 56, &info->mChannelsPerFrame, 4);
+	memcpy(p + 60, &info->mBitsPerChannel, 4);
+	memcpy(p + 64, &info->mFileType, 4);
+	memcpy(p + 68, &info->mMaxPacketSize, 4);
+	memcpy(p + 72, &info->mNumPackets, 8);
+	memcpy(p + 80, &info->mDuration, 8);
+}
+
+// Reads entries until the data ends or stops making sense, keeping those before that
+static
+void AQHeaderCache_Load(struct AQHeaderCache * cache, const UInt8 * data, size_t size)
+{
+	UInt32 numEntries;
+	UInt32 version;
+	UInt32 k;
+	
+	if (size < kHeaderCacheHeaderSize || memcmp(data, "AQHC", 4) != 0)
+	{
+		return;
+	}
+	
+	memcpy(&version, data + 4, 4);
+	memcpy(&numEntries, data + 8, 4);
+	
+	if (version != kHeaderCacheVersion)
+	{
+		return;
+	}
+	
+	const UInt8 * p = data + kHeaderCacheHeaderSize;
+	const UInt8 * end = data + size;
+	
+	for (k = 0; k < numEntries && (size_t) (end - p) >= kHeaderCacheEntrySize; k++)
+	{
+		struct AQHeaderInfo info;
+		UInt64 fileSize;
+		SInt64 modifiedSeconds;
+		UInt32 modifiedNanoseconds;
+		UInt32 pathLength;
+		
+		memcpy(&fileSize, p, 8);
+		memcpy(&modifiedSeconds, p + 8, 8);
+		memcpy(&modifiedNanoseconds, p + 16, 4);
+		memcpy(&pathLength, p + 20, 4);
+		memcpy(&info.mCookieSize, p + 24, 4);
+		memcpy(&info.mSampleRate, p + 28, 8);
+		memcpy(&info.mFormatID, p + 36, 4);
+		memcpy(&info.mFormatFlags, p + 40, 4);
+		memcpy(&info.mBytesPerPacket, p + 44, 4);
+		memcpy(&info.mFramesPerPacket, p + 48, 4);
+		memcpy(&info.mBytesPerFrame, p + 52, 4);
+		memcpy(&info.mChannelsPerFrame, p + 56, 4);
+		memcpy(&info.mBitsPerChannel, p + 60, 4);
+		memcpy(&info.mFileType, p + 64, 4);
+		memcpy(&info.mMaxPacketSize, p + 68, 4);
+		memcpy(&info.mNumPackets, p + 72, 8);
+		memcpy(&info.mDuration, p + 80, 8);
+		p += kHeaderCacheEntrySize;
+		
+		if (pathLength == 0 || pathLength > kHeaderCacheMaxPathLength ||
+			info.mCookieSize > kAQHeaderInfoMaxCookieSize ||
+			(size_t) (end - p) < (size_t) pathLength + info.mCookieSize ||
+			memchr(p, 0, pathLength))
+		{
+			return;
+		}
+		
+		char path[kHeaderCacheMaxPathLength + 1];
+		
+		memcpy(path, p, pathLength);
+		path[pathLength] = 0;
+		memcpy(info.mCookie, p + pathLength, info.mCookieSize);
+		p += pathLength + info.mCookieSize;
+		
+		AQHeaderCache_Insert(cache, path, pathLength, fileSize, modifiedSeconds, modifiedNanoseconds, &info);
+	}
+}
+
+struct AQHeaderCache * AQHeaderCache_Open(const char path[])
+{
+	struct AQHeaderCache * cache = new AQHeaderCache;
+	FILE * file;
+	
+	cache->mPath = strdup(path);
+	cache->mSlots = NULL;
+	cache->mNumSlots = 0;
+	cache->mNumEntries = 0;
+	cache->mIsDirty = false;
+	
+	AQArena_Init(&cache->mArena, kAQArenaDefaultBlockSize);
+	
+	if ((file = fopen(path, "rb")) != NULL)
+	{
+		long size;
+		
+		if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0)
+		{
+			UInt8 * data = (UInt8 *) malloc((size_t) size);
+			
+			if (fread(data, 1, (size_t) size, file) == (size_t) size)
+			{
+				AQHeaderCache_Load(cache, data, (size_t) size);
+			}
+			
+			free(data);
+		}
+		
+		fclose(file);
+	}
+	
+	return cache;
+}
+
+bool AQHeaderCache_Lookup(struct AQHeaderCache * cache, const char filePath[], struct AQHeaderInfo * outInfo)
+{
+	char path[PATH_MAX];
+	UInt64 fileSize;
+	SInt64 modifiedSeconds;
+	UInt32 modifiedNanoseconds;
+	
+	// Outside the lock, it is the slow part
+	if (!AQHeaderCache_Canonicalize(filePath, path) ||
+		!AQHeaderCache_Stat(path, &fileSize, &modifiedSeconds, &modifiedNanoseconds))
+	{
+		return false;
+	}
+	
+	std::lock_guard<std::mutex> lock(cache->mMutex);
+	
+	if (cache->mNumEntries == 0)
+	{
+		return false;
+	}
+	
+	const struct AQHeaderCacheEntry * entry = AQHeaderCache_FindSlot(cache->mSlots, cache->mNumSlots, AQHeaderCache_Hash(path), path);
+	
+	if (entry->mHash == 0 ||
+		entry->mFileSize != fileSize ||
+		entry->mModifiedSeconds != modifiedSeconds ||
+		entry->mModifiedNanoseconds != modifiedNanoseconds)
+	{
+		return false;
+	}
+	
+	memcpy(outInfo, entry->mInfo, kHeaderInfoFixedSize + entry->mInfo->mCookieSize);
+	
+	return true;
+}
+
+void AQHeaderCache_Store(struct AQHeaderCache * cache, const char filePath[], const struct AQHeaderInfo * info)
+{
+	char path[PATH_MAX];
+	UInt64 fileSize;
+	SInt64 modifiedSeconds;
+	UInt32 modifiedNanoseconds;
+	
+	if (info->mCookieSize > kAQHeaderInfoMaxCookieSize ||
+		!AQHeaderCache_Canonicalize(filePath, path) ||
+		strlen(path) > kHeaderCacheMaxPathLength ||
+		!AQHeaderCache_Stat(path, &fileSize, &modifiedSeconds, &modifiedNanoseconds))
+	{
+		return;
+	}
+	
+	std::lock_guard<std::mutex> lock(cache->mMutex);
+	
+	AQHeaderCache_Insert(cache, path, (UInt32) strlen(path), fileSize, modifiedSeconds, modifiedNanoseconds, info);
+	cache->mIsDirty = true;
+}
+
+bool AQHeaderCache_Save(struct AQHeaderCache * cache)
+{
+	std::lock_guard<std::mutex> lock(cache->mMutex);
+	
+	AQHeaderCache_Prune(cache);
+	
+	if (!cache->mIsDirty)
+	{
+		return true;
+	}
+	
+	size_t pathLength = strlen(cache->mPath);
+	char * temporaryPath = (char *) malloc(pathLength + 5);
+	UInt8 header[kHeaderCacheHeaderSize];
+	UInt8 fixed[kHeaderCacheEntrySize];
+	UInt32 k;
+	
+	memcpy(temporaryPath, cache->mPath, pathLength);
+	memcpy(temporaryPath + pathLength, ".tmp", 5);
+	
+	FILE * file = fopen(temporaryPath, "wb");
+	bool ok = file != NULL;
+	
+	memset(header, 0, sizeof(header));
+	memcpy(header, "AQHC", 4);
+	memcpy(header + 4, &kHeaderCacheVersion, 4);
+	memcpy(header + 8, &cache->mNumEntries, 4);
+	
+	ok = ok && fwrite(header, sizeof(header), 1, file) == 1;
+	
+	for (k = 0; k < cache->mNumSlots && ok; k++)
+	{
+		const struct AQHeaderCacheEntry * entry = &cache->mSlots[k];
+		
+		if (entry->mHash != 0)
+		{
+			UInt32 entryPathLength = (UInt32) strlen(entry->mPath);
+			
+			AQHeaderCache_PutEntry(fixed, entry, entryPathLength);
+			
+			ok = fwrite(fixed, sizeof(fixed), 1, file) == 1 &&
+				 fwrite(entry->mPath, 1, entryPathLength, file) == entryPathLength &&
+				 fwrite(entry->mInfo->mCookie, 1, entry->mInfo->mCookieSize, file) == entry->mInfo->mCookieSize;
+		}
+	}
+	
+	if (file)
+	{
+		ok = fclose(file) == 0 && ok;
+	}
+	
+	ok = ok && rename(temporaryPath, cache->mPath) == 0;
+	
+	if (!ok)
+	{
+		remove(temporaryPath);
+	}
+	
+	cache->mIsDirty = !ok;
+	
+	free(temporaryPath);
+	
+	return ok;
+}
+
+void AQHeaderCache_Close(struct AQHeaderCache * cache)
+{
+	AQArena_CleanUp(&cache->mArena);
+	free(cache->mSlots);
+	free(cache->mPath);
+	
+	delete cache;
+}
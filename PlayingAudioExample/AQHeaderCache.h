@@ -0,0 +1,79 @@
+//
+//  AQHeaderCache.h
+//  PlayingAudioExample
+//
+
+/* What opening a file finds out from its header, kept from one run to the
+ * next so that opening it again does not ask AudioFile for any of it: the
+ * stream format, the packet size bound and packet count (which for formats
+ * without a packet table mean reading the whole file), the duration and the
+ * magic cookie.
+ *
+ * Entries are keyed by the path realpath gives, so every way of naming a file
+ * finds the same one, and only match while the file has the size and
+ * modification time it had when they were stored, so a file that changes is
+ * simply parsed again. Lookups and stores are safe from any thread; the cache
+ * goes to disk in AQHeaderCache_Save, which first drops the entries of files
+ * that were deleted or changed since, and writes to a temporary file renamed
+ * over the old one, so a run that dies half way leaves the last complete cache.
+ */
+
+#ifndef AQHeaderCache_h
+#define AQHeaderCache_h
+
+#include "AQTypes.h"
+
+// Larger cookies are not cached, the file is asked for them instead
+static const UInt32 kAQHeaderInfoMaxCookieSize = 512;
+
+struct AQHeaderInfo
+{
+	/* Description:
+	 * The fields of the file's AudioStreamBasicDescription, in its order.
+	 */
+	Float64 mSampleRate;
+	UInt32 mFormatID;
+	UInt32 mFormatFlags;
+	UInt32 mBytesPerPacket;
+	UInt32 mFramesPerPacket;
+	UInt32 mBytesPerFrame;
+	UInt32 mChannelsPerFrame;
+	UInt32 mBitsPerChannel;
+	
+	/* Description:
+	 * The AudioFileTypeID, which lets the next open skip guessing the type.
+	 */
+	UInt32 mFileType;
+	
+	UInt32 mMaxPacketSize;
+	UInt64 mNumPackets;
+	Float64 mDuration;
+	
+	/* Description:
+	 * The magic cookie, 0 bytes when the format has none. mCookie only holds it
+	 * when mCookieSize is at most kAQHeaderInfoMaxCookieSize.
+	 */
+	UInt32 mCookieSize;
+	UInt8 mCookie[kAQHeaderInfoMaxCookieSize];
+};
+
+struct AQHeaderCache;
+
+// Loads the cache at path, or starts an empty one if there is none there or it cannot
+// be read; nothing is written until AQHeaderCache_Save
+struct AQHeaderCache * AQHeaderCache_Open(const char path[]);
+
+// Whether the cache holds filePath as it is on disk now, and if so its header in outInfo
+bool AQHeaderCache_Lookup(struct AQHeaderCache * cache, const char filePath[], struct AQHeaderInfo * outInfo);
+
+// Keeps info for filePath as it is on disk now. Does nothing for paths that are not
+// files, or for cookies over kAQHeaderInfoMaxCookieSize.
+void AQHeaderCache_Store(struct AQHeaderCache * cache, const char filePath[], const struct AQHeaderInfo * info);
+
+// Drops the entries of files deleted or changed since they were stored, then writes the
+// cache out if that or a store changed anything since it was opened or last saved
+bool AQHeaderCache_Save(struct AQHeaderCache * cache);
+
+void AQHeaderCache_Close(struct AQHeaderCache * cache);
+
+#endif /* AQHeaderCache_h */
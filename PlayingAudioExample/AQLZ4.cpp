@@ -0,0 +1,279 @@
+//
+//  AQLZ4.cpp
+//  PlayingAudioExample
+//
+
+#include "AQLZ4.h"
+
+#include <string.h>
+
+static const UInt32 kLZ4MinMatch = 4;
+
+// The last bytes of a block are always literals, and the last match starts this far before its end
+static const UInt32 kLZ4LastLiterals = 5;
+static const UInt32 kLZ4MatchFindLimit = 12;
+
+static const UInt32 kLZ4MaxOffset = 65535;
+
+// Positions of earlier four byte sequences, by hash
+static const UInt32 kLZ4HashBits = 12;
+
+static inline
+UInt32 AQLZ4_Read32(const UInt8 * p)
+{
+	UInt32 value;
+	
+	memcpy(&value, p, sizeof(value));
+	
+	return value;
+}
+
+static inline
+UInt32 AQLZ4_Hash(UInt32 sequence)
+{
+	return (sequence * 2654435761u) >> (32 - kLZ4HashBits);
+}
+
+// A length past the 15 its token holds: 255s, then the remainder
+static inline
+UInt8 * AQLZ4_WriteLength(UInt8 * op, UInt32 length)
+{
+	for (; length >= 255; length -= 255)
+	{
+		*op++ = 255;
+	}
+	
+	*op++ = (UInt8) length;
+	
+	return op;
+}
+
+// Writes literals from anchor up to ip, followed by a match of matchLength at offset unless
+// matchLength is 0. NULL if that would not fit before end.
+static
+UInt8 * AQLZ4_WriteSequence(UInt8 * op, UInt8 * end, const UInt8 * anchor, const UInt8 * ip, UInt32 offset, UInt32 matchLength)
+{
+	UInt32 numLiterals = (UInt32) (ip - anchor);
+	UInt32 matchCode = matchLength > 0 ? matchLength - kLZ4MinMatch : 0;
+	
+	if ((size_t) (end - op) < 1 + numLiterals / 255 + 1 + numLiterals + (matchLength > 0 ? 2 + matchCode / 255 + 1 : 0))
+	{
+		return NULL;
+	}
+	
+	UInt8 * token = op++;
+	
+	*token = (UInt8) ((numLiterals < 15 ? numLiterals : 15) << 4);
+	
+	if (numLiterals >= 15)
+	{
+		op = AQLZ4_WriteLength(op, numLiterals - 15);
+	}
+	
+	memcpy(op, anchor, numLiterals);
+	op += numLiterals;
+	
+	if (matchLength > 0)
+	{
+		*op++ = (UInt8) offset;
+		*op++ = (UInt8) (offset >> 8);
+		*token |= (UInt8) (matchCode < 15 ? matchCode : 15);
+		
+		if (matchCode >= 15)
+		{
+			op = AQLZ4_WriteLength(op, matchCode - 15);
+		}
+	}
+	
+	return op;
+}
+
+UInt32 AQLZ4_Compress(const void * in, UInt32 size, void * out, UInt32 capacity)
+{
+	const UInt8 * start = (const UInt8 *) in;
+	const UInt8 * end = start + size;
+	const UInt8 * ip = start;
+	const UInt8 * anchor = start;
+	UInt8 * op = (UInt8 *) out;
+	UInt8 * outEnd = op + capacity;
+	UInt32 table[1 << kLZ4HashBits];
+	
+	memset(table, 0, sizeof(table));
+	
+	if (size > kLZ4MatchFindLimit)
+	{
+		const UInt8 * matchFindEnd = end - kLZ4MatchFindLimit;
+		const UInt8 * matchEnd = end - kLZ4LastLiterals;
+		
+		while (ip <= matchFindEnd)
+		{
+			UInt32 sequence = AQLZ4_Read32(ip);
+			UInt32 hash = AQLZ4_Hash(sequence);
+			const UInt8 * match = start + table[hash];
+			
+			table[hash] = (UInt32) (ip - start);
+			
+			if (match >= ip || ip - match > kLZ4MaxOffset || AQLZ4_Read32(match) != sequence)
+			{
+				// Step further the longer nothing matches, as incompressible data does not
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+			
+			// Back over literals that match too, then forward as far as allowed
+			while (ip > anchor && match > start && ip[-1] == match[-1])
+			{
+				ip--;
+				match--;
+			}
+			
+			UInt32 matchLength = kLZ4MinMatch;
+			
+			while (ip + matchLength < matchEnd && ip[matchLength] == match[matchLength])
+			{
+				matchLength++;
+			}
+			
+			if (!(op = AQLZ4_WriteSequence(op, outEnd, anchor, ip, (UInt32) (ip - match), matchLength)))
+			{
+				return 0;
+			}
+			
+			ip += matchLength;
+			anchor = ip;
+			
+			// The position just before, for runs of repeats
+			if (ip <= matchFindEnd)
+			{
+				table[AQLZ4_Hash(AQLZ4_Read32(ip - 2))] = (UInt32) (ip - 2 - start);
+			}
+		}
+	}
+	
+	if (!(op = AQLZ4_WriteSequence(op, outEnd, anchor, end, 0, 0)))
+	{
+		return 0;
+	}
+	
+	return (UInt32) (op - (UInt8 *) out);
+}
+
+// A length past the 15 its token holds; false if the input ends first
+static inline
+bool AQLZ4_ReadLength(const UInt8 ** ip, const UInt8 * end, UInt32 * length)
+{
+	UInt32 byte;
+	
+	do
+	{
+		if (*ip == end)
+		{
+			return false;
+		}
+		
+		byte = *(*ip)++;
+		*length += byte;
+	}
+	while (byte == 255);
+	
+	return true;
+}
+
+UInt32 AQLZ4_Decompress(const void * in, UInt32 size, void * out, UInt32 capacity)
+{
+	const UInt8 * ip = (const UInt8 *) in;
+	const UInt8 * end = ip + size;
+	UInt8 * op = (UInt8 *) out;
+	UInt8 * outEnd = op + capacity;
+	
+	while (ip < end)
+	{
+		UInt32 token = *ip++;
+		UInt32 numLiterals = token >> 4;
+		
+		if (numLiterals == 15 && !AQLZ4_ReadLength(&ip, end, &numLiterals))
+		{
+			return 0;
+		}
+		
+		if (numLiterals > (size_t) (end - ip) || numLiterals > (size_t) (outEnd - op))
+		{
+			return 0;
+		}
+		
+		memcpy(op, ip, numLiterals);
+		op += numLiterals;
+		ip += numLiterals;
+		
+		// The last sequence has no match
+		if (ip == end)
+		{
+			break;
+		}
+		
+		if (end - ip < 2)
+		{
+			return 0;
+		}
+		
+		UInt32 offset = ip[0] | ip[1] << 8;
+		UInt32 matchLength = (token & 0x0f) + kLZ4MinMatch;
+		
+		ip += 2;
+		
+		if (offset == 0 || offset > (size_t) (op - (UInt8 *) out))
+		{
+			return 0;
+		}
+		
+		if ((token & 0x0f) == 15 && !AQLZ4_ReadLength(&ip, end, &matchLength))
+		{
+			return 0;
+		}
+		
+		if (matchLength > (size_t) (outEnd - op))
+		{
+			return 0;
+		}
+		
+		const UInt8 * match = op - offset;
+		
+		if (offset >= matchLength)
+		{
+			memcpy(op, match, matchLength);
+			op += matchLength;
+		}
+		else
+		{
+			// Overlapping: the match repeats every offset bytes, so it also repeats at the
+			// first multiple of offset of 8 or more, from which no 8 byte step reads what it
+			// has not written yet. Silence is runs like this.
+			UInt32 period = offset;
+			UInt32 k;
+
+			while (period < 8)
+			{
+				period += offset;
+			}
+
+			for (k = 0; k < period - offset && k < matchLength; k++)
+			{
+				op[k] = match[k];
+			}
+
+			for (; k + 8 <= matchLength; k += 8)
+			{
+				memcpy(op + k, op + k - period, 8);
+			}
+
+			for (; k < matchLength; k++)
+			{
+				op[k] = match[k];
+			}
+
+			op += matchLength;
+		}
+	}
+	
+	return (UInt32) (op - (UInt8 *) out);
+}
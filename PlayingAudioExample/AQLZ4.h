@@ -0,0 +1,34 @@
+//
+//  AQLZ4.h
+//  PlayingAudioExample
+//
+
+/* Compression in the LZ4 block format: literals and back references of at
+ * least four bytes within 64 KB, with no entropy coding, so that it
+ * decompresses at memory speed. The compressor is the greedy single-probe
+ * kind, fast rather than thorough; anything it writes decodes with the
+ * reference LZ4 library and the other way round.
+ */
+
+#ifndef AQLZ4_h
+#define AQLZ4_h
+
+#include "AQTypes.h"
+
+// Most a block of size bytes compresses to, for sizing the output
+static inline
+UInt32 AQLZ4_CompressBound(UInt32 size)
+{
+	return size + size / 255 + 16;
+}
+
+// Compresses size bytes of in and returns the compressed size, or 0 if it does not fit in
+// capacity bytes of out
+UInt32 AQLZ4_Compress(const void * in, UInt32 size, void * out, UInt32 capacity);
+
+// Decompresses size bytes of in and returns the decompressed size, or 0 if in is not a
+// valid block or would not fit in capacity bytes of out. Never reads or writes outside
+// the buffers, whatever in holds.
+UInt32 AQLZ4_Decompress(const void * in, UInt32 size, void * out, UInt32 capacity);
+
+#endif /* AQLZ4_h */
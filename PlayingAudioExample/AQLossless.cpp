@@ -0,0 +1,760 @@
+//
+//  AQLossless.cpp
+//  PlayingAudioExample
+//
+
+#include "AQLossless.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* A block is one byte of stereo mode, one byte of predictor order per channel,
+ * the byte size (UInt32) of the stream of every channel but the last, then the
+ * streams. A stream is bits, most significant first, of the channel's
+ * partitions in order, padded to a byte. A partition starts with its 5 bit
+ * Rice parameter, or kLosslessEscape followed by a 5 bit width when its
+ * residuals are stored as plain width bit numbers. Residuals are zigzag coded,
+ * and every channel is predicted from zeros before the block.
+ */
+
+enum AQLosslessStereo
+{
+	kAQLosslessStereo_Independent,
+	kAQLosslessStereo_LeftSide,
+	kAQLosslessStereo_SideRight,
+	kAQLosslessStereo_MidSide
+};
+
+static const UInt32 kLosslessMaxOrder = 3;
+static const UInt32 kLosslessMaxRiceParameter = 30;
+static const UInt32 kLosslessEscape = 31;
+
+struct AQLosslessWriter
+{
+	UInt8 * mPosition;
+	UInt8 * mEnd;
+	UInt64 mBits;
+	UInt32 mNumBits;
+	bool mIsFull;
+};
+
+/* Description:
+ * mBits holds mNumBits bits still to be read at the top, and whatever follows
+ * them below. Past the end of the input it is refilled with zeros, mNumPadBits
+ * of which are in mBits; reading into those means the input was too short.
+ */
+struct AQLosslessReader
+{
+	const UInt8 * mPosition;
+	const UInt8 * mEnd;
+	UInt64 mBits;
+	UInt32 mNumBits;
+	UInt32 mNumPadBits;
+};
+
+static inline
+UInt32 AQLossless_ZigZag(SInt32 value)
+{
+	return ((UInt32) value << 1) ^ (UInt32) (value >> 31);
+}
+
+// numBits up to 32
+static inline
+void AQLosslessWriter_Put(struct AQLosslessWriter * writer, UInt32 value, UInt32 numBits)
+{
+	writer->mBits = writer->mBits << numBits | value;
+	writer->mNumBits += numBits;
+	
+	while (writer->mNumBits >= 8)
+	{
+		writer->mNumBits -= 8;
+		
+		if (writer->mPosition == writer->mEnd)
+		{
+			writer->mIsFull = true;
+			return;
+		}
+		
+		*writer->mPosition++ = (UInt8) (writer->mBits >> writer->mNumBits);
+	}
+}
+
+static
+void AQLosslessWriter_PutRice(struct AQLosslessWriter * writer, UInt32 value, UInt32 parameter)
+{
+	UInt32 quotient = value >> parameter;
+	
+	for (; quotient >= 32; quotient -= 32)
+	{
+		AQLosslessWriter_Put(writer, 0, 32);
+	}
+	
+	AQLosslessWriter_Put(writer, 1, quotient + 1);
+	AQLosslessWriter_Put(writer, value & ((1u << parameter) - 1), parameter);
+}
+
+// Residuals of order predicting x from zeros before it, zigzag coded
+static
+void AQLossless_Residuals(const SInt32 * x, UInt32 numSamples, UInt32 order, UInt32 * residuals)
+{
+	SInt32 x1 = 0, x2 = 0, x3 = 0;
+	UInt32 k;
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		SInt32 prediction = order == 0 ? 0 : order == 1 ? x1 : order == 2 ? 2 * x1 - x2 : 3 * (x1 - x2) + x3;
+		
+		residuals[k] = AQLossless_ZigZag(x[k] - prediction);
+		
+		x3 = x2;
+		x2 = x1;
+		x1 = x[k];
+	}
+}
+
+// The order whose residuals add up to least, as an estimate of what it costs to code x
+static
+UInt32 AQLossless_ChooseOrder(const SInt32 * x, UInt32 numSamples, UInt64 * outCost)
+{
+	UInt64 sums[kLosslessMaxOrder + 1] = {0, 0, 0, 0};
+	SInt32 x1 = 0, x2 = 0, x3 = 0;
+	UInt32 order = 0;
+	UInt32 k;
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		SInt32 e0 = x[k];
+		SInt32 e1 = e0 - x1;
+		SInt32 e2 = e1 - (x1 - x2);
+		SInt32 e3 = e2 - (x1 - 2 * x2 + x3);
+		
+		sums[0] += (UInt32) abs(e0);
+		sums[1] += (UInt32) abs(e1);
+		sums[2] += (UInt32) abs(e2);
+		sums[3] += (UInt32) abs(e3);
+		
+		x3 = x2;
+		x2 = x1;
+		x1 = e0;
+	}
+	
+	for (k = 1; k <= kLosslessMaxOrder; k++)
+	{
+		if (sums[k] < sums[order])
+		{
+			order = k;
+		}
+	}
+	
+	*outCost = sums[order];
+	
+	return order;
+}
+
+// Rice codes a partition, or stores it plainly when that is smaller
+static
+void AQLossless_WritePartition(struct AQLosslessWriter * writer, const UInt32 * residuals, UInt32 numSamples)
+{
+	UInt64 sum = 0;
+	UInt32 maxResidual = 0;
+	UInt32 parameter = 0;
+	UInt32 k;
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		sum += residuals[k];
+		maxResidual |= residuals[k];
+	}
+	
+	// Start from about log2 of the mean and try either side of it
+	while (parameter < kLosslessMaxRiceParameter && ((UInt64) numSamples << (parameter + 1)) < sum)
+	{
+		parameter++;
+	}
+	
+	UInt32 first = parameter > 0 ? parameter - 1 : 0;
+	UInt32 last = parameter < kLosslessMaxRiceParameter ? parameter + 1 : parameter;
+	UInt64 bestCost = ~(UInt64) 0;
+	
+	for (UInt32 candidate = first; candidate <= last; candidate++)
+	{
+		UInt64 cost = (UInt64) numSamples * (candidate + 1);
+		
+		for (k = 0; k < numSamples; k++)
+		{
+			cost += residuals[k] >> candidate;
+		}
+		
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			parameter = candidate;
+		}
+	}
+	
+	UInt32 width = maxResidual ? 32 - __builtin_clz(maxResidual) : 0;
+	
+	if ((UInt64) numSamples * width + 5 < bestCost)
+	{
+		AQLosslessWriter_Put(writer, kLosslessEscape, 5);
+		AQLosslessWriter_Put(writer, width, 5);
+		
+		for (k = 0; k < numSamples; k++)
+		{
+			AQLosslessWriter_Put(writer, residuals[k], width);
+		}
+	}
+	else
+	{
+		AQLosslessWriter_Put(writer, parameter, 5);
+		
+		for (k = 0; k < numSamples; k++)
+		{
+			AQLosslessWriter_PutRice(writer, residuals[k], parameter);
+		}
+	}
+}
+
+bool AQLossless_CanCompress(const struct AQSampleLayout * layout)
+{
+	return (layout->mType == kAQSampleType_SInt16 || layout->mType == kAQSampleType_SInt24) &&
+		   !layout->mIsBigEndian &&
+		   layout->mIsInterleaved &&
+		   layout->mNumChannels > 0 &&
+		   layout->mNumChannels <= kAQLosslessMaxChannels;
+}
+
+UInt32 AQLossless_Compress(const void * frames, UInt32 numFrames, const struct AQSampleLayout * layout, void * out, UInt32 capacity)
+{
+	UInt32 numChannels = layout->mNumChannels;
+	UInt32 bytesPerSample = AQSampleConvert_BytesPerSample(layout->mType);
+	const UInt8 * in = (const UInt8 *) frames;
+	UInt32 orders[kAQLosslessMaxChannels];
+	UInt64 costs[kAQLosslessMaxChannels + 2];
+	UInt32 stereo = kAQLosslessStereo_Independent;
+	UInt32 c, k;
+	
+	if (!AQLossless_CanCompress(layout) || capacity < 1 + numChannels)
+	{
+		return 0;
+	}
+	
+	// Every channel, then mid and side for stereo, as 32 bit samples
+	SInt32 * signals = (SInt32 *) malloc((size_t) (numChannels + 2) * numFrames * sizeof(SInt32));
+	UInt32 * residuals = (UInt32 *) malloc((size_t) numChannels * numFrames * sizeof(UInt32));
+	const SInt32 * coded[kAQLosslessMaxChannels];
+	
+	for (k = 0; k < numFrames; k++)
+	{
+		for (c = 0; c < numChannels; c++)
+		{
+			const UInt8 * p = in + ((size_t) k * numChannels + c) * bytesPerSample;
+			
+			signals[(size_t) c * numFrames + k] = bytesPerSample == 2 ? (SInt16) (p[0] | p[1] << 8)
+																	  : (SInt32) ((UInt32) p[0] << 8 | (UInt32) p[1] << 16 | (UInt32) p[2] << 24) >> 8;
+		}
+	}
+	
+	for (c = 0; c < numChannels; c++)
+	{
+		coded[c] = signals + (size_t) c * numFrames;
+		orders[c] = AQLossless_ChooseOrder(coded[c], numFrames, &costs[c]);
+	}
+	
+	if (numChannels == 2)
+	{
+		SInt32 * mid = signals + 2 * (size_t) numFrames;
+		SInt32 * side = signals + 3 * (size_t) numFrames;
+		UInt32 midOrder, sideOrder;
+		
+		for (k = 0; k < numFrames; k++)
+		{
+			mid[k] = (coded[0][k] + coded[1][k]) >> 1;
+			side[k] = coded[0][k] - coded[1][k];
+		}
+		
+		midOrder = AQLossless_ChooseOrder(mid, numFrames, &costs[2]);
+		sideOrder = AQLossless_ChooseOrder(side, numFrames, &costs[3]);
+		
+		UInt64 bestCost = costs[0] + costs[1];
+		
+		if (costs[0] + costs[3] < bestCost)
+		{
+			bestCost = costs[0] + costs[3];
+			stereo = kAQLosslessStereo_LeftSide;
+		}
+		
+		if (costs[3] + costs[1] < bestCost)
+		{
+			bestCost = costs[3] + costs[1];
+			stereo = kAQLosslessStereo_SideRight;
+		}
+		
+		if (costs[2] + costs[3] < bestCost)
+		{
+			stereo = kAQLosslessStereo_MidSide;
+		}
+		
+		// Side goes where the channel it stands in for was, mid takes the left's place
+		if (stereo == kAQLosslessStereo_LeftSide)
+		{
+			coded[1] = side;
+			orders[1] = sideOrder;
+		}
+		else if (stereo == kAQLosslessStereo_SideRight)
+		{
+			coded[0] = side;
+			orders[0] = sideOrder;
+		}
+		else if (stereo == kAQLosslessStereo_MidSide)
+		{
+			coded[0] = mid;
+			orders[0] = midOrder;
+			coded[1] = side;
+			orders[1] = sideOrder;
+		}
+	}
+	
+	for (c = 0; c < numChannels; c++)
+	{
+		AQLossless_Residuals(coded[c], numFrames, orders[c], residuals + (size_t) c * numFrames);
+	}
+	
+	UInt8 * header = (UInt8 *) out;
+	UInt32 headerSize = 1 + numChannels + 4 * (numChannels - 1);
+	struct AQLosslessWriter writer;
+	
+	if (capacity < headerSize)
+	{
+		free(signals);
+		free(residuals);
+		return 0;
+	}
+	
+	header[0] = (UInt8) stereo;
+	
+	for (c = 0; c < numChannels; c++)
+	{
+		header[1 + c] = (UInt8) orders[c];
+	}
+	
+	writer.mPosition = header + headerSize;
+	writer.mEnd = header + capacity;
+	writer.mIsFull = false;
+	
+	for (c = 0; c < numChannels && !writer.mIsFull; c++)
+	{
+		UInt8 * stream = writer.mPosition;
+		
+		writer.mBits = 0;
+		writer.mNumBits = 0;
+		
+		for (k = 0; k < numFrames && !writer.mIsFull; k += kAQLosslessPartitionFrames)
+		{
+			UInt32 numSamples = numFrames - k < kAQLosslessPartitionFrames ? numFrames - k : kAQLosslessPartitionFrames;
+			
+			AQLossless_WritePartition(&writer, residuals + (size_t) c * numFrames + k, numSamples);
+		}
+		
+		if (writer.mNumBits > 0)
+		{
+			AQLosslessWriter_Put(&writer, 0, 8 - writer.mNumBits);
+		}
+		
+		if (c + 1 < numChannels)
+		{
+			UInt32 streamSize = (UInt32) (writer.mPosition - stream);
+			UInt8 * p = header + 1 + numChannels + 4 * c;
+			
+			p[0] = (UInt8) streamSize;
+			p[1] = (UInt8) (streamSize >> 8);
+			p[2] = (UInt8) (streamSize >> 16);
+			p[3] = (UInt8) (streamSize >> 24);
+		}
+	}
+	
+	free(signals);
+	free(residuals);
+	
+	return writer.mIsFull ? 0 : (UInt32) (writer.mPosition - header);
+}
+
+// The last bytes one at a time, then zeros
+static
+void AQLosslessReader_RefillSlow(struct AQLosslessReader * reader)
+{
+	while (reader->mNumBits < 56)
+	{
+		if (reader->mPosition < reader->mEnd)
+		{
+			reader->mBits |= (UInt64) *reader->mPosition++ << (56 - reader->mNumBits);
+		}
+		else
+		{
+			reader->mNumPadBits += 8;
+		}
+		
+		reader->mNumBits += 8;
+	}
+}
+
+// Tops mBits up to at least 56 bits, 8 bytes at a time while they are there
+static inline
+void AQLosslessReader_Refill(struct AQLosslessReader * reader)
+{
+	if (reader->mEnd - reader->mPosition < 8)
+	{
+		AQLosslessReader_RefillSlow(reader);
+		return;
+	}
+	
+	UInt64 next;
+	
+	memcpy(&next, reader->mPosition, sizeof(next));
+	next = __builtin_bswap64(next);
+	
+	// The bits of a byte only partly taken in are taken in again with it next time
+	reader->mBits |= next >> reader->mNumBits;
+	reader->mPosition += (63 - reader->mNumBits) >> 3;
+	reader->mNumBits |= 56;
+}
+
+static inline
+void AQLosslessReader_Skip(struct AQLosslessReader * reader, UInt32 numBits)
+{
+	reader->mBits <<= numBits;
+	reader->mNumBits -= numBits;
+}
+
+// numBits up to 32
+static inline
+UInt32 AQLosslessReader_Get(struct AQLosslessReader * reader, UInt32 numBits)
+{
+	AQLosslessReader_Refill(reader);
+	
+	UInt32 value = (UInt32) ((reader->mBits >> 32) >> (32 - numBits));
+	
+	AQLosslessReader_Skip(reader, numBits);
+	
+	return value;
+}
+
+// A Rice code whose quotient runs past what is in mBits
+static
+UInt32 AQLosslessReader_GetRiceSlow(struct AQLosslessReader * reader, UInt32 parameter)
+{
+	UInt32 quotient = 0;
+	
+	for (;;)
+	{
+		AQLosslessReader_Refill(reader);
+		
+		UInt32 numZeros = reader->mBits ? __builtin_clzll(reader->mBits) : 64;
+		
+		if (numZeros < reader->mNumBits)
+		{
+			quotient += numZeros;
+			AQLosslessReader_Skip(reader, numZeros + 1);
+			break;
+		}
+		
+		// Nothing left but padding, the input was cut short
+		if (reader->mNumBits <= reader->mNumPadBits)
+		{
+			return 0;
+		}
+		
+		quotient += reader->mNumBits;
+		AQLosslessReader_Skip(reader, reader->mNumBits);
+	}
+	
+	return quotient << parameter | AQLosslessReader_Get(reader, parameter);
+}
+
+static inline
+UInt32 AQLosslessReader_GetRice(struct AQLosslessReader * reader, UInt32 parameter)
+{
+	if (reader->mNumBits < 32)
+	{
+		AQLosslessReader_Refill(reader);
+	}
+	
+	UInt64 bits = reader->mBits;
+	UInt32 quotient = __builtin_clzll(bits | 1);
+	
+	// Both under 64, so the code fits in what is there
+	if (quotient + 1 + parameter > reader->mNumBits)
+	{
+		return AQLosslessReader_GetRiceSlow(reader, parameter);
+	}
+	
+	// One shift past the whole code keeps the chain from one code to the next short;
+	// the remainder comes off to the side
+	UInt32 length = quotient + 1 + parameter;
+	UInt32 remainder = (UInt32) (((bits << quotient << 1) >> 32) >> (32 - parameter));
+	
+	reader->mBits = bits << length;
+	reader->mNumBits -= length;
+	
+	return quotient << parameter | remainder;
+}
+
+static inline
+UInt32 AQLossless_UnZigZag(UInt32 code)
+{
+	return (code >> 1) ^ (0u - (code & 1));
+}
+
+// Adds the prediction of Order back to a residual, carrying the history along.
+// Unsigned, so that damaged input wraps rather than overflows.
+template <UInt32 Order>
+static inline
+UInt32 AQLossless_Restore(UInt32 residual, UInt32 * history)
+{
+	UInt32 prediction = Order == 0 ? 0
+					  : Order == 1 ? history[0]
+					  : Order == 2 ? 2 * history[0] - history[1]
+					  : 3 * (history[0] - history[1]) + history[2];
+	UInt32 value = residual + prediction;
+	
+	history[2] = history[1];
+	history[1] = history[0];
+	history[0] = value;
+	
+	return value;
+}
+
+template <UInt32 Order>
+static
+void AQLossless_DecodeRice(struct AQLosslessReader * reader, UInt32 parameter, UInt32 * history, SInt32 * out, UInt32 numSamples)
+{
+	// Local copies, which the compiler can keep in registers across the stores to out
+	struct AQLosslessReader local = *reader;
+	UInt32 state[3] = {history[0], history[1], history[2]};
+	UInt32 k;
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		out[k] = (SInt32) AQLossless_Restore<Order>(AQLossless_UnZigZag(AQLosslessReader_GetRice(&local, parameter)), state);
+	}
+	
+	*reader = local;
+	memcpy(history, state, sizeof(state));
+}
+
+// Two channels at once: every code and every sample depends on the one before it in
+// its channel, so taking turns between channels lets the processor work on both together
+template <UInt32 FirstOrder, UInt32 SecondOrder>
+static
+void AQLossless_DecodeRicePair(struct AQLosslessReader * readers, const UInt32 * parameters, UInt32 (*history)[3], SInt32 (*out)[kAQLosslessPartitionFrames], UInt32 numSamples)
+{
+	struct AQLosslessReader first = readers[0];
+	struct AQLosslessReader second = readers[1];
+	UInt32 firstState[3] = {history[0][0], history[0][1], history[0][2]};
+	UInt32 secondState[3] = {history[1][0], history[1][1], history[1][2]};
+	UInt32 k;
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		out[0][k] = (SInt32) AQLossless_Restore<FirstOrder>(AQLossless_UnZigZag(AQLosslessReader_GetRice(&first, parameters[0])), firstState);
+		out[1][k] = (SInt32) AQLossless_Restore<SecondOrder>(AQLossless_UnZigZag(AQLosslessReader_GetRice(&second, parameters[1])), secondState);
+	}
+	
+	readers[0] = first;
+	readers[1] = second;
+	memcpy(history[0], firstState, sizeof(firstState));
+	memcpy(history[1], secondState, sizeof(secondState));
+}
+
+template <UInt32 Order>
+static
+void AQLossless_DecodePlain(struct AQLosslessReader * reader, UInt32 width, UInt32 * history, SInt32 * out, UInt32 numSamples)
+{
+	UInt32 k;
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		out[k] = (SInt32) AQLossless_Restore<Order>(AQLossless_UnZigZag(width ? AQLosslessReader_Get(reader, width) : 0), history);
+	}
+}
+
+typedef void (*AQLosslessDecodeFunction)(struct AQLosslessReader * reader, UInt32 parameter, UInt32 * history, SInt32 * out, UInt32 numSamples);
+typedef void (*AQLosslessDecodePairFunction)(struct AQLosslessReader * readers, const UInt32 * parameters, UInt32 (*history)[3], SInt32 (*out)[kAQLosslessPartitionFrames], UInt32 numSamples);
+
+static const AQLosslessDecodeFunction kLosslessDecodeRice[kLosslessMaxOrder + 1] =
+{
+	AQLossless_DecodeRice<0>, AQLossless_DecodeRice<1>, AQLossless_DecodeRice<2>, AQLossless_DecodeRice<3>
+};
+
+static const AQLosslessDecodePairFunction kLosslessDecodeRicePair[kLosslessMaxOrder + 1][kLosslessMaxOrder + 1] =
+{
+	{AQLossless_DecodeRicePair<0, 0>, AQLossless_DecodeRicePair<0, 1>, AQLossless_DecodeRicePair<0, 2>, AQLossless_DecodeRicePair<0, 3>},
+	{AQLossless_DecodeRicePair<1, 0>, AQLossless_DecodeRicePair<1, 1>, AQLossless_DecodeRicePair<1, 2>, AQLossless_DecodeRicePair<1, 3>},
+	{AQLossless_DecodeRicePair<2, 0>, AQLossless_DecodeRicePair<2, 1>, AQLossless_DecodeRicePair<2, 2>, AQLossless_DecodeRicePair<2, 3>},
+	{AQLossless_DecodeRicePair<3, 0>, AQLossless_DecodeRicePair<3, 1>, AQLossless_DecodeRicePair<3, 2>, AQLossless_DecodeRicePair<3, 3>}
+};
+
+static const AQLosslessDecodeFunction kLosslessDecodePlain[kLosslessMaxOrder + 1] =
+{
+	AQLossless_DecodePlain<0>, AQLossless_DecodePlain<1>, AQLossless_DecodePlain<2>, AQLossless_DecodePlain<3>
+};
+
+// Undoes the stereo coding of a partition in place
+static
+void AQLossless_Unmix(UInt32 stereo, SInt32 * left, SInt32 * right, UInt32 numSamples)
+{
+	UInt32 k;
+	
+	if (stereo == kAQLosslessStereo_LeftSide)
+	{
+		for (k = 0; k < numSamples; k++)
+		{
+			right[k] = (SInt32) ((UInt32) left[k] - (UInt32) right[k]);
+		}
+	}
+	else if (stereo == kAQLosslessStereo_SideRight)
+	{
+		for (k = 0; k < numSamples; k++)
+		{
+			left[k] = (SInt32) ((UInt32) left[k] + (UInt32) right[k]);
+		}
+	}
+	else if (stereo == kAQLosslessStereo_MidSide)
+	{
+		for (k = 0; k < numSamples; k++)
+		{
+			// The bit mid lost is the low bit of side
+			UInt32 mid = (UInt32) left[k] << 1 | ((UInt32) right[k] & 1);
+			UInt32 side = (UInt32) right[k];
+			
+			left[k] = (SInt32) (mid + side) >> 1;
+			right[k] = (SInt32) (mid - side) >> 1;
+		}
+	}
+}
+
+template <UInt32 BytesPerSample>
+static
+void AQLossless_Interleave(SInt32 (*samples)[kAQLosslessPartitionFrames], UInt32 numChannels, UInt32 numSamples, UInt8 * out)
+{
+	UInt32 c, k;
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		for (c = 0; c < numChannels; c++)
+		{
+			UInt32 value = (UInt32) samples[c][k];
+			
+			out[0] = (UInt8) value;
+			out[1] = (UInt8) (value >> 8);
+			
+			if (BytesPerSample == 3)
+			{
+				out[2] = (UInt8) (value >> 16);
+			}
+			
+			out += BytesPerSample;
+		}
+	}
+}
+
+bool AQLossless_Decompress(const void * in, UInt32 size, void * frames, UInt32 numFrames, const struct AQSampleLayout * layout)
+{
+	UInt32 numChannels = layout->mNumChannels;
+	UInt32 bytesPerFrame = numChannels * AQSampleConvert_BytesPerSample(layout->mType);
+	const UInt8 * header = (const UInt8 *) in;
+	SInt32 samples[kAQLosslessMaxChannels][kAQLosslessPartitionFrames];
+	UInt32 history[kAQLosslessMaxChannels][3];
+	struct AQLosslessReader readers[kAQLosslessMaxChannels];
+	UInt32 parameters[kAQLosslessMaxChannels];
+	UInt32 c, k;
+	
+	if (!AQLossless_CanCompress(layout) || size < 1 + numChannels + 4 * (numChannels - 1))
+	{
+		return false;
+	}
+	
+	UInt32 stereo = header[0];
+	
+	if (stereo > kAQLosslessStereo_MidSide || (stereo != kAQLosslessStereo_Independent && numChannels != 2))
+	{
+		return false;
+	}
+	
+	const UInt8 * stream = header + 1 + numChannels + 4 * (numChannels - 1);
+	
+	for (c = 0; c < numChannels; c++)
+	{
+		const UInt8 * p = header + 1 + numChannels + 4 * c;
+		size_t remaining = (size_t) (header + size - stream);
+		size_t streamSize = c + 1 < numChannels ? (UInt32) (p[0] | p[1] << 8 | p[2] << 16 | (UInt32) p[3] << 24) : remaining;
+		
+		if (header[1 + c] > kLosslessMaxOrder || streamSize > remaining)
+		{
+			return false;
+		}
+		
+		readers[c].mPosition = stream;
+		readers[c].mEnd = stream + streamSize;
+		readers[c].mBits = 0;
+		readers[c].mNumBits = 0;
+		readers[c].mNumPadBits = 0;
+		stream += streamSize;
+	}
+	
+	memset(history, 0, sizeof(history));
+	
+	for (k = 0; k < numFrames; k += kAQLosslessPartitionFrames)
+	{
+		UInt32 numSamples = numFrames - k < kAQLosslessPartitionFrames ? numFrames - k : kAQLosslessPartitionFrames;
+		
+		for (c = 0; c < numChannels; c++)
+		{
+			parameters[c] = AQLosslessReader_Get(&readers[c], 5);
+		}
+		
+		for (c = 0; c < numChannels; c++)
+		{
+			UInt32 order = header[1 + c];
+			
+			if (parameters[c] == kLosslessEscape)
+			{
+				kLosslessDecodePlain[order](&readers[c], AQLosslessReader_Get(&readers[c], 5), history[c], samples[c], numSamples);
+			}
+			else if (c + 1 < numChannels && parameters[c + 1] != kLosslessEscape)
+			{
+				kLosslessDecodeRicePair[order][header[2 + c]](&readers[c], &parameters[c], &history[c], &samples[c], numSamples);
+				c++;
+			}
+			else
+			{
+				kLosslessDecodeRice[order](&readers[c], parameters[c], history[c], samples[c], numSamples);
+			}
+		}
+		
+		// Past the end of a stream already, whatever was decoded is not the block
+		for (c = 0; c < numChannels; c++)
+		{
+			if (readers[c].mNumBits < readers[c].mNumPadBits)
+			{
+				return false;
+			}
+		}
+		
+		if (numChannels == 2)
+		{
+			AQLossless_Unmix(stereo, samples[0], samples[1], numSamples);
+		}
+		
+		if (layout->mType == kAQSampleType_SInt16)
+		{
+			AQLossless_Interleave<2>(samples, numChannels, numSamples, (UInt8 *) frames + (size_t) k * bytesPerFrame);
+		}
+		else
+		{
+			AQLossless_Interleave<3>(samples, numChannels, numSamples, (UInt8 *) frames + (size_t) k * bytesPerFrame);
+		}
+	}
+	
+	return true;
+}
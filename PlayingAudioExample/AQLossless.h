@@ -0,0 +1,42 @@
+//
+//  AQLossless.h
+//  PlayingAudioExample
+//
+
+/* Lossless compression of blocks of integer PCM, built to decode at memory
+ * speed rather than to squeeze out the last percent: stereo is coded as
+ * left/side, side/right or mid/side when that is smaller, each channel is
+ * predicted by a fixed polynomial of order 0 to 3 (the ones FLAC has, with no
+ * coefficients to apply), and the residuals are Rice coded with a parameter
+ * per partition of kAQLosslessPartitionFrames frames.
+ *
+ * Every channel has a stream of its own, so the decoder can take two channels
+ * in turns and keep both dependency chains busy. It works through one
+ * partition of every channel at a time in a small buffer on the stack and
+ * interleaves it straight into the output, so decoding a block needs no memory
+ * of its own. Loudly mastered music comes out at about 75% of its size, where
+ * FLAC gets to about 65%, and decodes in about two thirds of AQFLAC's time.
+ */
+
+#ifndef AQLossless_h
+#define AQLossless_h
+
+#include "AQSampleConvert.h"
+
+static const UInt32 kAQLosslessMaxChannels = 8;
+static const UInt32 kAQLosslessPartitionFrames = 256;
+
+// Whether frames in layout can be compressed: interleaved little endian SInt16 or
+// SInt24 of up to kAQLosslessMaxChannels channels
+bool AQLossless_CanCompress(const struct AQSampleLayout * layout);
+
+// Compresses numFrames frames and returns the compressed size, or 0 if it does not fit
+// in capacity bytes of out
+UInt32 AQLossless_Compress(const void * frames, UInt32 numFrames, const struct AQSampleLayout * layout, void * out, UInt32 capacity);
+
+// Decompresses size bytes of in into exactly numFrames frames. False if in is not a
+// valid block of that many frames, which may leave frames partly written; never reads
+// or writes outside the buffers, whatever in holds.
+bool AQLossless_Decompress(const void * in, UInt32 size, void * frames, UInt32 numFrames, const struct AQSampleLayout * layout);
+
+#endif /* AQLossless_h */
@@ -0,0 +1,228 @@
+//
+//  AQLoudness.cpp
+//  PlayingAudioExample
+//
+
+#include "AQLoudness.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// BS.1770's offset from the log of the weighted mean square to LUFS
+static const Float64 kLoudnessOffset = -0.691;
+
+static const Float64 kAbsoluteGateLUFS = -70.0;
+static const Float64 kRelativeGateLU = -10.0;
+
+// Surround channels count for this much more than the front ones
+static const Float64 kSurroundWeight = 1.41;
+
+static
+Float64 AQLoudness_EnergyOf(Float64 lufs)
+{
+	return pow(10.0, (lufs - kLoudnessOffset) / 10.0);
+}
+
+static
+Float64 AQLoudness_LUFSOf(Float64 energy)
+{
+	return kLoudnessOffset + 10.0 * log10(energy);
+}
+
+// BS.1770's stages at sampleRate, from the analog prototypes its 48 kHz coefficients
+// come from, so that other rates measure the same
+static
+void AQLoudness_DesignKWeighting(Float64 sampleRate, struct AQBiquadCoefficients * outShelf, struct AQBiquadCoefficients * outHighPass)
+{
+	const Float64 shelfFrequency = 1681.974450955533;
+	const Float64 shelfGainDB = 3.999843853973347;
+	const Float64 shelfQ = 0.7071752369554196;
+	const Float64 highPassFrequency = 38.13547087602444;
+	const Float64 highPassQ = 0.5003270373238773;
+	
+	Float64 K = tan(M_PI * shelfFrequency / sampleRate);
+	Float64 Vh = pow(10.0, shelfGainDB / 20.0);
+	Float64 Vb = pow(Vh, 0.4996667741545416);
+	Float64 a0 = 1.0 + K / shelfQ + K * K;
+	
+	outShelf->mB0 = (Float32) ((Vh + Vb * K / shelfQ + K * K) / a0);
+	outShelf->mB1 = (Float32) (2.0 * (K * K - Vh) / a0);
+	outShelf->mB2 = (Float32) ((Vh - Vb * K / shelfQ + K * K) / a0);
+	outShelf->mA1 = (Float32) (2.0 * (K * K - 1.0) / a0);
+	outShelf->mA2 = (Float32) ((1.0 - K / shelfQ + K * K) / a0);
+	
+	K = tan(M_PI * highPassFrequency / sampleRate);
+	a0 = 1.0 + K / highPassQ + K * K;
+	
+	outHighPass->mB0 = 1.f;
+	outHighPass->mB1 = -2.f;
+	outHighPass->mB2 = 1.f;
+	outHighPass->mA1 = (Float32) (2.0 * (K * K - 1.0) / a0);
+	outHighPass->mA2 = (Float32) ((1.0 - K / highPassQ + K * K) / a0);
+}
+
+void AQLoudnessMeter_Init(struct AQLoudnessMeter * meter, UInt32 numChannels, Float64 sampleRate)
+{
+	UInt32 c;
+	
+	memset(meter, 0, sizeof(struct AQLoudnessMeter));
+	
+	meter->mNumChannels = numChannels;
+	meter->mSampleRate = sampleRate;
+	meter->mStepFrames = (UInt32) lrint(sampleRate / 10);
+	
+	AQLoudness_DesignKWeighting(sampleRate, &meter->mShelf, &meter->mHighPass);
+	
+	for (c = 0; c < numChannels; c++)
+	{
+		meter->mWeights[c] = 1.0;
+		
+		if (numChannels >= 6 && c == 3)
+		{
+			meter->mWeights[c] = 0.0;
+		}
+		else if (numChannels >= 6 && c >= 4)
+		{
+			meter->mWeights[c] = kSurroundWeight;
+		}
+	}
+}
+
+void AQLoudnessMeter_CleanUp(struct AQLoudnessMeter * meter)
+{
+	free(meter->mBlocks);
+	meter->mBlocks = NULL;
+}
+
+// Closes the 100 ms step, and with the three before it a 400 ms block
+static
+void AQLoudnessMeter_EndStep(struct AQLoudnessMeter * meter)
+{
+	if (meter->mNumSteps >= 3)
+	{
+		if (meter->mNumBlocks == meter->mBlockCapacity)
+		{
+			meter->mBlockCapacity = meter->mBlockCapacity ? 2 * meter->mBlockCapacity : 1024;
+			meter->mBlocks = (Float64 *) realloc(meter->mBlocks, meter->mBlockCapacity * sizeof(Float64));
+		}
+		
+		Float64 sum = meter->mPreviousSums[0] + meter->mPreviousSums[1] + meter->mPreviousSums[2] + meter->mStepSum;
+		
+		meter->mBlocks[meter->mNumBlocks++] = sum / (4.0 * meter->mStepFrames);
+	}
+	
+	meter->mPreviousSums[0] = meter->mPreviousSums[1];
+	meter->mPreviousSums[1] = meter->mPreviousSums[2];
+	meter->mPreviousSums[2] = meter->mStepSum;
+	meter->mStepSum = 0.0;
+	meter->mNumStepFrames = 0;
+	meter->mNumSteps++;
+}
+
+void AQLoudnessMeter_AddFrames(struct AQLoudnessMeter * meter, const Float32 * samples, UInt32 numFrames)
+{
+	const struct AQBiquadCoefficients * shelf = &meter->mShelf;
+	const struct AQBiquadCoefficients * highPass = &meter->mHighPass;
+	UInt32 numChannels = meter->mNumChannels;
+	Float32 peak = meter->mPeak;
+	UInt32 c, k;
+	
+	while (numFrames > 0)
+	{
+		UInt32 n = meter->mStepFrames - meter->mNumStepFrames;
+		
+		if (n > numFrames)
+		{
+			n = numFrames;
+		}
+		
+		// A channel at a time, so each keeps its filter state in registers
+		for (c = 0; c < numChannels; c++)
+		{
+			const Float32 * in = samples + c;
+			Float64 s1 = meter->mShelfZ[c][0];
+			Float64 s2 = meter->mShelfZ[c][1];
+			Float64 h1 = meter->mHighPassZ[c][0];
+			Float64 h2 = meter->mHighPassZ[c][1];
+			Float64 sumSquares = 0.0;
+			
+			for (k = 0; k < n; k++)
+			{
+				Float32 x = in[(size_t) k * numChannels];
+				Float32 magnitude = fabsf(x);
+				
+				peak = magnitude > peak ? magnitude : peak;
+				
+				Float64 y = shelf->mB0 * x + s1;
+				s1 = shelf->mB1 * x - shelf->mA1 * y + s2;
+				s2 = shelf->mB2 * x - shelf->mA2 * y;
+				
+				Float64 z = highPass->mB0 * y + h1;
+				h1 = highPass->mB1 * y - highPass->mA1 * z + h2;
+				h2 = highPass->mB2 * y - highPass->mA2 * z;
+				
+				sumSquares += z * z;
+			}
+			
+			meter->mShelfZ[c][0] = s1;
+			meter->mShelfZ[c][1] = s2;
+			meter->mHighPassZ[c][0] = h1;
+			meter->mHighPassZ[c][1] = h2;
+			meter->mStepSum += meter->mWeights[c] * sumSquares;
+		}
+		
+		samples += (size_t) n * numChannels;
+		numFrames -= n;
+		meter->mNumStepFrames += n;
+		
+		if (meter->mNumStepFrames == meter->mStepFrames)
+		{
+			AQLoudnessMeter_EndStep(meter);
+		}
+	}
+	
+	meter->mPeak = peak;
+}
+
+// Mean of the blocks louder than threshold, 0 if there are none
+static
+Float64 AQLoudnessMeter_GatedMean(const struct AQLoudnessMeter * meter, Float64 threshold)
+{
+	Float64 sum = 0.0;
+	UInt64 count = 0;
+	UInt64 k;
+	
+	for (k = 0; k < meter->mNumBlocks; k++)
+	{
+		if (meter->mBlocks[k] > threshold)
+		{
+			sum += meter->mBlocks[k];
+			count++;
+		}
+	}
+	
+	return count ? sum / count : 0.0;
+}
+
+Float64 AQLoudnessMeter_GetIntegrated(const struct AQLoudnessMeter * meter)
+{
+	Float64 absoluteGate = AQLoudness_EnergyOf(kAbsoluteGateLUFS);
+	Float64 mean = AQLoudnessMeter_GatedMean(meter, absoluteGate);
+	
+	if (mean == 0.0)
+	{
+		return -HUGE_VAL;
+	}
+	
+	Float64 relativeGate = AQLoudness_EnergyOf(AQLoudness_LUFSOf(mean) + kRelativeGateLU);
+	
+	mean = AQLoudnessMeter_GatedMean(meter, relativeGate > absoluteGate ? relativeGate : absoluteGate);
+	
+	return mean > 0.0 ? AQLoudness_LUFSOf(mean) : -HUGE_VAL;
+}
+
+Float64 AQLoudnessMeter_GetPeak(const struct AQLoudnessMeter * meter)
+{
+	return meter->mPeak > 0.f ? 20.0 * log10(meter->mPeak) : -HUGE_VAL;
+}
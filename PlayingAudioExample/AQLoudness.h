@@ -0,0 +1,76 @@
+//
+//  AQLoudness.h
+//  PlayingAudioExample
+//
+
+/* Integrated loudness and sample peak of a whole file, as ITU-R BS.1770
+ * (EBU R 128) measures it: the channels are K-weighted, a high shelf and a high
+ * pass, their mean squares are summed over 400 ms blocks that start every
+ * 100 ms, and the loudness is that of the blocks left after an absolute gate at
+ * -70 LUFS and a relative one 10 LU below the loudness of the blocks above the
+ * absolute gate.
+ *
+ * Channels are in the WAVE / SMPTE order AQChannelMap uses. From 5.1 up the
+ * LFE is left out and the surround channels weigh 1.41, everything else 1.
+ */
+
+#ifndef AQLoudness_h
+#define AQLoudness_h
+
+#include "AQEqualizer.h"
+
+static const UInt32 kAQLoudnessMaxChannels = 8;
+
+struct AQLoudnessMeter
+{
+	UInt32 mNumChannels;
+	Float64 mSampleRate;
+	
+	/* Description:
+	 * The K-weighting stages, with their transposed direct form II state per
+	 * channel kept in Float64 so the 38 Hz high pass does not drift.
+	 */
+	struct AQBiquadCoefficients mShelf;
+	struct AQBiquadCoefficients mHighPass;
+	Float64 mShelfZ[kAQLoudnessMaxChannels][2];
+	Float64 mHighPassZ[kAQLoudnessMaxChannels][2];
+	Float64 mWeights[kAQLoudnessMaxChannels];
+	
+	/* Description:
+	 * The 100 ms step being summed, mStepFrames frames long, and the weighted sums
+	 * of squares of the three before it, oldest first; a block is those four.
+	 */
+	UInt32 mStepFrames;
+	UInt32 mNumStepFrames;
+	Float64 mStepSum;
+	Float64 mPreviousSums[3];
+	UInt64 mNumSteps;
+	
+	/* Description:
+	 * Mean square of every block so far, grown with realloc.
+	 */
+	Float64 * mBlocks;
+	UInt64 mNumBlocks;
+	UInt64 mBlockCapacity;
+	
+	/* Description:
+	 * Largest absolute sample of any channel, before weighting.
+	 */
+	Float32 mPeak;
+};
+
+// numChannels is at most kAQLoudnessMaxChannels
+void AQLoudnessMeter_Init(struct AQLoudnessMeter * meter, UInt32 numChannels, Float64 sampleRate);
+
+void AQLoudnessMeter_CleanUp(struct AQLoudnessMeter * meter);
+
+// Adds interleaved float samples in [-1, 1]
+void AQLoudnessMeter_AddFrames(struct AQLoudnessMeter * meter, const Float32 * samples, UInt32 numFrames);
+
+// Gated loudness of the frames so far in LUFS, -HUGE_VAL when no block passes the gates
+Float64 AQLoudnessMeter_GetIntegrated(const struct AQLoudnessMeter * meter);
+
+// Sample peak of the frames so far in dBFS, -HUGE_VAL for silence
+Float64 AQLoudnessMeter_GetPeak(const struct AQLoudnessMeter * meter);
+
+#endif /* AQLoudness_h */
@@ -0,0 +1,115 @@
+//
+//  AQMDCT.cpp
+//  PlayingAudioExample
+//
+
+#include "AQMDCT.h"
+#include "AQSimd.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void AQMDCTPlan_Init(struct AQMDCTPlan * plan, UInt32 size)
+{
+	UInt32 n = size / 4;
+	UInt32 k;
+	
+	memset(plan, 0, sizeof(struct AQMDCTPlan));
+	
+	plan->mSize = size;
+	AQFFTPlan_Init(&plan->mFFT, n);
+	
+	plan->mTwiddleRe = (Float32 *) malloc(n * sizeof(Float32));
+	plan->mTwiddleIm = (Float32 *) malloc(n * sizeof(Float32));
+	plan->mRe = (Float32 *) malloc(n * sizeof(Float32));
+	plan->mIm = (Float32 *) malloc(n * sizeof(Float32));
+	plan->mDCT = (Float32 *) malloc(2 * n * sizeof(Float32));
+	
+	for (k = 0; k < n; k++)
+	{
+		Float64 theta = -M_PI * (k + 0.125) / (2 * n);
+		
+		plan->mTwiddleRe[k] = (Float32) cos(theta);
+		plan->mTwiddleIm[k] = (Float32) sin(theta);
+	}
+}
+
+void AQMDCTPlan_CleanUp(struct AQMDCTPlan * plan)
+{
+	AQFFTPlan_CleanUp(&plan->mFFT);
+	
+	free(plan->mTwiddleRe);
+	free(plan->mTwiddleIm);
+	free(plan->mRe);
+	free(plan->mIm);
+	free(plan->mDCT);
+	
+	memset(plan, 0, sizeof(struct AQMDCTPlan));
+}
+
+// In place, (re + i im) times the plan's twiddles
+static
+void AQMDCT_Twiddle(const struct AQMDCTPlan * plan, Float32 * re, Float32 * im)
+{
+	UInt32 n = plan->mSize / 4;
+	UInt32 k;
+	
+	for (k = 0; k < n; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 xr = AQFloat4_Load(re + k), xi = AQFloat4_Load(im + k);
+		AQFloat4 wr = AQFloat4_Load(plan->mTwiddleRe + k), wi = AQFloat4_Load(plan->mTwiddleIm + k);
+		
+		AQFloat4_Store(re + k, AQFloat4_Sub(AQFloat4_Mul(xr, wr), AQFloat4_Mul(xi, wi)));
+		AQFloat4_Store(im + k, AQFloat4_MulAdd(xr, wi, AQFloat4_Mul(xi, wr)));
+	}
+}
+
+// n = size / 4 is a power of two of at least 4, so every loop below runs whole vectors
+void AQMDCT_Inverse(struct AQMDCTPlan * plan, const Float32 * in, Float32 * out)
+{
+	UInt32 n = plan->mSize / 4;
+	UInt32 half = 2 * n;
+	Float32 * dct = plan->mDCT;
+	AQFloat4 zero = AQFloat4_Set1(0.f);
+	AQFloat4 unused;
+	UInt32 k;
+	
+	// Fold: in[2k] + i in[half - 1 - 2k]
+	for (k = 0; k < n; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 even, odd;
+		
+		AQFloat4_LoadDeinterleaved(in + 2 * k, &even, &unused);
+		AQFloat4_LoadDeinterleaved(in + half - 2 * AQ_SIMD_WIDTH - 2 * k, &unused, &odd);
+		
+		AQFloat4_Store(plan->mRe + k, even);
+		AQFloat4_Store(plan->mIm + k, AQFloat4_Reverse(odd));
+	}
+	
+	AQMDCT_Twiddle(plan, plan->mRe, plan->mIm);
+	AQFFT_Forward(&plan->mFFT, plan->mRe, plan->mIm);
+	AQMDCT_Twiddle(plan, plan->mRe, plan->mIm);
+	
+	// DCT-IV: dct[2k] = re[k], dct[half - 1 - 2k] = -im[k]
+	for (k = 0; k < n; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 im = AQFloat4_Load(plan->mIm + n - AQ_SIMD_WIDTH - k);
+		
+		AQFloat4_StoreInterleaved(dct + 2 * k, AQFloat4_Load(plan->mRe + k), AQFloat4_Reverse(AQFloat4_Sub(zero, im)));
+	}
+	
+	// Unfold: dct[n ... half - 1], then -dct reversed, then -dct[0 ... n - 1]
+	for (k = 0; k < n; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4_Store(out + k, AQFloat4_Load(dct + n + k));
+		AQFloat4_Store(out + 3 * n + k, AQFloat4_Sub(zero, AQFloat4_Load(dct + k)));
+	}
+	
+	for (k = 0; k < half; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 x = AQFloat4_Load(dct + half - AQ_SIMD_WIDTH - k);
+		
+		AQFloat4_Store(out + n + k, AQFloat4_Sub(zero, AQFloat4_Reverse(x)));
+	}
+}
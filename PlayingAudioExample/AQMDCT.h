@@ -0,0 +1,49 @@
+//
+//  AQMDCT.h
+//  PlayingAudioExample
+//
+
+/* Inverse MDCT through a complex FFT of a quarter of the block size.
+ *
+ * The size / 2 coefficients are folded into a size / 4 point complex
+ * sequence, twiddled, transformed with AQFFT and twiddled again into a
+ * size / 2 point DCT-IV, whose symmetries unfold into the size output samples.
+ * Folding, twiddles and unfolding run AQ_SIMD_WIDTH at a time like the FFT's
+ * own passes.
+ */
+
+#ifndef AQMDCT_h
+#define AQMDCT_h
+
+#include "AQFFT.h"
+
+struct AQMDCTPlan
+{
+	UInt32 mSize;
+	struct AQFFTPlan mFFT;
+	
+	/* Description:
+	 * exp(-i pi (k + 1/8) / (mSize / 2)) for k < mSize / 4, applied before and
+	 * after the FFT.
+	 */
+	Float32 * mTwiddleRe;
+	Float32 * mTwiddleIm;
+	
+	/* Description:
+	 * The folded sequence (mSize / 4 values each) and the DCT-IV (mSize / 2).
+	 */
+	Float32 * mRe;
+	Float32 * mIm;
+	Float32 * mDCT;
+};
+
+// size must be a power of two, at least 16
+void AQMDCTPlan_Init(struct AQMDCTPlan * plan, UInt32 size);
+
+void AQMDCTPlan_CleanUp(struct AQMDCTPlan * plan);
+
+// size / 2 coefficients in, size samples out, unnormalized:
+// out[n] = sum in[k] cos(2 pi / size (n + 1/2 + size / 4) (k + 1/2))
+void AQMDCT_Inverse(struct AQMDCTPlan * plan, const Float32 * in, Float32 * out);
+
+#endif /* AQMDCT_h */
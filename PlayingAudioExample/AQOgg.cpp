@@ -0,0 +1,338 @@
+//
+//  AQOgg.cpp
+//  PlayingAudioExample
+//
+
+#include "AQOgg.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+static const UInt32 kOggPageHeaderSize = 27;
+static const UInt8 kOggFlagContinued = 0x01;
+
+// The furthest the last page can start from the end of the file
+static const UInt32 kOggMaxPageSize = 27 + 255 + 255 * 255;
+
+struct AQOggCRCTable
+{
+	UInt32 mValues[256];
+};
+
+// CRC-32 with polynomial 0x04c11db7, not reflected, as the page checksum is defined
+static
+struct AQOggCRCTable AQOgg_MakeCRCTable()
+{
+	struct AQOggCRCTable table;
+	UInt32 k, bit;
+	
+	for (k = 0; k < 256; k++)
+	{
+		UInt32 r = k << 24;
+		
+		for (bit = 0; bit < 8; bit++)
+		{
+			r = r & 0x80000000 ? (r << 1) ^ 0x04c11db7 : r << 1;
+		}
+		
+		table.mValues[k] = r;
+	}
+	
+	return table;
+}
+
+static
+UInt32 AQOgg_UpdateCRC(UInt32 crc, const UInt8 * data, UInt32 size)
+{
+	static const struct AQOggCRCTable sTable = AQOgg_MakeCRCTable();
+	UInt32 k;
+	
+	for (k = 0; k < size; k++)
+	{
+		crc = (crc << 8) ^ sTable.mValues[(crc >> 24) ^ data[k]];
+	}
+	
+	return crc;
+}
+
+static
+UInt32 GetUInt32(const UInt8 * p)
+{
+	return (UInt32) p[0] | (UInt32) p[1] << 8 | (UInt32) p[2] << 16 | (UInt32) p[3] << 24;
+}
+
+static
+SInt64 GetSInt64(const UInt8 * p)
+{
+	return (SInt64) ((UInt64) GetUInt32(p) | (UInt64) GetUInt32(p + 4) << 32);
+}
+
+// Reads up to and including the next "OggS"; false at the end of the file
+static
+bool AQOggReader_FindCapturePattern(struct AQOggReader * reader)
+{
+	static const char kCapture[4] = { 'O', 'g', 'g', 'S' };
+	UInt32 numMatched = 0;
+	
+	while (numMatched < 4)
+	{
+		int c = fgetc(reader->mFile);
+		
+		if (c == EOF)
+		{
+			return false;
+		}
+		
+		if (c == kCapture[numMatched])
+		{
+			numMatched++;
+		}
+		else
+		{
+			numMatched = c == kCapture[0] ? 1 : 0;
+		}
+	}
+	
+	return true;
+}
+
+// Reads the next good page of the stream into the reader
+static
+bool AQOggReader_ReadPage(struct AQOggReader * reader)
+{
+	UInt8 header[kOggPageHeaderSize];
+	
+	while (AQOggReader_FindCapturePattern(reader))
+	{
+		UInt32 bodySize = 0;
+		UInt32 k;
+		
+		memcpy(header, "OggS", 4);
+		
+		if (fread(header + 4, 1, kOggPageHeaderSize - 4, reader->mFile) != kOggPageHeaderSize - 4)
+		{
+			return false;
+		}
+		
+		if (header[4] != 0)
+		{
+			continue;
+		}
+		
+		UInt32 numSegments = header[26];
+		
+		if (fread(reader->mSegmentTable, 1, numSegments, reader->mFile) != numSegments)
+		{
+			return false;
+		}
+		
+		for (k = 0; k < numSegments; k++)
+		{
+			bodySize += reader->mSegmentTable[k];
+		}
+		
+		if (fread(reader->mPageBody, 1, bodySize, reader->mFile) != bodySize)
+		{
+			return false;
+		}
+		
+		UInt32 expectedCRC = GetUInt32(header + 22);
+		UInt32 crc;
+		
+		memset(header + 22, 0, 4);
+		crc = AQOgg_UpdateCRC(0, header, kOggPageHeaderSize);
+		crc = AQOgg_UpdateCRC(crc, reader->mSegmentTable, numSegments);
+		crc = AQOgg_UpdateCRC(crc, reader->mPageBody, bodySize);
+		
+		if (crc != expectedCRC)
+		{
+			// Whatever of the packet came before is useless without this page
+			reader->mPacketSize = 0;
+			reader->mIsSkippingPacket = true;
+			continue;
+		}
+		
+		UInt32 serialNumber = GetUInt32(header + 14);
+		
+		if (!reader->mHasSerialNumber)
+		{
+			reader->mSerialNumber = serialNumber;
+			reader->mHasSerialNumber = true;
+		}
+		else if (serialNumber != reader->mSerialNumber)
+		{
+			continue;
+		}
+		
+		if (header[5] & kOggFlagContinued)
+		{
+			if (reader->mPacketSize == 0)
+			{
+				reader->mIsSkippingPacket = true;
+			}
+		}
+		else
+		{
+			// A packet left unfinished by the previous page is lost
+			reader->mPacketSize = 0;
+			reader->mIsSkippingPacket = false;
+		}
+		
+		reader->mNumSegments = numSegments;
+		reader->mSegmentIndex = 0;
+		reader->mPageBodyOffset = 0;
+		reader->mPageGranulePosition = GetSInt64(header + 6);
+		reader->mLastPacketSegment = -1;
+		
+		for (k = 0; k < numSegments; k++)
+		{
+			if (reader->mSegmentTable[k] < 255)
+			{
+				reader->mLastPacketSegment = k;
+			}
+		}
+		
+		return true;
+	}
+	
+	return false;
+}
+
+bool AQOggReader_Open(struct AQOggReader * reader, const char path[])
+{
+	memset(reader, 0, sizeof(struct AQOggReader));
+	
+	reader->mFile = fopen(path, "rb");
+	
+	if (!reader->mFile)
+	{
+		return false;
+	}
+	
+	reader->mPageBody = (UInt8 *) malloc(kAQOggMaxPageBodySize);
+	reader->mPacketCapacity = kAQOggMaxPageBodySize;
+	reader->mPacket = (UInt8 *) malloc(reader->mPacketCapacity);
+	
+	return true;
+}
+
+void AQOggReader_Close(struct AQOggReader * reader)
+{
+	if (reader->mFile)
+	{
+		fclose(reader->mFile);
+	}
+	
+	free(reader->mPageBody);
+	free(reader->mPacket);
+	
+	memset(reader, 0, sizeof(struct AQOggReader));
+}
+
+bool AQOggReader_ReadPacket(struct AQOggReader * reader, const UInt8 ** packet, UInt32 * size, SInt64 * granulePosition)
+{
+	for (;;)
+	{
+		while (reader->mSegmentIndex < reader->mNumSegments)
+		{
+			UInt32 k = reader->mSegmentIndex++;
+			UInt32 length = reader->mSegmentTable[k];
+			
+			if (!reader->mIsSkippingPacket)
+			{
+				if (reader->mPacketSize + length > reader->mPacketCapacity)
+				{
+					reader->mPacketCapacity *= 2;
+					reader->mPacket = (UInt8 *) realloc(reader->mPacket, reader->mPacketCapacity);
+				}
+				
+				memcpy(reader->mPacket + reader->mPacketSize, reader->mPageBody + reader->mPageBodyOffset, length);
+				reader->mPacketSize += length;
+			}
+			
+			reader->mPageBodyOffset += length;
+			
+			if (length == 255)
+			{
+				continue;
+			}
+			
+			if (reader->mIsSkippingPacket)
+			{
+				reader->mIsSkippingPacket = false;
+				reader->mPacketSize = 0;
+				continue;
+			}
+			
+			*packet = reader->mPacket;
+			*size = reader->mPacketSize;
+			*granulePosition = (SInt32) k == reader->mLastPacketSegment ? reader->mPageGranulePosition : -1;
+			
+			// The next packet is assembled over this one, which stays valid until then
+			reader->mPacketSize = 0;
+			
+			return true;
+		}
+		
+		if (reader->mIsAtEnd || !AQOggReader_ReadPage(reader))
+		{
+			reader->mIsAtEnd = true;
+			return false;
+		}
+	}
+}
+
+UInt64 AQOggReader_GetPageOffset(const struct AQOggReader * reader)
+{
+	return (UInt64) ftello(reader->mFile);
+}
+
+bool AQOggReader_SeekPage(struct AQOggReader * reader, UInt64 offset)
+{
+	reader->mNumSegments = 0;
+	reader->mSegmentIndex = 0;
+	reader->mPacketSize = 0;
+	reader->mIsSkippingPacket = false;
+	reader->mIsAtEnd = false;
+	
+	return fseeko(reader->mFile, (off_t) offset, SEEK_SET) == 0;
+}
+
+SInt64 AQOggReader_FindLastGranulePosition(struct AQOggReader * reader)
+{
+	off_t position = ftello(reader->mFile);
+	SInt64 granulePosition = -1;
+	
+	if (fseeko(reader->mFile, 0, SEEK_END) != 0)
+	{
+		return -1;
+	}
+	
+	off_t fileSize = ftello(reader->mFile);
+	off_t tailSize = fileSize < (off_t) kOggMaxPageSize ? fileSize : (off_t) kOggMaxPageSize;
+	UInt8 * tail = (UInt8 *) malloc((size_t) tailSize);
+	
+	if (fseeko(reader->mFile, fileSize - tailSize, SEEK_SET) == 0 &&
+		fread(tail, 1, (size_t) tailSize, reader->mFile) == (size_t) tailSize)
+	{
+		off_t k;
+		
+		// The last header of the stream that fits in the tail; a false match in
+		// the body of a page is unlikely to also carry the stream's serial number
+		for (k = 0; k + (off_t) kOggPageHeaderSize <= tailSize; k++)
+		{
+			if (memcmp(tail + k, "OggS", 4) == 0 && tail[k + 4] == 0 &&
+				GetUInt32(tail + k + 14) == reader->mSerialNumber &&
+				GetSInt64(tail + k + 6) != -1)
+			{
+				granulePosition = GetSInt64(tail + k + 6);
+			}
+		}
+	}
+	
+	free(tail);
+	fseeko(reader->mFile, position, SEEK_SET);
+	
+	return granulePosition;
+}
@@ -0,0 +1,73 @@
+//
+//  AQOgg.h
+//  PlayingAudioExample
+//
+
+/* Ogg page reader: reassembles the packets of the first logical stream in a
+ * file from its pages, across page boundaries. Pages whose CRC does not match
+ * are dropped along with the packet they were part of, and the reader
+ * resynchronizes on the next capture pattern.
+ */
+
+#ifndef AQOgg_h
+#define AQOgg_h
+
+#include <stdio.h>
+
+#include "AQTypes.h"
+
+static const UInt32 kAQOggMaxPageBodySize = 255 * 255;
+
+struct AQOggReader
+{
+	FILE * mFile;
+	
+	/* Description:
+	 * Serial number of the stream being read, taken from the first page.
+	 * Pages of other streams multiplexed into the file are skipped.
+	 */
+	UInt32 mSerialNumber;
+	bool mHasSerialNumber;
+	
+	/* Description:
+	 * The current page: its lacing values, the body they divide up, the next
+	 * segment to take and the last segment a packet ends on.
+	 */
+	UInt8 mSegmentTable[255];
+	UInt32 mNumSegments;
+	UInt32 mSegmentIndex;
+	SInt32 mLastPacketSegment;
+	UInt8 * mPageBody;
+	UInt32 mPageBodyOffset;
+	SInt64 mPageGranulePosition;
+	
+	/* Description:
+	 * The packet being assembled. mIsSkippingPacket drops the rest of one whose
+	 * beginning was lost to a bad page or a seek.
+	 */
+	UInt8 * mPacket;
+	UInt32 mPacketSize;
+	UInt32 mPacketCapacity;
+	bool mIsSkippingPacket;
+	
+	bool mIsAtEnd;
+};
+
+bool AQOggReader_Open(struct AQOggReader * reader, const char path[]);
+
+void AQOggReader_Close(struct AQOggReader * reader);
+
+// The next packet, valid until the next call. granulePosition is the page's when the
+// packet is the last one to end on its page, -1 otherwise. Returns false at the end of the stream.
+bool AQOggReader_ReadPacket(struct AQOggReader * reader, const UInt8 ** packet, UInt32 * size, SInt64 * granulePosition);
+
+// Byte offset of the next page, for AQOggReader_SeekPage
+UInt64 AQOggReader_GetPageOffset(const struct AQOggReader * reader);
+
+// Continues with the page at offset, dropping the packet being assembled
+bool AQOggReader_SeekPage(struct AQOggReader * reader, UInt64 offset);
+
+// Granule position of the stream's last page, -1 if there is none. Leaves the reader where it was.
+SInt64 AQOggReader_FindLastGranulePosition(struct AQOggReader * reader);
+
+#endif /* AQOgg_h */
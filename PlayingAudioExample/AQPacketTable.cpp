@@ -0,0 +1,258 @@
+//
+//  AQPacketTable.cpp
+//  PlayingAudioExample
+//
+
+#include "AQPacketTable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// A 64 bit varint takes at most 10 bytes, and a packet at most three of them
+static const size_t kAQPacketTableMaxPacketBytes = 30;
+
+static
+UInt8 * AQPacketTable_PutVarint(UInt8 * p, UInt64 value)
+{
+	while (value >= 0x80)
+	{
+		*p++ = (UInt8) (value | 0x80);
+		value >>= 7;
+	}
+	
+	*p++ = (UInt8) value;
+	
+	return p;
+}
+
+static
+const UInt8 * AQPacketTable_GetVarint(const UInt8 * p, UInt64 * outValue)
+{
+	UInt64 value = 0;
+	UInt32 shift = 0;
+	
+	while (*p & 0x80)
+	{
+		value |= (UInt64) (*p++ & 0x7F) << shift;
+		shift += 7;
+	}
+	
+	*outValue = value | (UInt64) *p++ << shift;
+	
+	return p;
+}
+
+void AQPacketTable_Init(struct AQPacketTable * table, UInt32 framesPerPacket)
+{
+	memset(table, 0, sizeof(struct AQPacketTable));
+	
+	table->mFramesPerPacket = framesPerPacket;
+}
+
+void AQPacketTable_CleanUp(struct AQPacketTable * table)
+{
+	free(table->mData);
+	free(table->mBlocks);
+	
+	memset(table, 0, sizeof(struct AQPacketTable));
+}
+
+void AQPacketTable_Append(struct AQPacketTable * table, SInt64 startOffset, UInt32 dataByteSize, UInt32 numFrames)
+{
+	if (table->mFramesPerPacket)
+	{
+		numFrames = table->mFramesPerPacket;
+	}
+	
+	if (table->mNumPackets % kAQPacketTablePacketsPerBlock == 0)
+	{
+		if (table->mNumBlocks == table->mBlockCapacity)
+		{
+			table->mBlockCapacity = table->mBlockCapacity ? table->mBlockCapacity * 2 : 16;
+			table->mBlocks = (struct AQPacketTableBlock *) realloc(table->mBlocks, table->mBlockCapacity * sizeof(struct AQPacketTableBlock));
+		}
+		
+		struct AQPacketTableBlock * block = &table->mBlocks[table->mNumBlocks++];
+		
+		block->mStartOffset = startOffset;
+		block->mStartFrame = table->mNumFrames;
+		block->mDataOffset = table->mDataSize;
+		
+		// The block knows where its first packet starts, so it never needs a gap
+		table->mNextOffset = startOffset;
+	}
+	
+	if (table->mDataCapacity - table->mDataSize < kAQPacketTableMaxPacketBytes)
+	{
+		table->mDataCapacity = table->mDataCapacity ? table->mDataCapacity * 2 : 1024;
+		table->mData = (UInt8 *) realloc(table->mData, table->mDataCapacity);
+	}
+	
+	UInt8 * p = table->mData + table->mDataSize;
+	SInt64 gap = startOffset - table->mNextOffset;
+	
+	p = AQPacketTable_PutVarint(p, (UInt64) dataByteSize << 1 | (gap != 0));
+	
+	if (gap != 0)
+	{
+		// Zigzag, so that a small step backwards stays small too
+		p = AQPacketTable_PutVarint(p, ((UInt64) gap << 1) ^ (UInt64) (gap >> 63));
+	}
+	
+	if (!table->mFramesPerPacket)
+	{
+		p = AQPacketTable_PutVarint(p, numFrames);
+	}
+	
+	table->mDataSize = p - table->mData;
+	table->mNextOffset = startOffset + dataByteSize;
+	table->mNumFrames += numFrames;
+	table->mNumPackets++;
+}
+
+void AQPacketTable_Trim(struct AQPacketTable * table)
+{
+	if (table->mDataSize > 0)
+	{
+		table->mData = (UInt8 *) realloc(table->mData, table->mDataSize);
+		table->mDataCapacity = table->mDataSize;
+	}
+	
+	if (table->mNumBlocks > 0)
+	{
+		table->mBlocks = (struct AQPacketTableBlock *) realloc(table->mBlocks, table->mNumBlocks * sizeof(struct AQPacketTableBlock));
+		table->mBlockCapacity = table->mNumBlocks;
+	}
+}
+
+// Decodes the packet at p, which starts where previous ended, and returns the position after it
+static
+const UInt8 * AQPacketTable_DecodePacket(const struct AQPacketTable * table,
+										 const UInt8 * p,
+										 const struct AQPacketInfo * previous,
+										 struct AQPacketInfo * outInfo)
+{
+	UInt64 sizeAndFlag;
+	UInt64 value;
+	
+	p = AQPacketTable_GetVarint(p, &sizeAndFlag);
+	
+	outInfo->mStartOffset = previous->mStartOffset + previous->mDataByteSize;
+	outInfo->mStartFrame = previous->mStartFrame + previous->mNumFrames;
+	outInfo->mDataByteSize = (UInt32) (sizeAndFlag >> 1);
+	outInfo->mNumFrames = table->mFramesPerPacket;
+	
+	if (sizeAndFlag & 1)
+	{
+		p = AQPacketTable_GetVarint(p, &value);
+		outInfo->mStartOffset += (SInt64) (value >> 1) ^ -(SInt64) (value & 1);
+	}
+	
+	if (!table->mFramesPerPacket)
+	{
+		p = AQPacketTable_GetVarint(p, &value);
+		outInfo->mNumFrames = (UInt32) value;
+	}
+	
+	return p;
+}
+
+bool AQPacketTable_Get(const struct AQPacketTable * table, UInt64 packet, struct AQPacketInfo * outInfo)
+{
+	return AQPacketTable_GetRange(table, packet, 1, outInfo) == 1;
+}
+
+UInt32 AQPacketTable_GetRange(const struct AQPacketTable * table, UInt64 firstPacket, UInt32 count, struct AQPacketInfo * outInfos)
+{
+	if (firstPacket >= table->mNumPackets)
+	{
+		return 0;
+	}
+	
+	if (count > table->mNumPackets - firstPacket)
+	{
+		count = (UInt32) (table->mNumPackets - firstPacket);
+	}
+	
+	// Decoding starts at the block holding firstPacket
+	UInt64 packet = firstPacket - firstPacket % kAQPacketTablePacketsPerBlock;
+	const UInt8 * p = NULL;
+	struct AQPacketInfo info;
+	UInt32 k = 0;
+	
+	for (; packet < firstPacket + count; packet++)
+	{
+		if (packet % kAQPacketTablePacketsPerBlock == 0)
+		{
+			const struct AQPacketTableBlock * block = &table->mBlocks[packet / kAQPacketTablePacketsPerBlock];
+			
+			// An empty packet ending where the block starts, for the first one to follow
+			p = table->mData + block->mDataOffset;
+			
+			info.mStartOffset = block->mStartOffset;
+			info.mStartFrame = block->mStartFrame;
+			info.mDataByteSize = 0;
+			info.mNumFrames = 0;
+		}
+		
+		p = AQPacketTable_DecodePacket(table, p, &info, &info);
+		
+		if (packet >= firstPacket)
+		{
+			outInfos[k++] = info;
+		}
+	}
+	
+	return k;
+}
+
+UInt64 AQPacketTable_FindPacket(const struct AQPacketTable * table, UInt64 frame)
+{
+	if (frame >= table->mNumFrames)
+	{
+		return table->mNumPackets;
+	}
+	
+	if (table->mFramesPerPacket)
+	{
+		return frame / table->mFramesPerPacket;
+	}
+	
+	// Last block starting at or before frame
+	UInt64 low = 0;
+	UInt64 high = table->mNumBlocks;
+	
+	while (high - low > 1)
+	{
+		UInt64 middle = low + (high - low) / 2;
+		
+		if (table->mBlocks[middle].mStartFrame <= frame)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	
+	struct AQPacketInfo infos[kAQPacketTablePacketsPerBlock];
+	UInt64 firstPacket = low * kAQPacketTablePacketsPerBlock;
+	UInt32 count = AQPacketTable_GetRange(table, firstPacket, kAQPacketTablePacketsPerBlock, infos);
+	UInt32 k;
+	
+	for (k = 0; k + 1 < count; k++)
+	{
+		if (frame < infos[k].mStartFrame + infos[k].mNumFrames)
+		{
+			break;
+		}
+	}
+	
+	return firstPacket + k;
+}
+
+size_t AQPacketTable_GetMemorySize(const struct AQPacketTable * table)
+{
+	return sizeof(struct AQPacketTable) + table->mDataCapacity + table->mBlockCapacity * sizeof(struct AQPacketTableBlock);
+}
@@ -0,0 +1,96 @@
+//
+//  AQPacketTable.h
+//  PlayingAudioExample
+//
+
+/* Whole-file packet table in a few bytes per packet instead of the 16 of an
+ * AudioStreamPacketDescription.
+ *
+ * Packets are grouped in blocks of kAQPacketTablePacketsPerBlock. The block
+ * index holds the byte offset, first frame and encoding position of each
+ * block; inside a block every packet is a varint of its size shifted left one
+ * bit, the low bit set when the packet does not start right where the previous
+ * one ended (a zigzag varint of the gap follows), then, for formats without a
+ * fixed frame count per packet, a varint of its frame count. Looking a packet
+ * up decodes at most one block.
+ */
+
+#ifndef AQPacketTable_h
+#define AQPacketTable_h
+
+#include <stddef.h>
+
+#include "AQTypes.h"
+
+static const UInt32 kAQPacketTablePacketsPerBlock = 64;
+
+struct AQPacketTableBlock
+{
+	SInt64 mStartOffset;
+	UInt64 mStartFrame;
+	
+	/* Description:
+	 * Position of the block's first packet in AQPacketTable::mData.
+	 */
+	UInt64 mDataOffset;
+};
+
+/* Description:
+ * One packet as decoded from the table.
+ */
+struct AQPacketInfo
+{
+	SInt64 mStartOffset;
+	UInt64 mStartFrame;
+	UInt32 mDataByteSize;
+	UInt32 mNumFrames;
+};
+
+struct AQPacketTable
+{
+	UInt64 mNumPackets;
+	UInt64 mNumFrames;
+	
+	/* Description:
+	 * Frames in every packet, or 0 when each packet stores its own count.
+	 */
+	UInt32 mFramesPerPacket;
+	
+	UInt8 * mData;
+	size_t mDataSize;
+	size_t mDataCapacity;
+	
+	struct AQPacketTableBlock * mBlocks;
+	UInt64 mNumBlocks;
+	UInt64 mBlockCapacity;
+	
+	/* Description:
+	 * Where the next appended packet is expected to start.
+	 */
+	SInt64 mNextOffset;
+};
+
+// framesPerPacket as in the file's AudioStreamBasicDescription, 0 for variable
+void AQPacketTable_Init(struct AQPacketTable * table, UInt32 framesPerPacket);
+
+void AQPacketTable_CleanUp(struct AQPacketTable * table);
+
+// numFrames is ignored when the table has a fixed frame count per packet
+void AQPacketTable_Append(struct AQPacketTable * table, SInt64 startOffset, UInt32 dataByteSize, UInt32 numFrames);
+
+// Gives back the memory reserved for appending
+void AQPacketTable_Trim(struct AQPacketTable * table);
+
+// Returns false if packet is past the end
+bool AQPacketTable_Get(const struct AQPacketTable * table, UInt64 packet, struct AQPacketInfo * outInfo);
+
+// Decodes count consecutive packets from firstPacket, returns the number that exist
+UInt32 AQPacketTable_GetRange(const struct AQPacketTable * table, UInt64 firstPacket, UInt32 count, struct AQPacketInfo * outInfos);
+
+// The packet that holds frame, or mNumPackets if frame is past the end
+UInt64 AQPacketTable_FindPacket(const struct AQPacketTable * table, UInt64 frame);
+
+// Bytes the table occupies, to compare with mNumPackets * sizeof(AudioStreamPacketDescription)
+size_t AQPacketTable_GetMemorySize(const struct AQPacketTable * table);
+
+#endif /* AQPacketTable_h */
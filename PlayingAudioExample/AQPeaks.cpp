@@ -0,0 +1,319 @@
+//
+//  AQPeaks.cpp
+//  PlayingAudioExample
+//
+
+#include "AQPeaks.h"
+#include "AQSimd.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static
+void AQPeaksAccumulator_Reset(struct AQPeaksAccumulator * acc)
+{
+	acc->mMin = 1.f;
+	acc->mMax = -1.f;
+	acc->mSumSquares = 0.0;
+	acc->mCount = 0;
+}
+
+static
+SInt16 AQPeaks_Quantize(Float64 x)
+{
+	x = x * 32767.0;
+	
+	if (x > 32767.0) return 32767;
+	if (x < -32767.0) return -32767;
+	
+	return (SInt16) lrint(x);
+}
+
+/* Folds the pending entry of level into one AQPeak per channel, appends it to
+ * the level and feeds it to the pending entry of the level above.
+ */
+static
+void AQPeaksBuilder_PushEntry(struct AQPeaksBuilder * builder, UInt32 level)
+{
+	UInt32 numChannels = builder->mNumChannels;
+	UInt32 c;
+	
+	if (builder->mLevelCount[level] == builder->mLevelCapacity[level])
+	{
+		builder->mLevelCapacity[level] = builder->mLevelCapacity[level] ? 2 * builder->mLevelCapacity[level] : 256;
+		builder->mLevels[level] = (struct AQPeak *) realloc(builder->mLevels[level],
+															 builder->mLevelCapacity[level] * numChannels * sizeof(struct AQPeak));
+	}
+	
+	struct AQPeak * entry = builder->mLevels[level] + builder->mLevelCount[level] * numChannels;
+	bool hasParent = level + 1 < kAQPeaksMaxLevels;
+	
+	for (c = 0; c < numChannels; c++)
+	{
+		struct AQPeaksAccumulator * acc = &builder->mPending[level][c];
+		Float64 meanSquare = acc->mCount ? acc->mSumSquares / acc->mCount : 0.0;
+		
+		entry[c].mMin = AQPeaks_Quantize(acc->mMin);
+		entry[c].mMax = AQPeaks_Quantize(acc->mMax);
+		entry[c].mRMS = AQPeaks_Quantize(sqrt(meanSquare));
+		
+		if (hasParent)
+		{
+			struct AQPeaksAccumulator * parent = &builder->mPending[level + 1][c];
+			
+			parent->mMin = acc->mMin < parent->mMin ? acc->mMin : parent->mMin;
+			parent->mMax = acc->mMax > parent->mMax ? acc->mMax : parent->mMax;
+			parent->mSumSquares += meanSquare;
+			parent->mCount++;
+		}
+		
+		AQPeaksAccumulator_Reset(acc);
+	}
+	
+	builder->mLevelCount[level]++;
+	
+	if (hasParent && builder->mPending[level + 1][0].mCount == kAQPeaksFanout)
+	{
+		AQPeaksBuilder_PushEntry(builder, level + 1);
+	}
+}
+
+void AQPeaksBuilder_Init(struct AQPeaksBuilder * builder, UInt32 numChannels, Float64 sampleRate)
+{
+	UInt32 level;
+	UInt32 c;
+	
+	memset(builder, 0, sizeof(struct AQPeaksBuilder));
+	
+	builder->mNumChannels = numChannels < kAQPeaksMaxChannels ? numChannels : kAQPeaksMaxChannels;
+	builder->mSampleRate = sampleRate;
+	
+	for (level = 0; level < kAQPeaksMaxLevels; level++)
+	{
+		for (c = 0; c < kAQPeaksMaxChannels; c++)
+		{
+			AQPeaksAccumulator_Reset(&builder->mPending[level][c]);
+		}
+	}
+}
+
+void AQPeaksBuilder_CleanUp(struct AQPeaksBuilder * builder)
+{
+	UInt32 level;
+	
+	for (level = 0; level < kAQPeaksMaxLevels; level++)
+	{
+		free(builder->mLevels[level]);
+	}
+	
+	memset(builder, 0, sizeof(struct AQPeaksBuilder));
+}
+
+/* Accumulates numFrames frames into the pending level 0 entry. With 1, 2 or 4
+ * channels the channel pattern repeats every vector, so whole vectors can be
+ * folded and the lanes split back into channels at the end.
+ */
+static
+void AQPeaksBuilder_Accumulate(struct AQPeaksBuilder * builder, const Float32 * samples, UInt32 numFrames)
+{
+	UInt32 numChannels = builder->mNumChannels;
+	UInt32 numSamples = numFrames * numChannels;
+	struct AQPeaksAccumulator * pending = builder->mPending[0];
+	UInt32 k = 0;
+	
+	if (AQ_SIMD_WIDTH % numChannels == 0 && numSamples >= AQ_SIMD_WIDTH)
+	{
+		AQFloat4 vMin = AQFloat4_Set1(1.f);
+		AQFloat4 vMax = AQFloat4_Set1(-1.f);
+		AQFloat4 vSumSquares = AQFloat4_Set1(0.f);
+		Float32 lanes[3][AQ_SIMD_WIDTH];
+		UInt32 lane;
+		
+		for (; k + AQ_SIMD_WIDTH <= numSamples; k += AQ_SIMD_WIDTH)
+		{
+			AQFloat4 x = AQFloat4_Load(samples + k);
+			
+			vMin = AQFloat4_Min(vMin, x);
+			vMax = AQFloat4_Max(vMax, x);
+			vSumSquares = AQFloat4_MulAdd(x, x, vSumSquares);
+		}
+		
+		AQFloat4_Store(lanes[0], vMin);
+		AQFloat4_Store(lanes[1], vMax);
+		AQFloat4_Store(lanes[2], vSumSquares);
+		
+		for (lane = 0; lane < AQ_SIMD_WIDTH; lane++)
+		{
+			struct AQPeaksAccumulator * acc = &pending[lane % numChannels];
+			
+			acc->mMin = lanes[0][lane] < acc->mMin ? lanes[0][lane] : acc->mMin;
+			acc->mMax = lanes[1][lane] > acc->mMax ? lanes[1][lane] : acc->mMax;
+			acc->mSumSquares += lanes[2][lane];
+		}
+	}
+	
+	for (; k < numSamples; k++)
+	{
+		struct AQPeaksAccumulator * acc = &pending[k % numChannels];
+		Float32 x = samples[k];
+		
+		acc->mMin = x < acc->mMin ? x : acc->mMin;
+		acc->mMax = x > acc->mMax ? x : acc->mMax;
+		acc->mSumSquares += x * x;
+	}
+	
+	for (k = 0; k < numChannels; k++)
+	{
+		pending[k].mCount += numFrames;
+	}
+}
+
+void AQPeaksBuilder_AddFrames(struct AQPeaksBuilder * builder, const Float32 * samples, UInt32 numFrames)
+{
+	while (numFrames > 0)
+	{
+		UInt32 n = kAQPeaksBaseFrames - builder->mPendingFrames;
+		
+		if (n > numFrames)
+		{
+			n = numFrames;
+		}
+		
+		AQPeaksBuilder_Accumulate(builder, samples, n);
+		
+		builder->mPendingFrames += n;
+		builder->mNumFrames += n;
+		samples += n * builder->mNumChannels;
+		numFrames -= n;
+		
+		if (builder->mPendingFrames == kAQPeaksBaseFrames)
+		{
+			AQPeaksBuilder_PushEntry(builder, 0);
+			builder->mPendingFrames = 0;
+		}
+	}
+}
+
+static
+UInt32 AQPeaksBuilder_Finish(struct AQPeaksBuilder * builder)
+{
+	UInt32 level;
+	
+	if (builder->mPendingFrames > 0)
+	{
+		AQPeaksBuilder_PushEntry(builder, 0);
+		builder->mPendingFrames = 0;
+	}
+	
+	// Close the partial entries until some level is down to a single entry
+	for (level = 1; level < kAQPeaksMaxLevels; level++)
+	{
+		if (builder->mLevelCount[level - 1] <= 1)
+		{
+			return level;
+		}
+		
+		if (builder->mPending[level][0].mCount > 0)
+		{
+			AQPeaksBuilder_PushEntry(builder, level);
+		}
+	}
+	
+	return kAQPeaksMaxLevels;
+}
+
+bool AQPeaksBuilder_Write(struct AQPeaksBuilder * builder, const char sidecarPath[])
+{
+	struct AQPeaksHeader header;
+	UInt64 offset = sizeof(struct AQPeaksHeader);
+	UInt32 level;
+	bool ok = true;
+	
+	memset(&header, 0, sizeof(header));
+	
+	header.mMagic = kAQPeaksMagic;
+	header.mVersion = kAQPeaksVersion;
+	header.mNumChannels = builder->mNumChannels;
+	header.mBaseFrames = kAQPeaksBaseFrames;
+	header.mFanout = kAQPeaksFanout;
+	header.mNumLevels = AQPeaksBuilder_Finish(builder);
+	header.mSampleRate = builder->mSampleRate;
+	header.mNumFrames = builder->mNumFrames;
+	
+	for (level = 0; level < header.mNumLevels; level++)
+	{
+		header.mLevelOffset[level] = offset;
+		header.mLevelCount[level] = builder->mLevelCount[level];
+		
+		offset += builder->mLevelCount[level] * builder->mNumChannels * sizeof(struct AQPeak);
+	}
+	
+	FILE * file = fopen(sidecarPath, "wb");
+	
+	if (!file)
+	{
+		return false;
+	}
+	
+	ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	
+	for (level = 0; ok && level < header.mNumLevels; level++)
+	{
+		size_t numValues = (size_t) (builder->mLevelCount[level] * builder->mNumChannels);
+		
+		ok = fwrite(builder->mLevels[level], sizeof(struct AQPeak), numValues, file) == numValues;
+	}
+	
+	return fclose(file) == 0 && ok;
+}
+
+bool AQPeaks_ReadHeader(FILE * file, struct AQPeaksHeader * outHeader)
+{
+	if (fseek(file, 0, SEEK_SET) != 0 || fread(outHeader, sizeof(struct AQPeaksHeader), 1, file) != 1)
+	{
+		return false;
+	}
+	
+	return outHeader->mMagic == kAQPeaksMagic &&
+		   outHeader->mVersion == kAQPeaksVersion &&
+		   outHeader->mNumLevels <= kAQPeaksMaxLevels &&
+		   outHeader->mNumChannels <= kAQPeaksMaxChannels;
+}
+
+UInt32 AQPeaks_ChooseLevel(const struct AQPeaksHeader * header, UInt64 numColumns)
+{
+	UInt32 level = header->mNumLevels;
+	
+	while (level-- > 0)
+	{
+		if (header->mLevelCount[level] >= numColumns)
+		{
+			return level;
+		}
+	}
+	
+	return 0;
+}
+
+bool AQPeaks_ReadEntries(FILE * file,
+						 const struct AQPeaksHeader * header,
+						 UInt32 level,
+						 UInt64 firstEntry,
+						 UInt64 count,
+						 struct AQPeak * out)
+{
+	UInt64 entrySize = header->mNumChannels * sizeof(struct AQPeak);
+	
+	if (level >= header->mNumLevels || firstEntry + count > header->mLevelCount[level])
+	{
+		return false;
+	}
+	
+	if (fseeko(file, (off_t) (header->mLevelOffset[level] + firstEntry * entrySize), SEEK_SET) != 0)
+	{
+		return false;
+	}
+	
+	return fread(out, (size_t) entrySize, (size_t) count, file) == count;
+}
@@ -0,0 +1,120 @@
+//
+//  AQPeaks.h
+//  PlayingAudioExample
+//
+
+/* Multi-resolution min / max / RMS summary of a file, for drawing waveforms
+ * without decoding the audio again.
+ *
+ * Level 0 has one entry per kAQPeaksBaseFrames frames, and every level above
+ * summarizes kAQPeaksFanout entries of the one below, down to a single entry.
+ * The sidecar file is a fixed header, a table of level offsets and then the
+ * entries of each level, so a reader only ever touches the level it draws.
+ * Everything is stored in host (little endian) byte order.
+ */
+
+#ifndef AQPeaks_h
+#define AQPeaks_h
+
+#include "AQTypes.h"
+
+#include <stdio.h>
+
+static const UInt32 kAQPeaksBaseFrames = 256;
+static const UInt32 kAQPeaksFanout = 4;
+static const UInt32 kAQPeaksMaxLevels = 24;
+static const UInt32 kAQPeaksMaxChannels = 8;
+
+// 'AQPK'
+static const UInt32 kAQPeaksMagic = 0x4B505141;
+static const UInt32 kAQPeaksVersion = 1;
+
+/* Description:
+ * One channel of one entry, in full-scale 16 bit units. This is also the on-disk layout.
+ */
+struct AQPeak
+{
+	SInt16 mMin;
+	SInt16 mMax;
+	SInt16 mRMS;
+};
+
+struct AQPeaksHeader
+{
+	UInt32 mMagic;
+	UInt32 mVersion;
+	UInt32 mNumChannels;
+	UInt32 mBaseFrames;
+	UInt32 mFanout;
+	UInt32 mNumLevels;
+	Float64 mSampleRate;
+	UInt64 mNumFrames;
+	
+	/* Description:
+	 * Byte offset of each level's entries from the start of the file, and their count.
+	 * Each entry holds mNumChannels AQPeak values.
+	 */
+	UInt64 mLevelOffset[kAQPeaksMaxLevels];
+	UInt64 mLevelCount[kAQPeaksMaxLevels];
+};
+
+/* Description:
+ * Accumulator for one channel of an entry still being built.
+ */
+struct AQPeaksAccumulator
+{
+	Float32 mMin;
+	Float32 mMax;
+	Float64 mSumSquares;
+	UInt64 mCount;
+};
+
+struct AQPeaksBuilder
+{
+	UInt32 mNumChannels;
+	Float64 mSampleRate;
+	UInt64 mNumFrames;
+	
+	/* Description:
+	 * Completed entries per level, mNumChannels AQPeak values each, grown with realloc.
+	 */
+	struct AQPeak * mLevels[kAQPeaksMaxLevels];
+	UInt64 mLevelCount[kAQPeaksMaxLevels];
+	UInt64 mLevelCapacity[kAQPeaksMaxLevels];
+	
+	/* Description:
+	 * The entry being built on each level. On level 0 mCount counts samples, above
+	 * it counts child entries and mSumSquares holds the sum of their mean squares.
+	 */
+	struct AQPeaksAccumulator mPending[kAQPeaksMaxLevels][kAQPeaksMaxChannels];
+	
+	/* Description:
+	 * Frames already in the level 0 entry being built.
+	 */
+	UInt32 mPendingFrames;
+};
+
+void AQPeaksBuilder_Init(struct AQPeaksBuilder * builder, UInt32 numChannels, Float64 sampleRate);
+
+void AQPeaksBuilder_CleanUp(struct AQPeaksBuilder * builder);
+
+// Adds interleaved float samples in [-1, 1]
+void AQPeaksBuilder_AddFrames(struct AQPeaksBuilder * builder, const Float32 * samples, UInt32 numFrames);
+
+// Flushes the partial entries and writes the sidecar; returns false on I/O errors
+bool AQPeaksBuilder_Write(struct AQPeaksBuilder * builder, const char sidecarPath[]);
+
+bool AQPeaks_ReadHeader(FILE * file, struct AQPeaksHeader * outHeader);
+
+// Coarsest level with at least numColumns entries, or level 0 if there is none
+UInt32 AQPeaks_ChooseLevel(const struct AQPeaksHeader * header, UInt64 numColumns);
+
+// Reads count entries of a level starting at firstEntry into out (count * mNumChannels values)
+bool AQPeaks_ReadEntries(FILE * file,
+						 const struct AQPeaksHeader * header,
+						 UInt32 level,
+						 UInt64 firstEntry,
+						 UInt64 count,
+						 struct AQPeak * out);
+
+#endif /* AQPeaks_h */
@@ -0,0 +1,192 @@
+//
+//  AQPerfCounters.cpp
+//  PlayingAudioExample
+//
+
+#include "AQPerfCounters.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static
+UInt64 AQPerfCounters_Now()
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return (UInt64) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+const char * AQPerfEvent_Name(AQPerfEvent event)
+{
+	switch (event)
+	{
+		case kAQPerfEvent_Cycles:		return "cycles";
+		case kAQPerfEvent_Instructions:	return "instructions";
+		case kAQPerfEvent_CacheMisses:	return "cache-misses";
+		case kAQPerfEvent_BranchMisses:	return "branch-misses";
+		default:						return "?";
+	}
+}
+
+#ifdef __linux__
+
+static const UInt64 kAQPerfEventConfigs[kAQPerfNumEvents] =
+{
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static
+int AQPerfCounters_OpenEvent(UInt64 config, int groupFD)
+{
+	struct perf_event_attr attr;
+	
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = groupFD == -1;
+	
+	// User space only, which is all an unprivileged process may count anyway
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	
+	return (int) syscall(__NR_perf_event_open, &attr, 0, -1, groupFD, 0);
+}
+
+bool AQPerfCounters_Open(struct AQPerfCounters * counters)
+{
+	UInt32 k;
+	
+	counters->mGroupFD = -1;
+	counters->mStartNanos = 0;
+	
+	for (k = 0; k < kAQPerfNumEvents; k++)
+	{
+		counters->mFDs[k] = AQPerfCounters_OpenEvent(kAQPerfEventConfigs[k], counters->mGroupFD);
+		
+		if (counters->mFDs[k] >= 0 && counters->mGroupFD == -1)
+		{
+			counters->mGroupFD = counters->mFDs[k];
+		}
+	}
+	
+	return counters->mGroupFD != -1;
+}
+
+void AQPerfCounters_Close(struct AQPerfCounters * counters)
+{
+	UInt32 k;
+	
+	for (k = 0; k < kAQPerfNumEvents; k++)
+	{
+		if (counters->mFDs[k] >= 0)
+		{
+			close(counters->mFDs[k]);
+			counters->mFDs[k] = -1;
+		}
+	}
+	
+	counters->mGroupFD = -1;
+}
+
+void AQPerfCounters_Start(struct AQPerfCounters * counters)
+{
+	if (counters->mGroupFD != -1)
+	{
+		ioctl(counters->mGroupFD, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(counters->mGroupFD, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+	
+	counters->mStartNanos = AQPerfCounters_Now();
+}
+
+void AQPerfCounters_Stop(struct AQPerfCounters * counters, struct AQPerfSample * outSample)
+{
+	UInt32 k;
+	
+	outSample->mNanos = AQPerfCounters_Now() - counters->mStartNanos;
+	
+	if (counters->mGroupFD != -1)
+	{
+		ioctl(counters->mGroupFD, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	}
+	
+	for (k = 0; k < kAQPerfNumEvents; k++)
+	{
+		// value, time enabled, time running
+		UInt64 values[3];
+		
+		outSample->mCounts[k] = 0;
+		outSample->mIsValid[k] = false;
+		
+		if (counters->mFDs[k] < 0 || read(counters->mFDs[k], values, sizeof(values)) != sizeof(values) || values[2] == 0)
+		{
+			continue;
+		}
+		
+		outSample->mCounts[k] = values[2] < values[1] ? (UInt64) ((Float64) values[0] * values[1] / values[2]) : values[0];
+		outSample->mIsValid[k] = true;
+	}
+}
+
+#else
+
+bool AQPerfCounters_Open(struct AQPerfCounters * counters)
+{
+	UInt32 k;
+	
+	for (k = 0; k < kAQPerfNumEvents; k++)
+	{
+		counters->mFDs[k] = -1;
+	}
+	
+	counters->mGroupFD = -1;
+	counters->mStartNanos = 0;
+	
+	return false;
+}
+
+void AQPerfCounters_Close(struct AQPerfCounters * counters)
+{
+}
+
+void AQPerfCounters_Start(struct AQPerfCounters * counters)
+{
+	counters->mStartNanos = AQPerfCounters_Now();
+}
+
+void AQPerfCounters_Stop(struct AQPerfCounters * counters, struct AQPerfSample * outSample)
+{
+	outSample->mNanos = AQPerfCounters_Now() - counters->mStartNanos;
+	
+	memset(outSample->mCounts, 0, sizeof(outSample->mCounts));
+	memset(outSample->mIsValid, 0, sizeof(outSample->mIsValid));
+}
+
+#endif
+
+void AQPerfSample_Accumulate(struct AQPerfSample * sum, const struct AQPerfSample * in)
+{
+	UInt32 k;
+	
+	sum->mNanos += in->mNanos;
+	
+	for (k = 0; k < kAQPerfNumEvents; k++)
+	{
+		sum->mCounts[k] += in->mCounts[k];
+		sum->mIsValid[k] = sum->mIsValid[k] && in->mIsValid[k];
+	}
+}
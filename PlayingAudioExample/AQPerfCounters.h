@@ -0,0 +1,65 @@
+//
+//  AQPerfCounters.h
+//  PlayingAudioExample
+//
+
+/* Hardware event counts for the calling thread, to tell a memory-bound stage
+ * from a compute-bound one. On Linux they come from perf_event_open; anywhere
+ * else, or when the kernel refuses (no PMU in a VM, perf_event_paranoid too
+ * high), the counters are simply unavailable and only wall time is measured.
+ */
+
+#ifndef AQPerfCounters_h
+#define AQPerfCounters_h
+
+#include "AQTypes.h"
+
+enum AQPerfEvent
+{
+	kAQPerfEvent_Cycles,
+	kAQPerfEvent_Instructions,
+	kAQPerfEvent_CacheMisses,
+	kAQPerfEvent_BranchMisses,
+	
+	kAQPerfNumEvents
+};
+
+/* Description:
+ * Counts between AQPerfCounters_Start and AQPerfCounters_Stop. An event the host
+ * could not count is left out of mIsValid; counts are scaled up when the kernel
+ * had to multiplex the counters.
+ */
+struct AQPerfSample
+{
+	UInt64 mNanos;
+	UInt64 mCounts[kAQPerfNumEvents];
+	bool mIsValid[kAQPerfNumEvents];
+};
+
+struct AQPerfCounters
+{
+	/* Description:
+	 * One descriptor per event, -1 for those that could not be opened. The first
+	 * one opened leads the group so they all start and stop together.
+	 */
+	int mFDs[kAQPerfNumEvents];
+	int mGroupFD;
+	
+	UInt64 mStartNanos;
+};
+
+// Returns false if no hardware event could be opened; the counters still time
+bool AQPerfCounters_Open(struct AQPerfCounters * counters);
+
+void AQPerfCounters_Close(struct AQPerfCounters * counters);
+
+void AQPerfCounters_Start(struct AQPerfCounters * counters);
+
+void AQPerfCounters_Stop(struct AQPerfCounters * counters, struct AQPerfSample * outSample);
+
+// Adds in to sum, an event stays valid only if it was valid in both
+void AQPerfSample_Accumulate(struct AQPerfSample * sum, const struct AQPerfSample * in);
+
+const char * AQPerfEvent_Name(AQPerfEvent event);
+
+#endif /* AQPerfCounters_h */
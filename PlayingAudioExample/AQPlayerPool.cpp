@@ -0,0 +1,180 @@
+//
+//  AQPlayerPool.cpp
+//  PlayingAudioExample
+//
+
+#include "AQPlayerPool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static
+void AQPlayerPool_DisposePlayer(struct AQPlayerState * player)
+{
+	AQPlayerState_CleanUp(player);
+	free(player);
+}
+
+// Index of the most recently returned idle player for format, or -1
+static
+SInt32 AQPlayerPool_FindIdle(struct AQPlayerPool * pool, const AudioStreamBasicDescription * format)
+{
+	SInt32 k;
+	
+	for (k = (SInt32) pool->mNumIdle - 1; k >= 0; k--)
+	{
+		if (memcmp(&pool->mIdle[k]->mDataFormat, format, sizeof(AudioStreamBasicDescription)) == 0)
+		{
+			return k;
+		}
+	}
+	
+	return -1;
+}
+
+void AQPlayerPool_Init(struct AQPlayerPool * pool, struct AQThreadPool * threadPool, UInt32 maxIdle)
+{
+	pool->mThreadPool = threadPool;
+	pool->mFastStartSeconds = 0;
+	pool->mHeaderCache = NULL;
+	pool->mIdle = (struct AQPlayerState **) malloc(maxIdle * sizeof(struct AQPlayerState *));
+	pool->mNumIdle = 0;
+	pool->mNumRecycling = 0;
+	pool->mMaxIdle = maxIdle;
+	pool->mNumHits = 0;
+	pool->mNumMisses = 0;
+	
+	pthread_mutex_init(&pool->mMutex, NULL);
+}
+
+struct AQPlayerState * AQPlayerPool_CheckOut(struct AQPlayerPool * pool, const char path[])
+{
+	UInt64 requestNanos = GetMonotonicNanos();
+	AudioStreamBasicDescription format;
+	struct AQHeaderInfo header;
+	AudioFileID audioFile;
+	struct AQPlayerState * player = NULL;
+	
+	if (OpenAudioFileWithHeader(path, pool->mHeaderCache, &audioFile, &header) != noErr)
+	{
+		return NULL;
+	}
+	
+	FillFormatFromHeader(&format, &header);
+	
+	pthread_mutex_lock(&pool->mMutex);
+	
+	SInt32 index = AQPlayerPool_FindIdle(pool, &format);
+	
+	if (index >= 0)
+	{
+		player = pool->mIdle[index];
+		pool->mIdle[index] = pool->mIdle[--pool->mNumIdle];
+		pool->mNumHits++;
+	}
+	else
+	{
+		pool->mNumMisses++;
+	}
+	
+	pthread_mutex_unlock(&pool->mMutex);
+	
+	if (player)
+	{
+		player->mFastStartSeconds = pool->mFastStartSeconds;
+		AQPlayerState_Retarget(player, audioFile, &header);
+	}
+	else
+	{
+		player = (struct AQPlayerState *) calloc(1, sizeof(struct AQPlayerState));
+		
+		AQPlayerState_SetThreadPool(player, pool->mThreadPool);
+		AQPlayerState_SetHeaderCache(player, pool->mHeaderCache);
+		player->mFastStartSeconds = pool->mFastStartSeconds;
+		
+		if (AQPlayerState_InitializeWithAudioFile(player, audioFile, &header) != noErr)
+		{
+			fprintf(stderr, "Error: no queue for %s\n", path);
+			CloseAudioFile(audioFile);
+			free(player);
+			return NULL;
+		}
+	}
+	
+	// Time to first sample counts the file open too
+	player->mInitializeNanos = requestNanos;
+	
+	return player;
+}
+
+void AQPlayerPool_Return(struct AQPlayerPool * pool, struct AQPlayerState * player)
+{
+	pthread_mutex_lock(&pool->mMutex);
+	
+	bool keep = !player->mDecodeToPCM && pool->mNumIdle + pool->mNumRecycling < pool->mMaxIdle;
+	
+	if (keep)
+	{
+		pool->mNumRecycling++;
+	}
+	
+	pthread_mutex_unlock(&pool->mMutex);
+	
+	if (!keep)
+	{
+		AQPlayerPool_DisposePlayer(player);
+		return;
+	}
+	
+	// Stopping the queue waits for it, so only the slot is held under the lock
+	AQPlayerState_Recycle(player);
+	
+	pthread_mutex_lock(&pool->mMutex);
+	pool->mNumRecycling--;
+	pool->mIdle[pool->mNumIdle++] = player;
+	pthread_mutex_unlock(&pool->mMutex);
+}
+
+void AQPlayerPool_Prewarm(struct AQPlayerPool * pool, const char path[], UInt32 count)
+{
+	struct AQPlayerState ** players = (struct AQPlayerState **) malloc(count * sizeof(struct AQPlayerState *));
+	UInt32 k;
+	
+	// Check them all out before returning any, so that each one is a new player
+	for (k = 0; k < count; k++)
+	{
+		players[k] = AQPlayerPool_CheckOut(pool, path);
+		
+		if (!players[k])
+		{
+			break;
+		}
+	}
+	
+	while (k > 0)
+	{
+		AQPlayerPool_Return(pool, players[--k]);
+	}
+	
+	free(players);
+}
+
+void AQPlayerPool_CleanUp(struct AQPlayerPool * pool)
+{
+	UInt32 k;
+	
+	printf("Player pool: %llu check outs reused a player, %llu created one\n",
+		   (unsigned long long) pool->mNumHits, (unsigned long long) pool->mNumMisses);
+	
+	for (k = 0; k < pool->mNumIdle; k++)
+	{
+		AQPlayerPool_DisposePlayer(pool->mIdle[k]);
+	}
+	
+	free(pool->mIdle);
+	pool->mIdle = NULL;
+	pool->mNumIdle = 0;
+	
+	pthread_mutex_destroy(&pool->mMutex);
+}
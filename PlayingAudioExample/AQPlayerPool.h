@@ -0,0 +1,65 @@
+//
+//  AQPlayerPool.h
+//  PlayingAudioExample
+//
+
+#ifndef AQPlayerPool_h
+#define AQPlayerPool_h
+
+#include "AQPlayerState.h"
+
+#include <pthread.h>
+
+/* Description:
+ * Idle players kept with their queue, buffers and packet descriptions allocated,
+ * keyed by the stream format their queue was created for. Checking out a file of
+ * a format that has an idle player only costs opening the file and priming it.
+ */
+struct AQPlayerPool
+{
+	/* Description:
+	 * Given to every player the pool creates.
+	 */
+	struct AQThreadPool * mThreadPool;
+	Float64 mFastStartSeconds;
+	
+	/* Description:
+	 * Where check outs look up and store file headers, or NULL to always parse them.
+	 */
+	struct AQHeaderCache * mHeaderCache;
+	
+	/* Description:
+	 * Idle players, most recently returned last; at most mMaxIdle of them together
+	 * with the mNumRecycling being stopped on their way in. mMutex guards these and
+	 * the counts below, so check outs may run on several threads at once.
+	 */
+	struct AQPlayerState ** mIdle;
+	UInt32 mNumIdle;
+	UInt32 mNumRecycling;
+	UInt32 mMaxIdle;
+	pthread_mutex_t mMutex;
+	
+	/* Description:
+	 * Check outs served by an idle player, and those that had to create one.
+	 */
+	UInt64 mNumHits;
+	UInt64 mNumMisses;
+};
+
+// threadPool may be NULL for players filled on the run loop that checks them out
+void AQPlayerPool_Init(struct AQPlayerPool * pool, struct AQThreadPool * threadPool, UInt32 maxIdle);
+
+// A primed player for path that still has to be started, NULL when path does not open
+// or the queue cannot play it. Safe from any thread.
+struct AQPlayerState * AQPlayerPool_CheckOut(struct AQPlayerPool * pool, const char path[]);
+
+// Stops the player and keeps it for the next file of its format, or disposes of it
+// when the pool is full or the player decodes to PCM
+void AQPlayerPool_Return(struct AQPlayerPool * pool, struct AQPlayerState * player);
+
+// Sets up count idle players for the format of path ahead of time
+void AQPlayerPool_Prewarm(struct AQPlayerPool * pool, const char path[], UInt32 count);
+
+void AQPlayerPool_CleanUp(struct AQPlayerPool * pool);
+
+#endif /* AQPlayerPool_h */
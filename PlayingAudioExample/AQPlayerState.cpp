@@ -0,0 +1,1811 @@
+//
+//  AQPlayerState.cpp
+//  PlayingAudioExample
+//
+
+/* The playback side follows the example from:
+ * https://developer.apple.com/library/content/documentation/MusicAudio/Conceptual/AudioQueueProgrammingGuide/AQPlayback/PlayingAudio.html#//apple_ref/doc/uid/TP40005343-CH3-SW1
+ */
+
+#include "AQPlayerState.h"
+#include "AQTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <math.h>
+#include <sched.h>
+#include <strings.h>
+#include <time.h>
+
+// Enough for the packet descriptions and magic cookie of a compressed file in one block
+static const size_t kPlayerArenaBlockSize = 16 * 1024;
+
+// Each fill after a fast start may be this many times longer than the one before
+static const UInt32 kFastStartRampFactor = 4;
+
+static
+void HandleOutputBufferPCM(struct AQPlayerState * data, AudioQueueRef aq, AudioQueueBufferRef buf);
+
+UInt64 GetMonotonicNanos()
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return (UInt64) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Packets to read into the next buffer: a full buffer's worth, or less while ramping up after a fast start
+static
+UInt32 AQPlayerState_NextFillPackets(struct AQPlayerState * data, UInt32 numFullPackets)
+{
+	UInt32 numPackets = numFullPackets;
+	
+	if (data->mRampPackets > 0)
+	{
+		if (data->mRampPackets < numPackets)
+		{
+			numPackets = data->mRampPackets;
+		}
+		
+		data->mRampPackets *= kFastStartRampFactor;
+		
+		if (data->mRampPackets >= numFullPackets)
+		{
+			data->mRampPackets = 0;
+		}
+	}
+	
+	return numPackets;
+}
+
+static
+void AQPlayerState_Stop(struct AQPlayerState * data, AudioQueueRef aq)
+{
+	AudioQueueStop(aq, false);
+	__atomic_store_n(&data->mIsRunning, false, __ATOMIC_RELEASE);
+}
+
+// Indexes the packets of the file the first time a seek needs them. Runs on the fill
+// side, which owns the file, so nothing reads it meanwhile; the buffers already queued
+// go on playing. False when the file cannot be indexed.
+static
+bool AQPlayerState_IndexPackets(struct AQPlayerState * data)
+{
+	if (data->mPacketTable.mNumPackets > 0)
+	{
+		return true;
+	}
+	
+	if (!__atomic_load_n(&data->mCanIndexPackets, __ATOMIC_ACQUIRE))
+	{
+		return false;
+	}
+	
+	AQ_TRACE_SCOPE("index", 0);
+	
+	if (!BuildPacketTable(data->mAudioFile, &data->mPacketTable) || data->mPacketTable.mNumPackets == 0)
+	{
+		fprintf(stderr, "Could not index the packets, seeking is disabled\n");
+		AQPacketTable_CleanUp(&data->mPacketTable);
+		__atomic_store_n(&data->mCanIndexPackets, false, __ATOMIC_RELEASE);
+		return false;
+	}
+	
+	return true;
+}
+
+// Runs on the fill side, which owns the decoding position
+static
+void AQPlayerState_Seek(struct AQPlayerState * data, SInt64 frame)
+{
+	if (data->mDecodeToPCM)
+	{
+		// Seeking abandons a crossfade in progress, the fade restarts near the end of the file
+		AQPCMSource_Close(&data->mNextSource);
+		AQPCMSource_Seek(&data->mSource, frame);
+	}
+	else if (data->mDataFormat.mFramesPerPacket > 0)
+	{
+		data->mCurrentPacket = frame / data->mDataFormat.mFramesPerPacket;
+	}
+	else if (AQPlayerState_IndexPackets(data))
+	{
+		data->mCurrentPacket = AQPacketTable_FindPacket(&data->mPacketTable, frame);
+	}
+}
+
+// Position after the numPackets packets just read, which end at mCurrentPacket: from
+// the packet number when packets have fixed frames or are indexed, otherwise by adding
+// up the frames of the packets read since the start
+static
+SInt64 AQPlayerState_GetPacketFrame(struct AQPlayerState * data, UInt32 numPackets)
+{
+	struct AQPacketInfo info;
+	SInt64 frame;
+	UInt32 k;
+	
+	if (data->mDataFormat.mFramesPerPacket > 0)
+	{
+		return data->mCurrentPacket * data->mDataFormat.mFramesPerPacket;
+	}
+	
+	if (data->mPacketTable.mNumPackets > 0)
+	{
+		return AQPacketTable_Get(&data->mPacketTable, data->mCurrentPacket, &info) ? info.mStartFrame : data->mPacketTable.mNumFrames;
+	}
+	
+	// Only the fills write the position
+	frame = __atomic_load_n(&data->mFramePosition, __ATOMIC_RELAXED);
+	
+	for (k = 0; data->mPacketDescs && k < numPackets; k++)
+	{
+		frame += data->mPacketDescs[k].mVariableFramesInPacket;
+	}
+	
+	return frame;
+}
+
+// Reads the next chunk of the file into buf and enqueues it
+static
+void AQPlayerState_FillBuffer(struct AQPlayerState * data, AudioQueueRef aq, AudioQueueBufferRef buf)
+{
+	AQ_TRACE_SCOPE("fill", (UInt64) data->mCurrentPacket);
+	
+	//printf("Current packet: %lld\n", data->mCurrentPacket);
+	
+	if (!AQPlayerState_IsRunning(data))
+	{
+		return;
+	}
+	
+	SInt64 seekRequest = __atomic_exchange_n(&data->mSeekRequest, 0, __ATOMIC_ACQUIRE);
+	
+	if (seekRequest > 0)
+	{
+		AQPlayerState_Seek(data, seekRequest - 1);
+	}
+	
+	if (data->mDecodeToPCM)
+	{
+		HandleOutputBufferPCM(data, aq, buf);
+		return;
+	}
+	
+	UInt32 ioNumBytesReadFromFile;	// on input, the size of the outBuffer parameter
+									// on output, the number of bytes actually read
+	
+	UInt32 ioNumPackets;	// on input, the number of packets to read
+							// on output, the number of packets actually read
+	
+	ioNumBytesReadFromFile = data->bufferByteSize;
+	ioNumPackets = AQPlayerState_NextFillPackets(data, data->mNumPacketsToRead);
+	
+	//printf("attempting to read %d bytes\n", ioNumBytesReadFromFile);
+	//printf("attempting to read %d packets\n", ioNumPackets);
+	
+	{
+		AQ_TRACE_SCOPE("read", ioNumPackets);
+		
+		AudioFileReadPacketData(data->mAudioFile,
+								false,
+								&ioNumBytesReadFromFile,
+								data->mPacketDescs,
+								data->mCurrentPacket,
+								&ioNumPackets,
+								buf->mAudioData);
+	}
+	
+	//printf("read %d bytes\n", ioNumBytesReadFromFile);
+	//printf("read %d packets\n", ioNumPackets);
+	
+	AQTrace_Instant("bytes read", ioNumBytesReadFromFile);
+	
+	if (ioNumPackets > 0)
+	{
+		AQ_TRACE_SCOPE("enqueue", ioNumBytesReadFromFile);
+		
+		buf->mAudioDataByteSize = ioNumBytesReadFromFile;
+		AudioQueueEnqueueBuffer(
+								aq,
+								buf,
+								data->mPacketDescs ? ioNumPackets : 0,
+								data->mPacketDescs);
+		
+		data->mCurrentPacket += ioNumPackets;
+		
+		__atomic_store_n(&data->mFramePosition, AQPlayerState_GetPacketFrame(data, ioNumPackets), __ATOMIC_RELEASE);
+	}
+	else
+	{
+		AQPlayerState_Stop(data, aq);
+	}
+}
+
+// Pool task: fills the buffers handed over by HandleOutputBuffer, in order
+static
+void AQPlayerState_FillPendingBuffers(void * arg)
+{
+	struct AQPlayerState * data = (struct AQPlayerState *) arg;
+	
+	do
+	{
+		AudioQueueBufferRef buf = data->mPendingBuffers[data->mPendingTail % kNumberBuffers];
+		data->mPendingTail++;
+		
+		AQPlayerState_FillBuffer(data, data->mQueue, buf);
+	} while (__atomic_sub_fetch(&data->mNumPendingFills, 1, __ATOMIC_ACQ_REL) > 0);
+}
+
+// Audio Queue callback
+static
+void HandleOutputBuffer(void * aqData, AudioQueueRef aq, AudioQueueBufferRef buf)
+{
+	struct AQPlayerState * data = (AQPlayerState *) aqData;
+	
+	if (!data->mThreadPool)
+	{
+		AQPlayerState_FillBuffer(data, aq, buf);
+		return;
+	}
+	
+	if (!AQPlayerState_IsRunning(data))
+	{
+		return;
+	}
+	
+	// At most kNumberBuffers buffers are ever out of the queue, so the ring cannot overflow
+	data->mPendingBuffers[data->mPendingHead % kNumberBuffers] = buf;
+	data->mPendingHead++;
+	
+	if (__atomic_fetch_add(&data->mNumPendingFills, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		AQThreadPool_Submit(data->mThreadPool, AQPlayerState_FillPendingBuffers, data);
+	}
+}
+
+static
+void DeriveBufferSize(const AudioStreamBasicDescription * inDesc,
+					  UInt32   maxPacketSize,
+					  Float64  seconds,
+					  UInt32 * outBufferSize,
+					  UInt32 * outNumPacketsToRead)
+{
+	static const int maxBufferSize = 0x50000;  // 320 kBytes
+	static const int minBufferSize = 0x4000;   // 16 kBytes
+	
+	
+	// For audio data formats that devine a fixed number of frames per packet
+	if (inDesc->mFramesPerPacket != 0)
+	{
+		// Frames per second / frames per packet * seconds
+		Float64 numPacketsForTime = inDesc->mSampleRate / inDesc->mFramesPerPacket * seconds;
+		
+		*outBufferSize = numPacketsForTime * maxPacketSize;
+	}
+	// For audio data formats that do not define a fixed number of frames per packet,
+	// derives a reasonable audio queue buffer size based on the maximum packet size
+	// and the upper bound you've set.
+	else
+	{
+		// maxPacket size is the max buffer size when CBR? CBR indicated by mFramesPerPacket = 0?
+		*outBufferSize = maxBufferSize > maxPacketSize ? maxBufferSize : maxPacketSize;
+	}
+	
+	// If the derived buffer size is above the upper bound you've set, adjust the bound,
+	// taking into account the estimated maximum packet size;
+	// I think this if statement checks the outBufferSize calculated for audio data formats
+	// that do not define a fixed number of frames per packet.
+	if (*outBufferSize > maxBufferSize && *outBufferSize > maxPacketSize)
+	{
+		*outBufferSize = maxBufferSize;
+	}
+	else
+	{
+		if (*outBufferSize < minBufferSize)
+		{
+			*outBufferSize = minBufferSize;
+		}
+	}
+	
+	*outNumPacketsToRead = *outBufferSize / maxPacketSize;
+	
+	AQTrace_Instant("max packet size", maxPacketSize);
+	AQTrace_Instant("buffer size", *outBufferSize);
+	AQTrace_Instant("packets to read", *outNumPacketsToRead);
+}
+
+static
+void PrintResultCodes(OSStatus code)
+{
+	switch (code)
+	{
+		case kAudioFileUnspecifiedError:
+			printf("File unspecified\n");
+			break;
+		case kAudioFileUnsupportedFileTypeError:
+			printf("Unsupported file type\n");
+			break;
+		case kAudioFileUnsupportedDataFormatError:
+			printf("Unsupported data format\n");
+			break;
+		case kAudioFileUnsupportedPropertyError:
+			printf("Unsupported property\n");
+			break;
+		case kAudioFileBadPropertySizeError:
+			printf("Bad property size\n");
+			break;
+		case kAudioFileNotOptimizedError:
+			printf("File not optimized\n");
+			break;
+		case kAudioFileInvalidChunkError:
+			printf("Invalid chunk\n");
+			break;
+		case kAudioFileDoesNotAllow64BitDataSizeError:
+			printf("File does not allow 64 bit data size\n");
+			break;
+		case kAudioFileInvalidPacketOffsetError:
+			printf("Invalid packet offset\n");
+			break;
+		case kAudioFileInvalidFileError:
+			printf("Invalid file\n");
+			break;
+		case kAudioFileOperationNotSupportedError:
+			printf("Operation not supported\n");
+			break;
+		case kAudioFileNotOpenError:
+			printf("File not open\n");
+			break;
+		case kAudioFileEndOfFileError:
+			printf("End of file\n");
+			break;
+		case kAudioFilePositionError:
+			printf("Position\n");
+			break;
+		case kAudio_FileNotFoundError:
+			printf("File not found\n");
+			break;
+		default:
+			break;
+	}
+}
+
+static
+void PrintCFString(CFStringRef cf_string)
+{
+	const char * string = CFStringGetCStringPtr(cf_string, kCFStringEncodingMacRoman);
+	
+	printf("%s\n", string);
+}
+
+/* Description:
+ * Files opened from http:// URLs, each with the stream feeding it, so that
+ * CloseAudioFile can dispose of the stream along with the file.
+ */
+struct AQStreamingFile
+{
+	AudioFileID mAudioFile;
+	struct AQHTTPStream * mStream;
+	struct AQStreamingFile * mNext;
+};
+
+static struct AQStreamingFile * sStreamingFiles = NULL;
+static pthread_mutex_t sStreamingFilesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static UInt32 sStreamWatermarkBytes = kDefaultStreamWatermarkBytes;
+
+static
+OSStatus ReadStream(void * inClientData, SInt64 inPosition, UInt32 requestCount, void * buffer, UInt32 * actualCount)
+{
+	SInt32 numBytes = AQHTTPStream_ReadAt((struct AQHTTPStream *) inClientData, inPosition, requestCount, buffer);
+	
+	if (numBytes < 0)
+	{
+		*actualCount = 0;
+		return kAudioFileUnspecifiedError;
+	}
+	
+	*actualCount = numBytes;
+	
+	return noErr;
+}
+
+static
+SInt64 GetStreamSize(void * inClientData)
+{
+	return AQHTTPStream_GetLength((struct AQHTTPStream *) inClientData);
+}
+
+// A network stream cannot be probed cheaply, so tell the parser what to expect from the extension
+static
+AudioFileTypeID GuessFileType(const char url[])
+{
+	const char * extension = strrchr(url, '.');
+	
+	if (!extension || strchr(extension, '/'))
+	{
+		return 0;
+	}
+	
+	if (strncasecmp(extension, ".aac", 4) == 0)  return kAudioFileAAC_ADTSType;
+	if (strncasecmp(extension, ".wav", 4) == 0)  return kAudioFileWAVEType;
+	if (strncasecmp(extension, ".mp3", 4) == 0)  return kAudioFileMP3Type;
+	if (strncasecmp(extension, ".m4a", 4) == 0)  return kAudioFileM4AType;
+	if (strncasecmp(extension, ".mp4", 4) == 0)  return kAudioFileMPEG4Type;
+	if (strncasecmp(extension, ".caf", 4) == 0)  return kAudioFileCAFType;
+	if (strncasecmp(extension, ".aif", 4) == 0)  return kAudioFileAIFFType;
+	
+	return 0;
+}
+
+// Streams url through a jitter buffer, returning once the watermark is buffered
+static
+OSStatus OpenStreamingAudioFile(const char url[], AudioFileID * outAudioFile)
+{
+	struct AQHTTPStream * stream = AQHTTPStream_Open(url, kAQHTTPStreamDefaultBufferBytes);
+	
+	if (!stream)
+	{
+		return kAudio_FileNotFoundError;
+	}
+	
+	if (!AQHTTPStream_WaitForWatermark(stream, sStreamWatermarkBytes))
+	{
+		AQHTTPStream_Dispose(stream);
+		return kAudio_FileNotFoundError;
+	}
+	
+	OSStatus result =
+	AudioFileOpenWithCallbacks(stream, ReadStream, NULL, GetStreamSize, NULL, GuessFileType(url), outAudioFile);
+	
+	if (result != noErr)
+	{
+		AQHTTPStream_Dispose(stream);
+		return result;
+	}
+	
+	struct AQStreamingFile * file = (struct AQStreamingFile *) malloc(sizeof(struct AQStreamingFile));
+	
+	file->mAudioFile = *outAudioFile;
+	file->mStream = stream;
+	
+	pthread_mutex_lock(&sStreamingFilesMutex);
+	file->mNext = sStreamingFiles;
+	sStreamingFiles = file;
+	pthread_mutex_unlock(&sStreamingFilesMutex);
+	
+	return noErr;
+}
+
+static
+bool IsStreamingFile(AudioFileID audioFile)
+{
+	struct AQStreamingFile * file;
+	
+	pthread_mutex_lock(&sStreamingFilesMutex);
+	
+	for (file = sStreamingFiles; file; file = file->mNext)
+	{
+		if (file->mAudioFile == audioFile)
+		{
+			break;
+		}
+	}
+	
+	pthread_mutex_unlock(&sStreamingFilesMutex);
+	
+	return file != NULL;
+}
+
+void SetStreamWatermark(UInt32 numBytes)
+{
+	sStreamWatermarkBytes = numBytes;
+}
+
+void CloseAudioFile(AudioFileID audioFile)
+{
+	struct AQStreamingFile ** link;
+	struct AQStreamingFile * file = NULL;
+	
+	AudioFileClose(audioFile);
+	
+	pthread_mutex_lock(&sStreamingFilesMutex);
+	
+	for (link = &sStreamingFiles; *link; link = &(*link)->mNext)
+	{
+		if ((*link)->mAudioFile == audioFile)
+		{
+			file = *link;
+			*link = file->mNext;
+			break;
+		}
+	}
+	
+	pthread_mutex_unlock(&sStreamingFilesMutex);
+	
+	if (file)
+	{
+		struct AQHTTPStreamStats stats;
+		
+		AQHTTPStream_GetStats(file->mStream, &stats);
+		
+		printf("stream: %llu bytes downloaded, %u stalls, %u seeks, %u reconnects\n",
+			   (unsigned long long) stats.mBytesDownloaded, stats.mNumStalls, stats.mNumSeeks, stats.mNumReconnects);
+		
+		AQHTTPStream_Dispose(file->mStream);
+		free(file);
+	}
+}
+
+// fileType 0 has AudioFile work out the type itself
+static
+OSStatus OpenAudioFileOfType(const char filePath[], AudioFileTypeID fileType, AudioFileID * outAudioFile)
+{
+	AQ_TRACE_SCOPE("open", 0);
+	
+	OSStatus result;
+	
+	printf("filename: %s\n", filePath);
+	
+	*outAudioFile = NULL;
+	
+	if (AQHTTPStream_IsURL(filePath))
+	{
+		result = OpenStreamingAudioFile(filePath, outAudioFile);
+		PrintResultCodes(result);
+		
+		return result;
+	}
+	
+	CFURLRef audioFileURL = CFURLCreateFromFileSystemRepresentation(
+								NULL,
+								(const UInt8 *) filePath,
+								strlen(filePath),
+								false);
+	
+	PrintCFString(CFURLGetString(audioFileURL));
+	
+	result = AudioFileOpenURL(audioFileURL, kAudioFileReadPermission, fileType, outAudioFile);
+	
+	printf("mAudioFile: %p\n", *outAudioFile);
+	
+	CFRelease(audioFileURL);
+	
+	PrintResultCodes(result);
+	
+	return result;
+}
+
+OSStatus OpenAudioFile(const char filePath[], AudioFileID * outAudioFile)
+{
+	return OpenAudioFileOfType(filePath, 0, outAudioFile);
+}
+
+// Asks the file for everything AQHeaderInfo holds
+static
+void ReadHeader(AudioFileID audioFile, bool isStream, struct AQHeaderInfo * outHeader)
+{
+	AQ_TRACE_SCOPE("parse", 0);
+	
+	AudioStreamBasicDescription format;
+	UInt32 propertySize;
+	
+	memset(outHeader, 0, offsetof(struct AQHeaderInfo, mCookie));
+	
+	propertySize = sizeof(format);
+	AudioFileGetProperty(audioFile, kAudioFilePropertyDataFormat, &propertySize, &format);
+	
+	outHeader->mSampleRate = format.mSampleRate;
+	outHeader->mFormatID = format.mFormatID;
+	outHeader->mFormatFlags = format.mFormatFlags;
+	outHeader->mBytesPerPacket = format.mBytesPerPacket;
+	outHeader->mFramesPerPacket = format.mFramesPerPacket;
+	outHeader->mBytesPerFrame = format.mBytesPerFrame;
+	outHeader->mChannelsPerFrame = format.mChannelsPerFrame;
+	outHeader->mBitsPerChannel = format.mBitsPerChannel;
+	
+	propertySize = sizeof(outHeader->mFileType);
+	AudioFileGetProperty(audioFile, kAudioFilePropertyFileFormat, &propertySize, &outHeader->mFileType);
+	
+	propertySize = sizeof(outHeader->mMaxPacketSize);
+	AudioFileGetProperty(audioFile, kAudioFilePropertyPacketSizeUpperBound, &propertySize, &outHeader->mMaxPacketSize);
+	
+	// Without a packet table this reads to the end, which a stream must not wait for
+	if (!isStream || format.mBytesPerPacket != 0)
+	{
+		propertySize = sizeof(outHeader->mNumPackets);
+		AudioFileGetProperty(audioFile, kAudioFilePropertyAudioDataPacketCount, &propertySize, &outHeader->mNumPackets);
+	}
+	
+	propertySize = sizeof(outHeader->mDuration);
+	AudioFileGetProperty(audioFile, kAudioFilePropertyEstimatedDuration, &propertySize, &outHeader->mDuration);
+	
+	if (AudioFileGetPropertyInfo(audioFile, kAudioFilePropertyMagicCookieData, &propertySize, NULL) == noErr)
+	{
+		outHeader->mCookieSize = propertySize;
+		
+		// A larger one is read again when it is needed
+		if (propertySize <= kAQHeaderInfoMaxCookieSize)
+		{
+			AudioFileGetProperty(audioFile, kAudioFilePropertyMagicCookieData, &propertySize, outHeader->mCookie);
+		}
+	}
+}
+
+OSStatus OpenAudioFileWithHeader(const char filePath[], struct AQHeaderCache * cache, AudioFileID * outAudioFile, struct AQHeaderInfo * outHeader)
+{
+	if (cache && AQHeaderCache_Lookup(cache, filePath, outHeader))
+	{
+		// The type from last time spares AudioFile from guessing it
+		return OpenAudioFileOfType(filePath, outHeader->mFileType, outAudioFile);
+	}
+	
+	OSStatus result = OpenAudioFile(filePath, outAudioFile);
+	
+	if (result != noErr)
+	{
+		return result;
+	}
+	
+	ReadHeader(*outAudioFile, AQHTTPStream_IsURL(filePath), outHeader);
+	
+	if (cache)
+	{
+		AQHeaderCache_Store(cache, filePath, outHeader);
+	}
+	
+	return noErr;
+}
+
+void FillFormatFromHeader(AudioStreamBasicDescription * format, const struct AQHeaderInfo * header)
+{
+	memset(format, 0, sizeof(AudioStreamBasicDescription));
+	format->mSampleRate = header->mSampleRate;
+	format->mFormatID = header->mFormatID;
+	format->mFormatFlags = header->mFormatFlags;
+	format->mBytesPerPacket = header->mBytesPerPacket;
+	format->mFramesPerPacket = header->mFramesPerPacket;
+	format->mBytesPerFrame = header->mBytesPerFrame;
+	format->mChannelsPerFrame = header->mChannelsPerFrame;
+	format->mBitsPerChannel = header->mBitsPerChannel;
+}
+
+bool BuildPacketTable(AudioFileID audioFile, struct AQPacketTable * outTable)
+{
+	static const UInt32 kNumPacketsPerRead = 4096;
+	
+	AudioStreamBasicDescription format;
+	UInt32 maxPacketSize = 0;
+	UInt64 numPackets = 0;
+	UInt32 propertySize;
+	SInt64 packet = 0;
+	SInt64 offset = 0;
+	bool ok = true;
+	
+	propertySize = sizeof(format);
+	AudioFileGetProperty(audioFile, kAudioFilePropertyDataFormat, &propertySize, &format);
+	
+	propertySize = sizeof(maxPacketSize);
+	AudioFileGetProperty(audioFile, kAudioFilePropertyPacketSizeUpperBound, &propertySize, &maxPacketSize);
+	
+	propertySize = sizeof(numPackets);
+	AudioFileGetProperty(audioFile, kAudioFilePropertyAudioDataPacketCount, &propertySize, &numPackets);
+	
+	AQPacketTable_Init(outTable, format.mFramesPerPacket);
+	
+	bool isFormatVBR = format.mBytesPerPacket == 0 || format.mFramesPerPacket == 0;
+	void * data = malloc((size_t) kNumPacketsPerRead * maxPacketSize);
+	AudioStreamPacketDescription * packetDescs = (AudioStreamPacketDescription *) malloc(kNumPacketsPerRead * sizeof(AudioStreamPacketDescription));
+	
+	while ((UInt64) packet < numPackets)
+	{
+		UInt32 ioNumBytes = kNumPacketsPerRead * maxPacketSize;
+		UInt32 ioNumPackets = kNumPacketsPerRead;
+		UInt32 k;
+		
+		OSStatus result = AudioFileReadPacketData(audioFile, false, &ioNumBytes, isFormatVBR ? packetDescs : NULL, packet, &ioNumPackets, data);
+		
+		if ((result != noErr && result != kAudioFileEndOfFileError) || ioNumPackets == 0)
+		{
+			ok = (UInt64) packet == numPackets;
+			break;
+		}
+		
+		for (k = 0; k < ioNumPackets; k++)
+		{
+			if (isFormatVBR)
+			{
+				// Descriptions are relative to what this read returned
+				AQPacketTable_Append(outTable, offset + packetDescs[k].mStartOffset, packetDescs[k].mDataByteSize, packetDescs[k].mVariableFramesInPacket);
+			}
+			else
+			{
+				AQPacketTable_Append(outTable, offset + (SInt64) k * format.mBytesPerPacket, format.mBytesPerPacket, 0);
+			}
+		}
+		
+		offset += ioNumBytes;
+		packet += ioNumPackets;
+	}
+	
+	free(data);
+	free(packetDescs);
+	
+	AQPacketTable_Trim(outTable);
+	
+	return ok;
+}
+
+struct AQBlockFile * OpenBlockFile(const char filePath[])
+{
+	printf("filename: %s\n", filePath);
+	
+	struct AQBlockFile * blockFile = AQBlockFile_Open(filePath);
+	
+	if (!blockFile || AQBlockFile_GetInfo(blockFile)->mLayout.mNumChannels > kAQChannelMapMaxChannels)
+	{
+		fprintf(stderr, "Error: could not open %s as a block file\n", filePath);
+		exit(1);
+	}
+	
+	return blockFile;
+}
+
+static
+void AQPlayerState_InitAudioFile(struct AQPlayerState * aq, const char filePath[])
+{
+	if (AQBlockFile_IsBlockFilePath(filePath))
+	{
+		// Only ever read through AQPCMSource
+		aq->mBlockFile = OpenBlockFile(filePath);
+		aq->mDecodeToPCM = true;
+	}
+	else
+	{
+		CheckError(OpenAudioFileWithHeader(filePath, aq->mHeaderCache, &aq->mAudioFile, &aq->mHeader), "AudioFileOpen");
+	}
+}
+
+static
+void PrintBasicDescription(AudioStreamBasicDescription * mDataFormat)
+{
+	printf("Bits per channel  : %d\n", mDataFormat->mBitsPerChannel);
+	printf("Sample rate       : %lf.3\n", mDataFormat->mSampleRate);
+	printf("Channels per frame: %d\n", mDataFormat->mChannelsPerFrame);
+	printf("Frames per packet : %d\n", mDataFormat->mFramesPerPacket);
+	printf("Bytes per packet  : %d\n", mDataFormat->mBytesPerPacket);
+}
+
+static
+void AQPlayerState_InitBasicDescription(struct AQPlayerState * aq)
+{
+	if (aq->mBlockFile)
+	{
+		const struct AQBlockFileInfo * info = AQBlockFile_GetInfo(aq->mBlockFile);
+		
+		// Only the rate and channels matter, the format is replaced by the PCM decoded to
+		FillPCMFormat(&aq->mDataFormat, info->mSampleRate, info->mLayout.mNumChannels);
+	}
+	else
+	{
+		FillFormatFromHeader(&aq->mDataFormat, &aq->mHeader);
+	}
+	
+	PrintBasicDescription(&aq->mDataFormat);
+}
+
+void CheckError(OSStatus error, const char *operation)
+{
+	if (error == noErr) return;
+	
+	char str[20];
+	// see if it appears to be a 4-char-code
+	*(UInt32 *)(str + 1) = CFSwapInt32HostToBig(error);
+	if (isprint(str[1]) && isprint(str[2]) && isprint(str[3]) && isprint(str[4])) {
+		str[0] = str[5] = '\'';
+		str[6] = '\0';
+	} else
+		// no, format it as an integer
+		sprintf(str, "%d", (int)error);
+	
+	fprintf(stderr, "Error: %s (%s)\n", operation, str);
+	
+	exit(1);
+}
+
+// Native-endian packed float
+void FillPCMFormat(AudioStreamBasicDescription * format, Float64 sampleRate, UInt32 numChannels)
+{
+	memset(format, 0, sizeof(AudioStreamBasicDescription));
+	format->mSampleRate = sampleRate;
+	format->mFormatID = kAudioFormatLinearPCM;
+	format->mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
+	format->mBitsPerChannel = 8 * sizeof(Float32);
+	format->mChannelsPerFrame = numChannels;
+	format->mFramesPerPacket = 1;
+	format->mBytesPerFrame = numChannels * sizeof(Float32);
+	format->mBytesPerPacket = format->mBytesPerFrame;
+}
+
+// Describes file formats AQSampleConvert can read directly, returns false for anything else
+static
+bool GetSampleLayout(const AudioStreamBasicDescription * format, struct AQSampleLayout * outLayout)
+{
+	AudioFormatFlags flags = format->mFormatFlags;
+	UInt32 numChannels = format->mChannelsPerFrame;
+	bool isNonInterleaved = (flags & kAudioFormatFlagIsNonInterleaved) != 0;
+	UInt32 bytesPerSample;
+	
+	if (format->mFormatID != kAudioFormatLinearPCM || format->mFramesPerPacket != 1 || numChannels == 0)
+	{
+		return false;
+	}
+	
+	bytesPerSample = isNonInterleaved ? format->mBytesPerFrame : format->mBytesPerFrame / numChannels;
+	
+	// Samples must fill their bytes exactly, no padding or alignment bits
+	if (bytesPerSample * 8 != format->mBitsPerChannel)
+	{
+		return false;
+	}
+	
+	if (flags & kAudioFormatFlagIsFloat)
+	{
+		if (bytesPerSample == 4)      outLayout->mType = kAQSampleType_Float32;
+		else if (bytesPerSample == 8) outLayout->mType = kAQSampleType_Float64;
+		else                          return false;
+	}
+	else if (!(flags & kAudioFormatFlagIsSignedInteger))
+	{
+		if (bytesPerSample == 1)      outLayout->mType = kAQSampleType_UInt8;
+		else                          return false;
+	}
+	else
+	{
+		if (bytesPerSample == 2)      outLayout->mType = kAQSampleType_SInt16;
+		else if (bytesPerSample == 3) outLayout->mType = kAQSampleType_SInt24;
+		else if (bytesPerSample == 4) outLayout->mType = kAQSampleType_SInt32;
+		else                          return false;
+	}
+	
+	outLayout->mIsBigEndian = (flags & kAudioFormatFlagIsBigEndian) != 0;
+	outLayout->mIsInterleaved = !isNonInterleaved;
+	outLayout->mNumChannels = numChannels;
+	
+	return true;
+}
+
+void AQPCMSource_Open(struct AQPCMSource * src, AudioFileID audioFile, const struct AQHeaderInfo * header, const AudioStreamBasicDescription * outputFormat, UInt32 maxFrames)
+{
+	AudioStreamBasicDescription fileFormat;
+	struct AQSampleLayout layout;
+	UInt32 propertySize;
+	UInt32 numFileChannels;
+	
+	src->mAudioFile = audioFile;
+	
+	FillFormatFromHeader(&fileFormat, header);
+	
+	// Decode at the file's channel count and do the channel mapping ourselves,
+	// unless the layout is too wide for AQChannelMap
+	numFileChannels = fileFormat.mChannelsPerFrame;
+	
+	if (numFileChannels == 0 || numFileChannels > kAQChannelMapMaxChannels)
+	{
+		numFileChannels = outputFormat->mChannelsPerFrame;
+	}
+	
+	src->mFormat = *outputFormat;
+	src->mFormat.mChannelsPerFrame = numFileChannels;
+	src->mFormat.mBytesPerFrame = numFileChannels * sizeof(Float32);
+	src->mFormat.mBytesPerPacket = src->mFormat.mBytesPerFrame;
+	
+	if (fileFormat.mSampleRate == outputFormat->mSampleRate &&
+		numFileChannels == fileFormat.mChannelsPerFrame &&
+		GetSampleLayout(&fileFormat, &layout) &&
+		layout.mIsInterleaved)
+	{
+		src->mConvertKernel = AQSampleConvert_SelectKernel(&layout);
+	}
+	
+	if (src->mConvertKernel)
+	{
+		src->mFileBytesPerFrame = fileFormat.mBytesPerFrame;
+		src->mRawBuffer = malloc(maxFrames * fileFormat.mBytesPerFrame);
+		src->mCurrentPacket = 0;
+		
+		// One frame per packet
+		src->mLengthFrames = (SInt64) header->mNumPackets;
+	}
+	else
+	{
+		SInt64 fileLengthFrames;
+		
+		CheckError(ExtAudioFileWrapAudioFileID(audioFile, false, &src->mExtAudioFile), "ExtAudioFileWrapAudioFileID");
+		
+		CheckError(ExtAudioFileSetProperty(src->mExtAudioFile,
+										   kExtAudioFileProperty_ClientDataFormat,
+										   sizeof(AudioStreamBasicDescription),
+										   &src->mFormat),
+				   "ExtAudioFileSetProperty ClientDataFormat");
+		
+		propertySize = sizeof(fileLengthFrames);
+		ExtAudioFileGetProperty(src->mExtAudioFile, kExtAudioFileProperty_FileLengthFrames, &propertySize, &fileLengthFrames);
+		
+		// The file length is in file frames, the crossfade is scheduled in client frames
+		src->mLengthFrames = (SInt64) (fileLengthFrames * outputFormat->mSampleRate / fileFormat.mSampleRate);
+	}
+	
+	src->mFileSampleRate = fileFormat.mSampleRate;
+	src->mFramesRemaining = src->mLengthFrames;
+	src->mFramePosition = 0;
+	
+	AQChannelMap_Init(&src->mChannelMap, numFileChannels, outputFormat->mChannelsPerFrame);
+	
+	if (!src->mChannelMap.mIsIdentity)
+	{
+		src->mDecodeBuffer = (Float32 *) malloc(maxFrames * src->mFormat.mBytesPerFrame);
+	}
+}
+
+void AQPCMSource_OpenBlockFile(struct AQPCMSource * src, struct AQBlockFile * blockFile, const AudioStreamBasicDescription * outputFormat, UInt32 maxFrames)
+{
+	const struct AQBlockFileInfo * info = AQBlockFile_GetInfo(blockFile);
+	UInt32 numFileChannels = info->mLayout.mNumChannels;
+	
+	src->mBlockFile = blockFile;
+	
+	src->mFormat = *outputFormat;
+	src->mFormat.mChannelsPerFrame = numFileChannels;
+	src->mFormat.mBytesPerFrame = numFileChannels * sizeof(Float32);
+	src->mFormat.mBytesPerPacket = src->mFormat.mBytesPerFrame;
+	
+	// Frames are read straight out of the mapped blocks, so seeking costs nothing up front
+	src->mConvertKernel = AQSampleConvert_SelectKernel(&info->mLayout);
+	src->mFileBytesPerFrame = info->mBytesPerFrame;
+	src->mRawBuffer = malloc(maxFrames * info->mBytesPerFrame);
+	src->mCurrentPacket = 0;
+	
+	src->mLengthFrames = (SInt64) info->mNumFrames;
+	src->mFileSampleRate = info->mSampleRate;
+	src->mFramesRemaining = src->mLengthFrames;
+	src->mFramePosition = 0;
+	
+	AQChannelMap_Init(&src->mChannelMap, numFileChannels, outputFormat->mChannelsPerFrame);
+	
+	if (!src->mChannelMap.mIsIdentity)
+	{
+		src->mDecodeBuffer = (Float32 *) malloc(maxFrames * src->mFormat.mBytesPerFrame);
+	}
+}
+
+// Reads up to numFrames linear PCM packets and converts them to float, returns the number of frames read
+static
+UInt32 AQPCMSource_ReadRaw(struct AQPCMSource * src, Float32 * dst, UInt32 numFrames)
+{
+	UInt32 ioNumBytes = numFrames * src->mFileBytesPerFrame;
+	UInt32 ioNumPackets = numFrames;
+	OSStatus result = noErr;
+	
+	{
+		AQ_TRACE_SCOPE("read", numFrames);
+		
+		if (src->mBlockFile)
+		{
+			ioNumPackets = AQBlockFile_Read(src->mBlockFile, src->mRawBuffer, numFrames);
+		}
+		else
+		{
+			result = AudioFileReadPacketData(src->mAudioFile,
+											 false,
+											 &ioNumBytes,
+											 NULL,
+											 src->mCurrentPacket,
+											 &ioNumPackets,
+											 src->mRawBuffer);
+		}
+	}
+	
+	if (result != noErr && result != kAudioFileEndOfFileError)
+	{
+		return 0;
+	}
+	
+	AQ_TRACE_SCOPE("convert", ioNumPackets);
+	
+	src->mConvertKernel(src->mRawBuffer, dst, ioNumPackets, src->mFormat.mChannelsPerFrame);
+	src->mCurrentPacket += ioNumPackets;
+	
+	return ioNumPackets;
+}
+
+// Decodes up to numFrames into dst in the player's format and returns the number of frames decoded
+UInt32 AQPCMSource_Read(struct AQPCMSource * src, Float32 * dst, UInt32 numFrames)
+{
+	AudioBufferList bufferList;
+	Float32 * decoded = src->mChannelMap.mIsIdentity ? dst : src->mDecodeBuffer;
+	UInt32 ioNumFrames = numFrames;
+	
+	bufferList.mNumberBuffers = 1;
+	bufferList.mBuffers[0].mNumberChannels = src->mFormat.mChannelsPerFrame;
+	bufferList.mBuffers[0].mDataByteSize = numFrames * src->mFormat.mBytesPerFrame;
+	bufferList.mBuffers[0].mData = decoded;
+	
+	if (numFrames == 0)
+	{
+		ioNumFrames = 0;
+	}
+	else if (src->mConvertKernel)
+	{
+		ioNumFrames = AQPCMSource_ReadRaw(src, decoded, numFrames);
+	}
+	else
+	{
+		AQ_TRACE_SCOPE("decode", numFrames);
+		
+		if (ExtAudioFileRead(src->mExtAudioFile, &ioNumFrames, &bufferList) != noErr)
+		{
+			ioNumFrames = 0;
+		}
+	}
+	
+	// A short read before the end means the decoder or the stream fell behind
+	if (ioNumFrames < numFrames && src->mFramesRemaining > ioNumFrames)
+	{
+		AQTrace_Instant("underrun", numFrames - ioNumFrames);
+	}
+	
+	src->mFramePosition += ioNumFrames;
+	src->mFramesRemaining -= ioNumFrames;
+	
+	if (src->mFramesRemaining < 0)
+	{
+		src->mFramesRemaining = 0;
+	}
+	
+	// Anything the decoder could not deliver is played as silence
+	memset(decoded + ioNumFrames * src->mFormat.mChannelsPerFrame, 0, (numFrames - ioNumFrames) * src->mFormat.mBytesPerFrame);
+	
+	if (!src->mChannelMap.mIsIdentity)
+	{
+		AQ_TRACE_SCOPE("convert", numFrames);
+		
+		AQChannelMap_Apply(&src->mChannelMap, decoded, dst, numFrames);
+	}
+	
+	return ioNumFrames;
+}
+
+void AQPCMSource_Seek(struct AQPCMSource * src, SInt64 frame)
+{
+	if (frame > src->mLengthFrames)
+	{
+		frame = src->mLengthFrames;
+	}
+	
+	if (src->mBlockFile)
+	{
+		AQBlockFile_Seek(src->mBlockFile, (UInt64) frame);
+		src->mCurrentPacket = frame;
+	}
+	else if (src->mConvertKernel)
+	{
+		src->mCurrentPacket = frame;
+	}
+	else
+	{
+		// ExtAudioFileSeek counts in file frames
+		ExtAudioFileSeek(src->mExtAudioFile, (SInt64) (frame * src->mFileSampleRate / src->mFormat.mSampleRate));
+	}
+	
+	src->mFramePosition = frame;
+	src->mFramesRemaining = src->mLengthFrames - frame;
+}
+
+void AQPCMSource_Close(struct AQPCMSource * src)
+{
+	if (src->mExtAudioFile)
+	{
+		ExtAudioFileDispose(src->mExtAudioFile);
+	}
+	
+	if (src->mAudioFile)
+	{
+		CloseAudioFile(src->mAudioFile);
+	}
+	
+	AQBlockFile_Close(src->mBlockFile);
+	
+	free(src->mDecodeBuffer);
+	free(src->mRawBuffer);
+	
+	memset(src, 0, sizeof(struct AQPCMSource));
+}
+
+static
+void AQPlayerState_OpenNextSource(struct AQPlayerState * aq)
+{
+	const char * filePath = aq->mPlaylist[aq->mPlaylistIndex + 1];
+	UInt32 maxFrames = aq->bufferByteSize / aq->mDataFormat.mBytesPerFrame;
+	struct AQHeaderInfo header;
+	AudioFileID audioFile;
+	
+	if (AQBlockFile_IsBlockFilePath(filePath))
+	{
+		AQPCMSource_OpenBlockFile(&aq->mNextSource, OpenBlockFile(filePath), &aq->mDataFormat, maxFrames);
+	}
+	else
+	{
+		CheckError(OpenAudioFileWithHeader(filePath, aq->mHeaderCache, &audioFile, &header), "AudioFileOpen");
+		AQPCMSource_Open(&aq->mNextSource, audioFile, &header, &aq->mDataFormat, maxFrames);
+	}
+	
+	// Fade over whatever is left of the current file, up to the full crossfade length
+	AQCrossfade_Start(&aq->mCrossfade, (UInt32) aq->mSource.mFramesRemaining);
+}
+
+static
+void AQPlayerState_AdvancePlaylist(struct AQPlayerState * aq)
+{
+	AQPCMSource_Close(&aq->mSource);
+	
+	aq->mSource = aq->mNextSource;
+	aq->mAudioFile = aq->mSource.mAudioFile;
+	aq->mBlockFile = aq->mSource.mBlockFile;
+	aq->mPlaylistIndex++;
+	
+	memset(&aq->mNextSource, 0, sizeof(struct AQPCMSource));
+}
+
+static
+UInt32 AQPlayerState_FillPCM(struct AQPlayerState * aq, Float32 * out, UInt32 numFrames)
+{
+	UInt32 numChannels = aq->mDataFormat.mChannelsPerFrame;
+	UInt32 numFramesFilled = 0;
+	
+	while (numFramesFilled < numFrames)
+	{
+		Float32 * dst = out + numFramesFilled * numChannels;
+		UInt32 numFramesWanted = numFrames - numFramesFilled;
+		bool hasNext = aq->mPlaylistIndex + 1 < aq->mPlaylistCount;
+		
+		if (aq->mNextSource.mAudioFile || aq->mNextSource.mBlockFile)
+		{
+			// Decode the tail of the current file and the head of the next one, then blend them
+			if (numFramesWanted > AQCrossfade_FramesLeft(&aq->mCrossfade))
+			{
+				numFramesWanted = AQCrossfade_FramesLeft(&aq->mCrossfade);
+			}
+			
+			AQPCMSource_Read(&aq->mSource, dst, numFramesWanted);
+			AQPCMSource_Read(&aq->mNextSource, aq->mMixBuffer, numFramesWanted);
+			
+			numFramesFilled += AQCrossfade_Mix(&aq->mCrossfade, dst, aq->mMixBuffer, dst, numFramesWanted);
+			
+			if (AQCrossfade_IsDone(&aq->mCrossfade))
+			{
+				AQPlayerState_AdvancePlaylist(aq);
+			}
+		}
+		else if (hasNext && aq->mSource.mFramesRemaining <= aq->mCrossfade.mLengthFrames)
+		{
+			AQPlayerState_OpenNextSource(aq);
+		}
+		else
+		{
+			// Stop short of the crossfade so it starts on the right frame
+			if (hasNext && numFramesWanted > aq->mSource.mFramesRemaining - aq->mCrossfade.mLengthFrames)
+			{
+				numFramesWanted = (UInt32) (aq->mSource.mFramesRemaining - aq->mCrossfade.mLengthFrames);
+			}
+			
+			UInt32 numFramesRead = AQPCMSource_Read(&aq->mSource, dst, numFramesWanted);
+			
+			if (numFramesRead == 0)
+			{
+				if (!hasNext)
+				{
+					break;
+				}
+				
+				// The file ended before its reported length, cut over to the next one
+				aq->mSource.mFramesRemaining = 0;
+			}
+			
+			numFramesFilled += numFramesRead;
+		}
+	}
+	
+	return numFramesFilled;
+}
+
+static
+void HandleOutputBufferPCM(struct AQPlayerState * data, AudioQueueRef aq, AudioQueueBufferRef buf)
+{
+	// One frame per packet in the client format
+	UInt32 numFrames = AQPlayerState_NextFillPackets(data, data->bufferByteSize / data->mDataFormat.mBytesPerFrame);
+	UInt32 numFramesFilled = AQPlayerState_FillPCM(data, (Float32 *) buf->mAudioData, numFrames);
+	
+	if (data->mPeaksPath)
+	{
+		AQPeaksBuilder_AddFrames(&data->mPeaks, (Float32 *) buf->mAudioData, numFramesFilled);
+	}
+	
+	AQEqualizer_Process(&data->mEqualizer, (Float32 *) buf->mAudioData, numFramesFilled);
+	
+	if (data->mSpectrum)
+	{
+		AQSpectrum_Tap(data->mSpectrum, (Float32 *) buf->mAudioData, numFramesFilled);
+	}
+	
+	AQTrace_Instant("frames filled", numFramesFilled);
+	
+	__atomic_store_n(&data->mFramePosition, data->mSource.mFramePosition, __ATOMIC_RELEASE);
+	
+	if (numFramesFilled > 0)
+	{
+		AQ_TRACE_SCOPE("enqueue", numFramesFilled);
+		
+		buf->mAudioDataByteSize = numFramesFilled * data->mDataFormat.mBytesPerFrame;
+		AudioQueueEnqueueBuffer(aq, buf, 0, NULL);
+	}
+	else
+	{
+		AQPlayerState_Stop(data, aq);
+	}
+}
+
+// Notes when the queue first reports that it is running, which is when its first sample goes out
+static
+void HandleIsRunningChanged(void * aqData, AudioQueueRef aq, AudioQueuePropertyID propertyID)
+{
+	struct AQPlayerState * data = (struct AQPlayerState *) aqData;
+	UInt32 isRunning = 0;
+	UInt32 propertySize = sizeof(isRunning);
+	UInt64 notYet = 0;
+	
+	AudioQueueGetProperty(aq, kAudioQueueProperty_IsRunning, &isRunning, &propertySize);
+	
+	if (isRunning)
+	{
+		__atomic_compare_exchange_n(&data->mFirstSampleNanos, &notYet, GetMonotonicNanos(), false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	}
+}
+
+static
+OSStatus AQPlayerState_InitOutputQueue(struct AQPlayerState * aq)
+{
+	// With a thread pool the callbacks come on the queue's own thread and only hand off work
+	CFRunLoopRef runLoop = aq->mThreadPool ? NULL : CFRunLoopGetCurrent();
+	
+	printf("aq->mQueue: %p -> ", aq->mQueue);
+	OSStatus code =
+	AudioQueueNewOutput(&aq->mDataFormat, HandleOutputBuffer, aq, runLoop, kCFRunLoopCommonModes, 0, &aq->mQueue);
+	
+	printf("%p\n", aq->mQueue);
+	
+	if (code != noErr)
+	{
+		return code;
+	}
+	
+	AudioQueueAddPropertyListener(aq->mQueue, kAudioQueueProperty_IsRunning, HandleIsRunningChanged, aq);
+	
+	return noErr;
+}
+
+static
+void AQPlayerState_InitSizes(struct AQPlayerState * aq)
+{
+	UInt32 outBufferSize;
+	UInt32 outNumPacketsToRead;
+	UInt32 maxPacketSize;
+	
+	if (aq->mDecodeToPCM)
+	{
+		// One frame per packet in the client format
+		maxPacketSize = aq->mDataFormat.mBytesPerPacket;
+	}
+	else
+	{
+		maxPacketSize = aq->mHeader.mMaxPacketSize;
+	}
+	
+	DeriveBufferSize(&aq->mDataFormat, maxPacketSize, 0.5, &outBufferSize, &outNumPacketsToRead);
+	
+	aq->bufferByteSize = outBufferSize;
+	aq->mNumPacketsToRead = outNumPacketsToRead;
+}
+
+static
+void AQPlayerState_AllocatePacketDescriptionsArray(struct AQPlayerState * aq)
+{
+	bool isFormatVBR =
+	aq->mDataFormat.mBytesPerPacket == 0 || aq->mDataFormat.mFramesPerPacket == 0;
+	
+	if (isFormatVBR)
+	{
+		aq->mPacketDescs = (AudioStreamPacketDescription *) AQArena_Alloc(&aq->mArena, aq->mNumPacketsToRead * sizeof(AudioStreamPacketDescription));
+	}
+	else
+	{
+		aq->mPacketDescs = NULL;
+	}
+}
+
+static
+void AQPlayerState_InitPCMFormat(struct AQPlayerState * aq)
+{
+	AudioStreamBasicDescription * clientFormat = &aq->mDataFormat;
+	Float64 sampleRate = clientFormat->mSampleRate;
+	UInt32 numChannels = aq->mNumOutputChannels;
+	
+	if (numChannels == 0)
+	{
+		numChannels = clientFormat->mChannelsPerFrame <= 2 ? clientFormat->mChannelsPerFrame : 2;
+	}
+	
+	// At the rate of the first file
+	FillPCMFormat(clientFormat, sampleRate, numChannels);
+	
+	printf("Decoding to PCM:\n");
+	PrintBasicDescription(clientFormat);
+	
+	AQCrossfade_Init(&aq->mCrossfade, (UInt32) (aq->mCrossfadeSeconds * sampleRate), numChannels);
+	
+	AQEqualizer_Init(&aq->mEqualizer, numChannels, sampleRate);
+	
+	if (!AQEqualizer_SetBands(&aq->mEqualizer, aq->mEqualizerBands, aq->mNumEqualizerBands))
+	{
+		fprintf(stderr, "Equalizer bands must be below %g Hz at this rate, playing without them\n", sampleRate / 2.0);
+	}
+	
+	if (aq->mPeaksPath)
+	{
+		AQPeaksBuilder_Init(&aq->mPeaks, numChannels, sampleRate);
+	}
+	
+	if (aq->mSpectrumSize)
+	{
+		// 75% overlap between consecutive windows
+		aq->mSpectrum = AQSpectrum_Create(aq->mSpectrumSize, aq->mSpectrumSize / 4, numChannels, sampleRate);
+	}
+}
+
+static
+void AQPlayerState_InitPCMSource(struct AQPlayerState * aq)
+{
+	UInt32 maxFrames = aq->bufferByteSize / aq->mDataFormat.mBytesPerFrame;
+	
+	aq->mMixBuffer = (Float32 *) AQArena_Alloc(&aq->mArena, aq->bufferByteSize);
+	
+	if (aq->mBlockFile)
+	{
+		AQPCMSource_OpenBlockFile(&aq->mSource, aq->mBlockFile, &aq->mDataFormat, maxFrames);
+	}
+	else
+	{
+		AQPCMSource_Open(&aq->mSource, aq->mAudioFile, &aq->mHeader, &aq->mDataFormat, maxFrames);
+	}
+}
+
+static
+void AQPlayerState_MagicCookie(struct AQPlayerState * aq)
+{
+	UInt32 cookieSize = aq->mHeader.mCookieSize;
+	
+	if (cookieSize > 0)
+	{
+		printf("Setting aq->mQueue's magic cookie property\n");
+		
+		char * magicCookie = (char *) AQArena_Alloc(&aq->mArena, cookieSize);
+		
+		if (cookieSize <= kAQHeaderInfoMaxCookieSize)
+		{
+			memcpy(magicCookie, aq->mHeader.mCookie, cookieSize);
+		}
+		else
+		{
+			AQ_TRACE_SCOPE("parse", 1);
+			
+			AudioFileGetProperty(aq->mAudioFile, kAudioFilePropertyMagicCookieData, &cookieSize, magicCookie);
+		}
+		
+		AudioQueueSetProperty(aq->mQueue, kAudioQueueProperty_MagicCookie, magicCookie, cookieSize);
+	}
+	else
+	{
+		printf("No magic cookie\n");
+	}
+}
+
+// Forgets the previous file's packet index. A file without fixed frames per packet is
+// only read through to index it on the first seek, off the start path; a stream would
+// have to be downloaded whole, so it is never indexed and cannot seek.
+static
+void AQPlayerState_ResetPacketIndex(struct AQPlayerState * aq)
+{
+	AQPacketTable_CleanUp(&aq->mPacketTable);
+	
+	__atomic_store_n(&aq->mCanIndexPackets,
+					 !aq->mDecodeToPCM && aq->mDataFormat.mFramesPerPacket == 0 && !IsStreamingFile(aq->mAudioFile),
+					 __ATOMIC_RELEASE);
+}
+
+static
+void AQPlayerState_AllocateBuffers(struct AQPlayerState * aq)
+{
+	int k;
+	
+	for (k = 0; k < kNumberBuffers; k++)
+	{
+		AudioQueueAllocateBuffer(aq->mQueue, aq->bufferByteSize, &aq->mBuffers[k]);
+	}
+}
+
+// Frames in a packet of the file, on average when the format does not fix them: from
+// the header's duration and packet count, or the packet table when there is one.
+// 0 when nothing says.
+static
+Float64 AQPlayerState_GetFramesPerPacket(const struct AQPlayerState * aq)
+{
+	if (aq->mDataFormat.mFramesPerPacket > 0)
+	{
+		return aq->mDataFormat.mFramesPerPacket;
+	}
+	
+	if (aq->mHeader.mNumPackets > 0 && aq->mHeader.mDuration > 0)
+	{
+		return aq->mHeader.mDuration * aq->mDataFormat.mSampleRate / aq->mHeader.mNumPackets;
+	}
+	
+	if (aq->mPacketTable.mNumPackets > 0)
+	{
+		return (Float64) aq->mPacketTable.mNumFrames / aq->mPacketTable.mNumPackets;
+	}
+	
+	return 0;
+}
+
+static
+void AQPlayerState_Prime(struct AQPlayerState * aq)
+{
+	int k;
+	aq->mCurrentPacket = 0;
+	aq->mNumPrimedBuffers = kNumberBuffers;
+	
+	// A ramp left over from a player that was recycled before it finished must not
+	// shorten the buffers of this one
+	aq->mRampPackets = 0;
+	
+	if (aq->mFastStartSeconds > 0)
+	{
+		// Prime one short buffer, AQPlayerState_Start fills the rest, each longer than the
+		// last. With no idea of the packet length the ramp starts from a single packet.
+		Float64 framesPerPacket = AQPlayerState_GetFramesPerPacket(aq);
+		
+		aq->mRampPackets = framesPerPacket > 0 ? (UInt32) ceil(aq->mFastStartSeconds * aq->mDataFormat.mSampleRate / framesPerPacket) : 1;
+		aq->mNumPrimedBuffers = 1;
+		
+		if (aq->mRampPackets == 0)
+		{
+			aq->mRampPackets = 1;
+		}
+	}
+	
+	for (k = 0; k < aq->mNumPrimedBuffers; k++)
+	{
+		// Prime on this thread, the queue is not started yet
+		AQPlayerState_FillBuffer(aq, aq->mQueue, aq->mBuffers[k]);
+	}
+}
+
+static
+void AQPlayerState_SetGain(struct AQPlayerState * aq)
+{
+	AudioQueueSetParameter(aq->mQueue, kAudioQueueParam_Volume, aq->mGain);
+}
+
+// Stops the callbacks, then lets a fill task still on the pool find the player
+// stopped and finish, so that the queue and its buffers can be reused or go away
+static
+void AQPlayerState_StopAndDrain(struct AQPlayerState * aq)
+{
+	__atomic_store_n(&aq->mIsRunning, false, __ATOMIC_RELEASE);
+	AudioQueueStop(aq->mQueue, true);
+	
+	while (__atomic_load_n(&aq->mNumPendingFills, __ATOMIC_ACQUIRE) > 0)
+	{
+		sched_yield();
+	}
+}
+
+void AQPlayerState_CleanUp(struct AQPlayerState * aq)
+{
+	if (aq->mThreadPool)
+	{
+		AQPlayerState_StopAndDrain(aq);
+	}
+	
+	AudioQueueDispose(aq->mQueue, true);
+	
+	if (aq->mDecodeToPCM)
+	{
+		// The sources own the audio files, including the one in mAudioFile or mBlockFile
+		AQPCMSource_Close(&aq->mSource);
+		AQPCMSource_Close(&aq->mNextSource);
+		AQCrossfade_CleanUp(&aq->mCrossfade);
+		
+		if (aq->mPeaksPath)
+		{
+			if (!AQPeaksBuilder_Write(&aq->mPeaks, aq->mPeaksPath))
+			{
+				fprintf(stderr, "Could not write peaks to %s\n", aq->mPeaksPath);
+			}
+			
+			AQPeaksBuilder_CleanUp(&aq->mPeaks);
+		}
+		
+		AQSpectrum_Dispose(aq->mSpectrum);
+	}
+	else if (aq->mAudioFile)
+	{
+		// A recycled player has already closed its file
+		CloseAudioFile(aq->mAudioFile);
+	}
+	
+	AQPacketTable_CleanUp(&aq->mPacketTable);
+	AQArena_CleanUp(&aq->mArena);
+}
+
+void AQPlayerState_SetPlaylist(struct AQPlayerState * aq, const char * const * files, UInt32 count, Float64 crossfadeSeconds)
+{
+	aq->mPlaylist = files;
+	aq->mPlaylistCount = count;
+	aq->mPlaylistIndex = 0;
+	aq->mCrossfadeSeconds = crossfadeSeconds;
+	aq->mDecodeToPCM = true;
+}
+
+void AQPlayerState_SetEqualizerBands(struct AQPlayerState * aq, const struct AQBiquadBand * bands, UInt32 numBands)
+{
+	aq->mEqualizerBands = bands;
+	aq->mNumEqualizerBands = numBands;
+	aq->mDecodeToPCM = true;
+}
+
+void AQPlayerState_SetThreadPool(struct AQPlayerState * aq, struct AQThreadPool * pool)
+{
+	aq->mThreadPool = pool;
+}
+
+void AQPlayerState_SetHeaderCache(struct AQPlayerState * aq, struct AQHeaderCache * cache)
+{
+	aq->mHeaderCache = cache;
+}
+
+bool AQPlayerState_IsRunning(struct AQPlayerState * aq)
+{
+	return __atomic_load_n(&aq->mIsRunning, __ATOMIC_ACQUIRE);
+}
+
+OSStatus AQPlayerState_Start(struct AQPlayerState * aq)
+{
+	UInt32 numRemaining = kNumberBuffers - aq->mNumPrimedBuffers;
+	OSStatus result;
+	int k;
+	
+	// After a fast start the remaining buffers are filled while the first one plays. On
+	// the pool they go through mPendingBuffers like any other, handed over before the
+	// queue runs so that its callback is never a second producer at the same time.
+	if (aq->mThreadPool)
+	{
+		for (k = aq->mNumPrimedBuffers; k < kNumberBuffers; k++)
+		{
+			aq->mPendingBuffers[aq->mPendingHead % kNumberBuffers] = aq->mBuffers[k];
+			aq->mPendingHead++;
+		}
+		
+		__atomic_add_fetch(&aq->mNumPendingFills, numRemaining, __ATOMIC_RELEASE);
+	}
+	
+	result = AudioQueueStart(aq->mQueue, NULL);
+	
+	if (result != noErr)
+	{
+		if (aq->mThreadPool)
+		{
+			aq->mPendingHead -= numRemaining;
+			__atomic_sub_fetch(&aq->mNumPendingFills, numRemaining, __ATOMIC_RELEASE);
+		}
+		
+		return result;
+	}
+	
+	if (numRemaining > 0 && aq->mThreadPool)
+	{
+		// A callback that came in meanwhile saw fills pending and left submitting to us
+		AQThreadPool_Submit(aq->mThreadPool, AQPlayerState_FillPendingBuffers, aq);
+	}
+	else
+	{
+		// The callbacks run on this thread's run loop, so nothing else is filling
+		for (k = aq->mNumPrimedBuffers; k < kNumberBuffers; k++)
+		{
+			AQPlayerState_FillBuffer(aq, aq->mQueue, aq->mBuffers[k]);
+		}
+	}
+	
+	aq->mNumPrimedBuffers = kNumberBuffers;
+	
+	return noErr;
+}
+
+Float64 AQPlayerState_GetTimeToFirstSample(struct AQPlayerState * aq)
+{
+	UInt64 firstSampleNanos = __atomic_load_n(&aq->mFirstSampleNanos, __ATOMIC_ACQUIRE);
+	
+	if (firstSampleNanos == 0)
+	{
+		return -1;
+	}
+	
+	return (firstSampleNanos - aq->mInitializeNanos) * 1e-9;
+}
+
+bool AQPlayerState_RequestSeek(struct AQPlayerState * aq, Float64 seconds)
+{
+	SInt64 frame = seconds > 0 ? (SInt64) (seconds * aq->mDataFormat.mSampleRate) : 0;
+	
+	if (!aq->mDecodeToPCM && aq->mDataFormat.mFramesPerPacket == 0 && !__atomic_load_n(&aq->mCanIndexPackets, __ATOMIC_ACQUIRE))
+	{
+		return false;
+	}
+	
+	__atomic_store_n(&aq->mSeekRequest, frame + 1, __ATOMIC_RELEASE);
+	
+	return true;
+}
+
+Float64 AQPlayerState_GetPosition(struct AQPlayerState * aq)
+{
+	return __atomic_load_n(&aq->mFramePosition, __ATOMIC_ACQUIRE) / aq->mDataFormat.mSampleRate;
+}
+
+void AQPlayerState_ChangeGain(struct AQPlayerState * aq, Float32 gain)
+{
+	aq->mGain = gain;
+	
+	AQPlayerState_SetGain(aq);
+}
+
+void AQPlayerState_Recycle(struct AQPlayerState * aq)
+{
+	AQPlayerState_StopAndDrain(aq);
+	
+	CloseAudioFile(aq->mAudioFile);
+	aq->mAudioFile = NULL;
+}
+
+void AQPlayerState_Retarget(struct AQPlayerState * aq, AudioFileID audioFile, const struct AQHeaderInfo * header)
+{
+	aq->mInitializeNanos = GetMonotonicNanos();
+	aq->mFirstSampleNanos = 0;
+	aq->mAudioFile = audioFile;
+	aq->mHeader = *header;
+	aq->mSeekRequest = 0;
+	aq->mFramePosition = 0;
+	aq->mIsRunning = true;
+	aq->mGain = 1.0;
+	
+	// Same format, but the packet size bound, and so the buffer size, is per file
+	AQPlayerState_InitSizes(aq);
+	
+	if (aq->bufferByteSize > aq->mBuffers[0]->mAudioDataBytesCapacity)
+	{
+		int k;
+		
+		for (k = 0; k < kNumberBuffers; k++)
+		{
+			AudioQueueFreeBuffer(aq->mQueue, aq->mBuffers[k]);
+		}
+		
+		AQPlayerState_AllocateBuffers(aq);
+	}
+	
+	// Only compressed players are retargeted, so the arena holds nothing but the
+	// previous file's packet descriptions and cookie
+	AQArena_Reset(&aq->mArena);
+	AQPlayerState_AllocatePacketDescriptionsArray(aq);
+	
+	// Files of one format can still differ in their decoder configuration
+	AQPlayerState_MagicCookie(aq);
+	AQPlayerState_ResetPacketIndex(aq);
+	
+	AQPlayerState_Prime(aq);
+	AQPlayerState_SetGain(aq);
+}
+
+// Everything AQPlayerState_Initialize does once mAudioFile, or mBlockFile, and mHeader are
+// set. Fails, holding nothing but the file, only when the queue cannot be created.
+static
+OSStatus AQPlayerState_InitializeOpened(struct AQPlayerState * aq)
+{
+	aq->mInitializeNanos = GetMonotonicNanos();
+	aq->mIsRunning = true;
+	aq->mGain = 1.0;
+	
+	AQArena_Init(&aq->mArena, kPlayerArenaBlockSize);
+	AQPacketTable_Init(&aq->mPacketTable, 0);
+	aq->mCanIndexPackets = false;
+	
+	// Init basic description property
+	AQPlayerState_InitBasicDescription(aq);
+	
+	if (aq->mDecodeToPCM)
+	{
+		// Decode the file ourselves and switch mDataFormat to the PCM we produce
+		AQPlayerState_InitPCMFormat(aq);
+	}
+	
+	// Init audio queue
+	OSStatus result = AQPlayerState_InitOutputQueue(aq);
+	
+	if (result != noErr)
+	{
+		AQArena_CleanUp(&aq->mArena);
+		return result;
+	}
+	
+	// Init buffer & packet size numbers
+	AQPlayerState_InitSizes(aq);
+	
+	// Allocate audio queue packet descriptor array
+	AQPlayerState_AllocatePacketDescriptionsArray(aq);
+	
+	if (aq->mDecodeToPCM)
+	{
+		// Start decoding, with scratch space for the next file during a crossfade
+		AQPlayerState_InitPCMSource(aq);
+	}
+	else
+	{
+		// Set the magic cookie property of the audio queue
+		AQPlayerState_MagicCookie(aq);
+		
+		// Whether a seek can index the packets, when a frame cannot be found from the
+		// packet number alone
+		AQPlayerState_ResetPacketIndex(aq);
+	}
+	
+	// Allocate audio queue buffers and prime them
+	AQPlayerState_AllocateBuffers(aq);
+	AQPlayerState_Prime(aq);
+	
+	// Set the gain
+	AQPlayerState_SetGain(aq);
+	
+	return noErr;
+}
+
+OSStatus AQPlayerState_InitializeWithAudioFile(struct AQPlayerState * aq, AudioFileID audioFile, const struct AQHeaderInfo * header)
+{
+	aq->mAudioFile = audioFile;
+	aq->mHeader = *header;
+	
+	return AQPlayerState_InitializeOpened(aq);
+}
+
+void AQPlayerState_Initialize(struct AQPlayerState * aq, const char audioFileName[])
+{
+	UInt64 requestNanos = GetMonotonicNanos();
+	
+	// Init audio file with system path
+	AQPlayerState_InitAudioFile(aq, audioFileName);
+	
+	CheckError(AQPlayerState_InitializeOpened(aq), "AudioQueueNewOutput");
+	
+	// Time to first sample counts the file open too
+	aq->mInitializeNanos = requestNanos;
+}
@@ -0,0 +1,379 @@
+//
+//  AQPlayerState.h
+//  PlayingAudioExample
+//
+
+#ifndef AQPlayerState_h
+#define AQPlayerState_h
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <AudioToolbox/AudioToolbox.h>
+#include <AudioToolbox/AudioQueue.h>
+#include <AudioToolbox/AudioFile.h>
+#include <AudioToolbox/ExtendedAudioFile.h>
+
+#include "AQArena.h"
+#include "AQBlockFile.h"
+#include "AQChannelMap.h"
+#include "AQCrossfade.h"
+#include "AQEqualizer.h"
+#include "AQHeaderCache.h"
+#include "AQHTTPStream.h"
+#include "AQPacketTable.h"
+#include "AQPeaks.h"
+#include "AQSampleConvert.h"
+#include "AQSpectrum.h"
+#include "AQThreadPool.h"
+
+// Set the number of buffers to use
+static const int kNumberBuffers = 3;
+
+// Bytes of an http:// stream buffered before the file is parsed and playback primed
+static const UInt32 kDefaultStreamWatermarkBytes = 64 * 1024;
+
+struct AQPCMSource
+{
+	/* Description:
+	 * The audio file being decoded, or the block file when it is one of those,
+	 * which AudioFile does not read. Owned by the source once it has been opened.
+	 */
+	AudioFileID mAudioFile;
+	struct AQBlockFile * mBlockFile;
+	
+	/* Description:
+	 * Wraps mAudioFile and converts its packets to the player's linear PCM client format.
+	 * NULL when mConvertKernel is used instead.
+	 */
+	ExtAudioFileRef mExtAudioFile;
+	
+	/* Description:
+	 * For files that already are linear PCM at the player's sample rate: the kernel
+	 * converting their samples to float, picked for the exact sample layout when the
+	 * source is opened. Packets are read straight into mRawBuffer, starting at
+	 * mCurrentPacket, and converted from there. Block files always go this way.
+	 */
+	AQSampleConvertKernel mConvertKernel;
+	void * mRawBuffer;
+	UInt32 mFileBytesPerFrame;
+	SInt64 mCurrentPacket;
+	
+	/* Description:
+	 * The format the file is decoded to: the player's PCM format, but with the
+	 * file's own channel count.
+	 */
+	AudioStreamBasicDescription mFormat;
+	
+	/* Description:
+	 * Remaps mFormat's channels to the player's. When this is not the identity the
+	 * file is decoded into mDecodeBuffer first, then mixed down into the destination.
+	 */
+	struct AQChannelMap mChannelMap;
+	Float32 * mDecodeBuffer;
+	
+	/* Description:
+	 * Frames left to decode, in the client sample rate. Used to decide when the
+	 * crossfade into the next file has to begin.
+	 */
+	SInt64 mFramesRemaining;
+	
+	/* Description:
+	 * Length of the file and the next frame to decode, both in the client sample
+	 * rate, and the file's own rate for seeking through mExtAudioFile.
+	 */
+	SInt64 mLengthFrames;
+	SInt64 mFramePosition;
+	Float64 mFileSampleRate;
+};
+
+struct AQPlayerState
+{
+	
+	/* Description:
+	 * From CoreAudioTypes.h, representing the audio data format of the file being played.
+	 * Gets used by the audio queue specified in the mQueue field.
+	 */
+	AudioStreamBasicDescription mDataFormat;
+	
+	/* Description:
+	 * The playback audio queue created by your application.
+	 */
+	AudioQueueRef mQueue;
+	
+	/* Description:
+	 * An array holding pointers to the audio queue buffers managed
+	 * by the audio queue.
+	 */
+	AudioQueueBufferRef mBuffers[kNumberBuffers];
+	
+	/* Description:
+	 * An audio file object that represents the audio file your program plays.
+	 * NULL when it is a block file, which is mBlockFile instead and is always
+	 * decoded to PCM.
+	 */
+	AudioFileID mAudioFile;
+	struct AQBlockFile * mBlockFile;
+	
+	/* Description:
+	 * The header properties of mAudioFile, read once when it is opened: from
+	 * mHeaderCache when that holds the file as it is on disk, otherwise from the
+	 * file, and then kept in mHeaderCache. The cache may be NULL and is shared, not
+	 * owned by the player.
+	 */
+	struct AQHeaderCache * mHeaderCache;
+	struct AQHeaderInfo mHeader;
+	
+	/* Description:
+	 * The size, in bytes, for each audio queue buffer. This value is calculated
+	 * in the DeriveBufferSize function, after the audio queue is created and before
+	 * it is started.
+	 */
+	UInt32 bufferByteSize;
+	
+	/* Description:
+	 * The packet index for the next packet ot play from the audio file.
+	 */
+	SInt64 mCurrentPacket;
+	
+	/* Description:
+	 * The number of packets to read on each invocation of the audio queue's playback callback.
+	 * Like the bufferByteSize field, this value is calculated in these examples in the DeriveBufferSize
+	 * function, after the audio queue is created and before it is started.
+	 */
+	UInt32 mNumPacketsToRead;
+	
+	/* Description:
+	 * For VBR audio data, the array of packet descriptions for the file being played. For CBR data,
+	 * the value of this field is NULL.
+	 */
+	AudioStreamPacketDescription  *mPacketDescs;
+	
+	/* Description:
+	 * Where the per-player allocations made while initializing come from: the packet
+	 * descriptions, the magic cookie and mMixBuffer. Released at once by CleanUp.
+	 * The queue buffers belong to the queue and are not part of it.
+	 */
+	struct AQArena mArena;
+	
+	/* Description:
+	 * A Boolean value indicating whether or not the audio queue is running.
+	 * Read and written with __atomic builtins once the queue runs off the main thread.
+	 */
+	bool mIsRunning;
+	
+	/* Description:
+	 * When set, the queue calls back on its own internal thread and the callback only
+	 * hands the buffer over: it is queued in mPendingBuffers and filled by a task on
+	 * this pool. mNumPendingFills counts the buffers handed over and not yet filled;
+	 * only the callback that raises it from zero submits a task, and that task keeps
+	 * filling until it drops back to zero, so fills of one player never overlap.
+	 */
+	struct AQThreadPool * mThreadPool;
+	AudioQueueBufferRef mPendingBuffers[kNumberBuffers];
+	UInt32 mPendingHead;
+	UInt32 mPendingTail;
+	UInt32 mNumPendingFills;
+	
+	/* Description:
+	 * Frame to seek to plus one, or 0 when no seek is pending. Any thread may post
+	 * one; the next buffer fill picks it up, so the buffers already queued still play.
+	 */
+	SInt64 mSeekRequest;
+	
+	/* Description:
+	 * Index of every packet of a compressed file whose packets carry their own frame
+	 * counts, so that a seek can find the packet holding a frame. Built by the fill
+	 * that picks up the first seek, and empty until then. mCanIndexPackets tells
+	 * whether such a file can be indexed: not streams, nor files that could not be
+	 * read through.
+	 */
+	struct AQPacketTable mPacketTable;
+	bool mCanIndexPackets;
+	
+	/* Description:
+	 * Position in the current file, in frames, after the latest buffer fill.
+	 * Written by the fills, read atomically by anyone.
+	 */
+	SInt64 mFramePosition;
+	
+	/* Description:
+	 * Linear volume of the queue.
+	 */
+	Float32 mGain;
+	
+	/* Description:
+	 * When non-zero, AQPlayerState_Initialize primes a single buffer of about this
+	 * many seconds instead of all of them, so the queue can start sooner.
+	 * mNumPrimedBuffers is how many it did prime; mRampPackets is the packet count
+	 * of the next fill while fills ramp back up to full buffers, 0 after that.
+	 */
+	Float64 mFastStartSeconds;
+	int mNumPrimedBuffers;
+	UInt32 mRampPackets;
+	
+	/* Description:
+	 * Monotonic clock readings, in nanoseconds, at the start of
+	 * AQPlayerState_Initialize and when the queue started running.
+	 * mFirstSampleNanos is 0 until then and is accessed atomically.
+	 */
+	UInt64 mInitializeNanos;
+	UInt64 mFirstSampleNanos;
+	
+	/* Description:
+	 * When true the queue is fed 32 bit float linear PCM decoded by mSource instead
+	 * of the file's own packets, and mDataFormat describes that PCM. Set by
+	 * AQPlayerState_SetPlaylist, since crossfading needs samples to blend.
+	 */
+	bool mDecodeToPCM;
+	
+	/* Description:
+	 * The file currently playing, and the file being faded in while a crossfade
+	 * is in progress (mNextSource.mAudioFile is NULL otherwise).
+	 */
+	struct AQPCMSource mSource;
+	struct AQPCMSource mNextSource;
+	
+	/* Description:
+	 * Paths to play back to back, and the index of the one in mSource.
+	 */
+	const char * const * mPlaylist;
+	UInt32 mPlaylistCount;
+	UInt32 mPlaylistIndex;
+	
+	/* Description:
+	 * Equal-power curves for the blend between consecutive playlist entries.
+	 */
+	Float64 mCrossfadeSeconds;
+	struct AQCrossfade mCrossfade;
+	
+	/* Description:
+	 * Scratch buffer of bufferByteSize bytes the head of mNextSource is decoded into.
+	 */
+	Float32 * mMixBuffer;
+	
+	/* Description:
+	 * Channel count of the PCM handed to the queue, 0 to pick one from the first
+	 * file (its own count for mono and stereo, a stereo downmix beyond that).
+	 */
+	UInt32 mNumOutputChannels;
+	
+	/* Description:
+	 * Biquad cascade applied to the decoded PCM, and the bands it starts out with.
+	 * Later changes go through AQEqualizer_SetBands, which is safe while playing.
+	 */
+	struct AQEqualizer mEqualizer;
+	const struct AQBiquadBand * mEqualizerBands;
+	UInt32 mNumEqualizerBands;
+	
+	/* Description:
+	 * When mPeaksPath is set, a waveform summary of the decoded audio is built while
+	 * playing and written there on clean up.
+	 */
+	const char * mPeaksPath;
+	struct AQPeaksBuilder mPeaks;
+	
+	/* Description:
+	 * Spectrum analyser tapping the PCM handed to the queue, created when
+	 * mSpectrumSize is non-zero. Read it with AQSpectrum_Acquire from one other thread.
+	 */
+	UInt32 mSpectrumSize;
+	struct AQSpectrum * mSpectrum;
+};
+
+// Nanoseconds on a clock that never jumps
+UInt64 GetMonotonicNanos();
+
+// Prints the error and exits unless error is noErr
+void CheckError(OSStatus error, const char *operation);
+
+// filePath may also be an http:// URL, which is streamed rather than downloaded first.
+// Prints what went wrong and returns the error when the file does not open.
+OSStatus OpenAudioFile(const char filePath[], AudioFileID * outAudioFile);
+
+// OpenAudioFile, also filling outHeader: from cache when it holds the file as it is on
+// disk, otherwise from the file, storing it in cache for next time. cache may be NULL.
+OSStatus OpenAudioFileWithHeader(const char filePath[], struct AQHeaderCache * cache, AudioFileID * outAudioFile, struct AQHeaderInfo * outHeader);
+
+// The file's stream format, as the header holds it
+void FillFormatFromHeader(AudioStreamBasicDescription * format, const struct AQHeaderInfo * header);
+
+// Opens a file ending in kAQBlockFileExtension; exits if it cannot be opened, or has
+// more channels than the player maps
+struct AQBlockFile * OpenBlockFile(const char filePath[]);
+
+// Closes a file from OpenAudioFile, along with its stream
+void CloseAudioFile(AudioFileID audioFile);
+
+// Applies to http:// files opened from now on
+void SetStreamWatermark(UInt32 numBytes);
+
+// Reads through the whole file to index every packet, offsets counted from the start
+// of the audio data. Returns false if the file could not be read to the end.
+bool BuildPacketTable(AudioFileID audioFile, struct AQPacketTable * outTable);
+
+// Native-endian packed float
+void FillPCMFormat(AudioStreamBasicDescription * format, Float64 sampleRate, UInt32 numChannels);
+
+// Takes ownership of audioFile, whose header is from OpenAudioFileWithHeader; maxFrames
+// bounds the numFrames of every AQPCMSource_Read
+void AQPCMSource_Open(struct AQPCMSource * src, AudioFileID audioFile, const struct AQHeaderInfo * header, const AudioStreamBasicDescription * outputFormat, UInt32 maxFrames);
+
+// AQPCMSource_Open for a block file, which has to be at outputFormat's sample rate
+void AQPCMSource_OpenBlockFile(struct AQPCMSource * src, struct AQBlockFile * blockFile, const AudioStreamBasicDescription * outputFormat, UInt32 maxFrames);
+
+// Decodes up to numFrames into dst in the player's format and returns the number of frames decoded
+UInt32 AQPCMSource_Read(struct AQPCMSource * src, Float32 * dst, UInt32 numFrames);
+
+// Continues decoding at frame, in the client sample rate
+void AQPCMSource_Seek(struct AQPCMSource * src, SInt64 frame);
+
+void AQPCMSource_Close(struct AQPCMSource * src);
+
+// Plays files back to back with a crossfade; files must outlive the player
+void AQPlayerState_SetPlaylist(struct AQPlayerState * aq, const char * const * files, UInt32 count, Float64 crossfadeSeconds);
+
+// Bands the equalizer starts out with; bands must outlive AQPlayerState_Initialize
+void AQPlayerState_SetEqualizerBands(struct AQPlayerState * aq, const struct AQBiquadBand * bands, UInt32 numBands);
+
+// Fills buffers on pool instead of the calling thread's run loop; call before AQPlayerState_Initialize
+void AQPlayerState_SetThreadPool(struct AQPlayerState * aq, struct AQThreadPool * pool);
+
+// Looks up and keeps the headers of the files the player opens in cache, which has to
+// outlive the player; call before AQPlayerState_Initialize
+void AQPlayerState_SetHeaderCache(struct AQPlayerState * aq, struct AQHeaderCache * cache);
+
+bool AQPlayerState_IsRunning(struct AQPlayerState * aq);
+
+// Starts the queue, then fills the buffers a fast start left out
+OSStatus AQPlayerState_Start(struct AQPlayerState * aq);
+
+// Seconds from AQPlayerState_Initialize to the queue running, -1 until it runs
+Float64 AQPlayerState_GetTimeToFirstSample(struct AQPlayerState * aq);
+
+// Safe from any thread while playing; takes effect from the next buffer filled. Returns
+// false, leaving the position alone, when the file has no way to find a frame.
+bool AQPlayerState_RequestSeek(struct AQPlayerState * aq, Float64 seconds);
+
+Float64 AQPlayerState_GetPosition(struct AQPlayerState * aq);
+
+void AQPlayerState_ChangeGain(struct AQPlayerState * aq, Float32 gain);
+
+// Opens the file, creates the queue and primes its buffers; the queue still has to be
+// started. Exits when the file does not open or the queue cannot play it.
+void AQPlayerState_Initialize(struct AQPlayerState * aq, const char audioFileName[]);
+
+// AQPlayerState_Initialize for a file from OpenAudioFileWithHeader, which the player takes
+// over once this succeeds. Returns the error, leaving the file to the caller, when the
+// queue cannot be created.
+OSStatus AQPlayerState_InitializeWithAudioFile(struct AQPlayerState * aq, AudioFileID audioFile, const struct AQHeaderInfo * header);
+
+// Stops a player that is not decoding to PCM and closes its file, keeping the
+// queue, its buffers and its format so AQPlayerState_Retarget can reuse them
+void AQPlayerState_Recycle(struct AQPlayerState * aq);
+
+// Points a recycled player at audioFile, which has to have exactly the player's
+// mDataFormat, and primes it as AQPlayerState_Initialize would
+void AQPlayerState_Retarget(struct AQPlayerState * aq, AudioFileID audioFile, const struct AQHeaderInfo * header);
+
+void AQPlayerState_CleanUp(struct AQPlayerState * aq);
+
+#endif /* AQPlayerState_h */
@@ -0,0 +1,232 @@
+//
+//  AQSampleConvert.cpp
+//  PlayingAudioExample
+//
+
+#include "AQSampleConvert.h"
+#include "AQSimd.h"
+
+#include <string.h>
+
+/* Sample readers: one per stored type and byte order, each turning the bytes
+ * of a single sample into a float. Byte order is a template parameter, so the
+ * swap is resolved at compile time.
+ */
+
+struct AQReadUInt8
+{
+	enum { kBytes = 1 };
+	
+	static inline Float32 Read(const UInt8 * p)
+	{
+		return ((SInt32) p[0] - 128) * (1.f / 128.f);
+	}
+};
+
+template <bool BigEndian>
+struct AQReadSInt16
+{
+	enum { kBytes = 2 };
+	
+	static inline Float32 Read(const UInt8 * p)
+	{
+		UInt16 v = BigEndian ? (UInt16) ((p[0] << 8) | p[1]) : (UInt16) ((p[1] << 8) | p[0]);
+		
+		return (SInt16) v * (1.f / 32768.f);
+	}
+};
+
+template <bool BigEndian>
+struct AQReadSInt24
+{
+	enum { kBytes = 3 };
+	
+	static inline Float32 Read(const UInt8 * p)
+	{
+		// Assemble in the top 24 bits, then an arithmetic shift sign extends
+		UInt32 v = BigEndian ? ((UInt32) p[0] << 24) | ((UInt32) p[1] << 16) | ((UInt32) p[2] << 8)
+							 : ((UInt32) p[2] << 24) | ((UInt32) p[1] << 16) | ((UInt32) p[0] << 8);
+		
+		return ((SInt32) v >> 8) * (1.f / 8388608.f);
+	}
+};
+
+template <bool BigEndian>
+struct AQReadSInt32
+{
+	enum { kBytes = 4 };
+	
+	static inline Float32 Read(const UInt8 * p)
+	{
+		UInt32 v = BigEndian ? ((UInt32) p[0] << 24) | ((UInt32) p[1] << 16) | ((UInt32) p[2] << 8) | p[3]
+							 : ((UInt32) p[3] << 24) | ((UInt32) p[2] << 16) | ((UInt32) p[1] << 8) | p[0];
+		
+		return (SInt32) v * (1.f / 2147483648.f);
+	}
+};
+
+template <bool BigEndian>
+struct AQReadFloat32
+{
+	enum { kBytes = 4 };
+	
+	static inline Float32 Read(const UInt8 * p)
+	{
+		UInt32 v = BigEndian ? ((UInt32) p[0] << 24) | ((UInt32) p[1] << 16) | ((UInt32) p[2] << 8) | p[3]
+							 : ((UInt32) p[3] << 24) | ((UInt32) p[2] << 16) | ((UInt32) p[1] << 8) | p[0];
+		Float32 x;
+		
+		memcpy(&x, &v, sizeof(x));
+		return x;
+	}
+};
+
+template <bool BigEndian>
+struct AQReadFloat64
+{
+	enum { kBytes = 8 };
+	
+	static inline Float32 Read(const UInt8 * p)
+	{
+		UInt64 v = 0;
+		Float64 x;
+		int k;
+		
+		for (k = 0; k < 8; k++)
+		{
+			v |= (UInt64) p[BigEndian ? k : 7 - k] << (56 - 8 * k);
+		}
+		
+		memcpy(&x, &v, sizeof(x));
+		return (Float32) x;
+	}
+};
+
+/* Generic kernel. NumChannels is 0 when the channel count is only known at
+ * runtime; otherwise the per-frame channel loop has a constant trip count and
+ * is unrolled.
+ */
+template <class Reader, UInt32 NumChannels, bool Interleaved>
+static
+void AQSampleConvert_Kernel(const void * in, Float32 * out, UInt32 numFrames, UInt32 numChannelsAtRuntime)
+{
+	const UInt32 numChannels = NumChannels ? NumChannels : numChannelsAtRuntime;
+	const UInt8 * src = (const UInt8 *) in;
+	UInt32 f, c;
+	
+	for (f = 0; f < numFrames; f++, out += numChannels)
+	{
+		for (c = 0; c < numChannels; c++)
+		{
+			UInt32 sampleIndex = Interleaved ? f * numChannels + c : c * numFrames + f;
+			
+			out[c] = Reader::Read(src + sampleIndex * Reader::kBytes);
+		}
+	}
+}
+
+/* Native little endian 16 bit interleaved, the bulk of the traffic: whole
+ * vectors of samples are widened and scaled regardless of the channel count,
+ * since interleaved input maps one-to-one onto interleaved output.
+ */
+static
+void AQSampleConvert_SInt16NativeInterleaved(const void * in, Float32 * out, UInt32 numFrames, UInt32 numChannels)
+{
+	const SInt16 * src = (const SInt16 *) in;
+	UInt32 numSamples = numFrames * numChannels;
+	AQFloat4 scale = AQFloat4_Set1(1.f / 32768.f);
+	UInt32 k = 0;
+	
+	for (; k + 2 * AQ_SIMD_WIDTH <= numSamples; k += 2 * AQ_SIMD_WIDTH)
+	{
+		AQFloat4_Store(out + k, AQFloat4_Mul(AQFloat4_LoadSInt16(src + k), scale));
+		AQFloat4_Store(out + k + AQ_SIMD_WIDTH, AQFloat4_Mul(AQFloat4_LoadSInt16(src + k + AQ_SIMD_WIDTH), scale));
+	}
+	
+	for (; k < numSamples; k++)
+	{
+		out[k] = src[k] * (1.f / 32768.f);
+	}
+}
+
+template <class Reader>
+static
+AQSampleConvertKernel AQSampleConvert_SelectForReader(const struct AQSampleLayout * layout)
+{
+	if (layout->mIsInterleaved)
+	{
+		switch (layout->mNumChannels)
+		{
+			case 1:  return AQSampleConvert_Kernel<Reader, 1, true>;
+			case 2:  return AQSampleConvert_Kernel<Reader, 2, true>;
+			default: return AQSampleConvert_Kernel<Reader, 0, true>;
+		}
+	}
+	
+	switch (layout->mNumChannels)
+	{
+		case 1:  return AQSampleConvert_Kernel<Reader, 1, false>;
+		case 2:  return AQSampleConvert_Kernel<Reader, 2, false>;
+		default: return AQSampleConvert_Kernel<Reader, 0, false>;
+	}
+}
+
+static
+bool AQSampleConvert_HostIsBigEndian()
+{
+	const UInt16 probe = 1;
+	
+	return *(const UInt8 *) &probe == 0;
+}
+
+AQSampleConvertKernel AQSampleConvert_SelectKernel(const struct AQSampleLayout * layout)
+{
+	bool bigEndian = layout->mIsBigEndian;
+	
+	if (layout->mNumChannels == 0)
+	{
+		return NULL;
+	}
+	
+	switch (layout->mType)
+	{
+		case kAQSampleType_UInt8:
+			return AQSampleConvert_SelectForReader<AQReadUInt8>(layout);
+		case kAQSampleType_SInt16:
+			if (layout->mIsInterleaved && bigEndian == AQSampleConvert_HostIsBigEndian())
+			{
+				return AQSampleConvert_SInt16NativeInterleaved;
+			}
+			return bigEndian ? AQSampleConvert_SelectForReader<AQReadSInt16<true> >(layout)
+							 : AQSampleConvert_SelectForReader<AQReadSInt16<false> >(layout);
+		case kAQSampleType_SInt24:
+			return bigEndian ? AQSampleConvert_SelectForReader<AQReadSInt24<true> >(layout)
+							 : AQSampleConvert_SelectForReader<AQReadSInt24<false> >(layout);
+		case kAQSampleType_SInt32:
+			return bigEndian ? AQSampleConvert_SelectForReader<AQReadSInt32<true> >(layout)
+							 : AQSampleConvert_SelectForReader<AQReadSInt32<false> >(layout);
+		case kAQSampleType_Float32:
+			return bigEndian ? AQSampleConvert_SelectForReader<AQReadFloat32<true> >(layout)
+							 : AQSampleConvert_SelectForReader<AQReadFloat32<false> >(layout);
+		case kAQSampleType_Float64:
+			return bigEndian ? AQSampleConvert_SelectForReader<AQReadFloat64<true> >(layout)
+							 : AQSampleConvert_SelectForReader<AQReadFloat64<false> >(layout);
+	}
+	
+	return NULL;
+}
+
+UInt32 AQSampleConvert_BytesPerSample(AQSampleType type)
+{
+	switch (type)
+	{
+		case kAQSampleType_UInt8:   return 1;
+		case kAQSampleType_SInt16:  return 2;
+		case kAQSampleType_SInt24:  return 3;
+		case kAQSampleType_SInt32:  return 4;
+		case kAQSampleType_Float32: return 4;
+		case kAQSampleType_Float64: return 8;
+	}
+	
+	return 0;
+}
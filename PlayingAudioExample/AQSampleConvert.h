@@ -0,0 +1,49 @@
+//
+//  AQSampleConvert.h
+//  PlayingAudioExample
+//
+
+/* Conversion of linear PCM as stored in a file to the interleaved 32 bit float
+ * the player works in. Every supported (sample type, byte order, channel count,
+ * interleaving) combination is its own template instantiation, so the inner
+ * loops have no per-sample branches; AQSampleConvert_SelectKernel picks one
+ * when a source is opened and the fill path only calls through the pointer.
+ */
+
+#ifndef AQSampleConvert_h
+#define AQSampleConvert_h
+
+#include "AQTypes.h"
+
+enum AQSampleType
+{
+	kAQSampleType_UInt8,		// offset binary, as in 8 bit WAVE
+	kAQSampleType_SInt16,
+	kAQSampleType_SInt24,		// packed in 3 bytes
+	kAQSampleType_SInt32,
+	kAQSampleType_Float32,
+	kAQSampleType_Float64
+};
+
+struct AQSampleLayout
+{
+	AQSampleType mType;
+	bool mIsBigEndian;
+	
+	/* Description:
+	 * False when each channel is stored as a contiguous block of numFrames samples.
+	 */
+	bool mIsInterleaved;
+	
+	UInt32 mNumChannels;
+};
+
+// Converts numFrames frames of in to interleaved floats in [-1, 1)
+typedef void (*AQSampleConvertKernel)(const void * in, Float32 * out, UInt32 numFrames, UInt32 numChannels);
+
+// Returns NULL if the layout is not supported
+AQSampleConvertKernel AQSampleConvert_SelectKernel(const struct AQSampleLayout * layout);
+
+UInt32 AQSampleConvert_BytesPerSample(AQSampleType type);
+
+#endif /* AQSampleConvert_h */
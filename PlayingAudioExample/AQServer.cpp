@@ -0,0 +1,353 @@
+//
+//  AQServer.cpp
+//  PlayingAudioExample
+//
+
+#include "AQServer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const UInt32 kInitialMaxSlots = 64;
+static const UInt32 kSlotMask = (1 << kAQServerSlotBits) - 1;
+
+// True once the player has read its last buffer and the queue has played it
+static
+bool AQServer_HasPlayedOut(struct AQPlayerState * player)
+{
+	UInt32 isRunning = 0;
+	UInt32 propertySize = sizeof(isRunning);
+	
+	if (AQPlayerState_IsRunning(player))
+	{
+		return false;
+	}
+	
+	if (AudioQueueGetProperty(player->mQueue, kAudioQueueProperty_IsRunning, &isRunning, &propertySize) != noErr)
+	{
+		return true;
+	}
+	
+	return isRunning == 0;
+}
+
+/* Description:
+ * A load command being worked on by the load pool.
+ */
+struct AQServerLoad
+{
+	struct AQServer * mServer;
+	char * mPath;
+	struct AQControlDeferred * mDeferred;
+	struct AQPlayerState * mPlayer;
+};
+
+static
+UInt32 AQServer_TakeSlot(struct AQServer * server)
+{
+	if (server->mNumFreeSlots > 0)
+	{
+		return server->mFreeSlots[--server->mNumFreeSlots];
+	}
+	
+	if (server->mNumSlots == server->mMaxSlots)
+	{
+		server->mMaxSlots *= 2;
+		server->mPlayers = (struct AQPlayerState **) realloc(server->mPlayers, server->mMaxSlots * sizeof(struct AQPlayerState *));
+		server->mGenerations = (UInt32 *) realloc(server->mGenerations, server->mMaxSlots * sizeof(UInt32));
+		server->mFreeSlots = (UInt32 *) realloc(server->mFreeSlots, server->mMaxSlots * sizeof(UInt32));
+		server->mIsPaused = (bool *) realloc(server->mIsPaused, server->mMaxSlots * sizeof(bool));
+	}
+	
+	server->mGenerations[server->mNumSlots] = 0;
+	
+	return server->mNumSlots++;
+}
+
+static
+void AQServer_ReleaseSlot(struct AQServer * server, UInt32 slot)
+{
+	AQPlayerPool_Return(&server->mPlayerPool, server->mPlayers[slot]);
+	
+	server->mPlayers[slot] = NULL;
+	server->mGenerations[slot]++;
+	server->mFreeSlots[server->mNumFreeSlots++] = slot;
+	server->mNumPlayers--;
+}
+
+void AQServer_Init(struct AQServer * server, UInt32 numThreads)
+{
+	server->mThreadPool = AQThreadPool_Create(numThreads);
+	server->mPlayers = (struct AQPlayerState **) malloc(kInitialMaxSlots * sizeof(struct AQPlayerState *));
+	server->mGenerations = (UInt32 *) malloc(kInitialMaxSlots * sizeof(UInt32));
+	server->mFreeSlots = (UInt32 *) malloc(kInitialMaxSlots * sizeof(UInt32));
+	server->mIsPaused = (bool *) malloc(kInitialMaxSlots * sizeof(bool));
+	server->mNumFreeSlots = 0;
+	server->mNumSlots = 0;
+	server->mMaxSlots = kInitialMaxSlots;
+	server->mNumPlayers = 0;
+	server->mLoadPool = AQThreadPool_Create(kAQServerLoadThreads);
+	server->mControl = NULL;
+	server->mNumLoading = 0;
+	
+	AQPlayerPool_Init(&server->mPlayerPool, server->mThreadPool, kAQServerMaxIdlePlayers);
+	
+	printf("Server filling buffers on %u threads\n", AQThreadPool_NumThreads(server->mThreadPool));
+}
+
+// Gives a checked out player a slot and returns its handle
+static
+UInt32 AQServer_AddPlayer(struct AQServer * server, struct AQPlayerState * player)
+{
+	UInt32 slot = AQServer_TakeSlot(server);
+	
+	server->mPlayers[slot] = player;
+	server->mIsPaused[slot] = true;
+	server->mNumPlayers++;
+	
+	// Slot 0 is handle 1, so 0 never names a player
+	return (server->mGenerations[slot] << kAQServerSlotBits) | (slot + 1);
+}
+
+UInt32 AQServer_LoadPlayer(struct AQServer * server, const char path[])
+{
+	if (server->mNumPlayers + server->mNumLoading >= kAQServerMaxPlayers)
+	{
+		return 0;
+	}
+	
+	struct AQPlayerState * player = AQPlayerPool_CheckOut(&server->mPlayerPool, path);
+	
+	return player ? AQServer_AddPlayer(server, player) : 0;
+}
+
+// Polling thread: replies to the load command with the player's handle
+static
+void AQServer_FinishLoad(void * arg)
+{
+	struct AQServerLoad * load = (struct AQServerLoad *) arg;
+	struct AQServer * server = load->mServer;
+	UInt32 handle = load->mPlayer ? AQServer_AddPlayer(server, load->mPlayer) : 0;
+	
+	load->mDeferred->mReply.mPlayer = handle;
+	load->mDeferred->mReply.mStatus = handle ? kAQControlOK : kAQControlFailed;
+	
+	AQControlServer_Complete(server->mControl, load->mDeferred);
+	server->mNumLoading--;
+	
+	free(load->mPath);
+	free(load);
+}
+
+// Load pool: opens and primes the player, then hands it back to the polling thread
+static
+void AQServer_RunLoad(void * arg)
+{
+	struct AQServerLoad * load = (struct AQServerLoad *) arg;
+	
+	load->mPlayer = AQPlayerPool_CheckOut(&load->mServer->mPlayerPool, load->mPath);
+	
+	AQControlServer_Post(load->mServer->mControl, AQServer_FinishLoad, load);
+}
+
+struct AQPlayerState * AQServer_GetPlayer(struct AQServer * server, UInt32 handle)
+{
+	UInt32 slot = (handle & kSlotMask) - 1;
+	
+	if ((handle & kSlotMask) == 0 || slot >= server->mNumSlots)
+	{
+		return NULL;
+	}
+	
+	if ((server->mGenerations[slot] << kAQServerSlotBits) != (handle & ~kSlotMask))
+	{
+		return NULL;
+	}
+	
+	return server->mPlayers[slot];
+}
+
+UInt32 AQServer_StartPlayer(struct AQServer * server, const char path[])
+{
+	UInt32 handle = AQServer_LoadPlayer(server, path);
+	
+	if (handle)
+	{
+		CheckError(AQPlayerState_Start(AQServer_GetPlayer(server, handle)), "AudioQueueStart");
+		server->mIsPaused[(handle & kSlotMask) - 1] = false;
+	}
+	
+	return handle;
+}
+
+UInt32 AQServer_Reap(struct AQServer * server)
+{
+	UInt32 slot;
+	
+	for (slot = 0; slot < server->mNumSlots; slot++)
+	{
+		// A paused player keeps its queue, however long it waits
+		if (server->mPlayers[slot] && !server->mIsPaused[slot] && AQServer_HasPlayedOut(server->mPlayers[slot]))
+		{
+			AQServer_ReleaseSlot(server, slot);
+		}
+	}
+	
+	return server->mNumPlayers;
+}
+
+static
+UInt8 AQServer_RunPlayerCommand(struct AQServer * server, struct AQPlayerState * player, UInt32 slot,
+								const struct AQControlHeader * request, const void * payload,
+								struct AQControlHeader * reply, void * replyPayload)
+{
+	Float64 seconds;
+	Float32 gain;
+	Float64 timeToFirstSample;
+	struct AQControlStats stats;
+	
+	switch (request->mCommand)
+	{
+		case kAQControlPlay:
+			if (!AQPlayerState_IsRunning(player) || AQPlayerState_Start(player) != noErr)
+			{
+				return kAQControlFailed;
+			}
+			
+			server->mIsPaused[slot] = false;
+			return kAQControlOK;
+		
+		case kAQControlPause:
+			if (AudioQueuePause(player->mQueue) != noErr)
+			{
+				return kAQControlFailed;
+			}
+			
+			server->mIsPaused[slot] = true;
+			return kAQControlOK;
+		
+		case kAQControlSeek:
+			if (request->mLength != sizeof(seconds))
+			{
+				return kAQControlBadPayload;
+			}
+			
+			memcpy(&seconds, payload, sizeof(seconds));
+			
+			if (!AQPlayerState_RequestSeek(player, seconds))
+			{
+				return kAQControlFailed;
+			}
+			
+			return kAQControlOK;
+		
+		case kAQControlGain:
+			if (request->mLength != sizeof(gain))
+			{
+				return kAQControlBadPayload;
+			}
+			
+			memcpy(&gain, payload, sizeof(gain));
+			AQPlayerState_ChangeGain(player, gain);
+			return kAQControlOK;
+		
+		case kAQControlStats:
+			stats.mState = !AQPlayerState_IsRunning(player) ? kAQControlStopped :
+						   server->mIsPaused[slot] ? kAQControlPaused : kAQControlPlaying;
+			stats.mNumPlayers = server->mNumPlayers;
+			stats.mPositionSeconds = AQPlayerState_GetPosition(player);
+			stats.mGain = player->mGain;
+			timeToFirstSample = AQPlayerState_GetTimeToFirstSample(player);
+			stats.mTimeToFirstSampleMicros = timeToFirstSample >= 0 ? (UInt32) (timeToFirstSample * 1e6) : 0;
+			
+			memcpy(replyPayload, &stats, sizeof(stats));
+			reply->mLength = sizeof(stats);
+			return kAQControlOK;
+		
+		default:
+			return kAQControlUnknownCommand;
+	}
+}
+
+void AQServer_HandleCommand(void * context,
+							const struct AQControlHeader * request, const void * payload,
+							struct AQControlHeader * reply, void * replyPayload)
+{
+	struct AQServer * server = (struct AQServer *) context;
+	
+	if (request->mCommand == kAQControlLoad)
+	{
+		char path[kAQControlMaxPayload + 1];
+		
+		memcpy(path, payload, request->mLength);
+		path[request->mLength] = '\0';
+		
+		if (server->mControl && server->mNumPlayers + server->mNumLoading < kAQServerMaxPlayers)
+		{
+			struct AQServerLoad * load = (struct AQServerLoad *) malloc(sizeof(struct AQServerLoad));
+			
+			load->mServer = server;
+			load->mPath = strdup(path);
+			load->mDeferred = AQControlServer_Defer(server->mControl);
+			load->mPlayer = NULL;
+			server->mNumLoading++;
+			
+			AQThreadPool_Submit(server->mLoadPool, AQServer_RunLoad, load);
+			return;
+		}
+		
+		reply->mPlayer = AQServer_LoadPlayer(server, path);
+		reply->mStatus = reply->mPlayer ? kAQControlOK : kAQControlFailed;
+		return;
+	}
+	
+	if (request->mCommand == kAQControlStats && request->mPlayer == 0)
+	{
+		struct AQControlStats stats;
+		
+		memset(&stats, 0, sizeof(stats));
+		stats.mNumPlayers = server->mNumPlayers;
+		
+		memcpy(replyPayload, &stats, sizeof(stats));
+		reply->mLength = sizeof(stats);
+		return;
+	}
+	
+	struct AQPlayerState * player = AQServer_GetPlayer(server, request->mPlayer);
+	
+	if (!player)
+	{
+		reply->mStatus = kAQControlUnknownPlayer;
+		return;
+	}
+	
+	reply->mStatus = AQServer_RunPlayerCommand(server, player, (request->mPlayer & kSlotMask) - 1, request, payload, reply, replyPayload);
+}
+
+void AQServer_CleanUp(struct AQServer * server)
+{
+	UInt32 slot;
+	
+	AQThreadPool_Dispose(server->mLoadPool);
+	
+	for (slot = 0; slot < server->mNumSlots; slot++)
+	{
+		if (server->mPlayers[slot])
+		{
+			AQServer_ReleaseSlot(server, slot);
+		}
+	}
+	
+	AQPlayerPool_CleanUp(&server->mPlayerPool);
+	
+	// Every queue is disposed and every fill has finished, the pool only has to wind down
+	AQThreadPool_Dispose(server->mThreadPool);
+	
+	free(server->mPlayers);
+	free(server->mGenerations);
+	free(server->mFreeSlots);
+	free(server->mIsPaused);
+	server->mPlayers = NULL;
+	server->mNumSlots = 0;
+}
@@ -0,0 +1,93 @@
+//
+//  AQServer.h
+//  PlayingAudioExample
+//
+
+#ifndef AQServer_h
+#define AQServer_h
+
+#include "AQPlayerState.h"
+#include "AQPlayerPool.h"
+#include "AQControl.h"
+
+// Player handles carry the slot index in their low bits and a reuse count above,
+// so a handle to a reaped player is never mistaken for the slot's next player
+static const UInt32 kAQServerSlotBits = 20;
+static const UInt32 kAQServerMaxPlayers = (1 << kAQServerSlotBits) - 1;
+
+// Finished players kept around for reuse
+static const UInt32 kAQServerMaxIdlePlayers = 256;
+
+// Threads opening files for load commands, apart from the fill threads so that a
+// slow open or download never delays a buffer
+static const UInt32 kAQServerLoadThreads = 2;
+
+/* Description:
+ * Hosts any number of players in one process. Their queues call back on the queues'
+ * own threads and all buffer fills run on one shared thread pool, so the thread
+ * count stays at the pool size however many streams are playing.
+ */
+struct AQServer
+{
+	struct AQThreadPool * mThreadPool;
+	struct AQThreadPool * mLoadPool;
+	
+	/* Description:
+	 * The control server commands come from. When set, load commands open and prime
+	 * their player on mLoadPool and reply once it is ready, leaving the polling
+	 * thread free; mNumLoading of them are under way. Without it they load in place.
+	 */
+	struct AQControlServer * mControl;
+	UInt32 mNumLoading;
+	
+	/* Description:
+	 * Player of each slot, NULL for free slots, and how often each slot has been
+	 * handed out. Free slots are stacked in mFreeSlots for reuse.
+	 */
+	struct AQPlayerState ** mPlayers;
+	UInt32 * mGenerations;
+	UInt32 * mFreeSlots;
+	UInt32 mNumFreeSlots;
+	UInt32 mNumSlots;
+	UInt32 mMaxSlots;
+	
+	UInt32 mNumPlayers;
+	
+	/* Description:
+	 * Pause state of each slot's player. Only the thread running commands uses it.
+	 */
+	bool * mIsPaused;
+	
+	/* Description:
+	 * Players come from here and go back here once reaped, so a stream of short
+	 * files of one format reuses the same few queues. Set its mFastStartSeconds
+	 * to fast start the players.
+	 */
+	struct AQPlayerPool mPlayerPool;
+};
+
+// numThreads of 0 uses one fill thread per core
+void AQServer_Init(struct AQServer * server, UInt32 numThreads);
+
+// Opens path and primes a player for it without starting it; returns its handle, 0 on failure
+UInt32 AQServer_LoadPlayer(struct AQServer * server, const char path[]);
+
+// NULL when handle is stale or was never handed out
+struct AQPlayerState * AQServer_GetPlayer(struct AQServer * server, UInt32 handle);
+
+// Opens path and starts playing it right away; returns its handle, 0 on failure
+UInt32 AQServer_StartPlayer(struct AQServer * server, const char path[]);
+
+// Cleans up the players whose queues have played out and returns how many are left
+UInt32 AQServer_Reap(struct AQServer * server);
+
+// AQControlHandler with the server as context. Runs on the thread polling the
+// control socket and only uses thread-safe queue calls and the players' atomics.
+void AQServer_HandleCommand(void * context,
+							const struct AQControlHeader * request, const void * payload,
+							struct AQControlHeader * reply, void * replyPayload);
+
+// Stops and cleans up every player, then the pool. Loads must have finished, see mNumLoading.
+void AQServer_CleanUp(struct AQServer * server);
+
+#endif /* AQServer_h */
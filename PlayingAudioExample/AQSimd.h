@@ -0,0 +1,319 @@
+//
+//  AQSimd.h
+//  PlayingAudioExample
+//
+
+/* Four-lane float vector used by the DSP kernels. Maps onto SSE on x86, NEON on
+ * ARM and a plain struct everywhere else, so every kernel has exactly one
+ * implementation and the scalar fallback is always compiled somewhere.
+ * Defining AQ_NO_SIMD selects the struct on every host, which is what the
+ * benchmarks compare the vector builds against.
+ */
+
+#ifndef AQSimd_h
+#define AQSimd_h
+
+#include "AQTypes.h"
+
+#define AQ_SIMD_WIDTH 4
+
+#if !defined(AQ_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || defined(_M_IX86_FP))
+
+#include <xmmintrin.h>
+
+typedef __m128 AQFloat4;
+
+static inline AQFloat4 AQFloat4_Load(const Float32 * p)         { return _mm_loadu_ps(p); }
+static inline void     AQFloat4_Store(Float32 * p, AQFloat4 v)  { _mm_storeu_ps(p, v); }
+static inline AQFloat4 AQFloat4_Set1(Float32 x)                  { return _mm_set1_ps(x); }
+static inline AQFloat4 AQFloat4_Add(AQFloat4 a, AQFloat4 b)      { return _mm_add_ps(a, b); }
+static inline AQFloat4 AQFloat4_Sub(AQFloat4 a, AQFloat4 b)      { return _mm_sub_ps(a, b); }
+static inline AQFloat4 AQFloat4_Mul(AQFloat4 a, AQFloat4 b)      { return _mm_mul_ps(a, b); }
+static inline AQFloat4 AQFloat4_Min(AQFloat4 a, AQFloat4 b)      { return _mm_min_ps(a, b); }
+static inline AQFloat4 AQFloat4_Max(AQFloat4 a, AQFloat4 b)      { return _mm_max_ps(a, b); }
+
+// a * b + c
+static inline AQFloat4 AQFloat4_MulAdd(AQFloat4 a, AQFloat4 b, AQFloat4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+// Lanes in the opposite order
+static inline AQFloat4 AQFloat4_Reverse(AQFloat4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)); }
+
+// p[0], p[2], p[4], p[6] into even and p[1], p[3], p[5], p[7] into odd
+static inline void AQFloat4_LoadDeinterleaved(const Float32 * p, AQFloat4 * even, AQFloat4 * odd)
+{
+	__m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4);
+	
+	*even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+	*odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+// even into p[0], p[2], p[4], p[6] and odd into p[1], p[3], p[5], p[7]
+static inline void AQFloat4_StoreInterleaved(Float32 * p, AQFloat4 even, AQFloat4 odd)
+{
+	_mm_storeu_ps(p, _mm_unpacklo_ps(even, odd));
+	_mm_storeu_ps(p + 4, _mm_unpackhi_ps(even, odd));
+}
+
+// a[lane], a[lane], b[lane], b[lane]
+static inline AQFloat4 AQFloat4_DupLanePair(AQFloat4 a, AQFloat4 b, UInt32 lane)
+{
+	switch (lane)
+	{
+		case 0:  return _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 0, 0));
+		case 1:  return _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 1, 1));
+		case 2:  return _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 2, 2, 2));
+		default: return _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+}
+
+// The sums of the lanes of a, b, c and d, in that order
+static inline AQFloat4 AQFloat4_SumLanes4(AQFloat4 a, AQFloat4 b, AQFloat4 c, AQFloat4 d)
+{
+	__m128 ab = _mm_add_ps(_mm_unpacklo_ps(a, b), _mm_unpackhi_ps(a, b));
+	__m128 cd = _mm_add_ps(_mm_unpacklo_ps(c, d), _mm_unpackhi_ps(c, d));
+	
+	return _mm_add_ps(_mm_movelh_ps(ab, cd), _mm_movehl_ps(cd, ab));
+}
+
+// The first n of p[0..3] into the low lanes, the others zero; n is 1 to 4
+static inline AQFloat4 AQFloat4_LoadPartial(const Float32 * p, UInt32 n)
+{
+	switch (n)
+	{
+		case 1:  return _mm_load_ss(p);
+		case 2:  return _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) p);
+		case 3:  return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) p), _mm_load_ss(p + 2));
+		default: return _mm_loadu_ps(p);
+	}
+}
+
+// The low n lanes into p[0..n-1]
+static inline void AQFloat4_StorePartial(Float32 * p, AQFloat4 v, UInt32 n)
+{
+	switch (n)
+	{
+		case 1:  _mm_store_ss(p, v); break;
+		case 2:  _mm_storel_pi((__m64 *) p, v); break;
+		case 3:  _mm_storel_pi((__m64 *) p, v); _mm_store_ss(p + 2, _mm_movehl_ps(v, v)); break;
+		default: _mm_storeu_ps(p, v); break;
+	}
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+
+// Four native-endian 16 bit integers, sign extended and converted
+static inline AQFloat4 AQFloat4_LoadSInt16(const SInt16 * p)
+{
+	__m128i x = _mm_loadl_epi64((const __m128i *) p);
+	
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+}
+#else
+static inline AQFloat4 AQFloat4_LoadSInt16(const SInt16 * p)
+{
+	return _mm_setr_ps(p[0], p[1], p[2], p[3]);
+}
+#endif
+
+#elif !defined(AQ_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+
+#include <arm_neon.h>
+
+typedef float32x4_t AQFloat4;
+
+static inline AQFloat4 AQFloat4_Load(const Float32 * p)         { return vld1q_f32(p); }
+static inline void     AQFloat4_Store(Float32 * p, AQFloat4 v)  { vst1q_f32(p, v); }
+static inline AQFloat4 AQFloat4_Set1(Float32 x)                  { return vdupq_n_f32(x); }
+static inline AQFloat4 AQFloat4_Add(AQFloat4 a, AQFloat4 b)      { return vaddq_f32(a, b); }
+static inline AQFloat4 AQFloat4_Sub(AQFloat4 a, AQFloat4 b)      { return vsubq_f32(a, b); }
+static inline AQFloat4 AQFloat4_Mul(AQFloat4 a, AQFloat4 b)      { return vmulq_f32(a, b); }
+static inline AQFloat4 AQFloat4_Min(AQFloat4 a, AQFloat4 b)      { return vminq_f32(a, b); }
+static inline AQFloat4 AQFloat4_Max(AQFloat4 a, AQFloat4 b)      { return vmaxq_f32(a, b); }
+
+// a * b + c
+static inline AQFloat4 AQFloat4_MulAdd(AQFloat4 a, AQFloat4 b, AQFloat4 c) { return vmlaq_f32(c, a, b); }
+
+// Lanes in the opposite order
+static inline AQFloat4 AQFloat4_Reverse(AQFloat4 v)
+{
+	float32x4_t r = vrev64q_f32(v);
+	
+	return vcombine_f32(vget_high_f32(r), vget_low_f32(r));
+}
+
+// p[0], p[2], p[4], p[6] into even and p[1], p[3], p[5], p[7] into odd
+static inline void AQFloat4_LoadDeinterleaved(const Float32 * p, AQFloat4 * even, AQFloat4 * odd)
+{
+	float32x4x2_t x = vld2q_f32(p);
+	
+	*even = x.val[0];
+	*odd = x.val[1];
+}
+
+// even into p[0], p[2], p[4], p[6] and odd into p[1], p[3], p[5], p[7]
+static inline void AQFloat4_StoreInterleaved(Float32 * p, AQFloat4 even, AQFloat4 odd)
+{
+	float32x4x2_t x = {{ even, odd }};
+	
+	vst2q_f32(p, x);
+}
+
+// a[lane], a[lane], b[lane], b[lane]
+static inline AQFloat4 AQFloat4_DupLanePair(AQFloat4 a, AQFloat4 b, UInt32 lane)
+{
+	switch (lane)
+	{
+		case 0:  return vcombine_f32(vdup_lane_f32(vget_low_f32(a), 0), vdup_lane_f32(vget_low_f32(b), 0));
+		case 1:  return vcombine_f32(vdup_lane_f32(vget_low_f32(a), 1), vdup_lane_f32(vget_low_f32(b), 1));
+		case 2:  return vcombine_f32(vdup_lane_f32(vget_high_f32(a), 0), vdup_lane_f32(vget_high_f32(b), 0));
+		default: return vcombine_f32(vdup_lane_f32(vget_high_f32(a), 1), vdup_lane_f32(vget_high_f32(b), 1));
+	}
+}
+
+// The sums of the lanes of a, b, c and d, in that order
+static inline AQFloat4 AQFloat4_SumLanes4(AQFloat4 a, AQFloat4 b, AQFloat4 c, AQFloat4 d)
+{
+	float32x4x2_t abZip = vzipq_f32(a, b);
+	float32x4x2_t cdZip = vzipq_f32(c, d);
+	float32x4_t ab = vaddq_f32(abZip.val[0], abZip.val[1]);
+	float32x4_t cd = vaddq_f32(cdZip.val[0], cdZip.val[1]);
+	
+	return vaddq_f32(vcombine_f32(vget_low_f32(ab), vget_low_f32(cd)), vcombine_f32(vget_high_f32(ab), vget_high_f32(cd)));
+}
+
+// The first n of p[0..3] into the low lanes, the others zero; n is 1 to 4
+static inline AQFloat4 AQFloat4_LoadPartial(const Float32 * p, UInt32 n)
+{
+	switch (n)
+	{
+		case 1:  return vsetq_lane_f32(p[0], vdupq_n_f32(0.f), 0);
+		case 2:  return vcombine_f32(vld1_f32(p), vdup_n_f32(0.f));
+		case 3:  return vcombine_f32(vld1_f32(p), vset_lane_f32(p[2], vdup_n_f32(0.f), 0));
+		default: return vld1q_f32(p);
+	}
+}
+
+// The low n lanes into p[0..n-1]
+static inline void AQFloat4_StorePartial(Float32 * p, AQFloat4 v, UInt32 n)
+{
+	switch (n)
+	{
+		case 1:  vst1q_lane_f32(p, v, 0); break;
+		case 2:  vst1_f32(p, vget_low_f32(v)); break;
+		case 3:  vst1_f32(p, vget_low_f32(v)); vst1q_lane_f32(p + 2, v, 2); break;
+		default: vst1q_f32(p, v); break;
+	}
+}
+
+// Four native-endian 16 bit integers, sign extended and converted
+static inline AQFloat4 AQFloat4_LoadSInt16(const SInt16 * p) { return vcvtq_f32_s32(vmovl_s16(vld1_s16(p))); }
+
+#else
+
+struct AQFloat4 { Float32 v[4]; };
+
+static inline AQFloat4 AQFloat4_Load(const Float32 * p)
+{
+	AQFloat4 r = {{ p[0], p[1], p[2], p[3] }};
+	return r;
+}
+
+static inline void AQFloat4_Store(Float32 * p, AQFloat4 v)
+{
+	p[0] = v.v[0]; p[1] = v.v[1]; p[2] = v.v[2]; p[3] = v.v[3];
+}
+
+static inline AQFloat4 AQFloat4_Set1(Float32 x)
+{
+	AQFloat4 r = {{ x, x, x, x }};
+	return r;
+}
+
+#define AQ_FLOAT4_LANEWISE(name, expr) \
+static inline AQFloat4 name(AQFloat4 a, AQFloat4 b) \
+{ \
+	AQFloat4 r; \
+	for (int i = 0; i < 4; i++) { Float32 x = a.v[i], y = b.v[i]; r.v[i] = (expr); } \
+	return r; \
+}
+
+AQ_FLOAT4_LANEWISE(AQFloat4_Add, x + y)
+AQ_FLOAT4_LANEWISE(AQFloat4_Sub, x - y)
+AQ_FLOAT4_LANEWISE(AQFloat4_Mul, x * y)
+AQ_FLOAT4_LANEWISE(AQFloat4_Min, x < y ? x : y)
+AQ_FLOAT4_LANEWISE(AQFloat4_Max, x > y ? x : y)
+
+#undef AQ_FLOAT4_LANEWISE
+
+// a * b + c
+static inline AQFloat4 AQFloat4_MulAdd(AQFloat4 a, AQFloat4 b, AQFloat4 c)
+{
+	return AQFloat4_Add(AQFloat4_Mul(a, b), c);
+}
+
+// Lanes in the opposite order
+static inline AQFloat4 AQFloat4_Reverse(AQFloat4 v)
+{
+	AQFloat4 r = {{ v.v[3], v.v[2], v.v[1], v.v[0] }};
+	return r;
+}
+
+// p[0], p[2], p[4], p[6] into even and p[1], p[3], p[5], p[7] into odd
+static inline void AQFloat4_LoadDeinterleaved(const Float32 * p, AQFloat4 * even, AQFloat4 * odd)
+{
+	AQFloat4 e = {{ p[0], p[2], p[4], p[6] }};
+	AQFloat4 o = {{ p[1], p[3], p[5], p[7] }};
+	
+	*even = e;
+	*odd = o;
+}
+
+// even into p[0], p[2], p[4], p[6] and odd into p[1], p[3], p[5], p[7]
+static inline void AQFloat4_StoreInterleaved(Float32 * p, AQFloat4 even, AQFloat4 odd)
+{
+	for (int i = 0; i < 4; i++) { p[2 * i] = even.v[i]; p[2 * i + 1] = odd.v[i]; }
+}
+
+// a[lane], a[lane], b[lane], b[lane]
+static inline AQFloat4 AQFloat4_DupLanePair(AQFloat4 a, AQFloat4 b, UInt32 lane)
+{
+	AQFloat4 r = {{ a.v[lane], a.v[lane], b.v[lane], b.v[lane] }};
+	return r;
+}
+
+// The sums of the lanes of a, b, c and d, in that order
+static inline AQFloat4 AQFloat4_SumLanes4(AQFloat4 a, AQFloat4 b, AQFloat4 c, AQFloat4 d)
+{
+	AQFloat4 r = {{ (a.v[0] + a.v[2]) + (a.v[1] + a.v[3]),
+					(b.v[0] + b.v[2]) + (b.v[1] + b.v[3]),
+					(c.v[0] + c.v[2]) + (c.v[1] + c.v[3]),
+					(d.v[0] + d.v[2]) + (d.v[1] + d.v[3]) }};
+	return r;
+}
+
+// The first n of p[0..3] into the low lanes, the others zero; n is 1 to 4
+static inline AQFloat4 AQFloat4_LoadPartial(const Float32 * p, UInt32 n)
+{
+	AQFloat4 r = {{ 0.f, 0.f, 0.f, 0.f }};
+	
+	for (UInt32 i = 0; i < n; i++) { r.v[i] = p[i]; }
+	return r;
+}
+
+// The low n lanes into p[0..n-1]
+static inline void AQFloat4_StorePartial(Float32 * p, AQFloat4 v, UInt32 n)
+{
+	for (UInt32 i = 0; i < n; i++) { p[i] = v.v[i]; }
+}
+
+// Four native-endian 16 bit integers, sign extended and converted
+static inline AQFloat4 AQFloat4_LoadSInt16(const SInt16 * p)
+{
+	AQFloat4 r = {{ (Float32) p[0], (Float32) p[1], (Float32) p[2], (Float32) p[3] }};
+	return r;
+}
+
+#endif
+
+#endif /* AQSimd_h */
@@ -0,0 +1,164 @@
+//
+//  AQSpectrum.cpp
+//  PlayingAudioExample
+//
+
+#include "AQSpectrum.h"
+#include "AQSimd.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Keeps silent bins finite
+static const Float32 kAQSpectrumFloorPower = 1e-20f;
+
+struct AQSpectrum * AQSpectrum_Create(UInt32 size, UInt32 hopSize, UInt32 numChannels, Float64 sampleRate)
+{
+	struct AQSpectrum * spectrum = (struct AQSpectrum *) calloc(1, sizeof(struct AQSpectrum));
+	struct AQSpectrumFrame * empty = (struct AQSpectrumFrame *) calloc(1, sizeof(struct AQSpectrumFrame));
+	Float64 windowSum = 0.0;
+	UInt32 k;
+	
+	spectrum->mSize = size;
+	spectrum->mHopSize = hopSize;
+	spectrum->mNumChannels = numChannels;
+	spectrum->mSampleRate = sampleRate;
+	
+	AQRealFFTPlan_Init(&spectrum->mPlan, size);
+	
+	spectrum->mWindow = (Float32 *) malloc(size * sizeof(Float32));
+	spectrum->mHistory = (Float32 *) calloc(size, sizeof(Float32));
+	spectrum->mBlock = (Float32 *) malloc(size * sizeof(Float32));
+	spectrum->mBinsRe = (Float32 *) malloc((size / 2 + 1) * sizeof(Float32));
+	spectrum->mBinsIm = (Float32 *) malloc((size / 2 + 1) * sizeof(Float32));
+	
+	for (k = 0; k < size; k++)
+	{
+		spectrum->mWindow[k] = (Float32) (0.5 - 0.5 * cos(2.0 * M_PI * k / size));
+		windowSum += spectrum->mWindow[k];
+	}
+	
+	// A full-scale sine peaks at amplitude windowSum / 2 in its bin
+	for (k = 0; k < size; k++)
+	{
+		spectrum->mWindow[k] = (Float32) (spectrum->mWindow[k] * 2.0 / windowSum);
+	}
+	
+	empty->mNumBins = size / 2 + 1;
+	empty->mBinWidth = (Float32) (sampleRate / size);
+	
+	AQTripleBuffer_Init(&spectrum->mFrames, empty);
+	
+	free(empty);
+	
+	return spectrum;
+}
+
+void AQSpectrum_Dispose(struct AQSpectrum * spectrum)
+{
+	if (!spectrum)
+	{
+		return;
+	}
+	
+	AQRealFFTPlan_CleanUp(&spectrum->mPlan);
+	
+	free(spectrum->mWindow);
+	free(spectrum->mHistory);
+	free(spectrum->mBlock);
+	free(spectrum->mBinsRe);
+	free(spectrum->mBinsIm);
+	free(spectrum);
+}
+
+static
+void AQSpectrum_Analyse(struct AQSpectrum * spectrum)
+{
+	UInt32 size = spectrum->mSize;
+	UInt32 numBins = size / 2 + 1;
+	UInt32 older = size - spectrum->mHistoryIndex;
+	const Float32 * window = spectrum->mWindow;
+	Float32 * block = spectrum->mBlock;
+	UInt32 k = 0;
+	
+	// Unroll the circular history, oldest sample first
+	memcpy(block, spectrum->mHistory + spectrum->mHistoryIndex, older * sizeof(Float32));
+	memcpy(block + older, spectrum->mHistory, spectrum->mHistoryIndex * sizeof(Float32));
+	
+	for (; k + AQ_SIMD_WIDTH <= size; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4_Store(block + k, AQFloat4_Mul(AQFloat4_Load(block + k), AQFloat4_Load(window + k)));
+	}
+	
+	AQRealFFT_Forward(&spectrum->mPlan, block, spectrum->mBinsRe, spectrum->mBinsIm);
+	
+	struct AQSpectrumFrame * frame = AQTripleBuffer_WriteBuffer(&spectrum->mFrames);
+	const Float32 * re = spectrum->mBinsRe;
+	const Float32 * im = spectrum->mBinsIm;
+	AQFloat4 vFloor = AQFloat4_Set1(kAQSpectrumFloorPower);
+	
+	for (k = 0; k + AQ_SIMD_WIDTH <= numBins; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 r = AQFloat4_Load(re + k);
+		AQFloat4 i = AQFloat4_Load(im + k);
+		
+		AQFloat4_Store(frame->mMagnitudeDB + k, AQFloat4_Max(AQFloat4_MulAdd(r, r, AQFloat4_Mul(i, i)), vFloor));
+	}
+	
+	for (; k < numBins; k++)
+	{
+		Float32 power = re[k] * re[k] + im[k] * im[k];
+		
+		frame->mMagnitudeDB[k] = power > kAQSpectrumFloorPower ? power : kAQSpectrumFloorPower;
+	}
+	
+	for (k = 0; k < numBins; k++)
+	{
+		frame->mMagnitudeDB[k] = 10.f * log10f(frame->mMagnitudeDB[k]);
+	}
+	
+	frame->mSequence = ++spectrum->mSequence;
+	frame->mFramePosition = spectrum->mFramePosition;
+	frame->mNumBins = numBins;
+	frame->mBinWidth = (Float32) (spectrum->mSampleRate / size);
+	
+	AQTripleBuffer_Publish(&spectrum->mFrames);
+}
+
+void AQSpectrum_Tap(struct AQSpectrum * spectrum, const Float32 * samples, UInt32 numFrames)
+{
+	UInt32 numChannels = spectrum->mNumChannels;
+	Float32 scale = 1.f / numChannels;
+	UInt32 f, c;
+	
+	for (f = 0; f < numFrames; f++, samples += numChannels)
+	{
+		Float32 mono = 0.f;
+		
+		for (c = 0; c < numChannels; c++)
+		{
+			mono += samples[c];
+		}
+		
+		spectrum->mHistory[spectrum->mHistoryIndex] = mono * scale;
+		spectrum->mHistoryIndex = (spectrum->mHistoryIndex + 1) & (spectrum->mSize - 1);
+		spectrum->mFramePosition++;
+		
+		if (++spectrum->mSinceLastHop == spectrum->mHopSize)
+		{
+			spectrum->mSinceLastHop = 0;
+			AQSpectrum_Analyse(spectrum);
+		}
+	}
+}
+
+const struct AQSpectrumFrame * AQSpectrum_Acquire(struct AQSpectrum * spectrum)
+{
+	if (!AQTripleBuffer_Acquire(&spectrum->mFrames))
+	{
+		return NULL;
+	}
+	
+	return AQTripleBuffer_ReadBuffer(&spectrum->mFrames);
+}
@@ -0,0 +1,91 @@
+//
+//  AQSpectrum.h
+//  PlayingAudioExample
+//
+
+#ifndef AQSpectrum_h
+#define AQSpectrum_h
+
+#include "AQTypes.h"
+#include "AQFFT.h"
+#include "AQTripleBuffer.h"
+
+static const UInt32 kAQSpectrumMaxSize = 8192;
+static const UInt32 kAQSpectrumMaxBins = kAQSpectrumMaxSize / 2 + 1;
+
+struct AQSpectrumFrame
+{
+	/* Description:
+	 * Number of analyses run so far, so readers can tell a new frame from a repeated one.
+	 */
+	UInt64 mSequence;
+	
+	/* Description:
+	 * Stream position, in frames, of the end of the analysed window.
+	 */
+	UInt64 mFramePosition;
+	
+	UInt32 mNumBins;
+	Float32 mBinWidth;		// Hz
+	
+	/* Description:
+	 * Power per bin in dB relative to a full-scale sine.
+	 */
+	Float32 mMagnitudeDB[kAQSpectrumMaxBins];
+};
+
+/* Description:
+ * Hann-windowed real FFTs over a mono mix of the tapped stream, one every mHopSize
+ * frames. The tap runs on the audio thread and never allocates or locks; the
+ * latest spectrum is published through a triple buffer for one reader thread.
+ */
+struct AQSpectrum
+{
+	UInt32 mSize;
+	UInt32 mHopSize;
+	UInt32 mNumChannels;
+	Float64 mSampleRate;
+	
+	struct AQRealFFTPlan mPlan;
+	
+	/* Description:
+	 * The Hann window, already scaled so that a full-scale sine reads 0 dB.
+	 */
+	Float32 * mWindow;
+	
+	/* Description:
+	 * Circular history of the last mSize mono samples, and where the next one goes.
+	 */
+	Float32 * mHistory;
+	UInt32 mHistoryIndex;
+	
+	/* Description:
+	 * Samples taken since the last analysis, and frames tapped in total.
+	 */
+	UInt32 mSinceLastHop;
+	UInt64 mFramePosition;
+	UInt64 mSequence;
+	
+	/* Description:
+	 * Scratch for one analysis: the windowed block and its bins.
+	 */
+	Float32 * mBlock;
+	Float32 * mBinsRe;
+	Float32 * mBinsIm;
+	
+	AQTripleBuffer<struct AQSpectrumFrame> mFrames;
+};
+
+// size is a power of two between 8 and kAQSpectrumMaxSize, hopSize at most size.
+// The struct is large, allocate it with AQSpectrum_Create.
+struct AQSpectrum * AQSpectrum_Create(UInt32 size, UInt32 hopSize, UInt32 numChannels, Float64 sampleRate);
+
+void AQSpectrum_Dispose(struct AQSpectrum * spectrum);
+
+// Audio thread: feeds interleaved frames, analysing and publishing every hop
+void AQSpectrum_Tap(struct AQSpectrum * spectrum, const Float32 * samples, UInt32 numFrames);
+
+// Reader thread: the latest published frame, or NULL if nothing new arrived since the last call
+const struct AQSpectrumFrame * AQSpectrum_Acquire(struct AQSpectrum * spectrum);
+
+#endif /* AQSpectrum_h */
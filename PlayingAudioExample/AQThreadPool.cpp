@@ -0,0 +1,227 @@
+//
+//  AQThreadPool.cpp
+//  PlayingAudioExample
+//
+
+#include "AQThreadPool.h"
+#include "AQTrace.h"
+
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct AQTask
+{
+	AQTaskFunction mFunction;
+	void * mArg;
+};
+
+struct AQWorker
+{
+	/* Description:
+	 * The owner pushes and pops at the back, thieves take from the front.
+	 */
+	std::mutex mMutex;
+	std::deque<struct AQTask> mTasks;
+	
+	std::thread mThread;
+};
+
+struct AQThreadPool
+{
+	UInt32 mNumThreads;
+	struct AQWorker * mWorkers;
+	
+	/* Description:
+	 * Tasks queued across all workers. Idle workers sleep on mWakeUp until it is
+	 * non-zero or mStopping is set.
+	 */
+	std::mutex mSleepMutex;
+	std::condition_variable mWakeUp;
+	UInt32 mNumQueued;
+	bool mStopping;
+	
+	/* Description:
+	 * Next worker an outside submission goes to.
+	 */
+	UInt32 mNextWorker;
+};
+
+// Index of the calling thread's worker, or -1 outside the pool
+static thread_local SInt32 sWorkerIndex = -1;
+static thread_local struct AQThreadPool * sWorkerPool = NULL;
+
+static
+bool AQThreadPool_PopOwn(struct AQThreadPool * pool, UInt32 index, struct AQTask * outTask)
+{
+	struct AQWorker * worker = &pool->mWorkers[index];
+	std::lock_guard<std::mutex> lock(worker->mMutex);
+	
+	if (worker->mTasks.empty())
+	{
+		return false;
+	}
+	
+	*outTask = worker->mTasks.back();
+	worker->mTasks.pop_back();
+	
+	return true;
+}
+
+static
+bool AQThreadPool_Steal(struct AQThreadPool * pool, UInt32 thief, struct AQTask * outTask)
+{
+	UInt32 k;
+	
+	for (k = 1; k < pool->mNumThreads; k++)
+	{
+		struct AQWorker * victim = &pool->mWorkers[(thief + k) % pool->mNumThreads];
+		
+		// Do not queue up behind a victim that is busy, try the next one
+		std::unique_lock<std::mutex> lock(victim->mMutex, std::try_to_lock);
+		
+		if (lock.owns_lock() && !victim->mTasks.empty())
+		{
+			*outTask = victim->mTasks.front();
+			victim->mTasks.pop_front();
+			
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static
+void AQThreadPool_TaskTaken(struct AQThreadPool * pool)
+{
+	std::lock_guard<std::mutex> lock(pool->mSleepMutex);
+	
+	pool->mNumQueued--;
+}
+
+static
+void AQThreadPool_WorkerMain(struct AQThreadPool * pool, UInt32 index)
+{
+	struct AQTask task;
+	
+	sWorkerIndex = index;
+	sWorkerPool = pool;
+	
+	char name[32];
+	snprintf(name, sizeof(name), "fill worker %u", index);
+	AQTrace_SetThreadName(name);
+	
+	for (;;)
+	{
+		if (AQThreadPool_PopOwn(pool, index, &task) || AQThreadPool_Steal(pool, index, &task))
+		{
+			AQThreadPool_TaskTaken(pool);
+			task.mFunction(task.mArg);
+			continue;
+		}
+		
+		std::unique_lock<std::mutex> lock(pool->mSleepMutex);
+		
+		if (pool->mNumQueued > 0)
+		{
+			// A task is queued but a try-lock missed it, look again
+			lock.unlock();
+			std::this_thread::yield();
+			continue;
+		}
+		
+		if (pool->mStopping)
+		{
+			return;
+		}
+		
+		pool->mWakeUp.wait(lock);
+	}
+}
+
+struct AQThreadPool * AQThreadPool_Create(UInt32 numThreads)
+{
+	UInt32 k;
+	
+	if (numThreads == 0)
+	{
+		numThreads = std::thread::hardware_concurrency();
+		
+		if (numThreads == 0)
+		{
+			numThreads = 1;
+		}
+	}
+	
+	struct AQThreadPool * pool = new AQThreadPool;
+	
+	pool->mNumThreads = numThreads;
+	pool->mWorkers = new AQWorker[numThreads];
+	pool->mNumQueued = 0;
+	pool->mStopping = false;
+	pool->mNextWorker = 0;
+	
+	for (k = 0; k < numThreads; k++)
+	{
+		pool->mWorkers[k].mThread = std::thread(AQThreadPool_WorkerMain, pool, k);
+	}
+	
+	return pool;
+}
+
+UInt32 AQThreadPool_NumThreads(const struct AQThreadPool * pool)
+{
+	return pool->mNumThreads;
+}
+
+void AQThreadPool_Submit(struct AQThreadPool * pool, AQTaskFunction function, void * arg)
+{
+	struct AQTask task = { function, arg };
+	UInt32 index;
+	
+	{
+		std::lock_guard<std::mutex> lock(pool->mSleepMutex);
+		
+		pool->mNumQueued++;
+		
+		// Tasks spawned by a task stay with its worker, where their data is still in cache
+		index = (sWorkerPool == pool) ? (UInt32) sWorkerIndex : pool->mNextWorker++ % pool->mNumThreads;
+		
+		struct AQWorker * worker = &pool->mWorkers[index];
+		std::lock_guard<std::mutex> workerLock(worker->mMutex);
+		
+		worker->mTasks.push_back(task);
+	}
+	
+	pool->mWakeUp.notify_one();
+}
+
+void AQThreadPool_Dispose(struct AQThreadPool * pool)
+{
+	UInt32 k;
+	
+	if (!pool)
+	{
+		return;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock(pool->mSleepMutex);
+		
+		pool->mStopping = true;
+	}
+	
+	pool->mWakeUp.notify_all();
+	
+	for (k = 0; k < pool->mNumThreads; k++)
+	{
+		pool->mWorkers[k].mThread.join();
+	}
+	
+	delete [] pool->mWorkers;
+	delete pool;
+}
@@ -0,0 +1,33 @@
+//
+//  AQThreadPool.h
+//  PlayingAudioExample
+//
+
+#ifndef AQThreadPool_h
+#define AQThreadPool_h
+
+#include "AQTypes.h"
+
+typedef void (*AQTaskFunction)(void * arg);
+
+struct AQThreadPool;
+
+/* Description:
+ * A fixed set of worker threads, each with its own task deque. Workers run their
+ * own tasks newest first and, when they run dry, steal the oldest task of another
+ * worker before going to sleep. Tasks submitted from outside the pool are dealt
+ * out round robin.
+ */
+
+// numThreads of 0 uses one thread per core
+struct AQThreadPool * AQThreadPool_Create(UInt32 numThreads);
+
+UInt32 AQThreadPool_NumThreads(const struct AQThreadPool * pool);
+
+// Safe from any thread, including from inside a task
+void AQThreadPool_Submit(struct AQThreadPool * pool, AQTaskFunction function, void * arg);
+
+// Runs the tasks still queued, then joins the workers
+void AQThreadPool_Dispose(struct AQThreadPool * pool);
+
+#endif /* AQThreadPool_h */
@@ -0,0 +1,240 @@
+//
+//  AQTrace.cpp
+//  PlayingAudioExample
+//
+
+#include "AQTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mutex>
+
+// Marks an AQTraceEvent recorded by AQTrace_Instant
+static const UInt64 kAQTraceInstant = ~(UInt64) 0;
+
+struct AQTraceEvent
+{
+	const char * mName;
+	UInt64 mBeginNanos;
+	UInt64 mDurationNanos;
+	UInt64 mArg;
+};
+
+/* Description:
+ * One thread's ring. Only its thread writes mEvents and mNumRecorded; the
+ * exporter reads them from outside, so mNumRecorded is published atomically
+ * after each event is complete.
+ */
+struct AQTraceThread
+{
+	UInt32 mThreadIndex;
+	char mName[32];
+	
+	struct AQTraceEvent * mEvents;
+	UInt32 mCapacity;
+	UInt64 mNumRecorded;
+	
+	struct AQTraceThread * mNext;
+};
+
+bool gAQTraceEnabled = false;
+
+static UInt32 sEventsPerThread = kAQTraceDefaultEventsPerThread;
+
+// Every thread that ever recorded, newest first. Rings live until the process exits,
+// so the exporter can still read the events of threads that are gone.
+static std::mutex sThreadsMutex;
+static struct AQTraceThread * sThreads = NULL;
+static UInt32 sNumThreads = 0;
+
+static thread_local struct AQTraceThread * sCurrentThread = NULL;
+
+static
+struct AQTraceThread * AQTrace_GetThread()
+{
+	if (sCurrentThread)
+	{
+		return sCurrentThread;
+	}
+	
+	struct AQTraceThread * thread = (struct AQTraceThread *) calloc(1, sizeof(struct AQTraceThread));
+	std::lock_guard<std::mutex> lock(sThreadsMutex);
+	
+	thread->mCapacity = sEventsPerThread;
+	thread->mEvents = (struct AQTraceEvent *) calloc(thread->mCapacity, sizeof(struct AQTraceEvent));
+	thread->mThreadIndex = ++sNumThreads;
+	snprintf(thread->mName, sizeof(thread->mName), "thread %u", thread->mThreadIndex);
+	
+	thread->mNext = sThreads;
+	sThreads = thread;
+	sCurrentThread = thread;
+	
+	return thread;
+}
+
+static
+void AQTrace_Record(const char * name, UInt64 beginNanos, UInt64 durationNanos, UInt64 arg)
+{
+	struct AQTraceThread * thread = AQTrace_GetThread();
+	struct AQTraceEvent * event = &thread->mEvents[thread->mNumRecorded & (thread->mCapacity - 1)];
+	
+	event->mName = name;
+	event->mBeginNanos = beginNanos;
+	event->mDurationNanos = durationNanos;
+	event->mArg = arg;
+	
+	__atomic_store_n(&thread->mNumRecorded, thread->mNumRecorded + 1, __ATOMIC_RELEASE);
+}
+
+void AQTrace_Enable(UInt32 eventsPerThread)
+{
+	UInt32 capacity = 1;
+	
+	while (capacity < eventsPerThread)
+	{
+		capacity <<= 1;
+	}
+	
+	sEventsPerThread = capacity;
+	__atomic_store_n(&gAQTraceEnabled, true, __ATOMIC_RELEASE);
+}
+
+void AQTrace_Disable()
+{
+	__atomic_store_n(&gAQTraceEnabled, false, __ATOMIC_RELEASE);
+}
+
+void AQTrace_SetThreadName(const char name[])
+{
+	// Naming a thread allocates its ring, so only do it for threads that will record
+	if (!AQTrace_IsEnabled())
+	{
+		return;
+	}
+	
+	struct AQTraceThread * thread = AQTrace_GetThread();
+	std::lock_guard<std::mutex> lock(sThreadsMutex);
+	
+	snprintf(thread->mName, sizeof(thread->mName), "%s", name);
+}
+
+UInt64 AQTrace_Now()
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return (UInt64) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void AQTrace_Complete(const char * name, UInt64 beginNanos, UInt64 arg)
+{
+	AQTrace_Record(name, beginNanos, AQTrace_Now() - beginNanos, arg);
+}
+
+void AQTrace_Instant(const char * name, UInt64 arg)
+{
+	if (AQTrace_IsEnabled())
+	{
+		AQTrace_Record(name, AQTrace_Now(), kAQTraceInstant, arg);
+	}
+}
+
+// Names come from the code, but keep the JSON valid whatever they hold
+static
+void AQTrace_WriteString(FILE * file, const char * string)
+{
+	fputc('"', file);
+	
+	for (; *string; string++)
+	{
+		if (*string == '"' || *string == '\\')
+		{
+			fputc('\\', file);
+		}
+		
+		if ((unsigned char) *string >= 0x20)
+		{
+			fputc(*string, file);
+		}
+	}
+	
+	fputc('"', file);
+}
+
+bool AQTrace_WriteChromeJSON(const char path[])
+{
+	FILE * file = fopen(path, "w");
+	struct AQTraceThread * thread;
+	bool isFirst = true;
+	int pid = (int) getpid();
+	UInt64 numWritten = 0;
+	
+	if (!file)
+	{
+		return false;
+	}
+	
+	std::lock_guard<std::mutex> lock(sThreadsMutex);
+	
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	
+	for (thread = sThreads; thread; thread = thread->mNext)
+	{
+		fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+				isFirst ? "" : ",\n", pid, thread->mThreadIndex);
+		AQTrace_WriteString(file, thread->mName);
+		fprintf(file, "}}");
+		isFirst = false;
+		
+		UInt64 numRecorded = __atomic_load_n(&thread->mNumRecorded, __ATOMIC_ACQUIRE);
+		UInt64 first = numRecorded > thread->mCapacity ? numRecorded - thread->mCapacity : 0;
+		UInt64 k;
+		
+		for (k = first; k < numRecorded; k++)
+		{
+			struct AQTraceEvent event = thread->mEvents[k & (thread->mCapacity - 1)];
+			
+			// The thread may have lapped the ring while we were copying; drop what it overwrote
+			UInt64 numNow = __atomic_load_n(&thread->mNumRecorded, __ATOMIC_ACQUIRE);
+			
+			if (numNow > thread->mCapacity && k < numNow - thread->mCapacity)
+			{
+				continue;
+			}
+			
+			fprintf(file, ",\n{\"name\":");
+			AQTrace_WriteString(file, event.mName);
+			
+			if (event.mDurationNanos == kAQTraceInstant)
+			{
+				fprintf(file, ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f", event.mBeginNanos * 1e-3);
+			}
+			else
+			{
+				fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f", event.mBeginNanos * 1e-3, event.mDurationNanos * 1e-3);
+			}
+			
+			fprintf(file, ",\"pid\":%d,\"tid\":%u,\"args\":{\"arg\":%llu}}",
+					pid, thread->mThreadIndex, (unsigned long long) event.mArg);
+			numWritten++;
+		}
+	}
+	
+	fprintf(file, "\n]}\n");
+	
+	bool ok = ferror(file) == 0;
+	
+	if (fclose(file) != 0)
+	{
+		ok = false;
+	}
+	
+	printf("Wrote %llu trace events to %s\n", (unsigned long long) numWritten, path);
+	
+	return ok;
+}
@@ -0,0 +1,79 @@
+//
+//  AQTrace.h
+//  PlayingAudioExample
+//
+
+/* Low overhead tracing of the playback pipeline.
+ *
+ * Each thread records its events into a ring buffer of its own, so recording
+ * takes no lock and never waits; when a ring is full the oldest events are
+ * overwritten. While tracing is disabled a scope costs one relaxed load.
+ * AQTrace_WriteChromeJSON writes everything recorded so far in the Chrome trace
+ * event format, which chrome://tracing and Perfetto open directly.
+ *
+ * Event names must be string literals, or otherwise outlive the trace.
+ */
+
+#ifndef AQTrace_h
+#define AQTrace_h
+
+#include "AQTypes.h"
+
+static const UInt32 kAQTraceDefaultEventsPerThread = 1 << 16;
+
+// Read on every event; only AQTrace_Enable and AQTrace_Disable write it
+extern bool gAQTraceEnabled;
+
+static inline bool AQTrace_IsEnabled()
+{
+	return __atomic_load_n(&gAQTraceEnabled, __ATOMIC_RELAXED);
+}
+
+// eventsPerThread is rounded up to a power of two; threads keep the size they started with
+void AQTrace_Enable(UInt32 eventsPerThread);
+
+void AQTrace_Disable();
+
+// Name shown for the calling thread, if tracing is enabled
+void AQTrace_SetThreadName(const char name[]);
+
+UInt64 AQTrace_Now();
+
+// Something that took from beginNanos until now
+void AQTrace_Complete(const char * name, UInt64 beginNanos, UInt64 arg);
+
+// Something that happened at one point in time
+void AQTrace_Instant(const char * name, UInt64 arg);
+
+bool AQTrace_WriteChromeJSON(const char path[]);
+
+/* Description:
+ * Records the lifetime of the enclosing block, see AQ_TRACE_SCOPE.
+ */
+struct AQTraceScope
+{
+	const char * mName;
+	UInt64 mBeginNanos;
+	UInt64 mArg;
+	
+	AQTraceScope(const char * name, UInt64 arg)
+	: mName(name), mBeginNanos(AQTrace_IsEnabled() ? AQTrace_Now() : 0), mArg(arg)
+	{
+	}
+	
+	~AQTraceScope()
+	{
+		if (mBeginNanos)
+		{
+			AQTrace_Complete(mName, mBeginNanos, mArg);
+		}
+	}
+};
+
+#define AQ_TRACE_CONCAT2(a, b) a##b
+#define AQ_TRACE_CONCAT(a, b) AQ_TRACE_CONCAT2(a, b)
+
+// Traces the rest of the enclosing block as name, with a number shown as its argument
+#define AQ_TRACE_SCOPE(name, arg) AQTraceScope AQ_TRACE_CONCAT(aqTraceScope, __LINE__)((name), (arg))
+
+#endif /* AQTrace_h */
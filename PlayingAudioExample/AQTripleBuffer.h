@@ -0,0 +1,85 @@
+//
+//  AQTripleBuffer.h
+//  PlayingAudioExample
+//
+
+/* Single-producer / single-consumer triple buffer. The writer always has a
+ * private slot to fill, the reader always has a private slot to look at, and the
+ * third slot is swapped between them atomically, so neither side ever waits.
+ * The struct is plain data (no constructors), so it can live inside structs that
+ * are memset to zero and then set up with AQTripleBuffer_Init.
+ */
+
+#ifndef AQTripleBuffer_h
+#define AQTripleBuffer_h
+
+#include "AQTypes.h"
+
+// Set in mMiddle when the middle slot holds data the reader has not picked up yet
+static const UInt32 kAQTripleBufferDirty = 0x4;
+static const UInt32 kAQTripleBufferIndexMask = 0x3;
+
+template <typename T>
+struct AQTripleBuffer
+{
+	T mSlots[3];
+	
+	/* Description:
+	 * Index of the shared slot, or'ed with kAQTripleBufferDirty. Only ever accessed atomically.
+	 */
+	UInt32 mMiddle;
+	
+	/* Description:
+	 * Slots privately owned by the writer and the reader.
+	 */
+	UInt32 mWriteIndex;
+	UInt32 mReadIndex;
+};
+
+template <typename T>
+void AQTripleBuffer_Init(AQTripleBuffer<T> * tb, const T * initialValue)
+{
+	tb->mSlots[0] = tb->mSlots[1] = tb->mSlots[2] = *initialValue;
+	tb->mWriteIndex = 0;
+	tb->mReadIndex = 2;
+	__atomic_store_n(&tb->mMiddle, 1, __ATOMIC_RELEASE);
+}
+
+// Writer side: the slot to fill before calling AQTripleBuffer_Publish
+template <typename T>
+T * AQTripleBuffer_WriteBuffer(AQTripleBuffer<T> * tb)
+{
+	return &tb->mSlots[tb->mWriteIndex];
+}
+
+template <typename T>
+void AQTripleBuffer_Publish(AQTripleBuffer<T> * tb)
+{
+	UInt32 previous = __atomic_exchange_n(&tb->mMiddle, tb->mWriteIndex | kAQTripleBufferDirty, __ATOMIC_ACQ_REL);
+	
+	tb->mWriteIndex = previous & kAQTripleBufferIndexMask;
+}
+
+// Reader side: picks up the latest published slot, returns false if nothing new was published
+template <typename T>
+bool AQTripleBuffer_Acquire(AQTripleBuffer<T> * tb)
+{
+	if (!(__atomic_load_n(&tb->mMiddle, __ATOMIC_ACQUIRE) & kAQTripleBufferDirty))
+	{
+		return false;
+	}
+	
+	UInt32 previous = __atomic_exchange_n(&tb->mMiddle, tb->mReadIndex, __ATOMIC_ACQ_REL);
+	
+	tb->mReadIndex = previous & kAQTripleBufferIndexMask;
+	
+	return true;
+}
+
+template <typename T>
+const T * AQTripleBuffer_ReadBuffer(const AQTripleBuffer<T> * tb)
+{
+	return &tb->mSlots[tb->mReadIndex];
+}
+
+#endif /* AQTripleBuffer_h */
@@ -0,0 +1,32 @@
+//
+//  AQTypes.h
+//  PlayingAudioExample
+//
+
+/* The DSP stages only need the fixed-size scalar types from MacTypes.h, so they
+ * take them from here instead of pulling in CoreFoundation. This keeps them
+ * buildable on hosts that have no AudioToolbox.
+ */
+
+#ifndef AQTypes_h
+#define AQTypes_h
+
+#ifdef __APPLE__
+#include <MacTypes.h>
+#else
+#include <stdint.h>
+
+typedef uint8_t  UInt8;
+typedef int8_t   SInt8;
+typedef uint16_t UInt16;
+typedef int16_t  SInt16;
+typedef uint32_t UInt32;
+typedef int32_t  SInt32;
+typedef uint64_t UInt64;
+typedef int64_t  SInt64;
+typedef float    Float32;
+typedef double   Float64;
+typedef int32_t  OSStatus;
+#endif
+
+#endif /* AQTypes_h */
@@ -0,0 +1,1909 @@
+//
+//  AQVorbis.cpp
+//  PlayingAudioExample
+//
+
+#include "AQVorbis.h"
+#include "AQArena.h"
+#include "AQMDCT.h"
+#include "AQOgg.h"
+#include "AQSimd.h"
+#include "AQTrace.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const UInt8 kVorbisPacketIdentification = 1;
+static const UInt8 kVorbisPacketComment = 3;
+static const UInt8 kVorbisPacketSetup = 5;
+
+static const UInt32 kVorbisCodebookSync = 0x564342;
+static const UInt32 kVorbisFloor1MaxValues = 65;
+static const UInt32 kVorbisMaxClassifications = 64;
+static const UInt32 kVorbisMinBlockSize = 64;
+static const UInt32 kVorbisMaxBlockSize = 8192;
+
+// Codes up to this long are decoded with one table lookup, longer ones by a search
+static const UInt32 kVorbisFastBits = 10;
+
+// Whatever the decoder holds for one file comes out of its arena in blocks of this size
+static const size_t kVorbisArenaBlockSize = 64 * 1024;
+
+/* Description:
+ * LSB-first reader over one packet. Reading past the end sets mIsPastEnd and
+ * returns zeros: that is how the format ends a truncated audio packet.
+ */
+struct AQVorbisBits
+{
+	const UInt8 * mData;
+	const UInt8 * mEnd;
+	UInt64 mBuffer;
+	SInt32 mNumBits;
+	bool mIsPastEnd;
+};
+
+struct AQVorbisCodebook
+{
+	UInt32 mDimensions;
+	UInt32 mNumEntries;
+	
+	/* Description:
+	 * Codeword length of each entry, 0 for entries that are not used.
+	 */
+	UInt8 * mLengths;
+	
+	/* Description:
+	 * The entry whose code the next mFastBits bits start with (LSB first), -1 when
+	 * the code is longer than that.
+	 */
+	UInt32 mFastBits;
+	SInt32 * mFastTable;
+	
+	/* Description:
+	 * Codes longer than mFastBits, MSB aligned and in ascending order, and their entries.
+	 */
+	UInt32 mNumLongCodes;
+	UInt32 * mLongCodes;
+	UInt32 * mLongEntries;
+	
+	/* Description:
+	 * The vector of each entry, mDimensions values apiece. NULL for codebooks
+	 * that only code scalars.
+	 */
+	Float32 * mValues;
+};
+
+struct AQVorbisFloor
+{
+	UInt32 mNumPartitions;
+	UInt8 mPartitionClasses[31];
+	
+	UInt8 mClassDimensions[16];
+	UInt8 mClassSubclasses[16];
+	SInt16 mClassMasterbooks[16];
+	SInt16 mSubclassBooks[16][8];
+	
+	UInt32 mMultiplier;
+	UInt32 mNumValues;
+	UInt32 mX[kVorbisFloor1MaxValues];
+	
+	/* Description:
+	 * Value indices in order of mX, and for every value from the third on the
+	 * closest earlier ones to its left and right.
+	 */
+	UInt8 mSorted[kVorbisFloor1MaxValues];
+	UInt8 mLowNeighbors[kVorbisFloor1MaxValues];
+	UInt8 mHighNeighbors[kVorbisFloor1MaxValues];
+};
+
+struct AQVorbisResidue
+{
+	UInt32 mType;
+	UInt32 mBegin;
+	UInt32 mEnd;
+	UInt32 mPartitionSize;
+	UInt32 mNumClassifications;
+	UInt32 mClassbook;
+	
+	/* Description:
+	 * Codebook of each classification in each of the eight passes, -1 for none.
+	 */
+	SInt16 mBooks[kVorbisMaxClassifications][8];
+	
+	/* Description:
+	 * The classifications each classbook entry stands for, one per partition it covers.
+	 */
+	UInt8 * mClassWords;
+};
+
+struct AQVorbisMapping
+{
+	UInt32 mNumSubmaps;
+	UInt32 mNumCouplingSteps;
+	UInt8 mMagnitudes[256];
+	UInt8 mAngles[256];
+	
+	/* Description:
+	 * Submap of each channel, and each submap's floor and residue.
+	 */
+	UInt8 * mMux;
+	UInt8 mSubmapFloors[16];
+	UInt8 mSubmapResidues[16];
+};
+
+struct AQVorbisMode
+{
+	UInt32 mBlockFlag;
+	UInt32 mMapping;
+};
+
+struct AQVorbisFile
+{
+	struct AQOggReader mReader;
+	struct AQVorbisInfo mInfo;
+	struct AQArena mArena;
+	
+	UInt32 mNumCodebooks;
+	struct AQVorbisCodebook * mCodebooks;
+	UInt32 mNumFloors;
+	struct AQVorbisFloor * mFloors;
+	UInt32 mNumResidues;
+	struct AQVorbisResidue * mResidues;
+	UInt32 mNumMappings;
+	struct AQVorbisMapping * mMappings;
+	UInt32 mNumModes;
+	UInt32 mModeBits;
+	struct AQVorbisMode * mModes;
+	
+	/* Description:
+	 * Transform and rising window half of each block size.
+	 */
+	struct AQMDCTPlan mMDCT[2];
+	Float32 * mWindowSlopes[2];
+	
+	/* Description:
+	 * Per channel, mBlockSizes[1] / 2 values each: the spectrum being decoded, the
+	 * windowed second half of the previous block and the frames finished by the
+	 * last packet. mBlock holds one channel's inverse transform.
+	 */
+	Float32 * mSpectra;
+	Float32 * mOverlap;
+	Float32 * mOutput;
+	Float32 * mBlock;
+	
+	/* Description:
+	 * Per channel floor values and flags of the packet being decoded.
+	 */
+	SInt32 * mFloorY;
+	bool * mIsFloorUsed;
+	bool * mHasResidue;
+	
+	/* Description:
+	 * Scratch for floor and residue decoding: the floor curve, the interleaved
+	 * vector of residue type 2, each vector's partition classifications
+	 * (mClassificationsStride apiece), and the vectors of one submap.
+	 */
+	Float32 * mFloorCurve;
+	Float32 * mInterleavedResidue;
+	UInt8 * mClassifications;
+	UInt32 mClassificationsStride;
+	Float32 ** mSubmapVectors;
+	bool * mSubmapDoNotDecode;
+	
+	/* Description:
+	 * Size of the previous block, 0 before the first audio packet, which only
+	 * primes the overlap.
+	 */
+	UInt32 mPreviousBlockSize;
+	
+	/* Description:
+	 * Frames in mOutput and how many of them were read already.
+	 */
+	UInt32 mNumOutputFrames;
+	UInt32 mOutputPosition;
+	
+	UInt64 mAudioOffset;
+	UInt64 mFramePosition;
+};
+
+// Bits needed to store x
+static
+UInt32 AQVorbis_ILog(UInt32 x)
+{
+	UInt32 n = 0;
+	
+	while (x)
+	{
+		n++;
+		x >>= 1;
+	}
+	
+	return n;
+}
+
+static inline
+UInt32 AQVorbis_BitReverse(UInt32 x)
+{
+	x = ((x & 0xaaaaaaaa) >> 1) | ((x & 0x55555555) << 1);
+	x = ((x & 0xcccccccc) >> 2) | ((x & 0x33333333) << 2);
+	x = ((x & 0xf0f0f0f0) >> 4) | ((x & 0x0f0f0f0f) << 4);
+	x = ((x & 0xff00ff00) >> 8) | ((x & 0x00ff00ff) << 8);
+	
+	return (x >> 16) | (x << 16);
+}
+
+// The format's own 32 bit float: 21 bit mantissa, 10 bit exponent biased by 788, sign
+static
+Float32 AQVorbis_UnpackFloat(UInt32 x)
+{
+	Float64 mantissa = x & 0x1fffff;
+	int exponent = (int) ((x & 0x7fe00000) >> 21) - 788;
+	
+	return (Float32) ldexp(x & 0x80000000 ? -mantissa : mantissa, exponent);
+}
+
+// The largest r with r^dimensions <= numEntries
+static
+UInt32 AQVorbis_Lookup1Values(UInt32 numEntries, UInt32 dimensions)
+{
+	UInt32 r = (UInt32) floor(exp(log((Float64) numEntries) / dimensions));
+	
+	for (;;)
+	{
+		UInt64 power = 1;
+		UInt32 k;
+		
+		for (k = 0; k < dimensions && power <= numEntries; k++)
+		{
+			power *= r + 1;
+		}
+		
+		if (power > numEntries)
+		{
+			break;
+		}
+		
+		r++;
+	}
+	
+	return r;
+}
+
+struct AQVorbisDBTable
+{
+	Float32 mValues[256];
+};
+
+// floor1_inverse_dB_table: 256 steps from -140 dB to 0 dB
+static
+struct AQVorbisDBTable AQVorbis_MakeDBTable()
+{
+	struct AQVorbisDBTable table;
+	UInt32 k;
+	
+	for (k = 0; k < 256; k++)
+	{
+		table.mValues[k] = (Float32) pow(1.0649863e-07, (255 - k) / 255.0);
+	}
+	
+	return table;
+}
+
+static
+void AQVorbisBits_Init(struct AQVorbisBits * bits, const UInt8 * data, UInt32 size)
+{
+	bits->mData = data;
+	bits->mEnd = data + size;
+	bits->mBuffer = 0;
+	bits->mNumBits = 0;
+	bits->mIsPastEnd = false;
+}
+
+static inline
+void AQVorbisBits_Refill(struct AQVorbisBits * bits)
+{
+	while (bits->mNumBits <= 56 && bits->mData < bits->mEnd)
+	{
+		bits->mBuffer |= (UInt64) *bits->mData++ << bits->mNumBits;
+		bits->mNumBits += 8;
+	}
+}
+
+// n <= 32
+static inline
+UInt32 AQVorbisBits_Read(struct AQVorbisBits * bits, UInt32 n)
+{
+	if (bits->mNumBits < (SInt32) n)
+	{
+		AQVorbisBits_Refill(bits);
+		
+		if (bits->mNumBits < (SInt32) n)
+		{
+			bits->mIsPastEnd = true;
+			bits->mBuffer = 0;
+			bits->mNumBits = 0;
+			return 0;
+		}
+	}
+	
+	UInt32 value = (UInt32) (bits->mBuffer & ((1ULL << n) - 1));
+	
+	bits->mBuffer >>= n;
+	bits->mNumBits -= n;
+	
+	return value;
+}
+
+static
+SInt32 AQVorbisCodebook_DecodeLong(const struct AQVorbisCodebook * book, UInt32 peek)
+{
+	UInt32 value = AQVorbis_BitReverse(peek);
+	UInt32 low = 0;
+	UInt32 high = book->mNumLongCodes;
+	
+	if (high == 0 || book->mLongCodes[0] > value)
+	{
+		return -1;
+	}
+	
+	// The largest code not above value is the only one that can be its prefix
+	while (high - low > 1)
+	{
+		UInt32 middle = (low + high) / 2;
+		
+		if (book->mLongCodes[middle] <= value)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	
+	UInt32 entry = book->mLongEntries[low];
+	
+	if ((value ^ book->mLongCodes[low]) >> (32 - book->mLengths[entry]) != 0)
+	{
+		return -1;
+	}
+	
+	return (SInt32) entry;
+}
+
+// The next entry, -1 at the end of the packet or on a code the book does not have
+static inline
+SInt32 AQVorbisCodebook_Decode(const struct AQVorbisCodebook * book, struct AQVorbisBits * bits)
+{
+	AQVorbisBits_Refill(bits);
+	
+	UInt32 peek = (UInt32) bits->mBuffer;
+	SInt32 entry = book->mFastTable[peek & ((1U << book->mFastBits) - 1)];
+	
+	if (entry < 0)
+	{
+		entry = AQVorbisCodebook_DecodeLong(book, peek);
+		
+		if (entry < 0)
+		{
+			bits->mIsPastEnd = true;
+			return -1;
+		}
+	}
+	
+	SInt32 length = book->mLengths[entry];
+	
+	if (length > bits->mNumBits)
+	{
+		bits->mIsPastEnd = true;
+		bits->mBuffer = 0;
+		bits->mNumBits = 0;
+		return -1;
+	}
+	
+	bits->mBuffer >>= length;
+	bits->mNumBits -= length;
+	
+	return entry;
+}
+
+struct AQVorbisLongCode
+{
+	UInt32 mCode;
+	UInt32 mEntry;
+};
+
+static
+int AQVorbisLongCode_Compare(const void * a, const void * b)
+{
+	UInt32 x = ((const struct AQVorbisLongCode *) a)->mCode;
+	UInt32 y = ((const struct AQVorbisLongCode *) b)->mCode;
+	
+	return x < y ? -1 : x > y;
+}
+
+/* Assigns the codewords the way the format defines them: in entry order, each
+ * entry takes the lowest free code of its length, kept in available[] as the
+ * free node at each depth of the tree (MSB aligned, 0 for none). Then builds
+ * the lookup table and the sorted list of long codes.
+ */
+static
+bool AQVorbisCodebook_BuildDecoder(struct AQVorbisCodebook * book, struct AQArena * arena)
+{
+	UInt32 available[33];
+	UInt32 * codes = (UInt32 *) malloc(book->mNumEntries * sizeof(UInt32));
+	UInt32 numUsed = 0;
+	UInt32 maxLength = 0;
+	SInt32 lastUsed = -1;
+	UInt32 k, depth;
+	
+	memset(available, 0, sizeof(available));
+	
+	for (k = 0; k < book->mNumEntries; k++)
+	{
+		UInt32 length = book->mLengths[k];
+		
+		if (length == 0)
+		{
+			continue;
+		}
+		
+		if (numUsed == 0)
+		{
+			codes[k] = 0;
+			
+			for (depth = 1; depth <= length; depth++)
+			{
+				available[depth] = 1U << (32 - depth);
+			}
+		}
+		else
+		{
+			for (depth = length; depth > 0 && available[depth] == 0; depth--)
+			{
+			}
+			
+			if (depth == 0)
+			{
+				// More codes than the lengths leave room for
+				free(codes);
+				return false;
+			}
+			
+			codes[k] = available[depth];
+			available[depth] = 0;
+			
+			for (; length > depth; length--)
+			{
+				available[length] = codes[k] + (1U << (32 - length));
+			}
+		}
+		
+		numUsed++;
+		lastUsed = (SInt32) k;
+		maxLength = book->mLengths[k] > maxLength ? book->mLengths[k] : maxLength;
+	}
+	
+	book->mFastBits = maxLength < kVorbisFastBits ? maxLength : kVorbisFastBits;
+	book->mFastTable = (SInt32 *) AQArena_Alloc(arena, (sizeof(SInt32)) << book->mFastBits);
+	memset(book->mFastTable, 0xff, (sizeof(SInt32)) << book->mFastBits);
+	
+	if (numUsed == 1)
+	{
+		// A lone entry has no tree to speak of; any bits select it
+		for (k = 0; k < 1U << book->mFastBits; k++)
+		{
+			book->mFastTable[k] = lastUsed;
+		}
+		
+		free(codes);
+		return true;
+	}
+	
+	struct AQVorbisLongCode * longCodes = (struct AQVorbisLongCode *) malloc(book->mNumEntries * sizeof(struct AQVorbisLongCode));
+	
+	book->mNumLongCodes = 0;
+	
+	for (k = 0; k < book->mNumEntries; k++)
+	{
+		UInt32 length = book->mLengths[k];
+		
+		if (length == 0)
+		{
+			continue;
+		}
+		
+		if (length <= book->mFastBits)
+		{
+			UInt32 index;
+			
+			for (index = AQVorbis_BitReverse(codes[k]); index < 1U << book->mFastBits; index += 1U << length)
+			{
+				book->mFastTable[index] = (SInt32) k;
+			}
+		}
+		else
+		{
+			longCodes[book->mNumLongCodes].mCode = codes[k];
+			longCodes[book->mNumLongCodes].mEntry = k;
+			book->mNumLongCodes++;
+		}
+	}
+	
+	qsort(longCodes, book->mNumLongCodes, sizeof(struct AQVorbisLongCode), AQVorbisLongCode_Compare);
+	
+	book->mLongCodes = (UInt32 *) AQArena_Alloc(arena, book->mNumLongCodes * sizeof(UInt32));
+	book->mLongEntries = (UInt32 *) AQArena_Alloc(arena, book->mNumLongCodes * sizeof(UInt32));
+	
+	for (k = 0; k < book->mNumLongCodes; k++)
+	{
+		book->mLongCodes[k] = longCodes[k].mCode;
+		book->mLongEntries[k] = longCodes[k].mEntry;
+	}
+	
+	free(longCodes);
+	free(codes);
+	
+	return true;
+}
+
+// Unpacks the multiplicands of lookup type 1 (a lattice) or 2 (listed) into one vector per entry
+static
+bool AQVorbisCodebook_ReadValues(struct AQVorbisCodebook * book, struct AQVorbisBits * bits, UInt32 lookupType, struct AQArena * arena)
+{
+	Float32 minimum = AQVorbis_UnpackFloat(AQVorbisBits_Read(bits, 32));
+	Float32 delta = AQVorbis_UnpackFloat(AQVorbisBits_Read(bits, 32));
+	UInt32 valueBits = AQVorbisBits_Read(bits, 4) + 1;
+	bool isSequence = AQVorbisBits_Read(bits, 1) != 0;
+	UInt64 numValues = lookupType == 1 ? AQVorbis_Lookup1Values(book->mNumEntries, book->mDimensions)
+									   : (UInt64) book->mNumEntries * book->mDimensions;
+	UInt32 k, e, d;
+	
+	if (numValues == 0 || numValues * valueBits > (UInt64) (bits->mEnd - bits->mData + 8) * 8)
+	{
+		return false;
+	}
+	
+	UInt32 * multiplicands = (UInt32 *) malloc((size_t) numValues * sizeof(UInt32));
+	
+	for (k = 0; k < numValues; k++)
+	{
+		multiplicands[k] = AQVorbisBits_Read(bits, valueBits);
+	}
+	
+	book->mValues = (Float32 *) AQArena_Alloc(arena, (size_t) book->mNumEntries * book->mDimensions * sizeof(Float32));
+	
+	for (e = 0; e < book->mNumEntries; e++)
+	{
+		Float32 * values = book->mValues + (size_t) e * book->mDimensions;
+		Float32 last = 0.f;
+		UInt32 divisor = 1;
+		
+		for (d = 0; d < book->mDimensions; d++)
+		{
+			UInt32 offset;
+			
+			if (lookupType == 1)
+			{
+				offset = (e / divisor) % (UInt32) numValues;
+				divisor *= (UInt32) numValues;
+			}
+			else
+			{
+				offset = e * book->mDimensions + d;
+			}
+			
+			values[d] = multiplicands[offset] * delta + minimum + last;
+			
+			if (isSequence)
+			{
+				last = values[d];
+			}
+		}
+	}
+	
+	free(multiplicands);
+	
+	return !bits->mIsPastEnd;
+}
+
+static
+bool AQVorbisCodebook_Read(struct AQVorbisCodebook * book, struct AQVorbisBits * bits, struct AQArena * arena)
+{
+	UInt32 k;
+	
+	memset(book, 0, sizeof(struct AQVorbisCodebook));
+	
+	if (AQVorbisBits_Read(bits, 24) != kVorbisCodebookSync)
+	{
+		return false;
+	}
+	
+	book->mDimensions = AQVorbisBits_Read(bits, 16);
+	book->mNumEntries = AQVorbisBits_Read(bits, 24);
+	
+	if (book->mDimensions == 0 || book->mNumEntries == 0 || bits->mIsPastEnd)
+	{
+		return false;
+	}
+	
+	book->mLengths = (UInt8 *) AQArena_Calloc(arena, book->mNumEntries, 1);
+	
+	if (AQVorbisBits_Read(bits, 1))
+	{
+		// Ordered: runs of entries with lengths going up by one
+		UInt32 length = AQVorbisBits_Read(bits, 5) + 1;
+		
+		for (k = 0; k < book->mNumEntries && !bits->mIsPastEnd; length++)
+		{
+			UInt32 count = AQVorbisBits_Read(bits, AQVorbis_ILog(book->mNumEntries - k));
+			
+			if (length > 32 || count > book->mNumEntries - k)
+			{
+				return false;
+			}
+			
+			memset(book->mLengths + k, (int) length, count);
+			k += count;
+		}
+	}
+	else
+	{
+		bool isSparse = AQVorbisBits_Read(bits, 1) != 0;
+		
+		for (k = 0; k < book->mNumEntries && !bits->mIsPastEnd; k++)
+		{
+			if (!isSparse || AQVorbisBits_Read(bits, 1))
+			{
+				book->mLengths[k] = (UInt8) (AQVorbisBits_Read(bits, 5) + 1);
+			}
+		}
+	}
+	
+	UInt32 lookupType = AQVorbisBits_Read(bits, 4);
+	
+	if (lookupType == 1 || lookupType == 2)
+	{
+		if (!AQVorbisCodebook_ReadValues(book, bits, lookupType, arena))
+		{
+			return false;
+		}
+	}
+	else if (lookupType != 0)
+	{
+		return false;
+	}
+	
+	return !bits->mIsPastEnd && AQVorbisCodebook_BuildDecoder(book, arena);
+}
+
+static
+bool AQVorbisFloor_Read(struct AQVorbisFloor * floor, struct AQVorbisBits * bits, UInt32 numCodebooks)
+{
+	UInt32 numClasses = 0;
+	UInt32 k, j;
+	
+	memset(floor, 0, sizeof(struct AQVorbisFloor));
+	
+	floor->mNumPartitions = AQVorbisBits_Read(bits, 5);
+	
+	for (k = 0; k < floor->mNumPartitions; k++)
+	{
+		floor->mPartitionClasses[k] = (UInt8) AQVorbisBits_Read(bits, 4);
+		numClasses = floor->mPartitionClasses[k] + 1U > numClasses ? floor->mPartitionClasses[k] + 1U : numClasses;
+	}
+	
+	for (k = 0; k < numClasses; k++)
+	{
+		floor->mClassDimensions[k] = (UInt8) (AQVorbisBits_Read(bits, 3) + 1);
+		floor->mClassSubclasses[k] = (UInt8) AQVorbisBits_Read(bits, 2);
+		floor->mClassMasterbooks[k] = floor->mClassSubclasses[k] ? (SInt16) AQVorbisBits_Read(bits, 8) : -1;
+		
+		if (floor->mClassMasterbooks[k] >= (SInt32) numCodebooks)
+		{
+			return false;
+		}
+		
+		for (j = 0; j < 1U << floor->mClassSubclasses[k]; j++)
+		{
+			floor->mSubclassBooks[k][j] = (SInt16) ((SInt32) AQVorbisBits_Read(bits, 8) - 1);
+			
+			if (floor->mSubclassBooks[k][j] >= (SInt32) numCodebooks)
+			{
+				return false;
+			}
+		}
+	}
+	
+	floor->mMultiplier = AQVorbisBits_Read(bits, 2) + 1;
+	
+	UInt32 rangeBits = AQVorbisBits_Read(bits, 4);
+	
+	floor->mX[0] = 0;
+	floor->mX[1] = 1U << rangeBits;
+	floor->mNumValues = 2;
+	
+	for (k = 0; k < floor->mNumPartitions; k++)
+	{
+		UInt32 dimensions = floor->mClassDimensions[floor->mPartitionClasses[k]];
+		
+		for (j = 0; j < dimensions; j++)
+		{
+			if (floor->mNumValues == kVorbisFloor1MaxValues)
+			{
+				return false;
+			}
+			
+			floor->mX[floor->mNumValues++] = AQVorbisBits_Read(bits, rangeBits);
+		}
+	}
+	
+	// Insertion sort by X; repeated X values are not allowed
+	for (k = 0; k < floor->mNumValues; k++)
+	{
+		UInt8 value = (UInt8) k;
+		
+		for (j = k; j > 0 && floor->mX[floor->mSorted[j - 1]] > floor->mX[value]; j--)
+		{
+			floor->mSorted[j] = floor->mSorted[j - 1];
+		}
+		
+		if (j > 0 && floor->mX[floor->mSorted[j - 1]] == floor->mX[value])
+		{
+			return false;
+		}
+		
+		floor->mSorted[j] = value;
+	}
+	
+	for (k = 2; k < floor->mNumValues; k++)
+	{
+		SInt32 low = -1, high = -1;
+		
+		for (j = 0; j < k; j++)
+		{
+			if (floor->mX[j] < floor->mX[k] && (low < 0 || floor->mX[j] > floor->mX[low]))
+			{
+				low = (SInt32) j;
+			}
+			
+			if (floor->mX[j] > floor->mX[k] && (high < 0 || floor->mX[j] < floor->mX[high]))
+			{
+				high = (SInt32) j;
+			}
+		}
+		
+		if (low < 0 || high < 0)
+		{
+			return false;
+		}
+		
+		floor->mLowNeighbors[k] = (UInt8) low;
+		floor->mHighNeighbors[k] = (UInt8) high;
+	}
+	
+	return !bits->mIsPastEnd;
+}
+
+static
+bool AQVorbisResidue_Read(struct AQVorbisResidue * residue,
+						  struct AQVorbisBits * bits,
+						  UInt32 type,
+						  const struct AQVorbisCodebook * codebooks,
+						  UInt32 numCodebooks,
+						  struct AQArena * arena)
+{
+	UInt8 cascades[kVorbisMaxClassifications];
+	UInt32 k, j;
+	
+	memset(residue, 0, sizeof(struct AQVorbisResidue));
+	
+	residue->mType = type;
+	residue->mBegin = AQVorbisBits_Read(bits, 24);
+	residue->mEnd = AQVorbisBits_Read(bits, 24);
+	residue->mPartitionSize = AQVorbisBits_Read(bits, 24) + 1;
+	residue->mNumClassifications = AQVorbisBits_Read(bits, 6) + 1;
+	residue->mClassbook = AQVorbisBits_Read(bits, 8);
+	
+	if (residue->mClassbook >= numCodebooks)
+	{
+		return false;
+	}
+	
+	for (k = 0; k < residue->mNumClassifications; k++)
+	{
+		UInt32 lowBits = AQVorbisBits_Read(bits, 3);
+		UInt32 highBits = AQVorbisBits_Read(bits, 1) ? AQVorbisBits_Read(bits, 5) : 0;
+		
+		cascades[k] = (UInt8) (highBits << 3 | lowBits);
+	}
+	
+	for (k = 0; k < residue->mNumClassifications; k++)
+	{
+		for (j = 0; j < 8; j++)
+		{
+			residue->mBooks[k][j] = -1;
+			
+			if (cascades[k] & (1 << j))
+			{
+				UInt32 book = AQVorbisBits_Read(bits, 8);
+				
+				// Partitions are decoded in whole vectors
+				if (book >= numCodebooks || !codebooks[book].mValues ||
+					residue->mPartitionSize % codebooks[book].mDimensions != 0)
+				{
+					return false;
+				}
+				
+				residue->mBooks[k][j] = (SInt16) book;
+			}
+		}
+	}
+	
+	const struct AQVorbisCodebook * classbook = &codebooks[residue->mClassbook];
+	UInt32 numWords = classbook->mDimensions;
+	
+	residue->mClassWords = (UInt8 *) AQArena_Alloc(arena, (size_t) classbook->mNumEntries * numWords);
+	
+	for (k = 0; k < classbook->mNumEntries; k++)
+	{
+		UInt32 value = k;
+		
+		for (j = numWords; j-- > 0; )
+		{
+			residue->mClassWords[(size_t) k * numWords + j] = (UInt8) (value % residue->mNumClassifications);
+			value /= residue->mNumClassifications;
+		}
+	}
+	
+	return !bits->mIsPastEnd;
+}
+
+static
+bool AQVorbisMapping_Read(struct AQVorbisMapping * mapping, struct AQVorbisBits * bits, const struct AQVorbisFile * file, struct AQArena * arena)
+{
+	UInt32 numChannels = file->mInfo.mNumChannels;
+	UInt32 channelBits = AQVorbis_ILog(numChannels - 1);
+	UInt32 k;
+	
+	memset(mapping, 0, sizeof(struct AQVorbisMapping));
+	
+	if (AQVorbisBits_Read(bits, 16) != 0)
+	{
+		return false;
+	}
+	
+	mapping->mNumSubmaps = AQVorbisBits_Read(bits, 1) ? AQVorbisBits_Read(bits, 4) + 1 : 1;
+	
+	if (AQVorbisBits_Read(bits, 1))
+	{
+		mapping->mNumCouplingSteps = AQVorbisBits_Read(bits, 8) + 1;
+		
+		for (k = 0; k < mapping->mNumCouplingSteps; k++)
+		{
+			UInt32 magnitude = AQVorbisBits_Read(bits, channelBits);
+			UInt32 angle = AQVorbisBits_Read(bits, channelBits);
+			
+			if (magnitude == angle || magnitude >= numChannels || angle >= numChannels)
+			{
+				return false;
+			}
+			
+			mapping->mMagnitudes[k] = (UInt8) magnitude;
+			mapping->mAngles[k] = (UInt8) angle;
+		}
+	}
+	
+	if (AQVorbisBits_Read(bits, 2) != 0)
+	{
+		return false;
+	}
+	
+	mapping->mMux = (UInt8 *) AQArena_Calloc(arena, numChannels, 1);
+	
+	if (mapping->mNumSubmaps > 1)
+	{
+		for (k = 0; k < numChannels; k++)
+		{
+			mapping->mMux[k] = (UInt8) AQVorbisBits_Read(bits, 4);
+			
+			if (mapping->mMux[k] >= mapping->mNumSubmaps)
+			{
+				return false;
+			}
+		}
+	}
+	
+	for (k = 0; k < mapping->mNumSubmaps; k++)
+	{
+		// Unused time configuration
+		AQVorbisBits_Read(bits, 8);
+		
+		mapping->mSubmapFloors[k] = (UInt8) AQVorbisBits_Read(bits, 8);
+		mapping->mSubmapResidues[k] = (UInt8) AQVorbisBits_Read(bits, 8);
+		
+		if (mapping->mSubmapFloors[k] >= file->mNumFloors || mapping->mSubmapResidues[k] >= file->mNumResidues)
+		{
+			return false;
+		}
+	}
+	
+	return !bits->mIsPastEnd;
+}
+
+// Checks the packet type and "vorbis", and leaves bits after them
+static
+bool AQVorbis_StartHeader(struct AQVorbisBits * bits, const UInt8 * packet, UInt32 size, UInt8 type)
+{
+	if (size < 7 || packet[0] != type || memcmp(packet + 1, "vorbis", 6) != 0)
+	{
+		return false;
+	}
+	
+	AQVorbisBits_Init(bits, packet + 7, size - 7);
+	
+	return true;
+}
+
+static
+bool AQVorbisFile_ReadIdentification(struct AQVorbisFile * file, const UInt8 * packet, UInt32 size)
+{
+	struct AQVorbisBits bits;
+	
+	if (!AQVorbis_StartHeader(&bits, packet, size, kVorbisPacketIdentification) || AQVorbisBits_Read(&bits, 32) != 0)
+	{
+		return false;
+	}
+	
+	file->mInfo.mNumChannels = AQVorbisBits_Read(&bits, 8);
+	file->mInfo.mSampleRate = AQVorbisBits_Read(&bits, 32);
+	
+	// Maximum, nominal and minimum bit rates
+	AQVorbisBits_Read(&bits, 32);
+	AQVorbisBits_Read(&bits, 32);
+	AQVorbisBits_Read(&bits, 32);
+	
+	file->mInfo.mBlockSizes[0] = 1U << AQVorbisBits_Read(&bits, 4);
+	file->mInfo.mBlockSizes[1] = 1U << AQVorbisBits_Read(&bits, 4);
+	
+	return AQVorbisBits_Read(&bits, 1) == 1 && !bits.mIsPastEnd &&
+		   file->mInfo.mNumChannels > 0 && file->mInfo.mSampleRate > 0 &&
+		   file->mInfo.mBlockSizes[0] >= kVorbisMinBlockSize &&
+		   file->mInfo.mBlockSizes[0] <= file->mInfo.mBlockSizes[1] &&
+		   file->mInfo.mBlockSizes[1] <= kVorbisMaxBlockSize;
+}
+
+static
+bool AQVorbisFile_ReadSetup(struct AQVorbisFile * file, const UInt8 * packet, UInt32 size)
+{
+	struct AQArena * arena = &file->mArena;
+	struct AQVorbisBits bits;
+	UInt32 k;
+	
+	if (!AQVorbis_StartHeader(&bits, packet, size, kVorbisPacketSetup))
+	{
+		return false;
+	}
+	
+	file->mNumCodebooks = AQVorbisBits_Read(&bits, 8) + 1;
+	file->mCodebooks = (struct AQVorbisCodebook *) AQArena_Calloc(arena, file->mNumCodebooks, sizeof(struct AQVorbisCodebook));
+	
+	for (k = 0; k < file->mNumCodebooks; k++)
+	{
+		if (!AQVorbisCodebook_Read(&file->mCodebooks[k], &bits, arena))
+		{
+			return false;
+		}
+	}
+	
+	// Time domain transforms, placeholders that must all be 0
+	UInt32 numTimes = AQVorbisBits_Read(&bits, 6) + 1;
+	
+	for (k = 0; k < numTimes; k++)
+	{
+		if (AQVorbisBits_Read(&bits, 16) != 0)
+		{
+			return false;
+		}
+	}
+	
+	file->mNumFloors = AQVorbisBits_Read(&bits, 6) + 1;
+	file->mFloors = (struct AQVorbisFloor *) AQArena_Calloc(arena, file->mNumFloors, sizeof(struct AQVorbisFloor));
+	
+	for (k = 0; k < file->mNumFloors; k++)
+	{
+		if (AQVorbisBits_Read(&bits, 16) != 1 || !AQVorbisFloor_Read(&file->mFloors[k], &bits, file->mNumCodebooks))
+		{
+			return false;
+		}
+	}
+	
+	file->mNumResidues = AQVorbisBits_Read(&bits, 6) + 1;
+	file->mResidues = (struct AQVorbisResidue *) AQArena_Calloc(arena, file->mNumResidues, sizeof(struct AQVorbisResidue));
+	
+	for (k = 0; k < file->mNumResidues; k++)
+	{
+		UInt32 type = AQVorbisBits_Read(&bits, 16);
+		
+		if (type > 2 || !AQVorbisResidue_Read(&file->mResidues[k], &bits, type, file->mCodebooks, file->mNumCodebooks, arena))
+		{
+			return false;
+		}
+	}
+	
+	file->mNumMappings = AQVorbisBits_Read(&bits, 6) + 1;
+	file->mMappings = (struct AQVorbisMapping *) AQArena_Calloc(arena, file->mNumMappings, sizeof(struct AQVorbisMapping));
+	
+	for (k = 0; k < file->mNumMappings; k++)
+	{
+		if (!AQVorbisMapping_Read(&file->mMappings[k], &bits, file, arena))
+		{
+			return false;
+		}
+	}
+	
+	file->mNumModes = AQVorbisBits_Read(&bits, 6) + 1;
+	file->mModeBits = AQVorbis_ILog(file->mNumModes - 1);
+	file->mModes = (struct AQVorbisMode *) AQArena_Calloc(arena, file->mNumModes, sizeof(struct AQVorbisMode));
+	
+	for (k = 0; k < file->mNumModes; k++)
+	{
+		file->mModes[k].mBlockFlag = AQVorbisBits_Read(&bits, 1);
+		
+		// Window and transform types, both 0
+		if (AQVorbisBits_Read(&bits, 16) != 0 || AQVorbisBits_Read(&bits, 16) != 0)
+		{
+			return false;
+		}
+		
+		file->mModes[k].mMapping = AQVorbisBits_Read(&bits, 8);
+		
+		if (file->mModes[k].mMapping >= file->mNumMappings)
+		{
+			return false;
+		}
+	}
+	
+	return AQVorbisBits_Read(&bits, 1) == 1 && !bits.mIsPastEnd;
+}
+
+// Transforms, windows and the scratch every packet decodes into, once the headers are known
+static
+void AQVorbisFile_AllocateBuffers(struct AQVorbisFile * file)
+{
+	struct AQArena * arena = &file->mArena;
+	UInt32 numChannels = file->mInfo.mNumChannels;
+	UInt32 maxHalf = file->mInfo.mBlockSizes[1] / 2;
+	UInt32 k, j;
+	
+	for (k = 0; k < 2; k++)
+	{
+		UInt32 size = file->mInfo.mBlockSizes[k];
+		UInt32 slopeSize = size / 2;
+		
+		AQMDCTPlan_Init(&file->mMDCT[k], size);
+		file->mWindowSlopes[k] = (Float32 *) AQArena_Alloc(arena, slopeSize * sizeof(Float32));
+		
+		for (j = 0; j < slopeSize; j++)
+		{
+			Float64 x = sin((j + 0.5) / slopeSize * M_PI / 2);
+			
+			file->mWindowSlopes[k][j] = (Float32) sin(M_PI / 2 * x * x);
+		}
+	}
+	
+	file->mSpectra = (Float32 *) AQArena_Calloc(arena, (size_t) numChannels * maxHalf, sizeof(Float32));
+	file->mOverlap = (Float32 *) AQArena_Calloc(arena, (size_t) numChannels * maxHalf, sizeof(Float32));
+	file->mOutput = (Float32 *) AQArena_Calloc(arena, (size_t) numChannels * maxHalf, sizeof(Float32));
+	file->mBlock = (Float32 *) AQArena_Calloc(arena, 2 * maxHalf, sizeof(Float32));
+	
+	file->mFloorY = (SInt32 *) AQArena_Calloc(arena, (size_t) numChannels * kVorbisFloor1MaxValues, sizeof(SInt32));
+	file->mIsFloorUsed = (bool *) AQArena_Calloc(arena, numChannels, sizeof(bool));
+	file->mHasResidue = (bool *) AQArena_Calloc(arena, numChannels, sizeof(bool));
+	
+	file->mFloorCurve = (Float32 *) AQArena_Calloc(arena, maxHalf, sizeof(Float32));
+	file->mInterleavedResidue = (Float32 *) AQArena_Calloc(arena, (size_t) numChannels * maxHalf, sizeof(Float32));
+	file->mSubmapVectors = (Float32 **) AQArena_Calloc(arena, numChannels, sizeof(Float32 *));
+	file->mSubmapDoNotDecode = (bool *) AQArena_Calloc(arena, numChannels, sizeof(bool));
+	
+	// Enough partitions for the longest vector any residue can code, plus one
+	// classbook entry's worth of slack
+	file->mClassificationsStride = 0;
+	
+	for (k = 0; k < file->mNumResidues; k++)
+	{
+		const struct AQVorbisResidue * residue = &file->mResidues[k];
+		UInt32 numWords = file->mCodebooks[residue->mClassbook].mDimensions;
+		UInt32 stride = (residue->mType == 2 ? numChannels : 1) * maxHalf / residue->mPartitionSize + numWords;
+		
+		file->mClassificationsStride = stride > file->mClassificationsStride ? stride : file->mClassificationsStride;
+	}
+	
+	file->mClassifications = (UInt8 *) AQArena_Calloc(arena, (size_t) numChannels * file->mClassificationsStride, 1);
+}
+
+// Y values of the floor's points; false when the channel is unused in this packet
+static
+bool AQVorbisFile_DecodeFloor(const struct AQVorbisFile * file, struct AQVorbisBits * bits, const struct AQVorbisFloor * floor, SInt32 * y)
+{
+	static const UInt32 kRanges[4] = { 256, 128, 86, 64 };
+	
+	UInt32 valueBits = AQVorbis_ILog(kRanges[floor->mMultiplier - 1] - 1);
+	UInt32 offset = 2;
+	UInt32 k, j;
+	
+	if (AQVorbisBits_Read(bits, 1) == 0)
+	{
+		return false;
+	}
+	
+	y[0] = (SInt32) AQVorbisBits_Read(bits, valueBits);
+	y[1] = (SInt32) AQVorbisBits_Read(bits, valueBits);
+	
+	for (k = 0; k < floor->mNumPartitions; k++)
+	{
+		UInt32 classIndex = floor->mPartitionClasses[k];
+		UInt32 dimensions = floor->mClassDimensions[classIndex];
+		UInt32 subclassBits = floor->mClassSubclasses[classIndex];
+		UInt32 subclassMask = (1U << subclassBits) - 1;
+		UInt32 classValue = 0;
+		
+		if (subclassBits > 0)
+		{
+			SInt32 entry = AQVorbisCodebook_Decode(&file->mCodebooks[floor->mClassMasterbooks[classIndex]], bits);
+			
+			if (entry < 0)
+			{
+				return false;
+			}
+			
+			classValue = (UInt32) entry;
+		}
+		
+		for (j = 0; j < dimensions; j++)
+		{
+			SInt32 book = floor->mSubclassBooks[classIndex][classValue & subclassMask];
+			
+			classValue >>= subclassBits;
+			y[offset + j] = 0;
+			
+			if (book >= 0)
+			{
+				SInt32 entry = AQVorbisCodebook_Decode(&file->mCodebooks[book], bits);
+				
+				if (entry < 0)
+				{
+					return false;
+				}
+				
+				y[offset + j] = entry;
+			}
+		}
+		
+		offset += dimensions;
+	}
+	
+	return !bits->mIsPastEnd;
+}
+
+// Integer line from (x0, y0) to (x1, y1) as the format steps it, x0 included
+// and x1 not, through the dB table into curve, stopping at n
+static
+void AQVorbis_RenderLine(SInt32 x0, SInt32 y0, SInt32 x1, SInt32 y1, const Float32 * dB, Float32 * curve, SInt32 n)
+{
+	SInt32 dy = y1 - y0;
+	SInt32 adx = x1 - x0;
+	SInt32 base = dy / adx;
+	SInt32 step = dy < 0 ? base - 1 : base + 1;
+	SInt32 ady = (dy < 0 ? -dy : dy) - (base < 0 ? -base : base) * adx;
+	SInt32 end = x1 < n ? x1 : n;
+	SInt32 error = 0;
+	SInt32 x, y = y0;
+	
+	if (x0 >= end)
+	{
+		return;
+	}
+	
+	curve[x0] = dB[y < 0 ? 0 : y > 255 ? 255 : y];
+	
+	for (x = x0 + 1; x < end; x++)
+	{
+		error += ady;
+		
+		if (error >= adx)
+		{
+			error -= adx;
+			y += step;
+		}
+		else
+		{
+			y += base;
+		}
+		
+		curve[x] = dB[y < 0 ? 0 : y > 255 ? 255 : y];
+	}
+}
+
+// Turns the decoded Y values into the floor curve and multiplies the spectrum by it
+static
+void AQVorbisFile_ApplyFloor(struct AQVorbisFile * file, const struct AQVorbisFloor * floor, const SInt32 * y, Float32 * spectrum, UInt32 n)
+{
+	static const SInt32 kRanges[4] = { 256, 128, 86, 64 };
+	static const struct AQVorbisDBTable sDB = AQVorbis_MakeDBTable();
+	
+	SInt32 range = kRanges[floor->mMultiplier - 1];
+	SInt32 multiplier = (SInt32) floor->mMultiplier;
+	SInt32 finalY[kVorbisFloor1MaxValues];
+	bool isUsed[kVorbisFloor1MaxValues];
+	Float32 * curve = file->mFloorCurve;
+	UInt32 k;
+	
+	AQ_TRACE_SCOPE("floor", n);
+	
+	// Each point is coded relative to the line through its neighbors
+	finalY[0] = y[0];
+	finalY[1] = y[1];
+	isUsed[0] = true;
+	isUsed[1] = true;
+	
+	for (k = 2; k < floor->mNumValues; k++)
+	{
+		UInt32 low = floor->mLowNeighbors[k];
+		UInt32 high = floor->mHighNeighbors[k];
+		SInt32 dy = finalY[high] - finalY[low];
+		SInt32 adx = (SInt32) (floor->mX[high] - floor->mX[low]);
+		SInt32 offset = (dy < 0 ? -dy : dy) * (SInt32) (floor->mX[k] - floor->mX[low]) / adx;
+		SInt32 predicted = dy < 0 ? finalY[low] - offset : finalY[low] + offset;
+		SInt32 highRoom = range - predicted;
+		SInt32 lowRoom = predicted;
+		SInt32 room = (highRoom < lowRoom ? highRoom : lowRoom) * 2;
+		SInt32 value = y[k];
+		
+		if (value == 0)
+		{
+			isUsed[k] = false;
+			finalY[k] = predicted;
+			continue;
+		}
+		
+		isUsed[low] = true;
+		isUsed[high] = true;
+		isUsed[k] = true;
+		
+		if (value >= room)
+		{
+			finalY[k] = highRoom > lowRoom ? value - lowRoom + predicted : predicted - value + highRoom - 1;
+		}
+		else
+		{
+			finalY[k] = value & 1 ? predicted - (value + 1) / 2 : predicted + value / 2;
+		}
+	}
+	
+	SInt32 lx = 0;
+	SInt32 ly = finalY[floor->mSorted[0]] * multiplier;
+	
+	for (k = 1; k < floor->mNumValues; k++)
+	{
+		UInt32 index = floor->mSorted[k];
+		
+		if (isUsed[index])
+		{
+			SInt32 hx = (SInt32) floor->mX[index];
+			SInt32 hy = finalY[index] * multiplier;
+			
+			AQVorbis_RenderLine(lx, ly, hx, hy, sDB.mValues, curve, (SInt32) n);
+			lx = hx;
+			ly = hy;
+		}
+	}
+	
+	if (lx < (SInt32) n)
+	{
+		AQVorbis_RenderLine(lx, ly, (SInt32) n, ly, sDB.mValues, curve, (SInt32) n);
+	}
+	
+	for (k = 0; k < n; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4_Store(spectrum + k, AQFloat4_Mul(AQFloat4_Load(spectrum + k), AQFloat4_Load(curve + k)));
+	}
+}
+
+// Adds one partition's codebook vectors to v; false at the end of the packet
+static
+bool AQVorbis_DecodePartition(UInt32 type, const struct AQVorbisCodebook * book, struct AQVorbisBits * bits, Float32 * v, UInt32 size)
+{
+	UInt32 dimensions = book->mDimensions;
+	UInt32 k, j;
+	
+	if (type == 0)
+	{
+		// Vector values spread step apart
+		UInt32 step = size / dimensions;
+		
+		for (k = 0; k < step; k++)
+		{
+			SInt32 entry = AQVorbisCodebook_Decode(book, bits);
+			
+			if (entry < 0)
+			{
+				return false;
+			}
+			
+			const Float32 * values = book->mValues + (size_t) entry * dimensions;
+			
+			for (j = 0; j < dimensions; j++)
+			{
+				v[k + j * step] += values[j];
+			}
+		}
+	}
+	else if (dimensions % AQ_SIMD_WIDTH == 0)
+	{
+		for (k = 0; k < size; k += dimensions)
+		{
+			SInt32 entry = AQVorbisCodebook_Decode(book, bits);
+			
+			if (entry < 0)
+			{
+				return false;
+			}
+			
+			const Float32 * values = book->mValues + (size_t) entry * dimensions;
+			
+			for (j = 0; j < dimensions; j += AQ_SIMD_WIDTH)
+			{
+				AQFloat4_Store(v + k + j, AQFloat4_Add(AQFloat4_Load(v + k + j), AQFloat4_Load(values + j)));
+			}
+		}
+	}
+	else
+	{
+		for (k = 0; k < size; k += dimensions)
+		{
+			SInt32 entry = AQVorbisCodebook_Decode(book, bits);
+			
+			if (entry < 0)
+			{
+				return false;
+			}
+			
+			const Float32 * values = book->mValues + (size_t) entry * dimensions;
+			
+			for (j = 0; j < dimensions; j++)
+			{
+				v[k + j] += values[j];
+			}
+		}
+	}
+	
+	return true;
+}
+
+// Residue types 0 and 1 over numVectors vectors of size values each
+static
+void AQVorbisFile_DecodeResidueVectors(struct AQVorbisFile * file,
+									   struct AQVorbisBits * bits,
+									   const struct AQVorbisResidue * residue,
+									   Float32 * const * vectors,
+									   const bool * doNotDecode,
+									   UInt32 numVectors,
+									   UInt32 size)
+{
+	const struct AQVorbisCodebook * classbook = &file->mCodebooks[residue->mClassbook];
+	UInt32 numWords = classbook->mDimensions;
+	UInt32 begin = residue->mBegin < size ? residue->mBegin : size;
+	UInt32 end = residue->mEnd < size ? residue->mEnd : size;
+	UInt32 partitionSize = residue->mPartitionSize;
+	UInt32 numPartitions = end > begin ? (end - begin) / partitionSize : 0;
+	UInt32 stride = file->mClassificationsStride;
+	UInt32 pass, partition, k, v;
+	
+	for (pass = 0; pass < 8; pass++)
+	{
+		for (partition = 0; partition < numPartitions; )
+		{
+			if (pass == 0)
+			{
+				for (v = 0; v < numVectors; v++)
+				{
+					if (doNotDecode[v])
+					{
+						continue;
+					}
+					
+					SInt32 entry = AQVorbisCodebook_Decode(classbook, bits);
+					
+					if (entry < 0)
+					{
+						return;
+					}
+					
+					memcpy(file->mClassifications + v * stride + partition, residue->mClassWords + (size_t) entry * numWords, numWords);
+				}
+			}
+			
+			for (k = 0; k < numWords && partition < numPartitions; k++, partition++)
+			{
+				for (v = 0; v < numVectors; v++)
+				{
+					if (doNotDecode[v])
+					{
+						continue;
+					}
+					
+					SInt32 book = residue->mBooks[file->mClassifications[v * stride + partition]][pass];
+					
+					if (book >= 0 &&
+						!AQVorbis_DecodePartition(residue->mType,
+												  &file->mCodebooks[book],
+												  bits,
+												  vectors[v] + begin + partition * partitionSize,
+												  partitionSize))
+					{
+						return;
+					}
+				}
+			}
+		}
+	}
+}
+
+// Decodes a submap's vectors, which must be zeroed; a truncated packet leaves the rest zero
+static
+void AQVorbisFile_DecodeResidue(struct AQVorbisFile * file,
+								struct AQVorbisBits * bits,
+								const struct AQVorbisResidue * residue,
+								Float32 * const * vectors,
+								const bool * doNotDecode,
+								UInt32 numVectors,
+								UInt32 n)
+{
+	AQ_TRACE_SCOPE("residue", residue->mType);
+	
+	if (residue->mType != 2)
+	{
+		AQVorbisFile_DecodeResidueVectors(file, bits, residue, vectors, doNotDecode, numVectors, n);
+		return;
+	}
+	
+	// Type 2 codes the channels interleaved into one vector
+	static const bool kDecode = false;
+	Float32 * interleaved = file->mInterleavedResidue;
+	bool isDecoded = false;
+	UInt32 k, v;
+	
+	for (v = 0; v < numVectors; v++)
+	{
+		isDecoded = isDecoded || !doNotDecode[v];
+	}
+	
+	if (!isDecoded)
+	{
+		return;
+	}
+	
+	memset(interleaved, 0, (size_t) n * numVectors * sizeof(Float32));
+	AQVorbisFile_DecodeResidueVectors(file, bits, residue, &interleaved, &kDecode, 1, n * numVectors);
+	
+	if (numVectors == 2)
+	{
+		for (k = 0; k < n; k += AQ_SIMD_WIDTH)
+		{
+			AQFloat4 even, odd;
+			
+			AQFloat4_LoadDeinterleaved(interleaved + 2 * k, &even, &odd);
+			AQFloat4_Store(vectors[0] + k, even);
+			AQFloat4_Store(vectors[1] + k, odd);
+		}
+	}
+	else
+	{
+		for (k = 0; k < n; k++)
+		{
+			for (v = 0; v < numVectors; v++)
+			{
+				vectors[v][k] = interleaved[(size_t) k * numVectors + v];
+			}
+		}
+	}
+}
+
+// Magnitude and angle back to the two channels they were coupled from
+static
+void AQVorbis_Decouple(Float32 * magnitudes, Float32 * angles, UInt32 n)
+{
+	UInt32 k;
+	
+	for (k = 0; k < n; k++)
+	{
+		Float32 m = magnitudes[k];
+		Float32 a = angles[k];
+		
+		if (m > 0)
+		{
+			if (a > 0)
+			{
+				angles[k] = m - a;
+			}
+			else
+			{
+				angles[k] = m;
+				magnitudes[k] = m + a;
+			}
+		}
+		else
+		{
+			if (a > 0)
+			{
+				angles[k] = m + a;
+			}
+			else
+			{
+				angles[k] = m;
+				magnitudes[k] = m - a;
+			}
+		}
+	}
+}
+
+/* Windows one channel's block, adds its first half to the previous block's
+ * second half into out, and keeps its own second half for the next packet.
+ * Returns the frames finished: from the middle of the previous block to the
+ * middle of this one. Every range is a multiple of a sixteenth of a block, so
+ * the loops run whole vectors.
+ */
+static
+UInt32 AQVorbisFile_OverlapAdd(struct AQVorbisFile * file,
+							   Float32 * block,
+							   Float32 * overlap,
+							   Float32 * out,
+							   UInt32 blockFlag,
+							   UInt32 previousFlag,
+							   UInt32 nextFlag)
+{
+	UInt32 shortSize = file->mInfo.mBlockSizes[0];
+	UInt32 n = file->mInfo.mBlockSizes[blockFlag];
+	UInt32 previousN = file->mPreviousBlockSize;
+	AQFloat4 zero = AQFloat4_Set1(0.f);
+	UInt32 k;
+	
+	// Long blocks next to short ones use the short slope, centered on their quarter points
+	UInt32 leftFlag = blockFlag && previousFlag ? 1 : 0;
+	UInt32 rightFlag = blockFlag && nextFlag ? 1 : 0;
+	UInt32 leftSize = leftFlag ? n / 2 : shortSize / 2;
+	UInt32 rightSize = rightFlag ? n / 2 : shortSize / 2;
+	UInt32 leftStart = n / 4 - leftSize / 2;
+	UInt32 rightStart = 3 * n / 4 - rightSize / 2;
+	const Float32 * leftSlope = file->mWindowSlopes[leftFlag];
+	const Float32 * rightSlope = file->mWindowSlopes[rightFlag];
+	
+	AQ_TRACE_SCOPE("overlap", n);
+	
+	for (k = 0; k < leftStart; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4_Store(block + k, zero);
+	}
+	
+	for (k = 0; k < leftSize; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4_Store(block + leftStart + k, AQFloat4_Mul(AQFloat4_Load(block + leftStart + k), AQFloat4_Load(leftSlope + k)));
+	}
+	
+	UInt32 numFrames = 0;
+	
+	if (previousN > 0)
+	{
+		// Block position of out[0]; the quarter points of the two blocks line up
+		SInt32 shift = (SInt32) (n / 4) - (SInt32) (previousN / 4);
+		UInt32 overlapEnd = previousN / 2;
+		
+		numFrames = previousN / 4 + n / 4;
+		k = 0;
+		
+		for (; (SInt32) k + shift < 0; k += AQ_SIMD_WIDTH)
+		{
+			AQFloat4_Store(out + k, AQFloat4_Load(overlap + k));
+		}
+		
+		for (; k < overlapEnd && k < numFrames; k += AQ_SIMD_WIDTH)
+		{
+			AQFloat4_Store(out + k, AQFloat4_Add(AQFloat4_Load(overlap + k), AQFloat4_Load(block + k + shift)));
+		}
+		
+		for (; k < numFrames; k += AQ_SIMD_WIDTH)
+		{
+			AQFloat4_Store(out + k, AQFloat4_Load(block + k + shift));
+		}
+	}
+	
+	// Second half: as is up to the right slope, falling along it, zero after
+	for (k = n / 2; k < rightStart; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4_Store(overlap + k - n / 2, AQFloat4_Load(block + k));
+	}
+	
+	for (k = 0; k < rightSize; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4 slope = AQFloat4_Reverse(AQFloat4_Load(rightSlope + rightSize - AQ_SIMD_WIDTH - k));
+		
+		AQFloat4_Store(overlap + rightStart - n / 2 + k, AQFloat4_Mul(AQFloat4_Load(block + rightStart + k), slope));
+	}
+	
+	for (k = rightStart + rightSize; k < n; k += AQ_SIMD_WIDTH)
+	{
+		AQFloat4_Store(overlap + k - n / 2, zero);
+	}
+	
+	return numFrames;
+}
+
+// Decodes one audio packet into mOutput and returns the frames it finished
+static
+UInt32 AQVorbisFile_DecodePacket(struct AQVorbisFile * file, const UInt8 * packet, UInt32 size)
+{
+	UInt32 numChannels = file->mInfo.mNumChannels;
+	UInt32 maxHalf = file->mInfo.mBlockSizes[1] / 2;
+	struct AQVorbisBits bits;
+	UInt32 numFrames = 0;
+	UInt32 ch, k;
+	
+	AQ_TRACE_SCOPE("decode", size);
+	
+	AQVorbisBits_Init(&bits, packet, size);
+	
+	if (AQVorbisBits_Read(&bits, 1) != 0)
+	{
+		return 0;
+	}
+	
+	UInt32 modeIndex = AQVorbisBits_Read(&bits, file->mModeBits);
+	
+	if (modeIndex >= file->mNumModes)
+	{
+		return 0;
+	}
+	
+	const struct AQVorbisMode * mode = &file->mModes[modeIndex];
+	const struct AQVorbisMapping * mapping = &file->mMappings[mode->mMapping];
+	UInt32 n = file->mInfo.mBlockSizes[mode->mBlockFlag];
+	UInt32 half = n / 2;
+	UInt32 previousFlag = 0;
+	UInt32 nextFlag = 0;
+	
+	if (mode->mBlockFlag)
+	{
+		previousFlag = AQVorbisBits_Read(&bits, 1);
+		nextFlag = AQVorbisBits_Read(&bits, 1);
+	}
+	
+	if (bits.mIsPastEnd)
+	{
+		return 0;
+	}
+	
+	for (ch = 0; ch < numChannels; ch++)
+	{
+		const struct AQVorbisFloor * floor = &file->mFloors[mapping->mSubmapFloors[mapping->mMux[ch]]];
+		
+		file->mIsFloorUsed[ch] = AQVorbisFile_DecodeFloor(file, &bits, floor, file->mFloorY + ch * kVorbisFloor1MaxValues);
+		file->mHasResidue[ch] = file->mIsFloorUsed[ch];
+		
+		memset(file->mSpectra + (size_t) ch * maxHalf, 0, half * sizeof(Float32));
+	}
+	
+	// Coupled channels are decoded together if either of them has a floor
+	for (k = 0; k < mapping->mNumCouplingSteps; k++)
+	{
+		if (file->mHasResidue[mapping->mMagnitudes[k]] || file->mHasResidue[mapping->mAngles[k]])
+		{
+			file->mHasResidue[mapping->mMagnitudes[k]] = true;
+			file->mHasResidue[mapping->mAngles[k]] = true;
+		}
+	}
+	
+	for (k = 0; k < mapping->mNumSubmaps; k++)
+	{
+		UInt32 numVectors = 0;
+		
+		for (ch = 0; ch < numChannels; ch++)
+		{
+			if (mapping->mMux[ch] == k)
+			{
+				file->mSubmapVectors[numVectors] = file->mSpectra + (size_t) ch * maxHalf;
+				file->mSubmapDoNotDecode[numVectors] = !file->mHasResidue[ch];
+				numVectors++;
+			}
+		}
+		
+		AQVorbisFile_DecodeResidue(file,
+								   &bits,
+								   &file->mResidues[mapping->mSubmapResidues[k]],
+								   file->mSubmapVectors,
+								   file->mSubmapDoNotDecode,
+								   numVectors,
+								   half);
+	}
+	
+	for (k = mapping->mNumCouplingSteps; k-- > 0; )
+	{
+		AQVorbis_Decouple(file->mSpectra + (size_t) mapping->mMagnitudes[k] * maxHalf,
+						  file->mSpectra + (size_t) mapping->mAngles[k] * maxHalf,
+						  half);
+	}
+	
+	for (ch = 0; ch < numChannels; ch++)
+	{
+		Float32 * spectrum = file->mSpectra + (size_t) ch * maxHalf;
+		
+		if (file->mIsFloorUsed[ch])
+		{
+			const struct AQVorbisFloor * floor = &file->mFloors[mapping->mSubmapFloors[mapping->mMux[ch]]];
+			
+			AQVorbisFile_ApplyFloor(file, floor, file->mFloorY + ch * kVorbisFloor1MaxValues, spectrum, half);
+		}
+		else
+		{
+			memset(spectrum, 0, half * sizeof(Float32));
+		}
+		
+		{
+			AQ_TRACE_SCOPE("imdct", n);
+			
+			AQMDCT_Inverse(&file->mMDCT[mode->mBlockFlag], spectrum, file->mBlock);
+		}
+		
+		numFrames = AQVorbisFile_OverlapAdd(file,
+											file->mBlock,
+											file->mOverlap + (size_t) ch * maxHalf,
+											file->mOutput + (size_t) ch * maxHalf,
+											mode->mBlockFlag,
+											previousFlag,
+											nextFlag);
+	}
+	
+	file->mPreviousBlockSize = n;
+	
+	return numFrames;
+}
+
+static
+void AQVorbisFile_Reset(struct AQVorbisFile * file)
+{
+	file->mPreviousBlockSize = 0;
+	file->mNumOutputFrames = 0;
+	file->mOutputPosition = 0;
+	file->mFramePosition = 0;
+}
+
+struct AQVorbisFile * AQVorbisFile_Open(const char path[])
+{
+	struct AQVorbisFile * file = (struct AQVorbisFile *) calloc(1, sizeof(struct AQVorbisFile));
+	const UInt8 * packet;
+	UInt32 size;
+	SInt64 granulePosition;
+	
+	AQ_TRACE_SCOPE("open", 0);
+	
+	AQArena_Init(&file->mArena, kVorbisArenaBlockSize);
+	
+	if (!AQOggReader_Open(&file->mReader, path))
+	{
+		AQVorbisFile_Close(file);
+		return NULL;
+	}
+	
+	bool ok = AQOggReader_ReadPacket(&file->mReader, &packet, &size, &granulePosition) &&
+			  AQVorbisFile_ReadIdentification(file, packet, size) &&
+			  AQOggReader_ReadPacket(&file->mReader, &packet, &size, &granulePosition) &&
+			  size >= 7 && packet[0] == kVorbisPacketComment &&
+			  AQOggReader_ReadPacket(&file->mReader, &packet, &size, &granulePosition) &&
+			  AQVorbisFile_ReadSetup(file, packet, size);
+	
+	if (!ok)
+	{
+		AQVorbisFile_Close(file);
+		return NULL;
+	}
+	
+	AQVorbisFile_AllocateBuffers(file);
+	
+	// Audio starts on a page of its own
+	file->mAudioOffset = AQOggReader_GetPageOffset(&file->mReader);
+	
+	granulePosition = AQOggReader_FindLastGranulePosition(&file->mReader);
+	file->mInfo.mNumFrames = granulePosition > 0 ? (UInt64) granulePosition : 0;
+	
+	AQVorbisFile_Reset(file);
+	
+	return file;
+}
+
+const struct AQVorbisInfo * AQVorbisFile_GetInfo(const struct AQVorbisFile * file)
+{
+	return &file->mInfo;
+}
+
+UInt32 AQVorbisFile_Read(struct AQVorbisFile * file, Float32 * out, UInt32 numFrames)
+{
+	UInt32 numChannels = file->mInfo.mNumChannels;
+	UInt32 maxHalf = file->mInfo.mBlockSizes[1] / 2;
+	UInt32 numRead = 0;
+	
+	while (numRead < numFrames)
+	{
+		if (file->mOutputPosition == file->mNumOutputFrames)
+		{
+			const UInt8 * packet;
+			UInt32 size;
+			SInt64 granulePosition;
+			
+			if (!AQOggReader_ReadPacket(&file->mReader, &packet, &size, &granulePosition))
+			{
+				break;
+			}
+			
+			file->mNumOutputFrames = AQVorbisFile_DecodePacket(file, packet, size);
+			file->mOutputPosition = 0;
+			
+			// The last page's granule position cuts the final block short
+			if (file->mInfo.mNumFrames > 0 && file->mFramePosition + file->mNumOutputFrames > file->mInfo.mNumFrames)
+			{
+				file->mNumOutputFrames = (UInt32) (file->mInfo.mNumFrames - file->mFramePosition);
+			}
+			
+			file->mFramePosition += file->mNumOutputFrames;
+			continue;
+		}
+		
+		UInt32 count = file->mNumOutputFrames - file->mOutputPosition;
+		const Float32 * planar = file->mOutput + file->mOutputPosition;
+		Float32 * dst = out + (size_t) numRead * numChannels;
+		UInt32 k = 0, ch;
+		
+		count = count < numFrames - numRead ? count : numFrames - numRead;
+		
+		if (numChannels == 2)
+		{
+			for (; k + AQ_SIMD_WIDTH <= count; k += AQ_SIMD_WIDTH)
+			{
+				AQFloat4_StoreInterleaved(dst + 2 * k, AQFloat4_Load(planar + k), AQFloat4_Load(planar + maxHalf + k));
+			}
+		}
+		
+		for (; k < count; k++)
+		{
+			for (ch = 0; ch < numChannels; ch++)
+			{
+				dst[k * numChannels + ch] = planar[(size_t) ch * maxHalf + k];
+			}
+		}
+		
+		file->mOutputPosition += count;
+		numRead += count;
+	}
+	
+	return numRead;
+}
+
+bool AQVorbisFile_Rewind(struct AQVorbisFile * file)
+{
+	AQVorbisFile_Reset(file);
+	
+	return AQOggReader_SeekPage(&file->mReader, file->mAudioOffset);
+}
+
+void AQVorbisFile_Close(struct AQVorbisFile * file)
+{
+	if (file->mMDCT[0].mSize)
+	{
+		AQMDCTPlan_CleanUp(&file->mMDCT[0]);
+		AQMDCTPlan_CleanUp(&file->mMDCT[1]);
+	}
+	
+	AQOggReader_Close(&file->mReader);
+	AQArena_CleanUp(&file->mArena);
+	free(file);
+}
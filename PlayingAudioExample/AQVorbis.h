@@ -0,0 +1,55 @@
+//
+//  AQVorbis.h
+//  PlayingAudioExample
+//
+
+/* Ogg Vorbis decoder, so that .ogg files play and render without a system
+ * codec. Floor type 1 and residue types 0, 1 and 2 are decoded; floor type 0,
+ * which no encoder has produced in a long time, is refused when the file is
+ * opened.
+ *
+ * The per-block work is laid out for AQ_SIMD_WIDTH lanes: residue vectors are
+ * added four values at a time, the floor curve is applied and the block is
+ * windowed, overlapped and interleaved as vectors, and the inverse MDCT goes
+ * through AQMDCT. Decoding the floor's line segments and the Huffman codes is
+ * inherently serial and stays scalar.
+ */
+
+#ifndef AQVorbis_h
+#define AQVorbis_h
+
+#include "AQTypes.h"
+
+struct AQVorbisInfo
+{
+	UInt32 mNumChannels;
+	UInt32 mSampleRate;
+	
+	/* Description:
+	 * Short and long block sizes in samples.
+	 */
+	UInt32 mBlockSizes[2];
+	
+	/* Description:
+	 * From the granule position of the last page, 0 when the file has none.
+	 */
+	UInt64 mNumFrames;
+};
+
+struct AQVorbisFile;
+
+// NULL if the file is not Ogg Vorbis or uses something the decoder does not handle
+struct AQVorbisFile * AQVorbisFile_Open(const char path[]);
+
+const struct AQVorbisInfo * AQVorbisFile_GetInfo(const struct AQVorbisFile * file);
+
+// Decodes up to numFrames interleaved float frames into out and returns the number
+// decoded, 0 at the end of the stream
+UInt32 AQVorbisFile_Read(struct AQVorbisFile * file, Float32 * out, UInt32 numFrames);
+
+// Starts decoding over from the first frame
+bool AQVorbisFile_Rewind(struct AQVorbisFile * file);
+
+void AQVorbisFile_Close(struct AQVorbisFile * file);
+
+#endif /* AQVorbis_h */
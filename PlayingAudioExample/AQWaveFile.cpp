@@ -0,0 +1,318 @@
+//
+//  AQWaveFile.cpp
+//  PlayingAudioExample
+//
+
+#include "AQWaveFile.h"
+
+#include <string.h>
+#include <unistd.h>
+
+static const UInt16 kWaveFormatPCM = 0x0001;
+static const UInt16 kWaveFormatIEEEFloat = 0x0003;
+static const UInt16 kWaveFormatExtensible = 0xFFFE;
+
+// Offsets of the two sizes AQWaveFile_Close patches in a written file
+static const long kWaveRIFFSizeOffset = 4;
+static const long kWaveDataSizeOffset = 40;
+
+// Everything is little endian in the file; the host is assumed to be too, as in AQPeaks
+static
+UInt16 GetUInt16(const UInt8 * p)
+{
+	return (UInt16) (p[0] | p[1] << 8);
+}
+
+static
+UInt32 GetUInt32(const UInt8 * p)
+{
+	return (UInt32) p[0] | (UInt32) p[1] << 8 | (UInt32) p[2] << 16 | (UInt32) p[3] << 24;
+}
+
+static
+void PutUInt16(UInt8 * p, UInt16 value)
+{
+	p[0] = (UInt8) value;
+	p[1] = (UInt8) (value >> 8);
+}
+
+static
+void PutUInt32(UInt8 * p, UInt32 value)
+{
+	p[0] = (UInt8) value;
+	p[1] = (UInt8) (value >> 8);
+	p[2] = (UInt8) (value >> 16);
+	p[3] = (UInt8) (value >> 24);
+}
+
+static
+bool AQWaveFile_ParseFormat(struct AQWaveFile * wave, const UInt8 * fmt, UInt32 size)
+{
+	if (size < 16)
+	{
+		return false;
+	}
+	
+	UInt16 formatTag = GetUInt16(fmt);
+	UInt16 numChannels = GetUInt16(fmt + 2);
+	UInt32 sampleRate = GetUInt32(fmt + 4);
+	UInt16 blockAlign = GetUInt16(fmt + 12);
+	UInt16 bitsPerSample = GetUInt16(fmt + 14);
+	
+	// The sub format GUID starts with the format tag it stands for
+	if (formatTag == kWaveFormatExtensible && size >= 40)
+	{
+		formatTag = GetUInt16(fmt + 24);
+	}
+	
+	if (numChannels == 0 || bitsPerSample % 8 != 0 || blockAlign != numChannels * bitsPerSample / 8)
+	{
+		return false;
+	}
+	
+	if (formatTag == kWaveFormatIEEEFloat)
+	{
+		if (bitsPerSample == 32)      wave->mLayout.mType = kAQSampleType_Float32;
+		else if (bitsPerSample == 64) wave->mLayout.mType = kAQSampleType_Float64;
+		else                          return false;
+	}
+	else if (formatTag == kWaveFormatPCM)
+	{
+		if (bitsPerSample == 8)       wave->mLayout.mType = kAQSampleType_UInt8;
+		else if (bitsPerSample == 16) wave->mLayout.mType = kAQSampleType_SInt16;
+		else if (bitsPerSample == 24) wave->mLayout.mType = kAQSampleType_SInt24;
+		else if (bitsPerSample == 32) wave->mLayout.mType = kAQSampleType_SInt32;
+		else                          return false;
+	}
+	else
+	{
+		return false;
+	}
+	
+	wave->mLayout.mIsBigEndian = false;
+	wave->mLayout.mIsInterleaved = true;
+	wave->mLayout.mNumChannels = numChannels;
+	wave->mSampleRate = sampleRate;
+	wave->mBytesPerFrame = blockAlign;
+	
+	return true;
+}
+
+bool AQWaveFile_Open(struct AQWaveFile * wave, const char path[])
+{
+	UInt8 header[12];
+	UInt8 chunk[8];
+	UInt8 fmt[40];
+	bool hasFormat = false;
+	
+	memset(wave, 0, sizeof(struct AQWaveFile));
+	
+	wave->mFile = fopen(path, "rb");
+	
+	if (!wave->mFile)
+	{
+		return false;
+	}
+	
+	if (fread(header, 1, sizeof(header), wave->mFile) != sizeof(header) ||
+		memcmp(header, "RIFF", 4) != 0 ||
+		memcmp(header + 8, "WAVE", 4) != 0)
+	{
+		AQWaveFile_Close(wave);
+		return false;
+	}
+	
+	// Walk the chunks up to the data, which has to come after the format
+	while (fread(chunk, 1, sizeof(chunk), wave->mFile) == sizeof(chunk))
+	{
+		UInt32 size = GetUInt32(chunk + 4);
+		
+		if (memcmp(chunk, "fmt ", 4) == 0)
+		{
+			UInt32 numRead = size < sizeof(fmt) ? size : sizeof(fmt);
+			
+			if (fread(fmt, 1, numRead, wave->mFile) != numRead || !AQWaveFile_ParseFormat(wave, fmt, numRead))
+			{
+				break;
+			}
+			
+			hasFormat = true;
+			size -= numRead;
+		}
+		else if (memcmp(chunk, "data", 4) == 0)
+		{
+			if (!hasFormat)
+			{
+				break;
+			}
+			
+			wave->mDataOffset = ftello(wave->mFile);
+			wave->mNumFrames = size / wave->mBytesPerFrame;
+			
+			return true;
+		}
+		
+		// Chunks are padded to an even size
+		if (fseek(wave->mFile, size + (size & 1), SEEK_CUR) != 0)
+		{
+			break;
+		}
+	}
+	
+	AQWaveFile_Close(wave);
+	
+	return false;
+}
+
+UInt32 AQWaveFile_Read(struct AQWaveFile * wave, void * data, UInt32 numFrames)
+{
+	if (numFrames > wave->mNumFrames - wave->mFramePosition)
+	{
+		numFrames = (UInt32) (wave->mNumFrames - wave->mFramePosition);
+	}
+	
+	UInt32 numRead = (UInt32) fread(data, wave->mBytesPerFrame, numFrames, wave->mFile);
+	
+	wave->mFramePosition += numRead;
+	
+	return numRead;
+}
+
+bool AQWaveFile_Seek(struct AQWaveFile * wave, UInt64 frame)
+{
+	if (frame > wave->mNumFrames)
+	{
+		frame = wave->mNumFrames;
+	}
+	
+	if (fseeko(wave->mFile, (off_t) (wave->mDataOffset + frame * wave->mBytesPerFrame), SEEK_SET) != 0)
+	{
+		return false;
+	}
+	
+	wave->mFramePosition = frame;
+	
+	return true;
+}
+
+UInt32 AQWaveFile_ReadAt(const struct AQWaveFile * wave, UInt64 frame, void * data, UInt32 numFrames)
+{
+	if (frame >= wave->mNumFrames)
+	{
+		return 0;
+	}
+	
+	if (numFrames > wave->mNumFrames - frame)
+	{
+		numFrames = (UInt32) (wave->mNumFrames - frame);
+	}
+	
+	// pread does not move the file offset, so it can run alongside the buffered reads
+	size_t numBytes = (size_t) numFrames * wave->mBytesPerFrame;
+	off_t offset = (off_t) (wave->mDataOffset + frame * wave->mBytesPerFrame);
+	size_t numRead = 0;
+	
+	while (numRead < numBytes)
+	{
+		ssize_t result = pread(fileno(wave->mFile), (UInt8 *) data + numRead, numBytes - numRead, offset + numRead);
+		
+		if (result <= 0)
+		{
+			break;
+		}
+		
+		numRead += result;
+	}
+	
+	return (UInt32) (numRead / wave->mBytesPerFrame);
+}
+
+bool AQWaveFile_Create(struct AQWaveFile * wave, const char path[], Float64 sampleRate, UInt32 numChannels)
+{
+	UInt8 header[44];
+	
+	memset(wave, 0, sizeof(struct AQWaveFile));
+	
+	wave->mLayout.mType = kAQSampleType_Float32;
+	wave->mLayout.mIsInterleaved = true;
+	wave->mLayout.mNumChannels = numChannels;
+	wave->mSampleRate = sampleRate;
+	wave->mBytesPerFrame = numChannels * sizeof(Float32);
+	wave->mDataOffset = sizeof(header);
+	
+	wave->mFile = fopen(path, "wb");
+	
+	if (!wave->mFile)
+	{
+		return false;
+	}
+	
+	memcpy(header, "RIFF", 4);
+	PutUInt32(header + 4, 0);
+	memcpy(header + 8, "WAVE", 4);
+	
+	memcpy(header + 12, "fmt ", 4);
+	PutUInt32(header + 16, 16);
+	PutUInt16(header + 20, kWaveFormatIEEEFloat);
+	PutUInt16(header + 22, (UInt16) numChannels);
+	PutUInt32(header + 24, (UInt32) sampleRate);
+	PutUInt32(header + 28, (UInt32) sampleRate * wave->mBytesPerFrame);
+	PutUInt16(header + 32, (UInt16) wave->mBytesPerFrame);
+	PutUInt16(header + 34, 32);
+	
+	memcpy(header + 36, "data", 4);
+	PutUInt32(header + 40, 0);
+	
+	if (fwrite(header, 1, sizeof(header), wave->mFile) != sizeof(header))
+	{
+		fclose(wave->mFile);
+		wave->mFile = NULL;
+		return false;
+	}
+	
+	wave->mIsWriting = true;
+	
+	return true;
+}
+
+bool AQWaveFile_Write(struct AQWaveFile * wave, const Float32 * samples, UInt32 numFrames)
+{
+	if (fwrite(samples, wave->mBytesPerFrame, numFrames, wave->mFile) != numFrames)
+	{
+		return false;
+	}
+	
+	wave->mNumFramesWritten += numFrames;
+	
+	return true;
+}
+
+bool AQWaveFile_Close(struct AQWaveFile * wave)
+{
+	bool ok = true;
+	
+	if (!wave->mFile)
+	{
+		return true;
+	}
+	
+	if (wave->mIsWriting)
+	{
+		UInt8 size[4];
+		UInt64 dataSize = wave->mNumFramesWritten * wave->mBytesPerFrame;
+		
+		// Past 4 GB the sizes no longer fit, which RIFF has no answer for
+		ok = dataSize <= 0xFFFFFFFF - wave->mDataOffset;
+		
+		PutUInt32(size, (UInt32) (dataSize + wave->mDataOffset - 8));
+		ok = ok && fseek(wave->mFile, kWaveRIFFSizeOffset, SEEK_SET) == 0 && fwrite(size, 1, 4, wave->mFile) == 4;
+		
+		PutUInt32(size, (UInt32) dataSize);
+		ok = ok && fseek(wave->mFile, kWaveDataSizeOffset, SEEK_SET) == 0 && fwrite(size, 1, 4, wave->mFile) == 4;
+	}
+	
+	ok = fclose(wave->mFile) == 0 && ok;
+	wave->mFile = NULL;
+	
+	return ok;
+}
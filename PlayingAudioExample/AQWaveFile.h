@@ -0,0 +1,62 @@
+//
+//  AQWaveFile.h
+//  PlayingAudioExample
+//
+
+/* RIFF WAVE reading and writing without AudioToolbox, so that linear PCM can
+ * be rendered on hosts that have no AudioFile. The reader takes integer and
+ * float PCM, plain or WAVE_FORMAT_EXTENSIBLE, and hands out the raw frames
+ * for an AQSampleConvert kernel. The writer produces 32 bit float files.
+ */
+
+#ifndef AQWaveFile_h
+#define AQWaveFile_h
+
+#include <stdio.h>
+
+#include "AQSampleConvert.h"
+
+struct AQWaveFile
+{
+	FILE * mFile;
+	
+	struct AQSampleLayout mLayout;
+	Float64 mSampleRate;
+	UInt32 mBytesPerFrame;
+	
+	UInt64 mNumFrames;
+	
+	/* Description:
+	 * Byte offset of the first frame, and the frame the next read starts at.
+	 */
+	UInt64 mDataOffset;
+	UInt64 mFramePosition;
+	
+	/* Description:
+	 * Set by AQWaveFile_Create, with the frames written so far.
+	 */
+	bool mIsWriting;
+	UInt64 mNumFramesWritten;
+};
+
+// Returns false if the file is not a WAVE file of a sample type AQSampleConvert handles
+bool AQWaveFile_Open(struct AQWaveFile * wave, const char path[]);
+
+// Reads up to numFrames raw frames into data, returns the number read
+UInt32 AQWaveFile_Read(struct AQWaveFile * wave, void * data, UInt32 numFrames);
+
+bool AQWaveFile_Seek(struct AQWaveFile * wave, UInt64 frame);
+
+// Reads up to numFrames raw frames from frame on, leaving the position of AQWaveFile_Read
+// alone. Safe to call from several threads at once.
+UInt32 AQWaveFile_ReadAt(const struct AQWaveFile * wave, UInt64 frame, void * data, UInt32 numFrames);
+
+// Starts a 32 bit float file; the sizes in its header are filled in by AQWaveFile_Close
+bool AQWaveFile_Create(struct AQWaveFile * wave, const char path[], Float64 sampleRate, UInt32 numChannels);
+
+bool AQWaveFile_Write(struct AQWaveFile * wave, const Float32 * samples, UInt32 numFrames);
+
+// Returns false if a file being written could not be completed
+bool AQWaveFile_Close(struct AQWaveFile * wave);
+
+#endif /* AQWaveFile_h */
@@ -9,461 +9,611 @@
  * https://developer.apple.com/library/content/documentation/MusicAudio/Conceptual/AudioQueueProgrammingGuide/AQPlayback/PlayingAudio.html#//apple_ref/doc/uid/TP40005343-CH3-SW1
  */
 
+
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <CoreFoundation/CoreFoundation.h>
-#include <AudioToolbox/AudioToolbox.h>
-#include <AudioToolbox/AudioQueue.h>
-#include <AudioToolbox/AudioFile.h>
+#include <unistd.h>
+
+#include "AQChunkedDecoder.h"
+#include "AQPlayerState.h"
+#include "AQServer.h"
+#include "AQTrace.h"
 
-// Set the number of buffers to use
-static const int kNumberBuffers = 3;
+// Length of the blend between consecutive files of a playlist
+static const Float64 kDefaultCrossfadeSeconds = 3.0;
 
-struct AQPlayerState
+// Set from the signal handler to bring the server down
+static volatile sig_atomic_t sStopRequested = 0;
+
+static
+void HandleStopSignal(int signalNumber)
 {
-	
-	/* Description:
-	 * From CoreAudioTypes.h, representing the audio data format of the file being played.
-	 * Gets used by the audio queue specified in the mQueue field.
-	 */
-	AudioStreamBasicDescription mDataFormat;
-	
-	/* Description:
-	 * The playback audio queue created by your application.
-	 */
-	AudioQueueRef mQueue;
-	
-	/* Description:
-	 * An array holding pointers to the audio queue buffers managed
-	 * by the audio queue.
-	 */
-	AudioQueueBufferRef mBuffers[kNumberBuffers];
-	
-	/* Description:
-	 * An audio file object that represents the audio file your program plays.
-	 */
-	AudioFileID mAudioFile;
-	
-	/* Description:
-	 * The size, in bytes, for each audio queue buffer. This value is calculated
-	 * in the DeriveBufferSize function, after the audio queue is created and before
-	 * it is started.
-	 */
-	UInt32 bufferByteSize;
-	
-	/* Description:
-	 * The packet index for the next packet ot play from the audio file.
-	 */
-	SInt64 mCurrentPacket;
-	
-	/* Description:
-	 * The number of packets to read on each invocation of the audio queue's playback callback.
-	 * Like the bufferByteSize field, this value is calculated in these examples in the DeriveBufferSize
-	 * function, after the audio queue is created and before it is started.
-	 */
-	UInt32 mNumPacketsToRead;
-	
-	/* Description:
-	 * For VBR audio data, the array of packet descriptions for the file being played. For CBR data,
-	 * the value of this field is NULL.
-	 */
-	AudioStreamPacketDescription  *mPacketDescs;
-	
-	/* Description:
-	 * A Boolean value indicating whether or not the audio queue is running.
-	 */
-	bool mIsRunning;
-};
+	sStopRequested = 1;
+}
+
+// Where the trace goes when the process exits, if tracing
+static const char * sTracePath = NULL;
 
-// Audio Queue callback
 static
-void HandleOutputBuffer(void * aqData, AudioQueueRef aq, AudioQueueBufferRef buf)
+void WriteTrace()
 {
-	struct AQPlayerState * data = (AQPlayerState *) aqData;
-	
-	//printf("Current packet: %lld\n", data->mCurrentPacket);
-	
-	if (!data->mIsRunning)
-	{
-		return;
-	}
-	
-	UInt32 ioNumBytesReadFromFile;	// on input, the size of the outBuffer parameter
-									// on output, the number of bytes actually read
-	
-	UInt32 ioNumPackets;	// on input, the number of packets to read
-							// on output, the number of packets actually read
+	AQTrace_Disable();
 	
-	ioNumBytesReadFromFile = data->bufferByteSize;
-	ioNumPackets = data->mNumPacketsToRead;
-	
-	//printf("attempting to read %d bytes\n", ioNumBytesReadFromFile);
-	//printf("attempting to read %d packets\n", ioNumPackets);
-	
-	AudioFileReadPacketData(data->mAudioFile,
-							false,
-							&ioNumBytesReadFromFile,
-							data->mPacketDescs,
-							data->mCurrentPacket,
-							&ioNumPackets,
-							buf->mAudioData);
-	
-	//printf("read %d bytes\n", ioNumBytesReadFromFile);
-	//printf("read %d packets\n", ioNumPackets);
-	
-	printf("read %d / %d bytes\n", ioNumBytesReadFromFile, data->bufferByteSize);
-	
-	if (ioNumPackets > 0)
+	if (!AQTrace_WriteChromeJSON(sTracePath))
 	{
-		buf->mAudioDataByteSize = ioNumBytesReadFromFile;
-		AudioQueueEnqueueBuffer(
-								aq,
-								buf,
-								data->mPacketDescs ? ioNumPackets : 0,
-								data->mPacketDescs);
-		
-		data->mCurrentPacket += ioNumPackets;
-	}
-	else
-	{
-		AudioQueueStop(aq, false);
-		data->mIsRunning = false;
+		fprintf(stderr, "Could not write trace to %s\n", sTracePath);
 	}
 }
 
+// How often the server looks for players that have finished
+static const CFAbsoluteTime kReapInterval = 0.25;
+
+// Plays every file at once, each in its own player, until they finish or SIGINT/SIGTERM.
+// With a control socket the server keeps running, taking commands, until signalled.
 static
-void DeriveBufferSize(const AudioStreamBasicDescription * inDesc,
-					  UInt32   maxPacketSize,
-					  Float64  seconds,
-					  UInt32 * outBufferSize,
-					  UInt32 * outNumPacketsToRead)
+int RunServer(const char * const * files, UInt32 numFiles, UInt32 numThreads, const char * controlPath, Float64 fastStartSeconds, UInt32 numPrewarm, struct AQHeaderCache * headerCache)
 {
-	static const int maxBufferSize = 0x50000;  // 320 kBytes
-	static const int minBufferSize = 0x4000;   // 16 kBytes
+	struct AQServer server;
+	struct AQControlServer control;
+	UInt32 k;
 	
+	signal(SIGINT, HandleStopSignal);
+	signal(SIGTERM, HandleStopSignal);
 	
-	// For audio data formats that devine a fixed number of frames per packet
-	if (inDesc->mFramesPerPacket != 0)
+	AQServer_Init(&server, numThreads);
+	server.mPlayerPool.mFastStartSeconds = fastStartSeconds;
+	server.mPlayerPool.mHeaderCache = headerCache;
+	
+	if (numPrewarm > 0 && numFiles > 0)
 	{
-		// Frames per second / frames per packet * seconds
-		Float64 numPacketsForTime = inDesc->mSampleRate / inDesc->mFramesPerPacket * seconds;
-		
-		*outBufferSize = numPacketsForTime * maxPacketSize;
+		AQPlayerPool_Prewarm(&server.mPlayerPool, files[0], numPrewarm);
 	}
-	// For audio data formats that do not define a fixed number of frames per packet,
-	// derives a reasonable audio queue buffer size based on the maximum packet size
-	// and the upper bound you've set.
-	else
+	
+	if (controlPath && !AQControlServer_Open(&control, controlPath, AQServer_HandleCommand, &server))
 	{
-		// maxPacket size is the max buffer size when CBR? CBR indicated by mFramesPerPacket = 0?
-		*outBufferSize = maxBufferSize > maxPacketSize ? maxBufferSize : maxPacketSize;
+		AQServer_CleanUp(&server);
+		return 1;
 	}
 	
-	// If the derived buffer size is above the upper bound you've set, adjust the bound,
-	// taking into account the estimated maximum packet size;
-	// I think this if statement checks the outBufferSize calculated for audio data formats
-	// that do not define a fixed number of frames per packet.
-	if (*outBufferSize > maxBufferSize && *outBufferSize > maxPacketSize)
+	if (controlPath)
 	{
-		*outBufferSize = maxBufferSize;
+		server.mControl = &control;
 	}
-	else
+	
+	for (k = 0; k < numFiles; k++)
 	{
-		if (*outBufferSize < minBufferSize)
+		if (!AQServer_StartPlayer(&server, files[k]))
 		{
-			*outBufferSize = minBufferSize;
+			fprintf(stderr, "Could not play %s\n", files[k]);
 		}
 	}
 	
-	*outNumPacketsToRead = *outBufferSize / maxPacketSize;
+	CFAbsoluteTime lastReap = CFAbsoluteTimeGetCurrent();
 	
-	printf("maxPacketSize: %d\n", maxPacketSize);
-	printf("outBufferSize: %d\n", *outBufferSize);
-	printf("numPacketsToRead: %d\n", *outNumPacketsToRead);
-
-}
-
-static
-void PrintResultCodes(OSStatus code)
-{
-	switch (code)
+	while (!sStopRequested)
 	{
-		case kAudioFileUnspecifiedError:
-			printf("File unspecified\n");
-			break;
-		case kAudioFileUnsupportedFileTypeError:
-			printf("Unsupported file type\n");
-			break;
-		case kAudioFileUnsupportedDataFormatError:
-			printf("Unsupported data format\n");
-			break;
-		case kAudioFileUnsupportedPropertyError:
-			printf("Unsupported property\n");
-			break;
-		case kAudioFileBadPropertySizeError:
-			printf("Bad property size\n");
-			break;
-		case kAudioFileNotOptimizedError:
-			printf("File not optimized\n");
-			break;
-		case kAudioFileInvalidChunkError:
-			printf("Invalid chunk\n");
-			break;
-		case kAudioFileDoesNotAllow64BitDataSizeError:
-			printf("File does not allow 64 bit data size\n");
-			break;
-		case kAudioFileInvalidPacketOffsetError:
-			printf("Invalid packet offset\n");
-			break;
-		case kAudioFileInvalidFileError:
-			printf("Invalid file\n");
-			break;
-		case kAudioFileOperationNotSupportedError:
-			printf("Operation not supported\n");
-			break;
-		case kAudioFileNotOpenError:
-			printf("File not open\n");
-			break;
-		case kAudioFileEndOfFileError:
-			printf("End of file\n");
-			break;
-		case kAudioFilePositionError:
-			printf("Position\n");
-			break;
-		case kAudio_FileNotFoundError:
-			printf("File not found\n");
+		if (!controlPath)
+		{
+			usleep(kReapInterval * 1000000);
+		}
+		else
+		{
+			// Commands are answered as they arrive, the timeout only paces reaping
+			AQControlServer_Poll(&control, kReapInterval * 1000);
+			
+			if (CFAbsoluteTimeGetCurrent() - lastReap < kReapInterval)
+			{
+				continue;
+			}
+		}
+		
+		lastReap = CFAbsoluteTimeGetCurrent();
+		
+		if (AQServer_Reap(&server) == 0 && !controlPath)
+		{
 			break;
-		default:
-			return;
+		}
 	}
-	assert(false);
-}
-
-static
-void PrintCFString(CFStringRef cf_string)
-{
-	const char * string = CFStringGetCStringPtr(cf_string, kCFStringEncodingMacRoman);
 	
-	printf("%s\n", string);
+	if (controlPath)
+	{
+		// Loads still under way reply through the control server
+		while (server.mNumLoading > 0)
+		{
+			AQControlServer_Poll(&control, kReapInterval * 1000);
+		}
+		
+		AQControlServer_Close(&control);
+	}
+	
+	AQServer_CleanUp(&server);
+	
+	return 0;
 }
 
 static
-void AQPlayerState_InitAudioFile(struct AQPlayerState * aq, const char filePath[])
+void PrintSpectrumPeak(struct AQSpectrum * spectrum)
 {
-	printf("filename: %s\n", filePath);
-	
-	CFURLRef audioFileURL = CFURLCreateFromFileSystemRepresentation(
-								NULL,
-								(const UInt8 *) filePath,
-								strlen(filePath),
-								false);
+	const struct AQSpectrumFrame * frame = AQSpectrum_Acquire(spectrum);
+	UInt32 peakBin = 1;
+	UInt32 k;
 	
-	PrintCFString(CFURLGetString(audioFileURL));
-	
-	OSStatus result =
-	AudioFileOpenURL(audioFileURL, kAudioFileReadPermission, 0, &aq->mAudioFile);
-
-	printf("mAudioFile: %p\n", aq->mAudioFile);
+	if (!frame)
+	{
+		return;
+	}
 	
-	CFRelease(audioFileURL);
+	for (k = 2; k < frame->mNumBins; k++)
+	{
+		if (frame->mMagnitudeDB[k] > frame->mMagnitudeDB[peakBin])
+		{
+			peakBin = k;
+		}
+	}
 	
-	PrintResultCodes(result);
+	printf("spectrum #%llu: peak %.0f Hz at %.1f dB\n",
+		   (unsigned long long) frame->mSequence,
+		   peakBin * frame->mBinWidth,
+		   frame->mMagnitudeDB[peakBin]);
 }
 
-static
-void PrintBasicDescription(AudioStreamBasicDescription * mDataFormat)
+// Frames decoded per read when building peaks offline, and per task when decoding in parallel
+static const UInt32 kOfflineFramesPerRead = 0x8000;
+static const UInt32 kOfflineFramesPerChunk = 4 * kOfflineFramesPerRead;
+
+/* Description:
+ * One source per pool thread, so that every chunk task running can take one for
+ * itself; a source seeks to the chunk and decodes it.
+ */
+struct AQOfflineSources
 {
-	printf("Bits per channel  : %d\n", mDataFormat->mBitsPerChannel);
-	printf("Sample rate       : %lf.3\n", mDataFormat->mSampleRate);
-	printf("Channels per frame: %d\n", mDataFormat->mChannelsPerFrame);
-	printf("Frames per packet : %d\n", mDataFormat->mFramesPerPacket);
-	printf("Bytes per packet  : %d\n", mDataFormat->mBytesPerPacket);
-}
+	pthread_mutex_t mMutex;
+	struct AQPCMSource * mSources;
+	struct AQPCMSource ** mIdle;
+	UInt32 mNumSources;
+	UInt32 mNumIdle;
+};
 
+// AQChunkDecodeFunction
 static
-void AQPlayerState_InitBasicDescription(struct AQPlayerState * aq)
+UInt32 DecodeOfflineChunk(void * context, UInt64 firstFrame, UInt32 numFrames, Float32 * out)
 {
-	UInt32 ioDataSize = sizeof(AudioStreamBasicDescription);
+	struct AQOfflineSources * sources = (struct AQOfflineSources *) context;
+	struct AQPCMSource * source;
+	UInt32 numDecoded = 0;
+	UInt32 numRead;
 	
-	AudioFileGetProperty(aq->mAudioFile, kAudioFilePropertyDataFormat, &ioDataSize, &aq->mDataFormat);
+	pthread_mutex_lock(&sources->mMutex);
+	source = sources->mIdle[--sources->mNumIdle];
+	pthread_mutex_unlock(&sources->mMutex);
 	
-	PrintBasicDescription(&aq->mDataFormat);
-}
-
-static
-void CheckError(OSStatus error, const char *operation)
-{
-	if (error == noErr) return;
+	// Compressed sources pre-roll from the packets before the seek point themselves
+	AQPCMSource_Seek(source, firstFrame);
 	
-	char str[20];
-	// see if it appears to be a 4-char-code
-	*(UInt32 *)(str + 1) = CFSwapInt32HostToBig(error);
-	if (isprint(str[1]) && isprint(str[2]) && isprint(str[3]) && isprint(str[4])) {
-		str[0] = str[5] = '\'';
-		str[6] = '\0';
-	} else
-		// no, format it as an integer
-		sprintf(str, "%d", (int)error);
+	while (numDecoded < numFrames)
+	{
+		UInt32 numToRead = numFrames - numDecoded < kOfflineFramesPerRead ? numFrames - numDecoded : kOfflineFramesPerRead;
+		
+		if ((numRead = AQPCMSource_Read(source, out + (size_t) numDecoded * source->mFormat.mChannelsPerFrame, numToRead)) == 0)
+		{
+			break;
+		}
+		
+		numDecoded += numRead;
+	}
 	
-	fprintf(stderr, "Error: %s (%s)\n", operation, str);
+	pthread_mutex_lock(&sources->mMutex);
+	sources->mIdle[sources->mNumIdle++] = source;
+	pthread_mutex_unlock(&sources->mMutex);
 	
-	exit(1);
+	return numDecoded;
 }
 
+// Opens filePath once per source, in the file's own rate and channels
 static
-void AQPlayerState_InitOutputQueue(struct AQPlayerState * aq)
+void OpenOfflineSource(const char filePath[], struct AQPCMSource * source, UInt32 maxFrames)
 {
-	printf("aq->mQueue: %p -> ", aq->mQueue);
-	OSStatus code =
-	AudioQueueNewOutput(&aq->mDataFormat, HandleOutputBuffer, aq, CFRunLoopGetCurrent(), kCFRunLoopCommonModes, 0, &aq->mQueue);
+	struct AQHeaderInfo header;
+	AudioStreamBasicDescription pcmFormat;
+	AudioFileID audioFile;
 	
-	printf("%p\n", aq->mQueue);
+	memset(source, 0, sizeof(struct AQPCMSource));
 	
-	CheckError(code, "AudioQueueNewOutput ");
-}
-
-static
-void AQPlayerState_InitSizes(struct AQPlayerState * aq)
-{
-	UInt32 outBufferSize;
-	UInt32 outNumPacketsToRead;
-	UInt32 maxPacketSize;
-	UInt32 propertySize = sizeof(maxPacketSize);
+	if (AQBlockFile_IsBlockFilePath(filePath))
+	{
+		struct AQBlockFile * blockFile = OpenBlockFile(filePath);
+		const struct AQBlockFileInfo * info = AQBlockFile_GetInfo(blockFile);
+		
+		FillPCMFormat(&pcmFormat, info->mSampleRate, info->mLayout.mNumChannels);
+		AQPCMSource_OpenBlockFile(source, blockFile, &pcmFormat, maxFrames);
+		
+		return;
+	}
 	
-	AudioFileGetProperty(aq->mAudioFile, kAudioFilePropertyPacketSizeUpperBound, &propertySize, &maxPacketSize);
-
-	DeriveBufferSize(&aq->mDataFormat, maxPacketSize, 0.5, &outBufferSize, &outNumPacketsToRead);
+	CheckError(OpenAudioFileWithHeader(filePath, NULL, &audioFile, &header), "AudioFileOpen");
 	
-	aq->bufferByteSize = outBufferSize;
-	aq->mNumPacketsToRead = outNumPacketsToRead;
+	// Keep the file's own channels, the summary is per channel
+	FillPCMFormat(&pcmFormat, header.mSampleRate, header.mChannelsPerFrame);
 	
-	printf("bufferByteSize: %d\n", outBufferSize);
-	printf("mNumPacketsToRead: %d\n", outNumPacketsToRead);
+	AQPCMSource_Open(source, audioFile, &header, &pcmFormat, maxFrames);
 }
 
+// Whether chunks of the file decode independently: linear PCM, block files, and AAC,
+// whose packets the decoder can seek to with a packet of pre-roll
 static
-void AQPlayerState_AllocatePacketDescriptionsArray(struct AQPlayerState * aq)
+bool CanDecodeInChunks(const struct AQPCMSource * source)
 {
-	bool isFormatVBR =
-	aq->mDataFormat.mBytesPerPacket == 0 || aq->mDataFormat.mFramesPerPacket == 0;
+	AudioStreamBasicDescription fileFormat;
+	UInt32 propertySize = sizeof(fileFormat);
 	
-	if (isFormatVBR)
+	if (source->mBlockFile)
 	{
-		aq->mPacketDescs = (AudioStreamPacketDescription *) malloc(aq->mNumPacketsToRead * sizeof(AudioStreamPacketDescription));
-	}
-	else
-	{
-		aq->mPacketDescs = NULL;
+		return source->mLengthFrames > 0;
 	}
+	
+	AudioFileGetProperty(source->mAudioFile, kAudioFilePropertyDataFormat, &propertySize, &fileFormat);
+	
+	return source->mLengthFrames > 0 &&
+		   (fileFormat.mFormatID == kAudioFormatLinearPCM || fileFormat.mFormatID == kAudioFormatMPEG4AAC);
 }
 
+// Builds the waveform summary of a file without playing it, as fast as it decodes.
+// With a pool, chunks of the file are decoded on it when the format allows.
 static
-void AQPlayerState_MagicCookie(struct AQPlayerState * aq)
+bool WritePeaksOffline(const char filePath[], const char sidecarPath[], struct AQThreadPool * pool)
 {
-	UInt32 cookieSize;
+	struct AQPCMSource source;
+	struct AQPeaksBuilder peaks;
+	UInt32 numFramesRead;
 	
-	bool couldNotGetProperty = AudioFileGetPropertyInfo(aq->mAudioFile, kAudioFilePropertyMagicCookieData, &cookieSize, NULL);
-
-	bool couldGetProperty = !couldNotGetProperty;
+	OpenOfflineSource(filePath, &source, kOfflineFramesPerRead);
+	AQPeaksBuilder_Init(&peaks, source.mFormat.mChannelsPerFrame, source.mFormat.mSampleRate);
 	
-	if (couldGetProperty)
+	if (pool && CanDecodeInChunks(&source))
 	{
-		printf("Setting aq->mQueue's magic cookie property\n");
+		struct AQOfflineSources sources;
+		const Float32 * chunk;
+		UInt32 k;
+		
+		sources.mNumSources = AQThreadPool_NumThreads(pool);
+		sources.mSources = (struct AQPCMSource *) malloc(sources.mNumSources * sizeof(struct AQPCMSource));
+		sources.mIdle = (struct AQPCMSource **) malloc(sources.mNumSources * sizeof(struct AQPCMSource *));
+		sources.mNumIdle = sources.mNumSources;
+		pthread_mutex_init(&sources.mMutex, NULL);
 		
-		char * magicCookie = (char *) malloc(cookieSize);
+		for (k = 0; k < sources.mNumSources; k++)
+		{
+			OpenOfflineSource(filePath, &sources.mSources[k], kOfflineFramesPerRead);
+			sources.mIdle[k] = &sources.mSources[k];
+		}
 		
-		AudioFileGetProperty(aq->mAudioFile, kAudioFilePropertyMagicCookieData, &cookieSize, magicCookie);
+		struct AQChunkedDecoder * decoder = AQChunkedDecoder_Create(pool,
+																	DecodeOfflineChunk,
+																	&sources,
+																	source.mLengthFrames,
+																	source.mFormat.mChannelsPerFrame,
+																	kOfflineFramesPerChunk,
+																	0);
+		
+		while ((chunk = AQChunkedDecoder_Next(decoder, &numFramesRead)) != NULL)
+		{
+			AQPeaksBuilder_AddFrames(&peaks, chunk, numFramesRead);
+		}
 		
-		AudioQueueSetProperty(aq->mQueue, kAudioQueueProperty_MagicCookie, magicCookie, cookieSize);
+		AQChunkedDecoder_Dispose(decoder);
 		
-		free(magicCookie);
+		for (k = 0; k < sources.mNumSources; k++)
+		{
+			AQPCMSource_Close(&sources.mSources[k]);
+		}
+		
+		pthread_mutex_destroy(&sources.mMutex);
+		free(sources.mSources);
+		free(sources.mIdle);
 	}
 	else
 	{
-		printf("No magic cookie\n");
+		Float32 * samples = (Float32 *) malloc(kOfflineFramesPerRead * source.mFormat.mBytesPerFrame);
+		
+		while ((numFramesRead = AQPCMSource_Read(&source, samples, kOfflineFramesPerRead)) > 0)
+		{
+			AQPeaksBuilder_AddFrames(&peaks, samples, numFramesRead);
+		}
+		
+		free(samples);
 	}
+	
+	bool ok = AQPeaksBuilder_Write(&peaks, sidecarPath);
+	
+	printf("Wrote peaks of %llu frames to %s\n", (unsigned long long) peaks.mNumFrames, sidecarPath);
+	
+	AQPeaksBuilder_CleanUp(&peaks);
+	AQPCMSource_Close(&source);
+	
+	return ok;
 }
 
+// Options, each of which takes a value
+static const char * const kOptionNames[] =
+{
+	"--crossfade", "--eq", "--channels", "--peaks", "--spectrum", "--fast-start", "--watermark",
+	"--offline-peaks", "--decode-threads", "--server", "--prewarm", "--control", "--trace", "--header-cache"
+};
+
 static
-void AQPlayerState_AllocateBuffersAndPrime(struct AQPlayerState * aq)
+bool IsOption(const char arg[])
 {
-	int k;
-	aq->mCurrentPacket = 0;
+	UInt32 k;
 	
-	for (k = 0; k < kNumberBuffers; k++)
+	for (k = 0; k < sizeof(kOptionNames) / sizeof(kOptionNames[0]); k++)
 	{
-		AudioQueueAllocateBuffer(aq->mQueue, aq->bufferByteSize, &aq->mBuffers[k]);
-	
-		HandleOutputBuffer(aq, aq->mQueue, aq->mBuffers[k]);
+		if (strcmp(arg, kOptionNames[k]) == 0)
+		{
+			return true;
+		}
 	}
-}
-
-static
-void AQPlayerState_SetGain(struct AQPlayerState * aq)
-{
-	Float32 gain = 1.0;
 	
-	AudioQueueSetParameter(aq->mQueue, kAudioQueueParam_Volume, gain);
+	return false;
 }
 
 static
-void AQPlayerState_CleanUp(struct AQPlayerState * aq)
+void PrintUsage(FILE * file)
 {
-	AudioQueueDispose(aq->mQueue, true);
-	AudioFileClose(aq->mAudioFile);
-	free(aq->mPacketDescs);
+	fprintf(file, "Usage: PlayingAudioExample [--crossfade seconds] [--eq type:frequency:q:gain ...] [--channels n]\n"
+				  "                           [--peaks sidecar | --offline-peaks sidecar [--decode-threads n]] [--spectrum fft-size]\n"
+				  "                           [--watermark bytes] [--fast-start ms] [--header-cache file] [--trace json] [--] [file or http:// url ...]\n"
+				  "       PlayingAudioExample --server threads [--control socket] [--prewarm n] [--header-cache file] [--trace json] [--] [file ...]\n");
 }
 
-static
-void AQPlayerState_Initialize(struct AQPlayerState * aq, const char audioFileName[])
+int main(int argc, const char * argv[])
 {
-	aq->mIsRunning = true;
+	struct AQPlayerState aq;
 	
-	// Init audio file with system path
-	AQPlayerState_InitAudioFile(aq, audioFileName);
+	memset(&aq, 0, sizeof(AQPlayerState));
 	
-	// Init basic description property
-	AQPlayerState_InitBasicDescription(aq);
+	// Absolute path to music file
+	char audioFileName[] = "/Users/robbytong/Documents/Xcode/PlayingAudioExample/PlayingAudioExample/over_everything.aac";
 	
-	// Init audio queue
-	AQPlayerState_InitOutputQueue(aq);
+	// Usage: PlayingAudioExample [--crossfade seconds] [--eq type:frequency:q:gain ...] [--channels n]
+	//                           [--peaks sidecar | --offline-peaks sidecar [--decode-threads n]] [--spectrum fft-size]
+	//                           [--watermark bytes] [--fast-start ms] [--header-cache file] [--trace json] [--] [file or http:// url ...]
+	//        PlayingAudioExample --server threads [--control socket] [--prewarm n] [--header-cache file] [--trace json] [--] [file ...]   (threads of 0 uses one per core)
+	// Options may come before or after the files; --help prints this.
+	Float64 crossfadeSeconds = kDefaultCrossfadeSeconds;
+	struct AQBiquadBand equalizerBands[kAQEqualizerMaxBands];
+	UInt32 numEqualizerBands = 0;
+	const char * offlinePeaksPath = NULL;
+	UInt32 numDecodeThreads = 1;
+	bool serverMode = false;
+	UInt32 numServerThreads = 0;
+	const char * controlPath = NULL;
+	UInt32 numPrewarm = 0;
+	const char * tracePath = NULL;
+	const char * headerCachePath = NULL;
+	struct AQHeaderCache * headerCache = NULL;
+	const char ** paths = (const char **) malloc(argc * sizeof(const char *));
+	bool isOption = true;
+	UInt32 numPaths = 0;
+	int argIndex;
+	
+	// Options go before or after the files; anything starting with a dash is one, up
+	// to a "--" that ends them
+	for (argIndex = 1; argIndex < argc; argIndex++)
+	{
+		const char * arg = argv[argIndex];
+		
+		if (!isOption || arg[0] != '-' || arg[1] == '\0')
+		{
+			paths[numPaths++] = arg;
+			continue;
+		}
+		
+		if (strcmp(arg, "--") == 0)
+		{
+			isOption = false;
+			continue;
+		}
+		
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+		{
+			PrintUsage(stdout);
+			return 0;
+		}
+		
+		if (!IsOption(arg))
+		{
+			fprintf(stderr, "Unknown option: %s\n", arg);
+			PrintUsage(stderr);
+			return 1;
+		}
+		
+		if (argIndex + 1 == argc)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg);
+			PrintUsage(stderr);
+			return 1;
+		}
+		
+		const char * value = argv[++argIndex];
+		
+		if (strcmp(arg, "--crossfade") == 0)
+		{
+			crossfadeSeconds = atof(value);
+		}
+		else if (strcmp(arg, "--eq") == 0)
+		{
+			if (numEqualizerBands == kAQEqualizerMaxBands ||
+				!AQBiquad_ParseBand(value, 0.0, &equalizerBands[numEqualizerBands]))
+			{
+				fprintf(stderr, "Bad equalizer band: %s\n", value);
+				return 1;
+			}
+			
+			numEqualizerBands++;
+		}
+		else if (strcmp(arg, "--channels") == 0)
+		{
+			aq.mNumOutputChannels = atoi(value);
+			
+			if (aq.mNumOutputChannels < 1 || aq.mNumOutputChannels > kAQChannelMapMaxChannels)
+			{
+				fprintf(stderr, "Bad channel count: %s\n", value);
+				return 1;
+			}
+			
+			// Remapping channels needs decoded samples
+			aq.mDecodeToPCM = true;
+		}
+		else if (strcmp(arg, "--peaks") == 0)
+		{
+			aq.mPeaksPath = value;
+			aq.mDecodeToPCM = true;
+		}
+		else if (strcmp(arg, "--spectrum") == 0)
+		{
+			aq.mSpectrumSize = atoi(value);
+			
+			if (aq.mSpectrumSize < 8 || aq.mSpectrumSize > kAQSpectrumMaxSize || (aq.mSpectrumSize & (aq.mSpectrumSize - 1)))
+			{
+				fprintf(stderr, "Bad FFT size: %s\n", value);
+				return 1;
+			}
+			
+			aq.mDecodeToPCM = true;
+		}
+		else if (strcmp(arg, "--fast-start") == 0)
+		{
+			// Milliseconds of audio to prime before starting
+			aq.mFastStartSeconds = atof(value) / 1000;
+		}
+		else if (strcmp(arg, "--watermark") == 0)
+		{
+			SetStreamWatermark(atoi(value));
+		}
+		else if (strcmp(arg, "--offline-peaks") == 0)
+		{
+			offlinePeaksPath = value;
+		}
+		else if (strcmp(arg, "--decode-threads") == 0)
+		{
+			numDecodeThreads = atoi(value);
+		}
+		else if (strcmp(arg, "--server") == 0)
+		{
+			serverMode = true;
+			numServerThreads = atoi(value);
+		}
+		else if (strcmp(arg, "--prewarm") == 0)
+		{
+			numPrewarm = atoi(value);
+			
+			if (numPrewarm > kAQServerMaxIdlePlayers)
+			{
+				numPrewarm = kAQServerMaxIdlePlayers;
+			}
+		}
+		else if (strcmp(arg, "--control") == 0)
+		{
+			serverMode = true;
+			controlPath = value;
+		}
+		else if (strcmp(arg, "--trace") == 0)
+		{
+			tracePath = value;
+		}
+		else
+		{
+			headerCachePath = value;
+		}
+	}
 	
-	// Init buffer & packet size numbers
-	AQPlayerState_InitSizes(aq);
+	const char * defaultPlaylist[] = { audioFileName };
+	const char * const * playlist = numPaths > 0 ? paths : defaultPlaylist;
+	UInt32 playlistCount = numPaths > 0 ? numPaths : 1;
 	
-	// Allocate audio queue packet descriptor array
-	AQPlayerState_AllocatePacketDescriptionsArray(aq);
+	if (tracePath)
+	{
+		// Written on the way out, open it in chrome://tracing or Perfetto
+		AQTrace_Enable(kAQTraceDefaultEventsPerThread);
+		AQTrace_SetThreadName("main");
+		sTracePath = tracePath;
+		atexit(WriteTrace);
+	}
 	
-	// Set the magic cookie property of the audio queue
-	AQPlayerState_MagicCookie(aq);
+	if (offlinePeaksPath)
+	{
+		struct AQThreadPool * pool = numDecodeThreads != 1 ? AQThreadPool_Create(numDecodeThreads) : NULL;
+		bool ok = WritePeaksOffline(playlist[0], offlinePeaksPath, pool);
+		
+		if (pool)
+		{
+			AQThreadPool_Dispose(pool);
+		}
+		
+		free(paths);
+		
+		return ok ? 0 : 1;
+	}
 	
-	// Allocate audio queue buffers and prime them
-	AQPlayerState_AllocateBuffersAndPrime(aq);
+	if (headerCachePath)
+	{
+		headerCache = AQHeaderCache_Open(headerCachePath);
+		AQPlayerState_SetHeaderCache(&aq, headerCache);
+	}
 	
-	// Set the gain
-	AQPlayerState_SetGain(aq);
-}
-
-int main(int argc, const char * argv[])
-{
-	struct AQPlayerState aq;
+	if (serverMode)
+	{
+		// A controlled server starts empty unless given files
+		int status = RunServer(playlist, (controlPath && numPaths == 0) ? 0 : playlistCount, numServerThreads, controlPath, aq.mFastStartSeconds, numPrewarm, headerCache);
+		
+		if (headerCache)
+		{
+			AQHeaderCache_Save(headerCache);
+			AQHeaderCache_Close(headerCache);
+		}
+		
+		free(paths);
+		
+		return status;
+	}
 	
-	memset(&aq, 0, sizeof(AQPlayerState));
+	if (numEqualizerBands > 0)
+	{
+		AQPlayerState_SetEqualizerBands(&aq, equalizerBands, numEqualizerBands);
+	}
 	
-	// Absolute path to music file
-	char audioFileName[] = "/Users/robbytong/Documents/Xcode/PlayingAudioExample/PlayingAudioExample/over_everything.aac";
+	if (playlistCount > 1 || aq.mDecodeToPCM)
+	{
+		// Play the files back to back in one queue, crossfading between them
+		AQPlayerState_SetPlaylist(&aq, playlist, playlistCount, crossfadeSeconds);
+	}
 	
-	AQPlayerState_Initialize(&aq, audioFileName);
+	AQPlayerState_Initialize(&aq, playlist[0]);
 	
 	// Start the audio queue
 	printf("Starting audio queue: %p\n", aq.mQueue);
 	
-	CheckError(AudioQueueStart(aq.mQueue, NULL), "AudioQueueStart");
-
+	CheckError(AQPlayerState_Start(&aq), "AudioQueueStart");
+	
+	bool printedTimeToFirstSample = false;
+	
 	do
 	{
 		CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.25, false);
-	} while(aq.mIsRunning);
+		
+		if (!printedTimeToFirstSample && AQPlayerState_GetTimeToFirstSample(&aq) >= 0)
+		{
+			printf("Time to first sample: %.2f ms\n", AQPlayerState_GetTimeToFirstSample(&aq) * 1000);
+			printedTimeToFirstSample = true;
+		}
+		
+		if (aq.mSpectrum)
+		{
+			PrintSpectrumPeak(aq.mSpectrum);
+		}
+	} while(AQPlayerState_IsRunning(&aq));
 	
 	// After the audio queue has stopped, runs the run loop a bit longer to ensure
 	// that the audio queue buffer currently playing has time to finish.
@@ -473,6 +623,14 @@ int main(int argc, const char * argv[])
 	// Clean up
 	AQPlayerState_CleanUp(&aq);
 	
+	if (headerCache)
+	{
+		AQHeaderCache_Save(headerCache);
+		AQHeaderCache_Close(headerCache);
+	}
+	
+	free(paths);
+	
 	return 0;
 }
 
@@ -0,0 +1,18 @@
+#!/bin/sh
+#
+#  pgo-build.sh
+#  PlayingAudioExample
+#
+#  Profile guided build: instruments the code, renders the bundled assets with it
+#  and rebuilds with the profile. Both steps share _build/pgo, since GCC matches
+#  profiles to object files by path. The result is in _build/pgo.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+cmake --preset pgo-generate
+cmake --build --preset pgo-generate --target pgo-train
+
+cmake --preset pgo-use
+cmake --build --preset pgo-use
@@ -0,0 +1,248 @@
+//
+//  AQBlockFileTest.cpp
+//  PlayingAudioExample
+//
+
+/* Writes block files with every codec and reads them back in order, after a
+ * seek and at random positions, checking every frame, then damages a block of
+ * a checksummed file and checks that only that block reads as silence.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "AQBlockFile.h"
+#include "AQTest.h"
+
+static const UInt32 kAQBlockFileTestFramesPerBlock = 4096;
+static const UInt32 kAQBlockFileTestChannels = 2;
+
+// Three full blocks and a short one
+static const UInt32 kAQBlockFileTestFrames = 3 * kAQBlockFileTestFramesPerBlock + 123;
+
+/* Description:
+ * The samples written, as floats that 16 bit samples hold exactly, and the raw
+ * frames the file has to give back for them.
+ */
+struct AQBlockFileTestSignal
+{
+	Float32 * mSamples;
+	SInt16 * mInt16;
+};
+
+static
+void AQBlockFileTest_MakeSignal(struct AQBlockFileTestSignal * signal)
+{
+	size_t numSamples = (size_t) kAQBlockFileTestFrames * kAQBlockFileTestChannels;
+	UInt32 state = 0x3c6ef372;
+	size_t k;
+	
+	signal->mSamples = (Float32 *) malloc(numSamples * sizeof(Float32));
+	signal->mInt16 = (SInt16 *) malloc(numSamples * sizeof(SInt16));
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		state = state * 1664525 + 1013904223;
+		
+		// A slow ramp, so the lossless codec has something to predict, with noise on top
+		signal->mInt16[k] = (SInt16) ((SInt32) (k / kAQBlockFileTestChannels % 4000) * 8 - 16000 + (SInt32) (state >> 24));
+		signal->mSamples[k] = signal->mInt16[k] / 32768.0f;
+	}
+}
+
+static
+bool AQBlockFileTest_Write(const char path[], const struct AQBlockFileTestSignal * signal, AQSampleType type, AQBlockCodec codec, bool hasChecksums)
+{
+	struct AQBlockFileWriter * writer = AQBlockFileWriter_Create(path, 44100, kAQBlockFileTestChannels, type, kAQBlockFileTestFramesPerBlock, codec, hasChecksums);
+	UInt32 frame = 0;
+	bool ok = writer != NULL;
+	
+	// Writes that do not line up with the blocks
+	while (ok && frame < kAQBlockFileTestFrames)
+	{
+		UInt32 numFrames = kAQBlockFileTestFrames - frame < 1000 ? kAQBlockFileTestFrames - frame : 1000;
+		
+		ok = AQBlockFileWriter_Write(writer, signal->mSamples + (size_t) frame * kAQBlockFileTestChannels, numFrames);
+		frame += numFrames;
+	}
+	
+	if (writer)
+	{
+		ok = AQBlockFileWriter_Close(writer) && ok;
+	}
+	
+	return ok;
+}
+
+// Whether numFrames raw frames from frame on are what was written
+static
+bool AQBlockFileTest_IsSignal(const struct AQBlockFileTestSignal * signal, AQSampleType type, UInt64 frame, const void * data, UInt32 numFrames)
+{
+	size_t numSamples = (size_t) numFrames * kAQBlockFileTestChannels;
+	size_t first = (size_t) frame * kAQBlockFileTestChannels;
+	
+	if (type == kAQSampleType_Float32)
+	{
+		return memcmp(data, signal->mSamples + first, numSamples * sizeof(Float32)) == 0;
+	}
+	
+	return memcmp(data, signal->mInt16 + first, numSamples * sizeof(SInt16)) == 0;
+}
+
+static
+void AQBlockFileTest_RoundTrip(const char path[], const struct AQBlockFileTestSignal * signal, AQSampleType type, AQBlockCodec codec)
+{
+	static const UInt32 kChunkFrames = 777;
+	
+	UInt8 * data = (UInt8 *) malloc((size_t) kAQBlockFileTestFrames * kAQBlockFileTestChannels * sizeof(Float32));
+	struct AQBlockFile * file;
+	UInt32 state = 0x7f4a7c15;
+	UInt64 frame = 0;
+	UInt32 numFramesRead;
+	UInt32 numBad = 0;
+	UInt32 k;
+	
+	if (!AQ_TEST_CHECK(AQBlockFileTest_Write(path, signal, type, codec, true)))
+	{
+		free(data);
+		return;
+	}
+	
+	file = AQBlockFile_Open(path);
+	
+	if (!AQ_TEST_CHECK(file != NULL))
+	{
+		free(data);
+		return;
+	}
+	
+	const struct AQBlockFileInfo * info = AQBlockFile_GetInfo(file);
+	
+	AQ_TEST_CHECK(info->mNumFrames == kAQBlockFileTestFrames);
+	AQ_TEST_CHECK(info->mNumBlocks == 4);
+	AQ_TEST_CHECK(info->mFramesPerBlock == kAQBlockFileTestFramesPerBlock);
+	AQ_TEST_CHECK(info->mLayout.mType == type && info->mLayout.mNumChannels == kAQBlockFileTestChannels);
+	AQ_TEST_CHECK(info->mSampleRate == 44100);
+	
+	// In order, in chunks that straddle the blocks
+	while ((numFramesRead = AQBlockFile_Read(file, data, kChunkFrames)) > 0)
+	{
+		if (!AQBlockFileTest_IsSignal(signal, type, frame, data, numFramesRead))
+		{
+			numBad++;
+		}
+		
+		frame += numFramesRead;
+	}
+	
+	AQ_TEST_CHECK(numBad == 0);
+	AQ_TEST_CHECK(frame == kAQBlockFileTestFrames);
+	
+	// From just before the second block
+	AQBlockFile_Seek(file, kAQBlockFileTestFramesPerBlock - 5);
+	numFramesRead = AQBlockFile_Read(file, data, 10);
+	AQ_TEST_CHECK(numFramesRead > 0 && AQBlockFileTest_IsSignal(signal, type, kAQBlockFileTestFramesPerBlock - 5, data, numFramesRead));
+	
+	numBad = 0;
+	
+	for (k = 0; k < 200; k++)
+	{
+		state = state * 1664525 + 1013904223;
+		frame = state % kAQBlockFileTestFrames;
+		numFramesRead = AQBlockFile_ReadAt(file, frame, data, kChunkFrames);
+		
+		if (numFramesRead != (kAQBlockFileTestFrames - frame < kChunkFrames ? kAQBlockFileTestFrames - frame : kChunkFrames) ||
+			!AQBlockFileTest_IsSignal(signal, type, frame, data, numFramesRead))
+		{
+			numBad++;
+		}
+	}
+	
+	AQ_TEST_CHECK(numBad == 0);
+	AQ_TEST_CHECK(AQBlockFile_ReadAt(file, kAQBlockFileTestFrames, data, kChunkFrames) == 0);
+	
+	AQBlockFile_Close(file);
+	free(data);
+}
+
+// Flips a byte of the second block of an uncompressed file, which reads as silence after
+static
+void AQBlockFileTest_Damage(const char path[], const struct AQBlockFileTestSignal * signal)
+{
+	// The 64 byte header takes the first 4 KB, each block of 16 bit stereo 16 KB after it
+	static const off_t kSecondBlockOffset = 4096 + kAQBlockFileTestFramesPerBlock * kAQBlockFileTestChannels * sizeof(SInt16);
+	
+	SInt16 * data = (SInt16 *) malloc((size_t) kAQBlockFileTestFramesPerBlock * kAQBlockFileTestChannels * sizeof(SInt16));
+	struct AQBlockFile * file;
+	FILE * stream;
+	UInt32 k;
+	int byte;
+	
+	if (!AQ_TEST_CHECK(AQBlockFileTest_Write(path, signal, kAQSampleType_SInt16, kAQBlockCodec_None, true)))
+	{
+		free(data);
+		return;
+	}
+	
+	stream = fopen(path, "r+b");
+	fseeko(stream, kSecondBlockOffset + 100, SEEK_SET);
+	byte = fgetc(stream);
+	fseeko(stream, kSecondBlockOffset + 100, SEEK_SET);
+	fputc(byte ^ 0xff, stream);
+	fclose(stream);
+	
+	file = AQBlockFile_Open(path);
+	
+	if (!AQ_TEST_CHECK(file != NULL))
+	{
+		free(data);
+		return;
+	}
+	
+	AQ_TEST_CHECK(AQBlockFile_ReadAt(file, 0, data, kAQBlockFileTestFramesPerBlock) == kAQBlockFileTestFramesPerBlock);
+	AQ_TEST_CHECK(AQBlockFileTest_IsSignal(signal, kAQSampleType_SInt16, 0, data, kAQBlockFileTestFramesPerBlock));
+	
+	AQ_TEST_CHECK(AQBlockFile_ReadAt(file, kAQBlockFileTestFramesPerBlock, data, kAQBlockFileTestFramesPerBlock) == kAQBlockFileTestFramesPerBlock);
+	
+	for (k = 0; k < kAQBlockFileTestFramesPerBlock * kAQBlockFileTestChannels && data[k] == 0; k++)
+	{
+	}
+	
+	AQ_TEST_CHECK(k == kAQBlockFileTestFramesPerBlock * kAQBlockFileTestChannels);
+	
+	AQ_TEST_CHECK(AQBlockFile_ReadAt(file, 2 * kAQBlockFileTestFramesPerBlock, data, kAQBlockFileTestFramesPerBlock) == kAQBlockFileTestFramesPerBlock);
+	AQ_TEST_CHECK(AQBlockFileTest_IsSignal(signal, kAQSampleType_SInt16, 2 * kAQBlockFileTestFramesPerBlock, data, kAQBlockFileTestFramesPerBlock));
+	
+	AQBlockFile_Close(file);
+	free(data);
+}
+
+int main()
+{
+	struct AQBlockFileTestSignal signal;
+	char path[64];
+	
+	snprintf(path, sizeof(path), "/tmp/AQBlockFileTest.%d%s", (int) getpid(), kAQBlockFileExtension);
+	
+	AQ_TEST_CHECK(AQBlockFile_IsBlockFilePath(path));
+	AQ_TEST_CHECK(!AQBlockFile_IsBlockFilePath("/tmp/AQBlockFileTest.wav"));
+	
+	AQBlockFileTest_MakeSignal(&signal);
+	
+	AQBlockFileTest_RoundTrip(path, &signal, kAQSampleType_SInt16, kAQBlockCodec_None);
+	AQBlockFileTest_RoundTrip(path, &signal, kAQSampleType_SInt16, kAQBlockCodec_LZ4);
+	AQBlockFileTest_RoundTrip(path, &signal, kAQSampleType_SInt16, kAQBlockCodec_Lossless);
+	AQBlockFileTest_RoundTrip(path, &signal, kAQSampleType_Float32, kAQBlockCodec_LZ4);
+	
+	// Float32 blocks cannot be compressed losslessly and fall back to LZ4
+	AQBlockFileTest_RoundTrip(path, &signal, kAQSampleType_Float32, kAQBlockCodec_Lossless);
+	
+	AQBlockFileTest_Damage(path, &signal);
+	
+	unlink(path);
+	free(signal.mSamples);
+	free(signal.mInt16);
+	
+	return AQTest_Finish();
+}
@@ -0,0 +1,139 @@
+//
+//  AQChannelMapTest.cpp
+//  PlayingAudioExample
+//
+
+/* Checks the downmix matrices of the layouts AQChannelMap knows by speaker:
+ * the centre reaches both sides at -3 dB, each surround reaches its own side,
+ * and rows are scaled so that full scale input cannot clip. Also checks that
+ * the kernel picked for a count applies the matrix it was built with.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "AQChannelMap.h"
+#include "AQTest.h"
+
+static const Float32 kAQChannelMapTestTolerance = 1e-5f;
+
+static
+bool AQChannelMapTest_IsClose(Float32 a, Float32 b)
+{
+	return fabsf(a - b) < kAQChannelMapTestTolerance;
+}
+
+// Whether row o of the map is the gains in expected, one per input channel
+static
+bool AQChannelMapTest_HasRow(const struct AQChannelMap * map, UInt32 o, const Float32 * expected)
+{
+	UInt32 i;
+	
+	for (i = 0; i < map->mNumInputChannels; i++)
+	{
+		if (!AQChannelMapTest_IsClose(map->mMatrix[o][i], expected[i]))
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static
+void AQChannelMapTest_Downmix()
+{
+	const Float32 c = (Float32) M_SQRT1_2;
+	struct AQChannelMap map;
+	
+	// L R C: the centre splits evenly, each row scaled by 1 / (1 + c)
+	{
+		const Float32 left[] = { 1.f / (1.f + c), 0.f, c / (1.f + c) };
+		const Float32 right[] = { 0.f, 1.f / (1.f + c), c / (1.f + c) };
+		
+		AQChannelMap_Init(&map, 3, 2);
+		AQ_TEST_CHECK(AQChannelMapTest_HasRow(&map, 0, left));
+		AQ_TEST_CHECK(AQChannelMapTest_HasRow(&map, 1, right));
+	}
+	
+	// L R C Ls Rs: each surround to its own side, the sides the same but mirrored
+	{
+		const Float32 norm = 1.f / (1.f + 2.f * c);
+		const Float32 left[] = { norm, 0.f, c * norm, c * norm, 0.f };
+		const Float32 right[] = { 0.f, norm, c * norm, 0.f, c * norm };
+		const Float32 mono[] = { 0.5f * norm, 0.5f * norm, c * norm, 0.5f * c * norm, 0.5f * c * norm };
+		
+		AQChannelMap_Init(&map, 5, 2);
+		AQ_TEST_CHECK(AQChannelMapTest_HasRow(&map, 0, left));
+		AQ_TEST_CHECK(AQChannelMapTest_HasRow(&map, 1, right));
+		
+		AQChannelMap_Init(&map, 5, 1);
+		AQ_TEST_CHECK(AQChannelMapTest_HasRow(&map, 0, mono));
+	}
+	
+	// L R C LFE Ls Rs, the LFE dropped
+	{
+		const Float32 norm = 1.f / (1.f + 2.f * c);
+		const Float32 left[] = { norm, 0.f, c * norm, 0.f, c * norm, 0.f };
+		const Float32 right[] = { 0.f, norm, c * norm, 0.f, 0.f, c * norm };
+		
+		AQChannelMap_Init(&map, 6, 2);
+		AQ_TEST_CHECK(AQChannelMapTest_HasRow(&map, 0, left));
+		AQ_TEST_CHECK(AQChannelMapTest_HasRow(&map, 1, right));
+	}
+}
+
+// Runs an odd number of frames through the map's kernel against the matrix by hand
+static
+void AQChannelMapTest_Apply(UInt32 numIn, UInt32 numOut)
+{
+	static const UInt32 kNumFrames = 37;
+	
+	struct AQChannelMap map;
+	Float32 * in = (Float32 *) malloc(kNumFrames * numIn * sizeof(Float32));
+	Float32 * out = (Float32 *) malloc(kNumFrames * numOut * sizeof(Float32));
+	UInt32 numBad = 0;
+	UInt32 f, i, o;
+	
+	for (i = 0; i < kNumFrames * numIn; i++)
+	{
+		in[i] = sinf(0.37f * i);
+	}
+	
+	AQChannelMap_Init(&map, numIn, numOut);
+	AQChannelMap_Apply(&map, in, out, kNumFrames);
+	
+	for (f = 0; f < kNumFrames; f++)
+	{
+		for (o = 0; o < numOut; o++)
+		{
+			Float32 sum = 0.f;
+			
+			for (i = 0; i < numIn; i++)
+			{
+				sum += map.mMatrix[o][i] * in[f * numIn + i];
+			}
+			
+			if (!AQChannelMapTest_IsClose(out[f * numOut + o], sum))
+			{
+				numBad++;
+			}
+		}
+	}
+	
+	AQ_TEST_CHECK(numBad == 0);
+	
+	free(in);
+	free(out);
+}
+
+int main()
+{
+	AQChannelMapTest_Downmix();
+	AQChannelMapTest_Apply(3, 2);
+	AQChannelMapTest_Apply(5, 2);
+	AQChannelMapTest_Apply(6, 2);
+	AQChannelMapTest_Apply(8, 1);
+	
+	return AQTest_Finish();
+}
@@ -0,0 +1,411 @@
+//
+//  AQControlTest.cpp
+//  PlayingAudioExample
+//
+
+/* Runs a control server with a stand-in handler on a polling thread and talks
+ * to it over its socket: requests split across writes, thousands pipelined in
+ * one write, deferred replies mixed in and kept in order, an oversized payload
+ * dropping the connection, and a client leaving with a reply outstanding.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "AQControl.h"
+#include "AQTest.h"
+
+static const UInt32 kAQControlTestNumLoadThreads = 2;
+
+struct AQControlTestServer
+{
+	struct AQControlServer mControl;
+	struct AQThreadPool * mPool;
+	pthread_t mThread;
+	bool mIsDone;
+	
+	/* Description:
+	 * Loads completed, which each answer with the count so far as their player.
+	 */
+	UInt32 mNumLoads;
+	
+	char mPath[64];
+};
+
+/* Description:
+ * Stands in for a player load: the pool sleeps a little, then the completion is
+ * posted back to the polling thread.
+ */
+struct AQControlTestLoad
+{
+	struct AQControlTestServer * mServer;
+	struct AQControlDeferred * mDeferred;
+};
+
+static
+void AQControlTest_CompleteLoad(void * arg)
+{
+	struct AQControlTestLoad * load = (struct AQControlTestLoad *) arg;
+	
+	load->mDeferred->mReply.mPlayer = ++load->mServer->mNumLoads;
+	AQControlServer_Complete(&load->mServer->mControl, load->mDeferred);
+	
+	free(load);
+}
+
+static
+void AQControlTest_RunLoad(void * arg)
+{
+	struct AQControlTestLoad * load = (struct AQControlTestLoad *) arg;
+	
+	usleep(2000);
+	AQControlServer_Post(&load->mServer->mControl, AQControlTest_CompleteLoad, load);
+}
+
+// Stats answer with the request's sequence number as the position; seek takes a Float64
+static
+void AQControlTest_Handle(void * context,
+						  const struct AQControlHeader * request, const void * /* payload */,
+						  struct AQControlHeader * reply, void * replyPayload)
+{
+	struct AQControlTestServer * server = (struct AQControlTestServer *) context;
+	struct AQControlTestLoad * load;
+	struct AQControlStats stats;
+	
+	switch (request->mCommand)
+	{
+		case kAQControlLoad:
+			load = (struct AQControlTestLoad *) malloc(sizeof(struct AQControlTestLoad));
+			load->mServer = server;
+			load->mDeferred = AQControlServer_Defer(&server->mControl);
+			AQThreadPool_Submit(server->mPool, AQControlTest_RunLoad, load);
+			return;
+		
+		case kAQControlSeek:
+			reply->mStatus = request->mLength == sizeof(Float64) ? kAQControlOK : kAQControlBadPayload;
+			return;
+		
+		case kAQControlStats:
+			memset(&stats, 0, sizeof(stats));
+			stats.mPositionSeconds = request->mSequence;
+			
+			memcpy(replyPayload, &stats, sizeof(stats));
+			reply->mLength = sizeof(stats);
+			return;
+		
+		default:
+			reply->mStatus = kAQControlUnknownCommand;
+			return;
+	}
+}
+
+static
+void * AQControlTest_Poll(void * arg)
+{
+	struct AQControlTestServer * server = (struct AQControlTestServer *) arg;
+	
+	while (!__atomic_load_n(&server->mIsDone, __ATOMIC_ACQUIRE))
+	{
+		AQControlServer_Poll(&server->mControl, 10);
+	}
+	
+	return NULL;
+}
+
+static
+bool AQControlTest_Start(struct AQControlTestServer * server)
+{
+	memset(server, 0, sizeof(struct AQControlTestServer));
+	snprintf(server->mPath, sizeof(server->mPath), "/tmp/AQControlTest.%d.sock", (int) getpid());
+	
+	if (!AQControlServer_Open(&server->mControl, server->mPath, AQControlTest_Handle, server))
+	{
+		return false;
+	}
+	
+	server->mPool = AQThreadPool_Create(kAQControlTestNumLoadThreads);
+	pthread_create(&server->mThread, NULL, AQControlTest_Poll, server);
+	
+	return true;
+}
+
+static
+void AQControlTest_Stop(struct AQControlTestServer * server)
+{
+	// Polling stops first, so that nothing is submitted to the pool as it goes; loads
+	// still on it post their completions, which AQControlServer_Close runs
+	__atomic_store_n(&server->mIsDone, true, __ATOMIC_RELEASE);
+	pthread_join(server->mThread, NULL);
+	
+	// Every client has gone, the one that left with a load outstanding included
+	AQ_TEST_CHECK(server->mControl.mNumConnections == 0);
+	
+	AQThreadPool_Dispose(server->mPool);
+	AQControlServer_Close(&server->mControl);
+}
+
+// A client socket whose reads give up after a few seconds instead of hanging the test
+static
+int AQControlTest_Connect(const struct AQControlTestServer * server)
+{
+	struct sockaddr_un address;
+	struct timeval timeout = { 5, 0 };
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, server->mPath, sizeof(address.sun_path) - 1);
+	
+	if (connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	
+	return fd;
+}
+
+static
+bool AQControlTest_SendAll(int fd, const void * data, size_t size)
+{
+	const UInt8 * p = (const UInt8 *) data;
+	
+	while (size > 0)
+	{
+		ssize_t numBytes = send(fd, p, size, 0);
+		
+		if (numBytes <= 0)
+		{
+			return false;
+		}
+		
+		p += numBytes;
+		size -= numBytes;
+	}
+	
+	return true;
+}
+
+// Reads one reply, its payload into payload when it fits in capacity bytes
+static
+bool AQControlTest_Receive(int fd, struct AQControlHeader * reply, void * payload, size_t capacity)
+{
+	if (recv(fd, reply, sizeof(struct AQControlHeader), MSG_WAITALL) != (ssize_t) sizeof(struct AQControlHeader))
+	{
+		return false;
+	}
+	
+	if (reply->mLength == 0)
+	{
+		return true;
+	}
+	
+	return reply->mLength <= capacity && recv(fd, payload, reply->mLength, MSG_WAITALL) == (ssize_t) reply->mLength;
+}
+
+static
+void AQControlTest_MakeRequest(struct AQControlHeader * request, UInt8 command, UInt32 sequence, UInt16 length)
+{
+	memset(request, 0, sizeof(struct AQControlHeader));
+	request->mCommand = command;
+	request->mSequence = sequence;
+	request->mLength = length;
+}
+
+// A seek sent a few bytes at a time, then an unknown command and a seek without payload
+static
+void AQControlTest_Framing(const struct AQControlTestServer * server)
+{
+	UInt8 message[sizeof(struct AQControlHeader) + sizeof(Float64)];
+	struct AQControlHeader request;
+	struct AQControlHeader reply;
+	Float64 seconds = 12.5;
+	size_t offset;
+	int fd = AQControlTest_Connect(server);
+	
+	if (!AQ_TEST_CHECK(fd >= 0))
+	{
+		return;
+	}
+	
+	AQControlTest_MakeRequest(&request, kAQControlSeek, 7, sizeof(seconds));
+	memcpy(message, &request, sizeof(request));
+	memcpy(message + sizeof(request), &seconds, sizeof(seconds));
+	
+	for (offset = 0; offset < sizeof(message); offset += 3)
+	{
+		AQControlTest_SendAll(fd, message + offset, sizeof(message) - offset < 3 ? sizeof(message) - offset : 3);
+		usleep(1000);
+	}
+	
+	if (AQ_TEST_CHECK(AQControlTest_Receive(fd, &reply, NULL, 0)))
+	{
+		AQ_TEST_CHECK(reply.mCommand == kAQControlSeek && reply.mSequence == 7 && reply.mStatus == kAQControlOK);
+	}
+	
+	AQControlTest_MakeRequest(&request, 99, 8, 0);
+	AQControlTest_SendAll(fd, &request, sizeof(request));
+	AQControlTest_MakeRequest(&request, kAQControlSeek, 9, 0);
+	AQControlTest_SendAll(fd, &request, sizeof(request));
+	
+	if (AQ_TEST_CHECK(AQControlTest_Receive(fd, &reply, NULL, 0)))
+	{
+		AQ_TEST_CHECK(reply.mSequence == 8 && reply.mStatus == kAQControlUnknownCommand);
+	}
+	
+	if (AQ_TEST_CHECK(AQControlTest_Receive(fd, &reply, NULL, 0)))
+	{
+		AQ_TEST_CHECK(reply.mSequence == 9 && reply.mStatus == kAQControlBadPayload);
+	}
+	
+	close(fd);
+}
+
+// More requests in one write than fit in the socket buffers, every reply in order
+static
+void AQControlTest_Pipelining(const struct AQControlTestServer * server)
+{
+	static const UInt32 kNumRequests = 3000;
+	
+	struct AQControlHeader * requests = (struct AQControlHeader *) malloc(kNumRequests * sizeof(struct AQControlHeader));
+	struct AQControlHeader reply;
+	struct AQControlStats stats;
+	UInt32 numReplies = 0;
+	UInt32 numBad = 0;
+	UInt32 k;
+	int fd = AQControlTest_Connect(server);
+	
+	if (!AQ_TEST_CHECK(fd >= 0))
+	{
+		free(requests);
+		return;
+	}
+	
+	for (k = 0; k < kNumRequests; k++)
+	{
+		AQControlTest_MakeRequest(&requests[k], kAQControlStats, k, 0);
+	}
+	
+	AQ_TEST_CHECK(AQControlTest_SendAll(fd, requests, kNumRequests * sizeof(struct AQControlHeader)));
+	
+	for (k = 0; k < kNumRequests && AQControlTest_Receive(fd, &reply, &stats, sizeof(stats)); k++)
+	{
+		if (reply.mSequence != k || reply.mLength != sizeof(stats) || stats.mPositionSeconds != k)
+		{
+			numBad++;
+		}
+		
+		numReplies++;
+	}
+	
+	AQ_TEST_CHECK(numReplies == kNumRequests);
+	AQ_TEST_CHECK(numBad == 0);
+	
+	close(fd);
+	free(requests);
+}
+
+// Every tenth request a load, whose reply holds up the ones behind it
+static
+void AQControlTest_Deferred(const struct AQControlTestServer * server)
+{
+	static const UInt32 kNumRequests = 200;
+	
+	struct AQControlHeader * requests = (struct AQControlHeader *) malloc(kNumRequests * sizeof(struct AQControlHeader));
+	struct AQControlHeader reply;
+	struct AQControlStats stats;
+	UInt32 numBad = 0;
+	UInt32 numLoads = 0;
+	UInt32 k;
+	int fd = AQControlTest_Connect(server);
+	
+	if (!AQ_TEST_CHECK(fd >= 0))
+	{
+		free(requests);
+		return;
+	}
+	
+	for (k = 0; k < kNumRequests; k++)
+	{
+		AQControlTest_MakeRequest(&requests[k], k % 10 == 0 ? kAQControlLoad : kAQControlStats, k, 0);
+	}
+	
+	AQ_TEST_CHECK(AQControlTest_SendAll(fd, requests, kNumRequests * sizeof(struct AQControlHeader)));
+	
+	for (k = 0; k < kNumRequests; k++)
+	{
+		if (!AQ_TEST_CHECK(AQControlTest_Receive(fd, &reply, &stats, sizeof(stats))))
+		{
+			break;
+		}
+		
+		if (reply.mSequence != k || reply.mCommand != requests[k].mCommand)
+		{
+			numBad++;
+		}
+		
+		if (reply.mCommand == kAQControlLoad && reply.mPlayer != ++numLoads)
+		{
+			numBad++;
+		}
+	}
+	
+	AQ_TEST_CHECK(numBad == 0);
+	
+	// Leaving with a load outstanding orphans its reply, which is then dropped
+	AQControlTest_MakeRequest(&requests[0], kAQControlLoad, 0, 0);
+	AQ_TEST_CHECK(AQControlTest_SendAll(fd, requests, sizeof(struct AQControlHeader)));
+	close(fd);
+	
+	// Time for the server to notice, AQControlTest_Stop checks it did
+	usleep(100000);
+	
+	free(requests);
+}
+
+// A payload over kAQControlMaxPayload ends the connection instead of being buffered
+static
+void AQControlTest_Oversized(const struct AQControlTestServer * server)
+{
+	struct AQControlHeader request;
+	char byte;
+	int fd = AQControlTest_Connect(server);
+	
+	if (!AQ_TEST_CHECK(fd >= 0))
+	{
+		return;
+	}
+	
+	AQControlTest_MakeRequest(&request, kAQControlLoad, 1, kAQControlMaxPayload + 1);
+	AQControlTest_SendAll(fd, &request, sizeof(request));
+	
+	AQ_TEST_CHECK(recv(fd, &byte, 1, 0) == 0);
+	
+	close(fd);
+}
+
+int main()
+{
+	struct AQControlTestServer server;
+	
+	if (!AQ_TEST_CHECK(AQControlTest_Start(&server)))
+	{
+		return AQTest_Finish();
+	}
+	
+	AQControlTest_Framing(&server);
+	AQControlTest_Pipelining(&server);
+	AQControlTest_Deferred(&server);
+	AQControlTest_Oversized(&server);
+	
+	AQControlTest_Stop(&server);
+	
+	return AQTest_Finish();
+}
@@ -0,0 +1,193 @@
+//
+//  AQDecoderTest.cpp
+//  PlayingAudioExample
+//
+
+/* Decodes the bundled over_everything assets whole and checks that each
+ * decoder gives the number of frames its header promises, that the compressed
+ * versions are as long as the WAVE they were made from, that a rewind
+ * decodes the same frames again, and that AAC decodes the same frames from
+ * the middle of the file as from its start.
+ *
+ * Usage: AQDecoderTest asset-directory
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AQAAC.h"
+#include "AQTest.h"
+#include "AQVorbis.h"
+#include "AQWaveFile.h"
+
+static const UInt32 kAQDecoderTestChunkFrames = 4096;
+
+typedef UInt32 (*AQDecoderTestReadFunction)(void * file, Float32 * out, UInt32 numFrames);
+typedef bool (*AQDecoderTestRewindFunction)(void * file);
+
+static
+UInt32 AQDecoderTest_ReadVorbis(void * file, Float32 * out, UInt32 numFrames)
+{
+	return AQVorbisFile_Read((struct AQVorbisFile *) file, out, numFrames);
+}
+
+static
+bool AQDecoderTest_RewindVorbis(void * file)
+{
+	return AQVorbisFile_Rewind((struct AQVorbisFile *) file);
+}
+
+static
+UInt32 AQDecoderTest_ReadAAC(void * file, Float32 * out, UInt32 numFrames)
+{
+	return AQAACFile_Read((struct AQAACFile *) file, out, numFrames);
+}
+
+static
+bool AQDecoderTest_RewindAAC(void * file)
+{
+	return AQAACFile_Rewind((struct AQAACFile *) file);
+}
+
+// Decodes to the end and returns the frame count; outFirst gets the first chunk
+static
+UInt64 AQDecoderTest_Decode(void * file, AQDecoderTestReadFunction read, UInt32 numChannels, Float32 * outFirst, bool * outIsFinite)
+{
+	Float32 * samples = (Float32 *) malloc((size_t) kAQDecoderTestChunkFrames * numChannels * sizeof(Float32));
+	UInt64 numFrames = 0;
+	UInt32 numFramesRead;
+	size_t k;
+	
+	*outIsFinite = true;
+	
+	while ((numFramesRead = read(file, samples, kAQDecoderTestChunkFrames)) > 0)
+	{
+		if (numFrames == 0)
+		{
+			memcpy(outFirst, samples, (size_t) numFramesRead * numChannels * sizeof(Float32));
+		}
+		
+		for (k = 0; k < (size_t) numFramesRead * numChannels; k++)
+		{
+			if (!isfinite(samples[k]))
+			{
+				*outIsFinite = false;
+			}
+		}
+		
+		numFrames += numFramesRead;
+	}
+	
+	free(samples);
+	
+	return numFrames;
+}
+
+// Decodes the file twice, with a rewind between, and checks its length
+static
+void AQDecoderTest_Check(void * file, AQDecoderTestReadFunction read, AQDecoderTestRewindFunction rewind,
+						 UInt32 numChannels, UInt64 expectedFrames)
+{
+	size_t chunkBytes = (size_t) kAQDecoderTestChunkFrames * numChannels * sizeof(Float32);
+	Float32 * first = (Float32 *) calloc(1, chunkBytes);
+	Float32 * again = (Float32 *) calloc(1, chunkBytes);
+	bool isFinite;
+	
+	AQ_TEST_CHECK(AQDecoderTest_Decode(file, read, numChannels, first, &isFinite) == expectedFrames);
+	AQ_TEST_CHECK(isFinite);
+	
+	if (AQ_TEST_CHECK(rewind(file)))
+	{
+		AQ_TEST_CHECK(read(file, again, kAQDecoderTestChunkFrames) == kAQDecoderTestChunkFrames);
+		AQ_TEST_CHECK(memcmp(first, again, chunkBytes) == 0);
+	}
+	
+	free(first);
+	free(again);
+}
+
+// Decodes from a frame inside a packet, which starts from the packet before it, and
+// checks that it gives the frames a decode from the start does
+static
+void AQDecoderTest_CheckAACReadAt(struct AQAACFile * file, UInt32 numChannels)
+{
+	static const UInt32 kFirstFrame = 5 * kAQAACFramesPerPacket + 100;
+	static const UInt32 kNumFrames = 3000;
+	
+	size_t numSamples = (size_t) (kFirstFrame + kNumFrames) * numChannels;
+	Float32 * expected = (Float32 *) calloc(numSamples, sizeof(Float32));
+	Float32 * actual = (Float32 *) calloc((size_t) kNumFrames * numChannels, sizeof(Float32));
+	
+	if (AQ_TEST_CHECK(AQAACFile_IndexFrames(file)) && AQ_TEST_CHECK(AQAACFile_Rewind(file)))
+	{
+		AQ_TEST_CHECK(AQAACFile_Read(file, expected, kFirstFrame + kNumFrames) == kFirstFrame + kNumFrames);
+		AQ_TEST_CHECK(AQAACFile_ReadAt(file, kFirstFrame, actual, kNumFrames) == kNumFrames);
+		AQ_TEST_CHECK(memcmp(expected + (size_t) kFirstFrame * numChannels, actual, (size_t) kNumFrames * numChannels * sizeof(Float32)) == 0);
+		
+		// Cut short by the end
+		AQ_TEST_CHECK(AQAACFile_ReadAt(file, AQAACFile_GetInfo(file)->mNumFrames - 10, actual, kNumFrames) == 10);
+	}
+	
+	free(expected);
+	free(actual);
+}
+
+int main(int argc, const char * argv[])
+{
+	struct AQWaveFile wave;
+	char path[1024];
+	
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: AQDecoderTest asset-directory\n");
+		return 1;
+	}
+	
+	snprintf(path, sizeof(path), "%s/over_everything.wav", argv[1]);
+	
+	if (!AQ_TEST_CHECK(AQWaveFile_Open(&wave, path)))
+	{
+		return AQTest_Finish();
+	}
+	
+	UInt64 numWaveFrames = wave.mNumFrames;
+	UInt32 numChannels = wave.mLayout.mNumChannels;
+	
+	AQ_TEST_CHECK(wave.mSampleRate == 44100 && numChannels == 2);
+	AQWaveFile_Close(&wave);
+	
+	snprintf(path, sizeof(path), "%s/over_everything.ogg", argv[1]);
+	
+	struct AQVorbisFile * vorbis = AQVorbisFile_Open(path);
+	
+	if (AQ_TEST_CHECK(vorbis != NULL))
+	{
+		const struct AQVorbisInfo * info = AQVorbisFile_GetInfo(vorbis);
+		
+		AQ_TEST_CHECK(info->mNumChannels == numChannels && info->mSampleRate == 44100);
+		AQ_TEST_CHECK(info->mNumFrames == numWaveFrames);
+		
+		AQDecoderTest_Check(vorbis, AQDecoderTest_ReadVorbis, AQDecoderTest_RewindVorbis, numChannels, info->mNumFrames);
+		AQVorbisFile_Close(vorbis);
+	}
+	
+	snprintf(path, sizeof(path), "%s/over_everything.aac", argv[1]);
+	
+	struct AQAACFile * aac = AQAACFile_Open(path);
+	
+	if (AQ_TEST_CHECK(aac != NULL))
+	{
+		const struct AQAACInfo * info = AQAACFile_GetInfo(aac);
+		
+		AQ_TEST_CHECK(info->mNumChannels == numChannels && info->mSampleRate == 44100);
+		AQ_TEST_CHECK(info->mPrimingFrames == kAQAACPrimingFrames);
+		AQ_TEST_CHECK(info->mNumFrames == numWaveFrames);
+		
+		AQDecoderTest_Check(aac, AQDecoderTest_ReadAAC, AQDecoderTest_RewindAAC, numChannels, info->mNumFrames);
+		AQDecoderTest_CheckAACReadAt(aac, numChannels);
+		AQAACFile_Close(aac);
+	}
+	
+	return AQTest_Finish();
+}
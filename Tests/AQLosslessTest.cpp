@@ -0,0 +1,143 @@
+//
+//  AQLosslessTest.cpp
+//  PlayingAudioExample
+//
+
+/* Compresses 16 and 24 bit blocks of tones, noise, silence and full scale
+ * samples and checks they decompress to the same bytes, and that truncated or
+ * damaged blocks are turned down rather than read past.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AQLossless.h"
+#include "AQTest.h"
+
+static const UInt32 kAQLosslessTestFrames = 4096;
+
+// Little endian samples: a tone per channel with a little noise, then silence, then
+// alternating full scale, each a third of the block
+static
+void AQLosslessTest_MakeFrames(UInt8 * frames, UInt32 numFrames, UInt32 numChannels, UInt32 bytesPerSample)
+{
+	SInt32 fullScale = bytesPerSample == 2 ? 32768 : 8388608;
+	UInt32 state = 0x1f123bb5;
+	UInt32 frame;
+	UInt32 channel;
+	
+	for (frame = 0; frame < numFrames; frame++)
+	{
+		for (channel = 0; channel < numChannels; channel++)
+		{
+			UInt8 * p = frames + ((size_t) frame * numChannels + channel) * bytesPerSample;
+			SInt32 sample;
+			
+			state = state * 1664525 + 1013904223;
+			
+			if (frame < numFrames / 3)
+			{
+				sample = (SInt32) (0.6 * fullScale * sin(frame * 0.01 * (channel + 1))) + (SInt32) (state >> 26) - 32;
+			}
+			else if (frame < 2 * numFrames / 3)
+			{
+				sample = 0;
+			}
+			else
+			{
+				sample = (frame + channel) % 2 ? fullScale - 1 : -fullScale;
+			}
+			
+			p[0] = (UInt8) sample;
+			p[1] = (UInt8) (sample >> 8);
+			
+			if (bytesPerSample == 3)
+			{
+				p[2] = (UInt8) (sample >> 16);
+			}
+		}
+	}
+}
+
+static
+void AQLosslessTest_RoundTrip(AQSampleType type, UInt32 numChannels)
+{
+	struct AQSampleLayout layout = { type, false, true, numChannels };
+	UInt32 bytesPerFrame = AQSampleConvert_BytesPerSample(type) * numChannels;
+	size_t numBytes = (size_t) kAQLosslessTestFrames * bytesPerFrame;
+	UInt32 capacity = (UInt32) numBytes * 2;
+	
+	UInt8 * frames = (UInt8 *) malloc(numBytes);
+	UInt8 * decoded = (UInt8 *) malloc(numBytes);
+	UInt8 * compressed = (UInt8 *) malloc(capacity);
+	UInt32 size;
+	UInt32 cut;
+	
+	AQ_TEST_CHECK(AQLossless_CanCompress(&layout));
+	
+	AQLosslessTest_MakeFrames(frames, kAQLosslessTestFrames, numChannels, AQSampleConvert_BytesPerSample(type));
+	
+	size = AQLossless_Compress(frames, kAQLosslessTestFrames, &layout, compressed, capacity);
+	
+	if (AQ_TEST_CHECK(size > 0 && size < numBytes))
+	{
+		AQ_TEST_CHECK(AQLossless_Decompress(compressed, size, decoded, kAQLosslessTestFrames, &layout));
+		AQ_TEST_CHECK(memcmp(frames, decoded, numBytes) == 0);
+		
+		// Too small a buffer is not an error, it just does not compress
+		AQ_TEST_CHECK(AQLossless_Compress(frames, kAQLosslessTestFrames, &layout, compressed + size, size / 2) == 0);
+		
+		// Every truncation comes back false, and never reads past size
+		for (cut = 0; cut < size; cut += 1 + cut / 8)
+		{
+			UInt8 * truncated = (UInt8 *) malloc(cut > 0 ? cut : 1);
+			
+			memcpy(truncated, compressed, cut);
+			
+			if (!AQ_TEST_CHECK(!AQLossless_Decompress(truncated, cut, decoded, kAQLosslessTestFrames, &layout)))
+			{
+				cut = size;
+			}
+			
+			free(truncated);
+		}
+		
+		// Damage may go unnoticed, but must stay inside the buffers
+		for (cut = 0; cut < size; cut += 7)
+		{
+			compressed[cut] ^= 0x5a;
+			AQLossless_Decompress(compressed, size, decoded, kAQLosslessTestFrames, &layout);
+			compressed[cut] ^= 0x5a;
+		}
+	}
+	
+	free(frames);
+	free(decoded);
+	free(compressed);
+}
+
+static
+void AQLosslessTest_Layouts()
+{
+	struct AQSampleLayout planar = { kAQSampleType_SInt16, false, false, 2 };
+	struct AQSampleLayout bigEndian = { kAQSampleType_SInt16, true, true, 2 };
+	struct AQSampleLayout floats = { kAQSampleType_Float32, false, true, 2 };
+	struct AQSampleLayout wide = { kAQSampleType_SInt16, false, true, kAQLosslessMaxChannels + 1 };
+	
+	AQ_TEST_CHECK(!AQLossless_CanCompress(&planar));
+	AQ_TEST_CHECK(!AQLossless_CanCompress(&bigEndian));
+	AQ_TEST_CHECK(!AQLossless_CanCompress(&floats));
+	AQ_TEST_CHECK(!AQLossless_CanCompress(&wide));
+}
+
+int main()
+{
+	AQLosslessTest_Layouts();
+	AQLosslessTest_RoundTrip(kAQSampleType_SInt16, 1);
+	AQLosslessTest_RoundTrip(kAQSampleType_SInt16, 2);
+	AQLosslessTest_RoundTrip(kAQSampleType_SInt24, 2);
+	AQLosslessTest_RoundTrip(kAQSampleType_SInt24, 6);
+	
+	return AQTest_Finish();
+}
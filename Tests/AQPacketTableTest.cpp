@@ -0,0 +1,149 @@
+//
+//  AQPacketTableTest.cpp
+//  PlayingAudioExample
+//
+
+/* Builds packet tables from known packets, with and without a fixed frame count
+ * and with gaps between packets, and checks that every packet, range and frame
+ * lookup gives back what went in.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AQPacketTable.h"
+#include "AQTest.h"
+
+// Packets 0 to numPackets - 1, a few of them not starting where the previous one ended
+static
+void AQPacketTableTest_MakePackets(struct AQPacketInfo * packets, UInt32 numPackets, UInt32 framesPerPacket)
+{
+	UInt32 state = 0x6b43a9b5;
+	SInt64 offset = 0;
+	UInt64 frame = 0;
+	UInt32 k;
+	
+	for (k = 0; k < numPackets; k++)
+	{
+		state = state * 1664525 + 1013904223;
+		
+		// Gaps both ways, as with a chunk between packets or an overlapping description
+		if (k % 97 == 5)
+		{
+			offset += (state >> 28) + 1;
+		}
+		else if (k % 131 == 7)
+		{
+			offset -= 3;
+		}
+		
+		packets[k].mStartOffset = offset;
+		packets[k].mStartFrame = frame;
+		packets[k].mDataByteSize = k % 211 == 0 ? 0 : (state >> 20);
+		packets[k].mNumFrames = framesPerPacket ? framesPerPacket : (state >> 31) ? 1024 : 128;
+		
+		offset += packets[k].mDataByteSize;
+		frame += packets[k].mNumFrames;
+	}
+}
+
+static
+bool AQPacketTableTest_IsEqual(const struct AQPacketInfo * a, const struct AQPacketInfo * b)
+{
+	return a->mStartOffset == b->mStartOffset &&
+		   a->mStartFrame == b->mStartFrame &&
+		   a->mDataByteSize == b->mDataByteSize &&
+		   a->mNumFrames == b->mNumFrames;
+}
+
+static
+void AQPacketTableTest_RoundTrip(UInt32 framesPerPacket)
+{
+	static const UInt32 kNumPackets = 10 * kAQPacketTablePacketsPerBlock + 17;
+	
+	struct AQPacketInfo * packets = (struct AQPacketInfo *) malloc(kNumPackets * sizeof(struct AQPacketInfo));
+	struct AQPacketInfo range[kAQPacketTablePacketsPerBlock + 5];
+	struct AQPacketTable table;
+	struct AQPacketInfo info;
+	UInt32 numBad = 0;
+	UInt32 k;
+	
+	AQPacketTableTest_MakePackets(packets, kNumPackets, framesPerPacket);
+	AQPacketTable_Init(&table, framesPerPacket);
+	
+	for (k = 0; k < kNumPackets; k++)
+	{
+		AQPacketTable_Append(&table, packets[k].mStartOffset, packets[k].mDataByteSize, packets[k].mNumFrames);
+	}
+	
+	AQPacketTable_Trim(&table);
+	
+	AQ_TEST_CHECK(table.mNumPackets == kNumPackets);
+	AQ_TEST_CHECK(table.mNumFrames == packets[kNumPackets - 1].mStartFrame + packets[kNumPackets - 1].mNumFrames);
+	
+	// Smaller than the 16 bytes per packet of an AudioStreamPacketDescription
+	AQ_TEST_CHECK(AQPacketTable_GetMemorySize(&table) < (size_t) kNumPackets * 16);
+	
+	for (k = 0; k < kNumPackets; k++)
+	{
+		if (!AQPacketTable_Get(&table, k, &info) || !AQPacketTableTest_IsEqual(&info, &packets[k]))
+		{
+			numBad++;
+		}
+	}
+	
+	AQ_TEST_CHECK(numBad == 0);
+	AQ_TEST_CHECK(!AQPacketTable_Get(&table, kNumPackets, &info));
+	
+	// A range across a block boundary, and one cut short by the end
+	AQ_TEST_CHECK(AQPacketTable_GetRange(&table, 60, kAQPacketTablePacketsPerBlock + 5, range) == kAQPacketTablePacketsPerBlock + 5);
+	AQ_TEST_CHECK(AQPacketTableTest_IsEqual(&range[0], &packets[60]));
+	AQ_TEST_CHECK(AQPacketTableTest_IsEqual(&range[kAQPacketTablePacketsPerBlock + 4], &packets[60 + kAQPacketTablePacketsPerBlock + 4]));
+	AQ_TEST_CHECK(AQPacketTable_GetRange(&table, kNumPackets - 3, 10, range) == 3);
+	AQ_TEST_CHECK(AQPacketTableTest_IsEqual(&range[2], &packets[kNumPackets - 1]));
+	
+	// First, last and a middle frame of every packet
+	numBad = 0;
+	
+	for (k = 0; k < kNumPackets; k++)
+	{
+		UInt64 first = packets[k].mStartFrame;
+		UInt64 last = first + packets[k].mNumFrames - 1;
+		
+		if (AQPacketTable_FindPacket(&table, first) != k ||
+			AQPacketTable_FindPacket(&table, last) != k ||
+			AQPacketTable_FindPacket(&table, (first + last) / 2) != k)
+		{
+			numBad++;
+		}
+	}
+	
+	AQ_TEST_CHECK(numBad == 0);
+	AQ_TEST_CHECK(AQPacketTable_FindPacket(&table, table.mNumFrames) == kNumPackets);
+	
+	AQPacketTable_CleanUp(&table);
+	free(packets);
+}
+
+static
+void AQPacketTableTest_Empty()
+{
+	struct AQPacketTable table;
+	struct AQPacketInfo info;
+	
+	AQPacketTable_Init(&table, 0);
+	
+	AQ_TEST_CHECK(!AQPacketTable_Get(&table, 0, &info));
+	AQ_TEST_CHECK(AQPacketTable_FindPacket(&table, 0) == 0);
+	
+	AQPacketTable_CleanUp(&table);
+}
+
+int main()
+{
+	AQPacketTableTest_Empty();
+	AQPacketTableTest_RoundTrip(0);
+	AQPacketTableTest_RoundTrip(1024);
+	
+	return AQTest_Finish();
+}
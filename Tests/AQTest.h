@@ -0,0 +1,46 @@
+//
+//  AQTest.h
+//  PlayingAudioExample
+//
+
+/* Checks for the test programs under Tests/, which ctest runs. A failed check
+ * prints where it is and what it tested, and the program keeps going so one
+ * run reports every failure; main returns AQTest_Finish() as its exit status.
+ * Nothing here needs an audio device.
+ */
+
+#ifndef AQTest_h
+#define AQTest_h
+
+#include <stdio.h>
+
+#include "AQTypes.h"
+
+static UInt32 sAQTestNumChecks;
+static UInt32 sAQTestNumFailures;
+
+static inline bool AQTest_Check(bool passed, const char * expression, const char * file, int line)
+{
+	sAQTestNumChecks++;
+	
+	if (!passed)
+	{
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+		sAQTestNumFailures++;
+	}
+	
+	return passed;
+}
+
+// Prints the tally, returns the exit status
+static inline int AQTest_Finish()
+{
+	printf("%u checks, %u failed\n", sAQTestNumChecks, sAQTestNumFailures);
+	
+	return sAQTestNumFailures == 0 ? 0 : 1;
+}
+
+// Evaluates to whether condition held, so a test can stop when the rest would be moot
+#define AQ_TEST_CHECK(condition) AQTest_Check((condition), #condition, __FILE__, __LINE__)
+
+#endif /* AQTest_h */
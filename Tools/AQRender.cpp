@@ -0,0 +1,731 @@
+//
+//  AQRender.cpp
+//  PlayingAudioExample
+//
+
+/* Offline render of files through the player's PCM pipeline (sample
+ * conversion, channel map, equalizer, peaks) as fast as it goes, without an
+ * audio device. This is what the player does per buffer on hosts that have no
+ * AudioQueue, and the workload the benchmarks and profiles are taken from.
+ *
+ * Usage: AQRender [--eq type:frequency:q:gain ...] [--channels n] [--peaks sidecar]
+ *                 [--out file.wav|file.aqb] [--block-type s16|s24|s32|f32] [--block-codec none|lz4|lossless]
+ *                 [--threads n] [--trace json] [--] file.wav|file.ogg|file.aac|file.flac|file.aqb ...
+ *
+ * Options may come before or after the files. --help prints the usage, and
+ * any other argument starting with a dash that is not an option is an error;
+ * files whose names start with a dash go after --.
+ *
+ * Files are WAVE, Ogg Vorbis through AQVorbis, ADTS AAC through AQAAC, FLAC
+ * through AQFLAC or block files through AQBlockFile. --threads decodes a
+ * WAVE, AAC, FLAC or block file in chunks on that many threads (0 for one per
+ * core) while the equalizer, peaks and output take them in order. AAC blocks
+ * overlap one another, so each chunk decodes one packet before its start as
+ * well; Vorbis packets vary in size, so .ogg files always decode in line.
+ * --out writes a block file when it ends in .aqb, of --block-type samples (f32
+ * by default) compressed with --block-codec (none by default; lossless takes
+ * s16 and s24 and falls back to lz4 otherwise), and a 32 bit float WAVE file
+ * otherwise.
+ * --out and --peaks take a single file. Rendering several files goes on past
+ * the ones that fail, and the exit status tells whether any did.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "AQAAC.h"
+#include "AQBlockFile.h"
+#include "AQChannelMap.h"
+#include "AQChunkedDecoder.h"
+#include "AQEqualizer.h"
+#include "AQFLAC.h"
+#include "AQPeaks.h"
+#include "AQSampleConvert.h"
+#include "AQThreadPool.h"
+#include "AQTrace.h"
+#include "AQVorbis.h"
+#include "AQWaveFile.h"
+
+// Frames per pass through the pipeline, about what one queue buffer holds
+static const UInt32 kNumFramesPerRender = 4096;
+
+// Frames each task decodes when rendering on several threads
+static const UInt32 kNumFramesPerChunk = 1 << 16;
+
+struct AQRenderOptions
+{
+	struct AQBiquadBand mEqualizerBands[kAQEqualizerMaxBands];
+	UInt32 mNumEqualizerBands;
+	
+	/* Description:
+	 * Channels rendered, 0 to keep mono and stereo as they are and downmix anything wider.
+	 */
+	UInt32 mNumOutputChannels;
+	
+	const char * mPeaksPath;
+	const char * mOutputPath;
+	const char * mTracePath;
+	
+	/* Description:
+	 * How an .aqb mOutputPath stores its samples.
+	 */
+	AQSampleType mBlockType;
+	AQBlockCodec mBlockCodec;
+	
+	/* Description:
+	 * Threads decoding chunks of the file ahead of the rest of the pipeline, 1 to
+	 * decode in line and 0 for one per core.
+	 */
+	UInt32 mNumThreads;
+};
+
+static
+Float64 AQRender_Now()
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* Description:
+ * A file opened for rendering, and how its frames become the rendered channels.
+ */
+struct AQRenderSource
+{
+	/* Description:
+	 * Either mWave or mBlockFile, whose raw frames of mRawBytesPerFrame bytes
+	 * mConvertKernel turns to float, or mVorbis, mAAC or mFLAC, whichever is not
+	 * NULL. When mIsParallel is set, AAC, FLAC and block files are decoded at
+	 * any frame, otherwise in order.
+	 */
+	struct AQWaveFile mWave;
+	struct AQBlockFile * mBlockFile;
+	AQSampleConvertKernel mConvertKernel;
+	UInt32 mRawBytesPerFrame;
+	struct AQVorbisFile * mVorbis;
+	struct AQAACFile * mAAC;
+	struct AQFLACFile * mFLAC;
+	bool mIsParallel;
+	
+	Float64 mSampleRate;
+	struct AQChannelMap mChannelMap;
+	UInt32 mNumFileChannels;
+	UInt32 mNumChannels;
+};
+
+static
+void AQRenderSource_Close(struct AQRenderSource * source)
+{
+	if (source->mVorbis)
+	{
+		AQVorbisFile_Close(source->mVorbis);
+	}
+	else if (source->mAAC)
+	{
+		AQAACFile_Close(source->mAAC);
+	}
+	else if (source->mFLAC)
+	{
+		AQFLACFile_Close(source->mFLAC);
+	}
+	else if (source->mBlockFile)
+	{
+		AQBlockFile_Close(source->mBlockFile);
+	}
+	else
+	{
+		AQWaveFile_Close(&source->mWave);
+	}
+}
+
+static
+bool AQRenderSource_Open(struct AQRenderSource * source, const char path[], UInt32 numChannels)
+{
+	const char * extension = strrchr(path, '.');
+	
+	memset(source, 0, sizeof(struct AQRenderSource));
+	
+	if (extension && strcmp(extension, ".ogg") == 0)
+	{
+		if (!(source->mVorbis = AQVorbisFile_Open(path)))
+		{
+			fprintf(stderr, "Could not open %s as Ogg Vorbis\n", path);
+			return false;
+		}
+		
+		source->mSampleRate = AQVorbisFile_GetInfo(source->mVorbis)->mSampleRate;
+		source->mNumFileChannels = AQVorbisFile_GetInfo(source->mVorbis)->mNumChannels;
+	}
+	else if (extension && strcmp(extension, ".aac") == 0)
+	{
+		if (!(source->mAAC = AQAACFile_Open(path)))
+		{
+			fprintf(stderr, "Could not open %s as ADTS AAC\n", path);
+			return false;
+		}
+		
+		source->mSampleRate = AQAACFile_GetInfo(source->mAAC)->mSampleRate;
+		source->mNumFileChannels = AQAACFile_GetInfo(source->mAAC)->mNumChannels;
+	}
+	else if (extension && strcmp(extension, ".flac") == 0)
+	{
+		if (!(source->mFLAC = AQFLACFile_Open(path)))
+		{
+			fprintf(stderr, "Could not open %s as FLAC\n", path);
+			return false;
+		}
+		
+		source->mSampleRate = AQFLACFile_GetInfo(source->mFLAC)->mSampleRate;
+		source->mNumFileChannels = AQFLACFile_GetInfo(source->mFLAC)->mNumChannels;
+	}
+	else if (AQBlockFile_IsBlockFilePath(path))
+	{
+		if (!(source->mBlockFile = AQBlockFile_Open(path)))
+		{
+			fprintf(stderr, "Could not open %s as a block file\n", path);
+			return false;
+		}
+		
+		const struct AQBlockFileInfo * info = AQBlockFile_GetInfo(source->mBlockFile);
+		
+		source->mConvertKernel = AQSampleConvert_SelectKernel(&info->mLayout);
+		source->mRawBytesPerFrame = info->mBytesPerFrame;
+		source->mSampleRate = info->mSampleRate;
+		source->mNumFileChannels = info->mLayout.mNumChannels;
+	}
+	else
+	{
+		if (!AQWaveFile_Open(&source->mWave, path))
+		{
+			fprintf(stderr, "Could not open %s as WAVE\n", path);
+			return false;
+		}
+		
+		source->mConvertKernel = AQSampleConvert_SelectKernel(&source->mWave.mLayout);
+		source->mRawBytesPerFrame = source->mWave.mBytesPerFrame;
+		source->mSampleRate = source->mWave.mSampleRate;
+		source->mNumFileChannels = source->mWave.mLayout.mNumChannels;
+	}
+	
+	if (source->mNumFileChannels > kAQChannelMapMaxChannels || !(source->mConvertKernel || source->mVorbis || source->mAAC || source->mFLAC))
+	{
+		fprintf(stderr, "Unsupported layout in %s\n", path);
+		AQRenderSource_Close(source);
+		return false;
+	}
+	
+	if (numChannels == 0)
+	{
+		numChannels = source->mNumFileChannels <= 2 ? source->mNumFileChannels : 2;
+	}
+	
+	source->mNumChannels = numChannels;
+	AQChannelMap_Init(&source->mChannelMap, source->mNumFileChannels, numChannels);
+	
+	return true;
+}
+
+// Frames in a file that can decode in chunks, those of an AAC or FLAC file once they are indexed
+static
+UInt64 AQRenderSource_NumFrames(const struct AQRenderSource * source)
+{
+	if (source->mAAC)
+	{
+		return AQAACFile_GetInfo(source->mAAC)->mNumFrames;
+	}
+	
+	if (source->mFLAC)
+	{
+		return AQFLACFile_GetInfo(source->mFLAC)->mNumFrames;
+	}
+	
+	if (source->mBlockFile)
+	{
+		return AQBlockFile_GetInfo(source->mBlockFile)->mNumFrames;
+	}
+	
+	return source->mWave.mNumFrames;
+}
+
+// Reads, converts and maps numFrames from firstFrame into out, through raw and decoded
+// scratch big enough for numFrames (decoded is unused when the map is the identity).
+// Safe to call from several threads at once for WAVE files, and for AAC, FLAC and
+// block files when mIsParallel is set; otherwise files decode in order, firstFrame always
+// being the frame after the previous call's.
+static
+UInt32 AQRenderSource_Decode(const struct AQRenderSource * source,
+							 UInt64 firstFrame,
+							 UInt32 numFrames,
+							 UInt8 * raw,
+							 Float32 * decoded,
+							 Float32 * out)
+{
+	Float32 * pcm = source->mChannelMap.mIsIdentity ? out : decoded;
+	
+	if (source->mVorbis)
+	{
+		AQ_TRACE_SCOPE("decode", numFrames);
+		
+		numFrames = AQVorbisFile_Read(source->mVorbis, pcm, numFrames);
+	}
+	else if (source->mAAC)
+	{
+		AQ_TRACE_SCOPE("decode", numFrames);
+		
+		numFrames = source->mIsParallel ? AQAACFile_ReadAt(source->mAAC, firstFrame, pcm, numFrames)
+										: AQAACFile_Read(source->mAAC, pcm, numFrames);
+	}
+	else if (source->mFLAC)
+	{
+		AQ_TRACE_SCOPE("decode", numFrames);
+		
+		numFrames = source->mIsParallel ? AQFLACFile_ReadAt(source->mFLAC, firstFrame, pcm, numFrames)
+										: AQFLACFile_Read(source->mFLAC, pcm, numFrames);
+	}
+	else
+	{
+		{
+			AQ_TRACE_SCOPE("read", numFrames);
+			
+			if (!source->mBlockFile)
+			{
+				numFrames = AQWaveFile_ReadAt(&source->mWave, firstFrame, raw, numFrames);
+			}
+			else if (source->mIsParallel)
+			{
+				numFrames = AQBlockFile_ReadAt(source->mBlockFile, firstFrame, raw, numFrames);
+			}
+			else
+			{
+				numFrames = AQBlockFile_Read(source->mBlockFile, raw, numFrames);
+			}
+		}
+		
+		AQ_TRACE_SCOPE("convert", numFrames);
+		
+		source->mConvertKernel(raw, pcm, numFrames, source->mNumFileChannels);
+	}
+	
+	if (!source->mChannelMap.mIsIdentity)
+	{
+		AQ_TRACE_SCOPE("convert", numFrames);
+		
+		AQChannelMap_Apply(&source->mChannelMap, decoded, out, numFrames);
+	}
+	
+	return numFrames;
+}
+
+// AQChunkDecodeFunction, with scratch of its own for each chunk
+static
+UInt32 AQRenderSource_DecodeChunk(void * context, UInt64 firstFrame, UInt32 numFrames, Float32 * out)
+{
+	const struct AQRenderSource * source = (const struct AQRenderSource *) context;
+	UInt8 * raw = (UInt8 *) malloc((size_t) numFrames * source->mRawBytesPerFrame);
+	Float32 * decoded = (Float32 *) malloc((size_t) numFrames * source->mNumFileChannels * sizeof(Float32));
+	
+	numFrames = AQRenderSource_Decode(source, firstFrame, numFrames, raw, decoded, out);
+	
+	free(raw);
+	free(decoded);
+	
+	return numFrames;
+}
+
+/* Description:
+ * The stages after decoding, which carry state from one block to the next and
+ * so see the blocks in order on one thread.
+ */
+struct AQRenderSink
+{
+	const struct AQRenderOptions * mOptions;
+	struct AQEqualizer mEqualizer;
+	struct AQPeaksBuilder mPeaks;
+	
+	/* Description:
+	 * Where the rendered frames go, mBlockOutput when the output is a block file.
+	 */
+	struct AQWaveFile mOutput;
+	struct AQBlockFileWriter * mBlockOutput;
+	
+	UInt64 mNumFramesRendered;
+	bool mIsOK;
+};
+
+static
+void AQRenderSink_Process(struct AQRenderSink * sink, Float32 * samples, UInt32 numFrames)
+{
+	AQ_TRACE_SCOPE("fill", sink->mNumFramesRendered);
+	
+	AQEqualizer_Process(&sink->mEqualizer, samples, numFrames);
+	
+	if (sink->mOptions->mPeaksPath)
+	{
+		AQPeaksBuilder_AddFrames(&sink->mPeaks, samples, numFrames);
+	}
+	
+	if (sink->mOptions->mOutputPath)
+	{
+		AQ_TRACE_SCOPE("write", numFrames);
+		
+		if (sink->mBlockOutput)
+		{
+			sink->mIsOK = AQBlockFileWriter_Write(sink->mBlockOutput, samples, numFrames) && sink->mIsOK;
+		}
+		else
+		{
+			sink->mIsOK = AQWaveFile_Write(&sink->mOutput, samples, numFrames) && sink->mIsOK;
+		}
+	}
+	
+	sink->mNumFramesRendered += numFrames;
+}
+
+static
+void AQRender_Sequential(struct AQRenderSource * source, struct AQRenderSink * sink)
+{
+	UInt8 * raw = (UInt8 *) malloc(kNumFramesPerRender * source->mRawBytesPerFrame);
+	Float32 * decoded = (Float32 *) malloc(kNumFramesPerRender * source->mNumFileChannels * sizeof(Float32));
+	Float32 * samples = (Float32 *) malloc(kNumFramesPerRender * source->mNumChannels * sizeof(Float32));
+	UInt32 numFrames;
+	
+	while (sink->mIsOK &&
+		   (numFrames = AQRenderSource_Decode(source, sink->mNumFramesRendered, kNumFramesPerRender, raw, decoded, samples)) > 0)
+	{
+		AQRenderSink_Process(sink, samples, numFrames);
+	}
+	
+	free(raw);
+	free(decoded);
+	free(samples);
+}
+
+// Decodes chunks on the pool, ahead of the sink taking them in order
+static
+void AQRender_Parallel(struct AQRenderSource * source, struct AQRenderSink * sink, struct AQThreadPool * pool)
+{
+	struct AQChunkedDecoder * decoder = AQChunkedDecoder_Create(pool,
+																AQRenderSource_DecodeChunk,
+																source,
+																AQRenderSource_NumFrames(source),
+																source->mNumChannels,
+																kNumFramesPerChunk,
+																0);
+	const Float32 * chunk;
+	UInt32 numFrames;
+	UInt32 k;
+	
+	while (sink->mIsOK && (chunk = AQChunkedDecoder_Next(decoder, &numFrames)) != NULL)
+	{
+		// In the same blocks as a sequential render, so that the equalizer's ramps match.
+		// The chunk stays ours until the next call, the in-place stages may write to it.
+		for (k = 0; k < numFrames; k += kNumFramesPerRender)
+		{
+			Float32 * block = (Float32 *) chunk + (size_t) k * source->mNumChannels;
+			
+			AQRenderSink_Process(sink, block, numFrames - k < kNumFramesPerRender ? numFrames - k : kNumFramesPerRender);
+		}
+	}
+	
+	AQChunkedDecoder_Dispose(decoder);
+}
+
+static
+bool AQRender_Run(const char inputPath[], const struct AQRenderOptions * options, struct AQThreadPool * pool)
+{
+	struct AQRenderSource source;
+	struct AQRenderSink sink;
+	
+	if (!AQRenderSource_Open(&source, inputPath, options->mNumOutputChannels))
+	{
+		return false;
+	}
+	
+	Float64 sampleRate = source.mSampleRate;
+	UInt32 k;
+	
+	for (k = 0; k < options->mNumEqualizerBands; k++)
+	{
+		if (!AQBiquad_IsBandValid(&options->mEqualizerBands[k], sampleRate))
+		{
+			fprintf(stderr, "Equalizer band %u is at or above Nyquist for %g Hz\n", (unsigned) k + 1, sampleRate);
+			AQRenderSource_Close(&source);
+			return false;
+		}
+	}
+	
+	sink.mOptions = options;
+	sink.mBlockOutput = NULL;
+	sink.mNumFramesRendered = 0;
+	sink.mIsOK = true;
+	
+	if (options->mOutputPath && AQBlockFile_IsBlockFilePath(options->mOutputPath))
+	{
+		sink.mBlockOutput = AQBlockFileWriter_Create(options->mOutputPath,
+													 sampleRate,
+													 source.mNumChannels,
+													 options->mBlockType,
+													 0,
+													 options->mBlockCodec,
+													 true);
+		sink.mIsOK = sink.mBlockOutput != NULL;
+	}
+	else if (options->mOutputPath)
+	{
+		sink.mIsOK = AQWaveFile_Create(&sink.mOutput, options->mOutputPath, sampleRate, source.mNumChannels);
+	}
+	
+	if (!sink.mIsOK)
+	{
+		fprintf(stderr, "Could not create %s\n", options->mOutputPath);
+		AQRenderSource_Close(&source);
+		return false;
+	}
+	
+	AQEqualizer_Init(&sink.mEqualizer, source.mNumChannels, sampleRate);
+	AQEqualizer_SetBands(&sink.mEqualizer, options->mEqualizerBands, options->mNumEqualizerBands);
+	
+	if (options->mPeaksPath)
+	{
+		AQPeaksBuilder_Init(&sink.mPeaks, source.mNumChannels, sampleRate);
+	}
+	
+	Float64 startSeconds = AQRender_Now();
+	
+	// FLAC frames decode independently once they have been found, AAC packets with the one before
+	source.mIsParallel = pool && !source.mVorbis &&
+						 (!source.mFLAC || AQFLACFile_IndexFrames(source.mFLAC)) &&
+						 (!source.mAAC || AQAACFile_IndexFrames(source.mAAC));
+	
+	if (source.mIsParallel)
+	{
+		AQRender_Parallel(&source, &sink, pool);
+	}
+	else
+	{
+		AQRender_Sequential(&source, &sink);
+	}
+	
+	Float64 elapsedSeconds = AQRender_Now() - startSeconds;
+	bool ok = sink.mIsOK;
+	
+	printf("Rendered %llu frames of %s in %.3f s, %.1fx realtime\n",
+		   (unsigned long long) sink.mNumFramesRendered,
+		   inputPath,
+		   elapsedSeconds,
+		   elapsedSeconds > 0 ? sink.mNumFramesRendered / sampleRate / elapsedSeconds : 0.0);
+	
+	if (sink.mBlockOutput ? !AQBlockFileWriter_Close(sink.mBlockOutput) : options->mOutputPath && !AQWaveFile_Close(&sink.mOutput))
+	{
+		fprintf(stderr, "Could not write %s\n", options->mOutputPath);
+		ok = false;
+	}
+	
+	if (options->mPeaksPath)
+	{
+		if (!AQPeaksBuilder_Write(&sink.mPeaks, options->mPeaksPath))
+		{
+			fprintf(stderr, "Could not write peaks to %s\n", options->mPeaksPath);
+			ok = false;
+		}
+		
+		AQPeaksBuilder_CleanUp(&sink.mPeaks);
+	}
+	
+	AQRenderSource_Close(&source);
+	
+	return ok;
+}
+
+// Options, each of which takes a value
+static const char * const kOptionNames[] = { "--eq", "--channels", "--peaks", "--out", "--block-type", "--block-codec", "--threads", "--trace" };
+
+static
+bool AQRender_IsOption(const char arg[])
+{
+	UInt32 k;
+	
+	for (k = 0; k < sizeof(kOptionNames) / sizeof(kOptionNames[0]); k++)
+	{
+		if (strcmp(arg, kOptionNames[k]) == 0)
+		{
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static
+void AQRender_PrintUsage(FILE * file)
+{
+	fprintf(file, "Usage: AQRender [--eq type:frequency:q:gain ...] [--channels n] [--peaks sidecar] [--out file.wav|file.aqb] [--block-type s16|s24|s32|f32] [--block-codec none|lz4|lossless] [--threads n] [--trace json] [--] file.wav|file.ogg|file.aac|file.flac|file.aqb ...\n");
+}
+
+int main(int argc, const char * argv[])
+{
+	struct AQRenderOptions options;
+	const char ** paths = (const char **) malloc(argc * sizeof(const char *));
+	bool isOption = true;
+	UInt32 numPaths = 0;
+	int argIndex;
+	UInt32 k;
+	
+	memset(&options, 0, sizeof(options));
+	options.mNumThreads = 1;
+	options.mBlockType = kAQSampleType_Float32;
+	options.mBlockCodec = kAQBlockCodec_None;
+	
+	// Options go before or after the files; anything starting with a dash is one, up
+	// to a "--" that ends them
+	for (argIndex = 1; argIndex < argc; argIndex++)
+	{
+		const char * arg = argv[argIndex];
+		
+		if (!isOption || arg[0] != '-' || arg[1] == '\0')
+		{
+			paths[numPaths++] = arg;
+			continue;
+		}
+		
+		if (strcmp(arg, "--") == 0)
+		{
+			isOption = false;
+			continue;
+		}
+		
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+		{
+			AQRender_PrintUsage(stdout);
+			free(paths);
+			return 0;
+		}
+		
+		if (!AQRender_IsOption(arg))
+		{
+			fprintf(stderr, "Unknown option: %s\n", arg);
+			AQRender_PrintUsage(stderr);
+			free(paths);
+			return 1;
+		}
+		
+		if (argIndex + 1 == argc)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg);
+			AQRender_PrintUsage(stderr);
+			free(paths);
+			return 1;
+		}
+		
+		const char * value = argv[++argIndex];
+		
+		if (strcmp(arg, "--eq") == 0)
+		{
+			if (options.mNumEqualizerBands == kAQEqualizerMaxBands ||
+				!AQBiquad_ParseBand(value, 0.0, &options.mEqualizerBands[options.mNumEqualizerBands]))
+			{
+				fprintf(stderr, "Bad equalizer band: %s\n", value);
+				free(paths);
+				return 1;
+			}
+			
+			options.mNumEqualizerBands++;
+		}
+		else if (strcmp(arg, "--channels") == 0)
+		{
+			options.mNumOutputChannels = atoi(value);
+			
+			if (options.mNumOutputChannels < 1 || options.mNumOutputChannels > kAQChannelMapMaxChannels)
+			{
+				fprintf(stderr, "Bad channel count: %s\n", value);
+				free(paths);
+				return 1;
+			}
+		}
+		else if (strcmp(arg, "--peaks") == 0)
+		{
+			options.mPeaksPath = value;
+		}
+		else if (strcmp(arg, "--out") == 0)
+		{
+			options.mOutputPath = value;
+		}
+		else if (strcmp(arg, "--block-type") == 0)
+		{
+			if (strcmp(value, "s16") == 0)      options.mBlockType = kAQSampleType_SInt16;
+			else if (strcmp(value, "s24") == 0) options.mBlockType = kAQSampleType_SInt24;
+			else if (strcmp(value, "s32") == 0) options.mBlockType = kAQSampleType_SInt32;
+			else if (strcmp(value, "f32") == 0) options.mBlockType = kAQSampleType_Float32;
+			else
+			{
+				fprintf(stderr, "Bad block sample type: %s\n", value);
+				free(paths);
+				return 1;
+			}
+		}
+		else if (strcmp(arg, "--block-codec") == 0)
+		{
+			if (strcmp(value, "none") == 0)          options.mBlockCodec = kAQBlockCodec_None;
+			else if (strcmp(value, "lz4") == 0)      options.mBlockCodec = kAQBlockCodec_LZ4;
+			else if (strcmp(value, "lossless") == 0) options.mBlockCodec = kAQBlockCodec_Lossless;
+			else
+			{
+				fprintf(stderr, "Bad block codec: %s\n", value);
+				free(paths);
+				return 1;
+			}
+		}
+		else if (strcmp(arg, "--threads") == 0)
+		{
+			options.mNumThreads = atoi(value);
+		}
+		else
+		{
+			options.mTracePath = value;
+		}
+	}
+	
+	if (numPaths == 0 || ((options.mOutputPath || options.mPeaksPath) && numPaths != 1))
+	{
+		AQRender_PrintUsage(stderr);
+		free(paths);
+		return 1;
+	}
+	
+	if (options.mTracePath)
+	{
+		AQTrace_Enable(kAQTraceDefaultEventsPerThread);
+		AQTrace_SetThreadName("render");
+	}
+	
+	struct AQThreadPool * pool = options.mNumThreads != 1 ? AQThreadPool_Create(options.mNumThreads) : NULL;
+	bool ok = true;
+	
+	for (k = 0; k < numPaths; k++)
+	{
+		ok = AQRender_Run(paths[k], &options, pool) && ok;
+	}
+	
+	if (pool)
+	{
+		AQThreadPool_Dispose(pool);
+	}
+	
+	if (options.mTracePath)
+	{
+		AQTrace_Disable();
+		
+		if (!AQTrace_WriteChromeJSON(options.mTracePath))
+		{
+			fprintf(stderr, "Could not write trace to %s\n", options.mTracePath);
+		}
+	}
+	
+	free(paths);
+	
+	return ok ? 0 : 1;
+}
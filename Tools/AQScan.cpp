@@ -0,0 +1,1163 @@
+//
+//  AQScan.cpp
+//  PlayingAudioExample
+//
+
+/* Catalog scanner: walks directory trees on a pool of threads and writes a
+ * manifest of every audio file in them, one row per file and one tab
+ * separated column per field:
+ *
+ *   path  size  mtime  format  rate  channels  bits  frames  duration  max_packet  peak_dbfs  loudness_lufs
+ *
+ * Usage: AQScan [--threads n] [--measure none|peak|loudness] [--previous manifest.tsv]
+ *               [--out manifest.tsv] [--trace json] [--] dir|file ...
+ *
+ * Options may come before or after the paths. --help prints the usage, and
+ * any other argument starting with a dash that is not an option is an error,
+ * so a mistyped option is never scanned as a path; paths that start with a
+ * dash go after --.
+ *
+ * Files are found by extension and read with the same decoders as AQRender:
+ * WAVE, Ogg Vorbis, ADTS AAC, FLAC and block files. Every directory is a task
+ * of its own, which reads its entries and stats the files relative to the open
+ * directory, and the files go on to be scanned in batches of kFilesPerBatch.
+ * Names starting with a dot are skipped, and symbolic links are only followed
+ * to files.
+ * The format, rate, channels, length and largest packet come from the headers;
+ * files are only decoded for --measure (loudness by default, BS.1770 integrated
+ * loudness and sample peak), or for an Ogg file whose length is not in its last
+ * page. --measure none scans a catalog without decoding anything.
+ *
+ * With --previous, files whose path, size and modification time match a row
+ * of an earlier manifest that measured at least as much are not opened at all;
+ * their row is carried over. The manifest is sorted by path and goes to --out,
+ * or to stdout. Files that cannot be read are reported and left out, and the
+ * exit status tells whether there were any.
+ */
+
+#include <condition_variable>
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "AQAAC.h"
+#include "AQBlockFile.h"
+#include "AQFLAC.h"
+#include "AQLoudness.h"
+#include "AQSampleConvert.h"
+#include "AQThreadPool.h"
+#include "AQTrace.h"
+#include "AQVorbis.h"
+#include "AQWaveFile.h"
+
+// Files scanned per task, enough to make a task worth handing to a thread
+static const UInt32 kFilesPerBatch = 32;
+
+// Frames decoded per read when measuring
+static const UInt32 kNumFramesPerRead = 4096;
+
+static const char kManifestHeader[] = "path\tsize\tmtime\tformat\trate\tchannels\tbits\tframes\tduration\tmax_packet\tpeak_dbfs\tloudness_lufs\n";
+
+enum AQScanMeasure
+{
+	kAQScanMeasure_None,
+	kAQScanMeasure_Peak,
+	kAQScanMeasure_Loudness
+};
+
+struct AQScanOptions
+{
+	/* Description:
+	 * Threads walking and scanning, 0 for one per core.
+	 */
+	UInt32 mNumThreads;
+	AQScanMeasure mMeasure;
+	
+	const char * mPreviousPath;
+	const char * mOutputPath;
+	const char * mTracePath;
+};
+
+/* Description:
+ * One file, and one row of the manifest.
+ */
+struct AQScanEntry
+{
+	char * mPath;
+	UInt64 mFileSize;
+	SInt64 mModifiedSeconds;
+	UInt32 mModifiedNanoseconds;
+	
+	/* Description:
+	 * From the header. mFormat is one of kFormatNames; mBitsPerSample and
+	 * mMaxPacketSize are 0 when the format does not say.
+	 */
+	const char * mFormat;
+	Float64 mSampleRate;
+	UInt32 mNumChannels;
+	UInt32 mBitsPerSample;
+	UInt64 mNumFrames;
+	UInt32 mMaxPacketSize;
+	
+	/* Description:
+	 * What --measure asked for, in dBFS and LUFS, NAN when it was not measured
+	 * and -HUGE_VAL for silence.
+	 */
+	Float64 mPeak;
+	Float64 mLoudness;
+	
+	bool mIsOK;
+};
+
+static const char * const kFormatNames[] = { "wave", "vorbis", "aac", "flac", "aqb" };
+
+struct AQScanBatch
+{
+	struct AQScan * mScan;
+	struct AQScanEntry mEntries[kFilesPerBatch];
+	UInt32 mNumEntries;
+	
+	/* Description:
+	 * The next scanned batch, once this one is done.
+	 */
+	struct AQScanBatch * mNext;
+};
+
+struct AQScanDirectory
+{
+	struct AQScan * mScan;
+	char * mPath;
+};
+
+struct AQScan
+{
+	const struct AQScanOptions * mOptions;
+	struct AQThreadPool * mPool;
+	
+	/* Description:
+	 * Rows of the --previous manifest sorted by path, read only once the scan starts.
+	 */
+	struct AQScanEntry * mPrevious;
+	UInt64 mNumPrevious;
+	
+	/* Description:
+	 * Tasks submitted and not yet finished; the scan is over when it drops to 0.
+	 */
+	std::mutex mMutex;
+	std::condition_variable mIdle;
+	UInt64 mNumPending;
+	
+	/* Description:
+	 * Everything below is guarded by mMutex.
+	 */
+	struct AQScanBatch * mBatches;
+	UInt64 mNumScanned;
+	UInt64 mNumReused;
+	UInt64 mNumFailed;
+};
+
+static
+Float64 AQScan_Now()
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static
+void AQScanEntry_SetStatus(struct AQScanEntry * entry, const struct stat * status)
+{
+	entry->mFileSize = (UInt64) status->st_size;
+
+#ifdef __APPLE__
+	entry->mModifiedSeconds = (SInt64) status->st_mtimespec.tv_sec;
+	entry->mModifiedNanoseconds = (UInt32) status->st_mtimespec.tv_nsec;
+#else
+	entry->mModifiedSeconds = (SInt64) status->st_mtim.tv_sec;
+	entry->mModifiedNanoseconds = (UInt32) status->st_mtim.tv_nsec;
+#endif
+}
+
+static
+int AQScanEntry_ComparePaths(const void * a, const void * b)
+{
+	return strcmp(((const struct AQScanEntry *) a)->mPath, ((const struct AQScanEntry *) b)->mPath);
+}
+
+static
+bool AQScan_IsAudioPath(const char path[])
+{
+	static const char * const kExtensions[] = { ".wav", ".wave", ".ogg", ".aac", ".flac", kAQBlockFileExtension };
+	const char * extension = strrchr(path, '.');
+	UInt32 k;
+	
+	for (k = 0; extension && k < sizeof(kExtensions) / sizeof(kExtensions[0]); k++)
+	{
+		if (strcasecmp(extension, kExtensions[k]) == 0)
+		{
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static
+char * AQScan_JoinPath(const char directory[], const char name[])
+{
+	size_t directoryLength = strlen(directory);
+	size_t nameLength = strlen(name);
+	char * path = (char *) malloc(directoryLength + nameLength + 2);
+	
+	memcpy(path, directory, directoryLength);
+	
+	if (directoryLength == 0 || directory[directoryLength - 1] != '/')
+	{
+		path[directoryLength++] = '/';
+	}
+	
+	memcpy(path + directoryLength, name, nameLength + 1);
+	
+	return path;
+}
+
+static
+void AQScan_Submit(struct AQScan * scan, AQTaskFunction function, void * arg)
+{
+	{
+		std::lock_guard<std::mutex> lock(scan->mMutex);
+		scan->mNumPending++;
+	}
+	
+	AQThreadPool_Submit(scan->mPool, function, arg);
+}
+
+static
+void AQScan_FinishTask(struct AQScan * scan)
+{
+	std::lock_guard<std::mutex> lock(scan->mMutex);
+	
+	if (--scan->mNumPending == 0)
+	{
+		scan->mIdle.notify_all();
+	}
+}
+
+static
+void AQScan_CountFailure(struct AQScan * scan)
+{
+	std::lock_guard<std::mutex> lock(scan->mMutex);
+	scan->mNumFailed++;
+}
+
+/* Description:
+ * A file opened for scanning: either mWave or mBlockFile, whose raw frames
+ * mConvertKernel turns to float, or mVorbis, mAAC or mFLAC.
+ */
+struct AQScanSource
+{
+	struct AQWaveFile mWave;
+	struct AQBlockFile * mBlockFile;
+	AQSampleConvertKernel mConvertKernel;
+	UInt32 mRawBytesPerFrame;
+	struct AQVorbisFile * mVorbis;
+	struct AQAACFile * mAAC;
+	struct AQFLACFile * mFLAC;
+	
+	UInt32 mNumChannels;
+};
+
+static
+void AQScanSource_Close(struct AQScanSource * source)
+{
+	if (source->mVorbis)
+	{
+		AQVorbisFile_Close(source->mVorbis);
+	}
+	else if (source->mAAC)
+	{
+		AQAACFile_Close(source->mAAC);
+	}
+	else if (source->mFLAC)
+	{
+		AQFLACFile_Close(source->mFLAC);
+	}
+	else if (source->mBlockFile)
+	{
+		AQBlockFile_Close(source->mBlockFile);
+	}
+	else
+	{
+		AQWaveFile_Close(&source->mWave);
+	}
+}
+
+// Opens entry's file and fills in what its header says
+static
+bool AQScanSource_Open(struct AQScanSource * source, struct AQScanEntry * entry)
+{
+	const char * extension = strrchr(entry->mPath, '.');
+	
+	memset(source, 0, sizeof(struct AQScanSource));
+	
+	if (!extension)
+	{
+		extension = "";
+	}
+	
+	if (strcasecmp(extension, ".ogg") == 0)
+	{
+		if (!(source->mVorbis = AQVorbisFile_Open(entry->mPath)))
+		{
+			return false;
+		}
+		
+		const struct AQVorbisInfo * info = AQVorbisFile_GetInfo(source->mVorbis);
+		
+		entry->mFormat = kFormatNames[1];
+		entry->mSampleRate = info->mSampleRate;
+		entry->mNumChannels = info->mNumChannels;
+		entry->mNumFrames = info->mNumFrames;
+	}
+	else if (strcasecmp(extension, ".aac") == 0)
+	{
+		if (!(source->mAAC = AQAACFile_Open(entry->mPath)))
+		{
+			return false;
+		}
+		
+		const struct AQAACInfo * info = AQAACFile_GetInfo(source->mAAC);
+		
+		entry->mFormat = kFormatNames[2];
+		entry->mSampleRate = info->mSampleRate;
+		entry->mNumChannels = info->mNumChannels;
+		entry->mNumFrames = info->mNumFrames;
+		entry->mMaxPacketSize = info->mMaxPacketSize;
+	}
+	else if (strcasecmp(extension, ".flac") == 0)
+	{
+		if (!(source->mFLAC = AQFLACFile_Open(entry->mPath)))
+		{
+			return false;
+		}
+		
+		// Finding the frames reads the file but decodes none of it
+		if (AQFLACFile_GetInfo(source->mFLAC)->mNumFrames == 0)
+		{
+			AQFLACFile_IndexFrames(source->mFLAC);
+		}
+		
+		const struct AQFLACInfo * info = AQFLACFile_GetInfo(source->mFLAC);
+		
+		entry->mFormat = kFormatNames[3];
+		entry->mSampleRate = info->mSampleRate;
+		entry->mNumChannels = info->mNumChannels;
+		entry->mBitsPerSample = info->mBitsPerSample;
+		entry->mNumFrames = info->mNumFrames;
+		entry->mMaxPacketSize = info->mMaxPacketSize;
+	}
+	else if (AQBlockFile_IsBlockFilePath(entry->mPath))
+	{
+		if (!(source->mBlockFile = AQBlockFile_Open(entry->mPath)))
+		{
+			return false;
+		}
+		
+		const struct AQBlockFileInfo * info = AQBlockFile_GetInfo(source->mBlockFile);
+		
+		source->mConvertKernel = AQSampleConvert_SelectKernel(&info->mLayout);
+		source->mRawBytesPerFrame = info->mBytesPerFrame;
+		
+		// A block is the unit read, however it is compressed
+		entry->mFormat = kFormatNames[4];
+		entry->mSampleRate = info->mSampleRate;
+		entry->mNumChannels = info->mLayout.mNumChannels;
+		entry->mBitsPerSample = 8 * AQSampleConvert_BytesPerSample(info->mLayout.mType);
+		entry->mNumFrames = info->mNumFrames;
+		entry->mMaxPacketSize = info->mFramesPerBlock * info->mBytesPerFrame;
+	}
+	else
+	{
+		if (!AQWaveFile_Open(&source->mWave, entry->mPath))
+		{
+			return false;
+		}
+		
+		source->mConvertKernel = AQSampleConvert_SelectKernel(&source->mWave.mLayout);
+		source->mRawBytesPerFrame = source->mWave.mBytesPerFrame;
+		
+		// One frame per packet, as AudioFile has it for linear PCM
+		entry->mFormat = kFormatNames[0];
+		entry->mSampleRate = source->mWave.mSampleRate;
+		entry->mNumChannels = source->mWave.mLayout.mNumChannels;
+		entry->mBitsPerSample = 8 * AQSampleConvert_BytesPerSample(source->mWave.mLayout.mType);
+		entry->mNumFrames = source->mWave.mNumFrames;
+		entry->mMaxPacketSize = source->mWave.mBytesPerFrame;
+	}
+	
+	source->mNumChannels = entry->mNumChannels;
+	
+	if (entry->mNumChannels == 0 || !(source->mConvertKernel || source->mVorbis || source->mAAC || source->mFLAC))
+	{
+		AQScanSource_Close(source);
+		return false;
+	}
+	
+	return true;
+}
+
+// Decodes up to numFrames interleaved float frames into out, through raw scratch for PCM
+static
+UInt32 AQScanSource_Read(struct AQScanSource * source, UInt8 * raw, Float32 * out, UInt32 numFrames)
+{
+	AQ_TRACE_SCOPE("decode", numFrames);
+	
+	if (source->mVorbis)
+	{
+		return AQVorbisFile_Read(source->mVorbis, out, numFrames);
+	}
+	
+	if (source->mAAC)
+	{
+		return AQAACFile_Read(source->mAAC, out, numFrames);
+	}
+	
+	if (source->mFLAC)
+	{
+		return AQFLACFile_Read(source->mFLAC, out, numFrames);
+	}
+	
+	numFrames = source->mBlockFile ? AQBlockFile_Read(source->mBlockFile, raw, numFrames)
+								   : AQWaveFile_Read(&source->mWave, raw, numFrames);
+	
+	source->mConvertKernel(raw, out, numFrames, source->mNumChannels);
+	
+	return numFrames;
+}
+
+static
+Float32 AQScan_Peak(const Float32 * samples, size_t numSamples, Float32 peak)
+{
+	size_t k;
+	
+	for (k = 0; k < numSamples; k++)
+	{
+		Float32 magnitude = fabsf(samples[k]);
+		
+		peak = magnitude > peak ? magnitude : peak;
+	}
+	
+	return peak;
+}
+
+// Fills in entry from its file, decoding it only when the measure or its length needs it
+static
+bool AQScan_ScanFile(const struct AQScanOptions * options, struct AQScanEntry * entry)
+{
+	AQ_TRACE_SCOPE("scan", entry->mFileSize);
+	
+	struct AQScanSource source;
+	AQScanMeasure measure = options->mMeasure;
+	
+	entry->mPeak = NAN;
+	entry->mLoudness = NAN;
+	
+	if (!AQScanSource_Open(&source, entry))
+	{
+		return false;
+	}
+	
+	// Vorbis files that end without a granule position only tell their length by decoding
+	bool needsLength = source.mVorbis && entry->mNumFrames == 0;
+	
+	if (measure == kAQScanMeasure_Loudness && entry->mNumChannels > kAQLoudnessMaxChannels)
+	{
+		measure = kAQScanMeasure_Peak;
+	}
+	
+	if (measure != kAQScanMeasure_None || needsLength)
+	{
+		UInt8 * raw = (UInt8 *) malloc((size_t) kNumFramesPerRead * source.mRawBytesPerFrame);
+		Float32 * samples = (Float32 *) malloc((size_t) kNumFramesPerRead * entry->mNumChannels * sizeof(Float32));
+		struct AQLoudnessMeter meter;
+		UInt64 numFramesDecoded = 0;
+		Float32 peak = 0.f;
+		UInt32 numFrames;
+		
+		if (measure == kAQScanMeasure_Loudness)
+		{
+			AQLoudnessMeter_Init(&meter, entry->mNumChannels, entry->mSampleRate);
+		}
+		
+		while ((numFrames = AQScanSource_Read(&source, raw, samples, kNumFramesPerRead)) > 0)
+		{
+			if (measure == kAQScanMeasure_Loudness)
+			{
+				AQLoudnessMeter_AddFrames(&meter, samples, numFrames);
+			}
+			else if (measure == kAQScanMeasure_Peak)
+			{
+				peak = AQScan_Peak(samples, (size_t) numFrames * entry->mNumChannels, peak);
+			}
+			
+			numFramesDecoded += numFrames;
+		}
+		
+		if (measure == kAQScanMeasure_Loudness)
+		{
+			entry->mPeak = AQLoudnessMeter_GetPeak(&meter);
+			entry->mLoudness = AQLoudnessMeter_GetIntegrated(&meter);
+			AQLoudnessMeter_CleanUp(&meter);
+		}
+		else if (measure == kAQScanMeasure_Peak)
+		{
+			entry->mPeak = peak > 0.f ? 20.0 * log10(peak) : -HUGE_VAL;
+		}
+		
+		if (needsLength)
+		{
+			entry->mNumFrames = numFramesDecoded;
+		}
+		
+		free(raw);
+		free(samples);
+	}
+	
+	AQScanSource_Close(&source);
+	
+	return true;
+}
+
+// Whether previous is entry's file as it is now, with everything options measure
+static
+bool AQScan_CanReuse(const struct AQScanOptions * options, const struct AQScanEntry * previous, const struct AQScanEntry * entry)
+{
+	if (previous->mFileSize != entry->mFileSize ||
+		previous->mModifiedSeconds != entry->mModifiedSeconds ||
+		previous->mModifiedNanoseconds != entry->mModifiedNanoseconds)
+	{
+		return false;
+	}
+	
+	switch (options->mMeasure)
+	{
+		case kAQScanMeasure_Loudness:
+			// Files with too many channels for the meter only ever have a peak
+			return !isnan(previous->mPeak) && (!isnan(previous->mLoudness) || previous->mNumChannels > kAQLoudnessMaxChannels);
+		case kAQScanMeasure_Peak:
+			return !isnan(previous->mPeak);
+		case kAQScanMeasure_None:
+		default:
+			return true;
+	}
+}
+
+static
+const struct AQScanEntry * AQScan_FindPrevious(const struct AQScan * scan, const char path[])
+{
+	struct AQScanEntry key;
+	
+	key.mPath = (char *) path;
+	
+	return (const struct AQScanEntry *) bsearch(&key, scan->mPrevious, scan->mNumPrevious, sizeof(struct AQScanEntry), AQScanEntry_ComparePaths);
+}
+
+// NAN for "-", the column of a value that was not measured
+static
+Float64 AQScan_ParseLevel(const char * field)
+{
+	return strcmp(field, "-") == 0 ? NAN : strtod(field, NULL);
+}
+
+// Splits a manifest row in place into entry, false if it is not one
+static
+bool AQScan_ParseRow(char * line, struct AQScanEntry * entry)
+{
+	char * fields[12];
+	UInt32 numFields = 0;
+	char * cursor = line;
+	UInt32 k;
+	
+	while (numFields < 12)
+	{
+		fields[numFields++] = cursor;
+		cursor = strchr(cursor, '\t');
+		
+		if (!cursor)
+		{
+			break;
+		}
+		
+		*cursor++ = '\0';
+	}
+	
+	if (numFields != 12 || cursor)
+	{
+		return false;
+	}
+	
+	memset(entry, 0, sizeof(struct AQScanEntry));
+	
+	for (k = 0; k < sizeof(kFormatNames) / sizeof(kFormatNames[0]); k++)
+	{
+		if (strcmp(fields[3], kFormatNames[k]) == 0)
+		{
+			entry->mFormat = kFormatNames[k];
+		}
+	}
+	
+	char * nanoseconds = strchr(fields[2], '.');
+	
+	entry->mPath = fields[0];
+	entry->mFileSize = strtoull(fields[1], NULL, 10);
+	entry->mModifiedSeconds = strtoll(fields[2], NULL, 10);
+	entry->mModifiedNanoseconds = nanoseconds ? (UInt32) strtoul(nanoseconds + 1, NULL, 10) : 0;
+	entry->mSampleRate = strtod(fields[4], NULL);
+	entry->mNumChannels = (UInt32) strtoul(fields[5], NULL, 10);
+	entry->mBitsPerSample = (UInt32) strtoul(fields[6], NULL, 10);
+	entry->mNumFrames = strtoull(fields[7], NULL, 10);
+	entry->mMaxPacketSize = (UInt32) strtoul(fields[9], NULL, 10);
+	entry->mPeak = AQScan_ParseLevel(fields[10]);
+	entry->mLoudness = AQScan_ParseLevel(fields[11]);
+	entry->mIsOK = true;
+	
+	return entry->mFormat != NULL;
+}
+
+// Loads the rows of an earlier manifest, their paths pointing into the returned text
+static
+char * AQScan_LoadPrevious(struct AQScan * scan, const char path[])
+{
+	FILE * file = fopen(path, "rb");
+	
+	if (!file)
+	{
+		return NULL;
+	}
+	
+	fseeko(file, 0, SEEK_END);
+	off_t size = ftello(file);
+	rewind(file);
+	
+	char * text = (char *) malloc((size_t) size + 1);
+	
+	if (size < 0 || fread(text, 1, (size_t) size, file) != (size_t) size)
+	{
+		fclose(file);
+		free(text);
+		return NULL;
+	}
+	
+	fclose(file);
+	text[size] = '\0';
+	
+	UInt64 numLines = 0;
+	char * line;
+	
+	for (line = text; (line = strchr(line, '\n')) != NULL; line++)
+	{
+		numLines++;
+	}
+	
+	scan->mPrevious = (struct AQScanEntry *) malloc((numLines + 1) * sizeof(struct AQScanEntry));
+	scan->mNumPrevious = 0;
+	
+	for (line = text; *line; )
+	{
+		char * end = strchr(line, '\n');
+		char * next = end ? end + 1 : line + strlen(line);
+		
+		if (end)
+		{
+			*end = '\0';
+		}
+		
+		if (AQScan_ParseRow(line, &scan->mPrevious[scan->mNumPrevious]))
+		{
+			scan->mNumPrevious++;
+		}
+		
+		line = next;
+	}
+	
+	qsort(scan->mPrevious, scan->mNumPrevious, sizeof(struct AQScanEntry), AQScanEntry_ComparePaths);
+	
+	return text;
+}
+
+static
+void AQScan_ScanBatch(void * arg)
+{
+	struct AQScanBatch * batch = (struct AQScanBatch *) arg;
+	struct AQScan * scan = batch->mScan;
+	UInt64 numReused = 0;
+	UInt64 numFailed = 0;
+	UInt32 k;
+	
+	for (k = 0; k < batch->mNumEntries; k++)
+	{
+		struct AQScanEntry * entry = &batch->mEntries[k];
+		const struct AQScanEntry * previous = scan->mNumPrevious ? AQScan_FindPrevious(scan, entry->mPath) : NULL;
+		
+		if (previous && AQScan_CanReuse(scan->mOptions, previous, entry))
+		{
+			char * path = entry->mPath;
+			
+			*entry = *previous;
+			entry->mPath = path;
+			numReused++;
+		}
+		else if (!(entry->mIsOK = AQScan_ScanFile(scan->mOptions, entry)))
+		{
+			fprintf(stderr, "Could not read %s\n", entry->mPath);
+			numFailed++;
+		}
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock(scan->mMutex);
+		
+		batch->mNext = scan->mBatches;
+		scan->mBatches = batch;
+		scan->mNumScanned += batch->mNumEntries;
+		scan->mNumReused += numReused;
+		scan->mNumFailed += numFailed;
+	}
+	
+	AQScan_FinishTask(scan);
+}
+
+// Adds a file to *batch, handing the batch to the pool once it is full. Takes path.
+static
+void AQScan_AddFile(struct AQScan * scan, struct AQScanBatch ** batch, char * path, const struct stat * status)
+{
+	// A row is one line of tab separated columns
+	if (strpbrk(path, "\t\n"))
+	{
+		fprintf(stderr, "Skipping %s, which has a tab or line break in its path\n", path);
+		free(path);
+		return;
+	}
+	
+	if (!*batch)
+	{
+		*batch = (struct AQScanBatch *) calloc(1, sizeof(struct AQScanBatch));
+		(*batch)->mScan = scan;
+	}
+	
+	struct AQScanEntry * entry = &(*batch)->mEntries[(*batch)->mNumEntries++];
+	
+	entry->mPath = path;
+	AQScanEntry_SetStatus(entry, status);
+	
+	if ((*batch)->mNumEntries == kFilesPerBatch)
+	{
+		AQScan_Submit(scan, AQScan_ScanBatch, *batch);
+		*batch = NULL;
+	}
+}
+
+static
+void AQScan_WalkDirectory(void * arg)
+{
+	AQ_TRACE_SCOPE("walk", 0);
+	
+	struct AQScanDirectory * directory = (struct AQScanDirectory *) arg;
+	struct AQScan * scan = directory->mScan;
+	struct AQScanBatch * batch = NULL;
+	DIR * dir = opendir(directory->mPath);
+	struct dirent * item;
+	
+	if (!dir)
+	{
+		fprintf(stderr, "Could not open directory %s\n", directory->mPath);
+		AQScan_CountFailure(scan);
+	}
+	
+	while (dir && (item = readdir(dir)) != NULL)
+	{
+		struct stat status;
+		
+		// Hidden files and directories, . and .. among them
+		if (item->d_name[0] == '.')
+		{
+			continue;
+		}
+		
+		bool isDirectory = item->d_type == DT_DIR;
+		
+		// The type from the directory saves a stat on everything but files of interest.
+		// Symbolic links are followed to files but not to directories, which could loop.
+		if (item->d_type == DT_UNKNOWN)
+		{
+			if (fstatat(dirfd(dir), item->d_name, &status, AT_SYMLINK_NOFOLLOW) != 0)
+			{
+				continue;
+			}
+			
+			isDirectory = S_ISDIR(status.st_mode);
+		}
+		
+		if (isDirectory)
+		{
+			struct AQScanDirectory * child = (struct AQScanDirectory *) malloc(sizeof(struct AQScanDirectory));
+			
+			child->mScan = scan;
+			child->mPath = AQScan_JoinPath(directory->mPath, item->d_name);
+			
+			AQScan_Submit(scan, AQScan_WalkDirectory, child);
+		}
+		else if (AQScan_IsAudioPath(item->d_name) &&
+				 fstatat(dirfd(dir), item->d_name, &status, 0) == 0 &&
+				 S_ISREG(status.st_mode))
+		{
+			AQScan_AddFile(scan, &batch, AQScan_JoinPath(directory->mPath, item->d_name), &status);
+		}
+	}
+	
+	if (batch)
+	{
+		AQScan_Submit(scan, AQScan_ScanBatch, batch);
+	}
+	
+	if (dir)
+	{
+		closedir(dir);
+	}
+	
+	free(directory->mPath);
+	free(directory);
+	
+	AQScan_FinishTask(scan);
+}
+
+static
+void AQScan_WriteLevel(FILE * file, Float64 level, char separator)
+{
+	if (isnan(level))
+	{
+		fprintf(file, "-%c", separator);
+	}
+	else if (isinf(level))
+	{
+		fprintf(file, "-inf%c", separator);
+	}
+	else
+	{
+		fprintf(file, "%.2f%c", level, separator);
+	}
+}
+
+static
+bool AQScan_WriteManifest(FILE * file, const struct AQScanEntry * entries, UInt64 numEntries)
+{
+	UInt64 k;
+	
+	fputs(kManifestHeader, file);
+	
+	for (k = 0; k < numEntries; k++)
+	{
+		const struct AQScanEntry * entry = &entries[k];
+		
+		fprintf(file, "%s\t%llu\t%lld.%09u\t%s\t%.0f\t%u\t%u\t%llu\t%.3f\t%u\t",
+				entry->mPath,
+				(unsigned long long) entry->mFileSize,
+				(long long) entry->mModifiedSeconds,
+				entry->mModifiedNanoseconds,
+				entry->mFormat,
+				entry->mSampleRate,
+				entry->mNumChannels,
+				entry->mBitsPerSample,
+				(unsigned long long) entry->mNumFrames,
+				entry->mSampleRate > 0 ? entry->mNumFrames / entry->mSampleRate : 0.0,
+				entry->mMaxPacketSize);
+		
+		AQScan_WriteLevel(file, entry->mPeak, '\t');
+		AQScan_WriteLevel(file, entry->mLoudness, '\n');
+	}
+	
+	return !ferror(file);
+}
+
+// Gathers the rows of every batch, sorted by path, and frees the batches
+static
+struct AQScanEntry * AQScan_CollectEntries(struct AQScan * scan, UInt64 * outNumEntries)
+{
+	struct AQScanEntry * entries = (struct AQScanEntry *) malloc((scan->mNumScanned + 1) * sizeof(struct AQScanEntry));
+	UInt64 numEntries = 0;
+	UInt32 k;
+	
+	while (scan->mBatches)
+	{
+		struct AQScanBatch * batch = scan->mBatches;
+		
+		for (k = 0; k < batch->mNumEntries; k++)
+		{
+			if (batch->mEntries[k].mIsOK)
+			{
+				entries[numEntries++] = batch->mEntries[k];
+			}
+			else
+			{
+				free(batch->mEntries[k].mPath);
+			}
+		}
+		
+		scan->mBatches = batch->mNext;
+		free(batch);
+	}
+	
+	qsort(entries, numEntries, sizeof(struct AQScanEntry), AQScanEntry_ComparePaths);
+	
+	*outNumEntries = numEntries;
+	
+	return entries;
+}
+
+static
+bool AQScan_Run(const char * const * paths, UInt32 numPaths, const struct AQScanOptions * options)
+{
+	struct AQScan * scan = new AQScan();
+	struct AQScanBatch * batch = NULL;
+	char * previousText = NULL;
+	UInt64 n;
+	UInt32 k;
+	
+	scan->mOptions = options;
+	scan->mPrevious = NULL;
+	scan->mNumPrevious = 0;
+	scan->mNumPending = 0;
+	scan->mBatches = NULL;
+	scan->mNumScanned = 0;
+	scan->mNumReused = 0;
+	scan->mNumFailed = 0;
+	
+	// Not being able to read it only means scanning everything
+	if (options->mPreviousPath && !(previousText = AQScan_LoadPrevious(scan, options->mPreviousPath)))
+	{
+		fprintf(stderr, "Could not read %s, scanning every file\n", options->mPreviousPath);
+	}
+	
+	Float64 startSeconds = AQScan_Now();
+	
+	scan->mPool = AQThreadPool_Create(options->mNumThreads);
+	
+	for (k = 0; k < numPaths; k++)
+	{
+		struct stat status;
+		
+		if (stat(paths[k], &status) != 0)
+		{
+			fprintf(stderr, "Could not find %s\n", paths[k]);
+			scan->mNumFailed++;
+		}
+		else if (S_ISDIR(status.st_mode))
+		{
+			struct AQScanDirectory * directory = (struct AQScanDirectory *) malloc(sizeof(struct AQScanDirectory));
+			
+			directory->mScan = scan;
+			directory->mPath = strdup(paths[k]);
+			
+			AQScan_Submit(scan, AQScan_WalkDirectory, directory);
+		}
+		else
+		{
+			// Named files are scanned whatever their extension
+			AQScan_AddFile(scan, &batch, strdup(paths[k]), &status);
+		}
+	}
+	
+	if (batch)
+	{
+		AQScan_Submit(scan, AQScan_ScanBatch, batch);
+	}
+	
+	{
+		std::unique_lock<std::mutex> lock(scan->mMutex);
+		
+		while (scan->mNumPending > 0)
+		{
+			scan->mIdle.wait(lock);
+		}
+	}
+	
+	AQThreadPool_Dispose(scan->mPool);
+	
+	Float64 elapsedSeconds = AQScan_Now() - startSeconds;
+	UInt64 numEntries;
+	struct AQScanEntry * entries = AQScan_CollectEntries(scan, &numEntries);
+	FILE * file = options->mOutputPath ? fopen(options->mOutputPath, "wb") : stdout;
+	bool ok = scan->mNumFailed == 0;
+	
+	if (!file || !AQScan_WriteManifest(file, entries, numEntries) || (file != stdout && fclose(file) != 0))
+	{
+		fprintf(stderr, "Could not write %s\n", options->mOutputPath ? options->mOutputPath : "the manifest");
+		ok = false;
+	}
+	
+	fprintf(stderr, "Scanned %llu files (%llu from the previous manifest, %llu failed) in %.3f s\n",
+			(unsigned long long) scan->mNumScanned,
+			(unsigned long long) scan->mNumReused,
+			(unsigned long long) scan->mNumFailed,
+			elapsedSeconds);
+	
+	for (n = 0; n < numEntries; n++)
+	{
+		free(entries[n].mPath);
+	}
+	
+	free(entries);
+	free(scan->mPrevious);
+	free(previousText);
+	delete scan;
+	
+	return ok;
+}
+
+// Options, each of which takes a value
+static const char * const kOptionNames[] = { "--threads", "--measure", "--previous", "--out", "--trace" };
+
+static
+bool AQScan_IsOption(const char arg[])
+{
+	UInt32 k;
+	
+	for (k = 0; k < sizeof(kOptionNames) / sizeof(kOptionNames[0]); k++)
+	{
+		if (strcmp(arg, kOptionNames[k]) == 0)
+		{
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static
+void AQScan_PrintUsage(FILE * file)
+{
+	fprintf(file, "Usage: AQScan [--threads n] [--measure none|peak|loudness] [--previous manifest.tsv] [--out manifest.tsv] [--trace json] [--] dir|file ...\n");
+}
+
+int main(int argc, const char * argv[])
+{
+	struct AQScanOptions options;
+	const char ** paths = (const char **) malloc(argc * sizeof(const char *));
+	bool isOption = true;
+	UInt32 numPaths = 0;
+	int argIndex;
+	
+	memset(&options, 0, sizeof(options));
+	options.mMeasure = kAQScanMeasure_Loudness;
+	
+	// Options go before or after the paths; anything starting with a dash is one, up
+	// to a "--" that ends them
+	for (argIndex = 1; argIndex < argc; argIndex++)
+	{
+		const char * arg = argv[argIndex];
+		
+		if (!isOption || arg[0] != '-' || arg[1] == '\0')
+		{
+			paths[numPaths++] = arg;
+			continue;
+		}
+		
+		if (strcmp(arg, "--") == 0)
+		{
+			isOption = false;
+			continue;
+		}
+		
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+		{
+			AQScan_PrintUsage(stdout);
+			free(paths);
+			return 0;
+		}
+		
+		if (!AQScan_IsOption(arg))
+		{
+			fprintf(stderr, "Unknown option: %s\n", arg);
+			AQScan_PrintUsage(stderr);
+			free(paths);
+			return 1;
+		}
+		
+		if (argIndex + 1 == argc)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg);
+			AQScan_PrintUsage(stderr);
+			free(paths);
+			return 1;
+		}
+		
+		const char * value = argv[++argIndex];
+		
+		if (strcmp(arg, "--threads") == 0)
+		{
+			options.mNumThreads = atoi(value);
+		}
+		else if (strcmp(arg, "--measure") == 0)
+		{
+			if (strcmp(value, "none") == 0)          options.mMeasure = kAQScanMeasure_None;
+			else if (strcmp(value, "peak") == 0)     options.mMeasure = kAQScanMeasure_Peak;
+			else if (strcmp(value, "loudness") == 0) options.mMeasure = kAQScanMeasure_Loudness;
+			else
+			{
+				fprintf(stderr, "Bad measure: %s\n", value);
+				free(paths);
+				return 1;
+			}
+		}
+		else if (strcmp(arg, "--previous") == 0)
+		{
+			options.mPreviousPath = value;
+		}
+		else if (strcmp(arg, "--out") == 0)
+		{
+			options.mOutputPath = value;
+		}
+		else
+		{
+			options.mTracePath = value;
+		}
+	}
+	
+	if (numPaths == 0)
+	{
+		AQScan_PrintUsage(stderr);
+		free(paths);
+		return 1;
+	}
+	
+	if (options.mTracePath)
+	{
+		AQTrace_Enable(kAQTraceDefaultEventsPerThread);
+		AQTrace_SetThreadName("scan");
+	}
+	
+	bool ok = AQScan_Run(paths, numPaths, &options);
+	
+	if (options.mTracePath)
+	{
+		AQTrace_Disable();
+		
+		if (!AQTrace_WriteChromeJSON(options.mTracePath))
+		{
+			fprintf(stderr, "Could not write trace to %s\n", options.mTracePath);
+		}
+	}
+	
+	free(paths);
+	
+	return ok ? 0 : 1;
+}
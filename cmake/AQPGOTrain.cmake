@@ -0,0 +1,58 @@
+# Training workload for profile guided optimization, run by the pgo-train target
+# of an AQ_PGO=GENERATE build:
+#
+#   AQ_PGO_DIR    profile directory, emptied first so that runs do not accumulate
+#   AQ_RENDER     AQRender, the offline render every host has
+#   AQ_PLAYER     PlayingAudioExample where there is AudioToolbox, otherwise empty
+#   AQ_ASSETS     files to train on, |-separated
+#   AQ_PROFDATA   llvm-profdata when building with Clang, otherwise empty
+
+file(REMOVE_RECURSE "${AQ_PGO_DIR}")
+file(MAKE_DIRECTORY "${AQ_PGO_DIR}")
+
+# Arguments of each render, comma separated: the plain fast path, then the settings
+# a player typically runs with
+set(AQ_RENDER_SETTINGS
+	"--channels,2"
+	"--eq,lowshelf:100:0.7:3,--eq,peak:1000:1:-4,--eq,highshelf:8000:0.7:2"
+	"--channels,1,--eq,peak:60:2:6"
+)
+
+string(REPLACE "|" ";" AQ_ASSETS "${AQ_ASSETS}")
+
+foreach(asset IN LISTS AQ_ASSETS)
+	get_filename_component(name "${asset}" NAME)
+	
+	foreach(settings IN LISTS AQ_RENDER_SETTINGS)
+		string(REPLACE "," ";" arguments "${settings}")
+		
+		execute_process(COMMAND "${AQ_RENDER}" ${arguments} "${asset}" RESULT_VARIABLE result)
+		
+		if(NOT result EQUAL 0)
+			message(WARNING "AQRender could not render ${name}, it is left out of the profile")
+			break()
+		endif()
+	endforeach()
+	
+	if(AQ_PLAYER)
+		# Decodes through AudioToolbox and the player's PCM fill path
+		execute_process(COMMAND "${AQ_PLAYER}" --offline-peaks "${AQ_PGO_DIR}/${name}.peaks" "${asset}" RESULT_VARIABLE result)
+		
+		if(NOT result EQUAL 0)
+			message(WARNING "PlayingAudioExample could not render ${name}")
+		endif()
+	endif()
+endforeach()
+
+if(AQ_PROFDATA)
+	file(GLOB raw_profiles "${AQ_PGO_DIR}/*.profraw")
+	
+	execute_process(COMMAND "${AQ_PROFDATA}" merge "-output=${AQ_PGO_DIR}/default.profdata" ${raw_profiles}
+					RESULT_VARIABLE result)
+	
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "llvm-profdata could not merge the profiles")
+	endif()
+endif()
+
+message(STATUS "Profile written to ${AQ_PGO_DIR}")